@@ -0,0 +1,272 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "hydranfc_cmd_sniff_iso14443.h"
+#include "nfc_raw_decode.h"
+
+/*
+ * The functions only read the input buffer and write to their own output,
+ * several chunks of a buffer can be decoded in parallel.
+ */
+
+static inline uint32_t get32(const uint8_t *buf)
+{
+	return buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((uint32_t)buf[3] << 24);
+}
+
+static inline uint32_t timestamps_size(uint8_t options)
+{
+	return ((options & NFC_RAW_OPT_SOF_TIMESTAMP) ? 4 : 0) +
+	       ((options & NFC_RAW_OPT_EOF_TIMESTAMP) ? 4 : 0);
+}
+
+/* Size of the frame at pos if its header is valid, else 0 */
+size_t nfc_raw_frame_size(const uint8_t *buf, size_t len, size_t pos)
+{
+	uint8_t options;
+	uint32_t size;
+
+	if (len - pos < NFC_RAW_HDR_SIZE)
+		return 0;
+
+	options = buf[pos];
+	if (options & ~(NFC_RAW_OPT_SOF_TIMESTAMP | NFC_RAW_OPT_EOF_TIMESTAMP))
+		return 0;
+	if (buf[pos + 1] != NFC_RAW_MODULATION_RAW_848KBPS)
+		return 0;
+
+	/* At least the start bit */
+	size = buf[pos + 2] | (buf[pos + 3] << 8);
+	if (size < NFC_RAW_HDR_SIZE + timestamps_size(options) + 1)
+		return 0;
+
+	return size;
+}
+
+/*
+ * First position from pos starting NFC_RAW_SYNC_FRAMES valid frame headers
+ * with the same options, or fewer running to the end of the buffer.
+ * Returns the position of the last bytes, which may start a header, if
+ * there is none.
+ */
+size_t nfc_raw_sync(const uint8_t *buf, size_t len, size_t pos)
+{
+	size_t next, size;
+	uint32_t i;
+
+	for (; len - pos >= NFC_RAW_HDR_SIZE; pos++) {
+		size = nfc_raw_frame_size(buf, len, pos);
+		if (size == 0)
+			continue;
+
+		next = pos + size;
+		for (i = 1; i < NFC_RAW_SYNC_FRAMES; i++) {
+			if (next >= len || len - next < NFC_RAW_HDR_SIZE)
+				return pos;
+			size = nfc_raw_frame_size(buf, len, next);
+			if (size == 0 || buf[next] != buf[pos])
+				break;
+			next += size;
+		}
+		if (i == NFC_RAW_SYNC_FRAMES)
+			return pos;
+	}
+
+	return pos;
+}
+
+/*
+ * Decodes the etus of a frame of size bytes (header included) to the data
+ * of frame, which shall have room for size / 9 + 1 bytes.
+ * Same decoding as hydranfc_sniff_14443A(): the bits are read from the
+ * second etu (the first one is the start bit), LSB first, the parity bit
+ * of each byte is discarded and an incomplete last byte is kept if it has
+ * at least 4 bits.
+ */
+uint32_t nfc_raw_decode_frame(const uint8_t *raw, uint32_t size, nfc_raw_frame_t *frame)
+{
+	const uint8_t *etu, *end;
+	const uint8_t *bit_table;
+	uint8_t *data;
+	uint32_t rsh, or_mask, nb_bit, i;
+	uint8_t byte;
+
+	frame->options = raw[0];
+	frame->sof_timestamp = 0;
+	frame->eof_timestamp = 0;
+	etu = raw + NFC_RAW_HDR_SIZE;
+	end = raw + size;
+	if (frame->options & NFC_RAW_OPT_SOF_TIMESTAMP) {
+		frame->sof_timestamp = get32(etu);
+		etu += 4;
+	}
+	if (frame->options & NFC_RAW_OPT_EOF_TIMESTAMP) {
+		end -= 4;
+		frame->eof_timestamp = get32(end);
+	}
+
+	rsh = 0;
+	or_mask = 0;
+	switch (detected_protocol[*etu]) {
+	case MILLER_MODIFIED_106KHZ:
+		frame->type = NFC_RAW_A_PCD;
+		bit_table = miller_modified_106kb;
+		break;
+
+	case MANCHESTER_106KHZ:
+		frame->type = NFC_RAW_A_PICC;
+		bit_table = manchester_106kb;
+		break;
+
+	default:
+		/*
+		 * The sniffer resynchronizes these frames 15 samples later,
+		 * which is 4 etu samples here with the start of the etu at 1.
+		 */
+		frame->type = NFC_RAW_A_PCD_NO_SOF;
+		bit_table = miller_modified_106kb;
+		rsh = 4;
+		or_mask = 0xF0;
+		break;
+	}
+	etu++;
+
+	data = NFC_RAW_FRAME_DATA(frame);
+	frame->len = 0;
+
+	/* Bytes with their parity bit */
+	for (; end - etu >= 9; etu += 9) {
+		byte = 0;
+		for (i = 0; i < 8; i++)
+			byte |= bit_table[(etu[i] >> rsh) | or_mask] << i;
+		data[frame->len++] = byte;
+	}
+
+	/* End of frame */
+	nb_bit = end - etu;
+	if (nb_bit > 8)
+		nb_bit = 8;
+	if (nb_bit > 3) {
+		byte = 0;
+		for (i = 0; i < nb_bit; i++)
+			byte |= bit_table[(etu[i] >> rsh) | or_mask] << i;
+		data[frame->len++] = byte;
+	}
+
+	return frame->len;
+}
+
+static bool nfc_raw_out_reserve(nfc_raw_out_t *out, size_t size)
+{
+	uint8_t *buf;
+	size_t new_size;
+
+	if (out->size - out->len >= size)
+		return true;
+
+	new_size = out->size ? out->size : 65536;
+	while (new_size - out->len < size)
+		new_size *= 2;
+	buf = realloc(out->buf, new_size);
+	if (buf == NULL)
+		return false;
+	out->buf = buf;
+	out->size = new_size;
+
+	return true;
+}
+
+/*
+ * Decodes the frames of buf starting from pos up to end, the last frame
+ * may go past end. The stream is first synchronized on the frame headers
+ * if sync is set.
+ * Returns the position following the last decoded frame, an incomplete
+ * frame at the end of buf is not decoded.
+ */
+size_t nfc_raw_decode_chunk(const uint8_t *buf, size_t len, size_t pos, size_t end,
+			    bool sync, nfc_raw_out_t *out)
+{
+	nfc_raw_frame_t *frame;
+	size_t size, next;
+
+	if (sync) {
+		next = nfc_raw_sync(buf, len, pos);
+		out->skipped += next - pos;
+		pos = next;
+	}
+
+	while (pos < end && len - pos >= NFC_RAW_HDR_SIZE) {
+		size = nfc_raw_frame_size(buf, len, pos);
+		if (size == 0) {
+			next = nfc_raw_sync(buf, len, pos + 1);
+			out->skipped += next - pos;
+			pos = next;
+			continue;
+		}
+		if (size > len - pos)
+			break;
+
+		if (!nfc_raw_out_reserve(out, nfc_raw_frame_record_size(size / 9 + 1)))
+			break;
+		frame = (nfc_raw_frame_t *)(out->buf + out->len);
+		frame->offset = pos;
+		nfc_raw_decode_frame(buf + pos, size, frame);
+		out->len += nfc_raw_frame_record_size(frame->len);
+		out->frames++;
+
+		pos += size;
+	}
+
+	return pos;
+}
+
+void nfc_raw_out_init(nfc_raw_out_t *out)
+{
+	out->buf = NULL;
+	out->size = 0;
+	nfc_raw_out_reset(out);
+}
+
+void nfc_raw_out_reset(nfc_raw_out_t *out)
+{
+	out->len = 0;
+	out->frames = 0;
+	out->skipped = 0;
+}
+
+void nfc_raw_out_free(nfc_raw_out_t *out)
+{
+	free(out->buf);
+	nfc_raw_out_init(out);
+}
+
+/*
+ * Type of a frame knowing the type of the previous one, as the sniffer
+ * does: a frame without recognized start bit following a PICC frame is a
+ * PCD one.
+ */
+nfc_raw_type_t nfc_raw_frame_type(const nfc_raw_frame_t *frame, nfc_raw_type_t prev)
+{
+	if (frame->type != NFC_RAW_A_PCD_NO_SOF)
+		return frame->type;
+
+	return (prev == NFC_RAW_A_PICC) ? NFC_RAW_A_PCD : NFC_RAW_UNKNOWN;
+}
@@ -0,0 +1,104 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _NFC_RAW_DECODE_H_
+#define _NFC_RAW_DECODE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Decoder of the HydraNFC raw sniffer output (hydranfc_sniff_14443AB_bin_raw()
+ * in src/hydranfc/hydranfc_cmd_sniff.c), sent on UART1 at 8.4Mbaud.
+ *
+ * Each frame is:
+ *  - sniff_14443a_bin_frame_header_t: options, modulation (3, RAW_848KBPS),
+ *    data_size (little endian, whole frame including this header)
+ *  - start of frame timestamp (32 bits, 168MHz cycles) if options bit 3
+ *  - one byte per etu: the 32 samples at 3.39MHz downsampled by 4, the
+ *    first byte starts on the first edge of the frame (start bit)
+ *  - end of frame timestamp (32 bits, 168MHz cycles) if options bit 4
+ *
+ * The decoding of the bytes is the one of hydranfc_sniff_14443A(), with
+ * the same tables.
+ */
+
+#define NFC_RAW_HDR_SIZE		(4)
+#define NFC_RAW_OPT_SOF_TIMESTAMP	(1 << 3)
+#define NFC_RAW_OPT_EOF_TIMESTAMP	(1 << 4)
+#define NFC_RAW_MODULATION_RAW_848KBPS	(3)
+
+/* Consecutive frame headers needed to synchronize on the stream */
+#define NFC_RAW_SYNC_FRAMES		(4)
+
+/* Room left before the decoded bytes for the pcap data header */
+#define NFC_RAW_DATA_HEADER_SIZE	(8)
+
+typedef enum {
+	NFC_RAW_UNKNOWN = 0,
+	NFC_RAW_A_PCD, /* Miller Modified start bit */
+	NFC_RAW_A_PICC, /* Manchester start bit */
+	/*
+	 * Start bit not recognized, decoded as Miller Modified. This is a PCD
+	 * frame if the previous frame was a PICC one, see nfc_raw_frame_type().
+	 */
+	NFC_RAW_A_PCD_NO_SOF,
+} nfc_raw_type_t;
+
+/* Decoded frame, followed by the data header room and len bytes */
+typedef struct {
+	uint64_t offset; /* Offset of the raw frame in its buffer */
+	uint32_t sof_timestamp;
+	uint32_t eof_timestamp;
+	uint16_t len;
+	uint8_t options;
+	uint8_t type; /* nfc_raw_type_t */
+} nfc_raw_frame_t;
+
+/* Decoded frames of a chunk of the stream */
+typedef struct {
+	uint8_t *buf;
+	size_t len;
+	size_t size;
+	uint64_t frames;
+	uint64_t skipped; /* Bytes skipped to find a frame header */
+} nfc_raw_out_t;
+
+#define NFC_RAW_FRAME_DATA(f)	((uint8_t *)((f) + 1) + NFC_RAW_DATA_HEADER_SIZE)
+#define NFC_RAW_FRAME_NEXT(f) \
+	((nfc_raw_frame_t *)((uint8_t *)(f) + nfc_raw_frame_record_size((f)->len)))
+
+static inline size_t nfc_raw_frame_record_size(uint32_t len)
+{
+	return (sizeof(nfc_raw_frame_t) + NFC_RAW_DATA_HEADER_SIZE + len + 7) & ~(size_t)7;
+}
+
+size_t nfc_raw_frame_size(const uint8_t *buf, size_t len, size_t pos);
+size_t nfc_raw_sync(const uint8_t *buf, size_t len, size_t pos);
+uint32_t nfc_raw_decode_frame(const uint8_t *raw, uint32_t size, nfc_raw_frame_t *frame);
+size_t nfc_raw_decode_chunk(const uint8_t *buf, size_t len, size_t pos, size_t end,
+			    bool sync, nfc_raw_out_t *out);
+
+void nfc_raw_out_init(nfc_raw_out_t *out);
+void nfc_raw_out_reset(nfc_raw_out_t *out);
+void nfc_raw_out_free(nfc_raw_out_t *out);
+
+nfc_raw_type_t nfc_raw_frame_type(const nfc_raw_frame_t *frame, nfc_raw_type_t prev);
+
+#endif /* _NFC_RAW_DECODE_H_ */
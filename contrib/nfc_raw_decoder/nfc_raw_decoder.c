@@ -0,0 +1,664 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * HydraNFC raw sniffer (sniff bin raw) decoder: decodes the ISO14443A
+ * frames of a capture to a pcapng file, the chunks of the capture are
+ * decoded in parallel.
+ *
+ * nfc_raw_decoder [-j threads] [-o out.pcapng] [capture.bin|-]
+ * nfc_raw_decoder gen [-s MB] [-t] out.bin
+ * nfc_raw_decoder bench [-j threads] [-s MB] [-t]
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "crc32.h"
+#include "hydranfc_cmd_sniff_iso14443.h"
+#include "pcapng.h"
+#include "nfc_raw_decode.h"
+
+/* Size of the input decoded by each thread at once */
+#define CHUNK_SIZE		(16 * 1024 * 1024)
+/* Smaller inputs are not split */
+#define CHUNK_SIZE_MIN		(64 * 1024)
+/* Largest frame, data_size is 16 bits */
+#define FRAME_SIZE_MAX		(65535)
+
+#define PCAP_BUF_SIZE		(1024 * 1024)
+#define CYCLES_FREQ		(168000000)
+
+/* Raw stream data rate: one byte per etu (106kbps) */
+#define RAW_RATE		(13560000.0 / 128)
+/* UART1 at 8.4Mbaud, 8N1 */
+#define UART_RATE		(8400000.0 / 10)
+
+typedef struct {
+	const uint8_t *buf;
+	size_t len;
+	size_t start;
+	size_t end;
+	size_t first; /* First frame found from start */
+	size_t next; /* Frame following the last decoded one */
+	nfc_raw_out_t out;
+	pthread_t thread;
+} worker_t;
+
+typedef struct {
+	int nb_threads;
+	worker_t *workers;
+	pcapng_writer_t *pcap;
+	/* Sequential state, kept between the chunks */
+	nfc_raw_type_t prev_type;
+	bool has_timestamp;
+	uint32_t last_timestamp;
+	uint64_t timestamp;
+	uint32_t crc;
+	uint64_t frames[NFC_RAW_A_PCD_NO_SOF];
+	uint64_t skipped;
+	uint64_t resync;
+} decoder_t;
+
+static void *worker_run(void *arg)
+{
+	worker_t *w = arg;
+
+	if (w->start == 0) {
+		w->first = 0;
+		w->next = nfc_raw_decode_chunk(w->buf, w->len, 0, w->end, true, &w->out);
+	} else {
+		/* Bytes before the first frame belong to the previous chunk */
+		w->first = nfc_raw_sync(w->buf, w->len, w->start);
+		w->next = nfc_raw_decode_chunk(w->buf, w->len, w->first, w->end, false, &w->out);
+	}
+
+	return NULL;
+}
+
+static int decoder_init(decoder_t *d, int nb_threads, pcapng_writer_t *pcap)
+{
+	int i;
+
+	memset(d, 0, sizeof(*d));
+	d->nb_threads = nb_threads;
+	d->pcap = pcap;
+	d->prev_type = NFC_RAW_UNKNOWN;
+	d->crc = CRC32_INIT;
+	d->workers = calloc(nb_threads, sizeof(worker_t));
+	if (d->workers == NULL)
+		return -1;
+	for (i = 0; i < nb_threads; i++)
+		nfc_raw_out_init(&d->workers[i].out);
+
+	return 0;
+}
+
+static void decoder_free(decoder_t *d)
+{
+	int i;
+
+	for (i = 0; i < d->nb_threads; i++)
+		nfc_raw_out_free(&d->workers[i].out);
+	free(d->workers);
+}
+
+/* Same 8 bytes header as the sniffer PCAP output, see sniff_write_data_header() */
+static void write_data_header(uint8_t *hdr, nfc_raw_type_t type, uint32_t eof_timestamp)
+{
+	hdr[0] = 0x7F;
+	hdr[1] = (type == NFC_RAW_A_PCD) ? 0xb0 : (type == NFC_RAW_A_PICC) ? 0xb1 : 0xb2;
+	hdr[2] = 0xc0;
+	hdr[3] = eof_timestamp >> 24;
+	hdr[4] = eof_timestamp >> 16;
+	hdr[5] = eof_timestamp >> 8;
+	hdr[6] = eof_timestamp;
+	hdr[7] = 0xd0;
+}
+
+/* Sequential part: frame types, timestamps and output, in stream order */
+static void decoder_output(decoder_t *d, nfc_raw_out_t *out)
+{
+	nfc_raw_frame_t *frame, *end;
+	nfc_raw_type_t type;
+	uint32_t ts;
+	uint8_t *data;
+	uint8_t type_u8;
+
+	end = (nfc_raw_frame_t *)(out->buf + out->len);
+	for (frame = (nfc_raw_frame_t *)out->buf; frame < end; frame = NFC_RAW_FRAME_NEXT(frame)) {
+		type = nfc_raw_frame_type(frame, d->prev_type);
+		d->prev_type = type;
+		d->frames[type]++;
+
+		/* 32 bits cycle counter, wraps every 25s */
+		if (frame->options & (NFC_RAW_OPT_SOF_TIMESTAMP | NFC_RAW_OPT_EOF_TIMESTAMP)) {
+			ts = (frame->options & NFC_RAW_OPT_SOF_TIMESTAMP) ?
+			     frame->sof_timestamp : frame->eof_timestamp;
+			if (d->has_timestamp)
+				d->timestamp += (uint32_t)(ts - d->last_timestamp);
+			else
+				d->timestamp = ts;
+			d->has_timestamp = true;
+			d->last_timestamp = ts;
+		}
+
+		data = NFC_RAW_FRAME_DATA(frame);
+		type_u8 = type;
+		d->crc = crc32_update(d->crc, &type_u8, 1);
+		d->crc = crc32_update(d->crc, data, frame->len);
+
+		if (d->pcap) {
+			data -= NFC_RAW_DATA_HEADER_SIZE;
+			write_data_header(data, type, frame->eof_timestamp);
+			pcapng_writer_packet(d->pcap, PCAPNG_LINK_ISO14443A, d->timestamp,
+					     data, NFC_RAW_DATA_HEADER_SIZE + frame->len);
+		}
+	}
+	d->skipped += out->skipped;
+}
+
+/*
+ * Decodes the complete frames of buf, returns the position of the first
+ * frame not decoded (incomplete), to give again with the following data.
+ * The chunks are decoded in parallel from the first frame header found
+ * after their start, then stitched: each chunk shall start where the
+ * previous one ended, else it is decoded again from there.
+ */
+static size_t decoder_run(decoder_t *d, const uint8_t *buf, size_t len)
+{
+	worker_t *w;
+	size_t pos;
+	int i, n;
+
+	n = d->nb_threads;
+	if (len / n < CHUNK_SIZE_MIN)
+		n = (len / CHUNK_SIZE_MIN) ? (int)(len / CHUNK_SIZE_MIN) : 1;
+
+	for (i = 0; i < n; i++) {
+		w = &d->workers[i];
+		w->buf = buf;
+		w->len = len;
+		w->start = len / n * i;
+		w->end = (i == n - 1) ? len : len / n * (i + 1);
+		nfc_raw_out_reset(&w->out);
+		if (i > 0 && pthread_create(&w->thread, NULL, worker_run, w) != 0)
+			worker_run(w);
+	}
+	worker_run(&d->workers[0]);
+	for (i = 1; i < n; i++)
+		pthread_join(d->workers[i].thread, NULL);
+
+	pos = d->workers[0].next;
+	decoder_output(d, &d->workers[0].out);
+	for (i = 1; i < n; i++) {
+		w = &d->workers[i];
+		if (w->first != pos) {
+			d->resync++;
+			nfc_raw_out_reset(&w->out);
+			w->next = nfc_raw_decode_chunk(buf, len, pos, w->end, false, &w->out);
+		}
+		pos = w->next;
+		decoder_output(d, &w->out);
+	}
+
+	return pos;
+}
+
+static int nb_cpus(void)
+{
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return (n > 0) ? (int)n : 1;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static bool file_write(void *ctx, const uint8_t *data, uint32_t len)
+{
+	return fwrite(data, 1, len, ctx) == len;
+}
+
+static void print_stats(decoder_t *d, uint64_t bytes, double duration)
+{
+	fprintf(stderr, "%llu bytes, %llu A PCD, %llu A PICC, %llu unknown frames, "
+		"%llu bytes skipped, %llu chunks resynchronized\n",
+		(unsigned long long)bytes,
+		(unsigned long long)d->frames[NFC_RAW_A_PCD],
+		(unsigned long long)d->frames[NFC_RAW_A_PICC],
+		(unsigned long long)d->frames[NFC_RAW_UNKNOWN],
+		(unsigned long long)d->skipped,
+		(unsigned long long)d->resync);
+	if (duration > 0)
+		fprintf(stderr, "%.3fs, %.1f MB/s, %.0fx real time, %.0fx UART rate\n",
+			duration, bytes / duration / 1e6,
+			bytes / duration / RAW_RATE, bytes / duration / UART_RATE);
+}
+
+/* True if more input can be read without waiting */
+static bool input_ready(int fd)
+{
+	struct pollfd pfd;
+
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	return (poll(&pfd, 1, 0) > 0);
+}
+
+/*
+ * Reads the capture by blocks of nb_threads chunks. The data read so far
+ * is decoded when the input has to be waited for (UART device, pipe), so
+ * the output follows the capture.
+ */
+static int cmd_decode(int nb_threads, const char *in_name, const char *out_name)
+{
+	decoder_t d;
+	pcapng_writer_t pcap;
+	uint8_t *buf, *pcap_buf;
+	size_t size, len, pos;
+	uint64_t total;
+	ssize_t n;
+	FILE *out;
+	double start;
+	int fd, ret;
+
+	fd = (strcmp(in_name, "-") == 0) ? STDIN_FILENO : open(in_name, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "%s: %s\n", in_name, strerror(errno));
+		return 1;
+	}
+	out = (strcmp(out_name, "-") == 0) ? stdout : fopen(out_name, "wb");
+	if (out == NULL) {
+		fprintf(stderr, "%s: %s\n", out_name, strerror(errno));
+		return 1;
+	}
+
+	size = (size_t)nb_threads * CHUNK_SIZE + FRAME_SIZE_MAX;
+	buf = malloc(size);
+	pcap_buf = malloc(PCAP_BUF_SIZE);
+	if (buf == NULL || pcap_buf == NULL || decoder_init(&d, nb_threads, &pcap) < 0) {
+		fprintf(stderr, "Out of memory\n");
+		return 1;
+	}
+	pcapng_writer_init(&pcap, pcap_buf, PCAP_BUF_SIZE, file_write, out, CYCLES_FREQ);
+
+	ret = 0;
+	len = 0;
+	total = 0;
+	start = now();
+	while (1) {
+		n = read(fd, buf + len, size - len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0) {
+			fprintf(stderr, "%s: %s\n", in_name, strerror(errno));
+			ret = 1;
+			break;
+		}
+		if (n == 0)
+			break;
+		len += n;
+		total += n;
+		if (len < size && input_ready(fd))
+			continue;
+
+		pos = decoder_run(&d, buf, len);
+		memmove(buf, buf + pos, len - pos);
+		len -= pos;
+		pcapng_writer_flush(&pcap);
+		fflush(out);
+	}
+	if (len > 0) {
+		pos = decoder_run(&d, buf, len);
+		/* Incomplete frame at the end of the capture */
+		d.skipped += len - pos;
+	}
+	if (!pcapng_writer_flush(&pcap) || fflush(out) != 0) {
+		fprintf(stderr, "%s: write error\n", out_name);
+		ret = 1;
+	}
+
+	print_stats(&d, total, now() - start);
+
+	decoder_free(&d);
+	free(pcap_buf);
+	free(buf);
+	if (out != stdout)
+		fclose(out);
+	if (fd != STDIN_FILENO)
+		close(fd);
+
+	return ret;
+}
+
+/*
+ * Synthetic capture: PCD and PICC frames with random data, encoded with
+ * the first byte of the tables giving each bit, and some garbage.
+ */
+typedef struct {
+	uint8_t options;
+	uint32_t seed;
+	uint32_t timestamp;
+	uint8_t start[NFC_RAW_A_PCD_NO_SOF + 1];
+	uint8_t bit[NFC_RAW_A_PCD_NO_SOF + 1][2];
+	uint8_t idle;
+	uint32_t crc;
+	uint64_t frames;
+	uint64_t garbage;
+	uint32_t frames_ok; /* Frames since the last garbage */
+	nfc_raw_type_t prev_type;
+} gen_t;
+
+static void put32(uint8_t *buf, uint32_t val)
+{
+	buf[0] = val;
+	buf[1] = val >> 8;
+	buf[2] = val >> 16;
+	buf[3] = val >> 24;
+}
+
+static uint32_t gen_rand(gen_t *g)
+{
+	g->seed = g->seed * 1103515245 + 12345;
+	return g->seed >> 8;
+}
+
+static void gen_init(gen_t *g, bool timestamps)
+{
+	int i;
+
+	memset(g, 0, sizeof(*g));
+	g->options = timestamps ? (NFC_RAW_OPT_SOF_TIMESTAMP | NFC_RAW_OPT_EOF_TIMESTAMP) : 0;
+	g->seed = 1;
+	g->crc = CRC32_INIT;
+	g->prev_type = NFC_RAW_UNKNOWN;
+
+	for (i = 255; i >= 0; i--) {
+		if (detected_protocol[i] == MILLER_MODIFIED_106KHZ)
+			g->start[NFC_RAW_A_PCD] = i;
+		else if (detected_protocol[i] == MANCHESTER_106KHZ)
+			g->start[NFC_RAW_A_PICC] = i;
+		else
+			g->start[NFC_RAW_A_PCD_NO_SOF] = i;
+		g->bit[NFC_RAW_A_PCD][miller_modified_106kb[i]] = i;
+		g->bit[NFC_RAW_A_PICC][manchester_106kb[i]] = i;
+		g->bit[NFC_RAW_A_PCD_NO_SOF][miller_modified_106kb[0xF0 | (i >> 4)]] = i;
+	}
+	g->idle = 0xFF;
+}
+
+static uint32_t gen_frame(gen_t *g, uint8_t *buf)
+{
+	nfc_raw_type_t type, out_type;
+	uint8_t data[64];
+	uint32_t i, j, len, pos;
+	uint8_t type_u8;
+
+	type = (g->prev_type == NFC_RAW_A_PICC) ?
+	       ((gen_rand(g) & 1) ? NFC_RAW_A_PCD : NFC_RAW_A_PCD_NO_SOF) :
+	       NFC_RAW_A_PICC;
+	len = 1 + gen_rand(g) % sizeof(data);
+	for (i = 0; i < len; i++)
+		data[i] = gen_rand(g);
+
+	buf[0] = g->options;
+	buf[1] = NFC_RAW_MODULATION_RAW_848KBPS;
+	pos = NFC_RAW_HDR_SIZE;
+	g->timestamp += 10000 + gen_rand(g) % 100000;
+	if (g->options & NFC_RAW_OPT_SOF_TIMESTAMP) {
+		put32(buf + pos, g->timestamp);
+		pos += 4;
+	}
+	buf[pos++] = g->start[type];
+	for (i = 0; i < len; i++) {
+		for (j = 0; j < 8; j++)
+			buf[pos++] = g->bit[type][(data[i] >> j) & 1];
+		/* Parity */
+		buf[pos++] = g->bit[type][1];
+	}
+	/* Idle etus before the end of frame detection */
+	buf[pos++] = g->idle;
+	buf[pos++] = g->idle;
+	g->timestamp += len * 9 * 1586;
+	if (g->options & NFC_RAW_OPT_EOF_TIMESTAMP) {
+		put32(buf + pos, g->timestamp);
+		pos += 4;
+	}
+	buf[2] = pos;
+	buf[3] = pos >> 8;
+
+	out_type = (type == NFC_RAW_A_PCD_NO_SOF) ? NFC_RAW_A_PCD : type;
+	type_u8 = out_type;
+	g->crc = crc32_update(g->crc, &type_u8, 1);
+	g->crc = crc32_update(g->crc, data, len);
+	g->prev_type = out_type;
+	g->frames++;
+
+	return pos;
+}
+
+/* Some bytes which can not start a frame header */
+static uint32_t gen_garbage(gen_t *g, uint8_t *buf)
+{
+	uint32_t i, len;
+
+	len = 1 + gen_rand(g) % 64;
+	for (i = 0; i < len; i++)
+		buf[i] = 0x80 | gen_rand(g);
+	g->garbage += len;
+
+	return len;
+}
+
+static size_t gen_capture(gen_t *g, uint8_t *buf, size_t size)
+{
+	size_t len = 0;
+
+	while (size - len >= FRAME_SIZE_MAX) {
+		/* Frames closer to garbage than NFC_RAW_SYNC_FRAMES are lost */
+		if (gen_rand(g) % 1000 == 0 && g->frames_ok >= NFC_RAW_SYNC_FRAMES) {
+			len += gen_garbage(g, buf + len);
+			g->frames_ok = 0;
+		}
+		len += gen_frame(g, buf + len);
+		g->frames_ok++;
+	}
+
+	return len;
+}
+
+static int cmd_gen(size_t size, bool timestamps, const char *out_name)
+{
+	gen_t g;
+	uint8_t *buf;
+	size_t len, total;
+	FILE *out;
+
+	out = fopen(out_name, "wb");
+	buf = malloc(CHUNK_SIZE);
+	if (out == NULL || buf == NULL) {
+		fprintf(stderr, "%s: %s\n", out_name, strerror(errno));
+		return 1;
+	}
+
+	gen_init(&g, timestamps);
+	for (total = 0; total < size; total += len) {
+		len = gen_capture(&g, buf, (size - total < CHUNK_SIZE) ?
+				  size - total + FRAME_SIZE_MAX : CHUNK_SIZE);
+		if (fwrite(buf, 1, len, out) != len) {
+			fprintf(stderr, "%s: write error\n", out_name);
+			return 1;
+		}
+	}
+	fclose(out);
+	free(buf);
+
+	fprintf(stderr, "%zu bytes, %llu frames, %llu garbage bytes, crc %08x\n",
+		total, (unsigned long long)g.frames, (unsigned long long)g.garbage, g.crc);
+
+	return 0;
+}
+
+/* Decodes a synthetic capture in memory with 1 to nb_threads threads */
+static int cmd_bench(int nb_threads, size_t size, bool timestamps)
+{
+	decoder_t d;
+	gen_t g;
+	uint8_t *buf;
+	size_t len, pos, block, n;
+	double start;
+	int threads, next, ret;
+
+	buf = malloc(size + FRAME_SIZE_MAX);
+	if (buf == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		return 1;
+	}
+	gen_init(&g, timestamps);
+	len = gen_capture(&g, buf, size + FRAME_SIZE_MAX);
+	fprintf(stderr, "Synthetic capture: %zu bytes, %llu frames, %llu garbage bytes\n",
+		len, (unsigned long long)g.frames, (unsigned long long)g.garbage);
+
+	ret = 0;
+	for (threads = 1; threads <= nb_threads; threads = next) {
+		if (decoder_init(&d, threads, NULL) < 0) {
+			fprintf(stderr, "Out of memory\n");
+			return 1;
+		}
+		block = (size_t)threads * CHUNK_SIZE;
+		start = now();
+		for (pos = 0; pos < len; pos += n) {
+			n = decoder_run(&d, buf + pos, (len - pos < block) ? len - pos : block);
+			if (n == 0)
+				break;
+		}
+
+		fprintf(stderr, "%d thread(s): ", threads);
+		print_stats(&d, len, now() - start);
+		if (d.crc != g.crc || d.skipped != g.garbage) {
+			fprintf(stderr, "Decoded frames do not match (crc %08x/%08x)\n",
+				d.crc, g.crc);
+			ret = 1;
+		}
+		decoder_free(&d);
+
+		next = threads * 2;
+		if (threads < nb_threads && next > nb_threads)
+			next = nb_threads;
+	}
+	free(buf);
+
+	return ret;
+}
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"Usage:\n"
+		"  nfc_raw_decoder [-j threads] [-o out.pcapng] [capture.bin|-]\n"
+		"  nfc_raw_decoder gen [-s MB] [-t] out.bin\n"
+		"  nfc_raw_decoder bench [-j threads] [-s MB] [-t]\n"
+		"Options:\n"
+		"  -j  number of decoding threads (default: number of CPUs)\n"
+		"  -o  pcapng output (default: capture name with .pcapng, - for stdout)\n"
+		"  -s  size of the synthetic capture in MB (default: 1024)\n"
+		"  -t  synthetic frames with start/end of frame timestamps\n");
+}
+
+int main(int argc, char **argv)
+{
+	const char *cmd = "decode";
+	const char *in_name = "-";
+	char *out_name = NULL;
+	size_t size = 1024;
+	bool timestamps = false;
+	int nb_threads = nb_cpus();
+	int opt, ret;
+
+	if (argc > 1 && (strcmp(argv[1], "gen") == 0 || strcmp(argv[1], "bench") == 0)) {
+		cmd = argv[1];
+		argc--;
+		argv++;
+	}
+
+	while ((opt = getopt(argc, argv, "j:o:s:th")) != -1) {
+		switch (opt) {
+		case 'j':
+			nb_threads = atoi(optarg);
+			break;
+		case 'o':
+			out_name = optarg;
+			break;
+		case 's':
+			size = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			timestamps = true;
+			break;
+		default:
+			usage();
+			return 1;
+		}
+	}
+	if (nb_threads < 1 || size == 0) {
+		usage();
+		return 1;
+	}
+	if (optind < argc)
+		in_name = argv[optind];
+	size *= 1024 * 1024;
+
+	if (strcmp(cmd, "bench") == 0)
+		return cmd_bench(nb_threads, size, timestamps);
+
+	if (strcmp(cmd, "gen") == 0) {
+		if (optind >= argc) {
+			usage();
+			return 1;
+		}
+		return cmd_gen(size, timestamps, in_name);
+	}
+
+	if (out_name == NULL) {
+		if (strcmp(in_name, "-") == 0) {
+			out_name = "-";
+		} else {
+			out_name = malloc(strlen(in_name) + sizeof(".pcapng"));
+			if (out_name == NULL)
+				return 1;
+			strcpy(out_name, in_name);
+			strcat(out_name, ".pcapng");
+		}
+	}
+	ret = cmd_decode(nb_threads, in_name, out_name);
+
+	return ret;
+}
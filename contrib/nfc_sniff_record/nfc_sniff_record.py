@@ -0,0 +1,122 @@
+#!/usr/bin/python3
+#
+# Converts the binary records saved by the HydraNFC sniffer ("sniff record"
+# option, nfc_sniff_<n>.bin files) to the text format of the sniffer or to
+# a PCAP file.
+#
+# Record format is described in src/hydranfc/hydranfc_sniff_record.h
+#
+# Author: HydraBus team
+# License: Apache License, Version 2.0
+#
+import struct
+import sys
+
+RECORD_MAGIC = b"HNFR"
+RECORD_VERSION = 1
+FILE_HDR_SIZE = 8
+RECORD_HDR_SIZE = 16
+
+RECORD_PCD = 1
+RECORD_PICC = 2
+RECORD_UNKNOWN = 3
+
+FLAG_PARITY = 1 << 0
+FLAG_DURATION = 1 << 1
+
+CPU_FREQ = 168000000
+# Same epoch as the sniffer PCAP output: 05/21/2015 00:00:00
+PCAP_EPOCH = 0x555d03e0
+PCAP_LINKTYPE = 0x93
+PCAP_POWER = 0x7f
+
+
+def print_usage():
+    print("Usage:")
+    print("\tnfc_sniff_record.py text <record_file> [<output_file>]")
+    print("\t\tConverts records to the text format of the sniffer.")
+    print("\tnfc_sniff_record.py pcap <record_file> <output_file>")
+    print("\t\tConverts records to a PCAP file.")
+    quit()
+
+
+def read_records(data):
+    """Yields (type, flags, timestamp, duration, sample, payload, parity)"""
+    if len(data) < FILE_HDR_SIZE or data[0:4] != RECORD_MAGIC:
+        raise ValueError("not a HydraNFC record file")
+    if data[4] != RECORD_VERSION:
+        raise ValueError("unsupported record version %d" % data[4])
+
+    pos = FILE_HDR_SIZE
+    while pos + RECORD_HDR_SIZE <= len(data):
+        rtype, flags, length, timestamp, duration, sample = \
+            struct.unpack_from("<BBHIIB", data, pos)
+        if rtype == 0:
+            # Zero filled tail of a truncated capture
+            break
+        pos += RECORD_HDR_SIZE
+        payload = data[pos:pos + length]
+        pos += length
+        parity = None
+        if flags & FLAG_PARITY:
+            nb = (length + 7) // 8
+            bits = data[pos:pos + nb]
+            parity = [(bits[n // 8] >> (n % 8)) & 1 for n in range(length)]
+            pos += nb
+        pos = (pos + 3) & ~3
+        if len(payload) != length:
+            break
+        yield rtype, flags, timestamp, duration, sample, payload, parity
+
+
+def to_text(records, out):
+    for rtype, flags, timestamp, duration, sample, payload, parity in records:
+        out.write("\r\n%08x\t" % timestamp)
+        if rtype == RECORD_PCD:
+            out.write("RDR\t")
+        elif rtype == RECORD_PICC:
+            out.write("TAG\t")
+        else:
+            out.write("U%02x\t" % sample)
+        out.write("".join("%02x " % b for b in payload))
+        if flags & FLAG_DURATION:
+            out.write("\t%08x" % duration)
+
+
+def to_pcap(records, out):
+    out.write(struct.pack(">IHHiIII", 0xa1b23c4d, 2, 4, 0, 0, 0xffff,
+                          PCAP_LINKTYPE))
+    for rtype, flags, timestamp, duration, sample, payload, parity in records:
+        second = PCAP_EPOCH + timestamp // CPU_FREQ
+        nsecond = (timestamp % CPU_FREQ) // 168 * 1000
+        size = len(payload) + 8
+        out.write(struct.pack(">IIII", second, nsecond, size, size))
+        norm = {RECORD_PCD: 0xb0, RECORD_PICC: 0xb1}.get(rtype, 0xb2)
+        end = (timestamp + duration) & 0xffffffff
+        out.write(struct.pack(">BBBIB", PCAP_POWER, norm, 0xc0, end, 0xd0))
+        out.write(payload)
+
+
+def main():
+    if len(sys.argv) < 3:
+        print_usage()
+
+    with open(sys.argv[2], "rb") as f:
+        data = f.read()
+
+    if sys.argv[1] == "text":
+        if len(sys.argv) > 3:
+            with open(sys.argv[3], "w", newline="") as out:
+                to_text(read_records(data), out)
+        else:
+            to_text(read_records(data), sys.stdout)
+            print()
+    elif sys.argv[1] == "pcap" and len(sys.argv) > 3:
+        with open(sys.argv[3], "wb") as out:
+            to_pcap(read_records(data), out)
+    else:
+        print_usage()
+
+
+if __name__ == "__main__":
+    main()
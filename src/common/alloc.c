@@ -22,91 +22,158 @@
 /* Taken from linux kernel */
 #define DIV_ROUND_UP(n, d) (((n) + (d) - 1) / (d))
 
+#define POOL_ORDER_NONE 0xff
+
 static uint8_t pool_buf[POOL_BUFFER_SIZE];
-static pool_t ram_pool;
+static uint8_t pool_ccm_buf[POOL_CCM_BUFFER_SIZE] __attribute__ ((section(".ram4")));
+static pool_t pools[POOL_END];
+
+/* First block of each aligned run of 1 << order blocks within a word */
+static const uint32_t pool_align_mask[] = {
+	0xffffffff, 0x55555555, 0x11111111, 0x01010101, 0x00010001, 0x00000001
+};
+
+static void pool_setup(pool_t * p, uint8_t * buf, uint32_t num_blocks)
+{
+	uint32_t i;
+
+	p->pool = buf;
+	p->pool_size = num_blocks;
+	p->blocks_used = 0;
+	p->blocks_max = 0;
+
+	for(i=0; i<POOL_BITMAP_WORDS; i++) {
+		p->used[i] = 0;
+	}
+	for(i=0; i<POOL_BLOCK_NUMBER; i++) {
+		p->order[i] = POOL_ORDER_NONE;
+		p->tag[i] = 0;
+	}
+}
 
 /**
   * @brief  Init pool allocator
   * @retval None
   */
 /*
- * This function initiates the pool allocator.
- * The number of blocks must be lower than 256
+ * This function initiates the main and CCM pools.
+ * The number of blocks of each pool must be a multiple of 32.
 */
 void pool_init(void)
 {
-	uint32_t i;
+	pool_setup(&pools[POOL_RAM], pool_buf, POOL_BLOCK_NUMBER);
+	pool_setup(&pools[POOL_CCM], pool_ccm_buf, POOL_CCM_BLOCK_NUMBER);
+}
 
-	ram_pool.pool_size = POOL_BLOCK_NUMBER;
-	ram_pool.block_size = POOL_BLOCK_SIZE;
-	ram_pool.blocks_used = 0;
-	ram_pool.pool = pool_buf;
-	
-	for(i=0; i<sizeof(ram_pool.blocks); i++) {
-		ram_pool.blocks[i] = 0;
+/* Smallest order so that 1 << order >= num_blocks */
+static uint32_t pool_order(uint32_t num_blocks)
+{
+	if(num_blocks <= 1) {
+		return 0;
 	}
+	return 32 - __builtin_clz(num_blocks - 1);
 }
 
-/**
-  * @brief Allocates a number of contiguous blocks
-  * @param  num_blocks: number of contiguous blocks to allocate
-  * @retval Pointer to the starting buffer, 0 if requested size is not available
-  */
 /*
- * This function tries to allocate contiguous blocks by looking at the free
- * blocks list.
- * If found, it will mark the blocks as used (number of allocated blocks).
+ * Returns the first block of a free run of 1 << order blocks aligned on its
+ * size, or -1 if there is none.
+ * Runs up to 32 blocks are found with a few shift and mask operations per
+ * bitmap word, larger ones are made of whole free words.
 */
-void * pool_alloc_blocks(uint8_t num_blocks)
+static int pool_find(pool_t * p, uint32_t order)
 {
-	uint32_t i,j;
-	uint8_t space_found;
+	uint32_t nb_words = p->pool_size / 32;
+	uint32_t w, s, words, free;
 
+	if(order <= 5) {
+		for(w=0; w<nb_words; w++) {
+			free = ~p->used[w];
+			for(s=1; s<(1UL << order); s<<=1) {
+				free &= free >> s;
+			}
+			free &= pool_align_mask[order];
+			if(free != 0) {
+				return w*32 + __builtin_ctz(free);
+			}
+		}
+	} else {
+		words = 1UL << (order - 5);
+		for(w=0; w+words<=nb_words; w+=words) {
+			for(s=0; s<words && p->used[w+s] == 0; s++);
+			if(s == words) {
+				return w*32;
+			}
+		}
+	}
+	return -1;
+}
+
+/* Sets or clears the bitmap bits of the run of 1 << order blocks at first */
+static void pool_mark(pool_t * p, uint32_t first, uint32_t order, int used)
+{
+	uint32_t w, mask, num_blocks = 1UL << order;
+
+	if(order >= 5) {
+		for(w=first/32; w<(first+num_blocks)/32; w++) {
+			p->used[w] = used ? 0xffffffff : 0;
+		}
+	} else {
+		mask = ((1UL << num_blocks) - 1) << (first % 32);
+		if(used) {
+			p->used[first/32] |= mask;
+		} else {
+			p->used[first/32] &= ~mask;
+		}
+	}
+}
+
+static void * pool_alloc_order(pool_t * p, uint32_t order, const char * tag)
+{
+	int first;
 
-	if(num_blocks == 0) {
+	if((1UL << order) > p->pool_size) {
 		return 0;
 	}
-	if(num_blocks > POOL_BLOCK_NUMBER) {
+	first = pool_find(p, order);
+	if(first < 0) {
 		return 0;
 	}
-
-	space_found = 1;
-	for(i=0; i<=(uint32_t)POOL_BLOCK_NUMBER-num_blocks; i++) {
-		if(ram_pool.blocks[i] == 0) {
-			for(j=1 ; j<num_blocks; j++) {
-				if(ram_pool.blocks[i+j] != 0) {
-					//i += j ?
-					space_found = 0;
-					break;
-				} else {
-					space_found = 1;
-				}
-			}
-			if (space_found == 1) {
-				for(j=0 ; j<num_blocks; j++) {
-					ram_pool.blocks[i+j] = num_blocks;
-				}
-				ram_pool.blocks_used += num_blocks;
-				return ram_pool.pool+(ram_pool.block_size * i);
-			}
-		}
+	pool_mark(p, first, order, 1);
+	p->order[first] = order;
+	p->tag[first] = tag;
+	p->blocks_used += 1UL << order;
+	if(p->blocks_used > p->blocks_max) {
+		p->blocks_max = p->blocks_used;
 	}
-	return 0;
+	return p->pool + (POOL_BLOCK_SIZE * first);
 }
 
 /**
-  * @brief  Helper function to allocate a buffer of at least n bytes
-  * @param  bytes: Number of bytes requested
+  * @brief  Allocates a buffer of at least n bytes
+  * @param  pool_id: pool to allocate from, POOL_CCM falls back to POOL_RAM
+  * @param  num_bytes: Number of bytes requested
+  * @param  tag: name of the caller, reported by pool_next_alloc()
   * @retval Pointer to the starting buffer, 0 if requested size is not available
   */
 /*
- * This helper function will allocate enough pool blocks to store the requested
- * number of bytes.
+ * The number of blocks is rounded up to a power of two, see pool_find().
 */
-void * pool_alloc_bytes(uint32_t num_bytes)
+void * pool_alloc_tag(pool_id_t pool_id, uint32_t num_bytes, const char * tag)
 {
-	uint32_t blocks_needed = DIV_ROUND_UP(num_bytes, POOL_BLOCK_SIZE);
-	return pool_alloc_blocks(blocks_needed);
+	uint32_t num_blocks = DIV_ROUND_UP(num_bytes, POOL_BLOCK_SIZE);
+	uint32_t order;
+	void * ptr;
+
+	if(num_blocks == 0 || num_blocks > POOL_BLOCK_NUMBER) {
+		return 0;
+	}
+	order = pool_order(num_blocks);
+
+	ptr = pool_alloc_order(&pools[pool_id], order, tag);
+	if(ptr == 0 && pool_id != POOL_RAM) {
+		ptr = pool_alloc_order(&pools[POOL_RAM], order, tag);
+	}
+	return ptr;
 }
 
 /**
@@ -115,38 +182,96 @@ void * pool_alloc_bytes(uint32_t num_bytes)
   * @retval None
   */
 /*
- * Marks the pool blocks as free (0). The number of allocated blocks is stored in
- * the block status.
+ * Finds the pool from the address and clears the blocks of the allocation
+ * in its bitmap.
 */
 void pool_free(void * ptr)
 {
-	uint8_t block_index, num_blocks, i;
+	pool_t * p;
+	uint32_t i, index;
+	uint8_t order;
 
 	if(ptr == 0) {
 		return;
 	}
 
-	block_index = ((int)ptr-(int)ram_pool.pool)/ram_pool.block_size;
-	num_blocks = ram_pool.blocks[block_index];
-
-	for(i = 0; i< num_blocks; i++) {
-		ram_pool.blocks[block_index+i] = 0;
+	for(i=0; i<POOL_END; i++) {
+		p = &pools[i];
+		if((uint8_t *)ptr < p->pool ||
+		   (uint8_t *)ptr >= p->pool + p->pool_size * POOL_BLOCK_SIZE) {
+			continue;
+		}
+		index = ((uint8_t *)ptr - p->pool) / POOL_BLOCK_SIZE;
+		order = p->order[index];
+		if(order == POOL_ORDER_NONE) {
+			return;
+		}
+		pool_mark(p, index, order, 0);
+		p->order[index] = POOL_ORDER_NONE;
+		p->tag[index] = 0;
+		p->blocks_used -= 1UL << order;
+		return;
 	}
-	ram_pool.blocks_used -= num_blocks;
 }
 
-uint8_t pool_stats_free()
+/*
+ * The largest allocation is the largest free aligned run of 1 << order
+ * blocks, which may be smaller than the largest run of free blocks.
+ * The fragmentation is the part of the free blocks it cannot use.
+*/
+void pool_stats(pool_id_t pool_id, pool_stats_t * stats)
 {
-	return ram_pool.pool_size - ram_pool.blocks_used;
-}
+	pool_t * p = &pools[pool_id];
+	uint32_t i, run = 0, free;
+	int order;
 
-uint8_t pool_stats_used()
-{
-	return ram_pool.blocks_used;
+	stats->block_size = POOL_BLOCK_SIZE;
+	stats->blocks_total = p->pool_size;
+	stats->blocks_used = p->blocks_used;
+	stats->blocks_max = p->blocks_max;
+	stats->largest_free = 0;
+	stats->nb_alloc = 0;
+
+	for(i=0; i<p->pool_size; i++) {
+		if(p->order[i] != POOL_ORDER_NONE) {
+			stats->nb_alloc++;
+		}
+		if(p->used[i/32] & (1UL << (i%32))) {
+			run = 0;
+		} else if(++run > stats->largest_free) {
+			stats->largest_free = run;
+		}
+	}
+
+	stats->largest_alloc = 0;
+	for(order=pool_order(stats->largest_free); order>=0; order--) {
+		if((1UL << order) <= stats->largest_free && pool_find(p, order) >= 0) {
+			stats->largest_alloc = 1UL << order;
+			break;
+		}
+	}
+	free = p->pool_size - p->blocks_used;
+	stats->fragmentation = free ? 100 - (stats->largest_alloc * 100) / free : 0;
 }
 
-uint8_t * pool_stats_blocks()
+/*
+ * Iterates over the live allocations of a pool, *index must be 0 for the
+ * first call. Returns 0 when there are no more allocations.
+*/
+int pool_next_alloc(pool_id_t pool_id, uint32_t * index, pool_alloc_info_t * info)
 {
-	return ram_pool.blocks;
-}
+	pool_t * p = &pools[pool_id];
+	uint32_t i;
 
+	for(i=*index; i<p->pool_size; i++) {
+		if(p->order[i] != POOL_ORDER_NONE) {
+			info->ptr = p->pool + (POOL_BLOCK_SIZE * i);
+			info->nb_blocks = 1UL << p->order[i];
+			info->tag = p->tag[i];
+			*index = i + 1;
+			return 1;
+		}
+	}
+	*index = p->pool_size;
+	return 0;
+}
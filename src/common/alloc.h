@@ -19,29 +19,68 @@
 #ifndef _ALLOC_H_
 #define _ALLOC_H_
 
+#include <stdint.h>
 
+/* Main pool in SRAM, usable as DMA buffers */
 #define POOL_BUFFER_SIZE	0x10000
 #define POOL_BLOCK_SIZE		0x200
-#define POOL_BLOCK_NUMBER	POOL_BUFFER_SIZE/POOL_BLOCK_SIZE
+#define POOL_BLOCK_NUMBER	(POOL_BUFFER_SIZE/POOL_BLOCK_SIZE)
 
+/* Second pool in CCM RAM, only for buffers accessed by the CPU */
+#define POOL_CCM_BUFFER_SIZE	0x8000
+#define POOL_CCM_BLOCK_NUMBER	(POOL_CCM_BUFFER_SIZE/POOL_BLOCK_SIZE)
+
+/* One bit per block in the allocation bitmap */
+#define POOL_BITMAP_WORDS	(POOL_BLOCK_NUMBER/32)
+
+/*
+ * Allocations are rounded to a power of two number of blocks and aligned
+ * on their size, order[] holds log2 of the number of blocks at the first
+ * block of each allocation.
+ */
 typedef struct pool {
-	void *	pool;
-	uint32_t block_size;	// Block size in bytes
-	uint8_t pool_size;	// Total number of blocks
-	uint8_t blocks_used;	// Number of used blocks
-	uint8_t blocks[POOL_BLOCK_NUMBER];	// Blocks status
+	uint8_t * pool;
+	uint32_t pool_size;	// Total number of blocks
+	uint32_t blocks_used;	// Number of used blocks
+	uint32_t blocks_max;	// High-water mark of used blocks
+	uint32_t used[POOL_BITMAP_WORDS];	// Used blocks bitmap
+	uint8_t order[POOL_BLOCK_NUMBER];
+	const char * tag[POOL_BLOCK_NUMBER];	// Caller of each allocation
 }pool_t;
 
+typedef enum {
+	POOL_RAM = 0,
+	POOL_CCM,
+	POOL_END
+} pool_id_t;
 
+typedef struct {
+	uint32_t block_size;
+	uint32_t blocks_total;
+	uint32_t blocks_used;
+	uint32_t blocks_max;
+	uint32_t largest_free;	// Largest run of free blocks
+	uint32_t largest_alloc;	// Largest possible allocation, in blocks
+	uint32_t fragmentation;	// Percent of free blocks out of largest_alloc
+	uint32_t nb_alloc;
+} pool_stats_t;
 
+typedef struct {
+	void * ptr;
+	uint32_t nb_blocks;
+	const char * tag;
+} pool_alloc_info_t;
 
 void pool_init(void);
-void * pool_alloc_bytes(uint32_t bytes);
-void * pool_alloc_blocks(uint8_t num_blocks);
+void * pool_alloc_tag(pool_id_t pool_id, uint32_t num_bytes, const char * tag);
 void pool_free(void * ptr);
 
-uint8_t pool_stats_free(void);
-uint8_t pool_stats_used(void);
-uint8_t * pool_stats_blocks(void);
+/* The allocating function is recorded for "show memory" */
+#define pool_alloc_bytes(bytes) pool_alloc_tag(POOL_RAM, (bytes), __func__)
+/* Falls back to the main pool when CCM RAM is full */
+#define pool_alloc_ccm(bytes) pool_alloc_tag(POOL_CCM, (bytes), __func__)
+
+void pool_stats(pool_id_t pool_id, pool_stats_t * stats);
+int pool_next_alloc(pool_id_t pool_id, uint32_t * index, pool_alloc_info_t * info);
 
 #endif /* _ALLOC_H_ */
@@ -39,17 +39,247 @@ uint8_t fbuff[2048] __attribute__ ((section(".ram4")));
 extern uint32_t debug_flags;
 extern char log_dest[];
 
+static void console_write_usb(void *ctx, const uint8_t *data, uint32_t size)
+{
+	t_hydra_console *con = ctx;
+
+	chnWrite(con->bss, data, size);
+}
+
+static uint32_t console_write_usb_nb(void *ctx, const uint8_t *data, uint32_t size)
+{
+	t_hydra_console *con = ctx;
+
+	return chnWriteTimeout(con->bss, data, size, TIME_IMMEDIATE);
+}
+
+void console_init(t_hydra_console *con)
+{
+	chMtxObjectInit(&con->out_mutex);
+	chMtxObjectInit(&con->log_mutex);
+	con->out_raw = FALSE;
+	console_out_init(&con->out, con->out_buf, sizeof(con->out_buf),
+			 console_write_usb, con);
+	console_log_init(&con->log, con->log_buf, sizeof(con->log_buf));
+}
+
+/*
+ * The console input is read through a copy of the SerialUSBDriver methods
+ * which returns the bytes pushed back by console_unread() first, so the
+ * binary modes get the input read ahead by the console thread.
+ */
+#define CONSOLE_INPUT_NB (2)
+static t_hydra_console *console_input[CONSOLE_INPUT_NB];
+static const struct SerialUSBDriverVMT *console_sdu_vmt;
+static struct SerialUSBDriverVMT console_vmt;
+
+static t_hydra_console *console_input_get(void *ip)
+{
+	int i;
+
+	for (i = 0; i < CONSOLE_INPUT_NB; i++) {
+		if (console_input[i] != NULL && (void *)console_input[i]->sdu == ip)
+			return console_input[i];
+	}
+	return NULL;
+}
+
+/* Returns the number of pushed back bytes copied to bp */
+static size_t console_input_take(void *ip, uint8_t *bp, size_t n)
+{
+	t_hydra_console *con = console_input_get(ip);
+	size_t len;
+
+	if (con == NULL || con->in_pos == con->in_len)
+		return 0;
+	len = MIN(n, (size_t)(con->in_len - con->in_pos));
+	memcpy(bp, &con->in_buf[con->in_pos], len);
+	con->in_pos += len;
+	return len;
+}
+
+static size_t console_input_read(void *ip, uint8_t *bp, size_t n)
+{
+	size_t len = console_input_take(ip, bp, n);
+
+	if (len == n)
+		return len;
+	return len + console_sdu_vmt->read(ip, bp + len, n - len);
+}
+
+static size_t console_input_readt(void *ip, uint8_t *bp, size_t n,
+				  sysinterval_t timeout)
+{
+	size_t len = console_input_take(ip, bp, n);
+
+	if (len == n)
+		return len;
+	/* Do not wait for the rest when pushed back bytes were returned */
+	return len + console_sdu_vmt->readt(ip, bp + len, n - len,
+					    len > 0 ? TIME_IMMEDIATE : timeout);
+}
+
+static msg_t console_input_get_byte(void *ip)
+{
+	uint8_t c;
+
+	if (console_input_take(ip, &c, 1) == 1)
+		return c;
+	return console_sdu_vmt->get(ip);
+}
+
+static msg_t console_input_gett(void *ip, sysinterval_t timeout)
+{
+	uint8_t c;
+
+	if (console_input_take(ip, &c, 1) == 1)
+		return c;
+	return console_sdu_vmt->gett(ip, timeout);
+}
+
+/* Shall be called after sduObjectInit() of the console channel */
+void console_input_init(t_hydra_console *con)
+{
+	int i;
+
+	con->in_pos = 0;
+	con->in_len = 0;
+	if (console_sdu_vmt == NULL) {
+		console_sdu_vmt = con->sdu->vmt;
+		console_vmt = *console_sdu_vmt;
+		console_vmt.read = console_input_read;
+		console_vmt.readt = console_input_readt;
+		console_vmt.get = console_input_get_byte;
+		console_vmt.gett = console_input_gett;
+	}
+	for (i = 0; i < CONSOLE_INPUT_NB; i++) {
+		if (console_input[i] == NULL) {
+			console_input[i] = con;
+			break;
+		}
+	}
+	con->sdu->vmt = &console_vmt;
+}
+
+/*
+ * Push back input read ahead by the console thread, it is returned by the
+ * next reads of the console channel. Only called by the console thread.
+ */
+void console_unread(t_hydra_console *con, const uint8_t *data, uint32_t size)
+{
+	size = MIN(size, sizeof(con->in_buf));
+	memcpy(con->in_buf, data, size);
+	con->in_pos = 0;
+	con->in_len = size;
+}
+
+/* Send the buffered output to USB, from the console thread */
+void console_flush(t_hydra_console *con)
+{
+	chMtxLock(&con->out_mutex);
+	console_out_flush(&con->out);
+	chMtxUnlock(&con->out_mutex);
+}
+
+/*
+ * Send the buffered output accepted by USB without waiting, called every
+ * CONSOLE_FLUSH_PERIOD_MS by the console flush thread. Skipped when a
+ * writer holds the console, it sends the output itself.
+ */
+void console_flush_nowait(t_hydra_console *con)
+{
+	if (!chMtxTryLock(&con->out_mutex))
+		return;
+	console_out_flush_nb(&con->out, console_write_usb_nb);
+	chMtxUnlock(&con->out_mutex);
+}
+
+/*
+ * Write the log to the SD card until less than min bytes are left.
+ * The writers only copy to the log ring, the SD card is accessed by the
+ * console and flush threads without out_mutex.
+ */
+static void console_log_drain(t_hydra_console *con, uint32_t min)
+{
+	const uint8_t *data;
+	uint32_t len;
+
+	chMtxLock(&con->log_mutex);
+	while (TRUE) {
+		chMtxLock(&con->out_mutex);
+		len = 0;
+		if (console_log_len(&con->log) >= min)
+			len = console_log_peek(&con->log, &data);
+		chMtxUnlock(&con->out_mutex);
+		if (len == 0)
+			break;
+
+		if (con->log_file.obj.fs)
+			file_append(&(con->log_file), (uint8_t *)data, len);
+
+		chMtxLock(&con->out_mutex);
+		console_log_consume(&con->log, len);
+		chMtxUnlock(&con->out_mutex);
+	}
+	chMtxUnlock(&con->log_mutex);
+}
+
+/* Write the whole log to the SD card, from the console thread */
+void console_flush_log(t_hydra_console *con)
+{
+	console_log_drain(con, 1);
+}
+
+/* Write the complete sectors of the log, from the console flush thread */
+void console_flush_log_sectors(t_hydra_console *con)
+{
+	console_log_drain(con, CONSOLE_LOG_SECTOR);
+}
+
+/*
+ * Binary protocols (BBIO, SUMP, ...) need their answers to be sent
+ * immediately, output is not buffered in raw mode.
+ * Returns the previous mode.
+ */
+bool console_set_raw(t_hydra_console *con, bool raw)
+{
+	bool prev;
+
+	chMtxLock(&con->out_mutex);
+	console_out_flush(&con->out);
+	prev = con->out_raw;
+	con->out_raw = raw;
+	chMtxUnlock(&con->out_mutex);
+
+	return prev;
+}
+
 void stream_write(t_hydra_console *con, const char *data, const uint32_t size)
 {
-	BaseSequentialStream* chp = con->bss;
+	uint32_t len, left;
 
 	if (!size)
 		return;
 
-	chnWrite(chp, (uint8_t *)data, size);
-
-	if (con->log_file.obj.fs)
-		file_append(&(con->log_file), (uint8_t *)data, size);
+	chMtxLock(&con->out_mutex);
+	if (con->out_raw) {
+		chnWrite(con->bss, (uint8_t *)data, size);
+	} else {
+		console_out_write(&con->out, (uint8_t *)data, size);
+	}
+	left = size;
+	while (con->log_file.obj.fs && left > 0) {
+		len = console_log_write(&con->log, (const uint8_t *)data, left);
+		data += len;
+		left -= len;
+		if (left > 0) {
+			/* Log ring full, wait for the flush thread */
+			chMtxUnlock(&con->out_mutex);
+			chThdSleepMilliseconds(1);
+			chMtxLock(&con->out_mutex);
+		}
+	}
+	chMtxUnlock(&con->out_mutex);
 }
 
 void print(void *user, const char *str)
@@ -75,31 +305,12 @@ void cprint(t_hydra_console *con, const char *data, const uint32_t size)
 
 void print_hex(t_hydra_console *con, uint8_t* data, uint8_t size)
 {
-	uint8_t ascii[17];
-	uint8_t i, j;
-	ascii[16] = '\0';
-	for (i = 0; i < size; ++i) {
-		cprintf(con, "%02X ", data[i]);
-		if (data[i] >= 0x20 && data[i] <= 0x7f) {
-			ascii[i % 16] = data[i];
-		} else {
-			ascii[i % 16] = '.';
-		}
-		if ((i+1) % 8 == 0 || i+1 == size) {
-			cprintf(con, " ");
-			if ((i+1) % 16 == 0) {
-				cprintf(con, "|  %s \r\n", ascii);
-			} else if (i+1 == size) {
-				ascii[(i+1) % 16] = '\0';
-				if ((i+1) % 16 <= 8) {
-					cprintf(con, " ");
-				}
-				for (j = (i+1) % 16; j < 16; ++j) {
-					cprintf(con, "   ");
-				}
-				cprintf(con, "|  %s \r\n", ascii);
-			}
-		}
+	char line[HEX_LINE_SIZE];
+	uint32_t i, nb;
+
+	for (i = 0; i < size; i += nb) {
+		nb = MIN((uint32_t)(size - i), 16);
+		stream_write(con, line, hex_format_line(line, data + i, nb));
 	}
 }
 
@@ -137,9 +348,31 @@ void DelayMs(uint32_t delay_ms)
 	osalSysPolledDelayX(MS2RTC(STM32_HCLK, delay_ms));
 }
 
+static void show_pool(t_hydra_console *con, pool_id_t pool_id, const char *name)
+{
+	pool_stats_t stats;
+	pool_alloc_info_t info;
+	uint32_t index = 0, free;
+
+	pool_stats(pool_id, &stats);
+	free = stats.blocks_total - stats.blocks_used;
+	cprintf(con, "%s pool: %u blocks of %u bytes\r\n", name,
+		stats.blocks_total, stats.block_size);
+	cprintf(con, "  used   : %u blocks (max %u)\r\n", stats.blocks_used,
+		stats.blocks_max);
+	cprintf(con, "  free   : %u blocks, largest run %u\r\n", free,
+		stats.largest_free);
+	/* Part of the free space not usable by the largest allocation */
+	cprintf(con, "  largest allocation: %u blocks, fragmentation: %u%%\r\n",
+		stats.largest_alloc, stats.fragmentation);
+	while(pool_next_alloc(pool_id, &index, &info)) {
+		cprintf(con, "  0x%08x %3u blocks %s\r\n", (uint32_t)info.ptr,
+			info.nb_blocks, info.tag ? info.tag : "");
+	}
+}
+
 void cmd_show_memory(t_hydra_console *con)
 {
-	uint32_t used, free;
 	size_t n, total, largest;
 
 	n = chHeapStatus(NULL, &total, &largest);
@@ -147,20 +380,8 @@ void cmd_show_memory(t_hydra_console *con)
 	cprintf(con, "heap fragments   : %u\r\n", n);
 	cprintf(con, "heap free total  : %u bytes\r\n", total);
 	cprintf(con, "heap free largest: %u bytes\r\n", largest);
-	free = pool_stats_free();
-	used = pool_stats_used();
-	cprintf(con, "pool free : %u blocks\r\n", free);
-	cprintf(con, "pool used : %u blocks\r\n", used);
-#ifdef MAKE_DEBUG
-	uint8_t * blocks;
-	blocks = pool_stats_blocks();
-	cprintf(con, "pool block status: \r\n");
-	for(n=0; n<POOL_BLOCK_NUMBER; n++) {
-		cprintf(con, "%02x ", blocks[n]);
-	}
-	cprint(con, "\r\n", 2);
-#endif
-
+	show_pool(con, POOL_RAM, "RAM");
+	show_pool(con, POOL_CCM, "CCM");
 }
 
 void cmd_show_threads(t_hydra_console *con)
@@ -29,6 +29,7 @@
 #include "mode_config.h"
 #include "ff.h"
 #include "alloc.h"
+#include "console_out.h"
 
 #define ARRAY_SIZE(x) (sizeof((x))/sizeof((x)[0]))
 
@@ -84,6 +85,16 @@ extern SerialUSBDriver SDU2;
 
 #define PROMPT "> "
 
+/* Console output buffering, see stream_write() */
+#define CONSOLE_OUT_SIZE (SERIAL_USB_BUFFERS_SIZE)
+/* Two SD sectors, one is written while the other is filled */
+#define CONSOLE_LOG_SIZE (1024)
+#define CONSOLE_LOG_SECTOR (512)
+#define CONSOLE_FLUSH_PERIOD_MS (5)
+
+/* Console input read at once, see console_unread() */
+#define CONSOLE_INPUT_SIZE (64) /* USB full speed packet size */
+
 struct t_mode_config;
 typedef struct hydra_console {
 	char *thread_name;
@@ -96,6 +107,17 @@ typedef struct hydra_console {
 	t_mode_config *mode;
 	int console_mode;
 	FIL log_file;
+	mutex_t out_mutex;
+	mutex_t log_mutex;	/* Log file accesses */
+	bool out_raw;
+	console_out_t out;
+	console_log_t log;
+	uint8_t out_buf[CONSOLE_OUT_SIZE];
+	uint8_t log_buf[CONSOLE_LOG_SIZE];
+	/* Input pushed back by console_unread(), read before the USB input */
+	uint8_t in_buf[CONSOLE_INPUT_SIZE];
+	uint8_t in_pos;
+	uint8_t in_len;
 } t_hydra_console;
 
 enum console_modes {
@@ -128,6 +150,14 @@ int cmd_sump(t_hydra_console *con, t_tokenline_parsed *p);
 int cmd_rng(t_hydra_console *con, t_tokenline_parsed *p);
 
 void token_dump(t_hydra_console *con, t_tokenline_parsed *p);
+void console_init(t_hydra_console *con);
+void console_input_init(t_hydra_console *con);
+void console_unread(t_hydra_console *con, const uint8_t *data, uint32_t size);
+void console_flush(t_hydra_console *con);
+void console_flush_nowait(t_hydra_console *con);
+void console_flush_log(t_hydra_console *con);
+void console_flush_log_sectors(t_hydra_console *con);
+bool console_set_raw(t_hydra_console *con, bool raw);
 void cprint(t_hydra_console *con, const char *data, const uint32_t size);
 void cprintf(t_hydra_console *con, const char *fmt, ...);
 void print_hex(t_hydra_console *con, uint8_t* data, uint8_t size);
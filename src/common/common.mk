@@ -5,7 +5,18 @@ COMMONSRC = common/common.c \
             common/usb1cfg.c \
             common/usb2cfg.c \
             common/script.c \
-            common/alloc.c
+            common/alloc.c \
+            common/console_out.c \
+            common/crc32.c \
+            common/sha256.c \
+            common/pcapng.c
+
+# Files without hardware or RTOS dependencies, also built by host.mk
+COMMONHOSTSRC = common/alloc.c \
+            common/console_out.c \
+            common/crc32.c \
+            common/sha256.c \
+            common/pcapng.c
 
 # Required include directories
 COMMONINC = ./common
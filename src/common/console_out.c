@@ -0,0 +1,178 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include "console_out.h"
+
+/*
+ * This file does not depend on ChibiOS, the locking and the flush on
+ * timeout are done by the caller (see stream_write()).
+ */
+
+static const char hex_digits[] = "0123456789ABCDEF";
+
+void console_out_init(console_out_t *out, uint8_t *buf, uint32_t size,
+		      console_out_write_t write, void *ctx)
+{
+	out->buf = buf;
+	out->size = size;
+	out->len = 0;
+	out->write = write;
+	out->ctx = ctx;
+}
+
+void console_out_flush(console_out_t *out)
+{
+	if (out->len == 0)
+		return;
+
+	out->write(out->ctx, out->buf, out->len);
+	out->len = 0;
+}
+
+/*
+ * Write the part of the buffer accepted by write_nb without waiting, the
+ * rest is kept for the next flush.
+ */
+void console_out_flush_nb(console_out_t *out, console_out_write_nb_t write_nb)
+{
+	uint32_t len;
+
+	if (out->len == 0)
+		return;
+
+	len = write_nb(out->ctx, out->buf, out->len);
+	if (len >= out->len) {
+		out->len = 0;
+		return;
+	}
+	memmove(out->buf, out->buf + len, out->len - len);
+	out->len -= len;
+}
+
+void console_out_write(console_out_t *out, const uint8_t *data, uint32_t size)
+{
+	uint32_t len;
+
+	/* Data larger than the buffer is written as is */
+	if (size >= out->size) {
+		console_out_flush(out);
+		out->write(out->ctx, data, size);
+		return;
+	}
+
+	while (size > 0) {
+		len = out->size - out->len;
+		if (len > size)
+			len = size;
+		memcpy(out->buf + out->len, data, len);
+		out->len += len;
+		data += len;
+		size -= len;
+		if (out->len == out->size)
+			console_out_flush(out);
+	}
+}
+
+void console_log_init(console_log_t *log, uint8_t *buf, uint32_t size)
+{
+	log->buf = buf;
+	log->size = size;
+	log->head = 0;
+	log->tail = 0;
+}
+
+/* Returns the number of bytes written, less than size when the ring is full */
+uint32_t console_log_write(console_log_t *log, const uint8_t *data, uint32_t size)
+{
+	uint32_t free, pos, len;
+
+	free = log->size - console_log_len(log);
+	if (size > free)
+		size = free;
+	pos = log->head & (log->size - 1);
+	len = log->size - pos;
+	if (len > size)
+		len = size;
+	memcpy(log->buf + pos, data, len);
+	memcpy(log->buf, data + len, size - len);
+	log->head += size;
+
+	return size;
+}
+
+/* Returns the length of the contiguous data at the tail of the ring */
+uint32_t console_log_peek(console_log_t *log, const uint8_t **data)
+{
+	uint32_t pos, len;
+
+	pos = log->tail & (log->size - 1);
+	len = log->size - pos;
+	if (len > console_log_len(log))
+		len = console_log_len(log);
+	*data = log->buf + pos;
+
+	return len;
+}
+
+void console_log_consume(console_log_t *log, uint32_t len)
+{
+	log->tail += len;
+}
+
+/*
+ * Format up to 16 bytes the same way as the original print_hex():
+ * "XX XX ... XX  XX ... XX  |  ascii \r\n", short lines are padded.
+ * line shall be at least HEX_LINE_SIZE bytes, returns the line length.
+ */
+uint32_t hex_format_line(char *line, const uint8_t *data, uint32_t nb)
+{
+	char *p = line;
+	uint32_t i;
+
+	for (i = 0; i < nb; i++) {
+		*p++ = hex_digits[data[i] >> 4];
+		*p++ = hex_digits[data[i] & 0x0f];
+		*p++ = ' ';
+		if ((i + 1) % 8 == 0 || i + 1 == nb)
+			*p++ = ' ';
+	}
+	if (nb < 16) {
+		if (nb <= 8)
+			*p++ = ' ';
+		for (i = nb; i < 16; i++) {
+			*p++ = ' ';
+			*p++ = ' ';
+			*p++ = ' ';
+		}
+	}
+	*p++ = '|';
+	*p++ = ' ';
+	*p++ = ' ';
+	for (i = 0; i < nb; i++) {
+		if (data[i] >= 0x20 && data[i] <= 0x7f)
+			*p++ = data[i];
+		else
+			*p++ = '.';
+	}
+	*p++ = ' ';
+	*p++ = '\r';
+	*p++ = '\n';
+
+	return p - line;
+}
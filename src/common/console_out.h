@@ -0,0 +1,69 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _CONSOLE_OUT_H_
+#define _CONSOLE_OUT_H_
+
+#include <stdint.h>
+
+/* Length of a print_hex() line: 16*"XX " + 2*" " + "|  " + 16 + " \r\n" */
+#define HEX_LINE_SIZE (80)
+
+typedef void (*console_out_write_t)(void *ctx, const uint8_t *data, uint32_t size);
+/* Write without waiting, returns the number of bytes written */
+typedef uint32_t (*console_out_write_nb_t)(void *ctx, const uint8_t *data, uint32_t size);
+
+/* Output buffer, data is written when the buffer is full or flushed */
+typedef struct {
+	uint8_t *buf;
+	uint32_t size;
+	uint32_t len;
+	console_out_write_t write;
+	void *ctx;
+} console_out_t;
+
+void console_out_init(console_out_t *out, uint8_t *buf, uint32_t size,
+		      console_out_write_t write, void *ctx);
+void console_out_write(console_out_t *out, const uint8_t *data, uint32_t size);
+void console_out_flush(console_out_t *out);
+void console_out_flush_nb(console_out_t *out, console_out_write_nb_t write_nb);
+
+/*
+ * Log ring, filled by the writers and emptied by the thread writing the
+ * log file, which accesses the data outside of the writers lock.
+ */
+typedef struct {
+	uint8_t *buf;
+	uint32_t size;		/* Power of 2 */
+	uint32_t head;		/* Bytes written, free running */
+	uint32_t tail;		/* Bytes consumed, free running */
+} console_log_t;
+
+void console_log_init(console_log_t *log, uint8_t *buf, uint32_t size);
+uint32_t console_log_write(console_log_t *log, const uint8_t *data, uint32_t size);
+uint32_t console_log_peek(console_log_t *log, const uint8_t **data);
+void console_log_consume(console_log_t *log, uint32_t len);
+
+static inline uint32_t console_log_len(const console_log_t *log)
+{
+	return log->head - log->tail;
+}
+
+uint32_t hex_format_line(char *line, const uint8_t *data, uint32_t nb);
+
+#endif /* _CONSOLE_OUT_H_ */
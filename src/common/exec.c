@@ -169,14 +169,21 @@ static int cmd_logging(t_hydra_console *con, t_tokenline_parsed *p)
 		} else {
 			strncpy(log_dest, filename, sizeof(log_dest) - 1);/* -1 to include terminating null-character */
 		}
-		if(!file_open(&(con->log_file), log_dest, 'w')) {
+		chMtxLock(&con->log_mutex);
+		enable = file_open(&(con->log_file), log_dest, 'w');
+		chMtxUnlock(&con->log_mutex);
+		if(!enable) {
 			cprintf(con, "Error. Unable to create file.\r\n");
-			enable = FALSE;
 			return FALSE;
 		}
 	} else {
 		log_dest[0] = '\0';
+		console_flush_log(con);
+		chMtxLock(&con->log_mutex);
 		file_close(&(con->log_file));
+		chMtxUnlock(&con->log_mutex);
+		/* Drop the output logged by other threads meanwhile */
+		console_flush_log(con);
 	}
 
 	return TRUE;
@@ -242,9 +249,13 @@ void execute(void *user, t_tokenline_parsed *p)
 		}
 	}
 
+	console_flush(con);
 	if (con->log_file.obj.fs) {
 		/* Flush cached logging output. */
+		console_flush_log(con);
+		chMtxLock(&con->log_mutex);
 		file_sync(&(con->log_file));
+		chMtxUnlock(&con->log_mutex);
 	}
 }
 
@@ -70,6 +70,8 @@ bool is_file_present(char * filename)
  *					w : opens a file for writing. file is
  *					created if it does not exist
  *					a : opens an existing file for writing
+ *					c : creates a file for writing. existing
+ *					file is truncated
  *
  * @return		        The operation status.
  */
@@ -91,6 +93,9 @@ bool file_open(FIL *file_handle, const char * filename, const char mode)
 	case 'a':
 		flags = FA_WRITE | FA_OPEN_EXISTING;
 		break;
+	case 'c':
+		flags = FA_WRITE | FA_CREATE_ALWAYS;
+		break;
 	default:
 		flags = FA_READ | FA_OPEN_EXISTING;
 		break;
@@ -172,6 +177,36 @@ bool file_append(FIL *file_handle, uint8_t *data, int len)
 	return TRUE;
 }
 
+/**
+ * @brief   Writes data at the current position of a file
+ *
+ * @param[in]  file_handle	pointer to a FIL object
+ * @param[in]  data		pointer to a buffer containing the data to write
+ * @param[in]  len		length of the data buffer
+ *
+ * @return			The operation status.
+ */
+/*
+ * Sector aligned buffers of multiple sectors are written directly to the
+ * SD card by FatFs, without going through the file buffer.
+ */
+bool file_write(FIL *file_handle, uint8_t *data, uint32_t len)
+{
+	UINT written;
+
+	if (f_write(file_handle, data, len, &written) != FR_OK) {
+		return FALSE;
+	}
+
+	return (written == len);
+}
+
+/* Write callback of the pcapng writer, ctx is the FIL */
+bool file_write_cb(void *ctx, const uint8_t *data, uint32_t len)
+{
+	return file_write((FIL *)ctx, (uint8_t *)data, len);
+}
+
 bool file_close(FIL *file_handle)
 {
 	if(f_close(file_handle) == FR_OK) {
@@ -181,6 +216,87 @@ bool file_close(FIL *file_handle)
 	}
 }
 
+/**
+ * @brief   Creates a new file with the first free number
+ *
+ * @param[in]  file_handle	pointer to a FIL object
+ * @param[in]  prefix		prefix of the file. a number will be appended
+ * @param[in]  ext		extension of the file
+ * @param[out] filename		name of the created file
+ *
+ * @return			The operation status.
+ */
+bool file_create(FIL *file_handle, const char * prefix, const char * ext, char * filename)
+{
+	uint32_t i;
+	FRESULT err = FR_EXIST;
+
+	if(!is_fs_ready()) {
+		if(mount() != 0) {
+			return FALSE;
+		}
+	}
+
+	for(i=0; i<999; i++) {
+		snprintf(filename, FILENAME_SIZE, "0:%s%ld.%s", prefix, i, ext);
+		err = f_open(file_handle, filename, FA_WRITE | FA_CREATE_NEW);
+		if(err == FR_OK) {
+			break;
+		}
+	}
+
+	return (err == FR_OK);
+}
+
+/**
+ * @brief   Creates a new pcapng file and starts its writer
+ *
+ * @param[in]  prefix		prefix of the file. a number will be appended
+ * @param[in]  size		writer buffer size, multiple of PCAPNG_CHUNK_SIZE
+ *
+ * @return			The file, NULL if it could not be created.
+ */
+file_pcapng_t *file_pcapng_open(const char * prefix, uint32_t size)
+{
+	file_pcapng_t *f;
+
+	/* In the main pool, the SDIO DMA reads the FIL buffer */
+	f = pool_alloc_bytes(sizeof(file_pcapng_t));
+	if(f == NULL) {
+		return NULL;
+	}
+	f->buf = pool_alloc_bytes(size);
+	if(f->buf == NULL ||
+	   !file_create(&f->file, prefix, "pcapng", f->filename.filename)) {
+		pool_free(f->buf);
+		pool_free(f);
+		return NULL;
+	}
+	pcapng_writer_init(&f->writer, f->buf, size, file_write_cb, &f->file,
+			   STM32_HCLK);
+
+	return f;
+}
+
+/**
+ * @brief   Writes the buffered packets, closes and frees the pcapng file
+ *
+ * @param[in]  f		file from file_pcapng_open()
+ *
+ * @return			The operation status.
+ */
+bool file_pcapng_close(file_pcapng_t *f)
+{
+	bool ok;
+
+	ok = pcapng_writer_flush(&f->writer);
+	ok = file_close(&f->file) && ok;
+	pool_free(f->buf);
+	pool_free(f);
+
+	return ok;
+}
+
 /**
  * @brief   Creates a new file and writes data in it
  *
@@ -194,7 +310,6 @@ bool file_close(FIL *file_handle)
  */
 bool file_create_write(FIL *file_handle, uint8_t* data, uint32_t len, const char * prefix, char * filename)
 {
-	uint32_t i;
 	FRESULT err;
 
 // FIL is a huge struct with 512+ bytes in non-tiny fs. Not any thread's stack can handle this.
@@ -205,32 +320,19 @@ bool file_create_write(FIL *file_handle, uint8_t* data, uint32_t len, const char
 		return FALSE;
 	}
 
-	if(!is_fs_ready()) {
-		if(mount() != 0) {
-			return FALSE;
-		}
+	/* Save data in file */
+	if(!file_create(file_handle, prefix, "txt", filename)) {
+		return FALSE;
 	}
 
-	/* Save data in file */
-	for(i=0; i<999; i++) {
-		snprintf(filename, FILENAME_SIZE, "0:%s%ld.txt", prefix, i);
-		err = f_open(file_handle, filename, FA_WRITE | FA_CREATE_NEW);
-		if(err == FR_OK) {
-			break;
-		}
+	err = f_write(file_handle, data, len, (void *)&bytes_written);
+	if(err != FR_OK) {
+		f_close(file_handle);
+		return FALSE;
 	}
-	if(err == FR_OK) {
-		err = f_write(file_handle, data, len, (void *)&bytes_written);
-		if(err != FR_OK) {
-			f_close(file_handle);
-			return FALSE;
-		}
 
-		err = f_close(file_handle);
-		if (err != FR_OK) {
-			return FALSE;
-		}
-	} else {
+	err = f_close(file_handle);
+	if (err != FR_OK) {
 		return FALSE;
 	}
 
@@ -268,8 +370,8 @@ bool badblocks(uint32_t start, uint32_t end, uint32_t blockatonce, uint8_t patte
 	uint32_t i = 0;
 	uint8_t *outbuf, *inbuf;
 
-	outbuf = pool_alloc_bytes(IN_OUT_BUF_SIZE+8);
-	inbuf = pool_alloc_bytes(IN_OUT_BUF_SIZE+8);
+	outbuf = pool_alloc_bytes(IN_OUT_BUF_SIZE);
+	inbuf = pool_alloc_bytes(IN_OUT_BUF_SIZE);
 
 	if(inbuf == 0 || outbuf == 0) {
 		pool_free(inbuf);
@@ -338,7 +440,8 @@ static int sd_perf_run(t_hydra_console *con, int seconds, int sectors, int offse
 {
 	uint32_t n, startblk;
 	systime_t start, end;
-	uint8_t * inbuf = pool_alloc_bytes(IN_OUT_BUF_SIZE+8);
+	/* A power of two number of pool blocks when aligned */
+	uint8_t * inbuf = pool_alloc_bytes(sectors * MMCSD_BLOCK_SIZE + offset);
 
 	if(inbuf == 0) {
 		pool_free(inbuf);
@@ -21,8 +21,11 @@
 
 #define SDC_BURST_SIZE  4 /* how many sectors reads at once */
 #define IN_OUT_BUF_SIZE (MMCSD_BLOCK_SIZE * SDC_BURST_SIZE)
+/* Sectors read at offset 1 of an IN_OUT_BUF_SIZE buffer */
+#define SDC_UNALIGNED_BURST_SIZE (SDC_BURST_SIZE - 1)
 
 #include "common.h"
+#include "pcapng.h"
 
 #define FILENAME_SIZE (255)
 
@@ -30,6 +33,14 @@ typedef struct {
 	char filename[FILENAME_SIZE];
 } filename_t;
 
+/* pcapng capture file, timestamps of the writer in CPU cycles */
+typedef struct {
+	FIL file;
+	filename_t filename;
+	pcapng_writer_t writer;
+	uint8_t *buf;
+} file_pcapng_t;
+
 bool is_fs_ready(void);
 bool is_file_present(char * filename);
 int sd_perf(t_hydra_console *con, int offset);
@@ -40,8 +51,13 @@ bool file_open(FIL *file_handle, const char * filename, const char mode);
 uint32_t file_read(FIL *file_handle, uint8_t *data, int len);
 bool file_readline(FIL *file_handle, uint8_t *data, int len);
 bool file_append(FIL *file_handle, uint8_t *data, int len);
+bool file_write(FIL *file_handle, uint8_t *data, uint32_t len);
+bool file_write_cb(void *ctx, const uint8_t *data, uint32_t len);
+bool file_create(FIL *file_handle, const char * prefix, const char * ext, char * filename);
 bool file_create_write(FIL *file_handle, uint8_t* data, uint32_t len, const char * prefix, char * filename);
 bool file_close(FIL *file_handle);
+file_pcapng_t *file_pcapng_open(const char * prefix, uint32_t size);
+bool file_pcapng_close(file_pcapng_t *f);
 bool file_sync(FIL * file_handle);
 
 int mount(void);
@@ -19,6 +19,9 @@
 #ifndef _MODE_CONFIG_H_
 #define _MODE_CONFIG_H_
 
+#include "hydrabus_can_filter.h"
+#include "hydrabus_isotp.h"
+
 typedef enum {
 	DEV_NUM = 0,
 	DEV_GPIO_PULL,
@@ -111,6 +114,7 @@ typedef struct {
 	uint8_t trst_pin;
 } jtag_config_t;
 
+#define CAN_CONFIG_FILTER_RULES (16)
 typedef struct {
 	uint32_t dev_speed;
 	uint8_t dev_mode;
@@ -118,6 +122,10 @@ typedef struct {
 	uint32_t can_id;
 	uint32_t filter_id;
 	uint32_t filter_mask;
+	/* Identifier ranges compiled to the filter banks, see can_set_filter_rules() */
+	uint8_t nb_filter_rules;
+	can_filter_rule_t filter_rules[CAN_CONFIG_FILTER_RULES];
+	isotp_config_t isotp;
 } can_config_t;
 
 typedef struct {
@@ -155,9 +163,11 @@ typedef struct {
 typedef struct {
 	uint32_t trigger_masks[4];
 	uint32_t trigger_values[4];
+	uint32_t trigger_configs[4];
 	uint32_t read_count;
 	uint32_t delay_count;
 	uint32_t divider;
+	uint32_t flags;
 	uint8_t state;
 	uint8_t channels;
 } sump_config_t;
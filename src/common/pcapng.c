@@ -0,0 +1,238 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include "pcapng.h"
+
+/*
+ * This file does not depend on ChibiOS, the file and the locking are
+ * handled by the caller through the write callback.
+ */
+
+#define PCAPNG_BT_SHB		(0x0A0D0D0A)
+#define PCAPNG_BT_IDB		(0x00000001)
+#define PCAPNG_BT_EPB		(0x00000006)
+#define PCAPNG_BYTE_ORDER	(0x1A2B3C4D)
+
+#define PCAPNG_OPT_ENDOFOPT	(0)
+#define PCAPNG_OPT_IF_NAME	(2)
+#define PCAPNG_OPT_IF_TSRESOL	(9)
+
+#define PCAPNG_SNAPLEN		(0xFFFF)
+
+static const struct {
+	uint16_t linktype;
+	const char *name;
+} pcapng_links[PCAPNG_LINK_END] = {
+	[PCAPNG_LINK_ISO14443A] = { 147, "iso14443a" },
+	[PCAPNG_LINK_ISO14443B] = { 147, "iso14443b" },
+	[PCAPNG_LINK_CAN] = { 227, "can" },
+	[PCAPNG_LINK_SPI] = { 148, "spi" },
+	[PCAPNG_LINK_I2C] = { 209, "i2c" },
+	[PCAPNG_LINK_UART] = { 149, "uart" },
+};
+
+static inline void put16(uint8_t *buf, uint16_t val)
+{
+	memcpy(buf, &val, sizeof(val));
+}
+
+static inline void put32(uint8_t *buf, uint32_t val)
+{
+	memcpy(buf, &val, sizeof(val));
+}
+
+uint32_t pcapng_shb(uint8_t *buf)
+{
+	put32(buf + 0, PCAPNG_BT_SHB);
+	put32(buf + 4, PCAPNG_SHB_SIZE);
+	put32(buf + 8, PCAPNG_BYTE_ORDER);
+	put16(buf + 12, 1); /* Major version */
+	put16(buf + 14, 0); /* Minor version */
+	/* Section length not specified */
+	put32(buf + 16, 0xFFFFFFFF);
+	put32(buf + 20, 0xFFFFFFFF);
+	put32(buf + 24, PCAPNG_SHB_SIZE);
+
+	return PCAPNG_SHB_SIZE;
+}
+
+uint32_t pcapng_idb(uint8_t *buf, pcapng_link_t link)
+{
+	const char *name = pcapng_links[link].name;
+	uint32_t name_len = strlen(name);
+	uint32_t i;
+
+	put32(buf + 0, PCAPNG_BT_IDB);
+	put16(buf + 8, pcapng_links[link].linktype);
+	put16(buf + 10, 0);
+	put32(buf + 12, PCAPNG_SNAPLEN);
+	i = 16;
+
+	put16(buf + i, PCAPNG_OPT_IF_NAME);
+	put16(buf + i + 2, name_len);
+	memset(buf + i + 4, 0, (name_len + 3) & ~3);
+	memcpy(buf + i + 4, name, name_len);
+	i += 4 + ((name_len + 3) & ~3);
+
+	/* Nanoseconds */
+	put16(buf + i, PCAPNG_OPT_IF_TSRESOL);
+	put16(buf + i + 2, 1);
+	put32(buf + i + 4, 0);
+	buf[i + 4] = 9;
+	i += 8;
+
+	put32(buf + i, PCAPNG_OPT_ENDOFOPT);
+	i += 4;
+
+	i += 4;
+	put32(buf + 4, i);
+	put32(buf + i - 4, i);
+
+	return i;
+}
+
+/* Enhanced Packet Block up to the packet data */
+uint32_t pcapng_epb_header(uint8_t *buf, uint32_t if_id, uint64_t ts_ns, uint32_t len)
+{
+	put32(buf + 0, PCAPNG_BT_EPB);
+	put32(buf + 4, PCAPNG_EPB_SIZE(len));
+	put32(buf + 8, if_id);
+	put32(buf + 12, (uint32_t)(ts_ns >> 32));
+	put32(buf + 16, (uint32_t)ts_ns);
+	put32(buf + 20, len); /* Captured length */
+	put32(buf + 24, len); /* Original length */
+
+	return PCAPNG_EPB_HDR_SIZE;
+}
+
+/* Enhanced Packet Block after the len bytes of packet data */
+uint32_t pcapng_epb_trailer(uint8_t *buf, uint32_t len)
+{
+	uint32_t pad = ((len + 3) & ~3) - len;
+
+	memset(buf, 0, pad);
+	put32(buf + pad, PCAPNG_EPB_SIZE(len));
+
+	return pad + 4;
+}
+
+uint32_t pcapng_epb(uint8_t *buf, uint32_t if_id, uint64_t ts_ns,
+		    const uint8_t *data, uint32_t len)
+{
+	uint32_t i;
+
+	i = pcapng_epb_header(buf, if_id, ts_ns, len);
+	memcpy(buf + i, data, len);
+	i += len;
+	i += pcapng_epb_trailer(buf + i, len);
+
+	return i;
+}
+
+/* Converts a timestamp counted at ts_freq Hz to nanoseconds */
+uint64_t pcapng_ts_ns(uint64_t ts, uint32_t ts_freq)
+{
+	return (ts / ts_freq) * 1000000000ULL +
+	       ((ts % ts_freq) * 1000000000ULL) / ts_freq;
+}
+
+/*
+ * size shall be a multiple of PCAPNG_CHUNK_SIZE, packets larger than
+ * size - PCAPNG_CHUNK_SIZE - PCAPNG_IDB_SIZE_MAX are dropped.
+ */
+void pcapng_writer_init(pcapng_writer_t *w, uint8_t *buf, uint32_t size,
+			pcapng_write_t write, void *ctx, uint32_t ts_freq)
+{
+	int i;
+
+	w->buf = buf;
+	w->size = size;
+	w->write = write;
+	w->ctx = ctx;
+	w->ts_freq = ts_freq;
+	w->flush_period = 0;
+	w->last_flush = 0;
+	for (i = 0; i < PCAPNG_LINK_END; i++)
+		w->if_id[i] = -1;
+	w->nb_if = 0;
+	w->packets = 0;
+	w->dropped = 0;
+	w->error = false;
+
+	w->len = pcapng_shb(buf);
+}
+
+/* Writes the complete chunks of the buffer */
+static void pcapng_writer_chunks(pcapng_writer_t *w)
+{
+	uint32_t len = w->len & ~(PCAPNG_CHUNK_SIZE - 1);
+
+	if (len == 0)
+		return;
+
+	if (!w->write(w->ctx, w->buf, len))
+		w->error = true;
+	w->len -= len;
+	memmove(w->buf, w->buf + len, w->len);
+}
+
+bool pcapng_writer_packet(pcapng_writer_t *w, pcapng_link_t link, uint64_t ts,
+			  const uint8_t *data, uint32_t len)
+{
+	uint32_t need;
+
+	need = PCAPNG_EPB_SIZE(len);
+	if (w->if_id[link] < 0)
+		need += PCAPNG_IDB_SIZE_MAX;
+
+	if (w->len + need > w->size)
+		pcapng_writer_chunks(w);
+	if (w->len + need > w->size || len > PCAPNG_SNAPLEN) {
+		w->dropped++;
+		return false;
+	}
+
+	if (w->if_id[link] < 0) {
+		w->len += pcapng_idb(w->buf + w->len, link);
+		w->if_id[link] = w->nb_if++;
+	}
+	w->len += pcapng_epb(w->buf + w->len, w->if_id[link],
+			     pcapng_ts_ns(ts, w->ts_freq), data, len);
+	w->packets++;
+
+	if (w->len >= w->size - PCAPNG_CHUNK_SIZE ||
+	    (w->flush_period > 0 && ts - w->last_flush >= w->flush_period)) {
+		pcapng_writer_chunks(w);
+		w->last_flush = ts;
+	}
+
+	return !w->error;
+}
+
+/* Writes all the buffered data, at the end of the capture */
+bool pcapng_writer_flush(pcapng_writer_t *w)
+{
+	if (w->len > 0) {
+		if (!w->write(w->ctx, w->buf, w->len))
+			w->error = true;
+		w->len = 0;
+	}
+
+	return !w->error;
+}
@@ -0,0 +1,109 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _PCAPNG_H_
+#define _PCAPNG_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * pcapng capture file writer, shared by the sniffers.
+ * Blocks are written in the CPU byte order (the Section Header Block
+ * gives it to the readers), timestamps are in nanoseconds.
+ */
+
+/* Size of the chunks written to the file, the microSD block size */
+#define PCAPNG_CHUNK_SIZE	(512)
+
+#define PCAPNG_SHB_SIZE		(28)
+/* Interface Description Block with if_name (up to 12 chars) and if_tsresol */
+#define PCAPNG_IDB_SIZE_MAX	(48)
+#define PCAPNG_EPB_HDR_SIZE	(28)
+#define PCAPNG_EPB_SIZE(len)	(PCAPNG_EPB_HDR_SIZE + (((len) + 3) & ~3) + 4)
+
+/*
+ * Link types, each one gets its own interface in the file.
+ * ISO14443A/B: HydraNFC 8 bytes data header then the frame (LINKTYPE_USER0,
+ *              same as the NFC sniffer PCAP output)
+ * CAN: SocketCAN frame (LINKTYPE_CAN_SOCKETCAN)
+ * SPI: MOSI byte then MISO byte for each transfer (LINKTYPE_USER1)
+ * I2C: Linux I2C header then the bytes (LINKTYPE_I2C_LINUX)
+ * UART: received bytes (LINKTYPE_USER2)
+ */
+typedef enum {
+	PCAPNG_LINK_ISO14443A = 0,
+	PCAPNG_LINK_ISO14443B,
+	PCAPNG_LINK_CAN,
+	PCAPNG_LINK_SPI,
+	PCAPNG_LINK_I2C,
+	PCAPNG_LINK_UART,
+	PCAPNG_LINK_END
+} pcapng_link_t;
+
+typedef bool (*pcapng_write_t)(void *ctx, const uint8_t *data, uint32_t size);
+
+/*
+ * Buffered writer, the buffer is written in chunks of PCAPNG_CHUNK_SIZE
+ * bytes as it fills, and at least every flush_period timestamp units if
+ * a chunk is available.
+ */
+typedef struct {
+	uint8_t *buf;
+	uint32_t size;
+	uint32_t len;
+	pcapng_write_t write;
+	void *ctx;
+	uint32_t ts_freq; /* Timestamps unit in Hz */
+	uint64_t flush_period; /* 0 to flush only when the buffer is full */
+	uint64_t last_flush;
+	int8_t if_id[PCAPNG_LINK_END]; /* -1 until the interface is declared */
+	uint8_t nb_if;
+	uint32_t packets;
+	uint32_t dropped;
+	bool error;
+} pcapng_writer_t;
+
+/* Block encoders, return the number of bytes written in buf */
+uint32_t pcapng_shb(uint8_t *buf);
+uint32_t pcapng_idb(uint8_t *buf, pcapng_link_t link);
+uint32_t pcapng_epb_header(uint8_t *buf, uint32_t if_id, uint64_t ts_ns, uint32_t len);
+uint32_t pcapng_epb_trailer(uint8_t *buf, uint32_t len);
+uint32_t pcapng_epb(uint8_t *buf, uint32_t if_id, uint64_t ts_ns,
+		    const uint8_t *data, uint32_t len);
+
+uint64_t pcapng_ts_ns(uint64_t ts, uint32_t ts_freq);
+
+/*
+ * Extends a 32 bits counter (CPU cycles) to 64 bits in *last: ts shall be
+ * less than 2^31 ticks away from the previous one, so the users feed the
+ * current counter while idle.
+ */
+static inline uint64_t pcapng_ts_extend(uint64_t *last, uint32_t ts)
+{
+	*last += (int64_t)(int32_t)(ts - (uint32_t)*last);
+	return *last;
+}
+
+void pcapng_writer_init(pcapng_writer_t *w, uint8_t *buf, uint32_t size,
+			pcapng_write_t write, void *ctx, uint32_t ts_freq);
+bool pcapng_writer_packet(pcapng_writer_t *w, pcapng_link_t link, uint64_t ts,
+			  const uint8_t *data, uint32_t len);
+bool pcapng_writer_flush(pcapng_writer_t *w);
+
+#endif /* _PCAPNG_H_ */
@@ -21,6 +21,9 @@ limitations under the License.
 
 static volatile uint64_t cyclecounter64 = 0;
 
+/* One bit per bsp_timer_t owned by a driver */
+static uint32_t bsp_timers_owned;
+
 /* Enable SCS DWT Cycle Counter for cycle accurate measurements */
 void bsp_scs_dwt_cycle_counter_enabled(void)
 {
@@ -111,6 +114,31 @@ uint32_t bsp_get_apb1_freq(void)
 	return 42000000;
 }
 
+/*
+ TIM8 is used by the sampler, the frequency counter and the ADC stream which
+ can be started from both consoles, TIM3 by the CAN replay of both CAN
+ devices, each one shall own the timer before use.
+*/
+bsp_status_t bsp_timer_acquire(bsp_timer_t timer)
+{
+	bsp_status_t status = BSP_BUSY;
+
+	chSysLock();
+	if(!(bsp_timers_owned & (1UL << timer))) {
+		bsp_timers_owned |= 1UL << timer;
+		status = BSP_OK;
+	}
+	chSysUnlock();
+	return status;
+}
+
+void bsp_timer_release(bsp_timer_t timer)
+{
+	chSysLock();
+	bsp_timers_owned &= ~(1UL << timer);
+	chSysUnlock();
+}
+
 void reboot_usb_dfu(void)
 {
 	/* Assert green LED (PA4) as indicator we are in the bootloader */
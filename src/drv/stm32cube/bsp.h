@@ -17,6 +17,7 @@ limitations under the License.
 
 #include <stdint.h>
 #include "stm32.h"
+#include "bsp_status.h"
 
 /* Internal Cycle Counter */
 typedef volatile uint32_t IOREG32;
@@ -58,15 +59,12 @@ typedef enum {
 } bool;
 #endif
 
-/* Same definition as HAL_StatusTypeDef,
-   used as abstraction layer to avoid dependencies with stm32f4xx_hal_def.h
-*/
+/* Timers used by several drivers, see bsp_timer_acquire() */
 typedef enum {
-	BSP_OK      = 0x00,
-	BSP_ERROR   = 0x01,
-	BSP_BUSY    = 0x02,
-	BSP_TIMEOUT = 0x03
-} bsp_status_t;
+	BSP_TIMER_TIM8 = 0,
+	BSP_TIMER_TIM3,
+	BSP_TIMER_END
+} bsp_timer_t;
 
 /* Returns the number of system ticks since the system boot
  For tick frequency see common/chconf.h/CH_CFG_ST_FREQUENCY
@@ -82,6 +80,12 @@ void wait_delay(uint32_t wait_nb_cycles);
 /* Return APB1 frequency */
 uint32_t bsp_get_apb1_freq(void);
 
+/* Take a shared timer, BSP_BUSY if another driver owns it */
+bsp_status_t bsp_timer_acquire(bsp_timer_t timer);
+
+/* Give back a timer taken with bsp_timer_acquire() */
+void bsp_timer_release(bsp_timer_t timer);
+
 /* Check if UBTN is pressed after reset then enter USB DFU */
 void bsp_enter_usb_dfu(void);
 
@@ -23,6 +23,11 @@ limitations under the License.
 static ADC_HandleTypeDef adc_handle[NB_ADC];
 static ADC_ChannelConfTypeDef adc_chan_conf[NB_ADC];
 
+static TIM_HandleTypeDef adc_stream_htim;
+static const stm32_dma_stream_t *adc_stream_dma;
+static uint32_t adc_stream_nb_samples;
+static volatile uint32_t adc_stream_laps;
+
 extern void DelayUs(uint32_t delay_us);
 
 /** \brief ADC GPIO HW DeInit.
@@ -57,6 +62,32 @@ static void adc_gpio_hw_init(bsp_dev_adc_t dev_num)
 	}
 }
 
+/** \brief ADC channel of a device.
+ *
+ * \param dev_num bsp_dev_adc_t: ADC dev num
+ * \return uint32_t: ADC_CHANNEL_xxx
+ *
+ */
+static uint32_t adc_channel(bsp_dev_adc_t dev_num)
+{
+	switch(dev_num) {
+	case BSP_DEV_ADC1:
+		return ADC_CHANNEL_1;
+
+	case BSP_DEV_ADC_TEMPSENSOR :
+		return ADC_CHANNEL_TEMPSENSOR;
+
+	case BSP_DEV_ADC_VREFINT:
+		return ADC_CHANNEL_VREFINT;
+
+	case BSP_DEV_ADC_VBAT:
+		return ADC_CHANNEL_VBAT;
+
+	default:
+		return ADC_CHANNEL_TEMPSENSOR;
+	}
+}
+
 /** \brief Init ADC device.
  *
  * \param dev_num bsp_dev_adc_t: ADC dev num.
@@ -102,27 +133,7 @@ bsp_status_t bsp_adc_init(bsp_dev_adc_t dev_num)
 	}
 
 	/* Configure ADC regular channel */
-	switch(dev_num) {
-	case BSP_DEV_ADC1:
-		adc_chan_num = ADC_CHANNEL_1;
-		break;
-
-	case BSP_DEV_ADC_TEMPSENSOR :
-		adc_chan_num = ADC_CHANNEL_TEMPSENSOR;
-		break;
-
-	case BSP_DEV_ADC_VREFINT:
-		adc_chan_num = ADC_CHANNEL_VREFINT;
-		break;
-
-	case BSP_DEV_ADC_VBAT:
-		adc_chan_num = ADC_CHANNEL_VBAT;
-		break;
-
-	default:
-		adc_chan_num = ADC_CHANNEL_TEMPSENSOR;
-		break;
-	}
+	adc_chan_num = adc_channel(dev_num);
 
 	hadc_chan = &adc_chan_conf[dev_num];
 	hadc_chan->Channel = adc_chan_num;
@@ -241,3 +252,239 @@ bsp_status_t bsp_adc_trigger(uint32_t low, uint32_t high, uint32_t delay)
 	bsp_adc_deinit(BSP_DEV_ADC1);
 	return status;
 }
+
+/** \brief Sampling time of a device in a stream.
+ *
+ * The temperature sensor, VREFINT and VBAT need 10us of sampling time.
+ *
+ * \param dev_num bsp_dev_adc_t: ADC dev num.
+ * \param cycles uint32_t*: conversion time in ADCCLK cycles.
+ * \return uint32_t: ADC_SAMPLETIME_xxx
+ *
+ */
+static uint32_t adc_stream_sampling_time(bsp_dev_adc_t dev_num, uint32_t *cycles)
+{
+	/* 12 bits conversion */
+	if(dev_num == BSP_DEV_ADC1) {
+		*cycles = 3 + 12;
+		return ADC_SAMPLETIME_3CYCLES;
+	}
+	*cycles = 480 + 12;
+	return ADC_SAMPLETIME_480CYCLES;
+}
+
+/* Split a period in timer clock cycles into 16bits prescaler & autoreload */
+static void adc_stream_split_period(uint32_t period, uint32_t *prescaler, uint32_t *reload)
+{
+	if(period == 0) {
+		period = 1;
+	}
+	*prescaler = (period - 1) / 0x10000 + 1;
+	/* Rounded up, the scans shall not be closer than requested */
+	*reload = (period + *prescaler - 1) / *prescaler;
+}
+
+static void adc_stream_dma_isr(void *p, uint32_t flags)
+{
+	(void)p;
+
+	if(flags & STM32_DMA_ISR_TCIF)
+		adc_stream_laps++;
+}
+
+/** \brief Maximum scan rate of a list of devices.
+ *
+ * \param sources const bsp_dev_adc_t*: ADC dev nums, in scan order.
+ * \param nb_sources uint8_t: number of sources.
+ * \return uint32_t: scans per second, 0 if a source is not valid.
+ *
+ */
+uint32_t bsp_adc_stream_max_rate(const bsp_dev_adc_t *sources, uint8_t nb_sources)
+{
+	uint32_t i, cycles, total = 0;
+
+	for(i = 0; i < nb_sources; i++) {
+		if(sources[i] >= BSP_DEV_ADC_END) {
+			return 0;
+		}
+		adc_stream_sampling_time(sources[i], &cycles);
+		total += cycles;
+	}
+	if(total == 0) {
+		return 0;
+	}
+	return BSP_ADC_CLOCK / total;
+}
+
+/** \brief Start a timer triggered scan of the sources, the results are
+ * written in a circular buffer by the DMA.
+ *
+ * The scans are started by the BSP_ADC_TIMER update event, the timer
+ * period is rounded up so the rate is at most the requested one.
+ *
+ * \param sources const bsp_dev_adc_t*: ADC dev nums, in scan order.
+ * \param nb_sources uint8_t: number of sources (max BSP_ADC_STREAM_MAX_SOURCES).
+ * \param rate uint32_t: scans per second (max bsp_adc_stream_max_rate()).
+ * \param buffer uint16_t*: circular buffer (shall not be in CCM RAM).
+ * \param nb_samples uint32_t: number of samples in buffer, up to 65535.
+ * \return bsp_status_t: BSP_BUSY if the DMA stream or the timer is used.
+ *
+ */
+bsp_status_t bsp_adc_stream_start(const bsp_dev_adc_t *sources, uint8_t nb_sources,
+				  uint32_t rate, uint16_t *buffer, uint32_t nb_samples)
+{
+	ADC_HandleTypeDef* hadc;
+	ADC_ChannelConfTypeDef chan;
+	TIM_MasterConfigTypeDef master;
+	uint32_t prescaler, reload, cycles, i;
+
+	if(nb_sources == 0 || nb_sources > BSP_ADC_STREAM_MAX_SOURCES ||
+	   rate == 0 || rate > bsp_adc_stream_max_rate(sources, nb_sources) ||
+	   nb_samples == 0 || nb_samples > 0xffff) {
+		return BSP_ERROR;
+	}
+
+	if(bsp_timer_acquire(BSP_ADC_TIMER_ID) != BSP_OK) {
+		return BSP_BUSY;
+	}
+	adc_stream_dma = STM32_DMA_STREAM(BSP_ADC1_DMA_STREAM);
+	if(dmaStreamAllocate(adc_stream_dma, BSP_ADC_DMA_IRQ_PRIORITY,
+			     adc_stream_dma_isr, NULL)) {
+		adc_stream_dma = NULL;
+		bsp_timer_release(BSP_ADC_TIMER_ID);
+		return BSP_BUSY;
+	}
+	adc_stream_htim.Instance = BSP_ADC_TIMER;
+
+	bsp_adc_deinit(BSP_DEV_ADC1);
+	for(i = 0; i < nb_sources; i++) {
+		adc_gpio_hw_init(sources[i]);
+	}
+	__ADC1_CLK_ENABLE();
+
+	hadc = &adc_handle[BSP_DEV_ADC1];
+	hadc->Instance = BSP_ADC1;
+	hadc->Init.ClockPrescaler = ADC_CLOCKPRESCALER_PCLK_DIV4;
+	hadc->Init.Resolution = ADC_RESOLUTION12b;
+	hadc->Init.ScanConvMode = ENABLE;
+	hadc->Init.ContinuousConvMode = DISABLE;
+	hadc->Init.DiscontinuousConvMode = DISABLE;
+	hadc->Init.NbrOfDiscConversion = 0;
+	hadc->Init.ExternalTrigConvEdge = ADC_EXTERNALTRIGCONVEDGE_RISING;
+	hadc->Init.ExternalTrigConv = BSP_ADC_TIMER_TRGO;
+	hadc->Init.DataAlign = ADC_DATAALIGN_RIGHT;
+	hadc->Init.NbrOfConversion = nb_sources;
+	hadc->Init.DMAContinuousRequests = ENABLE;
+	hadc->Init.EOCSelection = EOC_SEQ_CONV;
+
+	if(HAL_ADC_Init(hadc) != HAL_OK) {
+		bsp_adc_stream_stop();
+		return BSP_ERROR;
+	}
+
+	for(i = 0; i < nb_sources; i++) {
+		chan.Channel = adc_channel(sources[i]);
+		chan.Rank = i + 1;
+		chan.SamplingTime = adc_stream_sampling_time(sources[i], &cycles);
+		chan.Offset = 0;
+		if(HAL_ADC_ConfigChannel(hadc, &chan) != HAL_OK) {
+			bsp_adc_stream_stop();
+			return BSP_ERROR;
+		}
+	}
+
+	/* The timer is configured first, UG also drives TRGO */
+	BSP_ADC_TIMER_CLK_ENABLE();
+	adc_stream_htim.State = HAL_TIM_STATE_RESET;
+	adc_stream_split_period((BSP_ADC_TIMER_FREQ + rate - 1) / rate, &prescaler, &reload);
+	adc_stream_htim.Init.Period = reload - 1;
+	adc_stream_htim.Init.Prescaler = prescaler - 1;
+	adc_stream_htim.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+	adc_stream_htim.Init.CounterMode = TIM_COUNTERMODE_UP;
+	adc_stream_htim.Init.RepetitionCounter = 0;
+	if(HAL_TIM_Base_Init(&adc_stream_htim) != HAL_OK) {
+		bsp_adc_stream_stop();
+		return BSP_ERROR;
+	}
+	master.MasterOutputTrigger = TIM_TRGO_UPDATE;
+	master.MasterSlaveMode = TIM_MASTERSLAVEMODE_DISABLE;
+	if(HAL_TIMEx_MasterConfigSynchronization(&adc_stream_htim, &master) != HAL_OK) {
+		bsp_adc_stream_stop();
+		return BSP_ERROR;
+	}
+
+	adc_stream_nb_samples = nb_samples;
+	adc_stream_laps = 0;
+	dmaStreamSetPeripheral(adc_stream_dma, &hadc->Instance->DR);
+	dmaStreamSetMemory0(adc_stream_dma, buffer);
+	dmaStreamSetTransactionSize(adc_stream_dma, nb_samples);
+	dmaStreamSetMode(adc_stream_dma,
+			 STM32_DMA_CR_CHSEL(BSP_ADC1_DMA_CHANNEL) |
+			 STM32_DMA_CR_PL(BSP_ADC_DMA_PRIORITY) |
+			 STM32_DMA_CR_DIR_P2M | STM32_DMA_CR_CIRC |
+			 STM32_DMA_CR_PSIZE_HWORD | STM32_DMA_CR_MSIZE_HWORD |
+			 STM32_DMA_CR_MINC | STM32_DMA_CR_TCIE);
+	dmaStreamClearInterrupt(adc_stream_dma);
+	dmaStreamEnable(adc_stream_dma);
+
+	hadc->Instance->CR2 |= ADC_CR2_DMA;
+	__HAL_ADC_ENABLE(hadc);
+	/* ADC stabilization time */
+	DelayUs(3);
+
+	__HAL_TIM_SET_COUNTER(&adc_stream_htim, 0);
+	__HAL_TIM_ENABLE(&adc_stream_htim);
+
+	return BSP_OK;
+}
+
+/** \brief Number of samples written since bsp_adc_stream_start().
+ *
+ * Called from a thread, the count wraps at 2^32.
+ *
+ * \return uint32_t: free running sample count.
+ *
+ */
+uint32_t bsp_adc_stream_count(void)
+{
+	uint32_t laps, pos;
+
+	chSysLock();
+	pos = adc_stream_nb_samples - dmaStreamGetTransactionSize(adc_stream_dma);
+	laps = adc_stream_laps;
+	/* Buffer reloaded, the interrupt has not counted it yet */
+	if(BSP_ADC1_DMA_TC_PENDING() && pos < adc_stream_nb_samples / 2) {
+		laps++;
+	}
+	chSysUnlock();
+
+	return laps * adc_stream_nb_samples + pos;
+}
+
+/** \brief Stop the stream started by bsp_adc_stream_start() and
+ * de-initialize the ADC, the buffer content is kept.
+ *
+ * \return void
+ *
+ */
+void bsp_adc_stream_stop(void)
+{
+	ADC_HandleTypeDef* hadc = &adc_handle[BSP_DEV_ADC1];
+
+	if(adc_stream_dma == NULL) {
+		return;
+	}
+
+	__HAL_TIM_DISABLE(&adc_stream_htim);
+	HAL_TIM_Base_DeInit(&adc_stream_htim);
+	BSP_ADC_TIMER_CLK_DISABLE();
+
+	__HAL_ADC_DISABLE(hadc);
+	hadc->Instance->CR2 &= ~(ADC_CR2_DMA | ADC_CR2_DDS | ADC_CR2_EXTEN);
+	dmaStreamDisable(adc_stream_dma);
+	dmaStreamRelease(adc_stream_dma);
+	adc_stream_dma = NULL;
+	bsp_timer_release(BSP_ADC_TIMER_ID);
+
+	bsp_adc_deinit(BSP_DEV_ADC1);
+}
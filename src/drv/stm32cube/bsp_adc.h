@@ -32,4 +32,13 @@ bsp_status_t bsp_adc_deinit(bsp_dev_adc_t dev_num);
 bsp_status_t bsp_adc_read_u16(bsp_dev_adc_t dev_num, uint16_t* rx_data, uint8_t nb_data);
 bsp_status_t bsp_adc_trigger(uint32_t low, uint32_t high, uint32_t delay);
 
+/* Length of the ADC regular sequence */
+#define BSP_ADC_STREAM_MAX_SOURCES (16)
+
+uint32_t bsp_adc_stream_max_rate(const bsp_dev_adc_t *sources, uint8_t nb_sources);
+bsp_status_t bsp_adc_stream_start(const bsp_dev_adc_t *sources, uint8_t nb_sources,
+				  uint32_t rate, uint16_t *buffer, uint32_t nb_samples);
+uint32_t bsp_adc_stream_count(void);
+void bsp_adc_stream_stop(void);
+
 #endif /* _BSP_ADC_H_ */
@@ -23,6 +23,25 @@ limitations under the License.
 #define BSP_ADC1_PORT         GPIOA
 #define BSP_ADC1_PIN          GPIO_PIN_1 /* PA.1 */
 
+/* ADCCLK = PCLK2 / 4 */
+#define BSP_ADC_CLOCK         (21000000)
+
+/* Stream: the timer update event (TRGO) starts each scan */
+#define BSP_ADC_TIMER             TIM8
+#define BSP_ADC_TIMER_ID          BSP_TIMER_TIM8
+#define BSP_ADC_TIMER_CLK_ENABLE  __TIM8_CLK_ENABLE
+#define BSP_ADC_TIMER_CLK_DISABLE __TIM8_CLK_DISABLE
+#define BSP_ADC_TIMER_TRGO        ADC_EXTERNALTRIGCONV_T8_TRGO
+/* TIM8 is on APB2, timer clock is 2*PCLK2 */
+#define BSP_ADC_TIMER_FREQ        (168000000)
+
+/* ADC1 is DMA2 Stream4 Channel0, see common/mcuconf.h */
+#define BSP_ADC1_DMA_STREAM       STM32_DMA_STREAM_ID(2, 4)
+#define BSP_ADC1_DMA_CHANNEL      0
+#define BSP_ADC1_DMA_TC_PENDING() (DMA2->HISR & DMA_HISR_TCIF4)
+#define BSP_ADC_DMA_PRIORITY      3
+#define BSP_ADC_DMA_IRQ_PRIORITY  10
+
 #if 0
 /* ADC2 */
 #define BSP_ADC2              ADC_CHANNEL_6
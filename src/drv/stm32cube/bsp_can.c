@@ -12,6 +12,7 @@ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
 See the License for the specific language governing permissions and
 limitations under the License.
 */
+#include "common.h"
 #include "bsp_can.h"
 #include "bsp_can_conf.h"
 #include "stm32.h"
@@ -300,8 +301,11 @@ bsp_status_t bsp_can_init(bsp_dev_can_t dev_num, mode_config_proto_t* mode_conf)
 	/* receive FIFO Locked mode */
 	hcan->Init.ReceiveFifoLocked = DISABLE;
 
-	/* transmit FIFO priority */
-	hcan->Init.TransmitFifoPriority = DISABLE;
+	/*
+	 * transmit FIFO priority: frames with the same identifier are sent
+	 * in the request order (ISO-TP consecutive frames)
+	 */
+	hcan->Init.TransmitFifoPriority = ENABLE;
 
 	if(mode_conf->config.can.dev_mode == BSP_CAN_MODE_RO) {
 		hcan->Init.Mode = CAN_MODE_SILENT;
@@ -351,7 +355,7 @@ uint32_t bsp_can_prepare_filter(uint32_t filter_value)
   */
 bsp_status_t bsp_can_init_filter(bsp_dev_can_t dev_num, mode_config_proto_t* mode_conf)
 {
-	CAN_FilterTypeDef hcanfilter;
+	can_filter_bank_t bank;
 	CAN_HandleTypeDef* hcan;
 
 	can_mode_conf[dev_num] = mode_conf;
@@ -359,19 +363,13 @@ bsp_status_t bsp_can_init_filter(bsp_dev_can_t dev_num, mode_config_proto_t* mod
 
 	bsp_status_t status;
 
-	hcanfilter.FilterIdLow = 0;
-	hcanfilter.FilterIdHigh = 0;
-	hcanfilter.FilterMaskIdHigh = 0;
-	hcanfilter.FilterMaskIdLow = 0;
-	hcanfilter.FilterFIFOAssignment = CAN_FILTER_FIFO0;
-	hcanfilter.FilterBank = 14*dev_num;
-	hcanfilter.FilterMode = CAN_FILTERMODE_IDMASK;
-	hcanfilter.FilterScale = CAN_FILTERSCALE_32BIT;
-	hcanfilter.FilterActivation = ENABLE;
-	hcanfilter.SlaveStartFilterBank = 14;
+	bank.mode = CAN_FILTER_MODE_MASK;
+	bank.scale = 32;
+	bank.fr1 = 0;
+	bank.fr2 = 0;
 
 	HAL_CAN_Stop(hcan);
-	status = (bsp_status_t) HAL_CAN_ConfigFilter(hcan, &hcanfilter);
+	status = bsp_can_set_filter_banks(dev_num, &bank, 1);
 	HAL_CAN_Start(hcan);
 
 	return status;
@@ -388,33 +386,82 @@ bsp_status_t bsp_can_init_filter(bsp_dev_can_t dev_num, mode_config_proto_t* mod
 bsp_status_t bsp_can_set_filter(bsp_dev_can_t dev_num,
 				mode_config_proto_t* mode_conf)
 {
-	CAN_FilterTypeDef hcanfilter;
-	CAN_HandleTypeDef* hcan;
-	uint32_t filter_reg;
+	can_filter_bank_t bank;
 
 	can_mode_conf[dev_num] = mode_conf;
-	hcan = &can_handle[dev_num];
 
+	bank.mode = CAN_FILTER_MODE_MASK;
+	bank.scale = 32;
+	bank.fr1 = bsp_can_prepare_filter(mode_conf->config.can.filter_id);
+	bank.fr2 = bsp_can_prepare_filter(mode_conf->config.can.filter_mask);
+
+	return bsp_can_set_filter_banks(dev_num, &bank, 1);
+}
+
+/**
+  * @brief  Program the filter banks of the CAN device, its other banks are
+  *         disabled.
+  * @param  dev_num: CAN dev num.
+  * @param  banks: banks, see can_filter_compile().
+  * @param  nb_banks: number of banks, up to BSP_CAN_FILTER_BANKS.
+  * @retval status of the configuration.
+  */
+bsp_status_t bsp_can_set_filter_banks(bsp_dev_can_t dev_num, const can_filter_bank_t* banks,
+				      uint32_t nb_banks)
+{
+	CAN_FilterTypeDef hcanfilter;
+	CAN_HandleTypeDef* hcan;
+	const can_filter_bank_t* bank;
 	bsp_status_t status;
+	uint32_t i;
 
-	filter_reg = bsp_can_prepare_filter(mode_conf->config.can.filter_id);
-	hcanfilter.FilterIdLow = filter_reg & 0xffff;
-	hcanfilter.FilterIdHigh = filter_reg >> 16;
+	hcan = &can_handle[dev_num];
 
-	filter_reg = bsp_can_prepare_filter(mode_conf->config.can.filter_mask);
-	hcanfilter.FilterMaskIdLow = filter_reg & 0xffff;
-	hcanfilter.FilterMaskIdHigh = filter_reg >> 16;
+	if(nb_banks > BSP_CAN_FILTER_BANKS) {
+		return BSP_ERROR;
+	}
 
 	hcanfilter.FilterFIFOAssignment = CAN_FILTER_FIFO0;
-	hcanfilter.FilterBank = 14*dev_num;
-	hcanfilter.FilterMode = CAN_FILTERMODE_IDMASK;
-	hcanfilter.FilterScale = CAN_FILTERSCALE_32BIT;
-	hcanfilter.FilterActivation = ENABLE;
-	hcanfilter.SlaveStartFilterBank = 14;
+	hcanfilter.SlaveStartFilterBank = BSP_CAN_FILTER_BANKS;
+
+	for(i = 0; i < BSP_CAN_FILTER_BANKS; i++) {
+		hcanfilter.FilterBank = BSP_CAN_FILTER_BANKS * dev_num + i;
+		hcanfilter.FilterMode = CAN_FILTERMODE_IDMASK;
+		hcanfilter.FilterScale = CAN_FILTERSCALE_32BIT;
+		hcanfilter.FilterIdHigh = 0;
+		hcanfilter.FilterIdLow = 0;
+		hcanfilter.FilterMaskIdHigh = 0;
+		hcanfilter.FilterMaskIdLow = 0;
+		hcanfilter.FilterActivation = DISABLE;
+
+		if(i < nb_banks) {
+			bank = &banks[i];
+			if(bank->mode == CAN_FILTER_MODE_LIST) {
+				hcanfilter.FilterMode = CAN_FILTERMODE_IDLIST;
+			}
+			if(bank->scale == 32) {
+				hcanfilter.FilterIdHigh = bank->fr1 >> 16;
+				hcanfilter.FilterIdLow = bank->fr1 & 0xffff;
+				hcanfilter.FilterMaskIdHigh = bank->fr2 >> 16;
+				hcanfilter.FilterMaskIdLow = bank->fr2 & 0xffff;
+			} else {
+				/* The HAL fills FR1 with the "Low" fields */
+				hcanfilter.FilterScale = CAN_FILTERSCALE_16BIT;
+				hcanfilter.FilterIdLow = bank->fr1 & 0xffff;
+				hcanfilter.FilterMaskIdLow = bank->fr1 >> 16;
+				hcanfilter.FilterIdHigh = bank->fr2 & 0xffff;
+				hcanfilter.FilterMaskIdHigh = bank->fr2 >> 16;
+			}
+			hcanfilter.FilterActivation = ENABLE;
+		}
 
-	status = (bsp_status_t) HAL_CAN_ConfigFilter(hcan, &hcanfilter);
+		status = (bsp_status_t) HAL_CAN_ConfigFilter(hcan, &hcanfilter);
+		if(status != BSP_OK) {
+			return status;
+		}
+	}
 
-	return status;
+	return BSP_OK;
 }
 
 /**
@@ -523,3 +570,278 @@ bsp_status_t bsp_can_rxne(bsp_dev_can_t dev_num)
 
 	return HAL_CAN_GetRxFifoFillLevel(hcan, CAN_RX_FIFO0);
 }
+
+/**
+  * @brief  Sends data without waiting for a free mailbox, usable from an
+  *         interrupt.
+  * @param  dev_num: CAN dev num.
+  * @param  tx_msg: CAN frame.
+  * @retval BSP_BUSY if the transmit mailboxes are full.
+  */
+bsp_status_t bsp_can_write_nowait(bsp_dev_can_t dev_num, can_tx_frame* tx_msg)
+{
+	CAN_HandleTypeDef* hcan;
+	uint32_t dummy;
+
+	hcan = &can_handle[dev_num];
+
+	if(HAL_CAN_GetTxMailboxesFreeLevel(hcan) == 0) {
+		return BSP_BUSY;
+	}
+	return (bsp_status_t) HAL_CAN_AddTxMessage(hcan, &(tx_msg->header), tx_msg->data, &dummy);
+}
+
+/**
+  * @brief  Checks if all the transmitted frames are sent
+  * @retval true if the transmit mailboxes are empty
+  */
+bool bsp_can_tx_done(bsp_dev_can_t dev_num)
+{
+	CAN_HandleTypeDef* hcan;
+	hcan = &can_handle[dev_num];
+
+	return HAL_CAN_GetTxMailboxesFreeLevel(hcan) == 3;
+}
+
+/* Frames received by interrupt, see bsp_can_rx_irq_start() */
+typedef struct {
+	bsp_can_rx_cb_t cb;
+	void *arg;
+	uint32_t overruns;
+} can_rx_irq_t;
+static can_rx_irq_t can_rx_irq[NB_CAN];
+
+#define CAN_RX_IRQ_NOTIFICATIONS (CAN_IT_RX_FIFO0_MSG_PENDING | CAN_IT_RX_FIFO0_OVERRUN | \
+				  CAN_IT_RX_FIFO1_MSG_PENDING | CAN_IT_RX_FIFO1_OVERRUN)
+
+static void can_rx_irq_fifo(bsp_dev_can_t dev_num, uint32_t fifo)
+{
+	CAN_HandleTypeDef* hcan = &can_handle[dev_num];
+	can_rx_irq_t* rx = &can_rx_irq[dev_num];
+	volatile uint32_t* rfr;
+	can_rx_frame rx_msg;
+	uint32_t timestamp;
+
+	/* All the frames pending in the FIFO get the interrupt time */
+	timestamp = bsp_get_cyclecounter();
+
+	if(fifo == CAN_RX_FIFO0) {
+		rfr = &hcan->Instance->RF0R;
+	} else {
+		rfr = &hcan->Instance->RF1R;
+	}
+	/* A frame arrived while the 3 slots of the FIFO were used */
+	if(*rfr & CAN_RF0R_FOVR0) {
+		*rfr = CAN_RF0R_FOVR0;
+		rx->overruns++;
+	}
+
+	while((*rfr & CAN_RF0R_FMP0) != 0) {
+		if(HAL_CAN_GetRxMessage(hcan, fifo, &rx_msg.header, rx_msg.data) != HAL_OK)
+			break;
+		if(rx->cb != NULL)
+			rx->cb(rx->arg, &rx_msg, fifo, timestamp);
+	}
+}
+
+OSAL_IRQ_HANDLER(STM32_CAN1_RX0_HANDLER)
+{
+	OSAL_IRQ_PROLOGUE();
+	can_rx_irq_fifo(BSP_DEV_CAN1, CAN_RX_FIFO0);
+	OSAL_IRQ_EPILOGUE();
+}
+
+OSAL_IRQ_HANDLER(STM32_CAN1_RX1_HANDLER)
+{
+	OSAL_IRQ_PROLOGUE();
+	can_rx_irq_fifo(BSP_DEV_CAN1, CAN_RX_FIFO1);
+	OSAL_IRQ_EPILOGUE();
+}
+
+OSAL_IRQ_HANDLER(STM32_CAN2_RX0_HANDLER)
+{
+	OSAL_IRQ_PROLOGUE();
+	can_rx_irq_fifo(BSP_DEV_CAN2, CAN_RX_FIFO0);
+	OSAL_IRQ_EPILOGUE();
+}
+
+OSAL_IRQ_HANDLER(STM32_CAN2_RX1_HANDLER)
+{
+	OSAL_IRQ_PROLOGUE();
+	can_rx_irq_fifo(BSP_DEV_CAN2, CAN_RX_FIFO1);
+	OSAL_IRQ_EPILOGUE();
+}
+
+/**
+  * @brief  Receive the frames of both FIFO by interrupt.
+  *         bsp_can_read() shall not be used until bsp_can_rx_irq_stop().
+  *         The speed and timings shall not be changed meanwhile, they
+  *         reset the controller.
+  * @param  dev_num: CAN dev num.
+  * @param  cb: called from the interrupt for each received frame.
+  * @param  arg: argument of the callback.
+  * @retval status of the notifications activation.
+  */
+bsp_status_t bsp_can_rx_irq_start(bsp_dev_can_t dev_num, bsp_can_rx_cb_t cb, void *arg)
+{
+	CAN_HandleTypeDef* hcan = &can_handle[dev_num];
+	can_rx_irq_t* rx = &can_rx_irq[dev_num];
+
+	rx->cb = cb;
+	rx->arg = arg;
+	rx->overruns = 0;
+
+	if(dev_num == BSP_DEV_CAN1) {
+		nvicEnableVector(STM32_CAN1_RX0_NUMBER, BSP_CAN_IRQ_PRIORITY);
+		nvicEnableVector(STM32_CAN1_RX1_NUMBER, BSP_CAN_IRQ_PRIORITY);
+	} else { /* CAN2 */
+		nvicEnableVector(STM32_CAN2_RX0_NUMBER, BSP_CAN_IRQ_PRIORITY);
+		nvicEnableVector(STM32_CAN2_RX1_NUMBER, BSP_CAN_IRQ_PRIORITY);
+	}
+
+	return (bsp_status_t) HAL_CAN_ActivateNotification(hcan, CAN_RX_IRQ_NOTIFICATIONS);
+}
+
+/**
+  * @brief  Stop the reception started by bsp_can_rx_irq_start().
+  * @param  dev_num: CAN dev num.
+  * @retval None
+  */
+void bsp_can_rx_irq_stop(bsp_dev_can_t dev_num)
+{
+	CAN_HandleTypeDef* hcan = &can_handle[dev_num];
+	can_rx_irq_t* rx = &can_rx_irq[dev_num];
+
+	HAL_CAN_DeactivateNotification(hcan, CAN_RX_IRQ_NOTIFICATIONS);
+	if(dev_num == BSP_DEV_CAN1) {
+		nvicDisableVector(STM32_CAN1_RX0_NUMBER);
+		nvicDisableVector(STM32_CAN1_RX1_NUMBER);
+	} else { /* CAN2 */
+		nvicDisableVector(STM32_CAN2_RX0_NUMBER);
+		nvicDisableVector(STM32_CAN2_RX1_NUMBER);
+	}
+	rx->cb = NULL;
+}
+
+/**
+  * @brief  Number of RX FIFO overruns (frames lost by the controller)
+  *         since bsp_can_rx_irq_start().
+  * @param  dev_num: CAN dev num.
+  * @retval number of overruns
+  */
+uint32_t bsp_can_get_overruns(bsp_dev_can_t dev_num)
+{
+	return can_rx_irq[dev_num].overruns;
+}
+
+/**
+  * @brief  Error status of the controller.
+  * @param  dev_num: CAN dev num.
+  * @retval CAN_ESR register: REC, TEC, last error code and error flags.
+  */
+uint32_t bsp_can_get_errors(bsp_dev_can_t dev_num)
+{
+	CAN_HandleTypeDef* hcan;
+	hcan = &can_handle[dev_num];
+
+	return hcan->Instance->ESR;
+}
+
+static bsp_can_timer_cb_t can_timer_cb;
+static void *can_timer_arg;
+/* Set while the replay timer is owned, see bsp_timer_acquire() */
+static bool can_timer_owned;
+
+OSAL_IRQ_HANDLER(BSP_CAN_TIMER_HANDLER)
+{
+	OSAL_IRQ_PROLOGUE();
+	BSP_CAN_TIMER->SR = ~TIM_SR_CC1IF;
+	if(can_timer_cb != NULL) {
+		can_timer_cb(can_timer_arg);
+	}
+	OSAL_IRQ_EPILOGUE();
+}
+
+/**
+  * @brief  Start the replay timer, a 16 bits counter at 1MHz. The first
+  *         compare interrupt comes right away, the callback sets the next
+  *         ones with bsp_can_timer_set().
+  * @param  cb: called from the compare interrupt.
+  * @param  arg: argument of the callback.
+  * @retval BSP_BUSY if the timer is used by the other CAN device.
+  */
+bsp_status_t bsp_can_timer_start(bsp_can_timer_cb_t cb, void *arg)
+{
+	if(bsp_timer_acquire(BSP_CAN_TIMER_ID) != BSP_OK) {
+		return BSP_BUSY;
+	}
+	can_timer_owned = TRUE;
+
+	can_timer_cb = cb;
+	can_timer_arg = arg;
+
+	BSP_CAN_TIMER_CLK_ENABLE();
+	BSP_CAN_TIMER->CR1 = 0;
+	BSP_CAN_TIMER->PSC = (BSP_CAN_TIMER_CLOCK / 1000000) - 1;
+	BSP_CAN_TIMER->ARR = 0xffff;
+	/* Frozen output compare, the compare value is not preloaded */
+	BSP_CAN_TIMER->CCMR1 = 0;
+	BSP_CAN_TIMER->CNT = 0;
+	BSP_CAN_TIMER->EGR = TIM_EGR_UG;
+	BSP_CAN_TIMER->SR = 0;
+	BSP_CAN_TIMER->CCR1 = 1;
+	BSP_CAN_TIMER->DIER = TIM_DIER_CC1IE;
+	nvicEnableVector(BSP_CAN_TIMER_NUMBER, BSP_CAN_TIMER_IRQ_PRIORITY);
+	BSP_CAN_TIMER->CR1 = TIM_CR1_CEN;
+	return BSP_OK;
+}
+
+/**
+  * @brief  Replay timer counter.
+  * @retval microseconds
+  */
+uint16_t bsp_can_timer_now(void)
+{
+	return BSP_CAN_TIMER->CNT;
+}
+
+/**
+  * @brief  Next replay timer compare interrupt.
+  * @param  compare: counter value, less than 32ms ahead.
+  * @retval None
+  */
+void bsp_can_timer_set(uint16_t compare)
+{
+	BSP_CAN_TIMER->CCR1 = compare;
+}
+
+/**
+  * @brief  Stop the replay timer, can be called from its callback.
+  * @retval None
+  */
+void bsp_can_timer_stop(void)
+{
+	BSP_CAN_TIMER->DIER = 0;
+	BSP_CAN_TIMER->CR1 = 0;
+	BSP_CAN_TIMER->SR = 0;
+	can_timer_cb = NULL;
+}
+
+/**
+  * @brief  Stop the replay timer and give it back, from a thread only.
+  * @retval None
+  */
+void bsp_can_timer_release(void)
+{
+	/* Never started or owned by the other CAN device */
+	if(!can_timer_owned) {
+		return;
+	}
+
+	bsp_can_timer_stop();
+	nvicDisableVector(BSP_CAN_TIMER_NUMBER);
+	BSP_CAN_TIMER_CLK_DISABLE();
+
+	can_timer_owned = FALSE;
+	bsp_timer_release(BSP_CAN_TIMER_ID);
+}
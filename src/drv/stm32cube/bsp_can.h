@@ -18,10 +18,14 @@ limitations under the License.
 
 #include "bsp.h"
 #include "mode_config.h"
+#include "hydrabus_can_filter.h"
 
 #define BSP_CAN_MODE_RO	0
 #define BSP_CAN_MODE_RW	1
 
+/* The 28 filter banks are shared, CAN2 uses the banks from 14 */
+#define BSP_CAN_FILTER_BANKS	14
+
 typedef enum {
 	BSP_DEV_CAN1 = 0,
 	BSP_DEV_CAN2 = 1,
@@ -38,16 +42,30 @@ typedef struct {
 	uint8_t data[8];
 } can_tx_frame;
 
+/*
+ * Called from the RX interrupts for each frame, fifo is CAN_RX_FIFO0/1 and
+ * timestamp is in CPU cycles.
+ */
+typedef void (*bsp_can_rx_cb_t)(void *arg, const can_rx_frame *rx_msg,
+				uint32_t fifo, uint32_t timestamp);
+
+/* Called from the replay timer compare interrupt */
+typedef void (*bsp_can_timer_cb_t)(void *arg);
+
 bsp_status_t bsp_can_init(bsp_dev_can_t dev_num, mode_config_proto_t* mode_conf);
 uint32_t bsp_can_get_speed(bsp_dev_can_t dev_num);
 bsp_status_t bsp_can_set_speed(bsp_dev_can_t dev_num, uint32_t speed);
 bsp_status_t bsp_can_init_filter(bsp_dev_can_t dev_num, mode_config_proto_t* mode_conf);
 bsp_status_t bsp_can_set_filter(bsp_dev_can_t dev_num, mode_config_proto_t* mode_conf);
+bsp_status_t bsp_can_set_filter_banks(bsp_dev_can_t dev_num, const can_filter_bank_t* banks,
+				      uint32_t nb_banks);
 bsp_status_t bsp_can_deinit(bsp_dev_can_t dev_num);
 bsp_status_t bsp_can_write(bsp_dev_can_t dev_num, can_tx_frame* tx_msg);
 bsp_status_t bsp_can_read(bsp_dev_can_t dev_num, can_rx_frame* rx_msg);
 
 bsp_status_t bsp_can_rxne(bsp_dev_can_t dev_num);
+bool bsp_can_tx_done(bsp_dev_can_t dev_num);
+bsp_status_t bsp_can_write_nowait(bsp_dev_can_t dev_num, can_tx_frame* tx_msg);
 uint32_t bsp_can_get_timings(bsp_dev_can_t dev_num);
 bsp_status_t bsp_can_set_timings(bsp_dev_can_t dev_num, mode_config_proto_t* mode_conf);
 bsp_status_t bsp_can_set_ts1(bsp_dev_can_t dev_num, mode_config_proto_t* mode_conf, uint8_t ts1);
@@ -55,5 +73,16 @@ bsp_status_t bsp_can_set_ts2(bsp_dev_can_t dev_num, mode_config_proto_t* mode_co
 bsp_status_t bsp_can_set_sjw(bsp_dev_can_t dev_num, mode_config_proto_t* mode_conf, uint8_t sjw);
 bsp_status_t bsp_can_mode_rw(bsp_dev_can_t dev_num, mode_config_proto_t* mode_conf);
 
+bsp_status_t bsp_can_rx_irq_start(bsp_dev_can_t dev_num, bsp_can_rx_cb_t cb, void *arg);
+void bsp_can_rx_irq_stop(bsp_dev_can_t dev_num);
+uint32_t bsp_can_get_overruns(bsp_dev_can_t dev_num);
+uint32_t bsp_can_get_errors(bsp_dev_can_t dev_num);
+
+bsp_status_t bsp_can_timer_start(bsp_can_timer_cb_t cb, void *arg);
+uint16_t bsp_can_timer_now(void);
+void bsp_can_timer_set(uint16_t compare);
+void bsp_can_timer_stop(void);
+void bsp_can_timer_release(void);
+
 
 #endif /* _BSP_CAN_H_ */
@@ -38,4 +38,18 @@ limitations under the License.
 #define BSP_CAN2_RX_PORT     GPIOB
 #define BSP_CAN2_RX_PIN      GPIO_PIN_5 /* PB.5 */
 
+/* RX FIFO 0/1 interrupts */
+#define BSP_CAN_IRQ_PRIORITY 10
+
+/* Replay timer: 16 bits counter at 1MHz, compare 1 interrupt */
+#define BSP_CAN_TIMER             TIM3
+#define BSP_CAN_TIMER_ID          BSP_TIMER_TIM3
+#define BSP_CAN_TIMER_CLK_ENABLE  __TIM3_CLK_ENABLE
+#define BSP_CAN_TIMER_CLK_DISABLE __TIM3_CLK_DISABLE
+#define BSP_CAN_TIMER_CLOCK       STM32_TIMCLK1
+#define BSP_CAN_TIMER_HANDLER     STM32_TIM3_HANDLER
+#define BSP_CAN_TIMER_NUMBER      STM32_TIM3_NUMBER
+/* Above the RX interrupts, the frames are sent on time */
+#define BSP_CAN_TIMER_IRQ_PRIORITY 4
+
 #endif /* _BSP_CAN_CONF_H_ */
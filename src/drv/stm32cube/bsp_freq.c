@@ -19,6 +19,9 @@ limitations under the License.
 
 #define NB_FREQ (BSP_DEV_freq_END)
 
+/* Set while the FREQ timer is owned, see bsp_timer_acquire() */
+static bool freq_timer_owned;
+
 
 /** \brief FREQ GPIO HW DeInit.
  *
@@ -57,7 +60,7 @@ static void freq_gpio_hw_init(bsp_dev_freq_t dev_num)
 /** \brief Init FREQ device.
  *
  * \param dev_num bsp_dev_freq_t: FREQ dev num.
- * \return bsp_status_t: status of the init.
+ * \return bsp_status_t: status of the init, BSP_BUSY if the timer is used.
  *
  */
 bsp_status_t bsp_freq_init(bsp_dev_freq_t dev_num, uint16_t scale)
@@ -68,6 +71,10 @@ bsp_status_t bsp_freq_init(bsp_dev_freq_t dev_num, uint16_t scale)
 	uint32_t channel;
 
 	bsp_freq_deinit(dev_num);
+	if(bsp_timer_acquire(BSP_FREQ1_TIMER_ID) != BSP_OK) {
+		return BSP_BUSY;
+	}
+	freq_timer_owned = TRUE;
 
 	/* Configure the FREQ (TIM8) peripheral */
 	__TIM8_CLK_ENABLE();
@@ -136,6 +143,11 @@ bsp_status_t bsp_freq_deinit(bsp_dev_freq_t dev_num)
 {
 	TIM_HandleTypeDef  htim;
 
+	/* The timer may be used by another driver */
+	if(!freq_timer_owned) {
+		return BSP_OK;
+	}
+
 	htim.Instance = BSP_FREQ1_TIMER;
 	HAL_TIM_IC_Stop(&htim, TIM_CHANNEL_1);
 	HAL_TIM_IC_Stop(&htim, TIM_CHANNEL_2);
@@ -143,6 +155,8 @@ bsp_status_t bsp_freq_deinit(bsp_dev_freq_t dev_num)
 	/* DeInit the low level hardware: GPIO, CLOCK, NVIC... */
 	freq_gpio_hw_deinit(dev_num);
 
+	freq_timer_owned = FALSE;
+	bsp_timer_release(BSP_FREQ1_TIMER_ID);
 	return BSP_OK;
 }
 
@@ -203,8 +217,9 @@ bsp_status_t bsp_freq_get_values(bsp_dev_freq_t dev_num, uint32_t *freq, uint32_
 	bsp_status_t status;
 	bool sampled = FALSE;
 	while (sampled == FALSE) {
-		if(bsp_freq_init(dev_num, scale) != BSP_OK) {
-			return BSP_ERROR;
+		status = bsp_freq_init(dev_num, scale);
+		if(status != BSP_OK) {
+			return status;
 		}
 		status = bsp_freq_sample(dev_num);
 		if(status == BSP_TIMEOUT) {
@@ -242,8 +257,9 @@ bsp_status_t bsp_freq_get_baudrate(bsp_dev_freq_t dev_num, uint32_t *baudrate)
 	bsp_status_t status;
 	bool sampled = FALSE;
 	while (sampled == FALSE) {
-		if(bsp_freq_init(dev_num, 1) != BSP_OK) {
-			return BSP_ERROR;
+		status = bsp_freq_init(dev_num, 1);
+		if(status != BSP_OK) {
+			return status;
 		}
 		status = bsp_freq_sample(dev_num);
 		if(status == BSP_TIMEOUT) {
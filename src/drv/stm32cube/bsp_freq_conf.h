@@ -20,6 +20,7 @@ limitations under the License.
 /* FREQ1 -> PC6
 */
 #define BSP_FREQ1_TIMER TIM8
+#define BSP_FREQ1_TIMER_ID BSP_TIMER_TIM8
 #define BSP_FREQ1_AF	GPIO_AF3_TIM8
 #define BSP_FREQ1_PORT	GPIOC
 #define BSP_FREQ1_PIN	GPIO_PIN_6 // PC.6
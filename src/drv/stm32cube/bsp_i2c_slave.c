@@ -15,12 +15,26 @@ limitations under the License.
 */
 #include "bsp_i2c_slave.h"
 #include "bsp_i2c_conf.h"
+#include "bsp_sampler.h"
 
 #define I2C_SLAVE_TIMEOUT_MAX (100000) // About 10sec (see common/chconf.h/CH_CFG_ST_FREQUENCY)
 
 #define BSP_I2C_EVENT_START 0b10000000000
 #define BSP_I2C_EVENT_STOP  0b01000000000
 
+/*
+ * Sample period of bsp_i2c_slave_sniff_start() for each
+ * mode_conf->config.i2c.dev_speed, about 10 samples per bit
+ * (in cycles @168MHz).
+ */
+#define I2C_SLAVE_SNIFF_SPEED_MAX (4)
+static const uint32_t i2c_slave_sniff_period[I2C_SLAVE_SNIFF_SPEED_MAX] = {
+	/* 0 50KHz */ 336,
+	/* 1 100KHz */ 168,
+	/* 2 400KHz */ 42,
+	/* 3 1MHz */ 16
+};
+
 /** \brief I2C SW Bit Banging GPIO HW DeInit.
  *
  * \param dev_num bsp_dev_i2c_t: I2C dev num
@@ -258,3 +272,68 @@ bsp_status_t bsp_i2c_slave_sniff(bsp_dev_i2c_t dev_num, uint16_t * rx_value)
 	}
 	return BSP_ERROR;
 }
+
+/** \brief Start the sampling of SCL/SDA by DMA for the streaming sniffer.
+ *
+ * The GPIO port of SCL/SDA is written in loop to samples by the DMA at a
+ * rate depending on mode_conf->config.i2c.dev_speed, the pins shall be set
+ * by bsp_i2c_slave_init() first.
+ *
+ * \param dev_num bsp_dev_i2c_t: I2C dev num.
+ * \param mode_conf mode_config_proto_t*: Mode config proto.
+ * \param samples uint16_t*: samples buffer (shall not be in CCM RAM).
+ * \param nb_samples uint32_t: number of samples in buffer.
+ * \param period uint32_t*: sample period in cycles @168MHz.
+ * \param timestamp uint32_t*: cycle counter at the first sample.
+ * \return bsp_status_t: status of the init.
+ *
+ */
+bsp_status_t bsp_i2c_slave_sniff_start(bsp_dev_i2c_t dev_num, mode_config_proto_t* mode_conf,
+				       uint16_t* samples, uint32_t nb_samples,
+				       uint32_t* period, uint32_t* timestamp)
+{
+	(void) dev_num;
+	bsp_status_t status;
+	uint32_t speed;
+
+	speed = mode_conf->config.i2c.dev_speed;
+	if(speed >= I2C_SLAVE_SNIFF_SPEED_MAX)
+		speed = I2C_SLAVE_SNIFF_SPEED_MAX - 1;
+	*period = i2c_slave_sniff_period[speed];
+
+	status = bsp_sampler_init(*period);
+	if(status != BSP_OK)
+		return status;
+
+	bsp_sampler_set_port(BSP_I2C1_SCL_SDA_GPIO_PORT);
+	*timestamp = bsp_get_cyclecounter() + *period;
+	bsp_sampler_start(samples, nb_samples);
+
+	return BSP_OK;
+}
+
+/** \brief Index of the next sample written by the DMA.
+ *
+ * \param dev_num bsp_dev_i2c_t: I2C dev num.
+ * \return uint32_t: index in the samples buffer.
+ *
+ */
+uint32_t bsp_i2c_slave_sniff_get_index(bsp_dev_i2c_t dev_num)
+{
+	(void) dev_num;
+
+	return bsp_sampler_get_index();
+}
+
+/** \brief Stop the sampling started by bsp_i2c_slave_sniff_start().
+ *
+ * \param dev_num bsp_dev_i2c_t: I2C dev num.
+ * \return void
+ *
+ */
+void bsp_i2c_slave_sniff_stop(bsp_dev_i2c_t dev_num)
+{
+	(void) dev_num;
+
+	bsp_sampler_deinit();
+}
@@ -35,4 +35,10 @@ bsp_status_t bsp_i2c_slave_write_u8(bsp_dev_i2c_t dev_num, uint8_t tx_data, uint
 bsp_status_t bsp_i2c_slave_read_u8(bsp_dev_i2c_t dev_num, uint8_t* rx_data);
 
 bsp_status_t bsp_i2c_slave_sniff(bsp_dev_i2c_t dev_num, uint16_t * rx_value);
+
+bsp_status_t bsp_i2c_slave_sniff_start(bsp_dev_i2c_t dev_num, mode_config_proto_t* mode_conf,
+				       uint16_t* samples, uint32_t nb_samples,
+				       uint32_t* period, uint32_t* timestamp);
+uint32_t bsp_i2c_slave_sniff_get_index(bsp_dev_i2c_t dev_num);
+void bsp_i2c_slave_sniff_stop(bsp_dev_i2c_t dev_num);
 #endif /* _BSP_I2C_SLAVE_H_ */
@@ -0,0 +1,185 @@
+/*
+HydraBus/HydraNFC - Copyright (C) 2014-2020 Benjamin VERNOUX
+HydraBus/HydraNFC - Copyright (C) 2020 Nicolas OBERLI
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "common.h"
+#include "bsp_sampler.h"
+#include "bsp_sampler_conf.h"
+
+/* BSP_SAMPLER */
+static TIM_HandleTypeDef bsp_sampler_htim;
+static const stm32_dma_stream_t *bsp_sampler_dma;
+static uint32_t bsp_sampler_nb_samples;
+static GPIO_TypeDef *bsp_sampler_port;
+
+/* Split a period in timer clock cycles into 16bits prescaler & autoreload */
+static void sampler_split_period(uint32_t period, uint32_t *prescaler, uint32_t *reload)
+{
+	if(period == 0) {
+		period = 1;
+	}
+	*prescaler = (period - 1) / 0x10000 + 1;
+	*reload = period / *prescaler;
+}
+
+/** \brief Init sampling timer and allocate the DMA stream.
+ *
+ * Each timer update event requests one DMA transfer of the port IDR register
+ * into the capture buffer, so the sampling does not depend on CPU load.
+ *
+ * \param period uint32_t: sampling period in timer clock cycles (BSP_SAMPLER_TIMER_FREQ),
+ *        periods above 16bits are split between prescaler and autoreload.
+ * \return bsp_status_t: status of the init, BSP_BUSY if the timer is used.
+ *
+ */
+bsp_status_t bsp_sampler_init(uint32_t period)
+{
+	uint32_t prescaler, reload;
+
+	if(bsp_timer_acquire(BSP_SAMPLER_TIMER_ID) != BSP_OK) {
+		return BSP_BUSY;
+	}
+	bsp_sampler_port = BSP_SAMPLER_PORT;
+	bsp_sampler_dma = STM32_DMA_STREAM(BSP_SAMPLER_DMA_STREAM);
+	if(dmaStreamAllocate(bsp_sampler_dma, BSP_SAMPLER_DMA_PRIORITY, NULL, NULL)) {
+		bsp_sampler_dma = NULL;
+		bsp_timer_release(BSP_SAMPLER_TIMER_ID);
+		return BSP_ERROR;
+	}
+
+	BSP_SAMPLER_TIMER_CLK_ENABLE();
+
+	bsp_sampler_htim.Instance = BSP_SAMPLER_TIMER;
+	bsp_sampler_htim.State = HAL_TIM_STATE_RESET;
+	sampler_split_period(period, &prescaler, &reload);
+	bsp_sampler_htim.Init.Period = reload - 1;
+	bsp_sampler_htim.Init.Prescaler = prescaler - 1;
+	bsp_sampler_htim.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+	bsp_sampler_htim.Init.CounterMode = TIM_COUNTERMODE_UP;
+	bsp_sampler_htim.Init.RepetitionCounter = 0;
+
+	if(HAL_TIM_Base_Init(&bsp_sampler_htim) != HAL_OK) {
+		bsp_sampler_deinit();
+		return BSP_ERROR;
+	}
+	return BSP_OK;
+}
+
+/** \brief Set sampling period.
+ *
+ * \param period uint32_t: sampling period in timer clock cycles (BSP_SAMPLER_TIMER_FREQ),
+ *        periods above 16bits are split between prescaler and autoreload.
+ * \return void
+ *
+ */
+void bsp_sampler_set_period(uint32_t period)
+{
+	uint32_t prescaler, reload;
+
+	sampler_split_period(period, &prescaler, &reload);
+	__HAL_TIM_SET_PRESCALER(&bsp_sampler_htim, prescaler - 1);
+	__HAL_TIM_SET_AUTORELOAD(&bsp_sampler_htim, reload - 1);
+	__HAL_TIM_SET_COUNTER(&bsp_sampler_htim, 0);
+	/* Reload prescaler now instead of at next update event */
+	bsp_sampler_htim.Instance->EGR = TIM_EGR_UG;
+	__HAL_TIM_CLEAR_FLAG(&bsp_sampler_htim, TIM_FLAG_UPDATE);
+}
+
+/** \brief Set the sampled port, BSP_SAMPLER_PORT by default.
+ *
+ * \param port GPIO_TypeDef*: GPIO port (AHB1), used by next bsp_sampler_start().
+ * \return void
+ *
+ */
+void bsp_sampler_set_port(GPIO_TypeDef *port)
+{
+	bsp_sampler_port = port;
+}
+
+/** \brief Start circular capture of the sampled port.
+ *
+ * \param buffer uint16_t*: capture buffer (shall not be in CCM RAM).
+ * \param nb_samples uint32_t: number of samples in buffer (max BSP_SAMPLER_MAX_SAMPLES).
+ * \return void
+ *
+ */
+void bsp_sampler_start(uint16_t *buffer, uint32_t nb_samples)
+{
+	bsp_sampler_nb_samples = nb_samples;
+
+	dmaStreamDisable(bsp_sampler_dma);
+	dmaStreamSetPeripheral(bsp_sampler_dma, &bsp_sampler_port->IDR);
+	dmaStreamSetMemory0(bsp_sampler_dma, buffer);
+	dmaStreamSetTransactionSize(bsp_sampler_dma, nb_samples);
+	dmaStreamSetMode(bsp_sampler_dma,
+			 STM32_DMA_CR_CHSEL(BSP_SAMPLER_DMA_CHANNEL) |
+			 STM32_DMA_CR_PL(BSP_SAMPLER_DMA_PRIORITY) |
+			 STM32_DMA_CR_DIR_P2M | STM32_DMA_CR_CIRC |
+			 STM32_DMA_CR_PSIZE_HWORD | STM32_DMA_CR_MSIZE_HWORD |
+			 STM32_DMA_CR_MINC);
+	dmaStreamClearInterrupt(bsp_sampler_dma);
+	dmaStreamEnable(bsp_sampler_dma);
+
+	__HAL_TIM_SET_COUNTER(&bsp_sampler_htim, 0);
+	__HAL_TIM_ENABLE_DMA(&bsp_sampler_htim, TIM_DMA_UPDATE);
+	__HAL_TIM_ENABLE(&bsp_sampler_htim);
+}
+
+/** \brief Return the index of the next sample which will be written.
+ *
+ * \return uint32_t: index in the capture buffer (0 to nb_samples-1).
+ *
+ */
+uint32_t bsp_sampler_get_index(void)
+{
+	uint32_t remaining;
+
+	remaining = dmaStreamGetTransactionSize(bsp_sampler_dma);
+	if(remaining == 0) {
+		/* Circular mode reload in progress */
+		return 0;
+	}
+	return bsp_sampler_nb_samples - remaining;
+}
+
+/** \brief Stop capture, the buffer content is kept.
+ *
+ * \return void
+ *
+ */
+void bsp_sampler_stop(void)
+{
+	__HAL_TIM_DISABLE(&bsp_sampler_htim);
+	__HAL_TIM_DISABLE_DMA(&bsp_sampler_htim, TIM_DMA_UPDATE);
+	dmaStreamDisable(bsp_sampler_dma);
+}
+
+/** \brief Stop, DeInit and Disable sampling timer & DMA.
+ *
+ * \return void
+ *
+ */
+void bsp_sampler_deinit(void)
+{
+	if(bsp_sampler_dma == NULL) {
+		return;
+	}
+
+	bsp_sampler_stop();
+	HAL_TIM_Base_DeInit(&bsp_sampler_htim);
+	BSP_SAMPLER_TIMER_CLK_DISABLE();
+	dmaStreamRelease(bsp_sampler_dma);
+	bsp_sampler_dma = NULL;
+	bsp_timer_release(BSP_SAMPLER_TIMER_ID);
+}
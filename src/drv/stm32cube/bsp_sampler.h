@@ -0,0 +1,45 @@
+/*
+HydraBus/HydraNFC - Copyright (C) 2014-2020 Benjamin VERNOUX
+HydraBus/HydraNFC - Copyright (C) 2020 Nicolas OBERLI
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef _BSP_SAMPLER_H_
+#define _BSP_SAMPLER_H_
+
+#include "bsp.h"
+
+/* Maximum number of samples in the capture ring (DMA NDTR is 16bits) */
+#define BSP_SAMPLER_MAX_SAMPLES (0xFFFF)
+
+/* Init sampling timer & DMA, period is in timer clock cycles */
+bsp_status_t bsp_sampler_init(uint32_t period);
+
+/* Set sampling period in timer clock cycles */
+void bsp_sampler_set_period(uint32_t period);
+
+/* Set the sampled port (BSP_SAMPLER_PORT after bsp_sampler_init()) */
+void bsp_sampler_set_port(GPIO_TypeDef *port);
+
+/* Start circular capture of the port into buffer (nb_samples 16bits words) */
+void bsp_sampler_start(uint16_t *buffer, uint32_t nb_samples);
+
+/* Return index of the next sample which will be written by the DMA */
+uint32_t bsp_sampler_get_index(void);
+
+/* Stop capture, the buffer content is kept */
+void bsp_sampler_stop(void);
+
+/* Stop, DeInit and Disable sampling timer & DMA */
+void bsp_sampler_deinit(void);
+
+#endif /* _BSP_SAMPLER_H_ */
@@ -0,0 +1,40 @@
+/*
+HydraBus/HydraNFC - Copyright (C) 2014-2020 Benjamin VERNOUX
+HydraBus/HydraNFC - Copyright (C) 2020 Nicolas OBERLI
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _BSP_SAMPLER_CONF_H_
+#define _BSP_SAMPLER_CONF_H_
+
+/* Sampling timer, its update event requests the DMA */
+#define BSP_SAMPLER_TIMER		TIM8
+#define BSP_SAMPLER_TIMER_ID		BSP_TIMER_TIM8
+#define BSP_SAMPLER_TIMER_CLK_ENABLE	__TIM8_CLK_ENABLE
+#define BSP_SAMPLER_TIMER_CLK_DISABLE	__TIM8_CLK_DISABLE
+/* TIM8 is on APB2, timer clock is 2*PCLK2 */
+#define BSP_SAMPLER_TIMER_FREQ		(168000000)
+
+/*
+ * TIM8_UP is DMA2 Stream1 Channel7.
+ * Only DMA2 can reach the AHB1 GPIO registers, and the CCM RAM is not
+ * reachable by any DMA so the capture buffer shall be in main SRAM.
+ */
+#define BSP_SAMPLER_DMA_STREAM		STM32_DMA_STREAM_ID(2, 1)
+#define BSP_SAMPLER_DMA_CHANNEL		7
+#define BSP_SAMPLER_DMA_PRIORITY	3
+
+/* Sampled port (PC0 to PC15) */
+#define BSP_SAMPLER_PORT		GPIOC
+
+#endif /* _BSP_SAMPLER_CONF_H_ */
@@ -14,6 +14,7 @@ limitations under the License.
 */
 #include "bsp_smartcard.h"
 #include "bsp_smartcard_conf.h"
+#include "bsp_xfer.h"
 #include "bsp_gpio.h"
 
 /*
@@ -310,6 +311,46 @@ bsp_status_t bsp_smartcard_write_read_u8(bsp_dev_smartcard_t dev_num, uint8_t* t
 	return status;
 }
 
+/* Polling backend, data is sent then received */
+static bsp_status_t smartcard_xfer_poll(uint32_t dev_num, uint8_t* tx_data,
+					uint8_t* rx_data, uint16_t nb_data)
+{
+	SMARTCARD_HandleTypeDef* hsmartcard;
+	hsmartcard = &smartcard_handle[dev_num];
+
+	bsp_status_t status = BSP_OK;
+	if(tx_data != NULL) {
+		status = (bsp_status_t) HAL_SMARTCARD_Transmit(hsmartcard, tx_data, nb_data, SMARTCARDx_TIMEOUT_MAX);
+	} else {
+		__HAL_SMARTCARD_FLUSH_DRREGISTER(hsmartcard);
+	}
+	if(status == BSP_OK && rx_data != NULL) {
+		status = (bsp_status_t) HAL_SMARTCARD_Receive(hsmartcard, rx_data, nb_data, SMARTCARDx_TIMEOUT_MAX);
+	}
+	if(status != BSP_OK) {
+		smartcard_error(dev_num);
+	}
+	return status;
+}
+
+static const bsp_xfer_ops_t smartcard_xfer_ops = {
+	.poll = smartcard_xfer_poll,
+	.dma = NULL,
+};
+
+/**
+  * @brief  Send and/or receive data in blocking mode.
+  * @param  dev_num: SMARTCARD dev num.
+  * @param  tx_data: Data to send (NULL to only receive).
+  * @param  rx_data: Data to receive (NULL to only send).
+  * @param  nb_data: Number of data to send & receive.
+  * @retval status of the transfer.
+  */
+bsp_status_t bsp_smartcard_transfer(bsp_dev_smartcard_t dev_num, uint8_t* tx_data, uint8_t* rx_data, uint32_t nb_data)
+{
+	return bsp_xfer(&smartcard_xfer_ops, dev_num, tx_data, rx_data, nb_data);
+}
+
 /**
   * @brief  Checks if the SMARTCARD receive buffer is empty
   * @retval 0 if empty, 1 if data
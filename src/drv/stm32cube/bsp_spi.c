@@ -12,8 +12,10 @@ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
 See the License for the specific language governing permissions and
 limitations under the License.
 */
+#include "common.h"
 #include "bsp_spi.h"
 #include "bsp_spi_conf.h"
+#include "bsp_xfer.h"
 
 /*
 Warning in order to use this driver all GPIOs peripherals shall be enabled.
@@ -298,26 +300,205 @@ uint8_t bsp_spi_rxne(bsp_dev_spi_t dev_num)
 	return __HAL_SPI_GET_FLAG(hspi, SPI_FLAG_RXNE);
 }
 
-/**
-  * @brief  Sends a Byte in blocking mode and return the status.
-  * @param  dev_num: SPI dev num.
-  * @param  tx_data: data to send.
-  * @param  nb_data: Number of data to send.
-  * @retval status of the transfer.
-  */
-bsp_status_t bsp_spi_write_u8(bsp_dev_spi_t dev_num, uint8_t* tx_data, uint8_t nb_data)
+/* Polling backend */
+static bsp_status_t spi_xfer_poll(uint32_t dev_num, uint8_t* tx_data,
+				  uint8_t* rx_data, uint16_t nb_data)
 {
 	SPI_HandleTypeDef* hspi;
 	hspi = &spi_handle[dev_num];
 
 	bsp_status_t status;
-	status = (bsp_status_t) HAL_SPI_Transmit(hspi, tx_data, nb_data, SPIx_TIMEOUT_MAX);
+	if(tx_data != NULL && rx_data != NULL) {
+		status = (bsp_status_t) HAL_SPI_TransmitReceive(hspi, tx_data, rx_data, nb_data, SPIx_TIMEOUT_MAX);
+	} else if(tx_data != NULL) {
+		status = (bsp_status_t) HAL_SPI_Transmit(hspi, tx_data, nb_data, SPIx_TIMEOUT_MAX);
+	} else {
+		status = (bsp_status_t) HAL_SPI_Receive(hspi, rx_data, nb_data, SPIx_TIMEOUT_MAX);
+	}
+	if(status != BSP_OK) {
+		spi_error(dev_num);
+	}
+	return status;
+}
+
+/* DMA transfer in progress, see spi_dma_start() */
+typedef struct {
+	const stm32_dma_stream_t *dma_rx;
+	const stm32_dma_stream_t *dma_tx;
+	bool active;
+	uint16_t nb_circular; /* see bsp_spi_rx_circular_start() */
+} spi_dma_t;
+static spi_dma_t spi_dma[NB_SPI];
+
+/*
+ * Start a full duplex DMA transfer (dummy bytes are used for NULL buffers).
+ * Returns BSP_BUSY for buffers in CCM RAM, the caller falls back to polling.
+ */
+static bsp_status_t spi_dma_start(uint32_t dev_num, uint8_t* tx_data,
+				  uint8_t* rx_data, uint16_t nb_data)
+{
+	static const uint8_t tx_dummy = BSP_SPI_DMA_DUMMY;
+	static uint8_t rx_dummy;
+	spi_dma_t* dma = &spi_dma[dev_num];
+	SPI_TypeDef* spi;
+	uint32_t mode_rx, mode_tx;
+
+	if(bsp_xfer_in_ccm(tx_data) || bsp_xfer_in_ccm(rx_data)) {
+		return BSP_BUSY;
+	}
+
+	spi = spi_handle[dev_num].Instance;
+	if(dev_num == BSP_DEV_SPI1) {
+		dma->dma_rx = STM32_DMA_STREAM(BSP_SPI1_DMA_RX_STREAM);
+		dma->dma_tx = STM32_DMA_STREAM(BSP_SPI1_DMA_TX_STREAM);
+		mode_rx = STM32_DMA_CR_CHSEL(BSP_SPI1_DMA_CHANNEL);
+	} else { /* SPI2 */
+		dma->dma_rx = STM32_DMA_STREAM(BSP_SPI2_DMA_RX_STREAM);
+		dma->dma_tx = STM32_DMA_STREAM(BSP_SPI2_DMA_TX_STREAM);
+		mode_rx = STM32_DMA_CR_CHSEL(BSP_SPI2_DMA_CHANNEL);
+	}
+	mode_rx |= STM32_DMA_CR_PL(BSP_SPI_DMA_PRIORITY) |
+		   STM32_DMA_CR_PSIZE_BYTE | STM32_DMA_CR_MSIZE_BYTE;
+	mode_tx = mode_rx | STM32_DMA_CR_DIR_M2P;
+	mode_rx |= STM32_DMA_CR_DIR_P2M;
+
+	/* Streams may be owned by another driver (HydraNFC) */
+	if(dmaStreamAllocate(dma->dma_rx, BSP_SPI_DMA_IRQ_PRIORITY, NULL, NULL)) {
+		return BSP_BUSY;
+	}
+	if(dmaStreamAllocate(dma->dma_tx, BSP_SPI_DMA_IRQ_PRIORITY, NULL, NULL)) {
+		dmaStreamRelease(dma->dma_rx);
+		return BSP_BUSY;
+	}
+
+	dmaStreamSetPeripheral(dma->dma_rx, &spi->DR);
+	if(rx_data != NULL) {
+		dmaStreamSetMemory0(dma->dma_rx, rx_data);
+		mode_rx |= STM32_DMA_CR_MINC;
+	} else {
+		dmaStreamSetMemory0(dma->dma_rx, &rx_dummy);
+	}
+	dmaStreamSetTransactionSize(dma->dma_rx, nb_data);
+	dmaStreamSetMode(dma->dma_rx, mode_rx);
+
+	dmaStreamSetPeripheral(dma->dma_tx, &spi->DR);
+	if(tx_data != NULL) {
+		dmaStreamSetMemory0(dma->dma_tx, tx_data);
+		mode_tx |= STM32_DMA_CR_MINC;
+	} else {
+		dmaStreamSetMemory0(dma->dma_tx, &tx_dummy);
+	}
+	dmaStreamSetTransactionSize(dma->dma_tx, nb_data);
+	dmaStreamSetMode(dma->dma_tx, mode_tx);
+
+	/* Flush stale data & overrun flag */
+	(void)spi->DR;
+	(void)spi->SR;
+
+	dmaStreamEnable(dma->dma_rx);
+	dmaStreamEnable(dma->dma_tx);
+	spi->CR2 |= SPI_CR2_RXDMAEN | SPI_CR2_TXDMAEN;
+	dma->active = true;
+
+	return BSP_OK;
+}
+
+/* Wait end of the DMA transfer started by spi_dma_start() */
+static bsp_status_t spi_dma_wait(uint32_t dev_num)
+{
+	spi_dma_t* dma = &spi_dma[dev_num];
+	SPI_TypeDef* spi;
+	uint32_t tickstart, cr_rx, cr_tx;
+	bsp_status_t status = BSP_OK;
+
+	if(!dma->active) {
+		return BSP_OK;
+	}
+
+	spi = spi_handle[dev_num].Instance;
+	tickstart = HAL_GetTick();
+	for(;;) {
+		/*
+		 * A transfer error (TEIF) disables the stream before the end of
+		 * its transfer, EN is read first as the end also disables it.
+		 */
+		cr_rx = dma->dma_rx->stream->CR;
+		cr_tx = dma->dma_tx->stream->CR;
+		if(dmaStreamGetTransactionSize(dma->dma_rx) == 0) {
+			break;
+		}
+		if(!(cr_rx & STM32_DMA_CR_EN) ||
+		   (!(cr_tx & STM32_DMA_CR_EN) && dmaStreamGetTransactionSize(dma->dma_tx) > 0)) {
+			status = BSP_ERROR;
+			break;
+		}
+		if((HAL_GetTick() - tickstart) > SPIx_TIMEOUT_MAX || hydrabus_ubtn()) {
+			status = BSP_TIMEOUT;
+			break;
+		}
+	}
+
+	spi->CR2 &= ~(SPI_CR2_RXDMAEN | SPI_CR2_TXDMAEN);
+	dmaStreamDisable(dma->dma_tx);
+	dmaStreamDisable(dma->dma_rx);
+	dmaStreamRelease(dma->dma_tx);
+	dmaStreamRelease(dma->dma_rx);
+	dma->active = false;
+
 	if(status != BSP_OK) {
 		spi_error(dev_num);
 	}
 	return status;
 }
 
+/* DMA backend */
+static bsp_status_t spi_xfer_dma(uint32_t dev_num, uint8_t* tx_data,
+				 uint8_t* rx_data, uint16_t nb_data)
+{
+	bsp_status_t status;
+
+	status = spi_dma_start(dev_num, tx_data, rx_data, nb_data);
+	if(status != BSP_OK) {
+		return status;
+	}
+	return spi_dma_wait(dev_num);
+}
+
+static const bsp_xfer_ops_t spi_xfer_ops = {
+	.poll = spi_xfer_poll,
+	.dma = spi_xfer_dma,
+	.dma_threshold = BSP_SPI_DMA_THRESHOLD,
+};
+
+/**
+  * @brief  Send and/or receive data in blocking mode.
+  * @param  dev_num: SPI dev num.
+  * @param  tx_data: Data to send (NULL to send dummy bytes).
+  * @param  rx_data: Data to receive (NULL to drop received bytes).
+  * @param  nb_data: Number of data to send & receive.
+  * @retval status of the transfer.
+  */
+/*
+  Transfers of BSP_SPI_DMA_THRESHOLD bytes or more are done by DMA when the
+  DMA streams are available.
+*/
+bsp_status_t bsp_spi_transfer(bsp_dev_spi_t dev_num, uint8_t* tx_data, uint8_t* rx_data, uint32_t nb_data)
+{
+	return bsp_xfer(&spi_xfer_ops, dev_num, tx_data, rx_data, nb_data);
+}
+
+/**
+  * @brief  Sends a Byte in blocking mode and return the status.
+  * @param  dev_num: SPI dev num.
+  * @param  tx_data: data to send.
+  * @param  nb_data: Number of data to send.
+  * @retval status of the transfer.
+  */
+bsp_status_t bsp_spi_write_u8(bsp_dev_spi_t dev_num, uint8_t* tx_data, uint8_t nb_data)
+{
+	return bsp_spi_transfer(dev_num, tx_data, NULL, nb_data);
+}
+
 /**
   * @brief  Read a Byte in blocking mode and return the status.
   * @param  dev_num: SPI dev num.
@@ -327,15 +508,7 @@ bsp_status_t bsp_spi_write_u8(bsp_dev_spi_t dev_num, uint8_t* tx_data, uint8_t n
   */
 bsp_status_t bsp_spi_read_u8(bsp_dev_spi_t dev_num, uint8_t* rx_data, uint8_t nb_data)
 {
-	SPI_HandleTypeDef* hspi;
-	hspi = &spi_handle[dev_num];
-
-	bsp_status_t status;
-	status = (bsp_status_t) HAL_SPI_Receive(hspi, rx_data, nb_data, SPIx_TIMEOUT_MAX);
-	if(status != BSP_OK) {
-		spi_error(dev_num);
-	}
-	return status;
+	return bsp_spi_transfer(dev_num, NULL, rx_data, nb_data);
 }
 
 /**
@@ -347,14 +520,159 @@ bsp_status_t bsp_spi_read_u8(bsp_dev_spi_t dev_num, uint8_t* rx_data, uint8_t nb
   */
 bsp_status_t bsp_spi_write_read_u8(bsp_dev_spi_t dev_num, uint8_t* tx_data, uint8_t* rx_data, uint8_t nb_data)
 {
-	SPI_HandleTypeDef* hspi;
-	hspi = &spi_handle[dev_num];
+	return bsp_spi_transfer(dev_num, tx_data, rx_data, nb_data);
+}
 
+/**
+  * @brief  Start a transfer, bsp_spi_transfer_wait() shall be called before
+  *         any other access to the SPI device or to the buffers.
+  * @param  dev_num: SPI dev num.
+  * @param  tx_data: Data to send (NULL to send dummy bytes).
+  * @param  rx_data: Data to receive (NULL to drop received bytes).
+  * @param  nb_data: Number of data to send & receive.
+  * @retval status of the transfer.
+  */
+/*
+  If the DMA streams are not available the transfer is done by polling
+  before returning.
+*/
+bsp_status_t bsp_spi_transfer_start(bsp_dev_spi_t dev_num, uint8_t* tx_data, uint8_t* rx_data, uint16_t nb_data)
+{
 	bsp_status_t status;
-	status = (bsp_status_t) HAL_SPI_TransmitReceive(hspi, tx_data, rx_data, nb_data, SPIx_TIMEOUT_MAX);
-	if(status != BSP_OK) {
-		spi_error(dev_num);
+
+	status = spi_dma_start(dev_num, tx_data, rx_data, nb_data);
+	if(status == BSP_BUSY) {
+		status = spi_xfer_poll(dev_num, tx_data, rx_data, nb_data);
 	}
 	return status;
 }
 
+/**
+  * @brief  Wait end of the transfer started by bsp_spi_transfer_start().
+  * @param  dev_num: SPI dev num.
+  * @retval status of the transfer.
+  */
+bsp_status_t bsp_spi_transfer_wait(bsp_dev_spi_t dev_num)
+{
+	return spi_dma_wait(dev_num);
+}
+
+/**
+  * @brief  Start a receive only circular DMA, used by the slave sniffer.
+  *         The received bytes are written in loop to buffer until
+  *         bsp_spi_rx_circular_stop().
+  * @param  dev_num: SPI dev num.
+  * @param  buffer: receive buffer (shall not be in CCM RAM).
+  * @param  nb_data: size of the buffer.
+  * @retval BSP_BUSY if the DMA stream is used.
+  */
+bsp_status_t bsp_spi_rx_circular_start(bsp_dev_spi_t dev_num, uint8_t* buffer, uint16_t nb_data)
+{
+	spi_dma_t* dma = &spi_dma[dev_num];
+	SPI_TypeDef* spi;
+	uint32_t mode;
+
+	spi = spi_handle[dev_num].Instance;
+	if(dev_num == BSP_DEV_SPI1) {
+		dma->dma_rx = STM32_DMA_STREAM(BSP_SPI1_DMA_RX_STREAM);
+		mode = STM32_DMA_CR_CHSEL(BSP_SPI1_DMA_CHANNEL);
+	} else { /* SPI2 */
+		dma->dma_rx = STM32_DMA_STREAM(BSP_SPI2_DMA_RX_STREAM);
+		mode = STM32_DMA_CR_CHSEL(BSP_SPI2_DMA_CHANNEL);
+	}
+	mode |= STM32_DMA_CR_PL(BSP_SPI_DMA_PRIORITY) |
+		STM32_DMA_CR_PSIZE_BYTE | STM32_DMA_CR_MSIZE_BYTE |
+		STM32_DMA_CR_DIR_P2M | STM32_DMA_CR_CIRC | STM32_DMA_CR_MINC;
+
+	if(dmaStreamAllocate(dma->dma_rx, BSP_SPI_DMA_IRQ_PRIORITY, NULL, NULL)) {
+		return BSP_BUSY;
+	}
+
+	dmaStreamSetPeripheral(dma->dma_rx, &spi->DR);
+	dmaStreamSetMemory0(dma->dma_rx, buffer);
+	dmaStreamSetTransactionSize(dma->dma_rx, nb_data);
+	dmaStreamSetMode(dma->dma_rx, mode);
+	dmaStreamClearInterrupt(dma->dma_rx);
+
+	/* Drop a byte received before the start */
+	(void)spi->DR;
+	dmaStreamEnable(dma->dma_rx);
+	spi->CR2 |= SPI_CR2_RXDMAEN;
+	dma->nb_circular = nb_data;
+
+	return BSP_OK;
+}
+
+/**
+  * @brief  Index of the next byte written by the circular DMA.
+  * @param  dev_num: SPI dev num.
+  * @retval index in the buffer (0 to nb_data-1).
+  */
+uint32_t bsp_spi_rx_circular_index(bsp_dev_spi_t dev_num)
+{
+	spi_dma_t* dma = &spi_dma[dev_num];
+	uint32_t remaining;
+
+	remaining = dmaStreamGetTransactionSize(dma->dma_rx);
+	if(remaining == 0) {
+		/* Circular mode reload in progress */
+		return 0;
+	}
+	return dma->nb_circular - remaining;
+}
+
+/**
+  * @brief  Stop the circular DMA started by bsp_spi_rx_circular_start().
+  * @param  dev_num: SPI dev num.
+  * @retval None
+  */
+void bsp_spi_rx_circular_stop(bsp_dev_spi_t dev_num)
+{
+	spi_dma_t* dma = &spi_dma[dev_num];
+	SPI_TypeDef* spi;
+
+	spi = spi_handle[dev_num].Instance;
+	spi->CR2 &= ~SPI_CR2_RXDMAEN;
+	dmaStreamDisable(dma->dma_rx);
+	dmaStreamRelease(dma->dma_rx);
+	dma->nb_circular = 0;
+}
+
+/**
+  * @brief  Call cb on both edges of the Chip Select pin, which is set as
+  *         input (slave mode).
+  * @param  dev_num: SPI dev num.
+  * @param  cb: callback, called from the EXTI interrupt.
+  * @param  arg: argument of the callback.
+  * @retval None
+  */
+void bsp_spi_cs_event_start(bsp_dev_spi_t dev_num, bsp_spi_cs_cb_t cb, void *arg)
+{
+	ioportid_t port;
+	iopadid_t pad;
+
+	if(dev_num == BSP_DEV_SPI1) {
+		port = BSP_SPI1_NSS_PORT;
+		pad = BSP_SPI1_NSS_PAD;
+	} else { /* SPI2 */
+		port = BSP_SPI2_NSS_PORT;
+		pad = BSP_SPI2_NSS_PAD;
+	}
+	palSetPadMode(port, pad, PAL_MODE_INPUT_PULLUP);
+	palEnablePadEvent(port, pad, PAL_EVENT_MODE_BOTH_EDGES);
+	palSetPadCallback(port, pad, cb, arg);
+}
+
+/**
+  * @brief  Stop the Chip Select callback set by bsp_spi_cs_event_start().
+  * @param  dev_num: SPI dev num.
+  * @retval None
+  */
+void bsp_spi_cs_event_stop(bsp_dev_spi_t dev_num)
+{
+	if(dev_num == BSP_DEV_SPI1) {
+		palDisablePadEvent(BSP_SPI1_NSS_PORT, BSP_SPI1_NSS_PAD);
+	} else { /* SPI2 */
+		palDisablePadEvent(BSP_SPI2_NSS_PORT, BSP_SPI2_NSS_PAD);
+	}
+}
@@ -24,6 +24,9 @@ typedef enum {
 	BSP_DEV_SPI_END = 2
 } bsp_dev_spi_t;
 
+/* Chip Select edge callback, see bsp_spi_cs_event_start() */
+typedef void (*bsp_spi_cs_cb_t)(void *arg);
+
 bsp_status_t bsp_spi_init(bsp_dev_spi_t dev_num, mode_config_proto_t* mode_conf);
 bsp_status_t bsp_spi_deinit(bsp_dev_spi_t dev_num);
 
@@ -35,5 +38,14 @@ uint8_t bsp_spi_rxne(bsp_dev_spi_t dev_num);
 bsp_status_t bsp_spi_write_u8(bsp_dev_spi_t dev_num, uint8_t* tx_data, uint8_t nb_data);
 bsp_status_t bsp_spi_read_u8(bsp_dev_spi_t dev_num, uint8_t* rx_data, uint8_t nb_data);
 bsp_status_t bsp_spi_write_read_u8(bsp_dev_spi_t dev_num, uint8_t* tx_data, uint8_t* rx_data, uint8_t nb_data);
+bsp_status_t bsp_spi_transfer(bsp_dev_spi_t dev_num, uint8_t* tx_data, uint8_t* rx_data, uint32_t nb_data);
+bsp_status_t bsp_spi_transfer_start(bsp_dev_spi_t dev_num, uint8_t* tx_data, uint8_t* rx_data, uint16_t nb_data);
+bsp_status_t bsp_spi_transfer_wait(bsp_dev_spi_t dev_num);
+
+bsp_status_t bsp_spi_rx_circular_start(bsp_dev_spi_t dev_num, uint8_t* buffer, uint16_t nb_data);
+uint32_t bsp_spi_rx_circular_index(bsp_dev_spi_t dev_num);
+void bsp_spi_rx_circular_stop(bsp_dev_spi_t dev_num);
+void bsp_spi_cs_event_start(bsp_dev_spi_t dev_num, bsp_spi_cs_cb_t cb, void *arg);
+void bsp_spi_cs_event_stop(bsp_dev_spi_t dev_num);
 
 #endif /* _BSP_SPI_H_ */
@@ -23,6 +23,7 @@ limitations under the License.
 /* SPI1 NSS */
 #define BSP_SPI1_NSS_PORT     GPIOA
 #define BSP_SPI1_NSS_PIN      GPIO_PIN_15  /* PA.15 SW NSS */
+#define BSP_SPI1_NSS_PAD      15
 /* SPI1 SCK */
 #define BSP_SPI1_SCK_PORT     GPIOB
 #define BSP_SPI1_SCK_PIN      GPIO_PIN_3  /* PB.03 */
@@ -40,6 +41,7 @@ limitations under the License.
 /* SPI2 NSS */
 #define BSP_SPI2_NSS_PORT     GPIOC
 #define BSP_SPI2_NSS_PIN      GPIO_PIN_1 /* PC.01 SW NSS */
+#define BSP_SPI2_NSS_PAD      1
 /* SPI2 SCK */
 #define BSP_SPI2_SCK_PORT     GPIOB
 #define BSP_SPI2_SCK_PIN      GPIO_PIN_10 /* PB.10 */
@@ -50,5 +52,19 @@ limitations under the License.
 #define BSP_SPI2_MOSI_PORT    GPIOC
 #define BSP_SPI2_MOSI_PIN     GPIO_PIN_3 /* PC.03 */
 
+/* SPI DMA, see common/mcuconf.h for streams used by ChibiOS drivers */
+#define BSP_SPI1_DMA_RX_STREAM   STM32_DMA_STREAM_ID(2, 0)
+#define BSP_SPI1_DMA_TX_STREAM   STM32_DMA_STREAM_ID(2, 5)
+#define BSP_SPI1_DMA_CHANNEL     3
+#define BSP_SPI2_DMA_RX_STREAM   STM32_DMA_STREAM_ID(1, 3)
+#define BSP_SPI2_DMA_TX_STREAM   STM32_DMA_STREAM_ID(1, 4)
+#define BSP_SPI2_DMA_CHANNEL     0
+#define BSP_SPI_DMA_PRIORITY     2
+#define BSP_SPI_DMA_IRQ_PRIORITY 10
+/* Smaller transfers are done by polling */
+#define BSP_SPI_DMA_THRESHOLD    (32)
+/* Byte sent when there is no data to send */
+#define BSP_SPI_DMA_DUMMY        (0xFF)
+
 #endif /* _BSP_SPI_CONF_H_ */
 
@@ -12,8 +12,10 @@ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
 See the License for the specific language governing permissions and
 limitations under the License.
 */
+#include "common.h"
 #include "bsp_uart.h"
 #include "bsp_uart_conf.h"
+#include "bsp_xfer.h"
 
 /*
 Warning in order to use this driver all GPIOs peripherals shall be enabled.
@@ -322,6 +324,44 @@ bsp_status_t bsp_uart_write_read_u8(bsp_dev_uart_t dev_num, uint8_t* tx_data, ui
 	return status;
 }
 
+/* Polling backend, data is sent then received */
+static bsp_status_t uart_xfer_poll(uint32_t dev_num, uint8_t* tx_data,
+				   uint8_t* rx_data, uint16_t nb_data)
+{
+	UART_HandleTypeDef* huart;
+	huart = &uart_handle[dev_num];
+
+	bsp_status_t status = BSP_OK;
+	if(tx_data != NULL) {
+		status = (bsp_status_t) HAL_UART_Transmit(huart, tx_data, nb_data, UARTx_TIMEOUT_MAX);
+	}
+	if(status == BSP_OK && rx_data != NULL) {
+		status = (bsp_status_t) HAL_UART_Receive(huart, rx_data, nb_data, UARTx_TIMEOUT_MAX);
+	}
+	if(status != BSP_OK) {
+		uart_error(dev_num);
+	}
+	return status;
+}
+
+static const bsp_xfer_ops_t uart_xfer_ops = {
+	.poll = uart_xfer_poll,
+	.dma = NULL,
+};
+
+/**
+  * @brief  Send and/or receive data in blocking mode.
+  * @param  dev_num: UART dev num.
+  * @param  tx_data: Data to send (NULL to only receive).
+  * @param  rx_data: Data to receive (NULL to only send).
+  * @param  nb_data: Number of data to send & receive.
+  * @retval status of the transfer.
+  */
+bsp_status_t bsp_uart_transfer(bsp_dev_uart_t dev_num, uint8_t* tx_data, uint8_t* rx_data, uint32_t nb_data)
+{
+	return bsp_xfer(&uart_xfer_ops, dev_num, tx_data, rx_data, nb_data);
+}
+
 /**
   * @brief  Checks if the UART receive buffer is empty
   * @retval 0 if empty, 1 if data
@@ -381,3 +421,231 @@ uint32_t bsp_uart_get_final_baudrate(bsp_dev_uart_t dev_num)
 	}
 	return final_baudrate;
 }
+
+/* DMA transfers, see bsp_uart_rx_dma_start() and bsp_uart_tx_dma_start() */
+typedef struct {
+	const stm32_dma_stream_t *dma_rx;
+	const stm32_dma_stream_t *dma_tx;
+	bsp_uart_rx_cb_t cb;
+	void *arg;
+	uint16_t nb_rx;
+} uart_dma_t;
+static uart_dma_t uart_dma[NB_UART];
+
+static void uart_rx_dma_isr(void *p, uint32_t flags)
+{
+	uart_dma_t* dma = (uart_dma_t*)p;
+	uint32_t events = 0;
+
+	if(flags & STM32_DMA_ISR_HTIF)
+		events |= BSP_UART_EVENT_HT;
+	if(flags & STM32_DMA_ISR_TCIF)
+		events |= BSP_UART_EVENT_TC;
+	if(events != 0 && dma->cb != NULL)
+		dma->cb(dma->arg, events);
+}
+
+static void uart_irq(bsp_dev_uart_t dev_num)
+{
+	USART_TypeDef* usart = uart_handle[dev_num].Instance;
+	uart_dma_t* dma = &uart_dma[dev_num];
+
+	if(usart->SR & USART_SR_IDLE) {
+		/*
+		 * Cleared by the read of SR then DR, no byte is pending as the
+		 * line has been idle for a frame.
+		 */
+		dummy_read = usart->DR;
+		if(dma->cb != NULL)
+			dma->cb(dma->arg, BSP_UART_EVENT_IDLE);
+	}
+}
+
+OSAL_IRQ_HANDLER(STM32_USART1_HANDLER)
+{
+	OSAL_IRQ_PROLOGUE();
+	uart_irq(BSP_DEV_UART1);
+	OSAL_IRQ_EPILOGUE();
+}
+
+OSAL_IRQ_HANDLER(STM32_USART2_HANDLER)
+{
+	OSAL_IRQ_PROLOGUE();
+	uart_irq(BSP_DEV_UART2);
+	OSAL_IRQ_EPILOGUE();
+}
+
+/**
+  * @brief  Start a circular receive DMA with idle line detection.
+  * @param  dev_num: UART dev num.
+  * @param  buffer: receive ring (shall not be in CCM RAM).
+  * @param  nb_data: size of the ring.
+  * @param  cb: called from the interrupts with BSP_UART_EVENT_xxx when the
+  *         half or the end of the ring is reached and when the line is idle.
+  * @param  arg: argument of the callback.
+  * @retval BSP_BUSY if the DMA stream is used.
+  */
+bsp_status_t bsp_uart_rx_dma_start(bsp_dev_uart_t dev_num, uint8_t* buffer, uint16_t nb_data,
+				   bsp_uart_rx_cb_t cb, void *arg)
+{
+	uart_dma_t* dma = &uart_dma[dev_num];
+	USART_TypeDef* usart = uart_handle[dev_num].Instance;
+	uint32_t mode;
+
+	if(dev_num == BSP_DEV_UART1) {
+		dma->dma_rx = STM32_DMA_STREAM(BSP_UART1_DMA_RX_STREAM);
+		mode = STM32_DMA_CR_CHSEL(BSP_UART1_DMA_CHANNEL);
+	} else { /* UART2 */
+		dma->dma_rx = STM32_DMA_STREAM(BSP_UART2_DMA_RX_STREAM);
+		mode = STM32_DMA_CR_CHSEL(BSP_UART2_DMA_CHANNEL);
+	}
+	mode |= STM32_DMA_CR_PL(BSP_UART_DMA_PRIORITY) |
+		STM32_DMA_CR_PSIZE_BYTE | STM32_DMA_CR_MSIZE_BYTE |
+		STM32_DMA_CR_DIR_P2M | STM32_DMA_CR_CIRC | STM32_DMA_CR_MINC |
+		STM32_DMA_CR_HTIE | STM32_DMA_CR_TCIE;
+
+	if(dmaStreamAllocate(dma->dma_rx, BSP_UART_DMA_IRQ_PRIORITY,
+			     uart_rx_dma_isr, dma)) {
+		return BSP_BUSY;
+	}
+	dma->cb = cb;
+	dma->arg = arg;
+	dma->nb_rx = nb_data;
+
+	dmaStreamSetPeripheral(dma->dma_rx, &usart->DR);
+	dmaStreamSetMemory0(dma->dma_rx, buffer);
+	dmaStreamSetTransactionSize(dma->dma_rx, nb_data);
+	dmaStreamSetMode(dma->dma_rx, mode);
+	dmaStreamClearInterrupt(dma->dma_rx);
+
+	/* Flush old character and flags */
+	dummy_read = usart->SR;
+	dummy_read = usart->DR;
+	dmaStreamEnable(dma->dma_rx);
+	usart->CR3 |= USART_CR3_DMAR;
+	usart->CR1 |= USART_CR1_IDLEIE;
+	if(dev_num == BSP_DEV_UART1) {
+		nvicEnableVector(STM32_USART1_NUMBER, BSP_UART_IRQ_PRIORITY);
+	} else { /* UART2 */
+		nvicEnableVector(STM32_USART2_NUMBER, BSP_UART_IRQ_PRIORITY);
+	}
+
+	return BSP_OK;
+}
+
+/**
+  * @brief  Position of the next byte written by the receive DMA.
+  * @param  dev_num: UART dev num.
+  * @retval index in the ring (0 to nb_data-1, nb_data during the reload).
+  */
+uint32_t bsp_uart_rx_dma_pos(bsp_dev_uart_t dev_num)
+{
+	uart_dma_t* dma = &uart_dma[dev_num];
+
+	return dma->nb_rx - dmaStreamGetTransactionSize(dma->dma_rx);
+}
+
+/**
+  * @brief  Stop the receive DMA started by bsp_uart_rx_dma_start().
+  * @param  dev_num: UART dev num.
+  * @retval None
+  */
+void bsp_uart_rx_dma_stop(bsp_dev_uart_t dev_num)
+{
+	uart_dma_t* dma = &uart_dma[dev_num];
+	USART_TypeDef* usart = uart_handle[dev_num].Instance;
+
+	if(dev_num == BSP_DEV_UART1) {
+		nvicDisableVector(STM32_USART1_NUMBER);
+	} else { /* UART2 */
+		nvicDisableVector(STM32_USART2_NUMBER);
+	}
+	usart->CR1 &= ~USART_CR1_IDLEIE;
+	usart->CR3 &= ~USART_CR3_DMAR;
+	dmaStreamDisable(dma->dma_rx);
+	dmaStreamRelease(dma->dma_rx);
+	dma->cb = NULL;
+}
+
+/**
+  * @brief  Send data by DMA, bsp_uart_tx_dma_busy() tells when the buffer
+  *         can be reused. The DMA stream is kept until bsp_uart_tx_dma_stop().
+  * @param  dev_num: UART dev num.
+  * @param  tx_data: Data to send (shall not be in CCM RAM).
+  * @param  nb_data: Number of data to send.
+  * @retval BSP_BUSY if the DMA stream is used by another driver.
+  */
+bsp_status_t bsp_uart_tx_dma_start(bsp_dev_uart_t dev_num, uint8_t* tx_data, uint16_t nb_data)
+{
+	uart_dma_t* dma = &uart_dma[dev_num];
+	USART_TypeDef* usart = uart_handle[dev_num].Instance;
+	uint32_t mode;
+
+	if(dev_num == BSP_DEV_UART1) {
+		mode = STM32_DMA_CR_CHSEL(BSP_UART1_DMA_CHANNEL);
+	} else { /* UART2 */
+		mode = STM32_DMA_CR_CHSEL(BSP_UART2_DMA_CHANNEL);
+	}
+	mode |= STM32_DMA_CR_PL(BSP_UART_DMA_PRIORITY) |
+		STM32_DMA_CR_PSIZE_BYTE | STM32_DMA_CR_MSIZE_BYTE |
+		STM32_DMA_CR_DIR_M2P | STM32_DMA_CR_MINC;
+
+	if(dma->dma_tx == NULL) {
+		if(dev_num == BSP_DEV_UART1) {
+			dma->dma_tx = STM32_DMA_STREAM(BSP_UART1_DMA_TX_STREAM);
+		} else { /* UART2 */
+			dma->dma_tx = STM32_DMA_STREAM(BSP_UART2_DMA_TX_STREAM);
+		}
+		if(dmaStreamAllocate(dma->dma_tx, BSP_UART_DMA_IRQ_PRIORITY, NULL, NULL)) {
+			dma->dma_tx = NULL;
+			return BSP_BUSY;
+		}
+		dmaStreamSetPeripheral(dma->dma_tx, &usart->DR);
+		usart->CR3 |= USART_CR3_DMAT;
+	}
+
+	dmaStreamDisable(dma->dma_tx);
+	dmaStreamSetMemory0(dma->dma_tx, tx_data);
+	dmaStreamSetTransactionSize(dma->dma_tx, nb_data);
+	dmaStreamSetMode(dma->dma_tx, mode);
+	dmaStreamEnable(dma->dma_tx);
+
+	return BSP_OK;
+}
+
+/**
+  * @brief  Checks if the DMA transfer started by bsp_uart_tx_dma_start()
+  *         is in progress.
+  * @param  dev_num: UART dev num.
+  * @retval TRUE if the data are not all sent to the UART.
+  */
+bool bsp_uart_tx_dma_busy(bsp_dev_uart_t dev_num)
+{
+	uart_dma_t* dma = &uart_dma[dev_num];
+
+	if(dma->dma_tx == NULL)
+		return FALSE;
+	return dmaStreamGetTransactionSize(dma->dma_tx) > 0;
+}
+
+/**
+  * @brief  Wait the end of the DMA transfer and release the DMA stream.
+  * @param  dev_num: UART dev num.
+  * @retval None
+  */
+void bsp_uart_tx_dma_stop(bsp_dev_uart_t dev_num)
+{
+	uart_dma_t* dma = &uart_dma[dev_num];
+	USART_TypeDef* usart = uart_handle[dev_num].Instance;
+
+	if(dma->dma_tx == NULL)
+		return;
+
+	while(bsp_uart_tx_dma_busy(dev_num) && !hydrabus_ubtn()) {
+		chThdYield();
+	}
+	usart->CR3 &= ~USART_CR3_DMAT;
+	dmaStreamDisable(dma->dma_tx);
+	dmaStreamRelease(dma->dma_tx);
+	dma->dma_tx = NULL;
+}
@@ -27,7 +27,11 @@ typedef enum {
 #define BSP_UART_MODE_UART	0
 #define BSP_UART_MODE_LIN	1
 
-#define UART_BRIDGE_BUFF_SIZE 32
+/* Events of the receive DMA callback, see bsp_uart_rx_dma_start() */
+#define BSP_UART_EVENT_HT	(1 << 0) /* Half of the ring reached */
+#define BSP_UART_EVENT_TC	(1 << 1) /* End of the ring reached */
+#define BSP_UART_EVENT_IDLE	(1 << 2) /* Receive line idle */
+typedef void (*bsp_uart_rx_cb_t)(void *arg, uint32_t events);
 
 bsp_status_t bsp_uart_init(bsp_dev_uart_t dev_num, mode_config_proto_t* mode_conf);
 bsp_status_t bsp_uart_deinit(bsp_dev_uart_t dev_num);
@@ -36,10 +40,19 @@ bsp_status_t bsp_uart_write_u8(bsp_dev_uart_t dev_num, uint8_t* tx_data, uint8_t
 bsp_status_t bsp_uart_read_u8(bsp_dev_uart_t dev_num, uint8_t* rx_data, uint8_t nb_data);
 bsp_status_t bsp_uart_read_u8_timeout(bsp_dev_uart_t dev_num, uint8_t* rx_data, uint8_t nb_data, uint32_t timeout);
 bsp_status_t bsp_uart_write_read_u8(bsp_dev_uart_t dev_num, uint8_t* tx_data, uint8_t* rx_data, uint8_t nb_data);
+bsp_status_t bsp_uart_transfer(bsp_dev_uart_t dev_num, uint8_t* tx_data, uint8_t* rx_data, uint32_t nb_data);
 bsp_status_t bsp_uart_rxne(bsp_dev_uart_t dev_num);
 
 uint32_t bsp_uart_get_final_baudrate(bsp_dev_uart_t dev_num);
 
+bsp_status_t bsp_uart_rx_dma_start(bsp_dev_uart_t dev_num, uint8_t* buffer, uint16_t nb_data,
+				   bsp_uart_rx_cb_t cb, void *arg);
+uint32_t bsp_uart_rx_dma_pos(bsp_dev_uart_t dev_num);
+void bsp_uart_rx_dma_stop(bsp_dev_uart_t dev_num);
+bsp_status_t bsp_uart_tx_dma_start(bsp_dev_uart_t dev_num, uint8_t* tx_data, uint16_t nb_data);
+bool bsp_uart_tx_dma_busy(bsp_dev_uart_t dev_num);
+void bsp_uart_tx_dma_stop(bsp_dev_uart_t dev_num);
+
 bsp_status_t bsp_lin_break(bsp_dev_uart_t dev_num);
 
 #endif /* _BSP_UART_H_ */
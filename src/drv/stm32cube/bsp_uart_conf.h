@@ -38,4 +38,16 @@ limitations under the License.
 #define BSP_UART2_RX_PORT     GPIOA
 #define BSP_UART2_RX_PIN      GPIO_PIN_3 /* PA.03 */
 
+/* UART DMA, see common/mcuconf.h for streams used by ChibiOS drivers */
+#define BSP_UART1_DMA_RX_STREAM   STM32_DMA_STREAM_ID(2, 2)
+#define BSP_UART1_DMA_TX_STREAM   STM32_DMA_STREAM_ID(2, 7)
+#define BSP_UART1_DMA_CHANNEL     4
+#define BSP_UART2_DMA_RX_STREAM   STM32_DMA_STREAM_ID(1, 5)
+#define BSP_UART2_DMA_TX_STREAM   STM32_DMA_STREAM_ID(1, 6)
+#define BSP_UART2_DMA_CHANNEL     4
+#define BSP_UART_DMA_PRIORITY     2
+#define BSP_UART_DMA_IRQ_PRIORITY 10
+/* USART IRQ (IDLE line detection), ChibiOS serial/uart drivers shall not use the USART */
+#define BSP_UART_IRQ_PRIORITY     10
+
 #endif /* _BSP_UART_CONF_H_ */
@@ -0,0 +1,65 @@
+/*
+HydraBus/HydraNFC - Copyright (C) 2014-2020 Benjamin VERNOUX
+HydraBus/HydraNFC - Copyright (C) 2020 Nicolas OBERLI
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "bsp_xfer.h"
+
+/*
+ This file only contains the chunking logic, it does not include the HAL
+ so it is also built by host.mk.
+*/
+
+/** \brief Transfer data using the backends of a device.
+ *
+ * \param ops const bsp_xfer_ops_t*: device backends
+ * \param dev_num uint32_t: device number passed to the backends
+ * \param tx_data uint8_t*: data to send (NULL to send dummy data)
+ * \param rx_data uint8_t*: received data (NULL to drop received data)
+ * \param nb_data uint32_t: number of bytes to transfer
+ * \return bsp_status_t: status of the first failed chunk or BSP_OK
+ *
+ */
+bsp_status_t bsp_xfer(const bsp_xfer_ops_t* ops, uint32_t dev_num,
+		      uint8_t* tx_data, uint8_t* rx_data, uint32_t nb_data)
+{
+	bsp_status_t status = BSP_OK;
+	uint32_t chunk;
+
+	while(nb_data > 0) {
+		chunk = nb_data;
+		if(chunk > BSP_XFER_MAX_CHUNK) {
+			chunk = BSP_XFER_MAX_CHUNK;
+		}
+
+		status = BSP_BUSY;
+		if(ops->dma != NULL && chunk >= ops->dma_threshold) {
+			status = ops->dma(dev_num, tx_data, rx_data, chunk);
+		}
+		if(status == BSP_BUSY) {
+			status = ops->poll(dev_num, tx_data, rx_data, chunk);
+		}
+		if(status != BSP_OK) {
+			return status;
+		}
+
+		if(tx_data != NULL) {
+			tx_data += chunk;
+		}
+		if(rx_data != NULL) {
+			rx_data += chunk;
+		}
+		nb_data -= chunk;
+	}
+	return status;
+}
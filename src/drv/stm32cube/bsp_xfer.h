@@ -0,0 +1,54 @@
+/*
+HydraBus/HydraNFC - Copyright (C) 2014-2020 Benjamin VERNOUX
+HydraBus/HydraNFC - Copyright (C) 2020 Nicolas OBERLI
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef _BSP_XFER_H_
+#define _BSP_XFER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "bsp_status.h"
+
+/* HAL and DMA transfer sizes are 16bits */
+#define BSP_XFER_MAX_CHUNK (0xFFFF)
+
+/*
+ * Low level transfer of at most BSP_XFER_MAX_CHUNK bytes.
+ * tx_data or rx_data can be NULL (dummy data sent / received data dropped).
+ * A DMA backend returns BSP_BUSY if the DMA is not available, the transfer
+ * is then done by the polling backend.
+ */
+typedef bsp_status_t (*bsp_xfer_func_t)(uint32_t dev_num, uint8_t* tx_data,
+					uint8_t* rx_data, uint16_t nb_data);
+
+typedef struct {
+	bsp_xfer_func_t poll;	/* Polling backend (mandatory) */
+	bsp_xfer_func_t dma;	/* DMA backend (NULL if not supported) */
+	uint32_t dma_threshold;	/* Minimum chunk size to use DMA */
+} bsp_xfer_ops_t;
+
+/* The CCM RAM (.ram4, 64KB at 0x10000000) is not reachable by the DMA */
+#define BSP_XFER_CCM_BASE (0x10000000)
+#define BSP_XFER_CCM_SIZE (0x10000)
+
+static inline int bsp_xfer_in_ccm(const void* data)
+{
+	return ((uintptr_t)data - BSP_XFER_CCM_BASE) < BSP_XFER_CCM_SIZE;
+}
+
+/* Transfer nb_data bytes in chunks of at most BSP_XFER_MAX_CHUNK bytes */
+bsp_status_t bsp_xfer(const bsp_xfer_ops_t* ops, uint32_t dev_num,
+		      uint8_t* tx_data, uint8_t* rx_data, uint32_t nb_data);
+
+#endif /* _BSP_XFER_H_ */
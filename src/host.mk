@@ -0,0 +1,73 @@
+##############################################################################
+# Host build of the hardware independent modules (protocol parsers,
+# encoders, checksums...) as a static library, to check them and link them
+# in host tools without a board.
+# The tests and benchmarks of test/ are linked with it.
+# Usage: make -f host.mk [host|test|bench] [HOSTCC=clang]
+#
+
+HOSTCC ?= gcc
+HOSTAR ?= ar
+HOSTCFLAGS ?= -O2 -std=gnu89 -Wall -Wextra
+
+HOSTBUILDDIR = build/host
+HOSTLIB = $(HOSTBUILDDIR)/libhydrafw_host.a
+
+include common/common.mk
+include hydrabus/hydrabus.mk
+include hydranfc/hydranfc.mk
+include hydranfc/trf7970a/trf7970a.mk
+include drv/stm32cube/stm32cube.mk
+include test/test.mk
+
+HOSTCSRC = $(COMMONHOSTSRC) \
+           $(HYDRABUSHOSTSRC) \
+           $(HYDRANFCHOSTSRC) \
+           $(STM32CUBEHOSTSRC)
+
+HOSTINC = $(COMMONINC) \
+          $(HYDRABUSINC) \
+          $(HYDRANFCINC) \
+          $(TRFINC) \
+          $(STM32CUBEINC)
+
+HOSTOBJS = $(addprefix $(HOSTBUILDDIR)/obj/, $(notdir $(HOSTCSRC:.c=.o)))
+
+TESTBIN = $(HOSTBUILDDIR)/hydrafw_test
+TESTOBJS = $(addprefix $(HOSTBUILDDIR)/test/, $(notdir $(TESTSRC:.c=.o) $(TESTFWSRC:.c=.o)))
+
+vpath %.c $(sort $(dir $(HOSTCSRC) $(TESTSRC) $(TESTFWSRC)))
+
+.PHONY: host test bench clean-host
+
+host: $(HOSTLIB)
+
+test: $(TESTBIN)
+	@$(TESTBIN) test
+
+bench: $(TESTBIN)
+	@$(TESTBIN) bench
+
+$(HOSTLIB): $(HOSTOBJS)
+	@echo Creating $@
+	@$(HOSTAR) rcs $@ $^
+
+$(TESTBIN): $(TESTOBJS) $(HOSTLIB)
+	@echo Linking $@
+	@$(HOSTCC) $(HOSTCFLAGS) $^ -o $@
+
+$(HOSTBUILDDIR)/obj/%.o: %.c | $(HOSTBUILDDIR)/obj
+	@echo Compiling $(<F)
+	@$(HOSTCC) -c $(HOSTCFLAGS) $(addprefix -I,$(HOSTINC)) -MMD -MP $< -o $@
+
+$(HOSTBUILDDIR)/test/%.o: %.c | $(HOSTBUILDDIR)/test
+	@echo Compiling $(<F)
+	@$(HOSTCC) -c $(HOSTCFLAGS) $(TESTDEFS) $(addprefix -I,$(TESTINC) $(HOSTINC)) -MMD -MP $< -o $@
+
+$(HOSTBUILDDIR)/obj $(HOSTBUILDDIR)/test:
+	@mkdir -p $@
+
+clean-host:
+	@rm -rf $(HOSTBUILDDIR)
+
+-include $(HOSTOBJS:.o=.d) $(TESTOBJS:.o=.d)
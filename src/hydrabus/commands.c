@@ -89,6 +89,7 @@ const t_token_dict tl_dict[] = {
 #ifdef HYDRANFC
 	{ T_NFC, "nfc" },
 	{ T_TYPEA, "typea" },
+	{ T_TYPEB, "typeb" },
 	{ T_VICINITY, "vicinity" },
 	{ T_EMUL_MIFARE, "emul-mifare" },
 	{ T_EMUL_ISO14443A, "emul-3a" },
@@ -99,6 +100,7 @@ const t_token_dict tl_dict[] = {
 	{ T_TRACE_UART1, "trace-uart1" },
 	{ T_FRAME_TIME, "frame-time" },
 	{ T_PCAP, "pcap" },
+	{ T_RECORD, "record" },
 	{ T_BIN, "bin" },
 	{ T_DIRECT_MODE_0, "dm0" },
 	{ T_DIRECT_MODE_1, "dm1" },
@@ -163,6 +165,17 @@ const t_token_dict tl_dict[] = {
 	{ T_CONVENTION, "convention" },
 	{ T_DELAY, "delay" },
 	{ T_MMC, "mmc" },
+	{ T_DUMP, "dump" },
+	{ T_STATS, "stats" },
+	{ T_ADD, "add" },
+	{ T_ISOTP, "isotp" },
+	{ T_TX, "tx" },
+	{ T_RX, "rx" },
+	{ T_BLOCK_SIZE, "block-size" },
+	{ T_STMIN, "stmin" },
+	{ T_REPLAY, "replay" },
+	{ T_RATE, "rate" },
+	{ T_LOOP, "loop" },
 	/* Developer warning add new command(s) here */
 
 	/* BP-compatible commands */
@@ -248,6 +261,68 @@ t_token tokens_mode_brute[] = {
 	{ }
 };
 
+t_token tokens_mode_can_isotp[] = {
+	{
+		T_TX,
+		.arg_type = T_ARG_UINT,
+		.help = "Request identifier"
+	},
+	{
+		T_RX,
+		.arg_type = T_ARG_UINT,
+		.help = "Response identifier"
+	},
+	{
+		T_BLOCK_SIZE,
+		.arg_type = T_ARG_UINT,
+		.help = "Block size sent in the flow control (0: no limit)"
+	},
+	{
+		T_STMIN,
+		.arg_type = T_ARG_UINT,
+		.help = "STmin sent in the flow control"
+	},
+	{
+		T_WRITE,
+		.arg_type = T_ARG_STRING,
+		.help = "Send a request (hex) and print the response"
+	},
+	{ }
+};
+
+t_token tokens_mode_uart_bridge[] = {
+	{
+		T_PCAP,
+		.help = "Also save the received bytes to a pcapng file on the SD card"
+	},
+	{ }
+};
+
+t_token tokens_mode_i2c_sniff[] = {
+	{
+		T_PCAP,
+		.help = "Save to a pcapng file on the SD card"
+	},
+	{ }
+};
+
+t_token tokens_mode_can_replay[] = {
+	{
+		T_ARG_STRING,
+		.help = "Log file (candump -l format)"
+	},
+	{
+		T_RATE,
+		.arg_type = T_ARG_UINT,
+		.help = "Speed in percent of the original timing (default 100)"
+	},
+	{
+		T_LOOP,
+		.help = "Replay until UBTN is pressed"
+	},
+	{ }
+};
+
 t_token tokens_mode_can_filter[] = {
 	{
 		T_ON,
@@ -267,6 +342,11 @@ t_token tokens_mode_can_filter[] = {
 		.arg_type = T_ARG_UINT,
 		.help = "Filter mask"
 	},
+	{
+		T_ADD,
+		.arg_type = T_ARG_STRING,
+		.help = "Add identifiers (123,700-7ff,18daf100-18daf1ff)"
+	},
 	{ }
 };
 
@@ -344,6 +424,10 @@ t_token tokens_mode_nfc_emul_mf_ul[] = {
 };
 
 t_token tokens_mode_nfc_sniff[] = {
+	{
+		T_TYPEB,
+		.help = "Sniff TypeB (ISO14443B) instead of TypeA (text output only)"
+	},
 	{
 		T_TRACE_UART1,
 		.help = "Output realtime sniff trace on UART1(PA9@8.4Mbauds 8N1)"
@@ -366,7 +450,11 @@ t_token tokens_mode_nfc_sniff[] = {
 	},
 	{
 		T_PCAP,
-		.help = "Save output file in Wireshark PCAP format"
+		.help = "Save output file in Wireshark pcapng format"
+	},
+	{
+		T_RECORD,
+		.help = "Save output file as binary records"
 	},
 	{ }
 };
@@ -544,6 +632,7 @@ t_token tokens_mode_uart[] = {
 	},
 	{
 		T_BRIDGE,
+		.subtokens = tokens_mode_uart_bridge,
 		.help = "UART bridge mode"
 	},
 	{
@@ -890,6 +979,24 @@ t_token tokens_mode_can[] = {
 		T_SLCAN,
 		.help = "slcan (LAWICEL) mode"
 	},
+	{
+		T_PCAP,
+		.help = "Capture to a pcapng file on the SD card"
+	},
+	{
+		T_STATS,
+		.help = "Show the last slcan capture statistics"
+	},
+	{
+		T_ISOTP,
+		.subtokens = tokens_mode_can_isotp,
+		.help = "ISO-TP (ISO 15765-2) requests"
+	},
+	{
+		T_REPLAY,
+		.subtokens = tokens_mode_can_replay,
+		.help = "Replay a log file from the SD card at its timing"
+	},
 	{
 		T_EXIT,
 		.help = "Exit CAN mode"
@@ -934,6 +1041,7 @@ t_token tokens_mode_i2c[] = {
 	},
 	{
 		T_SNIFF,
+		.subtokens = tokens_mode_i2c_sniff,
 		.help = "Sniff I2C bus"
 	},
 	{
@@ -1042,6 +1150,15 @@ t_token tokens_i2c[] = {
 	{ T_LSB_FIRST, \
 		.help = "Send/receive LSB first" },
 
+t_token tokens_mode_spi_dump[] = {
+	{
+		T_FILE,
+		.arg_type = T_ARG_STRING,
+		.help = "microSD filename"
+	},
+	{ }
+};
+
 t_token tokens_mode_spi[] = {
 	{
 		T_SHOW,
@@ -1055,6 +1172,11 @@ t_token tokens_mode_spi[] = {
 	},
 	SPI_PARAMETERS
 	/* SPI-specific commands */
+	{
+		T_DUMP,
+		.subtokens = tokens_mode_spi_dump,
+		.help = "Dump SPI flash (JEDEC) to microSD"
+	},
 	{
 		T_READ,
 		.flags = T_FLAG_SUFFIX_TOKEN_DELIM_INT,
@@ -2141,7 +2263,7 @@ t_token tl_tokens[] = {
 		T_SPI,
 		.subtokens = tokens_spi,
 		.help = "SPI mode",
-		.help_full = "Configuration: spi [device (1/2)] [pull (up/down/floating)] [mode (master/slave)] [frequency (value hz/khz/mhz)] [polarity 0/1] [phase 0/1] [msb-first/lsb-first]\r\nInteraction: [cs-on/cs-off] <read/write (value:repeat)> [exit]"
+		.help_full = "Configuration: spi [device (1/2)] [pull (up/down/floating)] [mode (master/slave)] [frequency (value hz/khz/mhz)] [polarity 0/1] [phase 0/1] [msb-first/lsb-first]\r\nInteraction: [cs-on/cs-off] <read/write (value:repeat)> [dump filename <name>] [exit]"
 	},
 	{
 		T_I2C,
@@ -81,6 +81,7 @@ enum {
 #ifdef HYDRANFC
 	T_NFC,
 	T_TYPEA,
+	T_TYPEB,
 	T_VICINITY,
 	T_EMUL_MIFARE,
 	T_EMUL_ISO14443A,
@@ -91,6 +92,7 @@ enum {
 	T_TRACE_UART1,
 	T_FRAME_TIME,
 	T_PCAP,
+	T_RECORD,
 	T_BIN,
 	T_DIRECT_MODE_0,
 	T_DIRECT_MODE_1,
@@ -155,6 +157,17 @@ enum {
 	T_CONVENTION,
 	T_DELAY,
 	T_MMC,
+	T_DUMP,
+	T_STATS,
+	T_ADD,
+	T_ISOTP,
+	T_TX,
+	T_RX,
+	T_BLOCK_SIZE,
+	T_STMIN,
+	T_REPLAY,
+	T_RATE,
+	T_LOOP,
 	/* Developer warning add new command(s) here */
 
 	/* BP-compatible commands */
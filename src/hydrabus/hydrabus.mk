@@ -1,5 +1,6 @@
 # List of all the hydrabus related files.
 HYDRABUSSRC = hydrabus/hydrabus.c \
+            hydrabus/hydrabus_detect.c \
             hydrabus/commands.c \
             hydrabus/hydrabus_adc.c \
             hydrabus/hydrabus_dac.c \
@@ -7,10 +8,13 @@ HYDRABUSSRC = hydrabus/hydrabus.c \
             hydrabus/gpio.c \
             hydrabus/hydrabus_mode.c \
             hydrabus/hydrabus_mode_spi.c \
+            hydrabus/hydrabus_spi_flash.c \
             hydrabus/hydrabus_mode_uart.c \
             hydrabus/hydrabus_mode_smartcard.c \
             hydrabus/hydrabus_mode_i2c.c \
             hydrabus/hydrabus_sump.c \
+            hydrabus/hydrabus_sump_proto.c \
+            hydrabus/hydrabus_sump_trigger.c \
             hydrabus/hydrabus_mode_jtag.c \
             hydrabus/hydrabus_rng.c \
             hydrabus/hydrabus_mode_onewire.c \
@@ -39,7 +43,29 @@ HYDRABUSSRC = hydrabus/hydrabus.c \
             hydrabus/hydrabus_aux.c \
             hydrabus/hydrabus_serprog.c \
             hydrabus/hydrabus_mode_mmc.c \
-            hydrabus/hydrabus_bbio_mmc.c
+            hydrabus/hydrabus_bbio_mmc.c \
+            hydrabus/hydrabus_spi_sniff.c \
+            hydrabus/hydrabus_i2c_sniff.c \
+            hydrabus/hydrabus_uart_ring.c \
+            hydrabus/hydrabus_uart_bridge.c \
+            hydrabus/hydrabus_can_ring.c \
+            hydrabus/hydrabus_can_filter.c \
+            hydrabus/hydrabus_isotp.c \
+            hydrabus/hydrabus_can_replay.c \
+            hydrabus/hydrabus_adc_stream.c
+
+# Files without hardware or RTOS dependencies, also built by host.mk
+HYDRABUSHOSTSRC = hydrabus/hydrabus_detect.c \
+            hydrabus/hydrabus_sump_proto.c \
+            hydrabus/hydrabus_sump_trigger.c \
+            hydrabus/hydrabus_spi_sniff.c \
+            hydrabus/hydrabus_i2c_sniff.c \
+            hydrabus/hydrabus_uart_ring.c \
+            hydrabus/hydrabus_can_ring.c \
+            hydrabus/hydrabus_can_filter.c \
+            hydrabus/hydrabus_isotp.c \
+            hydrabus/hydrabus_can_replay.c \
+            hydrabus/hydrabus_adc_stream.c
 
 # Required include directories
 HYDRABUSINC = ./hydrabus
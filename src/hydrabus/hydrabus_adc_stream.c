@@ -0,0 +1,129 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include "hydrabus_adc_stream.h"
+
+static void put_header(uint8_t *out, uint8_t flags, uint16_t len, uint32_t seq)
+{
+	out[0] = ADC_STREAM_MAGIC;
+	out[1] = flags;
+	out[2] = len & 0xff;
+	out[3] = len >> 8;
+	out[4] = seq & 0xff;
+	out[5] = (seq >> 8) & 0xff;
+	out[6] = (seq >> 16) & 0xff;
+	out[7] = seq >> 24;
+}
+
+/**
+  * @brief  Block size for a rate, whole scans up to max_size samples
+  * @param  nb_sources: samples per scan
+  * @param  rate: scans per second
+  * @param  max_size: maximum block size in samples, at least nb_sources
+  * @retval block size in samples
+  */
+uint32_t adc_stream_block_size(uint32_t nb_sources, uint32_t rate, uint32_t max_size)
+{
+	uint32_t scans = rate / ADC_STREAM_BLOCK_RATE;
+
+	if(scans > max_size / nb_sources)
+		scans = max_size / nb_sources;
+	if(scans == 0)
+		scans = 1;
+	return scans * nb_sources;
+}
+
+/**
+  * @brief  Init the stream state
+  * @param  s: stream state
+  * @param  ring: sample ring (written by the DMA)
+  * @param  ring_size: samples in the ring, multiple of block_size and at
+  *         least twice block_size
+  * @param  block_size: samples per block, up to 32767
+  * @retval None
+  */
+void adc_stream_init(adc_stream_t *s, const uint16_t *ring, uint32_t ring_size,
+		     uint32_t block_size)
+{
+	memset(s, 0, sizeof(*s));
+	s->ring = ring;
+	s->ring_size = ring_size;
+	s->block_size = block_size;
+}
+
+/**
+  * @brief  Frame the next block. The oldest blocks are skipped when the
+  *         DMA may be writing over them: a block is read only if a whole
+  *         block separates it from the DMA write position.
+  * @param  s: stream state
+  * @param  wr: free running count of samples written by the DMA
+  * @param  out: block, ADC_STREAM_BLOCK_BYTES(block_size) bytes
+  * @retval bytes written in out, 0 if no block is complete
+  */
+uint32_t adc_stream_block(adc_stream_t *s, uint32_t wr, uint8_t *out)
+{
+	uint32_t avail = wr - s->rd;
+	uint32_t lost;
+
+	if((int32_t)avail < (int32_t)s->block_size)
+		return 0;
+
+	if(avail > s->ring_size - s->block_size) {
+		lost = (avail - (s->ring_size - s->block_size) + s->block_size - 1) /
+		       s->block_size;
+		s->rd += lost * s->block_size;
+		s->rd_pos = (s->rd_pos + lost * s->block_size) % s->ring_size;
+		s->seq += lost;
+		s->blocks_lost += lost;
+		s->lost = true;
+		/* With a small ring, the next block may not be complete yet */
+		if(avail - lost * s->block_size < s->block_size)
+			return 0;
+	}
+
+	put_header(out, s->lost ? ADC_STREAM_FLAG_LOST : 0,
+		   s->block_size * 2, s->seq);
+	/* The samples are little endian like the CPU */
+	memcpy(&out[sizeof(adc_stream_header_t)], &s->ring[s->rd_pos],
+	       s->block_size * 2);
+
+	s->rd += s->block_size;
+	s->rd_pos += s->block_size;
+	if(s->rd_pos == s->ring_size)
+		s->rd_pos = 0;
+	s->seq++;
+	s->blocks++;
+	s->lost = false;
+
+	return ADC_STREAM_BLOCK_BYTES(s->block_size);
+}
+
+/**
+  * @brief  Frame the end of the stream, the samples of the incomplete
+  *         block are dropped.
+  * @param  s: stream state
+  * @param  out: header, sizeof(adc_stream_header_t) bytes
+  * @retval bytes written in out
+  */
+uint32_t adc_stream_end(adc_stream_t *s, uint8_t *out)
+{
+	put_header(out, ADC_STREAM_FLAG_END | (s->lost ? ADC_STREAM_FLAG_LOST : 0),
+		   0, s->seq);
+	return sizeof(adc_stream_header_t);
+}
@@ -0,0 +1,77 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * ADC stream framing: cuts the sample ring (filled by the circular DMA)
+ * into blocks, each sent to the host after a header with its length and
+ * a sequence number. Blocks overwritten by the DMA before being sent are
+ * skipped with their sequence numbers, so the host sees the drops.
+ * This file does not depend on ChibiOS nor on the HAL.
+ */
+
+#ifndef _HYDRABUS_ADC_STREAM_H_
+#define _HYDRABUS_ADC_STREAM_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define ADC_STREAM_MAGIC	(0x41) /* 'A' */
+
+/* Blocks were lost before this one */
+#define ADC_STREAM_FLAG_LOST	(1 << 0)
+/* End of the stream, no samples */
+#define ADC_STREAM_FLAG_END	(1 << 1)
+
+/*
+ * Block header, little endian. The len bytes which follow are the
+ * samples (uint16_t little endian, 12 bits right aligned), by scans of
+ * all the sources in their order.
+ */
+typedef struct __attribute__ ((packed)) {
+	uint8_t magic;
+	uint8_t flags;
+	uint16_t len;
+	uint32_t seq;
+} adc_stream_header_t;
+
+/* Size of a block of size samples, with its header */
+#define ADC_STREAM_BLOCK_BYTES(size)	(sizeof(adc_stream_header_t) + (size) * 2)
+
+/* Blocks per second aimed at, slow rates send one scan per block */
+#define ADC_STREAM_BLOCK_RATE	(100)
+
+typedef struct {
+	const uint16_t *ring;
+	uint32_t ring_size; /* Samples, multiple of block_size */
+	uint32_t block_size; /* Samples */
+	uint32_t rd; /* Free running count of samples read */
+	uint32_t rd_pos; /* Index in ring */
+	uint32_t seq;
+	bool lost;
+
+	uint32_t blocks;
+	uint32_t blocks_lost;
+} adc_stream_t;
+
+uint32_t adc_stream_block_size(uint32_t nb_sources, uint32_t rate, uint32_t max_size);
+void adc_stream_init(adc_stream_t *s, const uint16_t *ring, uint32_t ring_size,
+		     uint32_t block_size);
+uint32_t adc_stream_block(adc_stream_t *s, uint32_t wr, uint8_t *out);
+uint32_t adc_stream_end(adc_stream_t *s, uint8_t *out);
+
+#endif /* _HYDRABUS_ADC_STREAM_H_ */
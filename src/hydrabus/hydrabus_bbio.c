@@ -107,6 +107,9 @@ int cmd_bbio(t_hydra_console *con)
 			case BBIO_VOLT_CONT:
 				bbio_adc_continuous(con);
 				continue;
+			case BBIO_VOLT_STREAM:
+				bbio_adc_stream(con);
+				continue;
 			case BBIO_FREQ:
 				bbio_freq(con);
 				continue;
@@ -48,6 +48,7 @@
 #define BBIO_VOLT	0b00010100
 #define BBIO_VOLT_CONT	0b00010101
 #define BBIO_FREQ	0b00010110
+#define BBIO_VOLT_STREAM	0b00010111
 
 /*
  * SPI-specific commands
@@ -56,6 +57,8 @@
 #define BBIO_SPI_CS_HIGH	0b00000011
 #define BBIO_SPI_WRITE_READ	0b00000100
 #define BBIO_SPI_WRITE_READ_NCS	0b00000101
+#define BBIO_SPI_SNIFF_PCAPNG	0b00001011
+#define BBIO_SPI_SNIFF_RECORDS	0b00001100
 #define BBIO_SPI_SNIFF_ALL	0b00001101
 #define BBIO_SPI_SNIFF_CS_LOW	0b00001110
 #define BBIO_SPI_SNIFF_CS_HIGH	0b00001111
@@ -78,6 +81,7 @@
 #define BBIO_I2C_ACK_BIT	0b00000110
 #define BBIO_I2C_NACK_BIT	0b00000111
 #define BBIO_I2C_WRITE_READ	0b00001000
+#define BBIO_I2C_START_SNIFF_BIN	0b00001110
 #define BBIO_I2C_START_SNIFF	0b00001111
 #define BBIO_I2C_BULK_WRITE	0b00010000
 #define BBIO_I2C_CONFIG_PERIPH	0b01000000
@@ -93,6 +97,10 @@
 #define BBIO_CAN_FILTER		0b00000110
 #define BBIO_CAN_WRITE		0b00001000
 #define BBIO_CAN_SET_TIMINGS	0b00010000
+#define BBIO_CAN_FILTER_CLEAR	0b00010001
+#define BBIO_CAN_FILTER_ADD	0b00010010
+#define BBIO_CAN_ISOTP_CONFIG	0b00010011
+#define BBIO_CAN_ISOTP_REQUEST	0b00010100
 #define BBIO_CAN_SET_SPEED	0b01100000
 #define BBIO_CAN_SLCAN		0b10100000
 
@@ -21,6 +21,7 @@
 
 #include "hydrabus_bbio.h"
 #include "bsp_adc.h"
+#include "hydrabus_adc_stream.h"
 
 void bbio_adc(t_hydra_console *con)
 {
@@ -47,3 +48,66 @@ void bbio_adc_continuous(t_hydra_console *con)
 	}
 	bsp_adc_deinit(BSP_DEV_ADC1);
 }
+
+#define ADC_STREAM_RING_SIZE	(0x2000) /* Samples */
+#define ADC_STREAM_BLOCK_MAX	(256) /* Samples */
+
+/*
+ * Parameters: rate (scans per second, 4 bytes big endian), number of
+ * sources (1 byte), then the sources (1 byte each, bsp_dev_adc_t) in scan
+ * order. Replies 0x01 then streams blocks (see hydrabus_adc_stream.h)
+ * until BBIO_RESET is received and the END block is sent, or 0x00 if the
+ * parameters are not valid.
+ */
+void bbio_adc_stream(t_hydra_console *con)
+{
+	bsp_dev_adc_t sources[BSP_ADC_STREAM_MAX_SOURCES];
+	uint8_t rx_buff[5], src, cmd=1;
+	uint32_t rate, nb_sources, block_size, ring_size, len, i;
+	uint16_t *ring;
+	uint8_t *out;
+	adc_stream_t s;
+	bsp_status_t status = BSP_ERROR;
+
+	chnRead(con->sdu, rx_buff, 5);
+	rate = (rx_buff[0] << 24) | (rx_buff[1] << 16) | (rx_buff[2] << 8) | rx_buff[3];
+	nb_sources = rx_buff[4];
+	for(i = 0; i < nb_sources; i++) {
+		chnRead(con->sdu, &src, 1);
+		if(i < BSP_ADC_STREAM_MAX_SOURCES)
+			sources[i] = src;
+	}
+
+	/* Read by the DMA */
+	ring = pool_alloc_bytes(ADC_STREAM_RING_SIZE * sizeof(uint16_t));
+	out = pool_alloc_bytes(ADC_STREAM_BLOCK_BYTES(ADC_STREAM_BLOCK_MAX));
+	if(nb_sources > 0 && nb_sources <= BSP_ADC_STREAM_MAX_SOURCES &&
+	   ring != NULL && out != NULL) {
+		block_size = adc_stream_block_size(nb_sources, rate, ADC_STREAM_BLOCK_MAX);
+		ring_size = ADC_STREAM_RING_SIZE / block_size * block_size;
+		adc_stream_init(&s, ring, ring_size, block_size);
+		status = bsp_adc_stream_start(sources, nb_sources, rate, ring, ring_size);
+	}
+	if(status != BSP_OK) {
+		cprint(con, "\x00", 1);
+		goto end;
+	}
+	cprint(con, "\x01", 1);
+
+	while(cmd != BBIO_RESET) {
+		len = adc_stream_block(&s, bsp_adc_stream_count(), out);
+		if(len > 0) {
+			cprint(con, (char *)out, len);
+			chnReadTimeout(con->sdu, &cmd, 1, TIME_IMMEDIATE);
+		} else {
+			chnReadTimeout(con->sdu, &cmd, 1, 1);
+		}
+	}
+	bsp_adc_stream_stop();
+	len = adc_stream_end(&s, out);
+	cprint(con, (char *)out, len);
+
+end:
+	pool_free(ring);
+	pool_free(out);
+}
@@ -19,3 +19,4 @@
 
 void bbio_adc(t_hydra_console *con);
 void bbio_adc_continuous(t_hydra_console *con);
+void bbio_adc_stream(t_hydra_console *con);
@@ -39,6 +39,14 @@ static void bbio_can_init_proto_default(t_hydra_console *con)
 
 	/* TS1 = 15TQ, TS2 = 5TQ, SJW = 2TQ */
 	proto->config.can.dev_timing = 0x14e0000;
+
+	proto->config.can.nb_filter_rules = 0;
+
+	proto->config.can.isotp.tx_id = 0x7e0;
+	proto->config.can.isotp.rx_id = 0x7e8;
+	proto->config.can.isotp.flags = ISOTP_FLAG_PAD;
+	proto->config.can.isotp.block_size = 0;
+	proto->config.can.isotp.stmin = 0;
 }
 
 static void print_raw_uint32(t_hydra_console *con, uint32_t num)
@@ -49,6 +57,52 @@ static void print_raw_uint32(t_hydra_console *con, uint32_t num)
 		(num&0xFF));
 }
 
+/*
+ * ISO-TP request: length (16 bits), PDU, response timeout in ms (16 bits),
+ * all big endian. Answers 0x01, response length (16 bits) and response or
+ * 0x00. A 0 length only waits for a response, a 0 timeout only sends.
+ */
+static void bbio_can_isotp_request(t_hydra_console *con)
+{
+	mode_config_proto_t* proto = &con->mode->proto;
+	uint8_t hdr[2], *buf;
+	uint16_t len, timeout, i;
+	bsp_status_t status = BSP_ERROR;
+	bool valid;
+
+	chnRead(con->sdu, hdr, 2);
+	len = (hdr[0] << 8) | hdr[1];
+
+	buf = pool_alloc_ccm(ISOTP_MAX_PDU);
+	valid = (buf != NULL && len <= ISOTP_MAX_PDU);
+	if(valid) {
+		chnRead(con->sdu, buf, len);
+	} else {
+		/* Drop the request */
+		for(i = 0; i < len; i++) {
+			chnRead(con->sdu, hdr, 1);
+		}
+	}
+	chnRead(con->sdu, hdr, 2);
+	timeout = (hdr[0] << 8) | hdr[1];
+
+	if(valid) {
+		status = can_isotp_request(proto, buf, &len, timeout);
+	}
+	if(status == BSP_OK) {
+		hdr[0] = len >> 8;
+		hdr[1] = len & 0xff;
+		cprint(con, "\x01", 1);
+		cprint(con, (char *)hdr, 2);
+		cprint(con, (char *)buf, len);
+	} else {
+		cprint(con, "\x00", 1);
+	}
+	if(buf != NULL) {
+		pool_free(buf);
+	}
+}
+
 static void bbio_mode_id(t_hydra_console *con)
 {
 	cprint(con, BBIO_CAN_HEADER, 4);
@@ -60,10 +114,11 @@ void bbio_mode_can(t_hydra_console *con)
 	bsp_status_t status;
 	mode_config_proto_t* proto = &con->mode->proto;
 
-	uint8_t rx_buff[10], i, to_tx;
+	uint8_t rx_buff[11], i, to_tx;
 	can_tx_frame tx_msg;
 	can_rx_frame rx_msg;
 	uint32_t can_id=0;
+	can_filter_rule_t rule;
 
 	proto->dev_num = 0;
 	proto->config.can.dev_speed = 500000;
@@ -92,6 +147,7 @@ void bbio_mode_can(t_hydra_console *con)
 				cprint(con, "\x01", 1);
 				break;
 			case BBIO_CAN_FILTER_OFF:
+				proto->config.can.nb_filter_rules = 0;
 				status = bsp_can_init_filter(proto->dev_num, proto);
 					if(status == BSP_OK) {
 						cprint(con, "\x01", 1);
@@ -100,6 +156,7 @@ void bbio_mode_can(t_hydra_console *con)
 					}
 				break;
 			case BBIO_CAN_FILTER_ON:
+				proto->config.can.nb_filter_rules = 0;
 				status = bsp_can_set_filter(proto->dev_num, proto);
 				if(status == BSP_OK) {
 					cprint(con, "\x01", 1);
@@ -107,6 +164,57 @@ void bbio_mode_can(t_hydra_console *con)
 					cprint(con, "\x00", 1);
 				}
 				break;
+			case BBIO_CAN_FILTER_CLEAR:
+				proto->config.can.nb_filter_rules = 0;
+				status = can_set_filter_rules(proto);
+				if(status == BSP_OK) {
+					cprint(con, "\x01", 1);
+				} else {
+					cprint(con, "\x00", 1);
+				}
+				break;
+			case BBIO_CAN_FILTER_ADD:
+				/* First and last identifiers (big endian), flags */
+				chnRead(con->sdu, rx_buff, 9);
+				rule.first =  rx_buff[0] << 24;
+				rule.first |= rx_buff[1] << 16;
+				rule.first |= rx_buff[2] << 8;
+				rule.first |= rx_buff[3];
+				rule.last =  rx_buff[4] << 24;
+				rule.last |= rx_buff[5] << 16;
+				rule.last |= rx_buff[6] << 8;
+				rule.last |= rx_buff[7];
+				rule.flags = rx_buff[8];
+				status = BSP_ERROR;
+				if(rule.first <= rule.last &&
+				   rule.last <= ((rule.flags & CAN_FILTER_EXT) ? 0x1fffffff : 0x7ff)) {
+					status = can_add_filter_rules(proto, &rule, 1);
+				}
+				if(status == BSP_OK) {
+					cprint(con, "\x01", 1);
+				} else {
+					cprint(con, "\x00", 1);
+				}
+				break;
+			case BBIO_CAN_ISOTP_CONFIG:
+				/* TX and RX identifiers (big endian), flags, block size, STmin */
+				chnRead(con->sdu, rx_buff, 11);
+				proto->config.can.isotp.tx_id =  rx_buff[0] << 24;
+				proto->config.can.isotp.tx_id |= rx_buff[1] << 16;
+				proto->config.can.isotp.tx_id |= rx_buff[2] << 8;
+				proto->config.can.isotp.tx_id |= rx_buff[3];
+				proto->config.can.isotp.rx_id =  rx_buff[4] << 24;
+				proto->config.can.isotp.rx_id |= rx_buff[5] << 16;
+				proto->config.can.isotp.rx_id |= rx_buff[6] << 8;
+				proto->config.can.isotp.rx_id |= rx_buff[7];
+				proto->config.can.isotp.flags = rx_buff[8];
+				proto->config.can.isotp.block_size = rx_buff[9];
+				proto->config.can.isotp.stmin = rx_buff[10];
+				cprint(con, "\x01", 1);
+				break;
+			case BBIO_CAN_ISOTP_REQUEST:
+				bbio_can_isotp_request(con);
+				break;
 			case BBIO_CAN_READ:
 				status = bsp_can_read(proto->dev_num, &rx_msg);
 				if(status == BSP_OK) {
@@ -201,6 +309,7 @@ void bbio_mode_can(t_hydra_console *con)
 						proto->config.can.filter_mask |= rx_buff[2] << 8;
 						proto->config.can.filter_mask |= rx_buff[3];
 					}
+					proto->config.can.nb_filter_rules = 0;
 					status = bsp_can_set_filter(proto->dev_num, proto);
 					if(status == BSP_OK) {
 						cprint(con, "\x01", 1);
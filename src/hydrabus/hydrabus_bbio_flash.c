@@ -39,8 +39,8 @@ void bbio_mode_flash(t_hydra_console *con)
 	FIL outfile;
 	uint32_t to_rx, to_tx, i;
 	uint8_t bbio_subcommand;
-	uint8_t *tx_data = pool_alloc_bytes(0x1000); // 4096 bytes
-	uint8_t *rx_data = pool_alloc_bytes(0x1000); // 4096 bytes
+	uint8_t *tx_data = pool_alloc_ccm(0x1000); // 4096 bytes
+	uint8_t *rx_data = pool_alloc_ccm(0x1000); // 4096 bytes
 	bool to_sd = FALSE;
 
 	if(tx_data == 0 || rx_data == 0) {
@@ -26,7 +26,7 @@ void bbio_freq(t_hydra_console *con)
 {
 	uint32_t frequency, duty;
 
-	if(bsp_freq_get_values(BSP_DEV_FREQ1, &frequency, &duty) == TRUE) {
+	if(bsp_freq_get_values(BSP_DEV_FREQ1, &frequency, &duty) == BSP_OK) {
 		cprint(con, (char *)&frequency, 4);
 		cprint(con, (char *)&duty, 4);
 	}
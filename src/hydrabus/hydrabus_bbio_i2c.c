@@ -27,7 +27,9 @@
 #include "hydrabus_bbio_i2c.h"
 #include "bsp_i2c_master.h"
 #include "bsp_i2c_slave.h"
+#include "bsp_i2c_conf.h"
 #include "hydrabus_bbio_aux.h"
+#include "hydrabus_i2c_sniff.h"
 
 #define I2C_DEV_NUM (1)
 
@@ -42,40 +44,103 @@ void bbio_i2c_init_proto_default(t_hydra_console *con)
 	proto->config.i2c.ack_pending = 0;
 }
 
-void bbio_i2c_sniff(t_hydra_console *con)
+#define I2C_SNIFF_NB_SAMPLES	(0x2000) /* Power of 2 */
+#define I2C_SNIFF_OUT_SIZE	(0x1000) /* Power of 2 */
+
+/* Send the output ring without blocking, or all of it if wait is set */
+static void bbio_i2c_sniff_flush(t_hydra_console *con, i2c_sniff_t *s, bool wait)
 {
-	(void)con;
-	bsp_status_t status;
-	uint16_t data;
-	uint8_t dummy;
+	const uint8_t *data;
+	uint32_t len;
 
-	mode_config_proto_t* proto = &con->mode->proto;
+	while((len = i2c_sniff_out_get(s, &data)) > 0) {
+		len = chnWriteTimeout(con->sdu, data, len,
+				      wait ? TIME_INFINITE : TIME_IMMEDIATE);
+		i2c_sniff_out_consume(s, len);
+		if(len == 0 && !wait)
+			break;
+	}
+}
 
-	bsp_i2c_master_deinit(proto->dev_num);
-	bsp_i2c_slave_init(proto->dev_num, proto);
+static void bbio_i2c_sniff_print(t_hydra_console *con, i2c_sniff_t *s)
+{
+	i2c_sniff_event_t ev;
 
-	while(!hydrabus_ubtn() || chnReadTimeout(con->sdu, &dummy, 1, TIME_IMMEDIATE)) {
-		status = bsp_i2c_slave_sniff(proto->dev_num, &data);
-		if (status != BSP_OK) {
-			continue;
-		}
-		switch(data) {
-		case 0x400:
+	while(i2c_sniff_pop(s, &ev)) {
+		switch(ev.type & I2C_SNIFF_TYPE_MASK) {
+		case I2C_SNIFF_START:
 			cprint(con, "[", 1);
 			break;
-		case 0x200:
+		case I2C_SNIFF_STOP:
 			cprint(con, "]", 1);
 			break;
 		default:
-			cprintf(con, "\\%c", data>>1);
-			cprint(con, data & 1 ? "-" : "+", 1);
+			cprintf(con, "\\%c", ev.data);
+			cprint(con, (ev.type & I2C_SNIFF_FLAG_NACK) ? "-" : "+", 1);
 			break;
 		}
 	}
+}
 
+/*
+ * SCL/SDA are sampled by DMA and decoded while the events are sent, as
+ * text ('[', ']', '\' data '+'/'-') or as i2c_sniff_event_t if binary is set.
+ */
+void bbio_i2c_sniff(t_hydra_console *con, bool binary)
+{
+	uint8_t dummy;
+	uint16_t *samples;
+	uint8_t *out;
+	uint32_t period, timestamp;
+	i2c_sniff_t *s;
+	bsp_status_t status = BSP_ERROR;
+	mode_config_proto_t* proto = &con->mode->proto;
+
+	samples = pool_alloc_bytes(I2C_SNIFF_NB_SAMPLES * sizeof(uint16_t));
+	out = pool_alloc_bytes(I2C_SNIFF_OUT_SIZE);
+	s = pool_alloc_ccm(sizeof(i2c_sniff_t));
+
+	bsp_i2c_master_deinit(proto->dev_num);
+	bsp_i2c_slave_init(proto->dev_num, proto);
+
+	if(samples != NULL && out != NULL && s != NULL) {
+		status = bsp_i2c_slave_sniff_start(proto->dev_num, proto, samples,
+						   I2C_SNIFF_NB_SAMPLES, &period, &timestamp);
+	}
+
+	if(status == BSP_OK) {
+		i2c_sniff_init(s, samples, I2C_SNIFF_NB_SAMPLES,
+			       BSP_I2C1_SCL_PIN, BSP_I2C1_SDA_PIN, period, timestamp,
+			       out, I2C_SNIFF_OUT_SIZE);
+
+		while(!hydrabus_ubtn() || chnReadTimeout(con->sdu, &dummy, 1, TIME_IMMEDIATE)) {
+			i2c_sniff_process(s, bsp_i2c_slave_sniff_get_index(proto->dev_num));
+			if(binary) {
+				bbio_i2c_sniff_flush(con, s, false);
+			} else {
+				bbio_i2c_sniff_print(con, s);
+			}
+		}
+
+		i2c_sniff_process(s, bsp_i2c_slave_sniff_get_index(proto->dev_num));
+		bsp_i2c_slave_sniff_stop(proto->dev_num);
+		if(binary) {
+			bbio_i2c_sniff_flush(con, s, true);
+		} else {
+			bbio_i2c_sniff_print(con, s);
+		}
+	}
+
+	pool_free(samples);
+	pool_free(out);
+	pool_free(s);
 	bsp_i2c_slave_deinit(proto->dev_num);
 	bsp_i2c_master_init(proto->dev_num, proto);
-	cprint(con, "\x01", 1);
+	if(status == BSP_OK) {
+		cprint(con, "\x01", 1);
+	} else {
+		cprint(con, "\x00", 1);
+	}
 }
 
 static void bbio_mode_id(t_hydra_console *con)
@@ -87,8 +152,8 @@ void bbio_mode_i2c(t_hydra_console *con)
 {
 	uint8_t bbio_subcommand;
 	uint16_t to_rx, to_tx, i;
-	uint8_t *tx_data = pool_alloc_bytes(0x1000); // 4096 bytes
-	uint8_t *rx_data = pool_alloc_bytes(0x1000); // 4096 bytes
+	uint8_t *tx_data = pool_alloc_ccm(0x1000); // 4096 bytes
+	uint8_t *rx_data = pool_alloc_ccm(0x1000); // 4096 bytes
 	uint8_t data;
 	uint8_t tx_ack_flag;
 	bsp_status_t status;
@@ -137,7 +202,10 @@ void bbio_mode_i2c(t_hydra_console *con)
 				cprint(con, "\x01", 1);
 				break;
 			case BBIO_I2C_START_SNIFF:
-				bbio_i2c_sniff(con);
+				bbio_i2c_sniff(con, false);
+				break;
+			case BBIO_I2C_START_SNIFF_BIN:
+				bbio_i2c_sniff(con, true);
 				break;
 			case BBIO_I2C_WRITE_READ:
 				chnRead(con->sdu, rx_data, 4);
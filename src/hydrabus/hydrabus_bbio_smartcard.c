@@ -55,8 +55,8 @@ void bbio_mode_smartcard(t_hydra_console *con)
 {
 	uint32_t to_rx, to_tx, i;
 	uint8_t bbio_subcommand;
-	uint8_t *tx_data = pool_alloc_bytes(0x1000); // 4096 bytes
-	uint8_t *rx_data = pool_alloc_bytes(0x1000); // 4096 bytes
+	uint8_t *tx_data = pool_alloc_ccm(0x1000); // 4096 bytes
+	uint8_t *rx_data = pool_alloc_ccm(0x1000); // 4096 bytes
 	uint8_t data;
 	uint32_t dev_speed=0;
 	uint32_t final_baudrate;
@@ -27,6 +27,7 @@
 #include "hydrabus_bbio_spi.h"
 #include "bsp_spi.h"
 #include "hydrabus_bbio_aux.h"
+#include "hydrabus_spi_sniff.h"
 
 void bbio_spi_init_proto_default(t_hydra_console *con)
 {
@@ -42,46 +43,128 @@ void bbio_spi_init_proto_default(t_hydra_console *con)
 	proto->config.spi.dev_bit_lsb_msb = DEV_FIRSTBIT_MSB;
 }
 
-void bbio_spi_sniff(t_hydra_console *con)
+#define SPI_SNIFF_RING_SIZE	(0x1000) /* Per slave SPI, power of 2 */
+#define SPI_SNIFF_OUT_SIZE	(0x2000) /* Power of 2 */
+
+/* CS edges of SPI1, both slaves share the same CS */
+static void spi_sniff_cs_cb(void *arg)
+{
+	spi_sniff_t *s = (spi_sniff_t *)arg;
+	uint32_t timestamp = bsp_get_cyclecounter();
+
+	chSysLockFromISR();
+	spi_sniff_cs_event(s, timestamp, bsp_spi_get_cs(BSP_DEV_SPI1),
+			   bsp_spi_rx_circular_index(BSP_DEV_SPI1),
+			   bsp_spi_rx_circular_index(BSP_DEV_SPI2));
+	chSysUnlockFromISR();
+}
+
+/* Send the output ring without blocking, or all of it if wait is set */
+static void spi_sniff_flush(t_hydra_console *con, spi_sniff_t *s, bool wait)
 {
-	uint8_t cs_state, data, rx_data[2];
+	const uint8_t *data;
+	uint32_t len;
+
+	while((len = spi_sniff_out_get(s, &data)) > 0) {
+		len = chnWriteTimeout(con->sdu, data, len,
+				      wait ? TIME_INFINITE : TIME_IMMEDIATE);
+		spi_sniff_out_consume(s, len);
+		if(len == 0 && !wait)
+			break;
+	}
+}
+
+/*
+ * MOSI is received by SPI1 and MISO by SPI2 (both slaves) with circular
+ * DMA, the CS edges are timestamped in the EXTI interrupt. The bytes are
+ * framed by transaction in the format fmt, see hydrabus_spi_sniff.h.
+ */
+void bbio_spi_sniff(t_hydra_console *con, uint8_t fmt)
+{
+	uint8_t data;
+	uint8_t *mosi, *miso, *out;
+	spi_sniff_t *s;
+	uint32_t events_lost;
+	bool idle;
 	mode_config_proto_t* proto = &con->mode->proto;
 	bsp_status_t status;
 
+	mosi = pool_alloc_bytes(SPI_SNIFF_RING_SIZE);
+	miso = pool_alloc_bytes(SPI_SNIFF_RING_SIZE);
+	out = pool_alloc_bytes(SPI_SNIFF_OUT_SIZE);
+	s = pool_alloc_bytes(sizeof(spi_sniff_t));
+
 	proto->config.spi.dev_mode = DEV_SLAVE;
 	status = bsp_spi_init(BSP_DEV_SPI1, proto);
-	status = bsp_spi_init(BSP_DEV_SPI2, proto);
+	if(status == BSP_OK)
+		status = bsp_spi_init(BSP_DEV_SPI2, proto);
+	if(status == BSP_OK && (mosi == NULL || miso == NULL || out == NULL || s == NULL))
+		status = BSP_ERROR;
+	if(status == BSP_OK) {
+		spi_sniff_init(s, fmt, mosi, miso, SPI_SNIFF_RING_SIZE,
+			       out, SPI_SNIFF_OUT_SIZE);
+		status = bsp_spi_rx_circular_start(BSP_DEV_SPI1, mosi, SPI_SNIFF_RING_SIZE);
+		if(status == BSP_OK) {
+			status = bsp_spi_rx_circular_start(BSP_DEV_SPI2, miso, SPI_SNIFF_RING_SIZE);
+			if(status != BSP_OK)
+				bsp_spi_rx_circular_stop(BSP_DEV_SPI1);
+		}
+	}
 
 	if(status == BSP_OK) {
 		cprint(con, "\x01", 1);
 	} else {
 		cprint(con, "\x00", 1);
-		proto->config.spi.dev_mode = DEV_MASTER;
-		status = bsp_spi_init(BSP_DEV_SPI1, proto);
-		status = bsp_spi_deinit(BSP_DEV_SPI2);
-		return;
+		goto end;
+	}
+
+	/* Origin of the 64 bits pcapng timestamps */
+	s->time = bsp_get_cyclecounter();
+	bsp_spi_cs_event_start(BSP_DEV_SPI1, spi_sniff_cs_cb, s);
+	if(!bsp_spi_get_cs(BSP_DEV_SPI1)) {
+		/* Transaction already started */
+		chSysLock();
+		spi_sniff_cs_event(s, bsp_get_cyclecounter(), 0,
+				   bsp_spi_rx_circular_index(BSP_DEV_SPI1),
+				   bsp_spi_rx_circular_index(BSP_DEV_SPI2));
+		chSysUnlock();
 	}
-	cs_state = 1;
+
 	while(!hydrabus_ubtn() || chnReadTimeout(con->sdu, &data, 1,1)) {
-		if (cs_state == 0 && bsp_spi_get_cs(BSP_DEV_SPI1)) {
-			cprint(con, "]", 1);
-			cs_state = 1;
-		} else if (cs_state == 1 && !(bsp_spi_get_cs(BSP_DEV_SPI1))) {
-			cprint(con, "[", 1);
-			cs_state = 0;
-		}
-		if(bsp_spi_rxne(BSP_DEV_SPI1)){
-			bsp_spi_read_u8(BSP_DEV_SPI1,	&rx_data[0], 1);
+		/* Read and clear with the CS interrupt masked */
+		chSysLock();
+		events_lost = s->events_lost;
+		s->events_lost = 0;
+		idle = (s->event_rd == s->event_wr);
+		chSysUnlock();
 
-			if(bsp_spi_rxne(BSP_DEV_SPI2)){
-				bsp_spi_read_u8(BSP_DEV_SPI2, &rx_data[1], 1);
-			} else {
-				rx_data[1] = 0;
-			}
+		spi_sniff_tick(s, bsp_get_cyclecounter());
+		spi_sniff_process(s, events_lost,
+				  bsp_spi_rx_circular_index(BSP_DEV_SPI1),
+				  bsp_spi_rx_circular_index(BSP_DEV_SPI2));
+		spi_sniff_flush(con, s, false);
 
-			cprintf(con, "\\%c%c", rx_data[0], rx_data[1]);
-		}
+		/*
+		 * No CS edge queued: wait a system tick (100us), the 4KB rings
+		 * take 780us to fill at 42MHz.
+		 */
+		if(idle)
+			chThdSleep(TIME_US2I(100));
 	}
+
+	bsp_spi_cs_event_stop(BSP_DEV_SPI1);
+	spi_sniff_close(s, bsp_get_cyclecounter(),
+			bsp_spi_rx_circular_index(BSP_DEV_SPI1),
+			bsp_spi_rx_circular_index(BSP_DEV_SPI2));
+	spi_sniff_flush(con, s, true);
+	bsp_spi_rx_circular_stop(BSP_DEV_SPI1);
+	bsp_spi_rx_circular_stop(BSP_DEV_SPI2);
+
+end:
+	pool_free(mosi);
+	pool_free(miso);
+	pool_free(out);
+	pool_free(s);
 	proto->config.spi.dev_mode = DEV_MASTER;
 	status = bsp_spi_init(BSP_DEV_SPI1, proto);
 	status = bsp_spi_deinit(BSP_DEV_SPI2);
@@ -135,7 +218,13 @@ void bbio_mode_spi(t_hydra_console *con)
 			case BBIO_SPI_SNIFF_ALL:
 			case BBIO_SPI_SNIFF_CS_LOW:
 			case BBIO_SPI_SNIFF_CS_HIGH:
-				bbio_spi_sniff(con);
+				bbio_spi_sniff(con, SPI_SNIFF_FMT_LEGACY);
+				break;
+			case BBIO_SPI_SNIFF_RECORDS:
+				bbio_spi_sniff(con, SPI_SNIFF_FMT_RECORD);
+				break;
+			case BBIO_SPI_SNIFF_PCAPNG:
+				bbio_spi_sniff(con, SPI_SNIFF_FMT_PCAPNG);
 				break;
 			case BBIO_SPI_WRITE_READ:
 			case BBIO_SPI_WRITE_READ_NCS:
@@ -151,32 +240,10 @@ void bbio_mode_spi(t_hydra_console *con)
 				}
 				if(to_tx > 0) {
 					chnRead(con->sdu, tx_data, to_tx);
-					i=0;
-					while(i<to_tx) {
-						if((to_tx-i) >= 255) {
-							bsp_spi_write_u8(proto->dev_num,
-									tx_data+i,
-									255);
-						} else {
-							bsp_spi_write_u8(proto->dev_num,
-									tx_data+i,
-									to_tx-i);
-						}
-						i+=255;
-					}
+					bsp_spi_transfer(proto->dev_num, tx_data, NULL, to_tx);
 				}
-				i=0;
-				while(i<to_rx) {
-					if((to_rx-i) >= 255) {
-						bsp_spi_read_u8(proto->dev_num,
-						                rx_data+i,
-						                255);
-					} else {
-						bsp_spi_read_u8(proto->dev_num,
-						                rx_data+i,
-						                to_rx-i);
-					}
-					i+=255;
+				if(to_rx > 0) {
+					bsp_spi_transfer(proto->dev_num, NULL, rx_data, to_rx);
 				}
 				if(bbio_subcommand == BBIO_SPI_WRITE_READ) {
 					bsp_spi_unselect(proto->dev_num);
@@ -20,5 +20,5 @@
 #define BBIO_SPI_HEADER		"SPI1"
 
 void bbio_spi_init_proto_default(t_hydra_console *con);
-void bbio_spi_sniff(t_hydra_console *con);
+void bbio_spi_sniff(t_hydra_console *con, uint8_t fmt);
 void bbio_mode_spi(t_hydra_console *con);
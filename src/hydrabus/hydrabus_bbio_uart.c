@@ -27,6 +27,7 @@
 #include "hydrabus_bbio_uart.h"
 #include "bsp_uart.h"
 #include "hydrabus_bbio_aux.h"
+#include "hydrabus_uart_bridge.h"
 
 void bbio_uart_init_proto_default(t_hydra_console *con)
 {
@@ -40,34 +41,22 @@ void bbio_uart_init_proto_default(t_hydra_console *con)
 	proto->config.uart.bus_mode = BSP_UART_MODE_UART;
 }
 
-static THD_FUNCTION(uart_reader_thread, arg)
+/* Init the UART, the echo DMA is restarted with the new settings */
+static bsp_status_t bbio_uart_init(t_hydra_console *con, uart_bridge_t **bridge)
 {
-	t_hydra_console *con;
-	con = arg;
-	chRegSetThreadName("UART reader");
-	chThdSleepMilliseconds(10);
-	uint8_t bytes_read;
 	mode_config_proto_t* proto = &con->mode->proto;
+	bsp_status_t status;
+	bool echo = (*bridge != NULL);
 
-	while (!hydrabus_ubtn()) {
-		if(!chThdShouldTerminateX())
-		{
-			if(bsp_uart_rxne(proto->dev_num)) {
-				bytes_read = bsp_uart_read_u8_timeout(proto->dev_num,
-											proto->buffer_rx,
-											UART_BRIDGE_BUFF_SIZE,
-											TIME_US2I(100));
-				if(bytes_read > 0) {
-					cprint(con, (char *)proto->buffer_rx, bytes_read);
-				}
-			} else {
-				chThdYield();
-			}
-		} else
-		{
-			chThdExit((msg_t)1);
-		}
+	if(echo) {
+		uart_bridge_free(*bridge);
+		*bridge = NULL;
 	}
+	status = bsp_uart_init(proto->dev_num, proto);
+	if(echo && status == BSP_OK) {
+		*bridge = uart_bridge_start(con, proto->dev_num, NULL);
+	}
+	return status;
 }
 
 static void bbio_mode_id(t_hydra_console *con)
@@ -84,7 +73,7 @@ void bbio_mode_uart(t_hydra_console *con)
 	uint8_t data;
 	bsp_status_t status;
 	mode_config_proto_t* proto = &con->mode->proto;
-	thread_t *rthread = NULL;
+	uart_bridge_t *bridge = NULL;
 
 	bbio_uart_init_proto_default(con);
 	bsp_uart_init(proto->dev_num, proto);
@@ -95,29 +84,24 @@ void bbio_mode_uart(t_hydra_console *con)
 		if(chnRead(con->sdu, &bbio_subcommand, 1) == 1) {
 			switch(bbio_subcommand) {
 			case BBIO_RESET:
+				if(bridge != NULL) {
+					uart_bridge_free(bridge);
+				}
 				bsp_uart_deinit(proto->dev_num);
 				return;
 			case BBIO_MODE_ID:
 				bbio_mode_id(con);
 				break;
 			case BBIO_UART_START_ECHO:
-				if(rthread == NULL)
-				{
-					rthread = chThdCreateFromHeap(NULL,
-								      CONSOLE_WA_SIZE,
-								      "uart_reader",
-								      NORMALPRIO,
-								      uart_reader_thread,
-								      con);
+				if(bridge == NULL) {
+					bridge = uart_bridge_start(con, proto->dev_num, NULL);
 				}
-				cprint(con, "\x01", 1);
+				cprint(con, (bridge != NULL) ? "\x01" : "\x00", 1);
 				break;
 			case BBIO_UART_STOP_ECHO:
-				if(rthread != NULL)
-				{
-					chThdTerminate(rthread);
-					chThdWait(rthread);
-					rthread = NULL;
+				if(bridge != NULL) {
+					uart_bridge_free(bridge);
+					bridge = NULL;
 				}
 				cprint(con, "\x01", 1);
 				break;
@@ -126,7 +110,7 @@ void bbio_mode_uart(t_hydra_console *con)
 				baud_rate =(rx_data[0]<<24) + (rx_data[1]<<16);
 				baud_rate +=(rx_data[2]<<8) + rx_data[3];
 				proto->config.uart.dev_speed = baud_rate;
-				status = bsp_uart_init(proto->dev_num, proto);
+				status = bbio_uart_init(con, &bridge);
 				if(status == BSP_OK) {
 					cprint(con, "\x01", 1);
 				} else {
@@ -134,27 +118,13 @@ void bbio_mode_uart(t_hydra_console *con)
 				}
 				break;
 			case BBIO_UART_BRIDGE:
-				if(rthread == NULL)
-				{
-					rthread = chThdCreateFromHeap(NULL,
-								      CONSOLE_WA_SIZE,
-								      "uart_reader",
-								      NORMALPRIO,
-								      uart_reader_thread,
-								      con);
-				}
-				while(!hydrabus_ubtn()) {
-					data = chnReadTimeout(con->sdu, proto->buffer_tx,
-								    UART_BRIDGE_BUFF_SIZE, TIME_US2I(100));
-					if(data > 0) {
-						bsp_uart_write_u8(proto->dev_num, proto->buffer_tx, data);
-					}
+				if(bridge == NULL) {
+					bridge = uart_bridge_start(con, proto->dev_num, NULL);
 				}
-				if(rthread != NULL)
-				{
-					chThdTerminate(rthread);
-					chThdWait(rthread);
-					rthread = NULL;
+				if(bridge != NULL) {
+					uart_bridge_tx(bridge);
+					uart_bridge_free(bridge);
+					bridge = NULL;
 				}
 				cprint(con, "\x01", 1);
 				break;
@@ -211,7 +181,7 @@ void bbio_mode_uart(t_hydra_console *con)
 						continue;
 					}
 
-					status = bsp_uart_init(proto->dev_num, proto);
+					status = bbio_uart_init(con, &bridge);
 					if(status == BSP_OK) {
 						cprint(con, "\x01", 1);
 					} else {
@@ -234,7 +204,7 @@ void bbio_mode_uart(t_hydra_console *con)
 						continue;
 					}
 
-					status = bsp_uart_init(proto->dev_num, proto);
+					status = bbio_uart_init(con, &bridge);
 					if(status == BSP_OK) {
 						cprint(con, "\x01", 1);
 					} else {
@@ -249,10 +219,7 @@ void bbio_mode_uart(t_hydra_console *con)
 			}
 		}
 	}
-	if(rthread != NULL)
-	{
-		chThdTerminate(rthread);
-		chThdWait(rthread);
-		rthread = NULL;
+	if(bridge != NULL) {
+		uart_bridge_free(bridge);
 	}
 }
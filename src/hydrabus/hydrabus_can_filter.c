@@ -0,0 +1,507 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include "hydrabus_can_filter.h"
+
+/*
+ * The entries are kept in the layout of the 32 bits filter registers:
+ * STID[10:0] EXID[17:0] IDE RTR 0. The standard frames are compared with
+ * EXID at 0.
+ */
+#define REG_STID	(0xFFE00000)
+#define REG_EXID	(0x001FFFF8)
+#define REG_EXID_LOW	(0x0003FFF8) /* EXID[14:0], not in the 16 bits filters */
+#define REG_IDE		(1 << 2)
+#define REG_RTR		(1 << 1)
+
+#define CAN_STD_ID_MAX	(0x7FF)
+#define CAN_EXT_ID_MAX	(0x1FFFFFFF)
+
+typedef struct {
+	uint32_t id;
+	uint32_t mask;
+} can_filter_entry_t;
+
+/* Bank kinds an entry can use, see can_filter_count() */
+typedef enum {
+	CAT_MASK32 = 0,
+	CAT_LIST32_1, /* One slot of a 32 bits list */
+	CAT_LIST32_2, /* Data and remote: both slots of a 32 bits list */
+	CAT_MASK16,
+	CAT_LIST16_1, /* One slot of a 16 bits list */
+	CAT_LIST16_2, /* Data and remote: two slots of a 16 bits list */
+	CAT_END
+} can_filter_cat_t;
+
+typedef struct {
+	uint32_t nb[CAT_END];
+	uint32_t list16_1_32; /* CAT_LIST16_1 entries which also fit a 32 bits list */
+} can_filter_counts_t;
+
+static inline uint32_t frame_reg(uint32_t id, bool ext, bool rtr)
+{
+	uint32_t reg = ext ? ((id << 3) | REG_IDE) : (id << 21);
+
+	return rtr ? (reg | REG_RTR) : reg;
+}
+
+/* 32 bits register layout to 16 bits: STID[10:0] RTR IDE EXID[17:15] */
+static inline uint32_t reg16(uint32_t reg)
+{
+	return ((reg >> 16) & 0xFFE0) | ((reg & REG_RTR) << 3) |
+	       ((reg & REG_IDE) << 1) | ((reg >> 18) & 0x7);
+}
+
+/* Identifier bits of the frames accepted by the entry, RTR excluded */
+static inline uint32_t id_bits(const can_filter_entry_t *e)
+{
+	if((e->mask & REG_IDE) && !(e->id & REG_IDE))
+		return REG_STID | REG_IDE;
+	return REG_STID | REG_EXID | REG_IDE;
+}
+
+static inline bool fits16(const can_filter_entry_t *e)
+{
+	return (e->mask & REG_EXID_LOW) == 0;
+}
+
+static inline bool exact32(const can_filter_entry_t *e)
+{
+	uint32_t bits = id_bits(e);
+
+	return (e->mask & bits) == bits;
+}
+
+static inline bool exact16(const can_filter_entry_t *e)
+{
+	uint32_t bits = id_bits(e) & ~REG_EXID_LOW;
+
+	return fits16(e) && (e->mask & bits) == bits;
+}
+
+static can_filter_cat_t entry_cat(const can_filter_entry_t *e)
+{
+	bool both = !(e->mask & REG_RTR);
+
+	if(!fits16(e)) {
+		if(!exact32(e))
+			return CAT_MASK32;
+		return both ? CAT_LIST32_2 : CAT_LIST32_1;
+	}
+	if(!exact16(e))
+		return CAT_MASK16;
+	return both ? CAT_LIST16_2 : CAT_LIST16_1;
+}
+
+static void counts_add(can_filter_counts_t *c, can_filter_cat_t cat, bool is32, int add)
+{
+	c->nb[cat] += add;
+	if(cat == CAT_LIST16_1 && is32)
+		c->list16_1_32 += add;
+}
+
+/*
+ * Number of banks used by can_filter_pack(): the odd slot of a 32 bits
+ * list takes a standard identifier, the odd slot of a 16 bits mask takes
+ * an identifier of the 16 bits lists.
+ */
+static uint32_t can_filter_count(const can_filter_counts_t *c)
+{
+	uint32_t banks, l16_1, l16_2;
+
+	banks = c->nb[CAT_MASK32] + c->nb[CAT_LIST32_2] +
+		(c->nb[CAT_LIST32_1] + 1) / 2 + (c->nb[CAT_MASK16] + 1) / 2;
+
+	l16_1 = c->nb[CAT_LIST16_1];
+	l16_2 = c->nb[CAT_LIST16_2];
+	if((c->nb[CAT_LIST32_1] & 1) && c->list16_1_32 > 0)
+		l16_1--;
+	if(c->nb[CAT_MASK16] & 1) {
+		if(l16_2 > 0)
+			l16_2--;
+		else if(l16_1 > 0)
+			l16_1--;
+	}
+	/* Items of 1 and 2 slots always fill the banks of 4 slots */
+	return banks + (2 * l16_2 + l16_1 + 3) / 4;
+}
+
+/* Frames accepted by an entry is 2^weight, to compare the merges */
+static uint8_t entry_weight(const can_filter_entry_t *e)
+{
+	uint32_t dont_care = (id_bits(e) | REG_RTR) & ~e->mask;
+
+	return __builtin_popcount(dont_care);
+}
+
+/* e1 covers e2 */
+static inline bool entry_covers(const can_filter_entry_t *e1, const can_filter_entry_t *e2)
+{
+	return (e1->mask & ~e2->mask) == 0 && ((e1->id ^ e2->id) & e1->mask) == 0;
+}
+
+static can_filter_entry_t entry_merge(const can_filter_entry_t *e1, const can_filter_entry_t *e2)
+{
+	can_filter_entry_t e;
+
+	e.mask = e1->mask & e2->mask & ~(e1->id ^ e2->id);
+	e.id = e1->id & e.mask;
+	return e;
+}
+
+/* Insert e, removing the entries it covers */
+static void entries_insert(can_filter_entry_t *entries, uint32_t *nb,
+			   const can_filter_entry_t *e)
+{
+	uint32_t i, n = 0;
+
+	for(i = 0; i < *nb; i++) {
+		if(!entry_covers(e, &entries[i]))
+			entries[n++] = entries[i];
+	}
+	entries[n++] = *e;
+	*nb = n;
+}
+
+/*
+ * Merge the two entries giving the fewest banks, then the fewest frames
+ * accepted in addition.
+ */
+static void entries_merge_best(can_filter_entry_t *entries, uint32_t *nb)
+{
+	can_filter_counts_t counts, c;
+	can_filter_entry_t e, best_e;
+	/* Called from the console thread, keep the stack small */
+	uint8_t cat[CAN_FILTER_MAX_ENTRIES];
+	bool is32[CAN_FILTER_MAX_ENTRIES];
+	uint8_t weight[CAN_FILTER_MAX_ENTRIES];
+	uint32_t i, j, banks, best_i = 0, best_j = 1, best_banks = UINT32_MAX;
+	int64_t cost, best_cost = 0;
+
+	memset(&counts, 0, sizeof(counts));
+	for(i = 0; i < *nb; i++) {
+		cat[i] = entry_cat(&entries[i]);
+		is32[i] = exact32(&entries[i]);
+		weight[i] = entry_weight(&entries[i]);
+		counts_add(&counts, cat[i], is32[i], 1);
+	}
+
+	best_e = entry_merge(&entries[0], &entries[1]);
+	for(i = 0; i < *nb; i++) {
+		for(j = i + 1; j < *nb; j++) {
+			e = entry_merge(&entries[i], &entries[j]);
+			c = counts;
+			counts_add(&c, cat[i], is32[i], -1);
+			counts_add(&c, cat[j], is32[j], -1);
+			counts_add(&c, entry_cat(&e), exact32(&e), 1);
+			banks = can_filter_count(&c);
+			if(banks > best_banks)
+				continue;
+			cost = (1ULL << entry_weight(&e)) - (1ULL << weight[i]) -
+			       (1ULL << weight[j]);
+			if(banks < best_banks || cost < best_cost) {
+				best_banks = banks;
+				best_cost = cost;
+				best_i = i;
+				best_j = j;
+				best_e = e;
+			}
+		}
+	}
+
+	/* best_j > best_i */
+	entries[best_j] = entries[--(*nb)];
+	entries[best_i] = entries[--(*nb)];
+	entries_insert(entries, nb, &best_e);
+}
+
+static void entries_add(can_filter_entry_t *entries, uint32_t *nb,
+			const can_filter_entry_t *e)
+{
+	uint32_t i;
+
+	for(i = 0; i < *nb; i++) {
+		if(entry_covers(&entries[i], e))
+			return;
+	}
+	if(*nb == CAN_FILTER_MAX_ENTRIES)
+		entries_merge_best(entries, nb);
+	entries_insert(entries, nb, e);
+}
+
+/* Split the range in aligned blocks, each one is an identifier and a mask */
+static void entries_add_rule(can_filter_entry_t *entries, uint32_t *nb,
+			     const can_filter_rule_t *rule)
+{
+	can_filter_entry_t e;
+	uint32_t first = rule->first, last = rule->last;
+	uint32_t id_max, size;
+	bool ext = rule->flags & CAN_FILTER_EXT;
+
+	id_max = ext ? CAN_EXT_ID_MAX : CAN_STD_ID_MAX;
+	if(last > id_max)
+		last = id_max;
+
+	while(first <= last) {
+		size = first ? (first & -first) : (id_max + 1);
+		while(size - 1 > last - first)
+			size >>= 1;
+
+		e.id = frame_reg(first, ext, false);
+		e.mask = frame_reg(~(size - 1) & id_max, ext, rule->flags & CAN_FILTER_NO_RTR);
+		e.mask |= REG_IDE;
+		entries_add(entries, nb, &e);
+
+		if(size - 1 == last - first)
+			break;
+		first += size;
+	}
+}
+
+static void bank_set(can_filter_bank_t *bank, uint8_t mode, uint8_t scale,
+		     uint32_t fr1, uint32_t fr2)
+{
+	bank->mode = mode;
+	bank->scale = scale;
+	bank->fr1 = fr1;
+	bank->fr2 = fr2;
+}
+
+/* Takes the first entry of a category, false if there is none */
+static bool take(can_filter_entry_t *entries, uint32_t nb, bool *used,
+		 can_filter_cat_t cat, bool need32, can_filter_entry_t *e)
+{
+	uint32_t i;
+
+	for(i = 0; i < nb; i++) {
+		if(used[i] || entry_cat(&entries[i]) != cat)
+			continue;
+		if(need32 && !exact32(&entries[i]))
+			continue;
+		used[i] = true;
+		*e = entries[i];
+		return true;
+	}
+	return false;
+}
+
+/* 16 bits list slots of an entry, returns the number of slots */
+static uint32_t list16_slots(const can_filter_entry_t *e, uint32_t *slots)
+{
+	if(e->mask & REG_RTR) {
+		slots[0] = reg16(e->id);
+		return 1;
+	}
+	slots[0] = reg16(e->id & ~REG_RTR);
+	slots[1] = reg16(e->id | REG_RTR);
+	return 2;
+}
+
+/* Fills the banks as counted by can_filter_count() */
+static uint32_t can_filter_pack(can_filter_entry_t *entries, uint32_t nb,
+				can_filter_bank_t *banks)
+{
+	bool used[CAN_FILTER_MAX_ENTRIES] = { false };
+	can_filter_entry_t e1, e2;
+	uint32_t slots[4], n, i, nb_banks = 0;
+
+	while(take(entries, nb, used, CAT_MASK32, false, &e1)) {
+		bank_set(&banks[nb_banks++], CAN_FILTER_MODE_MASK, 32, e1.id, e1.mask);
+	}
+	while(take(entries, nb, used, CAT_LIST32_2, false, &e1)) {
+		bank_set(&banks[nb_banks++], CAN_FILTER_MODE_LIST, 32,
+			 e1.id & ~REG_RTR, e1.id | REG_RTR);
+	}
+	while(take(entries, nb, used, CAT_LIST32_1, false, &e1)) {
+		if(!take(entries, nb, used, CAT_LIST32_1, false, &e2) &&
+		    !take(entries, nb, used, CAT_LIST16_1, true, &e2))
+			e2 = e1;
+		bank_set(&banks[nb_banks++], CAN_FILTER_MODE_LIST, 32, e1.id, e2.id);
+	}
+	while(take(entries, nb, used, CAT_MASK16, false, &e1)) {
+		if(!take(entries, nb, used, CAT_MASK16, false, &e2) &&
+		    !take(entries, nb, used, CAT_LIST16_2, false, &e2) &&
+		    !take(entries, nb, used, CAT_LIST16_1, false, &e2))
+			e2 = e1;
+		bank_set(&banks[nb_banks++], CAN_FILTER_MODE_MASK, 16,
+			 (reg16(e1.mask) << 16) | reg16(e1.id),
+			 (reg16(e2.mask) << 16) | reg16(e2.id));
+	}
+
+	/* Two slots entries first, so that they are not split */
+	n = 0;
+	while(take(entries, nb, used, CAT_LIST16_2, false, &e1) ||
+	      take(entries, nb, used, CAT_LIST16_1, false, &e1)) {
+		n += list16_slots(&e1, &slots[n]);
+		if(n == 4) {
+			bank_set(&banks[nb_banks++], CAN_FILTER_MODE_LIST, 16,
+				 (slots[1] << 16) | slots[0], (slots[3] << 16) | slots[2]);
+			n = 0;
+		}
+	}
+	if(n > 0) {
+		/* The unused slots repeat an identifier */
+		for(i = n; i < 4; i++)
+			slots[i] = slots[0];
+		bank_set(&banks[nb_banks++], CAN_FILTER_MODE_LIST, 16,
+			 (slots[1] << 16) | slots[0], (slots[3] << 16) | slots[2]);
+	}
+
+	return nb_banks;
+}
+
+/**
+  * @brief  Compile identifiers ranges to filter banks. Wider masks are used
+  *         if the banks are not enough, a frame matching a rule is always
+  *         accepted.
+  * @param  rules: identifier ranges
+  * @param  nb_rules: number of rules
+  * @param  banks: output banks
+  * @param  max_banks: number of banks available, at least 1
+  * @retval number of banks used, 0 if there is no rule (nothing to filter)
+  */
+uint32_t can_filter_compile(const can_filter_rule_t *rules, uint32_t nb_rules,
+			    can_filter_bank_t *banks, uint32_t max_banks)
+{
+	can_filter_entry_t entries[CAN_FILTER_MAX_ENTRIES];
+	can_filter_counts_t counts;
+	uint32_t i, nb = 0;
+
+	for(i = 0; i < nb_rules; i++) {
+		if(rules[i].first <= rules[i].last)
+			entries_add_rule(entries, &nb, &rules[i]);
+	}
+	if(nb == 0)
+		return 0;
+
+	while(nb > 1) {
+		memset(&counts, 0, sizeof(counts));
+		for(i = 0; i < nb; i++)
+			counts_add(&counts, entry_cat(&entries[i]), exact32(&entries[i]), 1);
+		if(can_filter_count(&counts) <= max_banks)
+			break;
+		entries_merge_best(entries, &nb);
+	}
+
+	return can_filter_pack(entries, nb, banks);
+}
+
+static const char *parse_hex(const char *str, uint32_t *val, uint32_t *digits)
+{
+	uint32_t nibble;
+
+	*val = 0;
+	*digits = 0;
+	while(1) {
+		if(*str >= '0' && *str <= '9')
+			nibble = *str - '0';
+		else if(*str >= 'a' && *str <= 'f')
+			nibble = *str - 'a' + 10;
+		else if(*str >= 'A' && *str <= 'F')
+			nibble = *str - 'A' + 10;
+		else
+			break;
+		*val = (*val << 4) | nibble;
+		(*digits)++;
+		str++;
+	}
+	return str;
+}
+
+/**
+  * @brief  Parse a list of identifiers and ranges, separated by commas.
+  *         Hexadecimal, standard identifiers have up to 3 digits, extended
+  *         ones 4 to 8 (as in SLCAN), e.g. "123,700-7ff,18DAF100-18DAF1FF".
+  * @param  str: string to parse
+  * @param  rules: output rules
+  * @param  max_rules: size of rules
+  * @retval number of rules, -1 if the string is not valid or too long
+  */
+int can_filter_parse(const char *str, can_filter_rule_t *rules, uint32_t max_rules)
+{
+	uint32_t first, last, digits, last_digits;
+	uint32_t nb = 0;
+	bool ext;
+
+	while(*str != 0) {
+		if(nb == max_rules)
+			return -1;
+
+		str = parse_hex(str, &first, &digits);
+		if(digits == 0 || digits > 8)
+			return -1;
+		ext = digits > 3;
+		last = first;
+		if(*str == '-') {
+			str = parse_hex(str + 1, &last, &last_digits);
+			if(last_digits == 0 || last_digits > 8)
+				return -1;
+		}
+		if(*str == ',')
+			str++;
+		else if(*str != 0)
+			return -1;
+
+		if(first > last || last > (ext ? CAN_EXT_ID_MAX : CAN_STD_ID_MAX))
+			return -1;
+		rules[nb].first = first;
+		rules[nb].last = last;
+		rules[nb].flags = ext ? CAN_FILTER_EXT : 0;
+		nb++;
+	}
+	return nb;
+}
+
+/**
+  * @brief  Check if the banks accept a frame, as the CAN controller does.
+  * @param  banks: filter banks
+  * @param  nb_banks: number of banks
+  * @param  id: identifier
+  * @param  ext: extended identifier
+  * @param  rtr: remote frame
+  * @retval true if the frame is accepted
+  */
+bool can_filter_match(const can_filter_bank_t *banks, uint32_t nb_banks,
+		      uint32_t id, bool ext, bool rtr)
+{
+	const can_filter_bank_t *b;
+	uint32_t reg = frame_reg(id, ext, rtr);
+	uint32_t r16 = reg16(reg);
+	uint32_t i;
+
+	for(i = 0; i < nb_banks; i++) {
+		b = &banks[i];
+		if(b->scale == 32) {
+			if(b->mode == CAN_FILTER_MODE_MASK) {
+				if(((reg ^ b->fr1) & b->fr2) == 0)
+					return true;
+			} else if(reg == b->fr1 || reg == b->fr2) {
+				return true;
+			}
+		} else if(b->mode == CAN_FILTER_MODE_MASK) {
+			if(((r16 ^ b->fr1) & (b->fr1 >> 16) & 0xFFFF) == 0 ||
+			   ((r16 ^ b->fr2) & (b->fr2 >> 16) & 0xFFFF) == 0)
+				return true;
+		} else if(r16 == (b->fr1 & 0xFFFF) || r16 == (b->fr1 >> 16) ||
+			  r16 == (b->fr2 & 0xFFFF) || r16 == (b->fr2 >> 16)) {
+			return true;
+		}
+	}
+	return false;
+}
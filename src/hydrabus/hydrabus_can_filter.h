@@ -0,0 +1,71 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * CAN acceptance filter compiler: turns a list of identifiers and ranges
+ * into bxCAN filter banks (identifier list or mask mode, 16 or 32 bits
+ * scale). When the banks are not enough, entries are merged into wider
+ * masks: more frames are accepted, a wanted frame is never rejected.
+ * This file does not depend on ChibiOS nor on the HAL.
+ */
+
+#ifndef _HYDRABUS_CAN_FILTER_H_
+#define _HYDRABUS_CAN_FILTER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Rule flags */
+#define CAN_FILTER_EXT		(1 << 0) /* 29 bits identifiers */
+#define CAN_FILTER_NO_RTR	(1 << 1) /* Remote frames are not wanted */
+
+/* Identifiers first to last */
+typedef struct {
+	uint32_t first;
+	uint32_t last;
+	uint8_t flags;
+} can_filter_rule_t;
+
+#define CAN_FILTER_MODE_MASK	(0)
+#define CAN_FILTER_MODE_LIST	(1)
+
+/*
+ * Filter bank, fr1 and fr2 are the values of the CAN_FiR1/CAN_FiR2
+ * registers:
+ *  - 32 bits mask: identifier, mask
+ *  - 32 bits list: identifier 1, identifier 2
+ *  - 16 bits mask: mask 1 << 16 | identifier 1, mask 2 << 16 | identifier 2
+ *  - 16 bits list: identifier 2 << 16 | identifier 1, 4 << 16 | 3
+ */
+typedef struct {
+	uint8_t mode;
+	uint8_t scale; /* 16 or 32 */
+	uint32_t fr1;
+	uint32_t fr2;
+} can_filter_bank_t;
+
+/* Identifiers and masks kept by the compiler, before the merges */
+#define CAN_FILTER_MAX_ENTRIES	(64)
+
+int can_filter_parse(const char *str, can_filter_rule_t *rules, uint32_t max_rules);
+uint32_t can_filter_compile(const can_filter_rule_t *rules, uint32_t nb_rules,
+			    can_filter_bank_t *banks, uint32_t max_banks);
+bool can_filter_match(const can_filter_bank_t *banks, uint32_t nb_banks,
+		      uint32_t id, bool ext, bool rtr);
+
+#endif /* _HYDRABUS_CAN_FILTER_H_ */
@@ -0,0 +1,319 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include "hydrabus_can_replay.h"
+
+/* The entry shall be written before the index which publishes it */
+#define can_replay_barrier() __asm__ __volatile__("" ::: "memory")
+
+/* Longest compare step, the due time stays in the 16 bits counter range */
+#define CAN_REPLAY_STEP_US	(0x4000)
+/* A frame closer than this is sent now, the compare would be missed */
+#define CAN_REPLAY_MARGIN_US	(2)
+/* Check for new entries when the schedule is empty */
+#define CAN_REPLAY_POLL_US	(100)
+
+static int hex_nibble(char c)
+{
+	if(c >= '0' && c <= '9')
+		return c - '0';
+	if(c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if(c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+static const char *skip_spaces(const char *s)
+{
+	while(*s == ' ' || *s == '\t')
+		s++;
+	return s;
+}
+
+/* "(seconds.fraction)" to microseconds */
+static const char *parse_timestamp(const char *s, uint64_t *us)
+{
+	uint64_t sec = 0;
+	uint32_t frac = 0, digits = 0;
+
+	if(*s++ != '(')
+		return NULL;
+	if(*s < '0' || *s > '9')
+		return NULL;
+	while(*s >= '0' && *s <= '9')
+		sec = sec * 10 + (*s++ - '0');
+	if(*s == '.') {
+		s++;
+		while(*s >= '0' && *s <= '9') {
+			if(digits < 6) {
+				frac = frac * 10 + (*s - '0');
+				digits++;
+			}
+			s++;
+		}
+	}
+	if(*s++ != ')')
+		return NULL;
+	while(digits++ < 6)
+		frac *= 10;
+
+	*us = sec * 1000000 + frac;
+	return s;
+}
+
+/* "123#11223344", "12345678#R", "123#11.22" */
+static bool parse_frame(const char *s, can_replay_entry_t *e)
+{
+	uint32_t n = 0;
+	int hi, lo;
+
+	e->id = 0;
+	while((hi = hex_nibble(*s)) >= 0) {
+		e->id = (e->id << 4) | hi;
+		s++;
+		n++;
+	}
+	if(*s++ != '#')
+		return false;
+	if(n == 3 && e->id <= 0x7ff) {
+		e->flags = 0;
+	} else if(n == 8 && e->id <= 0x1fffffff) {
+		e->flags = CAN_REPLAY_FLAG_EXT;
+	} else {
+		return false;
+	}
+
+	e->dlc = 0;
+	if(*s == 'R') {
+		e->flags |= CAN_REPLAY_FLAG_RTR;
+		s++;
+		/* Optional length of the requested data */
+		if(*s >= '0' && *s <= '8')
+			e->dlc = *s++ - '0';
+	} else {
+		while((hi = hex_nibble(s[0])) >= 0) {
+			lo = hex_nibble(s[1]);
+			if(lo < 0 || e->dlc == 8)
+				return false;
+			e->data[e->dlc++] = (hi << 4) | lo;
+			s += 2;
+			if(*s == '.')
+				s++;
+		}
+	}
+
+	/* CAN FD frames ("##") are not supported */
+	s = skip_spaces(s);
+	return *s == 0;
+}
+
+/**
+  * @brief  Init the log parser
+  * @param  p: parser
+  * @param  rate: percent of the original speed, 200 replays twice faster
+  * @retval None
+  */
+void can_replay_parser_init(can_replay_parser_t *p, uint32_t rate)
+{
+	memset(p, 0, sizeof(*p));
+	p->rate = rate;
+}
+
+/**
+  * @brief  Restart at the beginning of the log, the first frame is sent
+  *         right after the last one.
+  * @param  p: parser
+  * @retval None
+  */
+void can_replay_parser_rewind(can_replay_parser_t *p)
+{
+	p->started = false;
+}
+
+/**
+  * @brief  Parse a log line, without the end of line.
+  * @param  p: parser
+  * @param  line: candump -l line: (timestamp) interface frame
+  * @param  e: schedule entry
+  * @retval 1 for a frame, 0 for an empty line or a comment, -1 on error
+  */
+int can_replay_parse_line(can_replay_parser_t *p, const char *line, can_replay_entry_t *e)
+{
+	const char *s = skip_spaces(line);
+	uint64_t ts, t;
+
+	if(*s == 0 || *s == '#')
+		return 0;
+
+	s = parse_timestamp(s, &ts);
+	if(s == NULL)
+		return -1;
+	/* Interface name */
+	s = skip_spaces(s);
+	if(*s == 0)
+		return -1;
+	while(*s != 0 && *s != ' ' && *s != '\t')
+		s++;
+	s = skip_spaces(s);
+	if(!parse_frame(s, e))
+		return -1;
+
+	if(!p->started) {
+		p->started = true;
+		p->first = ts;
+		p->last = 0;
+		e->delay = 0;
+		return 1;
+	}
+
+	/* Out of order timestamps are sent right away */
+	if(ts < p->first)
+		ts = p->first;
+	/* Absolute times do not accumulate the rounding errors */
+	t = (ts - p->first) * 100 / p->rate;
+	if(t < p->last)
+		t = p->last;
+	e->delay = (t - p->last > UINT32_MAX) ? UINT32_MAX : t - p->last;
+	p->last = t;
+	return 1;
+}
+
+/**
+  * @brief  Init the schedule
+  * @param  r: schedule
+  * @param  entries: storage
+  * @param  size: number of entries, power of 2
+  * @retval None
+  */
+void can_replay_init(can_replay_t *r, can_replay_entry_t *entries, uint32_t size)
+{
+	memset(r, 0, sizeof(*r));
+	r->entries = entries;
+	r->size = size;
+	/* The first frame is due when the timer starts */
+	r->starved = true;
+}
+
+/**
+  * @brief  Number of entries which can be added
+  * @param  r: schedule
+  * @retval free entries
+  */
+uint32_t can_replay_free(const can_replay_t *r)
+{
+	return r->size - (r->wr - r->rd);
+}
+
+/**
+  * @brief  Add an entry at the end of the schedule, called by the parser.
+  * @param  r: schedule
+  * @param  e: entry
+  * @retval false if the schedule is full
+  */
+bool can_replay_put(can_replay_t *r, const can_replay_entry_t *e)
+{
+	uint32_t wr = r->wr;
+
+	if(wr - r->rd >= r->size)
+		return false;
+	r->entries[wr & (r->size - 1)] = *e;
+	can_replay_barrier();
+	r->wr = wr + 1;
+	return true;
+}
+
+/**
+  * @brief  Scheduler, called from the timer compare interrupt. When an
+  *         entry is returned, it shall be sent now then can_replay_sent()
+  *         called, or the interrupt retries later. Otherwise the next
+  *         compare value is set, unless done is set.
+  *         An empty schedule delays the following frames by the time
+  *         spent waiting.
+  * @param  r: schedule
+  * @param  now: timer counter, microseconds
+  * @param  compare: next compare value
+  * @retval entry due, NULL if none
+  */
+const can_replay_entry_t *can_replay_sched(can_replay_t *r, uint16_t now, uint16_t *compare)
+{
+	const can_replay_entry_t *e;
+	uint32_t step;
+	int16_t ahead;
+
+	for(;;) {
+		if(!r->armed) {
+			if(r->wr == r->rd) {
+				if(r->eof) {
+					r->done = true;
+					return NULL;
+				}
+				if(!r->starved) {
+					r->starved = true;
+					r->underruns++;
+				}
+				*compare = now + CAN_REPLAY_POLL_US;
+				return NULL;
+			}
+			can_replay_barrier();
+			e = &r->entries[r->rd & (r->size - 1)];
+			if(r->starved) {
+				r->starved = false;
+				r->due = now;
+			}
+			r->wait = e->delay;
+			r->armed = true;
+		}
+
+		if(r->wait > 0) {
+			step = (r->wait > CAN_REPLAY_STEP_US) ? CAN_REPLAY_STEP_US : r->wait;
+			r->wait -= step;
+			r->due += step;
+		}
+		ahead = (int16_t)(r->due - now);
+		if(ahead > CAN_REPLAY_MARGIN_US) {
+			*compare = r->due;
+			return NULL;
+		}
+		if(r->wait > 0)
+			continue;
+		return &r->entries[r->rd & (r->size - 1)];
+	}
+}
+
+/**
+  * @brief  The entry returned by can_replay_sched() is sent
+  * @param  r: schedule
+  * @param  now: timer counter, microseconds
+  * @retval None
+  */
+void can_replay_sent(can_replay_t *r, uint16_t now)
+{
+	int16_t late = (int16_t)(now - r->due);
+
+	if(late > CAN_REPLAY_LATE_US)
+		r->late++;
+	if(late > 0 && (uint32_t)late > r->max_late)
+		r->max_late = late;
+
+	can_replay_barrier();
+	r->rd++;
+	r->armed = false;
+	r->sent++;
+}
@@ -0,0 +1,84 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Timed CAN replay: candump log lines ("(1436509052.249713) can0 123#DEAD")
+ * are parsed ahead of time into a schedule of frames with their delay,
+ * read by the timer compare interrupt which sends them. The timer is a 16
+ * bits counter at 1MHz, longer delays are split in several compares.
+ * This file does not depend on ChibiOS nor on the HAL.
+ */
+
+#ifndef _HYDRABUS_CAN_REPLAY_H_
+#define _HYDRABUS_CAN_REPLAY_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define CAN_REPLAY_FLAG_EXT	(1 << 0) /* 29 bits identifier */
+#define CAN_REPLAY_FLAG_RTR	(1 << 1) /* Remote frame */
+
+/* Frames later than this are counted as late */
+#define CAN_REPLAY_LATE_US	(10)
+
+/* Schedule entry */
+typedef struct {
+	uint32_t delay; /* Microseconds after the previous frame, rate applied */
+	uint32_t id;
+	uint8_t flags;
+	uint8_t dlc;
+	uint8_t data[8];
+} can_replay_entry_t;
+
+typedef struct {
+	uint32_t rate; /* Percent of the original speed */
+	bool started;
+	uint64_t first; /* Timestamp of the first frame, microseconds */
+	uint64_t last; /* Time of the previous frame, rate applied */
+} can_replay_parser_t;
+
+typedef struct {
+	can_replay_entry_t *entries;
+	uint32_t size; /* Power of 2 */
+	volatile uint32_t wr; /* Free running, written by the parser */
+	volatile uint32_t rd; /* Free running, written by the interrupt */
+	volatile bool eof; /* No more entries */
+
+	/* Written by the interrupt */
+	uint16_t due; /* Timer value of the current frame, or of the previous one */
+	uint32_t wait; /* Microseconds from due to the current frame */
+	bool armed; /* The current frame is the entry at rd */
+	bool starved;
+	volatile bool done;
+	volatile uint32_t sent;
+	volatile uint32_t late;
+	volatile uint32_t max_late; /* Microseconds */
+	volatile uint32_t underruns;
+} can_replay_t;
+
+void can_replay_parser_init(can_replay_parser_t *p, uint32_t rate);
+void can_replay_parser_rewind(can_replay_parser_t *p);
+int can_replay_parse_line(can_replay_parser_t *p, const char *line, can_replay_entry_t *e);
+
+void can_replay_init(can_replay_t *r, can_replay_entry_t *entries, uint32_t size);
+uint32_t can_replay_free(const can_replay_t *r);
+bool can_replay_put(can_replay_t *r, const can_replay_entry_t *e);
+const can_replay_entry_t *can_replay_sched(can_replay_t *r, uint16_t now, uint16_t *compare);
+void can_replay_sent(can_replay_t *r, uint16_t now);
+
+#endif /* _HYDRABUS_CAN_REPLAY_H_ */
@@ -0,0 +1,250 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include "hydrabus_can_ring.h"
+
+/* The frame shall be written before the index which publishes it */
+#define can_ring_barrier() __asm__ __volatile__("" ::: "memory")
+
+#define SLCAN_TIMESTAMP_MOD	(60000)
+
+static const char hex_digits[] = "0123456789ABCDEF";
+
+/**
+  * @brief  Number of bits of a frame on the bus, without the stuff bits.
+  * @param  flags: CAN_RING_FLAG_xxx
+  * @param  dlc: data length
+  * @retval number of bits, interframe space included
+  */
+uint32_t can_frame_bits(uint8_t flags, uint8_t dlc)
+{
+	/*
+	 * SOF, arbitration, control, CRC, ACK, EOF and IFS: 47 bits,
+	 * 67 bits with the extended identifier.
+	 */
+	uint32_t bits = (flags & CAN_RING_FLAG_EXT) ? 67 : 47;
+
+	if(!(flags & CAN_RING_FLAG_RTR))
+		bits += 8 * dlc;
+	return bits;
+}
+
+/**
+  * @brief  Init the frames ring
+  * @param  r: ring
+  * @param  frames: ring storage
+  * @param  size: number of frames, power of 2
+  * @retval None
+  */
+void can_ring_init(can_ring_t *r, can_ring_frame_t *frames, uint32_t size)
+{
+	memset(r, 0, sizeof(*r));
+	r->frames = frames;
+	r->size = size;
+}
+
+/**
+  * @brief  Add a received frame, called from the interrupt.
+  * @param  r: ring
+  * @param  frame: received frame
+  * @retval false if the ring is full, the frame is dropped
+  */
+bool can_ring_put(can_ring_t *r, const can_ring_frame_t *frame)
+{
+	uint32_t wr = r->wr;
+	uint32_t fill = wr - r->rd;
+
+	r->received++;
+	r->bits += can_frame_bits(frame->flags, frame->dlc);
+	if(fill >= r->size) {
+		r->dropped++;
+		return false;
+	}
+
+	r->frames[wr & (r->size - 1)] = *frame;
+	can_ring_barrier();
+	r->wr = wr + 1;
+
+	if(fill + 1 > r->max_fill)
+		r->max_fill = fill + 1;
+	return true;
+}
+
+/**
+  * @brief  Get the oldest frame of the ring, it stays valid until
+  *         can_ring_consume().
+  * @param  r: ring
+  * @retval frame, NULL if the ring is empty
+  */
+const can_ring_frame_t *can_ring_get(can_ring_t *r)
+{
+	uint32_t rd = r->rd;
+
+	if(r->wr == rd)
+		return NULL;
+	can_ring_barrier();
+	return &r->frames[rd & (r->size - 1)];
+}
+
+/**
+  * @brief  Remove the frame returned by can_ring_get()
+  * @param  r: ring
+  * @retval None
+  */
+void can_ring_consume(can_ring_t *r)
+{
+	can_ring_barrier();
+	r->rd++;
+}
+
+/**
+  * @brief  Total number of bits of the frames seen on the bus, for the bus
+  *         load. Shall be called by the reader at least once per 2^32 bits
+  *         (71 minutes at 1Mbps).
+  * @param  r: ring
+  * @retval number of bits
+  */
+uint64_t can_ring_bits(can_ring_t *r)
+{
+	uint32_t bits = r->bits;
+
+	r->total_bits += bits - r->bits_rd;
+	r->bits_rd = bits;
+	return r->total_bits;
+}
+
+/**
+  * @brief  Init the SLCAN timestamp clock, its time is 0 at now.
+  * @param  c: clock
+  * @param  cycles_per_ms: cycle counter frequency / 1000
+  * @param  now: cycle counter
+  * @retval None
+  */
+void can_slcan_clock_init(can_slcan_clock_t *c, uint32_t cycles_per_ms, uint32_t now)
+{
+	c->cycles_per_ms = cycles_per_ms;
+	c->last = now;
+	c->rem = 0;
+	c->ms = 0;
+}
+
+/**
+  * @brief  SLCAN timestamp of a cycle counter value. The values shall be
+  *         increasing, a value slightly older than the previous one (frame
+  *         received before an update with the current time) gets the time
+  *         of the previous one.
+  * @param  c: clock
+  * @param  cycles: cycle counter
+  * @retval milliseconds, modulo 60000
+  */
+uint16_t can_slcan_clock(can_slcan_clock_t *c, uint32_t cycles)
+{
+	uint32_t delta = cycles - c->last;
+	uint64_t total;
+
+	if((int32_t)delta <= 0)
+		return c->ms;
+
+	c->last = cycles;
+	total = (uint64_t)c->rem + delta;
+	c->rem = total % c->cycles_per_ms;
+	c->ms = (c->ms + total / c->cycles_per_ms) % SLCAN_TIMESTAMP_MOD;
+	return c->ms;
+}
+
+static inline char *put_hex(char *p, uint32_t val, uint32_t digits)
+{
+	while(digits > 0) {
+		digits--;
+		*p++ = hex_digits[(val >> (4 * digits)) & 0xf];
+	}
+	return p;
+}
+
+/**
+  * @brief  Encode a frame as a SLCAN line: tiiildd..[TTTT]\r, T for the
+  *         extended identifiers, r/R for the remote frames.
+  * @param  buf: output, room for CAN_SLCAN_MAX_LEN characters
+  * @param  frame: frame
+  * @param  timestamp: add the timestamp
+  * @param  ms: timestamp, see can_slcan_clock()
+  * @retval number of characters written
+  */
+uint32_t can_slcan_format(char *buf, const can_ring_frame_t *frame,
+			  bool timestamp, uint16_t ms)
+{
+	char *p = buf;
+	uint32_t i;
+
+	*p = (frame->flags & CAN_RING_FLAG_RTR) ? 'r' : 't';
+	if(frame->flags & CAN_RING_FLAG_EXT) {
+		/* Extended frames have a capital letter */
+		*p++ -= 32;
+		p = put_hex(p, frame->id, 8);
+	} else {
+		p++;
+		p = put_hex(p, frame->id, 3);
+	}
+	*p++ = hex_digits[frame->dlc & 0xf];
+
+	if(!(frame->flags & CAN_RING_FLAG_RTR)) {
+		for(i = 0; i < frame->dlc; i++) {
+			p = put_hex(p, frame->data[i], 2);
+		}
+	}
+	if(timestamp)
+		p = put_hex(p, ms, 4);
+	*p++ = '\r';
+
+	return p - buf;
+}
+
+/**
+  * @brief  Encode a frame as a Linux SocketCAN struct can_frame, the
+  *         identifier in network byte order as in the pcap files.
+  * @param  buf: output, room for CAN_SOCKETCAN_LEN bytes
+  * @param  frame: frame
+  * @retval number of bytes written
+  */
+uint32_t can_socketcan_format(uint8_t *buf, const can_ring_frame_t *frame)
+{
+	uint32_t id = frame->id;
+	uint32_t i, len = frame->dlc;
+
+	if(frame->flags & CAN_RING_FLAG_EXT)
+		id |= CAN_SOCKETCAN_EFF;
+	if(frame->flags & CAN_RING_FLAG_RTR) {
+		/* The DLC is kept, a remote frame has no data */
+		id |= CAN_SOCKETCAN_RTR;
+		len = 0;
+	}
+
+	buf[0] = id >> 24;
+	buf[1] = id >> 16;
+	buf[2] = id >> 8;
+	buf[3] = id;
+	buf[4] = frame->dlc;
+	buf[5] = 0;
+	buf[6] = 0;
+	buf[7] = 0;
+	for(i = 0; i < 8; i++)
+		buf[8 + i] = (i < len) ? frame->data[i] : 0;
+
+	return CAN_SOCKETCAN_LEN;
+}
@@ -0,0 +1,95 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Received CAN frames ring, written by the CAN RX interrupts and read by
+ * the thread sending them to the host, SLCAN (LAWICEL) text encoder and
+ * SocketCAN (pcapng) encoder.
+ * This file does not depend on ChibiOS nor on the HAL.
+ */
+
+#ifndef _HYDRABUS_CAN_RING_H_
+#define _HYDRABUS_CAN_RING_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define CAN_RING_FLAG_EXT	(1 << 0) /* 29 bits identifier */
+#define CAN_RING_FLAG_RTR	(1 << 1) /* Remote frame */
+#define CAN_RING_FLAG_FIFO1	(1 << 2) /* Received in FIFO 1 */
+
+typedef struct {
+	uint32_t timestamp; /* CPU cycles (168MHz) */
+	uint32_t id;
+	uint8_t flags;
+	uint8_t dlc; /* 0 to 8 */
+	uint8_t filter; /* Filter match index */
+	uint8_t data[8];
+} can_ring_frame_t;
+
+typedef struct {
+	can_ring_frame_t *frames;
+	uint32_t size; /* Power of 2 */
+	volatile uint32_t wr; /* Free running, written by the interrupt */
+	volatile uint32_t rd; /* Free running, written by the reader */
+
+	/* Written by the interrupt */
+	volatile uint32_t received;
+	volatile uint32_t dropped;
+	volatile uint32_t max_fill;
+	volatile uint32_t bits; /* Free running */
+
+	/* Written by the reader */
+	uint32_t bits_rd;
+	uint64_t total_bits; /* Bits of the received and dropped frames */
+} can_ring_t;
+
+/*
+ * SLCAN timestamp, milliseconds modulo 60000, from the 32 bits cycle
+ * counter which wraps every 25s: it shall be updated more often.
+ */
+typedef struct {
+	uint32_t cycles_per_ms;
+	uint32_t last;
+	uint32_t rem; /* Cycles since the last millisecond */
+	uint16_t ms;
+} can_slcan_clock_t;
+
+/* "T" + 8 id + dlc + 16 data + 4 timestamp + "\r" */
+#define CAN_SLCAN_MAX_LEN	(31)
+
+/* Linux SocketCAN struct can_frame, pcapng LINKTYPE_CAN_SOCKETCAN */
+#define CAN_SOCKETCAN_LEN	(16)
+#define CAN_SOCKETCAN_EFF	(0x80000000)
+#define CAN_SOCKETCAN_RTR	(0x40000000)
+
+uint32_t can_frame_bits(uint8_t flags, uint8_t dlc);
+
+void can_ring_init(can_ring_t *r, can_ring_frame_t *frames, uint32_t size);
+bool can_ring_put(can_ring_t *r, const can_ring_frame_t *frame);
+const can_ring_frame_t *can_ring_get(can_ring_t *r);
+void can_ring_consume(can_ring_t *r);
+uint64_t can_ring_bits(can_ring_t *r);
+
+void can_slcan_clock_init(can_slcan_clock_t *c, uint32_t cycles_per_ms, uint32_t now);
+uint16_t can_slcan_clock(can_slcan_clock_t *c, uint32_t cycles);
+uint32_t can_slcan_format(char *buf, const can_ring_frame_t *frame,
+			  bool timestamp, uint16_t ms);
+uint32_t can_socketcan_format(uint8_t *buf, const can_ring_frame_t *frame);
+
+#endif /* _HYDRABUS_CAN_RING_H_ */
@@ -0,0 +1,58 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "hydrabus_detect.h"
+
+/*
+ * This file does not depend on ChibiOS, the console input bytes are fed one
+ * by one and the caller enters the detected mode.
+ */
+
+void detect_init(detect_t *detect)
+{
+	detect->nb_zero = 0;
+}
+
+detect_result_t detect_push(detect_t *detect, uint8_t c)
+{
+	switch(c) {
+	case 0:
+		if (++detect->nb_zero == DETECT_BBIO_NB_ZERO) {
+			detect->nb_zero = 0;
+			return DETECT_BBIO;
+		}
+		return DETECT_NONE;
+	/* Allows to enter SUMP mode automatically */
+	case DETECT_SUMP_ID:
+		if(detect->nb_zero == DETECT_SUMP_NB_ZERO) {
+			detect->nb_zero = 0;
+			return DETECT_SUMP;
+		}
+		return DETECT_NONE;
+	/* Enter SERPROG mode automatically */
+	case DETECT_SERPROG_ID:
+		if(detect->nb_zero == DETECT_SERPROG_NB_ZERO) {
+			detect->nb_zero = 0;
+			return DETECT_SERPROG;
+		}
+		return DETECT_NONE;
+	default:
+		detect->nb_zero = 0;
+		return DETECT_INPUT;
+	}
+}
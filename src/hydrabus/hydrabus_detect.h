@@ -0,0 +1,51 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _HYDRABUS_DETECT_H_
+#define _HYDRABUS_DETECT_H_
+
+#include <stdint.h>
+
+/*
+ * Console input detection of the binary modes:
+ * BBIO is 20*\x00
+ * SUMP identification is 5*\x00 \x02
+ * SERPROG identification is 8*\x00, then \x10
+ */
+#define DETECT_BBIO_NB_ZERO	(20)
+#define DETECT_SUMP_NB_ZERO	(5)
+#define DETECT_SUMP_ID		(0x02)
+#define DETECT_SERPROG_NB_ZERO	(8)
+#define DETECT_SERPROG_ID	(0x10)
+
+typedef enum {
+	DETECT_NONE = 0,	/* Byte used by the detection */
+	DETECT_INPUT,		/* Byte shall be sent to tokenline */
+	DETECT_BBIO,
+	DETECT_SUMP,
+	DETECT_SERPROG,
+} detect_result_t;
+
+typedef struct {
+	uint8_t nb_zero;	/* Number of consecutive \x00 */
+} detect_t;
+
+void detect_init(detect_t *detect);
+detect_result_t detect_push(detect_t *detect, uint8_t c);
+
+#endif /* _HYDRABUS_DETECT_H_ */
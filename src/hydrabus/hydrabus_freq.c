@@ -29,6 +29,7 @@ int cmd_freq(t_hydra_console *con, t_tokenline_parsed *p)
 {
 	uint32_t frequency, duty;
 	mode_config_proto_t* proto = &con->mode->proto;
+	bsp_status_t status;
 	(void) p;
 
 	/**
@@ -36,7 +37,11 @@ int cmd_freq(t_hydra_console *con, t_tokenline_parsed *p)
 	 * @todo previoud implmentation was buggy and didn't work on F407VG chip
 	 * (review datasheet) to add some token parsing and expand the frequnecy reading to multiple GPIO if possible
 	 */
-	bsp_freq_get_values(BSP_DEV_FREQ1, &frequency, &duty);
+	status = bsp_freq_get_values(BSP_DEV_FREQ1, &frequency, &duty);
+	if(status == BSP_BUSY) {
+		cprintf(con, "Error, timer used by another command.\r\n");
+		return FALSE;
+	}
 	cprintf(con, "Frequency : %dHz\r\n", frequency);
 	cprintf(con, "Duty : %d%%\r\n", duty);
 	cprintf(con, "\r\n");
@@ -0,0 +1,300 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include "hydrabus_i2c_sniff.h"
+
+/*
+ * When the DMA is less than this number of samples behind the decoder,
+ * samples are probably overwritten: the decoder restarts from the DMA
+ * write index.
+ */
+#define I2C_SNIFF_OVERRUN(nb_samples)	((nb_samples) / 8)
+
+/**
+  * @brief  Init the decoder state
+  * @param  s: decoder state
+  * @param  samples: samples ring (written by the DMA)
+  * @param  nb_samples: size of the ring, power of 2
+  * @param  scl: SCL pin mask in the samples
+  * @param  sda: SDA pin mask in the samples
+  * @param  period: sample period in CPU cycles
+  * @param  timestamp: time of samples[0]
+  * @param  out: output ring
+  * @param  out_size: size of the output ring, power of 2
+  * @retval None
+  */
+void i2c_sniff_init(i2c_sniff_t *s, const uint16_t *samples, uint32_t nb_samples,
+		    uint16_t scl, uint16_t sda, uint32_t period, uint32_t timestamp,
+		    uint8_t *out, uint32_t out_size)
+{
+	memset(s, 0, sizeof(*s));
+	s->samples = samples;
+	s->nb_samples = nb_samples;
+	s->scl = scl;
+	s->sda = sda;
+	s->period = period;
+	s->time = timestamp;
+	s->out = out;
+	s->out_size = out_size;
+}
+
+static void i2c_sniff_event(i2c_sniff_t *s, uint8_t type, uint8_t data, uint32_t timestamp)
+{
+	i2c_sniff_event_t ev;
+	const uint8_t *p;
+	uint32_t i;
+
+	if(s->out_size - (s->out_wr - s->out_rd) < sizeof(ev)) {
+		s->events_lost++;
+		s->lost = true;
+		return;
+	}
+
+	ev.type = type;
+	if(s->lost) {
+		ev.type |= I2C_SNIFF_FLAG_LOST;
+		s->lost = false;
+	}
+	ev.data = data;
+	ev.timestamp = timestamp;
+
+	p = (const uint8_t *)&ev;
+	for(i = 0; i < sizeof(ev); i++) {
+		s->out[s->out_wr++ & (s->out_size - 1)] = p[i];
+	}
+	s->events++;
+}
+
+/* Decodes a change of the lines from s->lines to lines */
+static void i2c_sniff_change(i2c_sniff_t *s, uint16_t lines, uint32_t timestamp)
+{
+	uint16_t changed = lines ^ s->lines;
+	uint8_t flags;
+
+	if(!(changed & s->scl)) {
+		/* SDA change while SCL is high */
+		if(lines & s->scl) {
+			/*
+			 * The SCL rising edge before a repeated START or a STOP
+			 * is counted as the first bit of a byte.
+			 */
+			flags = (s->in_frame && s->nb_bits > 1) ? I2C_SNIFF_FLAG_ABORT : 0;
+			if(lines & s->sda) {
+				if(s->in_frame)
+					i2c_sniff_event(s, I2C_SNIFF_STOP | flags, 0, timestamp);
+				s->in_frame = false;
+			} else {
+				i2c_sniff_event(s, I2C_SNIFF_START | flags, 0, timestamp);
+				s->in_frame = true;
+			}
+			s->nb_bits = 0;
+			s->value = 0;
+		}
+		return;
+	}
+
+	/*
+	 * SCL rising edge, the bit is the new SDA level even if it changed in
+	 * the same sample (which only happens if the sample rate is too low).
+	 */
+	if(!(lines & s->scl) || !s->in_frame)
+		return;
+
+	s->value = (s->value << 1) | ((lines & s->sda) ? 1 : 0);
+	if(++s->nb_bits == 9) {
+		i2c_sniff_event(s, I2C_SNIFF_BYTE |
+				((s->value & 1) ? I2C_SNIFF_FLAG_NACK : 0),
+				s->value >> 1, timestamp);
+		s->nb_bits = 0;
+		s->value = 0;
+	}
+}
+
+/**
+  * @brief  Decode the samples up to write_index.
+  * @param  s: decoder state
+  * @param  write_index: index of the next sample written by the DMA
+  * @retval None
+  */
+void i2c_sniff_process(i2c_sniff_t *s, uint32_t write_index)
+{
+	const uint16_t *samples = s->samples;
+	const uint32_t mask = s->nb_samples - 1;
+	const uint16_t lines_mask = s->scl | s->sda;
+	uint32_t rd = s->rd;
+	uint32_t count, i;
+	uint16_t lines;
+
+	count = (write_index - rd) & mask;
+	if(count == 0)
+		return;
+
+	if(count > s->nb_samples - I2C_SNIFF_OVERRUN(s->nb_samples)) {
+		s->overruns++;
+		s->lost = true;
+		s->synced = false;
+		s->in_frame = false;
+		s->nb_bits = 0;
+		s->value = 0;
+		s->time += count * s->period;
+		s->rd = write_index & mask;
+		return;
+	}
+
+	if(!s->synced) {
+		s->lines = samples[rd] & lines_mask;
+		s->synced = true;
+	}
+
+	for(i = 0; i < count; i++) {
+		lines = samples[(rd + i) & mask] & lines_mask;
+		if(lines != s->lines) {
+			i2c_sniff_change(s, lines, s->time + i * s->period);
+			s->lines = lines;
+		}
+	}
+	s->time += count * s->period;
+	s->rd = (rd + count) & mask;
+}
+
+/**
+  * @brief  Remove an event from the output ring
+  * @param  s: decoder state
+  * @param  ev: event
+  * @retval false if there is no event
+  */
+bool i2c_sniff_pop(i2c_sniff_t *s, i2c_sniff_event_t *ev)
+{
+	uint8_t *p = (uint8_t *)ev;
+	uint32_t i;
+
+	if(s->out_wr - s->out_rd < sizeof(*ev))
+		return false;
+
+	for(i = 0; i < sizeof(*ev); i++) {
+		p[i] = s->out[s->out_rd++ & (s->out_size - 1)];
+	}
+	return true;
+}
+
+/**
+  * @brief  Get the contiguous bytes available in the output ring
+  * @param  s: decoder state
+  * @param  data: set to the first byte
+  * @retval number of bytes
+  */
+uint32_t i2c_sniff_out_get(i2c_sniff_t *s, const uint8_t **data)
+{
+	uint32_t rd = s->out_rd & (s->out_size - 1);
+	uint32_t len = s->out_wr - s->out_rd;
+
+	if(len > s->out_size - rd)
+		len = s->out_size - rd;
+	*data = &s->out[rd];
+	return len;
+}
+
+/**
+  * @brief  Remove sent bytes from the output ring
+  * @param  s: decoder state
+  * @param  len: number of bytes sent
+  * @retval None
+  */
+void i2c_sniff_out_consume(i2c_sniff_t *s, uint32_t len)
+{
+	s->out_rd += len;
+}
+
+/**
+  * @brief  Init the Linux I2C messages assembler
+  * @param  m: assembler state
+  * @param  timestamp: current time, see i2c_sniff_init()
+  * @retval None
+  */
+void i2c_sniff_linux_init(i2c_sniff_linux_t *m, uint32_t timestamp)
+{
+	memset(m, 0, sizeof(*m));
+	m->time = timestamp;
+}
+
+/* Writes the current message if it has an address byte */
+static void i2c_sniff_linux_end(i2c_sniff_linux_t *m, pcapng_writer_t *w)
+{
+	if(m->len > I2C_LINUX_HDR_SIZE) {
+		pcapng_writer_packet(w, PCAPNG_LINK_I2C, m->start, m->buf, m->len);
+		m->messages++;
+	}
+	m->len = 0;
+}
+
+/**
+  * @brief  Add an event to the current message, writes the message to the
+  *         pcapng file at the next START or STOP. Messages with lost events
+  *         are dropped.
+  * @param  m: assembler state
+  * @param  ev: event from i2c_sniff_pop()
+  * @param  w: pcapng writer, timestamps in CPU cycles
+  * @retval None
+  */
+void i2c_sniff_linux_event(i2c_sniff_linux_t *m, const i2c_sniff_event_t *ev,
+			   pcapng_writer_t *w)
+{
+	uint64_t time = pcapng_ts_extend(&m->time, ev->timestamp);
+
+	if(ev->type & I2C_SNIFF_FLAG_LOST)
+		m->len = 0;
+
+	switch(ev->type & I2C_SNIFF_TYPE_MASK) {
+	case I2C_SNIFF_START:
+		i2c_sniff_linux_end(m, w);
+		memset(m->buf, 0, I2C_LINUX_HDR_SIZE);
+		m->len = I2C_LINUX_HDR_SIZE;
+		m->full = false;
+		m->start = time;
+		break;
+	case I2C_SNIFF_STOP:
+		i2c_sniff_linux_end(m, w);
+		break;
+	case I2C_SNIFF_BYTE:
+		if(m->len == 0)
+			break;
+		if(m->len == sizeof(m->buf)) {
+			if(!m->full)
+				m->truncated++;
+			m->full = true;
+			break;
+		}
+		if(m->len == I2C_LINUX_HDR_SIZE && (ev->data & 1))
+			m->buf[4] = I2C_LINUX_FLAG_RD;
+		m->buf[m->len++] = ev->data;
+		break;
+	}
+}
+
+/**
+  * @brief  Keep the timestamps extended to 64 bits on a quiet bus, call it
+  *         at least every 10s.
+  * @param  m: assembler state
+  * @param  timestamp: current time, not older than the events
+  * @retval None
+  */
+void i2c_sniff_linux_tick(i2c_sniff_linux_t *m, uint32_t timestamp)
+{
+	pcapng_ts_extend(&m->time, timestamp);
+}
@@ -0,0 +1,119 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * I2C sniffer decoder: finds the START/STOP conditions and the bytes in the
+ * SCL/SDA samples written by the DMA in a circular buffer (see bsp_sampler)
+ * and encodes them as timestamped events in an output ring, and assembles
+ * the events in Linux I2C messages for the pcapng files.
+ * This file does not depend on ChibiOS nor on the HAL.
+ */
+
+#ifndef _HYDRABUS_I2C_SNIFF_H_
+#define _HYDRABUS_I2C_SNIFF_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pcapng.h"
+
+/* Event types */
+#define I2C_SNIFF_START		(0x01) /* START or repeated START */
+#define I2C_SNIFF_STOP		(0x02)
+#define I2C_SNIFF_BYTE		(0x03) /* data is the byte */
+#define I2C_SNIFF_TYPE_MASK	(0x0F)
+/* Flags */
+/* The byte was not acknowledged */
+#define I2C_SNIFF_FLAG_NACK	(1 << 4)
+/* START/STOP in the middle of a byte, the incomplete byte is dropped */
+#define I2C_SNIFF_FLAG_ABORT	(1 << 5)
+/* Events or samples were lost before this event */
+#define I2C_SNIFF_FLAG_LOST	(1 << 7)
+
+/*
+ * Event sent to the host, little endian. The timestamp is in CPU cycles
+ * (168MHz): time of the sample which shows the condition, or the SCL rising
+ * edge of the ACK bit for a byte.
+ */
+typedef struct __attribute__ ((packed)) {
+	uint8_t type; /* Event type | flags */
+	uint8_t data;
+	uint32_t timestamp;
+} i2c_sniff_event_t;
+
+typedef struct {
+	/* Samples ring, nb_samples shall be a power of 2 */
+	const uint16_t *samples;
+	uint32_t nb_samples;
+	uint32_t rd;
+	uint16_t scl; /* Pin masks in the samples */
+	uint16_t sda;
+	uint32_t period; /* Sample period in CPU cycles */
+	uint32_t time; /* Timestamp of samples[rd] */
+
+	/* Decoder state */
+	bool synced;
+	bool in_frame;
+	bool lost;
+	uint16_t lines; /* Previous sample, masked */
+	uint16_t value;
+	uint8_t nb_bits;
+
+	/* Output ring of i2c_sniff_event_t, out_size shall be a power of 2 */
+	uint8_t *out;
+	uint32_t out_size;
+	uint32_t out_wr; /* Free running */
+	uint32_t out_rd;
+
+	uint32_t events;
+	uint32_t events_lost;
+	uint32_t overruns;
+} i2c_sniff_t;
+
+/*
+ * Linux I2C packet (LINKTYPE_I2C_LINUX): bus number, flags (big endian),
+ * then the address byte and the data bytes of one message, from a START
+ * to the next START or STOP.
+ */
+#define I2C_LINUX_HDR_SIZE	(5)
+#define I2C_LINUX_FLAG_RD	(0x0001) /* I2C_M_RD */
+#define I2C_LINUX_MAX_DATA	(256)
+
+typedef struct {
+	uint8_t buf[I2C_LINUX_HDR_SIZE + 1 + I2C_LINUX_MAX_DATA];
+	uint32_t len; /* 0 out of a message */
+	bool full;
+	uint64_t start; /* Extended timestamp of the START */
+	uint64_t time; /* Extended timestamp of the last event */
+	uint32_t messages;
+	uint32_t truncated; /* Messages longer than I2C_LINUX_MAX_DATA */
+} i2c_sniff_linux_t;
+
+void i2c_sniff_init(i2c_sniff_t *s, const uint16_t *samples, uint32_t nb_samples,
+		    uint16_t scl, uint16_t sda, uint32_t period, uint32_t timestamp,
+		    uint8_t *out, uint32_t out_size);
+void i2c_sniff_process(i2c_sniff_t *s, uint32_t write_index);
+bool i2c_sniff_pop(i2c_sniff_t *s, i2c_sniff_event_t *ev);
+uint32_t i2c_sniff_out_get(i2c_sniff_t *s, const uint8_t **data);
+void i2c_sniff_out_consume(i2c_sniff_t *s, uint32_t len);
+
+void i2c_sniff_linux_init(i2c_sniff_linux_t *m, uint32_t timestamp);
+void i2c_sniff_linux_event(i2c_sniff_linux_t *m, const i2c_sniff_event_t *ev,
+			   pcapng_writer_t *w);
+void i2c_sniff_linux_tick(i2c_sniff_linux_t *m, uint32_t timestamp);
+
+#endif /* _HYDRABUS_I2C_SNIFF_H_ */
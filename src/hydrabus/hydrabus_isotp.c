@@ -0,0 +1,309 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include "hydrabus_isotp.h"
+
+/* Protocol control information, high nibble of the first byte */
+#define ISOTP_PCI_SF	(0x00)
+#define ISOTP_PCI_FF	(0x10)
+#define ISOTP_PCI_CF	(0x20)
+#define ISOTP_PCI_FC	(0x30)
+
+/* Flow status */
+#define ISOTP_FS_CTS	(0)
+#define ISOTP_FS_WAIT	(1)
+#define ISOTP_FS_OVFLW	(2)
+
+/* Payload of the single, first and consecutive frames */
+#define ISOTP_SF_MAX	(7)
+#define ISOTP_FF_DATA	(6)
+#define ISOTP_CF_DATA	(7)
+
+static void frame_pad(const isotp_t *t, isotp_frame_t *out)
+{
+	if(t->cfg->flags & ISOTP_FLAG_PAD) {
+		memset(&out->data[out->dlc], ISOTP_PAD_BYTE, 8 - out->dlc);
+		out->dlc = 8;
+	}
+}
+
+static void frame_fc(const isotp_t *t, uint8_t fs, isotp_frame_t *out)
+{
+	out->data[0] = ISOTP_PCI_FC | fs;
+	out->data[1] = t->cfg->block_size;
+	out->data[2] = t->cfg->stmin;
+	out->dlc = 3;
+	frame_pad(t, out);
+}
+
+static void set_error(isotp_t *t, isotp_error_t error)
+{
+	t->state = ISOTP_ERROR;
+	t->error = error;
+}
+
+/**
+  * @brief  Init a link
+  * @param  t: link
+  * @param  cfg: configuration, used until the end of the link
+  * @param  rx_buf: received PDU storage
+  * @param  rx_size: rx_buf size, ISOTP_MAX_PDU for any PDU
+  * @retval None
+  */
+void isotp_init(isotp_t *t, const isotp_config_t *cfg, uint8_t *rx_buf, uint16_t rx_size)
+{
+	memset(t, 0, sizeof(*t));
+	t->cfg = cfg;
+	t->rx_buf = rx_buf;
+	t->rx_size = rx_size;
+}
+
+/**
+  * @brief  Minimum separation time between consecutive frames
+  * @param  stmin: ISO 15765-2 encoding, reserved values are 127ms
+  * @retval microseconds
+  */
+uint32_t isotp_stmin_us(uint8_t stmin)
+{
+	if(stmin <= 0x7f)
+		return stmin * 1000;
+	if(stmin >= 0xf1 && stmin <= 0xf9)
+		return (stmin - 0xf0) * 100;
+	return 127000;
+}
+
+/**
+  * @brief  Start sending a PDU, the state is ISOTP_DONE when it fits in a
+  *         single frame, ISOTP_TX_WAIT_FC otherwise.
+  * @param  t: link
+  * @param  pdu: data, used until the end of the transmission
+  * @param  len: 1 to ISOTP_MAX_PDU bytes
+  * @param  out: single or first frame to send
+  * @retval false if the length is not valid
+  */
+bool isotp_send(isotp_t *t, const uint8_t *pdu, uint16_t len, isotp_frame_t *out)
+{
+	if(len == 0 || len > ISOTP_MAX_PDU)
+		return false;
+
+	t->error = ISOTP_ERR_NONE;
+	if(len <= ISOTP_SF_MAX) {
+		out->data[0] = ISOTP_PCI_SF | len;
+		memcpy(&out->data[1], pdu, len);
+		out->dlc = 1 + len;
+		frame_pad(t, out);
+		t->state = ISOTP_DONE;
+		return true;
+	}
+
+	out->data[0] = ISOTP_PCI_FF | (len >> 8);
+	out->data[1] = len & 0xff;
+	memcpy(&out->data[2], pdu, ISOTP_FF_DATA);
+	out->dlc = 8;
+
+	t->tx_buf = pdu;
+	t->tx_len = len;
+	t->tx_pos = ISOTP_FF_DATA;
+	t->tx_sn = 1;
+	t->tx_wft = 0;
+	t->state = ISOTP_TX_WAIT_FC;
+	return true;
+}
+
+/**
+  * @brief  Next consecutive frame, in the ISOTP_TX_CF state. The caller
+  *         waits STmin between the frames.
+  * @param  t: link
+  * @param  out: consecutive frame to send
+  * @retval false if no frame can be sent
+  */
+bool isotp_send_cf(isotp_t *t, isotp_frame_t *out)
+{
+	uint16_t n;
+
+	if(t->state != ISOTP_TX_CF)
+		return false;
+
+	n = t->tx_len - t->tx_pos;
+	if(n > ISOTP_CF_DATA)
+		n = ISOTP_CF_DATA;
+	out->data[0] = ISOTP_PCI_CF | t->tx_sn;
+	memcpy(&out->data[1], &t->tx_buf[t->tx_pos], n);
+	out->dlc = 1 + n;
+	frame_pad(t, out);
+
+	t->tx_pos += n;
+	t->tx_sn = (t->tx_sn + 1) & 0xf;
+	if(t->tx_pos == t->tx_len) {
+		t->state = ISOTP_DONE;
+	} else if(t->tx_bs != 0 && --t->tx_bs_left == 0) {
+		t->state = ISOTP_TX_WAIT_FC;
+		t->tx_wft = 0;
+	}
+	return true;
+}
+
+/**
+  * @brief  Wait for a PDU, the state is ISOTP_DONE when rx_len bytes are
+  *         received in rx_buf.
+  * @param  t: link
+  * @retval None
+  */
+void isotp_recv_start(isotp_t *t)
+{
+	t->error = ISOTP_ERR_NONE;
+	t->rx_len = 0;
+	t->rx_pos = 0;
+	t->state = ISOTP_RX_WAIT;
+}
+
+static void receive_fc(isotp_t *t, const uint8_t *data, uint8_t dlc)
+{
+	if(t->state != ISOTP_TX_WAIT_FC)
+		return;
+	if(dlc < 3) {
+		set_error(t, ISOTP_ERR_FC);
+		return;
+	}
+
+	switch(data[0] & 0xf) {
+	case ISOTP_FS_CTS:
+		t->tx_bs = data[1];
+		t->tx_bs_left = data[1];
+		t->tx_stmin = data[2];
+		t->state = ISOTP_TX_CF;
+		break;
+	case ISOTP_FS_WAIT:
+		if(++t->tx_wft > ISOTP_MAX_WFT)
+			set_error(t, ISOTP_ERR_FC);
+		break;
+	default:
+		set_error(t, ISOTP_ERR_FC);
+		break;
+	}
+}
+
+static void receive_sf(isotp_t *t, const uint8_t *data, uint8_t dlc)
+{
+	uint8_t len = data[0] & 0xf;
+
+	/* Invalid lengths are ignored */
+	if(len == 0 || len > ISOTP_SF_MAX || len >= dlc)
+		return;
+	if(len > t->rx_size) {
+		set_error(t, ISOTP_ERR_OVERFLOW);
+		return;
+	}
+
+	memcpy(t->rx_buf, &data[1], len);
+	t->rx_len = len;
+	t->rx_pos = len;
+	t->state = ISOTP_DONE;
+}
+
+static bool receive_ff(isotp_t *t, const uint8_t *data, uint8_t dlc,
+		       isotp_frame_t *out)
+{
+	uint16_t len = ((data[0] & 0xf) << 8) | data[1];
+
+	if(dlc < 8 || len <= ISOTP_SF_MAX)
+		return false;
+	if(len > t->rx_size) {
+		frame_fc(t, ISOTP_FS_OVFLW, out);
+		set_error(t, ISOTP_ERR_OVERFLOW);
+		return true;
+	}
+
+	memcpy(t->rx_buf, &data[2], ISOTP_FF_DATA);
+	t->rx_len = len;
+	t->rx_pos = ISOTP_FF_DATA;
+	t->rx_sn = 1;
+	t->rx_bs_count = 0;
+	t->state = ISOTP_RX_CF;
+	frame_fc(t, ISOTP_FS_CTS, out);
+	return true;
+}
+
+static bool receive_cf(isotp_t *t, const uint8_t *data, uint8_t dlc,
+		       isotp_frame_t *out)
+{
+	uint16_t n;
+
+	if(t->state != ISOTP_RX_CF)
+		return false;
+	if((data[0] & 0xf) != t->rx_sn) {
+		set_error(t, ISOTP_ERR_SN);
+		return false;
+	}
+
+	n = t->rx_len - t->rx_pos;
+	if(n > ISOTP_CF_DATA)
+		n = ISOTP_CF_DATA;
+	/* The last frame may be shorter, the others shall be full */
+	if(dlc < 1 + n)
+		return false;
+	memcpy(&t->rx_buf[t->rx_pos], &data[1], n);
+	t->rx_pos += n;
+	t->rx_sn = (t->rx_sn + 1) & 0xf;
+
+	if(t->rx_pos == t->rx_len) {
+		t->state = ISOTP_DONE;
+		return false;
+	}
+	if(t->cfg->block_size != 0 && ++t->rx_bs_count == t->cfg->block_size) {
+		t->rx_bs_count = 0;
+		frame_fc(t, ISOTP_FS_CTS, out);
+		return true;
+	}
+	return false;
+}
+
+/**
+  * @brief  Process a frame received with the rx_id identifier: flow control
+  *         while sending, single, first or consecutive frame while
+  *         receiving. A single or first frame restarts the reception.
+  * @param  t: link
+  * @param  data: frame data
+  * @param  dlc: frame length
+  * @param  out: flow control frame to send
+  * @retval true if out shall be sent
+  */
+bool isotp_receive(isotp_t *t, const uint8_t *data, uint8_t dlc, isotp_frame_t *out)
+{
+	if(dlc == 0)
+		return false;
+
+	switch(data[0] & 0xf0) {
+	case ISOTP_PCI_FC:
+		receive_fc(t, data, dlc);
+		return false;
+	case ISOTP_PCI_SF:
+		if(t->state == ISOTP_RX_WAIT || t->state == ISOTP_RX_CF)
+			receive_sf(t, data, dlc);
+		return false;
+	case ISOTP_PCI_FF:
+		if(t->state != ISOTP_RX_WAIT && t->state != ISOTP_RX_CF)
+			return false;
+		return receive_ff(t, data, dlc, out);
+	case ISOTP_PCI_CF:
+		return receive_cf(t, data, dlc, out);
+	default:
+		return false;
+	}
+}
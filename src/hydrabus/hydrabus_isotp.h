@@ -0,0 +1,105 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * ISO-TP (ISO 15765-2) segmentation and reassembly of PDUs up to 4095
+ * bytes over classic CAN frames, normal addressing. The link is half
+ * duplex: a PDU is sent or received at a time. The caller sends the
+ * frames, feeds the received ones and handles the STmin and timeouts.
+ * This file does not depend on ChibiOS nor on the HAL.
+ */
+
+#ifndef _HYDRABUS_ISOTP_H_
+#define _HYDRABUS_ISOTP_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define ISOTP_MAX_PDU		(4095)
+
+/* Configuration flags */
+#define ISOTP_FLAG_EXT		(1 << 0) /* 29 bits identifiers */
+#define ISOTP_FLAG_PAD		(1 << 1) /* Frames padded to 8 bytes */
+
+#define ISOTP_PAD_BYTE		(0xCC)
+
+/* Flow control WAIT frames accepted before giving up (N_WFTmax) */
+#define ISOTP_MAX_WFT		(16)
+
+typedef struct {
+	uint32_t tx_id;
+	uint32_t rx_id;
+	uint8_t flags;
+	uint8_t block_size; /* Sent in the flow control, 0: no limit */
+	uint8_t stmin; /* Sent in the flow control, ISO 15765-2 encoding */
+} isotp_config_t;
+
+typedef enum {
+	ISOTP_IDLE = 0,
+	ISOTP_TX_WAIT_FC, /* First frame or block sent */
+	ISOTP_TX_CF, /* Consecutive frames to send */
+	ISOTP_RX_WAIT, /* Waiting for a single or first frame */
+	ISOTP_RX_CF, /* Waiting for the consecutive frames */
+	ISOTP_DONE, /* PDU sent or received */
+	ISOTP_ERROR,
+} isotp_state_t;
+
+typedef enum {
+	ISOTP_ERR_NONE = 0,
+	ISOTP_ERR_SN, /* Wrong consecutive frame sequence number */
+	ISOTP_ERR_OVERFLOW, /* PDU larger than the receive buffer */
+	ISOTP_ERR_FC, /* Invalid flow control, overflow or too many WAIT */
+} isotp_error_t;
+
+typedef struct {
+	uint8_t dlc;
+	uint8_t data[8];
+} isotp_frame_t;
+
+typedef struct {
+	const isotp_config_t *cfg;
+	isotp_state_t state;
+	isotp_error_t error;
+
+	/* Transmission */
+	const uint8_t *tx_buf;
+	uint16_t tx_len;
+	uint16_t tx_pos;
+	uint8_t tx_sn;
+	uint8_t tx_bs; /* Block size of the peer, 0: no limit */
+	uint8_t tx_bs_left; /* Consecutive frames until the next flow control */
+	uint8_t tx_stmin; /* STmin of the peer, see isotp_stmin_us() */
+	uint8_t tx_wft;
+
+	/* Reception */
+	uint8_t *rx_buf;
+	uint16_t rx_size;
+	uint16_t rx_len;
+	uint16_t rx_pos;
+	uint8_t rx_sn;
+	uint8_t rx_bs_count;
+} isotp_t;
+
+void isotp_init(isotp_t *t, const isotp_config_t *cfg, uint8_t *rx_buf, uint16_t rx_size);
+uint32_t isotp_stmin_us(uint8_t stmin);
+bool isotp_send(isotp_t *t, const uint8_t *pdu, uint16_t len, isotp_frame_t *out);
+bool isotp_send_cf(isotp_t *t, isotp_frame_t *out);
+void isotp_recv_start(isotp_t *t);
+bool isotp_receive(isotp_t *t, const uint8_t *data, uint8_t dlc, isotp_frame_t *out);
+
+#endif /* _HYDRABUS_ISOTP_H_ */
@@ -446,6 +446,13 @@ static int hydrabus_mode_read(t_hydra_console *con, t_tokenline_parsed *p,
 	} else {
 		count = 1;
 	}
+	if(count <= 0) {
+		cprintf(con, "Read count must be at least 1.\r\n");
+		return t - token_pos;
+	}
+	if(count > MODE_CONFIG_PROTO_BUFFER_SIZE) {
+		count = MODE_CONFIG_PROTO_BUFFER_SIZE;
+	}
 
 	mode_status = !HYDRABUS_MODE_STATUS_OK;
 	if(con->mode->exec->read != NULL) {
@@ -470,7 +477,7 @@ static int hydrabus_mode_hexdump(t_hydra_console *con, t_tokenline_parsed *p,
 	uint32_t count;
 	uint32_t bytes_read = 0;
 	int t;
-	uint8_t to_rx;
+	uint32_t to_rx;
 
 	p_proto = &con->mode->proto;
 
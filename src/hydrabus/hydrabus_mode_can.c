@@ -22,12 +22,16 @@
 #include "bsp_gpio.h"
 #include "bsp_can.h"
 #include "hydrabus_mode_can.h"
+#include "hydrabus_can_ring.h"
+#include "hydrabus_can_replay.h"
+#include "microsd.h"
 #include <string.h>
 #include <stdio.h>
+#include <ctype.h>
 
 static int exec(t_hydra_console *con, t_tokenline_parsed *p, int token_pos);
 static int show(t_hydra_console *con, t_tokenline_parsed *p);
-static uint32_t read(t_hydra_console *con, uint8_t *rx_data, uint8_t nb_data);
+static uint32_t read(t_hydra_console *con, uint8_t *rx_data, uint32_t nb_data);
 
 static const char* str_pins_can[] = {
 	"TX: PB9\r\nRX: PB8\r\n",
@@ -38,6 +42,75 @@ static const char* str_prompt_can[] = {
 	"can2" PROMPT,
 };
 
+/* ISO-TP N_Bs and N_Cr timeouts */
+#define CAN_ISOTP_TIMEOUT_MS	(1000)
+/* UDS response timeouts, then after a response pending (P2 and P2*) */
+#define CAN_UDS_P2_MS		(1000)
+#define CAN_UDS_P2_EXT_MS	(5000)
+
+#define CAN_CAPTURE_FRAMES	(512) /* Power of 2 */
+#define CAN_CAPTURE_OUT_SIZE	(2048)
+#define CAN_CAPTURE_PCAP_SIZE	(4096)
+
+/*
+ * SLCAN capture: the RX interrupts fill the frames ring, the reader thread
+ * encodes the pending frames and sends them to the console in bulk, or
+ * writes them to a pcapng file.
+ */
+typedef struct {
+	t_hydra_console *con;
+	bsp_dev_can_t dev_num;
+	can_ring_t ring;
+	can_ring_frame_t *frames;
+	can_slcan_clock_t clock;
+	bool timestamp;
+	char *out;
+	file_pcapng_t *pcap; /* NULL for SLCAN */
+	uint64_t pcap_time; /* Extended cycle counter */
+	binary_semaphore_t rx_sem;
+	thread_t *thread;
+	systime_t start;
+	/* Counters at the last SLCAN status command */
+	uint32_t dropped;
+	uint32_t overruns;
+} can_capture_t;
+
+/* Statistics of the last capture of each device, see can_print_stats() */
+typedef struct {
+	bool valid;
+	uint32_t received;
+	uint32_t dropped;
+	uint32_t overruns;
+	uint32_t max_fill;
+	uint64_t bits;
+	uint32_t duration; /* ms */
+	uint32_t speed;
+} can_capture_stats_t;
+static can_capture_stats_t can_stats[BSP_DEV_CAN_END];
+
+#define CAN_REPLAY_ENTRIES	(512) /* Power of 2 */
+#define CAN_REPLAY_READ_SIZE	(512)
+#define CAN_REPLAY_LINE_LEN	(128)
+/* Mailboxes full, send again after */
+#define CAN_REPLAY_RETRY_US	(20)
+
+/*
+ * Log replay: the console thread parses the file into the schedule, the
+ * timer interrupt sends the frames.
+ */
+typedef struct {
+	bsp_dev_can_t dev_num;
+	can_replay_t replay;
+	can_replay_parser_t parser;
+	binary_semaphore_t sem;
+	bool started;
+	bool busy; /* Timer owned by the other CAN device */
+	uint32_t frames;
+	uint32_t errors;
+	uint32_t line_len;
+	char line[CAN_REPLAY_LINE_LEN];
+} can_replay_ctx_t;
+
 static const char* str_bsp_init_err= { "bsp_can_init() error %d\r\n" };
 
 static void init_proto_default(t_hydra_console *con)
@@ -54,7 +127,14 @@ static void init_proto_default(t_hydra_console *con)
 
 	proto->config.can.filter_id = 0;
 	proto->config.can.filter_mask = 0;
+	proto->config.can.nb_filter_rules = 0;
 
+	/* UDS physical addressing of the engine ECU */
+	proto->config.can.isotp.tx_id = 0x7e0;
+	proto->config.can.isotp.rx_id = 0x7e8;
+	proto->config.can.isotp.flags = ISOTP_FLAG_PAD;
+	proto->config.can.isotp.block_size = 0;
+	proto->config.can.isotp.stmin = 0;
 }
 
 static void show_params(t_hydra_console *con)
@@ -71,35 +151,6 @@ static void show_params(t_hydra_console *con)
 	cprintf(con, "SJW: %dTQ\r\n", 1+((timings&0x3000000)>>24));
 }
 
-static void can_slcan_out(t_hydra_console *con, can_rx_frame *msg)
-{
-	char slcanmsg[27] = {0};
-	char outcode;
-	uint8_t i;
-	uint8_t offset = 0;
-
-	if (msg->header.RTR == CAN_RTR_DATA) {
-		outcode = 't';
-	} else {
-		outcode = 'r';
-	}
-	if (msg->header.IDE == CAN_ID_EXT) {
-		/*Extended frames have a capital letter */
-		outcode -= 32;
-		offset = snprintf(slcanmsg, 27, "%c%08X%d",
-			outcode, (unsigned int)msg->header.ExtId, (int)msg->header.DLC);
-	} else {
-		offset = snprintf(slcanmsg, 27, "%c%03X%d",
-			outcode, (unsigned int)msg->header.StdId, (int)msg->header.DLC);
-	}
-
-	for (i=0; i<msg->header.DLC; i++) {
-		snprintf(slcanmsg+offset, 3, "%02X", (unsigned int)msg->data[i]);
-		offset += 2;
-	}
-	cprintf(con, "%s\r", slcanmsg);
-}
-
 static bsp_status_t can_slcan_in(uint8_t *slcanmsg, can_tx_frame *msg)
 {
 	uint8_t data_index, i;
@@ -150,6 +201,248 @@ static bsp_status_t can_slcan_in(uint8_t *slcanmsg, can_tx_frame *msg)
 	return BSP_OK;
 }
 
+/**
+  * @brief  Program the filter banks with the identifiers rules of the
+  *         configuration, all the frames are accepted without rule.
+  * @param  proto: mode config
+  * @retval status of the filter banks setup
+  */
+bsp_status_t can_set_filter_rules(mode_config_proto_t* proto)
+{
+	can_filter_bank_t banks[BSP_CAN_FILTER_BANKS];
+	uint32_t nb_banks;
+
+	nb_banks = can_filter_compile(proto->config.can.filter_rules,
+				      proto->config.can.nb_filter_rules,
+				      banks, BSP_CAN_FILTER_BANKS);
+	if(nb_banks == 0) {
+		return bsp_can_init_filter(proto->dev_num, proto);
+	}
+	return bsp_can_set_filter_banks(proto->dev_num, banks, nb_banks);
+}
+
+/**
+  * @brief  Add identifiers rules to the configuration and program them.
+  * @param  proto: mode config
+  * @param  rules: rules to add
+  * @param  nb_rules: number of rules
+  * @retval BSP_ERROR if there are more than CAN_CONFIG_FILTER_RULES rules
+  */
+bsp_status_t can_add_filter_rules(mode_config_proto_t* proto,
+				  const can_filter_rule_t *rules, uint32_t nb_rules)
+{
+	can_config_t *can = &proto->config.can;
+
+	if(can->nb_filter_rules + nb_rules > CAN_CONFIG_FILTER_RULES) {
+		return BSP_ERROR;
+	}
+	memcpy(&can->filter_rules[can->nb_filter_rules], rules,
+	       nb_rules * sizeof(can_filter_rule_t));
+	can->nb_filter_rules += nb_rules;
+
+	return can_set_filter_rules(proto);
+}
+
+/*
+ * SLCAN filter extension, "M-" accepts all the frames, "M+<list>" adds
+ * identifiers, see can_filter_parse() for the list syntax.
+ */
+static bsp_status_t slcan_filter_rules(mode_config_proto_t* proto, uint8_t *buff)
+{
+	can_filter_rule_t rules[CAN_CONFIG_FILTER_RULES];
+	uint8_t *end;
+	int nb;
+
+	end = memchr(buff, '\r', SLCAN_BUFF_LEN);
+	if(end == NULL) {
+		return BSP_ERROR;
+	}
+	*end = 0;
+
+	if(buff[1] == '-') {
+		proto->config.can.nb_filter_rules = 0;
+		return can_set_filter_rules(proto);
+	}
+	nb = can_filter_parse((char *)&buff[2], rules, CAN_CONFIG_FILTER_RULES);
+	if(nb <= 0) {
+		return BSP_ERROR;
+	}
+	return can_add_filter_rules(proto, rules, nb);
+}
+
+static bsp_status_t can_isotp_write(mode_config_proto_t* proto,
+				    const isotp_frame_t *frame)
+{
+	isotp_config_t *cfg = &proto->config.can.isotp;
+	can_tx_frame tx_msg;
+
+	if(cfg->flags & ISOTP_FLAG_EXT) {
+		tx_msg.header.ExtId = cfg->tx_id;
+		tx_msg.header.IDE = CAN_ID_EXT;
+	} else {
+		tx_msg.header.StdId = cfg->tx_id;
+		tx_msg.header.IDE = CAN_ID_STD;
+	}
+	tx_msg.header.RTR = CAN_RTR_DATA;
+	tx_msg.header.DLC = frame->dlc;
+	memcpy(tx_msg.data, frame->data, frame->dlc);
+
+	return bsp_can_write(proto->dev_num, &tx_msg);
+}
+
+/* Wait for a frame of the ISO-TP peer, the other frames are dropped */
+static bsp_status_t can_isotp_read(mode_config_proto_t* proto,
+				   can_rx_frame *rx_msg, uint32_t timeout_ms)
+{
+	isotp_config_t *cfg = &proto->config.can.isotp;
+	uint32_t ide = (cfg->flags & ISOTP_FLAG_EXT) ? CAN_ID_EXT : CAN_ID_STD;
+	systime_t start = chVTGetSystemTime();
+	uint32_t id;
+
+	while(chVTTimeElapsedSinceX(start) < TIME_MS2I(timeout_ms)) {
+		if(hydrabus_ubtn()) {
+			return BSP_ERROR;
+		}
+		if(bsp_can_rxne(proto->dev_num) == 0) {
+			continue;
+		}
+		if(bsp_can_read(proto->dev_num, rx_msg) != BSP_OK) {
+			return BSP_ERROR;
+		}
+		id = (rx_msg->header.IDE == CAN_ID_EXT) ?
+		     rx_msg->header.ExtId : rx_msg->header.StdId;
+		if(rx_msg->header.IDE == ide && id == cfg->rx_id &&
+		   rx_msg->header.RTR == CAN_RTR_DATA) {
+			if(rx_msg->header.DLC > 8) {
+				rx_msg->header.DLC = 8;
+			}
+			return BSP_OK;
+		}
+	}
+	return BSP_TIMEOUT;
+}
+
+/* STmin runs from the end of the previous consecutive frame */
+static bsp_status_t can_isotp_stmin(mode_config_proto_t* proto, uint8_t stmin)
+{
+	uint32_t cycles = isotp_stmin_us(stmin) * (STM32_HCLK / 1000000);
+	uint32_t start;
+
+	while(!bsp_can_tx_done(proto->dev_num)) {
+		if(hydrabus_ubtn()) {
+			return BSP_ERROR;
+		}
+	}
+	start = bsp_get_cyclecounter();
+	while(bsp_get_cyclecounter() - start < cycles);
+
+	return BSP_OK;
+}
+
+static bsp_status_t can_isotp_send(mode_config_proto_t* proto, isotp_t *t,
+				   const uint8_t *pdu, uint16_t len)
+{
+	isotp_frame_t frame;
+	can_rx_frame rx_msg;
+	bsp_status_t status;
+	bool first_cf = false;
+
+	if(!isotp_send(t, pdu, len, &frame)) {
+		return BSP_ERROR;
+	}
+	status = can_isotp_write(proto, &frame);
+
+	while(status == BSP_OK) {
+		switch(t->state) {
+		case ISOTP_TX_WAIT_FC:
+			status = can_isotp_read(proto, &rx_msg, CAN_ISOTP_TIMEOUT_MS);
+			if(status == BSP_OK) {
+				isotp_receive(t, rx_msg.data, rx_msg.header.DLC, &frame);
+				first_cf = true;
+			}
+			break;
+		case ISOTP_TX_CF:
+			/* The consecutive frames of a block are queued back to back */
+			if(!first_cf && t->tx_stmin != 0) {
+				status = can_isotp_stmin(proto, t->tx_stmin);
+				if(status != BSP_OK) {
+					break;
+				}
+			}
+			first_cf = false;
+			isotp_send_cf(t, &frame);
+			status = can_isotp_write(proto, &frame);
+			break;
+		case ISOTP_DONE:
+			return BSP_OK;
+		default:
+			return BSP_ERROR;
+		}
+	}
+	return status;
+}
+
+static bsp_status_t can_isotp_recv(mode_config_proto_t* proto, isotp_t *t,
+				   uint32_t timeout_ms)
+{
+	isotp_frame_t frame;
+	can_rx_frame rx_msg;
+	bsp_status_t status;
+
+	isotp_recv_start(t);
+	while(t->state == ISOTP_RX_WAIT || t->state == ISOTP_RX_CF) {
+		status = can_isotp_read(proto, &rx_msg,
+					(t->state == ISOTP_RX_WAIT) ?
+					timeout_ms : CAN_ISOTP_TIMEOUT_MS);
+		if(status != BSP_OK) {
+			return status;
+		}
+		if(isotp_receive(t, rx_msg.data, rx_msg.header.DLC, &frame)) {
+			/* Flow control */
+			status = can_isotp_write(proto, &frame);
+			if(status != BSP_OK) {
+				return status;
+			}
+		}
+	}
+	return (t->state == ISOTP_DONE) ? BSP_OK : BSP_ERROR;
+}
+
+/**
+  * @brief  ISO-TP transfer with the peer of proto->config.can.isotp: sends
+  *         a PDU, then waits for a PDU. The whole PDUs are segmented and
+  *         reassembled here, at the bus speed.
+  * @param  proto: mode config
+  * @param  buf: request, then response, ISOTP_MAX_PDU bytes
+  * @param  len: request length, 0 to only receive. Response length.
+  * @param  timeout_ms: response timeout, 0 to only send
+  * @retval BSP_TIMEOUT if there is no response
+  */
+bsp_status_t can_isotp_request(mode_config_proto_t* proto, uint8_t *buf,
+			       uint16_t *len, uint32_t timeout_ms)
+{
+	isotp_t t;
+	bsp_status_t status;
+
+	isotp_init(&t, &proto->config.can.isotp, buf, ISOTP_MAX_PDU);
+	if(*len > 0) {
+		status = can_isotp_send(proto, &t, buf, *len);
+		*len = 0;
+		if(status != BSP_OK) {
+			return status;
+		}
+	}
+	if(timeout_ms == 0) {
+		return BSP_OK;
+	}
+
+	status = can_isotp_recv(proto, &t, timeout_ms);
+	if(status == BSP_OK) {
+		*len = t.rx_len;
+	}
+	return status;
+}
+
 static void slcan_read_command(t_hydra_console *con, uint8_t *buff){
 	uint8_t i=0;
 	uint8_t input = 0;
@@ -164,35 +457,282 @@ static void slcan_read_command(t_hydra_console *con, uint8_t *buff){
 	}
 }
 
+static void can_capture_rx_cb(void *arg, const can_rx_frame *rx_msg,
+			      uint32_t fifo, uint32_t timestamp)
+{
+	can_capture_t *c = (can_capture_t *)arg;
+	can_ring_frame_t frame;
+
+	frame.timestamp = timestamp;
+	frame.flags = 0;
+	if (rx_msg->header.IDE == CAN_ID_EXT) {
+		frame.id = rx_msg->header.ExtId;
+		frame.flags |= CAN_RING_FLAG_EXT;
+	} else {
+		frame.id = rx_msg->header.StdId;
+	}
+	if (rx_msg->header.RTR == CAN_RTR_REMOTE) {
+		frame.flags |= CAN_RING_FLAG_RTR;
+	}
+	if (fifo == CAN_RX_FIFO1) {
+		frame.flags |= CAN_RING_FLAG_FIFO1;
+	}
+	frame.dlc = (rx_msg->header.DLC > 8) ? 8 : rx_msg->header.DLC;
+	frame.filter = rx_msg->header.FilterMatchIndex;
+	memcpy(frame.data, rx_msg->data, sizeof(frame.data));
+	can_ring_put(&c->ring, &frame);
+
+	chSysLockFromISR();
+	chBSemSignalI(&c->rx_sem);
+	chSysUnlockFromISR();
+}
+
 static THD_FUNCTION(can_reader_thread, arg)
 {
-	t_hydra_console *con;
-	con = arg;
+	can_capture_t *c = (can_capture_t *)arg;
+	const can_ring_frame_t *frame;
+	uint8_t packet[CAN_SOCKETCAN_LEN];
+	uint32_t len = 0;
+	uint32_t now;
+	uint16_t ms = 0;
+
 	chRegSetThreadName("CAN reader");
-	chThdSleepMilliseconds(10);
-	can_rx_frame rx_msg;
-	mode_config_proto_t* proto = &con->mode->proto;
 
 	while (!chThdShouldTerminateX()) {
-		if(bsp_can_rxne(proto->dev_num)) {
-			bsp_can_read(proto->dev_num, &rx_msg);
-			can_slcan_out(con, &rx_msg);
+		/* The timeout keeps the timestamp clock running on a quiet bus */
+		chBSemWaitTimeout(&c->rx_sem, TIME_MS2I(10));
+
+		while (c->pcap != NULL &&
+		       (frame = can_ring_get(&c->ring)) != NULL) {
+			can_socketcan_format(packet, frame);
+			pcapng_writer_packet(&c->pcap->writer, PCAPNG_LINK_CAN,
+					     pcapng_ts_extend(&c->pcap_time,
+							      frame->timestamp),
+					     packet, sizeof(packet));
+			can_ring_consume(&c->ring);
 		}
-		chThdYield();
+
+		while ((frame = can_ring_get(&c->ring)) != NULL) {
+			if (c->timestamp) {
+				ms = can_slcan_clock(&c->clock, frame->timestamp);
+			}
+			len += can_slcan_format(c->out + len, frame, c->timestamp, ms);
+			can_ring_consume(&c->ring);
+
+			/* The frames received meanwhile are sent in the next write */
+			if (len > CAN_CAPTURE_OUT_SIZE - CAN_SLCAN_MAX_LEN) {
+				cprint(c->con, c->out, len);
+				len = 0;
+			}
+		}
+		if (len > 0) {
+			cprint(c->con, c->out, len);
+			len = 0;
+		}
+
+		/*
+		 * A frame stamped before now is already in the ring, as the
+		 * interrupt is not preempted by this thread.
+		 */
+		now = bsp_get_cyclecounter();
+		if (can_ring_get(&c->ring) == NULL) {
+			can_slcan_clock(&c->clock, now);
+			pcapng_ts_extend(&c->pcap_time, now);
+		}
+		can_ring_bits(&c->ring);
+	}
+}
+
+static void can_capture_free(can_capture_t *c)
+{
+	pool_free(c->frames);
+	pool_free(c->out);
+	pool_free(c);
+}
+
+static can_capture_t *can_capture_start(t_hydra_console *con, bool timestamp,
+					 file_pcapng_t *pcap)
+{
+	mode_config_proto_t* proto = &con->mode->proto;
+	can_capture_t *c;
+
+	c = pool_alloc_ccm(sizeof(can_capture_t));
+	if (c == NULL) {
+		return NULL;
+	}
+	memset(c, 0, sizeof(can_capture_t));
+	c->con = con;
+	c->dev_num = proto->dev_num;
+	c->timestamp = timestamp;
+	c->pcap = pcap;
+	c->frames = pool_alloc_ccm(CAN_CAPTURE_FRAMES * sizeof(can_ring_frame_t));
+	c->out = pool_alloc_ccm(CAN_CAPTURE_OUT_SIZE);
+	if (c->frames == NULL || c->out == NULL) {
+		can_capture_free(c);
+		return NULL;
+	}
+
+	can_ring_init(&c->ring, c->frames, CAN_CAPTURE_FRAMES);
+	can_slcan_clock_init(&c->clock, STM32_HCLK / 1000, bsp_get_cyclecounter());
+	c->pcap_time = bsp_get_cyclecounter();
+	chBSemObjectInit(&c->rx_sem, TRUE);
+	c->start = chVTGetSystemTime();
+
+	c->thread = chThdCreateFromHeap(NULL, CONSOLE_WA_SIZE, "SLCAN reader",
+					NORMALPRIO, can_reader_thread, c);
+	if (c->thread == NULL) {
+		can_capture_free(c);
+		return NULL;
+	}
+	if (bsp_can_rx_irq_start(c->dev_num, can_capture_rx_cb, c) != BSP_OK) {
+		bsp_can_rx_irq_stop(c->dev_num);
+		chThdTerminate(c->thread);
+		chBSemSignal(&c->rx_sem);
+		chThdWait(c->thread);
+		can_capture_free(c);
+		return NULL;
+	}
+
+	return c;
+}
+
+static void can_capture_stop(can_capture_t *c)
+{
+	can_capture_stats_t *stats = &can_stats[c->dev_num];
+
+	bsp_can_rx_irq_stop(c->dev_num);
+	chThdTerminate(c->thread);
+	chBSemSignal(&c->rx_sem);
+	chThdWait(c->thread);
+
+	stats->valid = true;
+	stats->received = c->ring.received;
+	stats->dropped = c->ring.dropped;
+	stats->overruns = bsp_can_get_overruns(c->dev_num);
+	stats->max_fill = c->ring.max_fill;
+	stats->bits = can_ring_bits(&c->ring);
+	stats->duration = TIME_I2MS(chVTTimeElapsedSinceX(c->start));
+	stats->speed = bsp_can_get_speed(c->dev_num);
+
+	can_capture_free(c);
+}
+
+/* SLCAN status flags, the overruns are reported once */
+static uint8_t can_capture_status(can_capture_t *c)
+{
+	uint32_t esr = bsp_can_get_errors(c->dev_num);
+	uint32_t dropped = c->ring.dropped;
+	uint32_t overruns = bsp_can_get_overruns(c->dev_num);
+	uint8_t status = 0;
+
+	if (dropped != c->dropped) {
+		/* Receive queue full */
+		status |= 0x01;
+	}
+	if (esr & CAN_ESR_EWGF) {
+		/* Error warning */
+		status |= 0x04;
+	}
+	if (overruns != c->overruns) {
+		/* Data overrun */
+		status |= 0x08;
 	}
+	if (esr & CAN_ESR_EPVF) {
+		/* Error passive */
+		status |= 0x20;
+	}
+	if (esr & CAN_ESR_BOFF) {
+		/* Bus error */
+		status |= 0x80;
+	}
+	c->dropped = dropped;
+	c->overruns = overruns;
+
+	return status;
+}
+
+static void can_print_stats(t_hydra_console *con)
+{
+	mode_config_proto_t* proto = &con->mode->proto;
+	can_capture_stats_t *stats = &can_stats[proto->dev_num];
+	uint32_t esr, load;
+
+	if (!stats->valid) {
+		cprintf(con, "No capture yet, see slcan\r\n");
+	} else {
+		/* Per mille of the bus time, stuff bits not counted */
+		load = 0;
+		if (stats->duration > 0 && stats->speed > 0) {
+			load = (stats->bits * 1000000) /
+			       ((uint64_t)stats->duration * stats->speed);
+		}
+		cprintf(con, "Last capture: %d ms at %d bps\r\n",
+			stats->duration, stats->speed);
+		cprintf(con, "Frames: %d received, %d dropped, max %d pending\r\n",
+			stats->received, stats->dropped, stats->max_fill);
+		cprintf(con, "FIFO overruns: %d\r\n", stats->overruns);
+		cprintf(con, "Bus load: %d.%d%%\r\n", load / 10, load % 10);
+	}
+
+	esr = bsp_can_get_errors(proto->dev_num);
+	cprintf(con, "Errors: REC %d, TEC %d%s%s%s\r\n",
+		(esr & CAN_ESR_REC) >> 24, (esr & CAN_ESR_TEC) >> 16,
+		(esr & CAN_ESR_EWGF) ? ", warning" : "",
+		(esr & CAN_ESR_EPVF) ? ", passive" : "",
+		(esr & CAN_ESR_BOFF) ? ", bus-off" : "");
+}
+
+/* Writes the received frames to a pcapng file until UBTN is pressed */
+static void can_pcap(t_hydra_console *con)
+{
+	can_capture_t *capture;
+	file_pcapng_t *pcap;
+	uint32_t packets, dropped;
+
+	pcap = file_pcapng_open("can_", CAN_CAPTURE_PCAP_SIZE);
+	if (pcap == NULL) {
+		cprintf(con, "Error, unable to create the file\r\n");
+		return;
+	}
+	capture = can_capture_start(con, false, pcap);
+	if (capture == NULL) {
+		cprintf(con, "Error, unable to start the capture\r\n");
+		file_pcapng_close(pcap);
+		return;
+	}
+
+	cprintf(con, "Writing %s\r\n", &pcap->filename.filename[2]);
+	cprintf(con, "Interrupt by pressing user button.\r\n");
+	while (!hydrabus_ubtn()) {
+		chThdSleepMilliseconds(10);
+	}
+	can_capture_stop(capture);
+
+	packets = pcap->writer.packets;
+	dropped = pcap->writer.dropped;
+	if (!file_pcapng_close(pcap)) {
+		cprintf(con, "Error, file write failed\r\n");
+	}
+	cprintf(con, "%d frames written, %d dropped\r\n", packets, dropped);
 }
 
 void slcan(t_hydra_console *con) {
 	uint8_t buff[SLCAN_BUFF_LEN];
 	can_tx_frame tx_msg;
 	mode_config_proto_t* proto = &con->mode->proto;
-	thread_t *rthread = NULL;
+	can_capture_t *capture = NULL;
+	bool timestamp = false;
 
 	while (!hydrabus_ubtn()) {
 		slcan_read_command(con, buff);
 		switch (buff[0]) {
 		case 'S':
 			/*CAN speed*/
+			if(capture != NULL) {
+				/* Resets the controller */
+				cprint(con, "\x07", 1);
+				break;
+			}
 			switch(buff[1]) {
 			case '0':
 				proto->config.can.dev_speed = 10000;
@@ -239,13 +779,10 @@ void slcan(t_hydra_console *con) {
 			break;
 		case 'O':
 			/*Open channel*/
-			if(rthread == NULL) {
-				rthread = chThdCreateFromHeap(NULL,
-							      CONSOLE_WA_SIZE,
-							      "SLCAN reader",
-							      LOWPRIO,
-							      can_reader_thread,
-							      con);
+			if(capture == NULL) {
+				capture = can_capture_start(con, timestamp, NULL);
+			}
+			if(capture != NULL) {
 				cprint(con, "\r", 1);
 			} else {
 				cprint(con, "\x07", 1);
@@ -253,10 +790,9 @@ void slcan(t_hydra_console *con) {
 			break;
 		case 'C':
 			/*Close channel*/
-			if(rthread != NULL) {
-				chThdTerminate(rthread);
-				chThdWait(rthread);
-				rthread = NULL;
+			if(capture != NULL) {
+				can_capture_stop(capture);
+				capture = NULL;
 			}
 			cprint(con, "\r", 1);
 			break;
@@ -278,13 +814,28 @@ void slcan(t_hydra_console *con) {
 			break;
 		case 'F':
 			/*status*/
+			if(capture != NULL) {
+				cprintf(con, "F%02X\r", can_capture_status(capture));
+			} else {
+				cprint(con, "\x07", 1);
+			}
 			break;
 		case 'M':
+			if(buff[1] == '+' || buff[1] == '-') {
+				if(slcan_filter_rules(proto, buff) == BSP_OK) {
+					cprint(con, "\r", 1);
+				} else {
+					cprint(con, "\x07", 1);
+				}
+				break;
+			}
+			proto->config.can.nb_filter_rules = 0;
 			proto->config.can.filter_id = *(uint32_t *) &buff[1];
 			proto->config.can.filter_id = reverse_u32(proto->config.can.filter_id);
 			bsp_can_set_filter(proto->dev_num, proto);
 			break;
 		case 'm':
+			proto->config.can.nb_filter_rules = 0;
 			proto->config.can.filter_mask = *(uint32_t *) &buff[1];
 			proto->config.can.filter_mask = reverse_u32(proto->config.can.filter_mask);
 			bsp_can_set_filter(proto->dev_num, proto);
@@ -298,20 +849,399 @@ void slcan(t_hydra_console *con) {
 			cprint(con, "NHYDR\r", 6);
 			break;
 		case 'Z':
-			/*Timestamp*/
-			/*Not implemented*/
-			cprint(con, "\x07", 1);
+			/*Timestamp, milliseconds modulo 60000*/
+			if(capture == NULL && (buff[1] == '0' || buff[1] == '1')) {
+				timestamp = (buff[1] == '1');
+				cprint(con, "\r", 1);
+			} else {
+				cprint(con, "\x07", 1);
+			}
 			break;
 		default:
 			cprint(con, "\x07", 1);
 			break;
 		}
 	}
-	if(rthread != NULL) {
-		chThdTerminate(rthread);
-		chThdWait(rthread);
-		rthread = NULL;
+	if(capture != NULL) {
+		can_capture_stop(capture);
+	}
+}
+
+static void can_isotp_print(t_hydra_console *con, const uint8_t *buf, uint16_t len)
+{
+	uint16_t i;
+
+	for(i = 0; i < len; i++) {
+		cprintf(con, "%02X", buf[i]);
+	}
+	cprintf(con, "\r\n");
+}
+
+/* UDS request, the responses pending (7F xx 78) are printed and waited */
+static void can_isotp_uds(t_hydra_console *con, const char *hex)
+{
+	mode_config_proto_t* proto = &con->mode->proto;
+	uint32_t timeout_ms = CAN_UDS_P2_MS;
+	bsp_status_t status;
+	uint16_t len = 0;
+	uint8_t *buf;
+
+	if(proto->config.can.dev_mode == BSP_CAN_MODE_RO) {
+		cprintf(con, "Switching to normal bus operation\r\n");
+		status = bsp_can_mode_rw(proto->dev_num, proto);
+		if(status != BSP_OK) {
+			cprintf(con, str_bsp_init_err, status);
+			return;
+		}
+	}
+
+	buf = pool_alloc_ccm(ISOTP_MAX_PDU);
+	if(buf == NULL) {
+		cprintf(con, "Not enough memory\r\n");
+		return;
+	}
+
+	while(isxdigit((int)hex[0]) && isxdigit((int)hex[1]) && len < ISOTP_MAX_PDU) {
+		buf[len++] = hex2byte((char *)hex);
+		hex += 2;
+	}
+	if(len == 0 || *hex != 0) {
+		cprintf(con, "Incorrect hex data\r\n");
+		pool_free(buf);
+		return;
+	}
+
+	for(;;) {
+		status = can_isotp_request(proto, buf, &len, timeout_ms);
+		if(status != BSP_OK) {
+			break;
+		}
+		can_isotp_print(con, buf, len);
+		if(len != 3 || buf[0] != 0x7f || buf[2] != 0x78) {
+			break;
+		}
+		timeout_ms = CAN_UDS_P2_EXT_MS;
+		len = 0;
+	}
+	if(status == BSP_TIMEOUT) {
+		cprintf(con, "No response\r\n");
+	} else if(status != BSP_OK) {
+		cprintf(con, "ISO-TP error %02X\r\n", status);
+	}
+
+	pool_free(buf);
+}
+
+static void can_replay_timer_cb(void *arg)
+{
+	can_replay_ctx_t *c = (can_replay_ctx_t *)arg;
+	const can_replay_entry_t *e;
+	can_tx_frame tx_msg;
+	uint16_t compare;
+
+	while((e = can_replay_sched(&c->replay, bsp_can_timer_now(), &compare)) != NULL) {
+		if(e->flags & CAN_REPLAY_FLAG_EXT) {
+			tx_msg.header.ExtId = e->id;
+			tx_msg.header.IDE = CAN_ID_EXT;
+		} else {
+			tx_msg.header.StdId = e->id;
+			tx_msg.header.IDE = CAN_ID_STD;
+		}
+		tx_msg.header.RTR = (e->flags & CAN_REPLAY_FLAG_RTR) ?
+				    CAN_RTR_REMOTE : CAN_RTR_DATA;
+		tx_msg.header.DLC = e->dlc;
+		memcpy(tx_msg.data, e->data, sizeof(tx_msg.data));
+
+		if(bsp_can_write_nowait(c->dev_num, &tx_msg) != BSP_OK) {
+			compare = bsp_can_timer_now() + CAN_REPLAY_RETRY_US;
+			break;
+		}
+		can_replay_sent(&c->replay, bsp_can_timer_now());
+	}
+
+	if(c->replay.done) {
+		bsp_can_timer_stop();
+	} else {
+		bsp_can_timer_set(compare);
+	}
+	if(c->replay.done || can_replay_free(&c->replay) >= CAN_REPLAY_ENTRIES / 2) {
+		chSysLockFromISR();
+		chBSemSignalI(&c->sem);
+		chSysUnlockFromISR();
+	}
+}
+
+/* Start the replay timer once, false if it is busy */
+static bool can_replay_start(can_replay_ctx_t *c)
+{
+	if(!c->started) {
+		if(bsp_can_timer_start(can_replay_timer_cb, c) != BSP_OK) {
+			c->busy = true;
+			return false;
+		}
+		c->started = true;
+	}
+	return true;
+}
+
+/* Parse a line into the schedule, false if aborted by UBTN or busy timer */
+static bool can_replay_line(can_replay_ctx_t *c)
+{
+	can_replay_entry_t e;
+	int res;
+
+	if(c->line_len >= CAN_REPLAY_LINE_LEN) {
+		/* Truncated */
+		res = -1;
+	} else {
+		c->line[c->line_len] = 0;
+		res = can_replay_parse_line(&c->parser, c->line, &e);
+	}
+	c->line_len = 0;
+	if(res < 0) {
+		c->errors++;
+	}
+	if(res <= 0) {
+		return true;
 	}
+	c->frames++;
+
+	while(!can_replay_put(&c->replay, &e)) {
+		/* The schedule is full, time to send it */
+		if(!can_replay_start(c)) {
+			return false;
+		}
+		chBSemWaitTimeout(&c->sem, TIME_MS2I(10));
+		if(hydrabus_ubtn()) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void can_replay_file(t_hydra_console *con, FIL *fp, can_replay_ctx_t *c,
+			    char *buf, bool loop)
+{
+	uint32_t cnt, i, pass_frames = 0;
+	FRESULT err;
+
+	while(!hydrabus_ubtn()) {
+		err = f_read(fp, buf, CAN_REPLAY_READ_SIZE, (void *)&cnt);
+		if(err != FR_OK) {
+			cprintf(con, "Failed to read file: error %d.\r\n", err);
+			break;
+		}
+		if(cnt == 0) {
+			/* Last line without end of line */
+			if(c->line_len > 0 && !can_replay_line(c)) {
+				return;
+			}
+			/* A log without frame would loop forever */
+			if(!loop || c->frames == pass_frames) {
+				break;
+			}
+			pass_frames = c->frames;
+			f_lseek(fp, 0);
+			can_replay_parser_rewind(&c->parser);
+			continue;
+		}
+
+		for(i = 0; i < cnt; i++) {
+			if(buf[i] == '\n') {
+				if(!can_replay_line(c)) {
+					return;
+				}
+			} else if(buf[i] != '\r') {
+				if(c->line_len < CAN_REPLAY_LINE_LEN) {
+					c->line[c->line_len] = buf[i];
+				}
+				c->line_len++;
+			}
+		}
+	}
+	if(hydrabus_ubtn()) {
+		return;
+	}
+
+	c->replay.eof = true;
+	if(c->frames > 0 && !can_replay_start(c)) {
+		return;
+	}
+	while(c->started && !c->replay.done && !hydrabus_ubtn()) {
+		chBSemWaitTimeout(&c->sem, TIME_MS2I(10));
+	}
+}
+
+/* Replay a candump -l log at rate percent of its speed, UBTN aborts */
+static void can_replay(t_hydra_console *con, const char *filename,
+		       uint32_t rate, bool loop)
+{
+	mode_config_proto_t* proto = &con->mode->proto;
+	char path[FILENAME_SIZE];
+	can_replay_entry_t *entries;
+	can_replay_ctx_t *c;
+	char *buf;
+	bsp_status_t status;
+	FRESULT err;
+	FIL fp;
+
+	if(proto->config.can.dev_mode == BSP_CAN_MODE_RO) {
+		cprintf(con, "Switching to normal bus operation\r\n");
+		status = bsp_can_mode_rw(proto->dev_num, proto);
+		if(status != BSP_OK) {
+			cprintf(con, str_bsp_init_err, status);
+			return;
+		}
+	}
+
+	snprintf(path, FILENAME_SIZE, "0:%s", filename);
+	if (!is_fs_ready()) {
+		err = mount();
+		if(err != 0) {
+			cprintf(con, "Mount failed: error %d.\r\n", err);
+			return;
+		}
+	}
+	err = f_open(&fp, path, FA_READ | FA_OPEN_EXISTING);
+	if (err != FR_OK) {
+		cprintf(con, "Failed to open file %s: error %d.\r\n", path, err);
+		return;
+	}
+
+	c = pool_alloc_ccm(sizeof(can_replay_ctx_t));
+	entries = pool_alloc_ccm(CAN_REPLAY_ENTRIES * sizeof(can_replay_entry_t));
+	/* Read by the SD card DMA */
+	buf = pool_alloc_bytes(CAN_REPLAY_READ_SIZE);
+	if(c == NULL || entries == NULL || buf == NULL) {
+		cprintf(con, "Not enough memory\r\n");
+		pool_free(c);
+		pool_free(entries);
+		pool_free(buf);
+		f_close(&fp);
+		return;
+	}
+
+	memset(c, 0, sizeof(can_replay_ctx_t));
+	c->dev_num = proto->dev_num;
+	can_replay_init(&c->replay, entries, CAN_REPLAY_ENTRIES);
+	can_replay_parser_init(&c->parser, rate);
+	chBSemObjectInit(&c->sem, TRUE);
+
+	cprintf(con, "Replaying %s, press UBTN to stop\r\n", filename);
+	can_replay_file(con, &fp, c, buf, loop);
+	if(c->started) {
+		bsp_can_timer_release();
+	}
+	f_close(&fp);
+
+	if(c->busy) {
+		cprintf(con, "Error, replay timer used by the other CAN device.\r\n");
+	}
+
+	cprintf(con, "Frames: %d sent, %d late (max %d us), %d underruns\r\n",
+		c->replay.sent, c->replay.late, c->replay.max_late,
+		c->replay.underruns);
+	if(c->errors > 0) {
+		cprintf(con, "Invalid lines: %d\r\n", c->errors);
+	}
+
+	pool_free(c);
+	pool_free(entries);
+	pool_free(buf);
+}
+
+static int can_replay_exec(t_hydra_console *con, t_tokenline_parsed *p,
+			   int token_pos)
+{
+	const char *filename = NULL;
+	uint32_t rate = 100;
+	bool loop = false;
+	int arg_int, t;
+
+	t = token_pos;
+	while(p->tokens[t]) {
+		switch(p->tokens[t++]) {
+		case T_ARG_STRING:
+			filename = (char *)p->buf + p->tokens[t++];
+			break;
+		case T_RATE:
+			t += 1;
+			memcpy(&arg_int, p->buf + p->tokens[t++], sizeof(int));
+			rate = arg_int;
+			break;
+		case T_LOOP:
+			loop = true;
+			break;
+		default:
+			return t - 1 - token_pos;
+		}
+	}
+
+	if(filename == NULL) {
+		cprintf(con, "Missing log file\r\n");
+	} else if(rate < 1 || rate > 10000) {
+		cprintf(con, "Rate must be 1 to 10000%%\r\n");
+	} else {
+		can_replay(con, filename, rate, loop);
+	}
+
+	return t - token_pos;
+}
+
+static int can_isotp_exec(t_hydra_console *con, t_tokenline_parsed *p,
+			  int token_pos)
+{
+	isotp_config_t *cfg = &con->mode->proto.config.can.isotp;
+	const char *hex = NULL;
+	int arg_int, t;
+
+	t = token_pos;
+	while(p->tokens[t]) {
+		switch(p->tokens[t++]) {
+		case T_TX:
+			t += 1;
+			memcpy(&arg_int, p->buf + p->tokens[t++], sizeof(int));
+			cfg->tx_id = arg_int;
+			break;
+		case T_RX:
+			t += 1;
+			memcpy(&arg_int, p->buf + p->tokens[t++], sizeof(int));
+			cfg->rx_id = arg_int;
+			break;
+		case T_BLOCK_SIZE:
+			t += 1;
+			memcpy(&arg_int, p->buf + p->tokens[t++], sizeof(int));
+			cfg->block_size = arg_int;
+			break;
+		case T_STMIN:
+			t += 1;
+			memcpy(&arg_int, p->buf + p->tokens[t++], sizeof(int));
+			cfg->stmin = arg_int;
+			break;
+		case T_WRITE:
+			t += 1;
+			hex = (char *)p->buf + p->tokens[t++];
+			break;
+		default:
+			return t - 1 - token_pos;
+		}
+	}
+
+	/* Same rule as the frames written */
+	if(cfg->tx_id > 0x7ff || cfg->rx_id > 0x7ff) {
+		cfg->flags |= ISOTP_FLAG_EXT;
+	} else {
+		cfg->flags &= ~ISOTP_FLAG_EXT;
+	}
+
+	if(hex != NULL) {
+		can_isotp_uds(con, hex);
+	} else {
+		cprintf(con, "TX: 0x%X RX: 0x%X block size: %d STmin: 0x%02X\r\n",
+			cfg->tx_id, cfg->rx_id, cfg->block_size, cfg->stmin);
+	}
+
+	return t - token_pos;
 }
 
 static int init(t_hydra_console *con, t_tokenline_parsed *p)
@@ -332,7 +1262,9 @@ static int init(t_hydra_console *con, t_tokenline_parsed *p)
 	}
 
 	/* By default, get all packets */
-	if (proto->config.can.filter_id != 0 || proto->config.can.filter_mask != 0) {
+	if (proto->config.can.nb_filter_rules > 0) {
+		bsp_status = can_set_filter_rules(proto);
+	} else if (proto->config.can.filter_id != 0 || proto->config.can.filter_mask != 0) {
 		bsp_status = bsp_can_set_filter(proto->dev_num, proto);
 	} else {
 		bsp_status = bsp_can_init_filter(proto->dev_num, proto);
@@ -349,7 +1281,8 @@ static int init(t_hydra_console *con, t_tokenline_parsed *p)
 static int exec(t_hydra_console *con, t_tokenline_parsed *p, int token_pos)
 {
 	mode_config_proto_t* proto = &con->mode->proto;
-	int arg_int, t;
+	can_filter_rule_t rules[CAN_CONFIG_FILTER_RULES];
+	int arg_int, t, nb_rules;
 	bsp_status_t bsp_status;
 
 	for (t = token_pos; p->tokens[t]; t++) {
@@ -433,6 +1366,7 @@ static int exec(t_hydra_console *con, t_tokenline_parsed *p, int token_pos)
 			/* Integer parameter. */
 			switch(p->tokens[t+1]) {
 			case T_OFF:
+				proto->config.can.nb_filter_rules = 0;
 				bsp_status = bsp_can_init_filter(proto->dev_num,
 								 proto);
 				if(bsp_status != BSP_OK) {
@@ -441,14 +1375,28 @@ static int exec(t_hydra_console *con, t_tokenline_parsed *p, int token_pos)
 				break;
 			case T_ID:
 				memcpy(&arg_int, p->buf + p->tokens[t+3], sizeof(int));
+				proto->config.can.nb_filter_rules = 0;
 				proto->config.can.filter_id = arg_int;
 				bsp_status = bsp_can_set_filter(proto->dev_num, proto);
 				break;
 			case T_MASK:
 				memcpy(&arg_int, p->buf + p->tokens[t+3], sizeof(int));
+				proto->config.can.nb_filter_rules = 0;
 				proto->config.can.filter_mask = arg_int;
 				bsp_status = bsp_can_set_filter(proto->dev_num, proto);
 				break;
+			case T_ADD:
+				nb_rules = can_filter_parse((char *)p->buf + p->tokens[t+3],
+							    rules, CAN_CONFIG_FILTER_RULES);
+				if(nb_rules <= 0) {
+					cprintf(con, "Incorrect identifiers list\r\n");
+					break;
+				}
+				bsp_status = can_add_filter_rules(proto, rules, nb_rules);
+				if(bsp_status != BSP_OK) {
+					cprintf(con, "Filter rules error %02X\r\n", bsp_status);
+				}
+				break;
 			}
 			t+=3;
 			break;
@@ -470,6 +1418,18 @@ static int exec(t_hydra_console *con, t_tokenline_parsed *p, int token_pos)
 			}
 			slcan(con);
 			break;
+		case T_PCAP:
+			can_pcap(con);
+			break;
+		case T_STATS:
+			can_print_stats(con);
+			break;
+		case T_ISOTP:
+			t += can_isotp_exec(con, p, t + 1);
+			break;
+		case T_REPLAY:
+			t += can_replay_exec(con, p, t + 1);
+			break;
 		default:
 			return t - token_pos;
 		}
@@ -507,11 +1467,11 @@ static uint32_t can_send_msg(t_hydra_console *con, can_tx_frame *tx_msg)
 }
 
 
-static uint32_t write(t_hydra_console *con, uint8_t *tx_data, uint8_t nb_data)
+static uint32_t write(t_hydra_console *con, uint8_t *tx_data, uint32_t nb_data)
 {
 	uint32_t status;
 	mode_config_proto_t* proto = &con->mode->proto;
-	uint8_t i = 0;
+	uint32_t i = 0;
 	can_tx_frame tx_msg;
 
 	if(proto->config.can.dev_mode == BSP_CAN_MODE_RO) {
@@ -558,7 +1518,7 @@ static uint32_t write(t_hydra_console *con, uint8_t *tx_data, uint8_t nb_data)
 	return status;
 }
 
-static uint32_t read(t_hydra_console *con, uint8_t *rx_data, uint8_t nb_data)
+static uint32_t read(t_hydra_console *con, uint8_t *rx_data, uint32_t nb_data)
 {
 	uint32_t status;
 	mode_config_proto_t* proto = &con->mode->proto;
@@ -597,6 +1557,31 @@ static void cleanup(t_hydra_console *con)
 	bsp_can_deinit(proto->dev_num);
 }
 
+static void show_filter_rules(t_hydra_console *con)
+{
+	mode_config_proto_t* proto = &con->mode->proto;
+	can_filter_bank_t banks[BSP_CAN_FILTER_BANKS];
+	can_filter_rule_t *rule;
+	uint32_t i, nb_banks;
+
+	for(i = 0; i < proto->config.can.nb_filter_rules; i++) {
+		rule = &proto->config.can.filter_rules[i];
+		cprintf(con, "%s 0x%08X-0x%08X%s\r\n",
+			(rule->flags & CAN_FILTER_EXT) ? "EXT" : "STD",
+			rule->first, rule->last,
+			(rule->flags & CAN_FILTER_NO_RTR) ? " no RTR" : "");
+	}
+
+	nb_banks = can_filter_compile(proto->config.can.filter_rules,
+				      proto->config.can.nb_filter_rules,
+				      banks, BSP_CAN_FILTER_BANKS);
+	for(i = 0; i < nb_banks; i++) {
+		cprintf(con, "Bank %d: %s%d 0x%08X 0x%08X\r\n", i,
+			(banks[i].mode == CAN_FILTER_MODE_LIST) ? "list" : "mask",
+			banks[i].scale, banks[i].fr1, banks[i].fr2);
+	}
+}
+
 static int show(t_hydra_console *con, t_tokenline_parsed *p)
 {
 	mode_config_proto_t* proto = &con->mode->proto;
@@ -610,6 +1595,10 @@ static int show(t_hydra_console *con, t_tokenline_parsed *p)
 		break;
 	case T_FILTER:
 		tokens_used++;
+		if(proto->config.can.nb_filter_rules > 0) {
+			show_filter_rules(con);
+			break;
+		}
 		cprintf(con, "ID : 0x%08X\r\nMask: 0x%08X\r\n",
 			proto->config.can.filter_id,
 			proto->config.can.filter_mask);
@@ -21,9 +21,15 @@
 #define _HYDRABUS_MODE_CAN_H_
 
 #include "hydrabus_mode.h"
+#include "bsp.h"
 
 #endif /* _HYDRABUS_MODE_CAN_H_ */
 
 #define SLCAN_BUFF_LEN 50
 
 void slcan(t_hydra_console *con);
+bsp_status_t can_set_filter_rules(mode_config_proto_t* proto);
+bsp_status_t can_add_filter_rules(mode_config_proto_t* proto,
+				  const can_filter_rule_t *rules, uint32_t nb_rules);
+bsp_status_t can_isotp_request(mode_config_proto_t* proto, uint8_t *buf,
+			       uint16_t *len, uint32_t timeout_ms);
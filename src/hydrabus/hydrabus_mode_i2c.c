@@ -20,12 +20,15 @@
 #include "hydrabus_mode_i2c.h"
 #include "bsp_i2c_master.h"
 #include "bsp_i2c_slave.h"
+#include "bsp_i2c_conf.h"
+#include "hydrabus_i2c_sniff.h"
+#include "microsd.h"
 #include <string.h>
 
 static int exec(t_hydra_console *con, t_tokenline_parsed *p, int token_pos);
 static int show(t_hydra_console *con, t_tokenline_parsed *p);
 static void scan(t_hydra_console *con, t_tokenline_parsed *p);
-static void sniff(t_hydra_console *con);
+static void sniff(t_hydra_console *con, bool pcap);
 
 #define I2C_DEV_NUM (1)
 
@@ -49,7 +52,9 @@ static uint32_t speeds[SPEED_NB] = {
 	1000000,
 };
 
-#define SNIFF_BUFFER_LENGTH 4096
+#define SNIFF_NB_SAMPLES 0x2000 /* Power of 2 */
+#define SNIFF_OUT_SIZE 0x1000 /* Power of 2 */
+#define SNIFF_PCAP_SIZE 0x1000 /* Multiple of PCAPNG_CHUNK_SIZE */
 
 static void init_proto_default(t_hydra_console *con)
 {
@@ -157,7 +162,12 @@ static int exec(t_hydra_console *con, t_tokenline_parsed *p, int token_pos)
 			scan(con, p);
 			break;
 		case T_SNIFF:
-			sniff(con);
+			if(p->tokens[t+1] == T_PCAP) {
+				t++;
+				sniff(con, true);
+			} else {
+				sniff(con, false);
+			}
 			break;
 		default:
 			return t - token_pos;
@@ -196,9 +206,9 @@ static void stop(t_hydra_console *con)
 	cprintf(con, str_i2c_stop_br);
 }
 
-static uint32_t write(t_hydra_console *con, uint8_t *tx_data, uint8_t nb_data)
+static uint32_t write(t_hydra_console *con, uint8_t *tx_data, uint32_t nb_data)
 {
-	int i;
+	uint32_t i;
 	uint32_t status;
 	uint8_t tx_ack_flag;
 	mode_config_proto_t* proto = &con->mode->proto;
@@ -232,9 +242,9 @@ static uint32_t write(t_hydra_console *con, uint8_t *tx_data, uint8_t nb_data)
 	return status;
 }
 
-static uint32_t read(t_hydra_console *con, uint8_t *rx_data, uint8_t nb_data)
+static uint32_t read(t_hydra_console *con, uint8_t *rx_data, uint32_t nb_data)
 {
-	int i;
+	uint32_t i;
 	uint32_t status;
 	mode_config_proto_t* proto = &con->mode->proto;
 
@@ -260,10 +270,11 @@ static uint32_t read(t_hydra_console *con, uint8_t *rx_data, uint8_t nb_data)
 	return status;
 }
 
-static uint32_t dump(t_hydra_console *con, uint8_t *rx_data, uint8_t nb_data)
+static uint32_t dump(t_hydra_console *con, uint8_t *rx_data, uint32_t nb_data)
 {
 	uint32_t status;
-	uint8_t i, tmp;
+	uint32_t i;
+	uint8_t tmp;
 	mode_config_proto_t* proto = &con->mode->proto;
 	status = BSP_ERROR;
 	for(i = 0; i < nb_data; i++) {
@@ -335,56 +346,138 @@ static void scan(t_hydra_console *con, t_tokenline_parsed *p)
 		cprintf(con, "No devices found.\r\n");
 }
 
-static void print_sniff_buffer(t_hydra_console *con, uint16_t *buffer, uint16_t length)
+/* Returns the number of events printed */
+static uint32_t print_sniff_events(t_hydra_console *con, i2c_sniff_t *s)
 {
-	uint16_t i = 0;
-	while(i < length) {
-		switch(buffer[i]) {
-		case 0x400:
+	i2c_sniff_event_t ev;
+	uint32_t nb = 0;
+
+	while(i2c_sniff_pop(s, &ev)) {
+		nb++;
+		switch(ev.type & I2C_SNIFF_TYPE_MASK) {
+		case I2C_SNIFF_START:
 			cprint(con, "[", 1);
 			break;
-		case 0x200:
+		case I2C_SNIFF_STOP:
 			cprint(con, "]\r\n", 3);
 			break;
 		default:
-			cprintf(con, "0x%02x", buffer[i]>>1);
-			cprint(con, buffer[i] & 1 ? "-" : "+", 1);
+			cprintf(con, "0x%02x", ev.data);
+			cprint(con, (ev.type & I2C_SNIFF_FLAG_NACK) ? "-" : "+", 1);
 			break;
 		}
-		i++;
 	}
+	return nb;
 }
 
-static void sniff(t_hydra_console *con)
+/* Writes each message to the pcapng file, returns the number of events */
+static uint32_t write_sniff_events(i2c_sniff_t *s, i2c_sniff_linux_t *m,
+				   file_pcapng_t *pcap)
 {
-	bsp_status_t status = BSP_OK;
-	uint16_t *buffer = pool_alloc_bytes(SNIFF_BUFFER_LENGTH); // 8192 bytes
-	uint16_t index = 0;
+	i2c_sniff_event_t ev;
+	uint32_t nb = 0;
 
-	if(buffer == 0) {
-		cprintf(con, "Error, unable to get buffer space.\r\n");
-		return;
+	while(i2c_sniff_pop(s, &ev)) {
+		i2c_sniff_linux_event(m, &ev, &pcap->writer);
+		nb++;
 	}
+	i2c_sniff_linux_tick(m, s->time);
+	return nb;
+}
 
+/*
+ * SCL/SDA are sampled by DMA in a ring, the events are decoded and printed
+ * or saved while the capture goes on.
+ */
+static void sniff(t_hydra_console *con, bool pcap)
+{
+	uint16_t *samples;
+	uint8_t *out;
+	uint32_t period, timestamp, nb_events;
+	i2c_sniff_t *s;
+	i2c_sniff_linux_t *m = NULL;
+	file_pcapng_t *file = NULL;
+	bsp_status_t status;
 	mode_config_proto_t* proto = &con->mode->proto;
 
+	if(pcap) {
+		m = pool_alloc_ccm(sizeof(i2c_sniff_linux_t));
+		file = file_pcapng_open("i2c_", SNIFF_PCAP_SIZE);
+		if(m == NULL || file == NULL) {
+			cprintf(con, "Error, unable to create the file.\r\n");
+			pool_free(m);
+			if(file != NULL)
+				file_pcapng_close(file);
+			return;
+		}
+	}
+
+	samples = pool_alloc_bytes(SNIFF_NB_SAMPLES * sizeof(uint16_t));
+	out = pool_alloc_bytes(SNIFF_OUT_SIZE);
+	s = pool_alloc_ccm(sizeof(i2c_sniff_t));
+	if(samples == NULL || out == NULL || s == NULL) {
+		cprintf(con, "Error, unable to get buffer space.\r\n");
+		pool_free(samples);
+		pool_free(out);
+		pool_free(s);
+		pool_free(m);
+		if(file != NULL)
+			file_pcapng_close(file);
+		return;
+	}
+
 	bsp_i2c_master_deinit(proto->dev_num);
 	bsp_i2c_slave_init(proto->dev_num, proto);
 
-	cprintf(con, "Interrupt by pressing user button.\r\n");
-	cprint(con, "\r\n", 2);
+	status = bsp_i2c_slave_sniff_start(proto->dev_num, proto, samples,
+					   SNIFF_NB_SAMPLES, &period, &timestamp);
+	if(status != BSP_OK) {
+		cprintf(con, "Error, sampler not available.\r\n");
+	} else {
+		i2c_sniff_init(s, samples, SNIFF_NB_SAMPLES,
+			       BSP_I2C1_SCL_PIN, BSP_I2C1_SDA_PIN, period, timestamp,
+			       out, SNIFF_OUT_SIZE);
+		if(file != NULL) {
+			i2c_sniff_linux_init(m, timestamp);
+			cprintf(con, "Writing %s\r\n", &file->filename.filename[2]);
+		}
+
+		cprintf(con, "Interrupt by pressing user button.\r\n");
+		cprint(con, "\r\n", 2);
+
+		while(!hydrabus_ubtn()) {
+			i2c_sniff_process(s, bsp_i2c_slave_sniff_get_index(proto->dev_num));
+			if(file != NULL)
+				nb_events = write_sniff_events(s, m, file);
+			else
+				nb_events = print_sniff_events(con, s);
+			/*
+			 * Bus idle: wait a system tick (100us), the samples
+			 * ring takes 780us to fill at 1MHz (16 cycles/sample).
+			 */
+			if(nb_events == 0)
+				chThdSleep(TIME_US2I(100));
+		}
+		bsp_i2c_slave_sniff_stop(proto->dev_num);
 
-	while(!hydrabus_ubtn()) {
-		status = bsp_i2c_slave_sniff(proto->dev_num, &buffer[index]);
-		if(buffer[index] == 0x200 || index == SNIFF_BUFFER_LENGTH || status == BSP_TIMEOUT) {
-			print_sniff_buffer(con, buffer, index+1);
-			index = 0;
-		} else {
-			index++;
+		if(s->events_lost > 0 || s->overruns > 0) {
+			cprintf(con, "\r\n%d events lost, %d overruns\r\n",
+				s->events_lost, s->overruns);
 		}
+		if(file != NULL) {
+			cprintf(con, "%d messages written, %d dropped, %d truncated\r\n",
+				m->messages, file->writer.dropped, m->truncated);
+		}
+	}
+
+	if(file != NULL && !file_pcapng_close(file)) {
+		cprintf(con, "Error, file write failed.\r\n");
 	}
+	pool_free(m);
 
-	pool_free(buffer);
+	pool_free(samples);
+	pool_free(out);
+	pool_free(s);
 	bsp_i2c_slave_deinit(proto->dev_num);
 	bsp_i2c_master_init(proto->dev_num, proto);
 }
@@ -39,6 +39,13 @@ static const char* str_prompt_jtag[] = {
 
 #define MAX_CHAIN_LEN 32
 
+#define OCD_BUFFER_SIZE 0x2000 // 8192 bytes - magic value from bus pirate
+/*
+ * TDI/TMS pairs and the 3 bytes answer header must fit in the buffer,
+ * multiple of 8 so the TDO of each chunk is made of whole bytes.
+ */
+#define OCD_TAP_SHIFT_MAX (((OCD_BUFFER_SIZE-3)/2)*8)
+
 static void init_proto_default(t_hydra_console *con)
 {
 	mode_config_proto_t* proto = &con->mode->proto;
@@ -618,22 +625,37 @@ static void jtag_brute_pins_idcode(t_hydra_console *con, uint8_t num_pins)
 	jtag_pin_init(con);
 }
 
-static uint8_t ocd_shift_u8(t_hydra_console *con, uint8_t tdi, uint8_t tms, uint8_t num_bits)
+/* BSRR values for each TMS/TDI combination, indexed by (tms << 1) | tdi */
+static void ocd_shift_masks(t_hydra_console *con, uint32_t masks[4])
+{
+	mode_config_proto_t* proto = &con->mode->proto;
+	uint32_t tms = 1 << proto->config.jtag.tms_pin;
+	uint32_t tdi = 1 << proto->config.jtag.tdi_pin;
+
+	masks[0] = (tms << 16) | (tdi << 16);
+	masks[1] = (tms << 16) | tdi;
+	masks[2] = tms | (tdi << 16);
+	masks[3] = tms | tdi;
+}
+
+/*
+ * Shift up to 8 bits, TMS and TDI are updated with a single BSRR write
+ * and TDO is sampled while TCK is high, as in jtag_read_bit_clock().
+ */
+static uint8_t ocd_shift_u8(const uint32_t masks[4], uint32_t tck, uint32_t tdo_pin,
+			    uint8_t tdi, uint8_t tms, uint8_t num_bits)
 {
 	uint8_t tdo = 0;
 
 	while(num_bits>0) {
-		if(tms & 1) {
-			jtag_tms_high(con);
-		} else {
-			jtag_tms_low(con);
-		}
-		if(tdi & 1) {
-			jtag_tdi_high(con);
-		} else {
-			jtag_tdi_low(con);
-		}
-		tdo = (jtag_read_bit_clock(con)<<7) | (tdo>>1);
+		GPIOB->BSRR.W = masks[((tms & 1) << 1) | (tdi & 1)];
+		bsp_tim_wait_irq();
+		GPIOB->BSRR.W = tck;
+		bsp_tim_clr_irq();
+		tdo = (((GPIOB->IDR >> tdo_pin) & 1) << 7) | (tdo >> 1);
+		bsp_tim_wait_irq();
+		GPIOB->BSRR.W = tck << 16;
+		bsp_tim_clr_irq();
 		tdi>>=1;
 		tms>>=1;
 		num_bits--;
@@ -641,15 +663,62 @@ static uint8_t ocd_shift_u8(t_hydra_console *con, uint8_t tdi, uint8_t tms, uint
 	return tdo;
 }
 
+/*
+ * Shift num_bits bits from the interleaved TDI/TMS byte pairs in data.
+ * TDO byte n is written to data[n], which is always at or before the pair
+ * it comes from, so the shift can be done in place.
+ */
+static void ocd_shift(t_hydra_console *con, uint8_t *data, uint16_t num_bits)
+{
+	mode_config_proto_t* proto = &con->mode->proto;
+	uint32_t masks[4];
+	uint32_t tck = 1 << proto->config.jtag.tck_pin;
+	uint32_t tdo_pin = proto->config.jtag.tdo_pin;
+	uint16_t i = 0;
+	uint8_t bits, tdi, tms;
+
+	ocd_shift_masks(con, masks);
+	while(num_bits>0) {
+		bits = (num_bits > 8) ? 8 : num_bits;
+		tdi = data[i*2];
+		tms = data[i*2+1];
+		data[i] = ocd_shift_u8(masks, tck, tdo_pin, tdi, tms, bits);
+		i++;
+		num_bits -= bits;
+	}
+}
+
+/*
+ * CMD_OCD_JTAG_SPEED parameter is the TCK frequency in kHz (big endian),
+ * 0 selects the fastest speed.
+ */
+static void ocd_set_speed(t_hydra_console *con, uint16_t khz)
+{
+	mode_config_proto_t* proto = &con->mode->proto;
+	uint32_t divider;
+
+	if(khz == 0 || khz * 1000UL >= JTAG_MAX_FREQ) {
+		divider = 1;
+	} else {
+		divider = JTAG_MAX_FREQ / (khz * 1000UL);
+		if(divider > 255) {
+			divider = 255;
+		}
+	}
+	proto->config.jtag.divider = divider;
+	tim_set_prescaler(con);
+}
+
 void openOCD(t_hydra_console *con)
 {
 	mode_config_proto_t* proto = &con->mode->proto;
 
-	uint16_t num_sequences, i, bits;
+	uint16_t num_sequences, num_bits, num_bytes;
+	uint8_t header_len;
 
-	uint8_t ocd_command, values;
+	uint8_t ocd_command;
 	uint8_t ocd_parameters[2] = {0};
-	uint8_t *buffer = pool_alloc_bytes(0x2000); // 8192 bytes - magic value from bus pirate
+	uint8_t *buffer = pool_alloc_ccm(OCD_BUFFER_SIZE);
 
 	if(buffer == 0) {
 		return;
@@ -714,8 +783,9 @@ void openOCD(t_hydra_console *con)
 				}
 				break;
 			case CMD_OCD_JTAG_SPEED:
-				//TODO
 				if(chnRead(con->sdu, ocd_parameters, 2) == 2) {
+					ocd_set_speed(con, (ocd_parameters[0] << 8) |
+						      ocd_parameters[1]);
 				}
 				break;
 			case CMD_OCD_UART_SPEED:
@@ -732,20 +802,27 @@ void openOCD(t_hydra_console *con)
 				if(chnRead(con->sdu, ocd_parameters, 2) == 2) {
 					num_sequences = ocd_parameters[0] << 8;
 					num_sequences |= ocd_parameters[1];
-					cprintf(con, "%c%c%c", CMD_OCD_TAP_SHIFT, ocd_parameters[0],
-						ocd_parameters[1]);
-
-					chnRead(con->sdu, buffer,((num_sequences+7)/8)*2);
-					i=0;
-					while(num_sequences>0) {
-						bits = (num_sequences > 8) ? 8 : num_sequences;
-						values = ocd_shift_u8(con, buffer[i],
-							     buffer[i+1],
-							     bits);
-						cprint(con, (char *)&values, 1);
-						i+=2;
-						num_sequences -= bits;
-					}
+
+					/*
+					 * Answer header followed by TDO, sent in one write.
+					 * Longer shifts are done in chunks of
+					 * OCD_TAP_SHIFT_MAX bits, TDO of each chunk is
+					 * sent after the previous one.
+					 */
+					buffer[0] = CMD_OCD_TAP_SHIFT;
+					buffer[1] = num_sequences >> 8;
+					buffer[2] = num_sequences & 0xff;
+					header_len = 3;
+					do {
+						num_bits = MIN(num_sequences, OCD_TAP_SHIFT_MAX);
+						num_bytes = (num_bits+7)/8;
+						chnRead(con->sdu, buffer+3, num_bytes*2);
+						ocd_shift(con, buffer+3, num_bits);
+						cprint(con, (char *)buffer+3-header_len,
+						       num_bytes+header_len);
+						header_len = 0;
+						num_sequences -= num_bits;
+					} while(num_sequences > 0);
 				} else {
 					cprint(con, "\x00", 1);
 				}
@@ -916,9 +993,9 @@ static int exec(t_hydra_console *con, t_tokenline_parsed *p, int token_pos)
 	return t - token_pos;
 }
 
-static uint32_t write(t_hydra_console *con, uint8_t *tx_data, uint8_t nb_data)
+static uint32_t write(t_hydra_console *con, uint8_t *tx_data, uint32_t nb_data)
 {
-	int i;
+	uint32_t i;
 	for (i = 0; i < nb_data; i++) {
 		jtag_write_u8(con, tx_data[i]);
 	}
@@ -937,9 +1014,9 @@ static uint32_t write(t_hydra_console *con, uint8_t *tx_data, uint8_t nb_data)
 	return BSP_OK;
 }
 
-static uint32_t read(t_hydra_console *con, uint8_t *rx_data, uint8_t nb_data)
+static uint32_t read(t_hydra_console *con, uint8_t *rx_data, uint32_t nb_data)
 {
-	int i;
+	uint32_t i;
 
 	for(i = 0; i < nb_data; i++) {
 		rx_data[i] = jtag_read_u8(con);
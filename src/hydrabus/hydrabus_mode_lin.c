@@ -119,13 +119,13 @@ static int exec(t_hydra_console *con, t_tokenline_parsed *p, int token_pos)
 	return t - token_pos;
 }
 
-static uint32_t write(t_hydra_console *con, uint8_t *tx_data, uint8_t nb_data)
+static uint32_t write(t_hydra_console *con, uint8_t *tx_data, uint32_t nb_data)
 {
-	int i;
+	uint32_t i;
 	uint32_t status;
 	mode_config_proto_t* proto = &con->mode->proto;
 
-	status = bsp_uart_write_u8(proto->dev_num, tx_data, nb_data);
+	status = bsp_uart_transfer(proto->dev_num, tx_data, NULL, nb_data);
 	if(status == BSP_OK) {
 		if(nb_data == 1) {
 			/* Write 1 data */
@@ -142,13 +142,13 @@ static uint32_t write(t_hydra_console *con, uint8_t *tx_data, uint8_t nb_data)
 	return status;
 }
 
-static uint32_t read(t_hydra_console *con, uint8_t *rx_data, uint8_t nb_data)
+static uint32_t read(t_hydra_console *con, uint8_t *rx_data, uint32_t nb_data)
 {
-	int i;
+	uint32_t i;
 	uint32_t status;
 	mode_config_proto_t* proto = &con->mode->proto;
 
-	status = bsp_uart_read_u8(proto->dev_num, rx_data, nb_data);
+	status = bsp_uart_transfer(proto->dev_num, NULL, rx_data, nb_data);
 	if(status == BSP_OK) {
 		if(nb_data == 1) {
 			/* Read 1 data */
@@ -165,23 +165,23 @@ static uint32_t read(t_hydra_console *con, uint8_t *rx_data, uint8_t nb_data)
 	return status;
 }
 
-static uint32_t dump(t_hydra_console *con, uint8_t *rx_data, uint8_t nb_data)
+static uint32_t dump(t_hydra_console *con, uint8_t *rx_data, uint32_t nb_data)
 {
 	uint32_t status;
 	mode_config_proto_t* proto = &con->mode->proto;
 
-	status = bsp_uart_read_u8(proto->dev_num, rx_data, nb_data);
+	status = bsp_uart_transfer(proto->dev_num, NULL, rx_data, nb_data);
 
 	return status;
 }
 
-static uint32_t write_read(t_hydra_console *con, uint8_t *tx_data, uint8_t *rx_data, uint8_t nb_data)
+static uint32_t write_read(t_hydra_console *con, uint8_t *tx_data, uint8_t *rx_data, uint32_t nb_data)
 {
-	int i;
+	uint32_t i;
 	uint32_t status;
 	mode_config_proto_t* proto = &con->mode->proto;
 
-	status = bsp_uart_write_read_u8(proto->dev_num, tx_data, rx_data, nb_data);
+	status = bsp_uart_transfer(proto->dev_num, tx_data, rx_data, nb_data);
 	if(status == BSP_OK) {
 		if(nb_data == 1) {
 			/* Write & Read 1 data */
@@ -37,10 +37,10 @@ static const char* str_prompt_smartcard[] = {
 static const char* str_bsp_init_err= { "bsp_smartcard_init() error %d\r\n" };
 
 /* Since the hardware cannot apply inverse convention, we manage it here */
-static void apply_convention(t_hydra_console *con, uint8_t * data, uint8_t nb_data)
+static void apply_convention(t_hydra_console *con, uint8_t * data, uint32_t nb_data)
 {
 	mode_config_proto_t* proto = &con->mode->proto;
-	uint8_t i;
+	uint32_t i;
 	if(proto->config.smartcard.dev_convention == DEV_CONVENTION_INVERSE) {
 		for(i=0; i<nb_data; i++) {
 			data[i] = data[i] ^ 0xff;
@@ -438,14 +438,14 @@ static int exec(t_hydra_console *con, t_tokenline_parsed *p, int token_pos)
 	return t - token_pos;
 }
 
-static uint32_t write(t_hydra_console *con, uint8_t *tx_data, uint8_t nb_data)
+static uint32_t write(t_hydra_console *con, uint8_t *tx_data, uint32_t nb_data)
 {
-	int i;
+	uint32_t i;
 	uint32_t status;
 	mode_config_proto_t* proto = &con->mode->proto;
 
 	apply_convention(con, tx_data, nb_data);
-	status = bsp_smartcard_write_u8(proto->dev_num, tx_data, nb_data);
+	status = bsp_smartcard_transfer(proto->dev_num, tx_data, NULL, nb_data);
 	if(status == BSP_OK) {
 		if(nb_data == 1) {
 			/* Write 1 data */
@@ -462,13 +462,13 @@ static uint32_t write(t_hydra_console *con, uint8_t *tx_data, uint8_t nb_data)
 	return status;
 }
 
-static uint32_t read(t_hydra_console *con, uint8_t *rx_data, uint8_t nb_data)
+static uint32_t read(t_hydra_console *con, uint8_t *rx_data, uint32_t nb_data)
 {
-	int i;
+	uint32_t i;
 	uint32_t status;
 	mode_config_proto_t* proto = &con->mode->proto;
 
-	status = bsp_smartcard_read_u8(proto->dev_num, rx_data, nb_data);
+	status = bsp_smartcard_transfer(proto->dev_num, NULL, rx_data, nb_data);
 	apply_convention(con, rx_data, nb_data);
 	if(status == BSP_OK) {
 		if(nb_data == 1) {
@@ -486,25 +486,25 @@ static uint32_t read(t_hydra_console *con, uint8_t *rx_data, uint8_t nb_data)
 	return status;
 }
 
-static uint32_t dump(t_hydra_console *con, uint8_t *rx_data, uint8_t nb_data)
+static uint32_t dump(t_hydra_console *con, uint8_t *rx_data, uint32_t nb_data)
 {
 	uint32_t status;
 	mode_config_proto_t* proto = &con->mode->proto;
 
-	status = bsp_smartcard_read_u8(proto->dev_num, rx_data, nb_data);
+	status = bsp_smartcard_transfer(proto->dev_num, NULL, rx_data, nb_data);
 	apply_convention(con, rx_data, nb_data);
 
 	return status;
 }
 
-static uint32_t write_read(t_hydra_console *con, uint8_t *tx_data, uint8_t *rx_data, uint8_t nb_data)
+static uint32_t write_read(t_hydra_console *con, uint8_t *tx_data, uint8_t *rx_data, uint32_t nb_data)
 {
-	int i;
+	uint32_t i;
 	uint32_t status;
 	mode_config_proto_t* proto = &con->mode->proto;
 
 	apply_convention(con, tx_data, nb_data);
-	status = bsp_smartcard_write_read_u8(proto->dev_num, tx_data, rx_data, nb_data);
+	status = bsp_smartcard_transfer(proto->dev_num, tx_data, rx_data, nb_data);
 	apply_convention(con, rx_data, nb_data);
 	if(status == BSP_OK) {
 		if(nb_data == 1) {
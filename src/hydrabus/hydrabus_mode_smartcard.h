@@ -26,8 +26,8 @@ static void smartcard_rst_low(t_hydra_console *con);
 static void smartcard_vcc_high(t_hydra_console *con);
 static void smartcard_vcc_low(t_hydra_console *con);
 
-static uint32_t read(t_hydra_console *con, uint8_t *rx_data, uint8_t nb_data);
-static uint32_t write(t_hydra_console *con, uint8_t *rx_data, uint8_t nb_data);
+static uint32_t read(t_hydra_console *con, uint8_t *rx_data, uint32_t nb_data);
+static uint32_t write(t_hydra_console *con, uint8_t *rx_data, uint32_t nb_data);
 
 
 #endif /* _HYDRABUS_MODE_SMARTCARD_H_ */
@@ -18,8 +18,10 @@
  */
 
 #include "hydrabus_mode_spi.h"
+#include "hydrabus_spi_flash.h"
 #include "bsp_spi.h"
 #include "common.h"
+#include "microsd.h"
 #include <string.h>
 
 static int exec(t_hydra_console *con, t_tokenline_parsed *p, int token_pos);
@@ -129,6 +131,7 @@ static int exec(t_hydra_console *con, t_tokenline_parsed *p, int token_pos)
 	float arg_float;
 	int arg_int, t, i;
 	bsp_status_t bsp_status;
+	filename_t sd_file;
 
 	for (t = token_pos; p->tokens[t]; t++) {
 		switch (p->tokens[t]) {
@@ -242,6 +245,16 @@ static int exec(t_hydra_console *con, t_tokenline_parsed *p, int token_pos)
 				return t;
 			}
 			break;
+		case T_DUMP:
+			if (p->tokens[t+1] != T_FILE || p->tokens[t+2] != T_ARG_STRING) {
+				cprintf(con, "Missing filename.\r\n");
+				return t;
+			}
+			memcpy(&arg_int, &p->tokens[t+3], sizeof(int));
+			snprintf(sd_file.filename, FILENAME_SIZE, "0:%s", p->buf + arg_int);
+			t += 3;
+			spi_flash_dump(con, sd_file.filename);
+			break;
 		default:
 			return t - token_pos;
 		}
@@ -266,13 +279,13 @@ static void stop(t_hydra_console *con)
 	cprintf(con, hydrabus_mode_str_cs_disabled);
 }
 
-static uint32_t write(t_hydra_console *con, uint8_t *tx_data, uint8_t nb_data)
+static uint32_t write(t_hydra_console *con, uint8_t *tx_data, uint32_t nb_data)
 {
-	int i;
+	uint32_t i;
 	uint32_t status;
 	mode_config_proto_t* proto = &con->mode->proto;
 
-	status = bsp_spi_write_u8(proto->dev_num, tx_data, nb_data);
+	status = bsp_spi_transfer(proto->dev_num, tx_data, NULL, nb_data);
 	if (status == BSP_OK) {
 		if (nb_data == 1) {
 			/* Write 1 data */
@@ -289,13 +302,13 @@ static uint32_t write(t_hydra_console *con, uint8_t *tx_data, uint8_t nb_data)
 	return status;
 }
 
-static uint32_t read(t_hydra_console *con, uint8_t *rx_data, uint8_t nb_data)
+static uint32_t read(t_hydra_console *con, uint8_t *rx_data, uint32_t nb_data)
 {
-	int i;
+	uint32_t i;
 	uint32_t status;
 	mode_config_proto_t* proto = &con->mode->proto;
 
-	status = bsp_spi_read_u8(proto->dev_num, rx_data, nb_data);
+	status = bsp_spi_transfer(proto->dev_num, NULL, rx_data, nb_data);
 	if (status == BSP_OK) {
 		if (nb_data == 1) {
 			/* Read 1 data */
@@ -312,22 +325,22 @@ static uint32_t read(t_hydra_console *con, uint8_t *rx_data, uint8_t nb_data)
 	return status;
 }
 
-static uint32_t dump(t_hydra_console *con, uint8_t *rx_data, uint8_t nb_data)
+static uint32_t dump(t_hydra_console *con, uint8_t *rx_data, uint32_t nb_data)
 {
 	uint32_t status;
 	mode_config_proto_t* proto = &con->mode->proto;
 
-	status = bsp_spi_read_u8(proto->dev_num, rx_data, nb_data);
+	status = bsp_spi_transfer(proto->dev_num, NULL, rx_data, nb_data);
 	return status;
 }
 
-static uint32_t write_read(t_hydra_console *con, uint8_t *tx_data, uint8_t *rx_data, uint8_t nb_data)
+static uint32_t write_read(t_hydra_console *con, uint8_t *tx_data, uint8_t *rx_data, uint32_t nb_data)
 {
-	int i;
+	uint32_t i;
 	uint32_t status;
 	mode_config_proto_t* proto = &con->mode->proto;
 
-	status = bsp_spi_write_read_u8(proto->dev_num, tx_data, rx_data, nb_data);
+	status = bsp_spi_transfer(proto->dev_num, tx_data, rx_data, nb_data);
 	if (status == BSP_OK) {
 		if (nb_data == 1) {
 			/* Write & Read 1 data */
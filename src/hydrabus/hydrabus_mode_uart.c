@@ -20,6 +20,7 @@
 #include "hydrabus_mode_uart.h"
 #include "bsp_uart.h"
 #include "bsp_freq.h"
+#include "hydrabus_uart_bridge.h"
 #include <string.h>
 
 #define UART_DEFAULT_SPEED (9600)
@@ -85,50 +86,45 @@ static int init(t_hydra_console *con, t_tokenline_parsed *p)
 	return tokens_used;
 }
 
-static THD_FUNCTION(bridge_thread, arg)
+static void bridge(t_hydra_console *con, bool pcap)
 {
-	t_hydra_console *con;
-	con = arg;
-	chRegSetThreadName("UART reader");
-	chThdSleepMilliseconds(10);
-	uint8_t bytes_read;
+	uart_bridge_t *b;
+	file_pcapng_t *file = NULL;
 	mode_config_proto_t* proto = &con->mode->proto;
 
-	while (!hydrabus_ubtn()) {
-		if(bsp_uart_rxne(proto->dev_num)) {
-			bytes_read = bsp_uart_read_u8_timeout(proto->dev_num,
-							      proto->buffer_rx,
-							      UART_BRIDGE_BUFF_SIZE,
-							      TIME_US2I(100));
-			if(bytes_read > 0) {
-				cprint(con, (char *)proto->buffer_rx, bytes_read);
-			}
-		} else {
-			chThdYield();
+	if(pcap) {
+		file = file_pcapng_open("uart_", UART_BRIDGE_PCAP_SIZE);
+		if(file == NULL) {
+			cprintf(con, "Error, unable to create the file.\r\n");
+			return;
 		}
 	}
-}
 
-static void bridge(t_hydra_console *con)
-{
-	uint8_t bytes_read;
-	//uint8_t bytes_read;
-	mode_config_proto_t* proto = &con->mode->proto;
+	b = uart_bridge_start(con, proto->dev_num, file);
+	if(b == NULL) {
+		cprintf(con, "Error, unable to get buffer space or DMA.\r\n");
+		if(file != NULL)
+			file_pcapng_close(file);
+		return;
+	}
 
+	if(file != NULL)
+		cprintf(con, "Writing %s\r\n", &file->filename.filename[2]);
 	cprintf(con, "Interrupt by pressing user button.\r\n");
 	cprint(con, "\r\n", 2);
 
-	thread_t *bthread = chThdCreateFromHeap(NULL, CONSOLE_WA_SIZE, "bridge_thread",
-						LOWPRIO, bridge_thread, con);
-	while(!hydrabus_ubtn()) {
-		bytes_read = chnReadTimeout(con->sdu, proto->buffer_tx,
-					    UART_BRIDGE_BUFF_SIZE, TIME_US2I(100));
-		if(bytes_read > 0) {
-			bsp_uart_write_u8(proto->dev_num, proto->buffer_tx, bytes_read);
-		}
+	uart_bridge_tx(b);
+	uart_bridge_stop(b);
+	cprint(con, "\r\n", 2);
+	uart_bridge_print_stats(con, b);
+	uart_bridge_free(b);
+
+	if(file != NULL) {
+		cprintf(con, "%d packets written, %d dropped\r\n",
+			file->writer.packets, file->writer.dropped);
+		if(!file_pcapng_close(file))
+			cprintf(con, "Error, file write failed.\r\n");
 	}
-	chThdTerminate(bthread);
-	chThdWait(bthread);
 }
 
 static void baudrate(t_hydra_console *con)
@@ -248,7 +244,12 @@ static int exec(t_hydra_console *con, t_tokenline_parsed *p, int token_pos)
 			}
 			break;
 		case T_BRIDGE:
-			bridge(con);
+			if(p->tokens[t+1] == T_PCAP) {
+				t++;
+				bridge(con, true);
+			} else {
+				bridge(con, false);
+			}
 			break;
 		case T_SCAN:
 			baudrate(con);
@@ -261,13 +262,13 @@ static int exec(t_hydra_console *con, t_tokenline_parsed *p, int token_pos)
 	return t - token_pos;
 }
 
-static uint32_t write(t_hydra_console *con, uint8_t *tx_data, uint8_t nb_data)
+static uint32_t write(t_hydra_console *con, uint8_t *tx_data, uint32_t nb_data)
 {
-	int i;
+	uint32_t i;
 	uint32_t status;
 	mode_config_proto_t* proto = &con->mode->proto;
 
-	status = bsp_uart_write_u8(proto->dev_num, tx_data, nb_data);
+	status = bsp_uart_transfer(proto->dev_num, tx_data, NULL, nb_data);
 	if(status == BSP_OK) {
 		if(nb_data == 1) {
 			/* Write 1 data */
@@ -284,13 +285,13 @@ static uint32_t write(t_hydra_console *con, uint8_t *tx_data, uint8_t nb_data)
 	return status;
 }
 
-static uint32_t read(t_hydra_console *con, uint8_t *rx_data, uint8_t nb_data)
+static uint32_t read(t_hydra_console *con, uint8_t *rx_data, uint32_t nb_data)
 {
-	int i;
+	uint32_t i;
 	uint32_t status;
 	mode_config_proto_t* proto = &con->mode->proto;
 
-	status = bsp_uart_read_u8(proto->dev_num, rx_data, nb_data);
+	status = bsp_uart_transfer(proto->dev_num, NULL, rx_data, nb_data);
 	if(status == BSP_OK) {
 		if(nb_data == 1) {
 			/* Read 1 data */
@@ -307,23 +308,23 @@ static uint32_t read(t_hydra_console *con, uint8_t *rx_data, uint8_t nb_data)
 	return status;
 }
 
-static uint32_t dump(t_hydra_console *con, uint8_t *rx_data, uint8_t nb_data)
+static uint32_t dump(t_hydra_console *con, uint8_t *rx_data, uint32_t nb_data)
 {
 	uint32_t status;
 	mode_config_proto_t* proto = &con->mode->proto;
 
-	status = bsp_uart_read_u8(proto->dev_num, rx_data, nb_data);
+	status = bsp_uart_transfer(proto->dev_num, NULL, rx_data, nb_data);
 
 	return status;
 }
 
-static uint32_t write_read(t_hydra_console *con, uint8_t *tx_data, uint8_t *rx_data, uint8_t nb_data)
+static uint32_t write_read(t_hydra_console *con, uint8_t *tx_data, uint8_t *rx_data, uint32_t nb_data)
 {
-	int i;
+	uint32_t i;
 	uint32_t status;
 	mode_config_proto_t* proto = &con->mode->proto;
 
-	status = bsp_uart_write_read_u8(proto->dev_num, tx_data, rx_data, nb_data);
+	status = bsp_uart_transfer(proto->dev_num, tx_data, rx_data, nb_data);
 	if(status == BSP_OK) {
 		if(nb_data == 1) {
 			/* Write & Read 1 data */
@@ -261,7 +261,7 @@ int cmd_sd_cat(t_hydra_console *con, t_tokenline_parsed *p)
 	bool hex;
 	uint32_t str_offset, offset, filelen;
 	uint32_t cnt;
-	uint8_t *inbuf, *outbuf;
+	uint8_t *inbuf;
 	FRESULT err;
 	FIL fp;
 
@@ -291,12 +291,8 @@ int cmd_sd_cat(t_hydra_console *con, t_tokenline_parsed *p)
 		return FALSE;
 	}
 
-	outbuf = pool_alloc_bytes(IN_OUT_BUF_SIZE+8);
-	inbuf = pool_alloc_bytes(IN_OUT_BUF_SIZE+8);
-
-	if(inbuf == 0 || outbuf == 0) {
-		pool_free(inbuf);
-		pool_free(outbuf);
+	inbuf = pool_alloc_bytes(IN_OUT_BUF_SIZE);
+	if(inbuf == 0) {
 		return FALSE;
 	}
 
@@ -326,7 +322,6 @@ int cmd_sd_cat(t_hydra_console *con, t_tokenline_parsed *p)
 		}
 	}
 	pool_free(inbuf);
-	pool_free(outbuf);
 	if (!hex)
 		cprintf(con, "\r\n");
 
@@ -349,8 +344,8 @@ int cmd_sd_erase(t_hydra_console *con, t_tokenline_parsed *p)
 		return FALSE;
 	}
 
-	outbuf = pool_alloc_bytes(IN_OUT_BUF_SIZE+8);
-	inbuf = pool_alloc_bytes(IN_OUT_BUF_SIZE+8);
+	outbuf = pool_alloc_bytes(IN_OUT_BUF_SIZE);
+	inbuf = pool_alloc_bytes(IN_OUT_BUF_SIZE);
 
 	if(inbuf == 0 || outbuf == 0) {
 		pool_free(inbuf);
@@ -443,7 +438,7 @@ int cmd_sd_erase(t_hydra_console *con, t_tokenline_parsed *p)
 		fillbuffer(0x55, inbuf);
 		fillbuffer(0x55, outbuf);
 		/* fill reference buffer from SD card */
-		if (sdcRead(&SDCD1, 0, inbuf + 1, SDC_BURST_SIZE)) {
+		if (sdcRead(&SDCD1, 0, inbuf + 1, SDC_UNALIGNED_BURST_SIZE)) {
 			cprintf(con, "sdcRead KO\r\n");
 			umount();
 			pool_free(inbuf);
@@ -452,7 +447,7 @@ int cmd_sd_erase(t_hydra_console *con, t_tokenline_parsed *p)
 		}
 
 		for (i=0; i<1000; i++) {
-			if (sdcRead(&SDCD1, 0, outbuf + 1, SDC_BURST_SIZE)) {
+			if (sdcRead(&SDCD1, 0, outbuf + 1, SDC_UNALIGNED_BURST_SIZE)) {
 				cprintf(con, "sdcRead KO\r\n");
 				umount();
 				pool_free(inbuf);
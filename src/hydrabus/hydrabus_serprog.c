@@ -39,12 +39,78 @@ void bbio_serprog_init_proto_default(t_hydra_console *con)
 	proto->config.spi.dev_bit_lsb_msb = DEV_FIRSTBIT_MSB;
 }
 
+/* Standard, fast, dual output and quad output read opcodes */
+static bool serprog_is_read_op(uint8_t opcode)
+{
+	switch(opcode) {
+	case 0x03:
+	case 0x0B:
+	case 0x3B:
+	case 0x6B:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/*
+ * Read to_rx bytes and send them to the host, the next chunk is clocked
+ * by DMA in one half of rx_data while the other half is sent over USB.
+ * The ACK is sent once the first chunk is read, NAK if it fails. A later
+ * error stops the stream: the host gets less data than requested instead
+ * of stale buffer contents.
+ */
+static void serprog_spiop_stream(t_hydra_console *con, bsp_dev_spi_t dev_num,
+				 uint8_t *rx_data, uint32_t to_rx)
+{
+	uint8_t *cur, *next, *tmp;
+	uint32_t len, next_len;
+	bsp_status_t status;
+	bool ack = false;
+
+	cur = rx_data;
+	next = rx_data + SERPROG_CHUNK_SIZE;
+
+	len = MIN(to_rx, SERPROG_CHUNK_SIZE);
+	status = bsp_spi_transfer_start(dev_num, NULL, cur, len);
+	to_rx -= len;
+
+	while(len > 0) {
+		if(status == BSP_OK) {
+			status = bsp_spi_transfer_wait(dev_num);
+		}
+		if(status != BSP_OK) {
+			break;
+		}
+		if(!ack) {
+			cprint(con, S_ACK, 1);
+			ack = true;
+		}
+
+		next_len = MIN(to_rx, SERPROG_CHUNK_SIZE);
+		if(next_len > 0) {
+			status = bsp_spi_transfer_start(dev_num, NULL, next, next_len);
+			to_rx -= next_len;
+		}
+		cprint(con, (char *)cur, len);
+
+		tmp = cur;
+		cur = next;
+		next = tmp;
+		len = next_len;
+	}
+	if(!ack) {
+		cprint(con, S_NAK, 1);
+	}
+}
+
 void bbio_mode_serprog(t_hydra_console *con)
 {
 	uint8_t serprog_command;
 	uint32_t to_rx, to_tx, i;
-	uint8_t *tx_data = pool_alloc_bytes(0x1000); // 4096 bytes
-	uint8_t *rx_data = pool_alloc_bytes(0x1000); // 4096 bytes
+	bsp_status_t status;
+	uint8_t *tx_data = pool_alloc_bytes(SERPROG_WRNMAXLEN);
+	uint8_t *rx_data = pool_alloc_bytes(2 * SERPROG_CHUNK_SIZE);
 	mode_config_proto_t* proto = &con->mode->proto;
 
 	if(tx_data == 0 || rx_data == 0) {
@@ -85,8 +151,11 @@ void bbio_mode_serprog(t_hydra_console *con)
 				break;
 			case S_CMD_Q_SERBUF:
 				cprint(con, S_ACK, 1);
-				//16 bytes  UART buffer
-				cprint(con, "\x10\x00", 2);
+				// USB input queue size
+				to_tx = SERIAL_USB_BUFFERS_SIZE * SERIAL_USB_BUFFERS_NUMBER;
+				tx_data[0] = (uint8_t)((to_tx >> 0) & 0xff);
+				tx_data[1] = (uint8_t)((to_tx >> 8) & 0xff);
+				cprint(con, (char *)tx_data, 2);
 				break;
 			case S_CMD_Q_BUSTYPE:
 				cprint(con, S_ACK, 1);
@@ -103,53 +172,51 @@ void bbio_mode_serprog(t_hydra_console *con)
 				break;
 			case S_CMD_Q_WRNMAXLEN:
 				cprint(con, S_ACK, 1);
-				//4096 bytes write buffer
-				cprint(con, "\x00\x10\x00", 3);
+				to_tx = SERPROG_WRNMAXLEN;
+				tx_data[0] = (uint8_t)((to_tx >> 0 ) & 0xff);
+				tx_data[1] = (uint8_t)((to_tx >> 8 ) & 0xff);
+				tx_data[2] = (uint8_t)((to_tx >> 16) & 0xff);
+				cprint(con, (char *)tx_data, 3);
 				break;
 			case S_CMD_Q_RDNMAXLEN:
 				cprint(con, S_ACK, 1);
-				//4096 bytes write buffer
-				cprint(con, "\x00\x10\x00", 3);
+				to_rx = SERPROG_RDNMAXLEN;
+				tx_data[0] = (uint8_t)((to_rx >> 0 ) & 0xff);
+				tx_data[1] = (uint8_t)((to_rx >> 8 ) & 0xff);
+				tx_data[2] = (uint8_t)((to_rx >> 16) & 0xff);
+				cprint(con, (char *)tx_data, 3);
 				break;
 			case S_CMD_O_SPIOP:
 				chnRead(con->sdu, rx_data, 6);
 				to_tx = (rx_data[2] << 16) + (rx_data[1] << 8) + rx_data[0];
 				to_rx = (rx_data[5] << 16) + (rx_data[4] << 8) + rx_data[3];
-				if ((to_tx > 4096) || (to_rx > 4096)) {
+				if ((to_tx > SERPROG_WRNMAXLEN) || (to_rx > SERPROG_RDNMAXLEN)) {
 					cprint(con, S_NAK, 1);
 					break;
 				}
 				bsp_spi_select(proto->dev_num);
+				status = BSP_OK;
 				if(to_tx > 0) {
 					chnRead(con->sdu, tx_data, to_tx);
-					i=0;
-					while(i<to_tx) {
-						if((to_tx-i) >= 255) {
-							bsp_spi_write_u8(proto->dev_num,
-									tx_data+i,
-									255);
-						} else {
-							bsp_spi_write_u8(proto->dev_num,
-									tx_data+i,
-									to_tx-i);
-						}
-						i+=255;
-					}
+					status = bsp_spi_transfer(proto->dev_num, tx_data, NULL, to_tx);
+				}
+				if(status == BSP_OK && to_rx > 0 &&
+				   ((to_tx > 0 && serprog_is_read_op(tx_data[0])) ||
+				    to_rx > SERPROG_CHUNK_SIZE)) {
+					/* Fast path: data is streamed while reading */
+					serprog_spiop_stream(con, proto->dev_num,
+							     rx_data, to_rx);
+					bsp_spi_unselect(proto->dev_num);
+					break;
 				}
-				i=0;
-				while(i<to_rx) {
-					if((to_rx-i) >= 255) {
-						bsp_spi_read_u8(proto->dev_num,
-						                rx_data+i,
-						                255);
-					} else {
-						bsp_spi_read_u8(proto->dev_num,
-						                rx_data+i,
-						                to_rx-i);
-					}
-					i+=255;
+				if(status == BSP_OK && to_rx > 0) {
+					status = bsp_spi_transfer(proto->dev_num, NULL, rx_data, to_rx);
 				}
 				bsp_spi_unselect(proto->dev_num);
+				if(status != BSP_OK) {
+					cprint(con, S_NAK, 1);
+					break;
+				}
 				cprint(con, S_ACK, 1);
 				cprint(con, (char *)rx_data, to_rx);
 				break;
@@ -42,5 +42,12 @@
 #define S_CMD_S_SPI_FREQ	0x14	/* Set SPI clock frequency			*/
 #define S_CMD_S_PIN_STATE	0x15	/* Enable/disable output drivers		*/
 
+/* Maximum length of the data sent with S_CMD_O_SPIOP */
+#define SERPROG_WRNMAXLEN	(0x1000)
+/* Maximum length of the data read with S_CMD_O_SPIOP (streamed to host) */
+#define SERPROG_RDNMAXLEN	(0x10000)
+/* Size of each half of the read buffer used for streamed reads */
+#define SERPROG_CHUNK_SIZE	(0x1000)
+
 void bbio_serprog_init_proto_default(t_hydra_console *con);
 void bbio_mode_serprog(t_hydra_console *con);
@@ -0,0 +1,219 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "common.h"
+#include "microsd.h"
+#include "bsp_spi.h"
+#include "crc32.h"
+#include "sha256.h"
+#include "hydrabus_spi_flash.h"
+
+/* FIL is too large for the shell thread stack */
+static FIL dump_file;
+
+/*
+ * JEDEC capacity codes: the size is 2^(code - first + shift) bytes.
+ * Above 0x1F the vendors left the 2^N encoding: Micron, Cypress/Spansion,
+ * Winbond and GigaDevice continue at 0x20 (512Mbit), Macronix 1.8V parts
+ * use 0x39 (256Mbit) and up.
+ */
+static const struct {
+	uint8_t first;
+	uint8_t last;
+	uint8_t shift;
+} spi_flash_capacity[] = {
+	{ 0x10, 0x1F, 16 },	/* 64KiB to 2GiB */
+	{ 0x20, 0x22, 26 },	/* 64MiB to 256MiB */
+	{ 0x39, 0x3C, 25 },	/* 32MiB to 256MiB */
+};
+
+/* Returns the flash size in bytes from the JEDEC ID, 0 if unknown */
+uint32_t spi_flash_size(const uint8_t *jedec_id)
+{
+	uint8_t capacity = jedec_id[2];
+	unsigned int i;
+
+	if(jedec_id[0] == 0x00 || jedec_id[0] == 0xFF) {
+		return 0;
+	}
+	for(i = 0; i < ARRAY_SIZE(spi_flash_capacity); i++) {
+		if(capacity >= spi_flash_capacity[i].first &&
+		   capacity <= spi_flash_capacity[i].last) {
+			return 1UL << (capacity - spi_flash_capacity[i].first +
+				       spi_flash_capacity[i].shift);
+		}
+	}
+	return 0;
+}
+
+/*
+ * Read the whole chip with a single read command, the flash increments the
+ * address by itself. The next chunk is read by DMA in one half of the
+ * buffer while the other half is hashed and written to the SD card.
+ */
+static bool spi_flash_read_to_file(t_hydra_console *con, bsp_dev_spi_t dev_num,
+				   uint32_t size, uint8_t *buf, uint32_t chunk_size,
+				   uint32_t *crc, sha256_ctx_t *sha)
+{
+	uint8_t cmd[5];
+	uint8_t *cur, *next, *tmp;
+	uint32_t len, next_len, done;
+	uint8_t cmd_len;
+	bool ret = TRUE;
+
+	if(size > (1UL << 24)) {
+		cmd[0] = SPI_FLASH_CMD_READ4B;
+		cmd[1] = cmd[2] = cmd[3] = cmd[4] = 0;
+		cmd_len = 5;
+	} else {
+		cmd[0] = SPI_FLASH_CMD_READ;
+		cmd[1] = cmd[2] = cmd[3] = 0;
+		cmd_len = 4;
+	}
+
+	bsp_spi_select(dev_num);
+	bsp_spi_transfer(dev_num, cmd, NULL, cmd_len);
+
+	cur = buf;
+	next = buf + chunk_size;
+	len = MIN(size, chunk_size);
+	bsp_spi_transfer_start(dev_num, NULL, cur, len);
+	done = len;
+
+	while(len > 0) {
+		if(bsp_spi_transfer_wait(dev_num) != BSP_OK) {
+			cprintf(con, "SPI read error.\r\n");
+			ret = FALSE;
+			break;
+		}
+
+		next_len = MIN(size - done, chunk_size);
+		if(next_len > 0) {
+			bsp_spi_transfer_start(dev_num, NULL, next, next_len);
+			done += next_len;
+		}
+
+		*crc = crc32_update(*crc, cur, len);
+		sha256_update(sha, cur, len);
+		if(!file_write(&dump_file, cur, len)) {
+			cprintf(con, "Error writing file.\r\n");
+			bsp_spi_transfer_wait(dev_num);
+			ret = FALSE;
+			break;
+		}
+
+		if(hydrabus_ubtn()) {
+			cprintf(con, "Aborted.\r\n");
+			bsp_spi_transfer_wait(dev_num);
+			ret = FALSE;
+			break;
+		}
+
+		tmp = cur;
+		cur = next;
+		next = tmp;
+		len = next_len;
+	}
+
+	bsp_spi_unselect(dev_num);
+	return ret;
+}
+
+/**
+ * @brief   Dump a SPI flash to a file on the SD card
+ *
+ * @param[in]  con		console, the SPI device shall be initialized
+ * @param[in]  filename		full path to the file on the SD
+ *
+ * @return			The operation status.
+ */
+bool spi_flash_dump(t_hydra_console *con, const char *filename)
+{
+	mode_config_proto_t* proto = &con->mode->proto;
+	uint8_t jedec_id[3];
+	uint8_t digest[SHA256_DIGEST_SIZE];
+	sha256_ctx_t sha;
+	uint32_t size, chunk_size, crc, elapsed;
+	systime_t start;
+	uint8_t *buf;
+	bool ret;
+	int i;
+
+	jedec_id[0] = SPI_FLASH_CMD_JEDEC_ID;
+	bsp_spi_select(proto->dev_num);
+	bsp_spi_transfer(proto->dev_num, jedec_id, NULL, 1);
+	bsp_spi_transfer(proto->dev_num, NULL, jedec_id, 3);
+	bsp_spi_unselect(proto->dev_num);
+
+	size = spi_flash_size(jedec_id);
+	cprintf(con, "JEDEC ID: %02X %02X %02X\r\n",
+		jedec_id[0], jedec_id[1], jedec_id[2]);
+	if(size == 0) {
+		cprintf(con, "Unknown flash.\r\n");
+		return FALSE;
+	}
+	cprintf(con, "Size: %d KiB\r\n", size / 1024);
+
+	/* Two buffers, as large as possible */
+	chunk_size = SPI_FLASH_DUMP_CHUNK_MAX;
+	while((buf = pool_alloc_bytes(2 * chunk_size)) == 0) {
+		chunk_size /= 2;
+		if(chunk_size < SPI_FLASH_DUMP_CHUNK_MIN) {
+			cprintf(con, "Not enough memory.\r\n");
+			return FALSE;
+		}
+	}
+
+	if(!file_open(&dump_file, filename, 'c')) {
+		cprintf(con, "Error opening file %s\r\n", filename);
+		pool_free(buf);
+		return FALSE;
+	}
+
+	crc = CRC32_INIT;
+	sha256_init(&sha);
+	start = chVTGetSystemTime();
+
+	ret = spi_flash_read_to_file(con, proto->dev_num, size, buf,
+				     chunk_size, &crc, &sha);
+
+	if(!file_close(&dump_file)) {
+		cprintf(con, "Error closing file.\r\n");
+		ret = FALSE;
+	}
+	pool_free(buf);
+
+	if(!ret) {
+		return FALSE;
+	}
+
+	elapsed = TIME_I2MS(chVTTimeElapsedSinceX(start));
+	sha256_final(&sha, digest);
+
+	cprintf(con, "Dumped %d bytes to %s in %d ms", size, filename, elapsed);
+	if(elapsed > 0) {
+		cprintf(con, " (%d KiB/s)", (uint32_t)(((uint64_t)size * 1000 / 1024) / elapsed));
+	}
+	cprintf(con, "\r\nCRC32: %08X\r\nSHA-256: ", crc);
+	for(i = 0; i < SHA256_DIGEST_SIZE; i++) {
+		cprintf(con, "%02x", digest[i]);
+	}
+	cprintf(con, "\r\n");
+
+	return TRUE;
+}
@@ -0,0 +1,35 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _HYDRABUS_SPI_FLASH_H_
+#define _HYDRABUS_SPI_FLASH_H_
+
+#include "common.h"
+
+#define SPI_FLASH_CMD_JEDEC_ID	(0x9F)
+#define SPI_FLASH_CMD_READ	(0x03)	/* 3 bytes address */
+#define SPI_FLASH_CMD_READ4B	(0x13)	/* 4 bytes address */
+
+/* Size of each half of the dump buffer (multiple of the SD sector size) */
+#define SPI_FLASH_DUMP_CHUNK_MAX	(0x4000)
+#define SPI_FLASH_DUMP_CHUNK_MIN	(0x1000)
+
+uint32_t spi_flash_size(const uint8_t *jedec_id);
+bool spi_flash_dump(t_hydra_console *con, const char *filename);
+
+#endif /* _HYDRABUS_SPI_FLASH_H_ */
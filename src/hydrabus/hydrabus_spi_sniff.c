@@ -0,0 +1,318 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include "hydrabus_spi_sniff.h"
+
+static inline uint32_t ring_count(spi_sniff_t *s, uint32_t wr, uint32_t rd)
+{
+	return (wr - rd) & (s->ring_size - 1);
+}
+
+/* out_wr and out_rd are free running */
+static inline uint32_t out_free(spi_sniff_t *s)
+{
+	return s->out_size - (s->out_wr - s->out_rd);
+}
+
+static inline void out_put(spi_sniff_t *s, uint8_t data)
+{
+	s->out[s->out_wr++ & (s->out_size - 1)] = data;
+}
+
+/**
+  * @brief  Init the sniffer state
+  * @param  s: sniffer state
+  * @param  fmt: output format
+  * @param  mosi: MOSI ring (written by the DMA)
+  * @param  miso: MISO ring (written by the DMA)
+  * @param  ring_size: size of each input ring, power of 2 up to 65536
+  * @param  out: output ring
+  * @param  out_size: size of the output ring, power of 2, which receives
+  *         the pcapng file header
+  * @retval None
+  */
+void spi_sniff_init(spi_sniff_t *s, spi_sniff_fmt_t fmt,
+		    const uint8_t *mosi, const uint8_t *miso, uint32_t ring_size,
+		    uint8_t *out, uint32_t out_size)
+{
+	memset(s, 0, sizeof(*s));
+	s->fmt = fmt;
+	s->mosi = mosi;
+	s->miso = miso;
+	s->ring_size = ring_size;
+	s->out = out;
+	s->out_size = out_size;
+
+	if(fmt == SPI_SNIFF_FMT_PCAPNG) {
+		s->out_wr = pcapng_shb(out);
+		s->out_wr += pcapng_idb(out + s->out_wr, PCAPNG_LINK_SPI);
+	}
+}
+
+/**
+  * @brief  Queue a CS edge, called from the CS interrupt
+  * @param  s: sniffer state
+  * @param  timestamp: time of the edge
+  * @param  cs: CS level after the edge
+  * @param  mosi_wr: MOSI ring DMA write index at the edge
+  * @param  miso_wr: MISO ring DMA write index at the edge
+  * @retval false if the queue is full, the edge is lost
+  */
+bool spi_sniff_cs_event(spi_sniff_t *s, uint32_t timestamp, uint8_t cs,
+			uint32_t mosi_wr, uint32_t miso_wr)
+{
+	spi_sniff_event_t *ev;
+	uint32_t wr = s->event_wr;
+
+	if(wr - s->event_rd >= SPI_SNIFF_EVENTS) {
+		s->events_lost++;
+		return false;
+	}
+
+	ev = &s->events[wr & (SPI_SNIFF_EVENTS - 1)];
+	ev->timestamp = timestamp;
+	ev->mosi = mosi_wr;
+	ev->miso = miso_wr;
+	ev->cs = cs;
+	s->event_wr = wr + 1;
+
+	return true;
+}
+
+/*
+ * Encodes nb_mosi/nb_miso bytes from the read indexes, the record is
+ * dropped if the output ring is full.
+ */
+static void spi_sniff_record(spi_sniff_t *s, uint32_t nb_mosi, uint32_t nb_miso,
+			     bool last, uint32_t end, uint8_t flags)
+{
+	spi_sniff_record_t rec;
+	uint8_t epb[PCAPNG_EPB_HDR_SIZE];
+	const uint8_t *hdr;
+	uint32_t i, nb, need, mask, len;
+
+	nb = (nb_mosi > nb_miso) ? nb_mosi : nb_miso;
+	if(s->fmt == SPI_SNIFF_FMT_RECORD) {
+		need = sizeof(rec) + 2 * nb;
+	} else if(s->fmt == SPI_SNIFF_FMT_PCAPNG) {
+		need = PCAPNG_EPB_SIZE(2 * nb);
+	} else {
+		need = 3 * nb + (s->bracket ? 0 : 1) + (last ? 1 : 0);
+	}
+
+	if(out_free(s) < need) {
+		s->records_lost++;
+		s->lost = true;
+		/* Keep the legacy brackets balanced */
+		if(last && s->bracket && out_free(s) > 0) {
+			out_put(s, ']');
+			s->bracket = false;
+		}
+	} else {
+		if(s->fmt == SPI_SNIFF_FMT_RECORD) {
+			rec.magic = SPI_SNIFF_RECORD_MAGIC;
+			rec.flags = flags;
+			if(!last)
+				rec.flags |= SPI_SNIFF_FLAG_MORE;
+			if(s->cont)
+				rec.flags |= SPI_SNIFF_FLAG_CONT;
+			if(nb_mosi != nb_miso)
+				rec.flags |= SPI_SNIFF_FLAG_MISMATCH;
+			if(s->lost)
+				rec.flags |= SPI_SNIFF_FLAG_LOST;
+			rec.nb_bytes = nb;
+			rec.start = s->start;
+			rec.duration = last ? end - s->start : 0;
+
+			hdr = (const uint8_t *)&rec;
+			for(i = 0; i < sizeof(rec); i++) {
+				out_put(s, hdr[i]);
+			}
+		} else if(s->fmt == SPI_SNIFF_FMT_PCAPNG) {
+			len = pcapng_epb_header(epb, 0,
+						pcapng_ts_ns(pcapng_ts_extend(&s->time, s->start),
+							     SPI_SNIFF_TS_FREQ),
+						2 * nb);
+			for(i = 0; i < len; i++) {
+				out_put(s, epb[i]);
+			}
+		} else if(!s->bracket) {
+			out_put(s, '[');
+			s->bracket = true;
+		}
+
+		mask = s->ring_size - 1;
+		for(i = 0; i < nb; i++) {
+			if(s->fmt == SPI_SNIFF_FMT_LEGACY)
+				out_put(s, '\\');
+			out_put(s, (i < nb_mosi) ? s->mosi[(s->mosi_rd + i) & mask] : 0);
+			out_put(s, (i < nb_miso) ? s->miso[(s->miso_rd + i) & mask] : 0);
+		}
+
+		if(s->fmt == SPI_SNIFF_FMT_LEGACY && last) {
+			out_put(s, ']');
+			s->bracket = false;
+		} else if(s->fmt == SPI_SNIFF_FMT_PCAPNG) {
+			len = pcapng_epb_trailer(epb, 2 * nb);
+			for(i = 0; i < len; i++) {
+				out_put(s, epb[i]);
+			}
+		}
+		s->records++;
+		s->lost = false;
+	}
+
+	s->mosi_rd = (s->mosi_rd + nb_mosi) & (s->ring_size - 1);
+	s->miso_rd = (s->miso_rd + nb_miso) & (s->ring_size - 1);
+	s->cont = !last;
+}
+
+/* Encodes the bytes up to the CS rising edge in one or more records */
+static void spi_sniff_end(spi_sniff_t *s, uint32_t timestamp,
+			  uint32_t mosi_end, uint32_t miso_end, uint8_t flags)
+{
+	uint32_t nb_mosi, nb_miso;
+
+	while(1) {
+		nb_mosi = ring_count(s, mosi_end, s->mosi_rd);
+		nb_miso = ring_count(s, miso_end, s->miso_rd);
+		if(nb_mosi <= SPI_SNIFF_RECORD_MAX && nb_miso <= SPI_SNIFF_RECORD_MAX)
+			break;
+		if(nb_mosi > SPI_SNIFF_RECORD_MAX)
+			nb_mosi = SPI_SNIFF_RECORD_MAX;
+		if(nb_miso > SPI_SNIFF_RECORD_MAX)
+			nb_miso = SPI_SNIFF_RECORD_MAX;
+		spi_sniff_record(s, nb_mosi, nb_miso, false, 0, flags);
+	}
+	spi_sniff_record(s, nb_mosi, nb_miso, true, timestamp, flags);
+	s->in_xfer = false;
+}
+
+/**
+  * @brief  Encode the transactions ended by the queued CS edges, and the
+  *         bytes of a long transaction in progress.
+  * @param  s: sniffer state
+  * @param  events_lost: CS edges lost since the last call, the caller
+  *         reads and clears s->events_lost with the CS interrupt masked.
+  * @param  mosi_wr: MOSI ring DMA write index
+  * @param  miso_wr: MISO ring DMA write index
+  * @retval None
+  */
+void spi_sniff_process(spi_sniff_t *s, uint32_t events_lost,
+		       uint32_t mosi_wr, uint32_t miso_wr)
+{
+	spi_sniff_event_t *ev;
+	uint32_t nb_mosi, nb_miso;
+
+	if(events_lost > 0)
+		s->lost = true;
+
+	while(s->event_rd != s->event_wr) {
+		ev = &s->events[s->event_rd & (SPI_SNIFF_EVENTS - 1)];
+
+		if(ev->cs == 0) {
+			/* CS rising edge lost */
+			if(s->in_xfer) {
+				spi_sniff_end(s, ev->timestamp, ev->mosi, ev->miso, 0);
+			}
+			s->in_xfer = true;
+			s->cont = false;
+			s->start = ev->timestamp;
+			/* Bytes received while CS was high are ignored */
+			s->mosi_rd = ev->mosi;
+			s->miso_rd = ev->miso;
+		} else if(s->in_xfer) {
+			spi_sniff_end(s, ev->timestamp, ev->mosi, ev->miso, 0);
+		}
+		s->event_rd++;
+	}
+
+	if(!s->in_xfer) {
+		s->mosi_rd = mosi_wr;
+		s->miso_rd = miso_wr;
+		return;
+	}
+
+	/* Long transaction, send it before the rings wrap */
+	while(1) {
+		nb_mosi = ring_count(s, mosi_wr, s->mosi_rd);
+		nb_miso = ring_count(s, miso_wr, s->miso_rd);
+		if(nb_mosi < SPI_SNIFF_RECORD_MAX || nb_miso < SPI_SNIFF_RECORD_MAX)
+			break;
+		spi_sniff_record(s, SPI_SNIFF_RECORD_MAX, SPI_SNIFF_RECORD_MAX, false, 0, 0);
+	}
+}
+
+/**
+  * @brief  Keep the pcapng timestamps extended to 64 bits while no
+  *         transaction is encoded, call it at least every 10s.
+  * @param  s: sniffer state
+  * @param  timestamp: current time
+  * @retval None
+  */
+void spi_sniff_tick(spi_sniff_t *s, uint32_t timestamp)
+{
+	pcapng_ts_extend(&s->time, timestamp);
+}
+
+/**
+  * @brief  End of the capture, encode the transaction in progress if any.
+  *         The CS interrupt shall be stopped.
+  * @param  s: sniffer state
+  * @param  timestamp: end of the capture
+  * @param  mosi_wr: MOSI ring DMA write index
+  * @param  miso_wr: MISO ring DMA write index
+  * @retval None
+  */
+void spi_sniff_close(spi_sniff_t *s, uint32_t timestamp, uint32_t mosi_wr, uint32_t miso_wr)
+{
+	spi_sniff_process(s, s->events_lost, mosi_wr, miso_wr);
+	s->events_lost = 0;
+	if(s->in_xfer) {
+		spi_sniff_end(s, timestamp, mosi_wr, miso_wr, SPI_SNIFF_FLAG_OPEN);
+	}
+}
+
+/**
+  * @brief  Get the contiguous data available in the output ring
+  * @param  s: sniffer state
+  * @param  data: set to the first byte
+  * @retval number of bytes
+  */
+uint32_t spi_sniff_out_get(spi_sniff_t *s, const uint8_t **data)
+{
+	uint32_t rd = s->out_rd & (s->out_size - 1);
+	uint32_t len = s->out_wr - s->out_rd;
+
+	if(len > s->out_size - rd)
+		len = s->out_size - rd;
+	*data = &s->out[rd];
+	return len;
+}
+
+/**
+  * @brief  Remove sent data from the output ring
+  * @param  s: sniffer state
+  * @param  len: number of bytes sent
+  * @retval None
+  */
+void spi_sniff_out_consume(spi_sniff_t *s, uint32_t len)
+{
+	s->out_rd += len;
+}
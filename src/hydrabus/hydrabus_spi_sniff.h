@@ -0,0 +1,133 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * SPI sniffer framing: splits the MOSI and MISO byte rings (filled by the
+ * circular DMA of the two slave SPI) into transactions using the CS edges
+ * and encodes them into an output ring, sent to the host in bulk.
+ * This file does not depend on ChibiOS nor on the HAL.
+ */
+
+#ifndef _HYDRABUS_SPI_SNIFF_H_
+#define _HYDRABUS_SPI_SNIFF_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pcapng.h"
+
+/* Output formats */
+typedef enum {
+	/* '[' at CS low, '\' MOSI MISO for each byte, ']' at CS high */
+	SPI_SNIFF_FMT_LEGACY = 0,
+	/* spi_sniff_record_t then the MOSI/MISO byte pairs */
+	SPI_SNIFF_FMT_RECORD,
+	/*
+	 * pcapng stream: Section Header and Interface Description Blocks,
+	 * then an Enhanced Packet Block of MOSI/MISO byte pairs per record
+	 * (PCAPNG_LINK_SPI) stamped with the CS falling edge.
+	 */
+	SPI_SNIFF_FMT_PCAPNG,
+} spi_sniff_fmt_t;
+
+/* Timestamps unit, CPU cycles */
+#define SPI_SNIFF_TS_FREQ	(168000000)
+
+#define SPI_SNIFF_RECORD_MAGIC	(0x53) /* 'S' */
+
+/* The transaction continues in the next record */
+#define SPI_SNIFF_FLAG_MORE	(1 << 0)
+/* The record continues the transaction of the previous one */
+#define SPI_SNIFF_FLAG_CONT	(1 << 1)
+/* MOSI and MISO byte counts differ, the shorter one is padded with 0 */
+#define SPI_SNIFF_FLAG_MISMATCH	(1 << 2)
+/* Records or CS edges were lost before this record */
+#define SPI_SNIFF_FLAG_LOST	(1 << 3)
+/* CS was still low at the end of the capture */
+#define SPI_SNIFF_FLAG_OPEN	(1 << 4)
+
+/*
+ * Record header, little endian. Timestamps are in CPU cycles (168MHz),
+ * the duration is the CS low time, 0 if the transaction is not complete
+ * (SPI_SNIFF_FLAG_MORE).
+ */
+typedef struct __attribute__ ((packed)) {
+	uint8_t magic;
+	uint8_t flags;
+	uint16_t nb_bytes; /* Number of MOSI/MISO pairs which follow */
+	uint32_t start;
+	uint32_t duration;
+} spi_sniff_record_t;
+
+/* Transactions are split in records of this number of bytes at most */
+#define SPI_SNIFF_RECORD_MAX	(256)
+
+/* CS edges queue (power of 2) */
+#define SPI_SNIFF_EVENTS	(32)
+
+typedef struct {
+	uint32_t timestamp;
+	uint16_t mosi; /* DMA write index of the rings at the edge */
+	uint16_t miso;
+	uint8_t cs; /* CS level after the edge */
+} spi_sniff_event_t;
+
+typedef struct {
+	/* Input rings, ring_size shall be a power of 2 */
+	const uint8_t *mosi;
+	const uint8_t *miso;
+	uint32_t ring_size;
+	uint32_t mosi_rd;
+	uint32_t miso_rd;
+
+	/* CS edges, written by the CS interrupt */
+	spi_sniff_event_t events[SPI_SNIFF_EVENTS];
+	volatile uint32_t event_wr;
+	volatile uint32_t event_rd;
+	volatile uint32_t events_lost;
+
+	/* Output ring, out_size shall be a power of 2 */
+	uint8_t *out;
+	uint32_t out_size;
+	uint32_t out_wr;
+	uint32_t out_rd;
+
+	spi_sniff_fmt_t fmt;
+	bool in_xfer;
+	bool cont;
+	bool lost;
+	bool bracket; /* Legacy '[' sent */
+	uint32_t start;
+	uint64_t time; /* Extended timestamp (pcapng), set by the caller */
+
+	uint32_t records;
+	uint32_t records_lost;
+} spi_sniff_t;
+
+void spi_sniff_init(spi_sniff_t *s, spi_sniff_fmt_t fmt,
+		    const uint8_t *mosi, const uint8_t *miso, uint32_t ring_size,
+		    uint8_t *out, uint32_t out_size);
+bool spi_sniff_cs_event(spi_sniff_t *s, uint32_t timestamp, uint8_t cs,
+			uint32_t mosi_wr, uint32_t miso_wr);
+void spi_sniff_process(spi_sniff_t *s, uint32_t events_lost,
+		       uint32_t mosi_wr, uint32_t miso_wr);
+void spi_sniff_tick(spi_sniff_t *s, uint32_t timestamp);
+void spi_sniff_close(spi_sniff_t *s, uint32_t timestamp, uint32_t mosi_wr, uint32_t miso_wr);
+uint32_t spi_sniff_out_get(spi_sniff_t *s, const uint8_t **data);
+void spi_sniff_out_consume(spi_sniff_t *s, uint32_t len);
+
+#endif /* _HYDRABUS_SPI_SNIFF_H_ */
@@ -20,15 +20,26 @@
 #include "common.h"
 #include "tokenline.h"
 #include "bsp.h"
-#include "bsp_tim.h"
+#include "bsp_sampler.h"
+#include "bsp_sampler_conf.h"
 #include "hydrabus_sump.h"
+#include "hydrabus_sump_trigger.h"
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
 
-#define STATES_LEN 8192
+/* Capture ring depth in samples (power of 2), from SUMP_MAX_STATES down */
+#define SUMP_MAX_STATES (POOL_BUFFER_SIZE/sizeof(uint16_t))
+#define SUMP_MIN_STATES (8192)
 
-static uint16_t INDEX = 0;
+/*
+ * Readout chunks are a multiple of the USB packet size (64) and of the 1 to
+ * 4 bytes samples: a sample is never split between two packets.
+ */
+#define SUMP_TX_ALIGN (64 * 3)
+#define SUMP_TX_CHUNK_SIZE (MODE_CONFIG_PROTO_BUFFER_SIZE / SUMP_TX_ALIGN * SUMP_TX_ALIGN)
+/* Readout staging buffer in CCM, the capture ring takes the main pool */
+#define SUMP_TX_STAGING_SIZE (4096 / SUMP_TX_ALIGN * SUMP_TX_ALIGN)
 
 static void portc_init(void)
 {
@@ -50,78 +61,96 @@ static void portc_init(void)
 	}
 }
 
-static void tim_init(t_hydra_console *con)
+static uint32_t sump_period(t_hydra_console *con)
 {
 	mode_config_proto_t* proto = &con->mode->proto;
 
-	bsp_tim_init(21, 2*(proto->config.sump.divider), TIM_CLOCKDIVISION_DIV1, TIM_COUNTERMODE_UP);
+	return sump_proto_get_period(&proto->config.sump, BSP_SAMPLER_TIMER_FREQ);
 }
 
-static void tim_set_prescaler(t_hydra_console *con)
-{
-	mode_config_proto_t* proto = &con->mode->proto;
-
-	bsp_tim_set_prescaler(2*(proto->config.sump.divider));
-}
-
-static void sump_init(t_hydra_console *con)
+static bool sump_init(t_hydra_console *con)
 {
 	portc_init();
-	tim_init(con);
+	return bsp_sampler_init(sump_period(con)) == BSP_OK;
 }
 
-static void get_samples(t_hydra_console *con, uint16_t * buffer) __attribute__((optimize("-O3")));
-static void get_samples(t_hydra_console *con, uint16_t * buffer)
+/*
+ * Samples are written by the DMA in a circular buffer of nb_states samples,
+ * the CPU only follows the DMA write index to look for the trigger.
+ * Returns the index following the last sample of the capture, nb_valid is
+ * set to the number of captured samples before it.
+ */
+static uint32_t get_samples(t_hydra_console *con, uint16_t *buffer, uint32_t nb_states,
+			    uint32_t *nb_valid) __attribute__((optimize("-O3")));
+static uint32_t get_samples(t_hydra_console *con, uint16_t *buffer, uint32_t nb_states,
+			    uint32_t *nb_valid)
 {
 	mode_config_proto_t* proto = &con->mode->proto;
-	uint32_t config_state;
-	config_state = proto->config.sump.state;
-
-	/* Lock Kernel for logic analyzer */
-	chSysLock();
-
-	bsp_tim_start();
-
-	if(config_state == SUMP_STATE_ARMED)
-	{
-		uint32_t config_trigger_value;
-		uint32_t config_trigger_mask;
-
-		config_trigger_value =  proto->config.sump.trigger_values[0];
-		config_trigger_mask = proto->config.sump.trigger_masks[0];
-
-		while(1)
-		{
-			bsp_tim_wait_irq();
-			*(buffer+INDEX) = GPIOC->IDR;
-			bsp_tim_clr_irq();
-			if ( !((*(buffer+INDEX) ^ config_trigger_value) & config_trigger_mask) ) {
-				config_state = SUMP_STATE_TRIGGED;
+	const uint32_t states_mask = nb_states - 1;
+	uint32_t index, write_index, prev_index;
+	uint32_t written, trigger_pos, end, overwritten;
+	uint32_t config_delay_count;
+	sump_trigger_t trigger;
+
+	sump_trigger_init(&trigger, &proto->config.sump);
+	config_delay_count = proto->config.sump.delay_count;
+
+	memset(buffer, 0, nb_states * sizeof(uint16_t));
+
+	/* written counts all the samples written since the start */
+	index = 0;
+	prev_index = 0;
+	written = 0;
+	bsp_sampler_start(buffer, nb_states);
+
+	if(proto->config.sump.state == SUMP_STATE_ARMED) {
+		while(!trigger.fired) {
+			write_index = bsp_sampler_get_index();
+			written += (write_index - prev_index) & states_mask;
+			prev_index = write_index;
+			index = sump_trigger_process(&trigger, buffer, states_mask,
+						     index, write_index);
+			if(hydrabus_ubtn()) {
 				break;
 			}
-			INDEX++;
-			INDEX &= STATES_LEN-1;
+		}
+		if(trigger.fired) {
+			proto->config.sump.state = SUMP_STATE_TRIGGED;
 		}
 	}
 
-	if(config_state == SUMP_STATE_TRIGGED)
-	{
-		register uint32_t config_delay_count = proto->config.sump.delay_count;
-
-		while(config_delay_count > 0)
-		{
-			bsp_tim_wait_irq();
-			*(buffer+INDEX) = GPIOC->IDR;
-			bsp_tim_clr_irq();
-			config_delay_count--;
-			INDEX++;
-			INDEX &= STATES_LEN-1;
+	/* Wait for delay_count samples after the trigger */
+	trigger_pos = written - ((prev_index - index) & states_mask);
+	while(written - trigger_pos <= config_delay_count) {
+		write_index = bsp_sampler_get_index();
+		written += (write_index - prev_index) & states_mask;
+		prev_index = write_index;
+		if(hydrabus_ubtn()) {
+			break;
 		}
 	}
 
-	chSysUnlock();
+	if(written - trigger_pos <= config_delay_count) {
+		/* Aborted, return what has been captured so far */
+		end = written;
+	} else {
+		end = trigger_pos + 1 + config_delay_count;
+	}
+	bsp_sampler_stop();
+	write_index = bsp_sampler_get_index();
+	written += (write_index - prev_index) & states_mask;
 	proto->config.sump.state = SUMP_STATE_IDLE;
-	bsp_tim_stop();
+
+	/* The samples written after end overwrote the oldest ones */
+	overwritten = written - end;
+	if(overwritten >= nb_states) {
+		*nb_valid = 0;
+	} else if(end > nb_states - overwritten) {
+		*nb_valid = nb_states - overwritten;
+	} else {
+		*nb_valid = end;
+	}
+	return end & states_mask;
 }
 
 static void sump_deinit(void)
@@ -130,19 +159,97 @@ static void sump_deinit(void)
 	hal_gpio_port =(GPIO_TypeDef*)GPIOC;
 	uint8_t gpio_pin;
 
-	bsp_tim_deinit();
+	bsp_sampler_deinit();
 	for(gpio_pin=0; gpio_pin<15; gpio_pin++) {
 		HAL_GPIO_DeInit(hal_gpio_port, 1 << gpio_pin);
 	}
 }
 
+/* Allocate the largest capture buffer available in the pool */
+static uint16_t *sump_alloc(uint32_t *nb_states)
+{
+	uint16_t *buffer;
+	uint32_t states;
+
+	for(states = SUMP_MAX_STATES; states >= SUMP_MIN_STATES; states >>= 1) {
+		buffer = pool_alloc_bytes(states * sizeof(uint16_t));
+		if(buffer != 0) {
+			*nb_states = states;
+			return buffer;
+		}
+	}
+	return 0;
+}
+
+/* Send read_count samples from the newest to the oldest one */
+static void sump_send_samples(t_hydra_console *con, uint16_t *buffer,
+			      uint32_t nb_states, uint32_t end, uint32_t nb_valid)
+{
+	mode_config_proto_t* proto = &con->mode->proto;
+	uint8_t *staging = pool_alloc_ccm(SUMP_TX_STAGING_SIZE);
+	uint8_t *tx_buf = staging;
+	uint32_t tx_size = SUMP_TX_STAGING_SIZE;
+	sump_reader_t reader;
+	uint32_t len;
+
+	/*
+	 * Samples are packed in the staging buffer (or in proto->buffer_tx if
+	 * the pool is full), each chunk is filled with whole samples up to
+	 * its SUMP_TX_ALIGN multiple size and sent with a single write
+	 */
+	if(staging == NULL) {
+		tx_buf = proto->buffer_tx;
+		tx_size = SUMP_TX_CHUNK_SIZE;
+	}
+	sump_reader_init(&reader, &proto->config.sump, buffer, nb_states, end,
+			 nb_valid);
+	while((len = sump_reader_fill(&reader, tx_buf, tx_size)) > 0) {
+		cprint(con, (char *)tx_buf, len);
+	}
+	pool_free(staging);
+}
+
+static void sump_send_desc(t_hydra_console *con, uint32_t nb_states)
+{
+	uint8_t desc[32];
+	uint8_t i = 0;
+
+	/* device name string */
+	desc[i++] = 0x01;
+	memcpy(&desc[i], "HydraBus", 9);
+	i += 9;
+	/* sample memory */
+	desc[i++] = 0x21;
+	desc[i++] = nb_states >> 24;
+	desc[i++] = nb_states >> 16;
+	desc[i++] = nb_states >> 8;
+	desc[i++] = nb_states;
+	/* sample rate */
+	desc[i++] = 0x23;
+	desc[i++] = SUMP_MAX_SAMPLE_RATE >> 24;
+	desc[i++] = SUMP_MAX_SAMPLE_RATE >> 16;
+	desc[i++] = SUMP_MAX_SAMPLE_RATE >> 8;
+	desc[i++] = SUMP_MAX_SAMPLE_RATE & 0xff;
+	/* number of probes (16) */
+	desc[i++] = 0x40;
+	desc[i++] = 0x10;
+	/* protocol version (2) */
+	desc[i++] = 0x41;
+	desc[i++] = 0x02;
+	desc[i++] = 0x00;
+
+	cprint(con, (char *)desc, i);
+}
+
 int cmd_sump(t_hydra_console *con, t_tokenline_parsed *p)
 {
 	(void) p;
 	cprintf(con, "Interrupt by pressing user button.\r\n");
 	cprint(con, "\r\n", 2);
 
+	console_set_raw(con, TRUE);
 	sump(con);
+	console_set_raw(con, FALSE);
 
 	return TRUE;
 }
@@ -151,18 +258,23 @@ void sump(t_hydra_console *con) __attribute__((optimize("-O3")));
 void sump(t_hydra_console *con)
 {
 	mode_config_proto_t* proto = &con->mode->proto;
-	uint16_t *buffer = pool_alloc_bytes(STATES_LEN*2);
+	uint32_t nb_states = 0;
+	uint16_t *buffer = sump_alloc(&nb_states);
+	uint32_t end, nb_valid;
 
 	if(buffer == 0) {
 		return;
 	}
 
-	sump_init(con);
-	proto->config.sump.state = SUMP_STATE_IDLE;
+	sump_proto_reset(&proto->config.sump);
+	if(!sump_init(con)) {
+		pool_free(buffer);
+		sump_deinit();
+		return;
+	}
 
 	uint8_t sump_command;
 	uint8_t sump_parameters[4] = {0};
-	uint32_t index=0;
 
 	while (!hydrabus_ubtn()) {
 		if(chnReadTimeout(con->sdu, &sump_command, 1, 1)) {
@@ -173,119 +285,27 @@ void sump(t_hydra_console *con)
 				cprintf(con, "1ALS");
 				break;
 			case SUMP_RUN:
-				INDEX=0;
 				proto->config.sump.state = SUMP_STATE_ARMED;
-				get_samples(con, buffer);
-
-				while(proto->config.sump.read_count > 0) {
-					if (INDEX == 0) {
-						INDEX = STATES_LEN-1;
-					} else {
-						INDEX--;
-					}
-					switch (proto->config.sump.channels) {
-					case 1:
-						cprintf(con, "%c\x00\x00\x00", *(buffer+INDEX) & 0xff);
-						break;
-					case 2:
-						cprintf(con, "%c\x00\x00\x00", (*(buffer+INDEX) & 0xff00)>>8);
-						break;
-					case 3:
-						cprintf(con, "%c%c\x00\x00", *(buffer+INDEX) & 0xff, (*(buffer+INDEX) & 0xff00)>>8);
-						break;
-					}
-					proto->config.sump.read_count--;
-				}
+				end = get_samples(con, buffer, nb_states, &nb_valid);
+				sump_send_samples(con, buffer, nb_states, end, nb_valid);
 				break;
 			case SUMP_DESC:
-				// device name string
-				cprintf(con, "%c", 0x01);
-				cprintf(con, "HydraBus");
-				cprintf(con, "%c", 0x00);
-				//sample memory (8192)
-				cprintf(con, "%c", 0x21);
-				cprintf(con, "%c", 0x00);
-				cprintf(con, "%c", 0x00);
-				cprintf(con, "%c", 0x20);
-				cprintf(con, "%c", 0x00);
-				//sample rate (2MHz)
-				cprintf(con, "%c", 0x23);
-				cprintf(con, "%c", 0x00);
-				cprintf(con, "%c", 0x1E);
-				cprintf(con, "%c", 0x84);
-				cprintf(con, "%c", 0x80);
-				//b
-				//number of probes (16)
-				cprintf(con, "%c", 0x40);
-				cprintf(con, "%c", 0x10);
-				//protocol version (2)
-				cprintf(con, "%c", 0x41);
-				cprintf(con, "%c", 0x02);
-				cprintf(con, "%c", 0x00);
+				sump_send_desc(con, nb_states);
 				break;
 			case SUMP_XON:
 			case SUMP_XOFF:
 				/* not implemented */
 				break;
 			default:
-				// Other commands take 4 bytes as parameters
+				if(!sump_proto_is_long_cmd(sump_command)) {
+					break;
+				}
+				// Long commands take 4 bytes as parameters
 				if(chnRead(con->sdu, sump_parameters, 4) == 4) {
-					switch(sump_command) {
-					case SUMP_TRIG_1:
-					case SUMP_TRIG_2:
-					case SUMP_TRIG_3:
-					case SUMP_TRIG_4:
-						// Get the trigger index
-						index = (sump_command & 0x0c) >> 2;
-						proto->config.sump.trigger_masks[index] = sump_parameters[3];
-						proto->config.sump.trigger_masks[index] <<= 8;
-						proto->config.sump.trigger_masks[index] |= sump_parameters[2];
-						proto->config.sump.trigger_masks[index] <<= 8;
-						proto->config.sump.trigger_masks[index] |= sump_parameters[1];
-						proto->config.sump.trigger_masks[index] <<= 8;
-						proto->config.sump.trigger_masks[index] |= sump_parameters[0];
-						break;
-					case SUMP_TRIG_VALS_1:
-					case SUMP_TRIG_VALS_2:
-					case SUMP_TRIG_VALS_3:
-					case SUMP_TRIG_VALS_4:
-						// Get the trigger index
-						index = (sump_command & 0x0c) >> 2;
-						proto->config.sump.trigger_values[index] = sump_parameters[3];
-						proto->config.sump.trigger_values[index] <<= 8;
-						proto->config.sump.trigger_values[index] |= sump_parameters[2];
-						proto->config.sump.trigger_values[index] <<= 8;
-						proto->config.sump.trigger_values[index] |= sump_parameters[1];
-						proto->config.sump.trigger_values[index] <<= 8;
-						proto->config.sump.trigger_values[index] |= sump_parameters[0];
-						break;
-					case SUMP_CNT:
-						proto->config.sump.delay_count = sump_parameters[3];
-						proto->config.sump.delay_count <<= 8;
-						proto->config.sump.delay_count |= sump_parameters[2];
-						proto->config.sump.delay_count <<= 2; /* values are multiples of 4 */
-						proto->config.sump.read_count = sump_parameters[1];
-						proto->config.sump.read_count <<= 8;
-						proto->config.sump.read_count |= sump_parameters[0];
-						proto->config.sump.read_count++;
-						proto->config.sump.read_count <<= 2; /* values are multiples of 4 */
-						break;
-					case SUMP_DIV:
-						proto->config.sump.divider = sump_parameters[2];
-						proto->config.sump.divider <<= 8;
-						proto->config.sump.divider |= sump_parameters[1];
-						proto->config.sump.divider <<= 8;
-						proto->config.sump.divider |= sump_parameters[0];
-						proto->config.sump.divider /= 50; /* Assuming 100MHz base frequency */
-						proto->config.sump.divider++;
-						tim_set_prescaler(con);
-						break;
-					case SUMP_FLAGS:
-						proto->config.sump.channels = (~sump_parameters[0] >> 2) & 0x0f;
-						/* not implemented */
-						break;
-					default:
-						break;
+					if(sump_proto_set_param(&proto->config.sump,
+								sump_command,
+								sump_parameters) & SUMP_PARAM_DIVIDER) {
+						bsp_sampler_set_period(sump_period(con));
 					}
 				}
 				break;
@@ -295,4 +315,3 @@ void sump(t_hydra_console *con)
 	pool_free(buffer);
 	sump_deinit();
 }
-
@@ -16,28 +16,7 @@
  * limitations under the License.
  */
 
-#define SUMP_RESET	0x00
-#define SUMP_RUN	0x01
-#define SUMP_ID		0x02
-#define SUMP_DESC	0x04
-#define SUMP_XON	0x11
-#define SUMP_XOFF	0x13
-#define SUMP_DIV	0x80
-#define SUMP_CNT	0x81
-#define SUMP_FLAGS	0x82
-#define SUMP_TRIG_1	0xc0
-#define SUMP_TRIG_2	0xc4
-#define SUMP_TRIG_3	0xc8
-#define SUMP_TRIG_4	0xcc
-#define SUMP_TRIG_VALS_1  0xc1
-#define SUMP_TRIG_VALS_2  0xc5
-#define SUMP_TRIG_VALS_3  0xc9
-#define SUMP_TRIG_VALS_4  0xcd
-
-#define SUMP_STATE_IDLE		0
-#define SUMP_STATE_ARMED	1
-#define SUMP_STATE_RUNNNING	2
-#define SUMP_STATE_TRIGGED	3
+#include "hydrabus_sump_proto.h"
 
 typedef struct {
 	uint32_t trigger_masks[4];
@@ -0,0 +1,397 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2015-2020 Nicolas OBERLI
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "hydrabus_sump_proto.h"
+
+/* SUMP parameters are sent LSB first */
+static uint32_t param_u32(const uint8_t *param)
+{
+	return param[0] | (param[1] << 8) | (param[2] << 16) |
+	       ((uint32_t)param[3] << 24);
+}
+
+/**
+  * @brief  Reset SUMP configuration to default values
+  * @param  config: SUMP configuration
+  * @retval None
+  */
+void sump_proto_reset(sump_config_t *config)
+{
+	uint8_t i;
+
+	for(i=0; i<4; i++) {
+		config->trigger_masks[i] = 0;
+		config->trigger_values[i] = 0;
+		/* Stages 2 to 4 are only armed at last level */
+		config->trigger_configs[i] = 3UL << 16;
+	}
+	/* Stage 1 starts the capture, for clients which do not configure stages */
+	config->trigger_configs[0] = SUMP_TRIG_CONF_START;
+	config->read_count = 0;
+	config->delay_count = 0;
+	config->divider = 0;
+	config->flags = 0;
+	config->state = SUMP_STATE_IDLE;
+	config->channels = 3;
+}
+
+/**
+  * @brief  Apply a SUMP long command to the configuration
+  * @param  config: SUMP configuration
+  * @param  command: SUMP command
+  * @param  param: 4 bytes of command parameters
+  * @retval SUMP_PARAM_xxx flags of the settings requiring hardware update
+  */
+uint32_t sump_proto_set_param(sump_config_t *config, uint8_t command,
+			      const uint8_t *param)
+{
+	uint32_t index;
+
+	switch(command) {
+	case SUMP_TRIG_1:
+	case SUMP_TRIG_2:
+	case SUMP_TRIG_3:
+	case SUMP_TRIG_4:
+		index = (command & 0x0c) >> 2;
+		config->trigger_masks[index] = param_u32(param);
+		break;
+	case SUMP_TRIG_VALS_1:
+	case SUMP_TRIG_VALS_2:
+	case SUMP_TRIG_VALS_3:
+	case SUMP_TRIG_VALS_4:
+		index = (command & 0x0c) >> 2;
+		config->trigger_values[index] = param_u32(param);
+		break;
+	case SUMP_TRIG_CONF_1:
+	case SUMP_TRIG_CONF_2:
+	case SUMP_TRIG_CONF_3:
+	case SUMP_TRIG_CONF_4:
+		index = (command & 0x0c) >> 2;
+		config->trigger_configs[index] = param_u32(param);
+		break;
+	case SUMP_CNT:
+		/* values are multiples of 4 */
+		config->read_count = ((param[1] << 8 | param[0]) + 1) << 2;
+		config->delay_count = (param[3] << 8 | param[2]) << 2;
+		break;
+	case SUMP_DIV:
+		config->divider = param_u32(param) & 0x00ffffff;
+		return SUMP_PARAM_DIVIDER;
+	case SUMP_FLAGS:
+		config->flags = param_u32(param);
+		config->channels = (~param[0] >> SUMP_FLAG_GROUPS_SHIFT) & 0x0f;
+		break;
+	default:
+		break;
+	}
+	return 0;
+}
+
+/**
+  * @brief  Compute sampling period for the configured divider
+  * @param  config: SUMP configuration
+  * @param  timer_freq: sampling timer clock frequency in Hz
+  * @retval Sampling period in timer clock cycles
+  */
+/*
+ * Sample rate is SUMP_BASE_CLOCK/(divider+1), it is clamped to
+ * SUMP_MAX_SAMPLE_RATE.
+*/
+uint32_t sump_proto_get_period(const sump_config_t *config, uint32_t timer_freq)
+{
+	uint64_t period;
+	uint32_t min_period;
+
+	period = (uint64_t)(config->divider + 1) * timer_freq;
+	period = (period + SUMP_BASE_CLOCK/2) / SUMP_BASE_CLOCK;
+	min_period = timer_freq / SUMP_MAX_SAMPLE_RATE;
+	if(period < min_period) {
+		period = min_period;
+	}
+	return (uint32_t)period;
+}
+
+/**
+  * @brief  Number of bytes sent per sample
+  * @param  channels: enabled channel groups (see sump_sample_pack())
+  * @retval One byte per enabled group
+  */
+uint8_t sump_sample_bytes(uint8_t channels)
+{
+	uint8_t nb = 0;
+
+	channels &= 0x0f;
+	while(channels) {
+		nb += channels & 1;
+		channels >>= 1;
+	}
+	return nb;
+}
+
+/**
+  * @brief  Init the RLE encoder
+  * @param  rle: RLE encoder state
+  * @param  sample_bytes: bytes per sample (see sump_sample_bytes())
+  * @retval None
+  */
+/*
+ * With RLE enabled the MSB of the packed sample marks a count word, so the
+ * last channel of the enabled groups is not available.
+*/
+void sump_rle_init(sump_rle_t *rle, uint8_t sample_bytes)
+{
+	rle->count_flag = 1UL << (sample_bytes * 8 - 1);
+	rle->max_count = rle->count_flag - 1;
+	rle->length = 0;
+	rle->value = 0;
+}
+
+/* Emit the current run, in reverse order (count then value) */
+static uint32_t rle_emit(sump_rle_t *rle, uint32_t *out)
+{
+	uint32_t nb = 0;
+
+	if(rle->length > 1) {
+		out[nb++] = rle->count_flag | (rle->length - 1);
+	}
+	out[nb++] = rle->value;
+	return nb;
+}
+
+/**
+  * @brief  Push a packed sample to the RLE encoder
+  * @param  rle: RLE encoder state
+  * @param  sample: packed sample
+  * @param  out: output words (at least 2)
+  * @retval Number of words written to out
+  */
+/*
+ * SUMP sends samples from the newest to the oldest, so samples are pushed in
+ * that order and each run is emitted as its count word followed by its value.
+ * Read in reverse, the stream is a regular RLE stream where a count word gives
+ * the number of repetitions of the previous sample.
+*/
+uint32_t sump_rle_push(sump_rle_t *rle, uint32_t sample, uint32_t *out)
+{
+	uint32_t nb = 0;
+
+	sample &= rle->max_count;
+	if(rle->length > 0) {
+		if(sample == rle->value && rle->length <= rle->max_count) {
+			rle->length++;
+			return 0;
+		}
+		nb = rle_emit(rle, out);
+	}
+	rle->value = sample;
+	rle->length = 1;
+	return nb;
+}
+
+/**
+  * @brief  Flush the current run of the RLE encoder
+  * @param  rle: RLE encoder state
+  * @param  out: output words (at least 2)
+  * @retval Number of words written to out
+  */
+uint32_t sump_rle_flush(sump_rle_t *rle, uint32_t *out)
+{
+	uint32_t nb = 0;
+
+	if(rle->length > 0) {
+		nb = rle_emit(rle, out);
+	}
+	rle->length = 0;
+	return nb;
+}
+
+/**
+  * @brief  Init the readout of a capture
+  * @param  reader: readout state
+  * @param  config: SUMP configuration (read_count, flags, channels)
+  * @param  ring: capture ring
+  * @param  nb_states: capture ring size (power of 2)
+  * @param  end: index following the newest sample
+  * @param  nb_valid: number of captured samples before end
+  * @retval None
+  */
+/*
+ * When less than read_count samples were captured (trigger fired before the
+ * ring was filled) the oldest captured sample is repeated up to read_count.
+*/
+void sump_reader_init(sump_reader_t *reader, const sump_config_t *config,
+		      const uint16_t *ring, uint32_t nb_states, uint32_t end,
+		      uint32_t nb_valid)
+{
+	reader->ring = ring;
+	reader->mask = nb_states - 1;
+	reader->index = end;
+	reader->samples = nb_valid < nb_states ? nb_valid : nb_states;
+	reader->remaining = config->read_count;
+	reader->pad = 0;
+	reader->has_pending = 0;
+	reader->channels = config->channels;
+	reader->sample_bytes = sump_sample_bytes(config->channels);
+	reader->rle_enabled = (config->flags & SUMP_FLAG_RLE) ? 1 : 0;
+	if(reader->sample_bytes == 0) {
+		reader->remaining = 0;
+	}
+	if(reader->rle_enabled) {
+		sump_rle_init(&reader->rle, reader->sample_bytes);
+	}
+}
+
+static uint32_t reader_fill_rle(sump_reader_t *reader, uint8_t *out, uint32_t size)
+{
+	const uint8_t sample_bytes = reader->sample_bytes;
+	uint32_t words[2];
+	uint32_t word, nb, i;
+	uint32_t len = 0;
+
+	while(reader->remaining > 0 && size - len >= sample_bytes) {
+		if(reader->has_pending) {
+			word = reader->pending;
+			reader->has_pending = 0;
+		} else {
+			if(reader->samples > 0) {
+				reader->samples--;
+				reader->index = (reader->index - 1) & reader->mask;
+				nb = sump_rle_push(&reader->rle,
+						   sump_sample_pack(reader->ring[reader->index],
+								    reader->channels),
+						   words);
+				if(nb == 0) {
+					continue;
+				}
+			} else {
+				/* Last run, then the oldest value as padding */
+				nb = sump_rle_flush(&reader->rle, words);
+				if(nb == 0) {
+					words[0] = reader->rle.value;
+					nb = 1;
+				}
+			}
+			if(nb > reader->remaining) {
+				/* Do not send a count word without its value */
+				words[0] = words[1];
+				nb = 1;
+			}
+			word = words[0];
+			if(nb > 1) {
+				reader->pending = words[1];
+				reader->has_pending = 1;
+			}
+		}
+		for(i = 0; i < sample_bytes; i++) {
+			out[len++] = word;
+			word >>= 8;
+		}
+		reader->remaining--;
+	}
+	return len;
+}
+
+/**
+  * @brief  Fill a buffer with the next words of a capture
+  * @param  reader: readout state
+  * @param  out: output buffer
+  * @param  size: output buffer size in bytes
+  * @retval Number of bytes written, 0 when the readout is complete
+  */
+/*
+ * Samples are sent from the newest to the oldest one, each word is
+ * sample_bytes long (LSB first).
+*/
+uint32_t sump_reader_fill(sump_reader_t *reader, uint8_t *out, uint32_t size)
+{
+	const uint16_t *ring = reader->ring;
+	const uint32_t mask = reader->mask;
+	uint32_t index = reader->index;
+	uint32_t nb, nb_read, i, j, word;
+	uint16_t sample;
+
+	if(reader->rle_enabled) {
+		return reader_fill_rle(reader, out, size);
+	}
+
+	nb = size / reader->sample_bytes;
+	if(nb > reader->remaining) {
+		nb = reader->remaining;
+	}
+	reader->remaining -= nb;
+	nb_read = nb;
+	if(nb_read > reader->samples) {
+		nb_read = reader->samples;
+	}
+	reader->samples -= nb_read;
+
+	switch(reader->sample_bytes) {
+	case 1:
+		if((reader->channels & 0x03) == 2) {
+			for(i = 0; i < nb_read; i++) {
+				index = (index - 1) & mask;
+				out[i] = ring[index] >> 8;
+			}
+		} else if(reader->channels & 0x01) {
+			for(i = 0; i < nb_read; i++) {
+				index = (index - 1) & mask;
+				out[i] = ring[index];
+			}
+		} else {
+			for(i = 0; i < nb_read; i++) {
+				out[i] = 0;
+			}
+			index = (index - nb_read) & mask;
+		}
+		break;
+	case 2:
+		if((reader->channels & 0x03) == 3) {
+			for(i = 0; i < nb_read; i++) {
+				index = (index - 1) & mask;
+				sample = ring[index];
+				out[2*i] = sample;
+				out[2*i+1] = sample >> 8;
+			}
+			break;
+		}
+	/* fall through */
+	default:
+		for(i = 0; i < nb_read; i++) {
+			index = (index - 1) & mask;
+			word = sump_sample_pack(ring[index], reader->channels);
+			for(j = 0; j < reader->sample_bytes; j++) {
+				out[i * reader->sample_bytes + j] = word;
+				word >>= 8;
+			}
+		}
+		break;
+	}
+	reader->index = index;
+
+	if(nb_read > 0) {
+		reader->pad = sump_sample_pack(ring[index], reader->channels);
+	}
+	for(i = nb_read; i < nb; i++) {
+		word = reader->pad;
+		for(j = 0; j < reader->sample_bytes; j++) {
+			out[i * reader->sample_bytes + j] = word;
+			word >>= 8;
+		}
+	}
+	return nb * reader->sample_bytes;
+}
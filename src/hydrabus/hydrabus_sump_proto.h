@@ -0,0 +1,140 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2015-2020 Nicolas OBERLI
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * SUMP protocol helpers (command parser, sample packing, RLE encoder,
+ * readout).
+ * This file does not depend on ChibiOS nor on the HAL.
+ */
+
+#ifndef _HYDRABUS_SUMP_PROTO_H_
+#define _HYDRABUS_SUMP_PROTO_H_
+
+#include <stdint.h>
+#include "mode_config.h"
+
+#define SUMP_RESET	0x00
+#define SUMP_RUN	0x01
+#define SUMP_ID		0x02
+#define SUMP_DESC	0x04
+#define SUMP_XON	0x11
+#define SUMP_XOFF	0x13
+#define SUMP_DIV	0x80
+#define SUMP_CNT	0x81
+#define SUMP_FLAGS	0x82
+#define SUMP_TRIG_1	0xc0
+#define SUMP_TRIG_2	0xc4
+#define SUMP_TRIG_3	0xc8
+#define SUMP_TRIG_4	0xcc
+#define SUMP_TRIG_VALS_1  0xc1
+#define SUMP_TRIG_VALS_2  0xc5
+#define SUMP_TRIG_VALS_3  0xc9
+#define SUMP_TRIG_VALS_4  0xcd
+#define SUMP_TRIG_CONF_1  0xc2
+#define SUMP_TRIG_CONF_2  0xc6
+#define SUMP_TRIG_CONF_3  0xca
+#define SUMP_TRIG_CONF_4  0xce
+
+#define SUMP_STATE_IDLE		0
+#define SUMP_STATE_ARMED	1
+#define SUMP_STATE_RUNNNING	2
+#define SUMP_STATE_TRIGGED	3
+
+/* Reference clock used by SUMP clients to compute the divider */
+#define SUMP_BASE_CLOCK		(100000000)
+/* Maximum sample rate supported by the DMA capture */
+#define SUMP_MAX_SAMPLE_RATE	(10000000)
+
+/* SUMP_FLAGS bits */
+#define SUMP_FLAG_DEMUX		(1 << 0)
+#define SUMP_FLAG_FILTER	(1 << 1)
+#define SUMP_FLAG_GROUPS_SHIFT	(2)
+#define SUMP_FLAG_EXTERNAL	(1 << 6)
+#define SUMP_FLAG_INVERTED	(1 << 7)
+#define SUMP_FLAG_RLE		(1 << 8)
+
+/* SUMP_TRIG_CONF_x bits */
+#define SUMP_TRIG_CONF_DELAY(conf)	((conf) & 0xffff)
+#define SUMP_TRIG_CONF_LEVEL(conf)	(((conf) >> 16) & 0x03)
+#define SUMP_TRIG_CONF_CHANNEL(conf)	(((conf) >> 20) & 0x1f)
+#define SUMP_TRIG_CONF_SERIAL		(1UL << 26)
+#define SUMP_TRIG_CONF_START		(1UL << 27)
+
+/* sump_proto_set_param() return flags */
+#define SUMP_PARAM_DIVIDER	(1 << 0)
+
+/* Returns non zero if command is followed by 4 bytes of parameters */
+#define sump_proto_is_long_cmd(cmd) ((cmd) & 0x80)
+
+typedef struct {
+	uint32_t value;		/* Current run packed sample */
+	uint32_t length;	/* Current run length (0 if no run) */
+	uint32_t max_count;	/* Maximum value of a count word */
+	uint32_t count_flag;	/* Count word marker (sample MSB) */
+} sump_rle_t;
+
+typedef struct {
+	const uint16_t *ring;	/* Capture ring */
+	uint32_t mask;		/* Capture ring size - 1 */
+	uint32_t index;		/* Index following the next sample to send */
+	uint32_t samples;	/* Number of captured samples left to read */
+	uint32_t remaining;	/* Number of words left to send */
+	uint32_t pad;		/* Word sent once the captured samples are read */
+	uint32_t pending;	/* RLE value word waiting for room */
+	uint8_t has_pending;
+	uint8_t channels;
+	uint8_t sample_bytes;	/* Bytes per word (one per enabled group) */
+	uint8_t rle_enabled;
+	sump_rle_t rle;
+} sump_reader_t;
+
+void sump_proto_reset(sump_config_t *config);
+uint32_t sump_proto_set_param(sump_config_t *config, uint8_t command,
+			      const uint8_t *param);
+uint32_t sump_proto_get_period(const sump_config_t *config, uint32_t timer_freq);
+
+/*
+ * Packs a raw 16 channels sample according to the enabled groups
+ * (group 0 is PC0-PC7, group 1 is PC8-PC15, groups 2 & 3 are always 0).
+ */
+static inline uint32_t sump_sample_pack(uint16_t sample, uint8_t channels)
+{
+	switch(channels & 0x03) {
+	case 1:
+		return sample & 0xff;
+	case 2:
+		return sample >> 8;
+	case 3:
+		return sample;
+	default:
+		return 0;
+	}
+}
+
+uint8_t sump_sample_bytes(uint8_t channels);
+
+void sump_rle_init(sump_rle_t *rle, uint8_t sample_bytes);
+uint32_t sump_rle_push(sump_rle_t *rle, uint32_t sample, uint32_t *out);
+uint32_t sump_rle_flush(sump_rle_t *rle, uint32_t *out);
+
+void sump_reader_init(sump_reader_t *reader, const sump_config_t *config,
+		      const uint16_t *ring, uint32_t nb_states, uint32_t end,
+		      uint32_t nb_valid);
+uint32_t sump_reader_fill(sump_reader_t *reader, uint8_t *out, uint32_t size);
+
+#endif /* _HYDRABUS_SUMP_PROTO_H_ */
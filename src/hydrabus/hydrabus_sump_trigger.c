@@ -0,0 +1,220 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2015-2020 Nicolas OBERLI
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "hydrabus_sump_proto.h"
+#include "hydrabus_sump_trigger.h"
+
+/*
+ * Trigger stages follow the SUMP/OLS semantics:
+ * - a stage is armed when the current level is at least the stage level
+ * - an armed stage matches when (input ^ value) & mask == 0, input is the
+ *   sample (parallel mode) or the last 32 bits seen on the stage channel
+ *   (serial mode)
+ * - delay samples after a match, a start stage starts the capture, any other
+ *   stage increments the level
+ * - each stage matches only once
+ * - without any start stage the capture starts immediately
+ * Stages are precomputed in a compact list of the stages which did not match
+ * yet, so evaluation cost only depends on the number of remaining stages.
+ * Level stages which cannot arm any start stage are dropped, so a single
+ * start stage runs the same loop as a plain parallel trigger.
+ */
+
+/* Recompute fast path flag, after a change of level or of live stages */
+static void trigger_update(sump_trigger_t *trig)
+{
+	sump_trigger_stage_t *stage = &trig->live[0];
+
+	trig->fast = (trig->nb_live == 1 && trig->nb_pending == 0 &&
+		      trig->nb_serial == 0 && stage->start &&
+		      stage->delay == 0 && stage->level <= trig->level);
+}
+
+/**
+  * @brief  Compile the SUMP trigger configuration
+  * @param  trig: trigger state
+  * @param  config: SUMP configuration
+  * @retval None
+  */
+void sump_trigger_init(sump_trigger_t *trig, const sump_config_t *config)
+{
+	sump_trigger_stage_t *stage;
+	uint32_t conf;
+	uint8_t i, max_start_level, nb_start;
+
+	trig->nb_live = 0;
+	trig->nb_pending = 0;
+	trig->nb_serial = 0;
+	trig->level = 0;
+	trig->fired = 0;
+
+	max_start_level = 0;
+	nb_start = 0;
+	for(i = 0; i < SUMP_TRIGGER_STAGES; i++) {
+		conf = config->trigger_configs[i];
+		if(!(conf & SUMP_TRIG_CONF_START)) {
+			continue;
+		}
+		nb_start++;
+		if(SUMP_TRIG_CONF_LEVEL(conf) > max_start_level) {
+			max_start_level = SUMP_TRIG_CONF_LEVEL(conf);
+		}
+	}
+
+	for(i = 0; i < SUMP_TRIGGER_STAGES; i++) {
+		conf = config->trigger_configs[i];
+		if(!(conf & SUMP_TRIG_CONF_START) &&
+		   SUMP_TRIG_CONF_LEVEL(conf) >= max_start_level) {
+			continue;
+		}
+		stage = &trig->live[trig->nb_live++];
+		stage->mask = config->trigger_masks[i];
+		stage->value = config->trigger_values[i] & stage->mask;
+		stage->shift = 0;
+		stage->delay = SUMP_TRIG_CONF_DELAY(conf);
+		stage->level = SUMP_TRIG_CONF_LEVEL(conf);
+		stage->channel = SUMP_TRIG_CONF_CHANNEL(conf);
+		stage->serial = (conf & SUMP_TRIG_CONF_SERIAL) ? 1 : 0;
+		stage->start = (conf & SUMP_TRIG_CONF_START) ? 1 : 0;
+		if(stage->serial) {
+			trig->nb_serial++;
+		}
+	}
+	if(nb_start == 0) {
+		trig->fired = 1;
+	}
+	trigger_update(trig);
+}
+
+/* Stage action once its delay is elapsed */
+static void trigger_action(sump_trigger_t *trig, uint8_t start)
+{
+	if(start) {
+		trig->fired = 1;
+	} else {
+		trig->level++;
+	}
+}
+
+/* Remove live stage i which just matched */
+static void trigger_match(sump_trigger_t *trig, uint8_t i)
+{
+	sump_trigger_stage_t *stage = &trig->live[i];
+	sump_trigger_delay_t *pending;
+
+	if(stage->delay == 0) {
+		trigger_action(trig, stage->start);
+	} else {
+		pending = &trig->pending[trig->nb_pending++];
+		pending->count = stage->delay;
+		pending->start = stage->start;
+	}
+	if(stage->serial) {
+		trig->nb_serial--;
+	}
+	trig->nb_live--;
+	trig->live[i] = trig->live[trig->nb_live];
+}
+
+/* Evaluate all stages for one sample, returns 1 when capture shall start */
+static uint8_t trigger_step(sump_trigger_t *trig, uint32_t sample)
+{
+	sump_trigger_stage_t *stage;
+	uint32_t input;
+	uint8_t i, level;
+
+	/* Delays of stages matched on previous samples */
+	for(i = 0; i < trig->nb_pending; ) {
+		if(--trig->pending[i].count == 0) {
+			trigger_action(trig, trig->pending[i].start);
+			trig->nb_pending--;
+			trig->pending[i] = trig->pending[trig->nb_pending];
+		} else {
+			i++;
+		}
+	}
+
+	/* Stages are evaluated at the level reached before this sample */
+	level = trig->level;
+	for(i = 0; i < trig->nb_live; ) {
+		stage = &trig->live[i];
+		if(stage->serial) {
+			stage->shift = (stage->shift << 1) |
+				       ((sample >> stage->channel) & 1);
+			input = stage->shift;
+		} else {
+			input = sample;
+		}
+		if(stage->level <= level &&
+		   !((input ^ stage->value) & stage->mask)) {
+			trigger_match(trig, i);
+		} else {
+			i++;
+		}
+	}
+	return trig->fired;
+}
+
+/**
+  * @brief  Evaluate trigger on new samples of the capture ring
+  * @param  trig: trigger state
+  * @param  ring: capture ring
+  * @param  ring_mask: capture ring size - 1
+  * @param  index: index of the first sample to evaluate
+  * @param  end: index following the last sample to evaluate
+  * @retval Index of the sample which starts the capture if trig->fired is
+  *         set (index if it was already set), else end
+  */
+uint32_t sump_trigger_process(sump_trigger_t *trig, const uint16_t *ring,
+			      uint32_t ring_mask, uint32_t index, uint32_t end)
+{
+	uint32_t mask, value;
+	uint8_t nb_live, nb_pending, level;
+
+	if(trig->fired) {
+		return index;
+	}
+	while(index != end) {
+		if(trig->fast) {
+			/* Same cost as a single parallel trigger */
+			mask = trig->live[0].mask;
+			value = trig->live[0].value;
+			while(index != end) {
+				if(!((ring[index] ^ value) & mask)) {
+					trig->fired = 1;
+					return index;
+				}
+				index = (index + 1) & ring_mask;
+			}
+			return end;
+		}
+
+		nb_live = trig->nb_live;
+		nb_pending = trig->nb_pending;
+		level = trig->level;
+		if(trigger_step(trig, ring[index])) {
+			return index;
+		}
+		if(nb_live != trig->nb_live || nb_pending != trig->nb_pending ||
+		   level != trig->level) {
+			trigger_update(trig);
+		}
+		index = (index + 1) & ring_mask;
+	}
+	return end;
+}
@@ -0,0 +1,65 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2015-2020 Nicolas OBERLI
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * SUMP trigger stages evaluation.
+ * This file does not depend on ChibiOS nor on the HAL.
+ */
+
+#ifndef _HYDRABUS_SUMP_TRIGGER_H_
+#define _HYDRABUS_SUMP_TRIGGER_H_
+
+#include <stdint.h>
+#include "mode_config.h"
+
+#define SUMP_TRIGGER_STAGES	(4)
+
+typedef struct {
+	uint32_t mask;
+	uint32_t value;
+	uint32_t shift;		/* Serial mode shift register */
+	uint32_t delay;
+	uint8_t level;
+	uint8_t channel;
+	uint8_t serial;
+	uint8_t start;
+} sump_trigger_stage_t;
+
+typedef struct {
+	uint32_t count;		/* Samples left before action */
+	uint8_t start;
+} sump_trigger_delay_t;
+
+typedef struct {
+	/* Stages which did not match yet */
+	sump_trigger_stage_t live[SUMP_TRIGGER_STAGES];
+	/* Matched stages waiting for their delay */
+	sump_trigger_delay_t pending[SUMP_TRIGGER_STAGES];
+	uint8_t nb_live;
+	uint8_t nb_pending;
+	uint8_t nb_serial;	/* Number of live serial stages */
+	uint8_t level;		/* Current trigger level */
+	uint8_t fast;		/* Single parallel start stage armed */
+	uint8_t fired;
+} sump_trigger_t;
+
+void sump_trigger_init(sump_trigger_t *trig, const sump_config_t *config);
+uint32_t sump_trigger_process(sump_trigger_t *trig, const uint16_t *ring,
+			      uint32_t ring_mask, uint32_t index, uint32_t end);
+
+#endif /* _HYDRABUS_SUMP_TRIGGER_H_ */
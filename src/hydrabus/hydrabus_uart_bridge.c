@@ -0,0 +1,207 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "common.h"
+#include "hydrabus_uart_bridge.h"
+#include <string.h>
+
+/*
+ * The received bytes are written by a circular DMA, the reader thread sleeps
+ * until the half/full ring or idle line interrupt and sends the bytes to
+ * the console in bulk.
+ */
+
+static void uart_bridge_rx_cb(void *arg, uint32_t events)
+{
+	uart_bridge_t *b = (uart_bridge_t *)arg;
+
+	chSysLockFromISR();
+	if(events & BSP_UART_EVENT_HT)
+		b->halves++;
+	if(events & BSP_UART_EVENT_TC)
+		b->halves++;
+	if(!b->irq_pending) {
+		b->irq_time = bsp_get_cyclecounter();
+		b->irq_pending = true;
+	}
+	chBSemSignalI(&b->rx_sem);
+	chSysUnlockFromISR();
+}
+
+static THD_FUNCTION(uart_bridge_rx_thread, arg)
+{
+	uart_bridge_t *b = (uart_bridge_t *)arg;
+	const uint8_t *data;
+	uint32_t len, halves, irq_time, latency;
+	uint64_t time;
+	bool irq_pending;
+
+	chRegSetThreadName("UART reader");
+
+	while(!chThdShouldTerminateX()) {
+		/* The timeout catches a few bytes without idle line */
+		chBSemWaitTimeout(&b->rx_sem, TIME_MS2I(10));
+
+		chSysLock();
+		irq_pending = b->irq_pending;
+		irq_time = b->irq_time;
+		b->irq_pending = false;
+		halves = b->halves;
+		chSysUnlock();
+
+		/* The bytes are stamped with the first interrupt since the last read */
+		time = pcapng_ts_extend(&b->pcap_time, irq_pending ?
+					irq_time : bsp_get_cyclecounter());
+
+		uart_ring_update(&b->ring, halves, bsp_uart_rx_dma_pos(b->dev_num));
+		while((len = uart_ring_get(&b->ring, &data)) > 0) {
+			if(b->pcap != NULL) {
+				pcapng_writer_packet(&b->pcap->writer, PCAPNG_LINK_UART,
+						     time, data, len);
+			}
+			cprint(b->con, (const char *)data, len);
+			uart_ring_consume(&b->ring, len);
+		}
+
+		if(irq_pending) {
+			latency = bsp_get_cyclecounter() - irq_time;
+			if(latency > b->max_latency)
+				b->max_latency = latency;
+		}
+	}
+}
+
+/**
+  * @brief  Start the UART to console direction of the bridge.
+  * @param  con: console
+  * @param  dev_num: UART dev num, already initialized.
+  * @param  pcap: file the received bytes are also written to, or NULL.
+  * @retval bridge state, NULL if the buffers or the DMA are not available.
+  */
+uart_bridge_t *uart_bridge_start(t_hydra_console *con, bsp_dev_uart_t dev_num,
+				 file_pcapng_t *pcap)
+{
+	uart_bridge_t *b;
+
+	b = pool_alloc_bytes(sizeof(uart_bridge_t));
+	if(b == NULL)
+		return NULL;
+	memset(b, 0, sizeof(uart_bridge_t));
+	b->con = con;
+	b->dev_num = dev_num;
+	b->pcap = pcap;
+	b->pcap_time = bsp_get_cyclecounter();
+	b->rx_buf = pool_alloc_bytes(UART_BRIDGE_RX_SIZE);
+	b->tx_buf[0] = pool_alloc_bytes(UART_BRIDGE_TX_SIZE);
+	b->tx_buf[1] = pool_alloc_bytes(UART_BRIDGE_TX_SIZE);
+	if(b->rx_buf == NULL || b->tx_buf[0] == NULL || b->tx_buf[1] == NULL) {
+		uart_bridge_free(b);
+		return NULL;
+	}
+
+	uart_ring_init(&b->ring, b->rx_buf, UART_BRIDGE_RX_SIZE);
+	chBSemObjectInit(&b->rx_sem, TRUE);
+	if(bsp_uart_rx_dma_start(dev_num, b->rx_buf, UART_BRIDGE_RX_SIZE,
+				 uart_bridge_rx_cb, b) != BSP_OK) {
+		uart_bridge_free(b);
+		return NULL;
+	}
+
+	b->thread = chThdCreateFromHeap(NULL, CONSOLE_WA_SIZE, "uart_reader",
+					NORMALPRIO, uart_bridge_rx_thread, b);
+	if(b->thread == NULL) {
+		bsp_uart_rx_dma_stop(dev_num);
+		uart_bridge_free(b);
+		return NULL;
+	}
+
+	return b;
+}
+
+/**
+  * @brief  Send the console data to the UART until the user button is pressed.
+  * @param  b: bridge state
+  * @retval None
+  */
+void uart_bridge_tx(uart_bridge_t *b)
+{
+	uint32_t len, idx = 0;
+
+	while(!hydrabus_ubtn()) {
+		len = chnReadTimeout(b->con->sdu, b->tx_buf[idx],
+				     UART_BRIDGE_TX_SIZE, TIME_US2I(100));
+		if(len == 0)
+			continue;
+
+		/* Previous buffer still being sent */
+		while(bsp_uart_tx_dma_busy(b->dev_num) && !hydrabus_ubtn()) {
+			chThdSleep(TIME_US2I(100));
+		}
+		if(bsp_uart_tx_dma_start(b->dev_num, b->tx_buf[idx], len) != BSP_OK) {
+			bsp_uart_transfer(b->dev_num, b->tx_buf[idx], NULL, len);
+		}
+		b->tx_bytes += len;
+		idx ^= 1;
+	}
+	bsp_uart_tx_dma_stop(b->dev_num);
+}
+
+/**
+  * @brief  Stop the UART to console direction, the statistics are kept.
+  * @param  b: bridge state
+  * @retval None
+  */
+void uart_bridge_stop(uart_bridge_t *b)
+{
+	if(b->thread == NULL)
+		return;
+
+	chThdTerminate(b->thread);
+	chBSemSignal(&b->rx_sem);
+	chThdWait(b->thread);
+	b->thread = NULL;
+	bsp_uart_rx_dma_stop(b->dev_num);
+}
+
+/**
+  * @brief  Stop the bridge and free its state.
+  * @param  b: bridge state
+  * @retval None
+  */
+void uart_bridge_free(uart_bridge_t *b)
+{
+	uart_bridge_stop(b);
+	pool_free(b->rx_buf);
+	pool_free(b->tx_buf[0]);
+	pool_free(b->tx_buf[1]);
+	pool_free(b);
+}
+
+/**
+  * @brief  Print the flow statistics of the bridge.
+  * @param  con: console
+  * @param  b: bridge state
+  * @retval None
+  */
+void uart_bridge_print_stats(t_hydra_console *con, uart_bridge_t *b)
+{
+	cprintf(con, "RX: %d bytes, %d lost (%d overruns), max %d bytes pending, max latency %dus\r\n",
+		b->ring.received, b->ring.lost, b->ring.overruns,
+		b->ring.max_fill, b->max_latency / (STM32_HCLK / 1000000));
+	cprintf(con, "TX: %d bytes\r\n", b->tx_bytes);
+}
@@ -0,0 +1,62 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _HYDRABUS_UART_BRIDGE_H_
+#define _HYDRABUS_UART_BRIDGE_H_
+
+#include "common.h"
+#include "bsp_uart.h"
+#include "hydrabus_uart_ring.h"
+#include "microsd.h"
+
+#define UART_BRIDGE_RX_SIZE	(0x1000) /* Power of 2 */
+#define UART_BRIDGE_TX_SIZE	(0x100)
+/* pcapng writer buffer, holds a full RX ring */
+#define UART_BRIDGE_PCAP_SIZE	(0x2000)
+
+typedef struct {
+	t_hydra_console *con;
+	bsp_dev_uart_t dev_num;
+	thread_t *thread;
+
+	/* UART -> console, ring written by the circular DMA */
+	uint8_t *rx_buf;
+	uart_ring_t ring;
+	binary_semaphore_t rx_sem;
+	volatile uint32_t halves;
+	volatile uint32_t irq_time;
+	volatile bool irq_pending;
+	uint32_t max_latency; /* Cycles from the interrupt to the console */
+
+	/* Received bytes also written to a pcapng file, NULL if not */
+	file_pcapng_t *pcap;
+	uint64_t pcap_time; /* Extended cycle counter */
+
+	/* Console -> UART, sent by DMA from one buffer while the other is filled */
+	uint8_t *tx_buf[2];
+	uint32_t tx_bytes;
+} uart_bridge_t;
+
+uart_bridge_t *uart_bridge_start(t_hydra_console *con, bsp_dev_uart_t dev_num,
+				 file_pcapng_t *pcap);
+void uart_bridge_tx(uart_bridge_t *b);
+void uart_bridge_stop(uart_bridge_t *b);
+void uart_bridge_free(uart_bridge_t *b);
+void uart_bridge_print_stats(t_hydra_console *con, uart_bridge_t *b);
+
+#endif /* _HYDRABUS_UART_BRIDGE_H_ */
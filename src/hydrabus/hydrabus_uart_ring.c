@@ -0,0 +1,105 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "hydrabus_uart_ring.h"
+
+/**
+  * @brief  Init the ring reader
+  * @param  r: ring reader
+  * @param  buf: ring written by the DMA
+  * @param  size: size of the ring, power of 2
+  * @retval None
+  */
+void uart_ring_init(uart_ring_t *r, const uint8_t *buf, uint32_t size)
+{
+	r->buf = buf;
+	r->size = size;
+	r->wr = 0;
+	r->rd = 0;
+	r->received = 0;
+	r->lost = 0;
+	r->overruns = 0;
+	r->max_fill = 0;
+}
+
+/**
+  * @brief  Update the write count from the DMA state
+  * @param  r: ring reader
+  * @param  halves: number of half and full transfer interrupts since the
+  *         start, read before pos
+  * @param  pos: DMA write position in the ring (size - remaining count)
+  * @retval None
+  */
+/*
+ * halves gives the last half ring boundary crossed by the DMA, pos the
+ * offset from it. pos may already be past the next boundary if its
+ * interrupt is pending, which is fine as long as the interrupt is not
+ * late by more than half a ring.
+ */
+void uart_ring_update(uart_ring_t *r, uint32_t halves, uint32_t pos)
+{
+	const uint32_t half = r->size / 2;
+	uint32_t base, wr, fill;
+
+	base = halves * half;
+	wr = base + ((pos - base) & (r->size - 1));
+	if((int32_t)(wr - r->wr) <= 0)
+		return;
+
+	r->received += wr - r->wr;
+	r->wr = wr;
+
+	fill = r->wr - r->rd;
+	if(fill > r->size) {
+		/* The oldest bytes were overwritten, drop the whole ring */
+		r->lost += fill;
+		r->overruns++;
+		r->rd = r->wr;
+		fill = 0;
+	}
+	if(fill > r->max_fill)
+		r->max_fill = fill;
+}
+
+/**
+  * @brief  Get the contiguous bytes available in the ring
+  * @param  r: ring reader
+  * @param  data: set to the first byte
+  * @retval number of bytes
+  */
+uint32_t uart_ring_get(uart_ring_t *r, const uint8_t **data)
+{
+	uint32_t rd = r->rd & (r->size - 1);
+	uint32_t len = r->wr - r->rd;
+
+	if(len > r->size - rd)
+		len = r->size - rd;
+	*data = &r->buf[rd];
+	return len;
+}
+
+/**
+  * @brief  Remove read bytes from the ring
+  * @param  r: ring reader
+  * @param  len: number of bytes read
+  * @retval None
+  */
+void uart_ring_consume(uart_ring_t *r, uint32_t len)
+{
+	r->rd += len;
+}
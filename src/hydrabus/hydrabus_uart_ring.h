@@ -0,0 +1,51 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Reader of a receive ring written by a circular DMA.
+ * The DMA position alone does not tell how many times the ring wrapped, so
+ * the half and full transfer interrupts are counted ("halves") and both
+ * are combined into a free running write count, which detects the data
+ * overwritten before being read.
+ * This file does not depend on ChibiOS nor on the HAL.
+ */
+
+#ifndef _HYDRABUS_UART_RING_H_
+#define _HYDRABUS_UART_RING_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct {
+	const uint8_t *buf;
+	uint32_t size; /* Power of 2 */
+	uint32_t wr; /* Free running */
+	uint32_t rd; /* Free running */
+
+	uint32_t received;
+	uint32_t lost; /* Bytes overwritten before being read */
+	uint32_t overruns;
+	uint32_t max_fill;
+} uart_ring_t;
+
+void uart_ring_init(uart_ring_t *r, const uint8_t *buf, uint32_t size);
+void uart_ring_update(uart_ring_t *r, uint32_t halves, uint32_t pos);
+uint32_t uart_ring_get(uart_ring_t *r, const uint8_t **data);
+void uart_ring_consume(uart_ring_t *r, uint32_t len);
+
+#endif /* _HYDRABUS_UART_RING_H_ */
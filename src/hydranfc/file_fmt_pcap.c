@@ -61,7 +61,7 @@ int file_fmt_create_pcap(FIL *file_handle)
 
 	for (i = 0; i < 999; i++) {
 
-		sprintf(write_filename.filename, "0:nfc_sniff_%ld.pcap", i);
+		sprintf(write_filename.filename, "0:nfc_sniff_%ld.pcapng", i);
 
 		err = f_open(file_handle, write_filename.filename,
 		FA_WRITE | FA_CREATE_NEW);
@@ -116,115 +116,6 @@ int file_fmt_flush_close(FIL *file_handle, uint8_t* buffer, uint32_t size)
 	return 0;
 }
 
-__attribute__ ((always_inline)) inline
-void sniff_write_pcap_global_header() /*MSB*/
-{
-    uint32_t i;
-    i = nfc_sniffer_index;
-
-    //magic_number nsecond resolution
-    nfc_sniffer_buffer[i+0] = 0xa1;
-    nfc_sniffer_buffer[i+1] = 0xb2;
-    nfc_sniffer_buffer[i+2] = 0x3c;
-    nfc_sniffer_buffer[i+3] = 0x4d;
-
-    //version_major
-    nfc_sniffer_buffer[i+4] = 0x0;
-    nfc_sniffer_buffer[i+5] = 0x2;
-
-    //version_minor
-    nfc_sniffer_buffer[i+6] = 0x0;
-    nfc_sniffer_buffer[i+7] = 0x4;
-
-    //thiszone
-    nfc_sniffer_buffer[i+8] = 0x0;
-    nfc_sniffer_buffer[i+9] = 0x0;
-    nfc_sniffer_buffer[i+10] = 0x0;
-    nfc_sniffer_buffer[i+11] = 0x0;
-
-    //sigfigs
-    nfc_sniffer_buffer[i+12] = 0x0;
-    nfc_sniffer_buffer[i+13] = 0x0;
-    nfc_sniffer_buffer[i+14] = 0x0;
-    nfc_sniffer_buffer[i+15] = 0x0;
-
-    //snaplen
-    nfc_sniffer_buffer[i+16] = 0x00;
-    nfc_sniffer_buffer[i+17] = 0x00;
-    nfc_sniffer_buffer[i+18] = 0xff;
-    nfc_sniffer_buffer[i+19] = 0xff;
-
-    //linktype
-    nfc_sniffer_buffer[i+20] = 0x0;
-    nfc_sniffer_buffer[i+21] = 0x0;
-    nfc_sniffer_buffer[i+22] = 0x0;
-    nfc_sniffer_buffer[i+23] = 0x93; /*(0x93=>0xa2)  private use*/
-
-    nfc_sniffer_index +=24;
-}
-
-__attribute__ ((always_inline)) inline
-void sniff_write_pcap_packet_header(uint32_t nb_cycles_start) /*MSB*/
-{
-    uint32_t i;
-	i = nfc_sniffer_index;
-
-    uint32_t second, nsecond, data_size;
-    uint8_t val;
-
-    second = nb_cycles_start/168000000;
-    nsecond = (nb_cycles_start % 168000000)/168 *1000;
-
-    //ts-sec
-    //Epoch time:555d03e0 = 05/21/2015 00:00:00
-    val = ((second & 0xFF000000) >> 24);
-    nfc_sniffer_buffer[i+0] = 0x55 + val;
-    val = ((second & 0x00FF0000) >> 16);
-    nfc_sniffer_buffer[i+1] = 0x5d + val;
-    val = ((second & 0x0000FF00) >> 8);
-    nfc_sniffer_buffer[i+2] = 0x03 + val;
-    val = (second & 0x000000FF);
-    nfc_sniffer_buffer[i+3] = 0xe0 + val;
-
-    //ts-nsec
-    val = ((nsecond & 0xFF000000) >> 24);
-    nfc_sniffer_buffer[i+4] = val;
-    val = ((nsecond & 0x00FF0000) >> 16);
-    nfc_sniffer_buffer[i+5] = val;
-    val = ((nsecond & 0x0000FF00) >> 8);
-    nfc_sniffer_buffer[i+6] = val;
-    val = (nsecond & 0x000000FF);
-    nfc_sniffer_buffer[i+7] = val;
-
-    //data size
-    if (tmp_sniffer_get_size() == 0) /*for ISO 7816*/
-        {
-            data_size = tmp_sniffer_get_size()+9;
-        }
-    else
-    data_size = tmp_sniffer_get_size()+8; /*8 = header packet size*/
-
-    val = ((data_size & 0xFF000000) >> 24);
-    nfc_sniffer_buffer[i+8] = val;
-    val = ((data_size & 0x00FF0000) >> 16);
-    nfc_sniffer_buffer[i+9] = val;
-    val = ((data_size & 0x0000FF00) >> 8);
-    nfc_sniffer_buffer[i+10] = val;
-    val = (data_size & 0x000000FF);
-    nfc_sniffer_buffer[i+11] = val;
-
-    val = ((data_size & 0xFF000000) >> 24);
-    nfc_sniffer_buffer[i+12] = val;
-    val = ((data_size & 0x00FF0000) >> 16);
-    nfc_sniffer_buffer[i+13] = val;
-    val = ((data_size & 0x0000FF00) >> 8);
-    nfc_sniffer_buffer[i+14] = val;
-    val = (data_size & 0x000000FF);
-    nfc_sniffer_buffer[i+15] = val;
-
-    nfc_sniffer_index +=16;
-}
-
 __attribute__ ((always_inline)) inline
 void sniff_write_data_header (uint8_t pow, uint32_t protocol, uint32_t speed, uint32_t nb_cycles_end, uint32_t parity)
 {
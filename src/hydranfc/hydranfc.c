@@ -289,7 +289,7 @@ THD_FUNCTION(key_sniff, arg)
 			}
 
 			D2_ON;
-			hydranfc_sniff_14443A(NULL, TRUE, FALSE, FALSE, FALSE);
+			hydranfc_sniff_14443A(NULL, TRUE, FALSE, FALSE, SNIFF_FORMAT_TEXT);
 			D2_OFF;
 		}
 
@@ -835,6 +835,8 @@ static int exec(t_hydra_console *con, t_tokenline_parsed *p, int token_pos)
 	bool sniff_frame_time;
 	bool sniff_parity;
 	bool sniff_pcap_output;
+	bool sniff_record_output;
+	bool sniff_typeb;
 
 	if(p->tokens[token_pos] == T_SD)
 	{
@@ -851,6 +853,8 @@ static int exec(t_hydra_console *con, t_tokenline_parsed *p, int token_pos)
 	sniff_frame_time = FALSE;
 	sniff_parity = FALSE;
 	sniff_pcap_output = FALSE;
+	sniff_record_output = FALSE;
+	sniff_typeb = FALSE;
 	action = 0;
 	period = 1000;
 	continuous = FALSE;
@@ -865,6 +869,10 @@ static int exec(t_hydra_console *con, t_tokenline_parsed *p, int token_pos)
 			proto->config.hydranfc.dev_function = NFC_TYPEA;
 			break;
 
+		case T_TYPEB:
+			sniff_typeb = TRUE;
+			break;
+
 		case T_VICINITY:
 			proto->config.hydranfc.dev_function = NFC_VICINITY;
 			break;
@@ -938,6 +946,9 @@ static int exec(t_hydra_console *con, t_tokenline_parsed *p, int token_pos)
 		case T_PCAP:
 			sniff_pcap_output = TRUE;
 			break;
+		case T_RECORD:
+			sniff_record_output = TRUE;
+			break;
 		}
 	}
 
@@ -981,7 +992,12 @@ static int exec(t_hydra_console *con, t_tokenline_parsed *p, int token_pos)
 		break;
 
 	case T_SNIFF:
-		if(sniff_bin)
+		if(sniff_typeb && !sniff_raw)
+		{
+			if(sniff_bin || sniff_trace_uart1 || sniff_pcap_output || sniff_record_output)
+				cprintf(con, "TypeB sniffer saves text output only, options ignored\r\n");
+			hydranfc_sniff_14443B(con);
+		}else if(sniff_bin)
 		{
 			if(sniff_raw)
 			{
@@ -1005,13 +1021,15 @@ static int exec(t_hydra_console *con, t_tokenline_parsed *p, int token_pos)
 				{
 					if(sniff_frame_time)
 						cprintf(con, "frame-time disabled for trace-uart1 in ASCII\r\n");
-					hydranfc_sniff_14443A(con, FALSE, FALSE, TRUE, FALSE);
+					hydranfc_sniff_14443A(con, FALSE, FALSE, TRUE, SNIFF_FORMAT_TEXT);
 				}else
 				{
 					if(sniff_pcap_output)
-						hydranfc_sniff_14443A(con, sniff_frame_time, sniff_frame_time, FALSE, TRUE);
+						hydranfc_sniff_14443A(con, sniff_frame_time, sniff_frame_time, FALSE, SNIFF_FORMAT_PCAP);
+					else if(sniff_record_output)
+						hydranfc_sniff_14443A(con, sniff_frame_time, sniff_frame_time, FALSE, SNIFF_FORMAT_RECORD);
 					else
-						hydranfc_sniff_14443A(con, sniff_frame_time, sniff_frame_time, FALSE, FALSE);
+						hydranfc_sniff_14443A(con, sniff_frame_time, sniff_frame_time, FALSE, SNIFF_FORMAT_TEXT);
 				}
 			}
 		}
@@ -71,7 +71,15 @@ void hydranfc_scan_iso14443A(t_hydranfc_scan_iso14443A *data);
 void hydranfc_scan_mifare(t_hydra_console *con);
 void hydranfc_scan_vicinity(t_hydra_console *con);
 
-void hydranfc_sniff_14443A(t_hydra_console *con, bool start_of_frame, bool end_of_frame, bool sniff_trace_uart1, bool sniff_pcap_output);
+/* Output format of hydranfc_sniff_14443A() */
+typedef enum {
+	SNIFF_FORMAT_TEXT = 0,
+	SNIFF_FORMAT_PCAP,
+	SNIFF_FORMAT_RECORD /* See hydranfc_sniff_record.h */
+} sniff_format_t;
+
+void hydranfc_sniff_14443A(t_hydra_console *con, bool start_of_frame, bool end_of_frame, bool sniff_trace_uart1, sniff_format_t sniff_format);
+void hydranfc_sniff_14443B(t_hydra_console *con);
 void hydranfc_sniff_14443A_bin(t_hydra_console *con, bool start_of_frame, bool end_of_frame, bool parity);
 void hydranfc_sniff_14443AB_bin_raw(t_hydra_console *con, bool start_of_frame, bool end_of_frame);
 
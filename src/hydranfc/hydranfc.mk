@@ -1,6 +1,8 @@
 # List of all the hydranfc related files.
 HYDRANFCSRC = hydranfc/hydranfc.c \
               hydranfc/hydranfc_cmd_sniff.c \
+              hydranfc/hydranfc_sniff_writer.c \
+              hydranfc/hydranfc_sniff_14443b.c \
               hydranfc/hydranfc_cmd_sniff_downsampling.c \
               hydranfc/hydranfc_cmd_sniff_iso14443.c \
               hydranfc/hydranfc_emul_14443a_sdd.c \
@@ -9,5 +11,10 @@ HYDRANFCSRC = hydranfc/hydranfc.c \
               hydranfc/hydranfc_emul_mf_ultralight.c \
               hydranfc/hydranfc_bbio_reader.c
 
+# Files without hardware or RTOS dependencies, also built by host.mk
+HYDRANFCHOSTSRC = hydranfc/hydranfc_sniff_14443b.c \
+              hydranfc/hydranfc_cmd_sniff_downsampling.c \
+              hydranfc/hydranfc_cmd_sniff_iso14443.c
+
 # Required include directories
 HYDRANFCINC = ./hydranfc
@@ -33,9 +33,15 @@
 #include "hydranfc.h"
 #include "hydranfc_cmd_sniff_iso14443.h"
 #include "hydranfc_cmd_sniff_downsampling.h"
+#include "hydranfc_sniff_writer.h"
+#include "hydranfc_sniff_record.h"
+#include "hydranfc_sniff_decode.h"
+#include "hydranfc_sniff_text.h"
+#include "hydranfc_sniff_14443b.h"
 
 #include "common.h"
 #include "microsd.h"
+#include "pcapng.h"
 #include "ff.h"
 #include "bsp.h"
 #include "bsp_uart.h"
@@ -55,6 +61,8 @@
 
 // Statistics/debug info on time spent to write data on UART
 //#define STAT_UART_WRITE
+// Statistics/debug info on cycles spent to decode each ISO14443A DMA word
+//#define STAT_DECODE
 
 #define PROTOCOL_OPTIONS_VERSION (0) /* Versions reserved on 3bits BIT0 to BIT2 */
 #define PROTOCOL_OPTIONS_START_OF_FRAME_TIMESTAMP (BIT3) /* Include 32bits start of frame timestamp(1/168MHz increment) at start of each frame */
@@ -118,9 +126,16 @@ static const SPIConfig spi1cfg = {
 };
 
 uint8_t sniff_pcap_output;
+static bool sniff_record_output;
 
 FIL log_file;
 
+/* Frames are saved while sniffing when the output file could be created */
+static sniff_writer_t sniff_writer;
+static bool sniff_streaming;
+/* Frames reaching this index are dropped, see SNIFF_WRITER_MARGIN */
+static uint32_t sniff_capacity;
+
 #define CountLeadingZero(x) (__CLZ(x))
 #define SWAP32(x) (__REV(x))
 
@@ -361,9 +376,32 @@ __attribute__ ((always_inline)) static inline uint32_t WaitGetDMABuffer(void)
   In case of Write Error(No SDCard, Write error or no data) D5 LED blink quickly
   In case of Write OK D5 LED blink quickly
 */
+static void sniff_log_status(bool ok)
+{
+	int i;
+
+	if (ok)
+		tprintf("Sniffed data were successfully saved!\r\n");
+	else
+		tprintf("Sniffed data were not saved!\r\n");
+
+	/* Green LED blink if all is OK, else Red LED blink */
+	for(i=0; i<4; i++) {
+		if (ok)
+			D4_ON;
+		else
+			D5_ON;
+		DelayUs(50000);
+		D4_OFF;
+		D5_OFF;
+		DelayUs(50000);
+	}
+}
+
 void sniff_log(void)
 {
 	int i;
+	bool ok;
 	chSysUnlock();
 	terminate_sniff_nfc();
 	D4_OFF;
@@ -372,7 +410,22 @@ void sniff_log(void)
 //	FIL log_file;
 	tprintf("Logging...\r\n");
 
-	if (sniff_pcap_output) {
+	if (sniff_streaming) {
+		sniff_streaming = FALSE;
+		ok = sniff_writer_stop(&sniff_writer, nfc_sniffer_index);
+		nfc_sniffer_buffer = sniff_writer.half[0];
+		tprintf("%ld bytes saved, %ld frames dropped, max backlog %ld bytes\r\n",
+			sniff_writer.written, sniff_writer.dropped,
+			sniff_writer.backlog_max);
+		sniff_log_status(ok);
+	} else if (sniff_record_output) {
+		ok = file_create(&log_file, "nfc_sniff_", "bin", (char *)&write_filename);
+		if (ok) {
+			ok = file_write(&log_file, sniffer_get_buffer(), sniffer_get_size());
+			ok = file_close(&log_file) && ok;
+		}
+		sniff_log_status(ok);
+	} else if (sniff_pcap_output) {
 		if (file_fmt_flush_close(&log_file, sniffer_get_buffer(),
 				sniffer_get_size())
 				< 0) {
@@ -460,6 +513,16 @@ bool sniff_wait_data_change_or_exit(void)
 			sniff_log();
 			return TRUE;
 		}
+
+		/* No frame in progress, let the SDC interrupts wake up the writer */
+		if (sniff_streaming && sniff_writer_busy(&sniff_writer)) {
+			chSysUnlock();
+			chSysLock();
+		}
+
+		/* Keep the 64 bits pcapng timestamps across CYCCNT wraps */
+		if (sniff_pcap_output)
+			bsp_get_cyclecounter64I();
 	}
 	return FALSE;
 }
@@ -493,71 +556,21 @@ bool sniff_wait_data_change_or_exit_nolog(void)
 __attribute__ ((always_inline)) static inline
 void sniff_write_pcd(void)
 {
-	/* Write output buffer 4 space (data format Miller Modified):
+	/* "RDR" (data format Miller Modified):
 	  It means Reader/Writer (PCD – Proximity Coupling Device)
 	*/
-	uint32_t i, nb_cycles;
-	uint8_t val;
-
-	i = nfc_sniffer_index;
-	nfc_sniffer_buffer[i+0] = '\r';
-	nfc_sniffer_buffer[i+1] = '\n';
-
-	nb_cycles = bsp_get_cyclecounter();
-	val = ((nb_cycles & 0xFF000000) >> 24);
-	nfc_sniffer_buffer[i+2] = htoa[(val & 0xF0) >> 4];
-	nfc_sniffer_buffer[i+3] = htoa[(val & 0x0F)];
-	val = ((nb_cycles & 0x00FF0000) >> 16);
-	nfc_sniffer_buffer[i+4] = htoa[(val & 0xF0) >> 4];
-	nfc_sniffer_buffer[i+5] = htoa[(val & 0x0F)];
-	val = ((nb_cycles & 0x0000FF00) >> 8);
-	nfc_sniffer_buffer[i+6] = htoa[(val & 0xF0) >> 4];
-	nfc_sniffer_buffer[i+7] = htoa[(val & 0x0F)];
-	val = (nb_cycles & 0x000000FF);
-	nfc_sniffer_buffer[i+8] = htoa[(val & 0xF0) >> 4];
-	nfc_sniffer_buffer[i+9] = htoa[(val & 0x0F)];
-	nfc_sniffer_buffer[i+10] = '\t';
-
-	nfc_sniffer_buffer[i+11] = 'R';
-	nfc_sniffer_buffer[i+12] = 'D';
-	nfc_sniffer_buffer[i+13] = 'R';
-	nfc_sniffer_buffer[i+14] = '\t';
-	nfc_sniffer_index +=15;
+	nfc_sniffer_index = sniff_text_start(nfc_sniffer_buffer, nfc_sniffer_index,
+					     bsp_get_cyclecounter(), 'R', 'D', 'R');
 }
 
 __attribute__ ((always_inline)) static inline
 void sniff_write_picc(void)
 {
-	/* Write output buffer "TAG"+1 space (data format Manchester):
+	/* "TAG" (data format Manchester):
 	  It means TAG(PICC – Proximity Integrated Circuit Card)
 	*/
-	uint32_t i, nb_cycles;
-	uint8_t val;
-
-	i = nfc_sniffer_index;
-	nfc_sniffer_buffer[i+0] = '\r';
-	nfc_sniffer_buffer[i+1] = '\n';
-
-	nb_cycles = bsp_get_cyclecounter();
-	val = ((nb_cycles & 0xFF000000) >> 24);
-	nfc_sniffer_buffer[i+2] = htoa[(val & 0xF0) >> 4];
-	nfc_sniffer_buffer[i+3] = htoa[(val & 0x0F)];
-	val = ((nb_cycles & 0x00FF0000) >> 16);
-	nfc_sniffer_buffer[i+4] = htoa[(val & 0xF0) >> 4];
-	nfc_sniffer_buffer[i+5] = htoa[(val & 0x0F)];
-	val = ((nb_cycles & 0x0000FF00) >> 8);
-	nfc_sniffer_buffer[i+6] = htoa[(val & 0xF0) >> 4];
-	nfc_sniffer_buffer[i+7] = htoa[(val & 0x0F)];
-	val = (nb_cycles & 0x000000FF);
-	nfc_sniffer_buffer[i+8] = htoa[(val & 0xF0) >> 4];
-	nfc_sniffer_buffer[i+9] = htoa[(val & 0x0F)];
-	nfc_sniffer_buffer[i+10] = '\t';
-
-	nfc_sniffer_buffer[i+11] = 'T';
-	nfc_sniffer_buffer[i+12] = 'A';
-	nfc_sniffer_buffer[i+13] = 'G';
-	nfc_sniffer_buffer[i+14] = '\t';
-	nfc_sniffer_index +=15;
+	nfc_sniffer_index = sniff_text_start(nfc_sniffer_buffer, nfc_sniffer_index,
+					     bsp_get_cyclecounter(), 'T', 'A', 'G');
 }
 
 __attribute__ ((always_inline)) static inline
@@ -572,75 +585,23 @@ void sniff_write_unknown_protocol(uint8_t data)
 	  data |= (downsample_4x[((f_data&0x0000FF00)>>8)])<<2;
 	  data |= (downsample_4x[(f_data&0x000000FF)]);
 	*/
-	uint32_t i, nb_cycles;
-	uint8_t val;
-
-	i = nfc_sniffer_index;
-	nfc_sniffer_buffer[i+0] = '\r';
-	nfc_sniffer_buffer[i+1] = '\n';
-
-	nb_cycles = bsp_get_cyclecounter();
-	val = ((nb_cycles & 0xFF000000) >> 24);
-	nfc_sniffer_buffer[i+2] = htoa[(val & 0xF0) >> 4];
-	nfc_sniffer_buffer[i+3] = htoa[(val & 0x0F)];
-	val = ((nb_cycles & 0x00FF0000) >> 16);
-	nfc_sniffer_buffer[i+4] = htoa[(val & 0xF0) >> 4];
-	nfc_sniffer_buffer[i+5] = htoa[(val & 0x0F)];
-	val = ((nb_cycles & 0x0000FF00) >> 8);
-	nfc_sniffer_buffer[i+6] = htoa[(val & 0xF0) >> 4];
-	nfc_sniffer_buffer[i+7] = htoa[(val & 0x0F)];
-	val = (nb_cycles & 0x000000FF);
-	nfc_sniffer_buffer[i+8] = htoa[(val & 0xF0) >> 4];
-	nfc_sniffer_buffer[i+9] = htoa[(val & 0x0F)];
-	nfc_sniffer_buffer[i+10] = '\t';
-
-	nfc_sniffer_buffer[i+11] = 'U';
-	nfc_sniffer_buffer[i+12] = htoa[(data & 0xF0) >> 4];
-	nfc_sniffer_buffer[i+13] = htoa[(data & 0x0F)];
-	nfc_sniffer_buffer[i+14] = '\t';
-	nfc_sniffer_index +=15;
+	nfc_sniffer_index = sniff_text_start(nfc_sniffer_buffer, nfc_sniffer_index,
+					     bsp_get_cyclecounter(), 'U',
+					     htoa[(data & 0xF0) >> 4], htoa[(data & 0x0F)]);
 }
 
 __attribute__ ((always_inline)) static inline
 void sniff_write_frameduration(uint32_t timestamp_nb_cycles)
 {
-	uint32_t i, nb_cycles;
-	uint8_t val;
-
-	i = nfc_sniffer_index;
-	nfc_sniffer_buffer[i+0] = '\t';
-
-	nb_cycles = timestamp_nb_cycles;
-	val = ((nb_cycles & 0xFF000000) >> 24);
-	nfc_sniffer_buffer[i+1] = htoa[(val & 0xF0) >> 4];
-	nfc_sniffer_buffer[i+2] = htoa[(val & 0x0F)];
-	val = ((nb_cycles & 0x00FF0000) >> 16);
-	nfc_sniffer_buffer[i+3] = htoa[(val & 0xF0) >> 4];
-	nfc_sniffer_buffer[i+4] = htoa[(val & 0x0F)];
-	val = ((nb_cycles & 0x0000FF00) >> 8);
-	nfc_sniffer_buffer[i+5] = htoa[(val & 0xF0) >> 4];
-	nfc_sniffer_buffer[i+6] = htoa[(val & 0x0F)];
-	val = (nb_cycles & 0x000000FF);
-	nfc_sniffer_buffer[i+7] = htoa[(val & 0xF0) >> 4];
-	nfc_sniffer_buffer[i+8] = htoa[(val & 0x0F)];
-
-	nfc_sniffer_index +=9;
+	nfc_sniffer_index = sniff_text_duration(nfc_sniffer_buffer, nfc_sniffer_index,
+						timestamp_nb_cycles);
 }
 
 __attribute__ ((always_inline)) static inline
 void sniff_write_8b_ASCII_HEX(uint8_t data, bool add_space)
 {
-	uint32_t i;
-
-	i = nfc_sniffer_index;
-	nfc_sniffer_buffer[i+0] = htoa[(data & 0xF0) >> 4];
-	nfc_sniffer_buffer[i+1] = htoa[(data & 0x0F)];
-	if (add_space == TRUE) {
-		nfc_sniffer_buffer[i+2] = ' ';
-		nfc_sniffer_index +=3;
-	} else {
-		nfc_sniffer_index +=2;
-	}
+	nfc_sniffer_index = sniff_text_8b(nfc_sniffer_buffer, nfc_sniffer_index,
+					  data, add_space);
 }
 
 __attribute__ ((always_inline)) static inline
@@ -657,25 +618,118 @@ void sniff_write_bin_8b(uint8_t data)
 	nfc_sniffer_index++;
 }
 
-void hydranfc_sniff_14443A(t_hydra_console *con, bool start_of_frame, bool end_of_frame, bool sniff_trace_uart1, bool arg_sniff_pcap_output)
+/* Binary records, see hydranfc_sniff_record.h */
+static sniff_record_t sniff_record = {
+	.parity = fbuff,
+	.parity_size = sizeof(fbuff),
+};
+
+__attribute__ ((always_inline)) static inline
+void sniff_write_record_file_header(void)
+{
+	nfc_sniffer_index = sniff_record_file_header(nfc_sniffer_buffer, nfc_sniffer_index);
+}
+
+/* nfc_sniffer_index is a multiple of 4 between records */
+__attribute__ ((always_inline)) static inline
+void sniff_write_record_start(uint8_t type, uint8_t sample)
+{
+	nfc_sniffer_index = sniff_record_start(&sniff_record, nfc_sniffer_buffer,
+					       nfc_sniffer_index, type, sample,
+					       bsp_get_cyclecounter());
+}
+
+__attribute__ ((always_inline)) static inline
+void sniff_write_record_byte(uint8_t data, uint8_t parity)
+{
+	nfc_sniffer_index = sniff_record_byte(&sniff_record, nfc_sniffer_buffer,
+					      nfc_sniffer_index, data, parity);
+}
+
+/* A record which does not fit is dropped by sniff_end_of_frame() */
+__attribute__ ((always_inline)) static inline
+void sniff_write_record_end(bool has_duration, uint32_t duration)
+{
+	nfc_sniffer_index = sniff_record_end(&sniff_record, nfc_sniffer_buffer,
+					     nfc_sniffer_index, sniff_capacity,
+					     has_duration, duration);
+}
+
+/* Opens the output file and starts saving frames while sniffing */
+static void sniff_stream_start(void)
+{
+	bool opened;
+
+	if (sniff_pcap_output) {
+		opened = (file_fmt_create_pcap(&log_file) == 0);
+	} else {
+		opened = file_create(&log_file, "nfc_sniff_",
+				     sniff_record_output ? "bin" : "txt",
+				     (char *)&write_filename);
+		if (opened)
+			tprintf("open_file %s\r\n", &write_filename.filename[2]);
+	}
+	if (!opened) {
+		tprintf("No SD card, sniffed data are kept in memory\r\n");
+		return;
+	}
+
+	sniff_writer_start(&sniff_writer, &log_file, nfc_sniffer_buffer, NB_SBUFFER);
+	sniff_capacity = sniff_writer.half_size - SNIFF_WRITER_MARGIN;
+	sniff_streaming = TRUE;
+}
+
+/*
+ * Called with the kernel locked at the end of each frame.
+ * Drops the frame if it did not fit, and hands the filled half to the
+ * writer if possible.
+ */
+__attribute__ ((always_inline)) static inline
+void sniff_end_of_frame(uint32_t frame_start)
+{
+	uint8_t *next;
+
+	if (nfc_sniffer_index >= sniff_capacity) {
+		nfc_sniffer_index = frame_start;
+		sniff_writer.dropped++;
+	}
+
+	if (!sniff_streaming || nfc_sniffer_index < SNIFF_WRITER_FLUSH_SIZE)
+		return;
+
+	next = sniff_writer_submitS(&sniff_writer, nfc_sniffer_index);
+	if (next != NULL) {
+		nfc_sniffer_buffer = next;
+		nfc_sniffer_index = 0;
+	}
+}
+
+void hydranfc_sniff_14443A(t_hydra_console *con, bool start_of_frame, bool end_of_frame, bool sniff_trace_uart1, sniff_format_t sniff_format)
 {
 	(void)con;
-	uint8_t  ds_data, tmp_u8_data, tmp_u8_data_nb_bit;
-	uint32_t f_data, lsh_bit, rsh_bit;
-	uint32_t rsh_miller_bit, lsh_miller_bit;
+	uint8_t  ds_data;
 	uint32_t protocol_found, old_protocol_found; /* 0=Unknown, 1=106kb Miller Modified, 2=106kb Manchester */
-	uint32_t old_data_counter;
 	uint32_t nb_data;
 	uint32_t uart_buf_pos;
 	uint32_t start_frame_cycles;
 	uint32_t total_frame_cycles;
+	uint32_t frame_start;
+	uint32_t first_u32_data;
+	sniff_14443a_t dec;
 #ifdef STAT_UART_WRITE
 	uint32_t uart_min;
 	uint32_t uart_max;
 	uint32_t uart_nb_loop;
 #endif
+#ifdef STAT_DECODE
+	uint32_t decode_cycles;
+	uint32_t decode_nb_words;
+	uint32_t ticks;
+#endif
+	uint32_t res;
 	// init global
-	sniff_pcap_output = arg_sniff_pcap_output ? 1 : 0;
+	sniff_pcap_output = (sniff_format == SNIFF_FORMAT_PCAP) ? 1 : 0;
+	sniff_record_output = (sniff_format == SNIFF_FORMAT_RECORD);
 
 	tprintf("sniff_14443A start\r\n");
 	if (sniff_pcap_output)
@@ -683,8 +737,12 @@ void hydranfc_sniff_14443A(t_hydra_console *con, bool start_of_frame, bool end_o
 	tprintf("Abort/Exit by pressing K4 button\r\n");
 	init_sniff_nfc(ISO14443A);
 
+	sniff_streaming = FALSE;
+	sniff_capacity = NB_SBUFFER - SNIFF_WRITER_MARGIN;
 	if(sniff_trace_uart1)
 		initUART1_sniff();
+	else
+		sniff_stream_start();
 
 	tprintf("Starting Sniffer ISO14443-A 106kbps ...\r\n");
 	/* Wait a bit in order to display all text */
@@ -693,6 +751,10 @@ void hydranfc_sniff_14443A(t_hydra_console *con, bool start_of_frame, bool end_o
 	uart_min = 0xFFFFFFFF;
 	uart_max = 0;
 	uart_nb_loop = 0;
+#endif
+#ifdef STAT_DECODE
+	decode_cycles = 0;
+	decode_nb_words = 0;
 #endif
 	uart_buf_pos = 0;
 	old_protocol_found = 0;
@@ -702,26 +764,31 @@ void hydranfc_sniff_14443A(t_hydra_console *con, bool start_of_frame, bool end_o
 	/* Lock Kernel for sniffer */
 	chSysLock();
 
-	if (sniff_pcap_output)
-		sniff_write_pcap_global_header();
+	if (sniff_pcap_output) {
+		/* ISO14443A is the interface 0 of the capture */
+		nfc_sniffer_index += pcapng_shb(&nfc_sniffer_buffer[nfc_sniffer_index]);
+		nfc_sniffer_index += pcapng_idb(&nfc_sniffer_buffer[nfc_sniffer_index],
+						PCAPNG_LINK_ISO14443A);
+	}
+	else if (sniff_record_output)
+		sniff_write_record_file_header();
 
 	/* Main Loop */
 	while (TRUE) {
-		lsh_bit = 0;
-		rsh_bit = 0;
 		irq_no = 0;
 
 		while (TRUE) {
 			D4_OFF;
 			old_data_bit = 0;
-			f_data = 0;
 
-			uint32_t unknown = 0;
 			uint8_t pow = 0x7F;
+			uint64_t nb_cycles_start64;
 			uint32_t nb_cycles_start = 0;
 			uint32_t nb_cycles_end = 0;
 
-			nb_cycles_start = bsp_get_cyclecounter();
+			nb_cycles_start64 = bsp_get_cyclecounter64I();
+			nb_cycles_start = (uint32_t)nb_cycles_start64;
+			frame_start = nfc_sniffer_index;
 
 			u32_data = WaitGetDMABuffer();
 			old_data_bit = (uint32_t)(u32_data&1);
@@ -731,6 +798,10 @@ void hydranfc_sniff_14443A(t_hydra_console *con, bool start_of_frame, bool end_o
 			if (sniff_wait_data_change_or_exit() == TRUE) {
 #ifdef STAT_UART_WRITE
 				tprintf("\r\nuart_nb_loop=%u uart_min=%u uart_max=%u\r\n", uart_nb_loop, uart_min, uart_max);
+#endif
+#ifdef STAT_DECODE
+				tprintf("\r\ndecode_nb_words=%u decode_cycles=%u cycles/word=%u\r\n", decode_nb_words, decode_cycles,
+					decode_nb_words ? (decode_cycles / decode_nb_words) : 0);
 #endif
 				/* Wait a bit in order to display all text */
 				chThdSleepMilliseconds(50);
@@ -743,38 +814,25 @@ void hydranfc_sniff_14443A(t_hydra_console *con, bool start_of_frame, bool end_o
 			/* Log All Data */
 			TST_ON;
 			D4_ON;
-			tmp_u8_data = 0;
-			tmp_u8_data_nb_bit = 0;
 
-			/* Search first edge bit position to synchronize stream */
-			/* Search an edge on each bit from MSB to LSB */
-			/* Old bit = 1 so new bit will be 0 => 11111111 10000000 => 00000000 01111111 just need to reverse it to count leading zero */
-			/* Old bit = 0 so new bit will be 1 => 00000000 01111111 no need to reverse to count leading zero */
-			lsh_bit = old_data_bit ? (~u32_data) : u32_data;
-			lsh_bit = CountLeadingZero(lsh_bit);
-			rsh_bit = 32-lsh_bit;
-
-			rsh_miller_bit = 0;
-			lsh_miller_bit = 32-rsh_miller_bit;
-
-			/* Shift data */
-			f_data = u32_data<<lsh_bit;
+			/*
+			 * Search first edge bit position to synchronize stream,
+			 * from MSB to LSB (count leading zero of the word, reversed
+			 * if the old bit is 1)
+			 */
+			first_u32_data = u32_data;
 			/* Next Data */
 			TST_OFF;
 			u32_data = WaitGetDMABuffer();
 			if(start_of_frame == true)
 				start_frame_cycles = bsp_get_cyclecounter();
 			TST_ON;
-			f_data |= u32_data>>rsh_bit;
 
 			/* Todo: Better algorithm to recognize frequency using table and counting number of edge ...
 			              and finaly use majority voting for frequency */
 			// DownSampling by 4 (input 32bits output 8bits filtered)
 			// In Freq of 3.39MHz => 105.9375KHz on 8bits (each bit is 848KHz so 2bits=423.75KHz)
-			ds_data  = ((downsample_4x[(f_data>>24)])<<6) |
-				   ((downsample_4x[((f_data&0x00FF0000)>>16)])<<4) |
-				   ((downsample_4x[((f_data&0x0000FF00)>>8)])<<2) |
-				   (downsample_4x[(f_data&0x000000FF)]);
+			ds_data = sniff_14443a_sync(&dec, old_data_bit, first_u32_data, u32_data);
 
 			/* Todo: Find frequency by counting number of consecutive "1" & "0" or the reverse.
 			 * Example0: 1x"1" then 1x"0" => 3.39MHz/2 = Freq 1695KHz
@@ -785,18 +843,25 @@ void hydranfc_sniff_14443A(t_hydra_console *con, bool start_of_frame, bool end_o
 			 * Example Miller Modified '0' @~106Khz: 00000000 00111111 11111111 11111111 => 10x"0" then 22x"1" (10+22=32) => 3.39MHz/32 = Freq 105.9375KHz
 			 **/
 			protocol_found = detected_protocol[ds_data];
+			sniff_14443a_coding(&dec, protocol_found == MANCHESTER_106KHZ,
+					    protocol_found != MILLER_MODIFIED_106KHZ &&
+					    protocol_found != MANCHESTER_106KHZ);
 			switch(protocol_found) {
 			case MILLER_MODIFIED_106KHZ:
 				/* Miller Modified@~106Khz Start bit */
 				old_protocol_found = MILLER_MODIFIED_106KHZ;
-				if (!sniff_pcap_output)
+				if (sniff_record_output)
+					sniff_write_record_start(SNIFF_RECORD_PCD, ds_data);
+				else if (!sniff_pcap_output)
 					sniff_write_pcd();
 				break;
 
 			case MANCHESTER_106KHZ:
 				/* Manchester@~106Khz Start bit */
 				old_protocol_found = MANCHESTER_106KHZ;
-				if (!sniff_pcap_output)
+				if (sniff_record_output)
+					sniff_write_record_start(SNIFF_RECORD_PICC, ds_data);
+				else if (!sniff_pcap_output)
 					sniff_write_picc();
 				break;
 
@@ -809,29 +874,24 @@ void hydranfc_sniff_14443A(t_hydra_console *con, bool start_of_frame, bool end_o
 					protocol_found = MILLER_MODIFIED_106KHZ;
 					/* RE Synchronize bit stream to start of bit from (00000000) 11111111 to 00111111 (2 to 3 us at level 0 are not seen) */
 					/* Nota only first Miller Modified Word does not need this hack because it is well detected it start with (11111111) 00111111  */
-					// New Word
-					rsh_miller_bit = 15; /* Between 2 to 3.1us => 7 to 11bits => Average 9bits + 6bits(margin) =< 32-15 = 17 bit */
-					lsh_miller_bit = 32-rsh_miller_bit;
-					if (!sniff_pcap_output)
+					if (sniff_record_output)
+						sniff_write_record_start(SNIFF_RECORD_PCD, ds_data);
+					else if (!sniff_pcap_output)
 						sniff_write_pcd();
 					/* Start Bit not included in data buffer */
 				} else {
 					old_protocol_found = MILLER_MODIFIED_106KHZ;
 					protocol_found = MILLER_MODIFIED_106KHZ;
-					/* RE Synchronize bit stream to start of bit from (00000000) 11111111 to 00111111 (2 to 3 us at level 0 are not seen) */
-					/* Nota only first Miller Modified Word does not need this hack because it is well detected it start with (11111111) 00111111  */
-					// New Word
-					rsh_miller_bit = 15; /* Between 2 to 3.1us => 7 to 11bits => Average 9bits + 6bits(margin) =< 32-15 = 17 bit */
-					lsh_miller_bit = 32-rsh_miller_bit;
-					if (!sniff_pcap_output)
+					/* Same re-synchronization */
+					if (sniff_record_output)
+						sniff_write_record_start(SNIFF_RECORD_UNKNOWN, ds_data);
+					else if (!sniff_pcap_output)
 						sniff_write_unknown_protocol(ds_data);
 				}
 				break;
 			}
 
 			/* Decode Data until end of frame detected */
-			old_u32_data = f_data;
-			old_data_counter = 0;
 			nb_data = 0;
 			while (1) {
 				if ( (K4_BUTTON) || (hydrabus_ubtn()) ) {
@@ -840,110 +900,63 @@ void hydranfc_sniff_14443A(t_hydra_console *con, bool start_of_frame, bool end_o
 					break;
 				}
 
-				/* New Word */
-				f_data = u32_data<<lsh_bit;
-
 				/* Next Data */
 				TST_OFF;
 				u32_data = WaitGetDMABuffer();
 				TST_ON;
 
-				f_data |= u32_data>>rsh_bit;
-
-				/* In New Data 32bits */
-				if (u32_data != old_u32_data) {
-					old_u32_data = u32_data;
-					old_data_counter = 0;
-				} else {
-					old_u32_data = u32_data;
-					/* No new data */
-					if ( (u32_data==0xFFFFFFFF) || (u32_data==0x00000000) ) {
-						old_data_counter++;
-						if (old_data_counter>1) {
-							/* No new data => End Of Frame detected => Wait new data & synchro */
-							if(end_of_frame == true)
-								total_frame_cycles = bsp_get_cyclecounter() - start_frame_cycles;
-							break;
-						}
-					} else {
-						old_data_counter = 0;
-					}
-				}
-
-				f_data = (f_data>>rsh_miller_bit)|(0xFFFFFFFF<<lsh_miller_bit);
-				// DownSampling by 4 (input 32bits output 8bits filtered)
-				// In Freq of 3.39MHz => 105.9375KHz on 8bits (each bit is 848KHz so 2bits=423.75KHz)
-				ds_data  = ((downsample_4x[(f_data>>24)])<<6) |
-					   ((downsample_4x[((f_data&0x00FF0000)>>16)])<<4) |
-					   ((downsample_4x[((f_data&0x0000FF00)>>8)])<<2) |
-					   (downsample_4x[(f_data&0x000000FF)]);
-
-				switch(protocol_found) {
-				case MILLER_MODIFIED_106KHZ:
-					if (tmp_u8_data_nb_bit < 8) {
-						tmp_u8_data |= (miller_modified_106kb[ds_data])<<tmp_u8_data_nb_bit;
-						tmp_u8_data_nb_bit++;
-					} else {
-						nb_data++;
-						tmp_u8_data_nb_bit=0;
-						/* Convert Hex to ASCII + Space */
-						if (!sniff_pcap_output)
-							sniff_write_8b_ASCII_HEX(tmp_u8_data, TRUE);
-						else
-							sniff_write_pcap_data(tmp_u8_data);
-
-						tmp_u8_data=0; /* Parity bit discarded */
-					}
-					break;
-
-				case MANCHESTER_106KHZ:
-					if (tmp_u8_data_nb_bit < 8) {
-						tmp_u8_data |= (manchester_106kb[ds_data])<<tmp_u8_data_nb_bit;
-						tmp_u8_data_nb_bit++;
-					} else {
-						nb_data++;
-						tmp_u8_data_nb_bit=0;
-						/* Convert Hex to ASCII + Space */
-						if (!sniff_pcap_output)
-							sniff_write_8b_ASCII_HEX(tmp_u8_data, TRUE);
-						else
-							sniff_write_pcap_data(tmp_u8_data);
-
-						tmp_u8_data=0; /* Parity bit discarded */
-					}
-					break;
-
-				default:
+#ifdef STAT_DECODE
+				ticks = bsp_get_cyclecounter();
+#endif
+				res = sniff_14443a_word(&dec, u32_data);
+#ifdef STAT_DECODE
+				decode_cycles += bsp_get_cyclecounter() - ticks;
+				decode_nb_words++;
+#endif
+				switch (res) {
+				case SNIFF_14443A_BIT:
+					continue;
+				case SNIFF_14443A_BYTE:
 					nb_data++;
-					/* Unknown protocol */
-					/* Convert Hex to ASCII */
-					if (!sniff_pcap_output)
-						sniff_write_8b_ASCII_HEX(ds_data, FALSE);
-					else {
-						unknown = 1;
-						sniff_write_pcap_data(tmp_u8_data);
+					/* Convert Hex to ASCII + Space */
+					if (sniff_record_output)
+						sniff_write_record_byte(dec.byte, dec.parity);
+					else if (!sniff_pcap_output)
+						sniff_write_8b_ASCII_HEX(dec.byte, TRUE);
+					else
+						sniff_write_pcap_data(dec.byte);
+					/* For safety to avoid potential buffer overflow ... */
+					if (nfc_sniffer_index >= sniff_capacity) {
+						nfc_sniffer_index = sniff_capacity;
 					}
+					continue;
+				default:
 					break;
 				}
-				/* For safety to avoid potential buffer overflow ... */
-				if (nfc_sniffer_index >= NB_SBUFFER) {
-					nfc_sniffer_index = NB_SBUFFER;
-				}
+
+				/* No new data => End Of Frame detected => Wait new data & synchro */
+				if(end_of_frame == true)
+					total_frame_cycles = bsp_get_cyclecounter() - start_frame_cycles;
+				break;
 			}
 
 			/* End of Frame detected check if incomplete byte (at least 4bit) is present to write it as output */
-			if (tmp_u8_data_nb_bit>3) {
+			if (dec.nb_bits>3) {
 					nb_data++;
 					/* Convert Hex to ASCII + Space */
-					if (!sniff_pcap_output)
-						sniff_write_8b_ASCII_HEX(tmp_u8_data, FALSE);
+					if (sniff_record_output)
+						sniff_write_record_byte(dec.acc, 0);
+					else if (!sniff_pcap_output)
+						sniff_write_8b_ASCII_HEX(dec.acc, FALSE);
 					else
-						sniff_write_pcap_data(tmp_u8_data);
+						sniff_write_pcap_data(dec.acc);
 			}
 
 			nb_cycles_end = bsp_get_cyclecounter();
 
-			if (!sniff_pcap_output)
+			if (sniff_record_output)
+				sniff_write_record_end(end_of_frame, end_of_frame ? total_frame_cycles : 0);
+			else if (!sniff_pcap_output)
 				if(end_of_frame == true)
 					sniff_write_frameduration(total_frame_cycles);
 
@@ -970,56 +983,124 @@ void hydranfc_sniff_14443A(t_hydra_console *con, bool start_of_frame, bool end_o
 #endif
 				}
 				/* For safety to avoid buffer overflow and restart buffer */
-				if (nfc_sniffer_index >= NB_SBUFFER) {
+				if (nfc_sniffer_index >= sniff_capacity) {
 					nfc_sniffer_index = 0;
 					uart_buf_pos = 0;
 				}
-			}else
-			{
-				/* For safety to avoid buffer overflow */
-				if (nfc_sniffer_index >= NB_SBUFFER) {
-					nfc_sniffer_index = NB_SBUFFER;
-				}
 			}
 
-			if (sniff_pcap_output) {
-				sniff_write_pcap_packet_header(nb_cycles_start);
+			/* Enhanced Packet Block with the 8 bytes data header */
+			if (sniff_pcap_output &&
+			    nfc_sniffer_index + PCAPNG_EPB_SIZE(8 + tmp_sniffer_get_size()) > sniff_capacity) {
+				nfc_sniffer_index = sniff_capacity;
+				tmp_sbuf_idx = 0;
+			} else if (sniff_pcap_output) {
+				nfc_sniffer_index += pcapng_epb_header(&nfc_sniffer_buffer[nfc_sniffer_index], 0,
+								       pcapng_ts_ns(nb_cycles_start64, STM32_HCLK),
+								       8 + tmp_sniffer_get_size());
 
-				if (unknown == 1)
-					sniff_write_data_header(pow, 3, 1,
-							nb_cycles_end, 0);
-				else
-					sniff_write_data_header(pow, protocol_found, 1,
+				sniff_write_data_header(pow, protocol_found, 1,
 							nb_cycles_end, 0);
 
-				uint32_t y = 0;
-
-				do {
-					uint32_t i;
-					i = nfc_sniffer_index;
-
-					nfc_sniffer_buffer[i + 0] = fbuff[y];
-					nfc_sniffer_index += 1;
-					y++;
-				} while (y < tmp_sniffer_get_size());
+				memcpy(&nfc_sniffer_buffer[nfc_sniffer_index], fbuff,
+				       tmp_sniffer_get_size());
+				nfc_sniffer_index += tmp_sniffer_get_size();
 
+				nfc_sniffer_index += pcapng_epb_trailer(&nfc_sniffer_buffer[nfc_sniffer_index],
+									8 + tmp_sniffer_get_size());
 				tmp_sbuf_idx = 0;
 			}
 
+			if(!sniff_trace_uart1)
+				sniff_end_of_frame(frame_start);
+
 			TST_OFF;
 		}
 	} // Main While Loop
 }
 
+/* ISO14443B 106kbps sniffer, text output */
+void hydranfc_sniff_14443B(t_hydra_console *con)
+{
+	(void)con;
+	sniff_14443b_t dec;
+	uint32_t frame_start;
+
+	sniff_pcap_output = 0;
+	sniff_record_output = FALSE;
+
+	tprintf("sniff_14443B start\r\n");
+	tprintf("Abort/Exit by pressing K4 button\r\n");
+	init_sniff_nfc(ISO14443B);
+
+	sniff_streaming = FALSE;
+	sniff_capacity = NB_SBUFFER - SNIFF_WRITER_MARGIN;
+	sniff_stream_start();
+
+	tprintf("Starting Sniffer ISO14443-B 106kbps ...\r\n");
+	/* Wait a bit in order to display all text */
+	chThdSleepMilliseconds(50);
+	nfc_sniffer_index = 0;
+	frame_start = 0;
+	sniff_14443b_init(&dec);
+
+	/* Lock Kernel for sniffer */
+	chSysLock();
+
+	while (TRUE) {
+		if ( (K4_BUTTON) || (hydrabus_ubtn()) ) {
+			sniff_log();
+			/* Wait a bit in order to display all text */
+			chThdSleepMilliseconds(50);
+			pool_free(nfc_sniffer_buffer);
+			return;
+		}
+
+		/* One DMA word is one etu */
+		switch (sniff_14443b_word(&dec, WaitGetDMABuffer())) {
+		case SNIFF_14443B_SOF:
+			D4_ON;
+			frame_start = nfc_sniffer_index;
+			if (dec.dir == SNIFF_14443B_PCD)
+				sniff_write_pcd();
+			else
+				sniff_write_picc();
+			break;
+
+		case SNIFF_14443B_BYTE:
+			sniff_write_8b_ASCII_HEX(dec.byte, TRUE);
+			/* For safety to avoid potential buffer overflow ... */
+			if (nfc_sniffer_index >= sniff_capacity)
+				nfc_sniffer_index = sniff_capacity;
+			break;
+
+		case SNIFF_14443B_EOF:
+		case SNIFF_14443B_ERROR:
+			/* Frames without EOF are kept, they end with the last byte */
+			D4_OFF;
+			sniff_end_of_frame(frame_start);
+			break;
+
+		default:
+			/* No frame in progress, let the SDC interrupts wake up the writer */
+			if (!sniff_14443b_in_frame(&dec) && sniff_streaming &&
+			    sniff_writer_busy(&sniff_writer)) {
+				chSysUnlock();
+				chSysLock();
+			}
+			break;
+		}
+	}
+}
+
 void hydranfc_sniff_14443A_bin(t_hydra_console *con, bool start_of_frame, bool end_of_frame, bool parity)
 {
 	(void)con;
 	sniff_14443a_bin_frame_header_t bin_frame_hdr;
-	uint8_t  ds_data, tmp_u8_data, tmp_u8_data_nb_bit;
-	uint32_t f_data, lsh_bit, rsh_bit;
-	uint32_t rsh_miller_bit, lsh_miller_bit;
+	uint8_t  ds_data;
 	uint32_t protocol_found, old_protocol_found; /* 0=Unknown, 1=106kb Miller Modified, 2=106kb Manchester */
-	uint32_t old_data_counter;
+	uint32_t first_u32_data;
+	sniff_14443a_t dec;
 #ifdef STAT_UART_WRITE
 	uint32_t uart_min;
 	uint32_t uart_max;
@@ -1058,15 +1139,12 @@ void hydranfc_sniff_14443A_bin(t_hydra_console *con, bool start_of_frame, bool e
 
 	/* Main Loop */
 	while (TRUE) {
-		lsh_bit = 0;
-		rsh_bit = 0;
 		irq_no = 0;
 
 		while (TRUE) {
 			/* Start of Frame Loop */
 			D4_OFF;
 			old_data_bit = 0;
-			f_data = 0;
 			nfc_sniffer_index = sizeof(bin_frame_hdr);
 
 			u32_data = WaitGetDMABuffer();
@@ -1088,38 +1166,21 @@ void hydranfc_sniff_14443A_bin(t_hydra_console *con, bool start_of_frame, bool e
 			/* Log All Data */
 			TST_ON;
 			D4_ON;
-			tmp_u8_data = 0;
-			tmp_u8_data_nb_bit = 0;
-
-			/* Search first edge bit position to synchronize stream */
-			/* Search an edge on each bit from MSB to LSB */
-			/* Old bit = 1 so new bit will be 0 => 11111111 10000000 => 00000000 01111111 just need to reverse it to count leading zero */
-			/* Old bit = 0 so new bit will be 1 => 00000000 01111111 no need to reverse to count leading zero */
-			lsh_bit = old_data_bit ? (~u32_data) : u32_data;
-			lsh_bit = CountLeadingZero(lsh_bit);
-			rsh_bit = 32-lsh_bit;
-
-			rsh_miller_bit = 0;
-			lsh_miller_bit = 32-rsh_miller_bit;
 
-			/* Shift data */
-			f_data = u32_data<<lsh_bit;
+			/* Search first edge bit position to synchronize stream, see hydranfc_sniff_14443A() */
+			first_u32_data = u32_data;
 			/* Next Data */
 			TST_OFF;
 			u32_data = WaitGetDMABuffer();
 			if(start_of_frame == true)
 				sniff_write_bin_timestamp(bsp_get_cyclecounter());
 			TST_ON;
-			f_data |= u32_data>>rsh_bit;
 
 			/* Todo: Better algorithm to recognize frequency using table and counting number of edge ...
 			              and finaly use majority voting for frequency */
 			// DownSampling by 4 (input 32bits output 8bits filtered)
 			// In Freq of 3.39MHz => 105.9375KHz on 8bits (each bit is 848KHz so 2bits=423.75KHz)
-			ds_data  = ((downsample_4x[(f_data>>24)])<<6) |
-				   ((downsample_4x[((f_data&0x00FF0000)>>16)])<<4) |
-				   ((downsample_4x[((f_data&0x0000FF00)>>8)])<<2) |
-				   (downsample_4x[(f_data&0x000000FF)]);
+			ds_data = sniff_14443a_sync(&dec, old_data_bit, first_u32_data, u32_data);
 
 			/* Todo: Find frequency by counting number of consecutive "1" & "0" or the reverse.
 			 * Example0: 1x"1" then 1x"0" => 3.39MHz/2 = Freq 1695KHz
@@ -1130,6 +1191,9 @@ void hydranfc_sniff_14443A_bin(t_hydra_console *con, bool start_of_frame, bool e
 			 * Example Miller Modified '0' @~106Khz: 00000000 00111111 11111111 11111111 => 10x"0" then 22x"1" (10+22=32) => 3.39MHz/32 = Freq 105.9375KHz
 			 */
 			protocol_found = detected_protocol[ds_data];
+			sniff_14443a_coding(&dec, protocol_found == MANCHESTER_106KHZ,
+					    protocol_found != MILLER_MODIFIED_106KHZ &&
+					    protocol_found != MANCHESTER_106KHZ);
 			switch(protocol_found) {
 			case MILLER_MODIFIED_106KHZ:
 				/* Miller Modified@~106Khz Start bit */
@@ -1153,27 +1217,18 @@ void hydranfc_sniff_14443A_bin(t_hydra_console *con, bool start_of_frame, bool e
 				  bin_frame_hdr.protocol_modulation = PROTOCOL_MODULATION_TYPEA_MILLER_MODIFIED_106KBPS;
 					/* RE Synchronize bit stream to start of bit from (00000000) 11111111 to 00111111 (2 to 3 us at level 0 are not seen) */
 					/* Nota only first Miller Modified Word does not need this hack because it is well detected it start with (11111111) 00111111  */
-					// New Word
-					rsh_miller_bit = 15; /* Between 2 to 3.1us => 7 to 11bits => Average 9bits + 6bits(margin) =< 32-15 = 17 bit */
-					lsh_miller_bit = 32-rsh_miller_bit;
 					/* Start Bit not included in data buffer */
 				} else {
 					old_protocol_found = MILLER_MODIFIED_106KHZ;
 					protocol_found = MILLER_MODIFIED_106KHZ;
 				  bin_frame_hdr.protocol_modulation = PROTOCOL_MODULATION_TYPEA_MILLER_MODIFIED_106KBPS;
-					/* RE Synchronize bit stream to start of bit from (00000000) 11111111 to 00111111 (2 to 3 us at level 0 are not seen) */
-					/* Nota only first Miller Modified Word does not need this hack because it is well detected it start with (11111111) 00111111  */
-					// New Word
-					rsh_miller_bit = 15; /* Between 2 to 3.1us => 7 to 11bits => Average 9bits + 6bits(margin) =< 32-15 = 17 bit */
-					lsh_miller_bit = 32-rsh_miller_bit;
+					/* Same re-synchronization */
 					//sniff_write_unknown_protocol(ds_data);
 				}
 				break;
 			}
 
 			/* Decode Data until end of frame detected */
-			old_u32_data = f_data;
-			old_data_counter = 0;
 			nb_data = 0;
 			while (1) {
 				if ( (K4_BUTTON) || (hydrabus_ubtn()) ) {
@@ -1182,99 +1237,40 @@ void hydranfc_sniff_14443A_bin(t_hydra_console *con, bool start_of_frame, bool e
 					break;
 				}
 
-				/* New Word */
-				f_data = u32_data<<lsh_bit;
-
 				/* Next Data */
 				TST_OFF;
 				u32_data = WaitGetDMABuffer();
 				TST_ON;
 
-				f_data |= u32_data>>rsh_bit;
-
-				/* In New Data 32bits */
-				if (u32_data != old_u32_data) {
-					old_u32_data = u32_data;
-					old_data_counter = 0;
-				} else {
-					old_u32_data = u32_data;
-					/* No new data */
-					if ( (u32_data==0xFFFFFFFF) || (u32_data==0x00000000) ) {
-						old_data_counter++;
-						if (old_data_counter>1) {
-							/* No new data => End Of Frame detected => Wait new data & synchro */
-							if(end_of_frame == true)
-								end_of_frame_cycles = bsp_get_cyclecounter();
-							break;
-						}
-					} else {
-						old_data_counter = 0;
-					}
-				}
-
-				f_data = (f_data>>rsh_miller_bit)|(0xFFFFFFFF<<lsh_miller_bit);
-				// DownSampling by 4 (input 32bits output 8bits filtered)
-				// In Freq of 3.39MHz => 105.9375KHz on 8bits (each bit is 848KHz so 2bits=423.75KHz)
-				ds_data  = ((downsample_4x[(f_data>>24)])<<6) |
-					   ((downsample_4x[((f_data&0x00FF0000)>>16)])<<4) |
-					   ((downsample_4x[((f_data&0x0000FF00)>>8)])<<2) |
-					   (downsample_4x[(f_data&0x000000FF)]);
-
-				switch(protocol_found) {
-				case MILLER_MODIFIED_106KHZ:
-					if (tmp_u8_data_nb_bit < 8) {
-						tmp_u8_data |= (miller_modified_106kb[ds_data])<<tmp_u8_data_nb_bit;
-						tmp_u8_data_nb_bit++;
-					} else {
-						bin_frame_hdr.protocol_modulation = PROTOCOL_MODULATION_TYPEA_MILLER_MODIFIED_106KBPS;
-						nb_data++;
-						tmp_u8_data_nb_bit=0;
-						/* Write 8bits Data */
-						sniff_write_bin_8b(tmp_u8_data);
-						/* Write Parity */
-						if(parity == true)
-							sniff_write_bin_8b(miller_modified_106kb[ds_data]);
-
-						tmp_u8_data=0; /* Parity bit discarded */
-					}
-					break;
-
-				case MANCHESTER_106KHZ:
-					if (tmp_u8_data_nb_bit < 8) {
-						tmp_u8_data |= (manchester_106kb[ds_data])<<tmp_u8_data_nb_bit;
-						tmp_u8_data_nb_bit++;
-					} else {
-						bin_frame_hdr.protocol_modulation = PROTOCOL_MODULATION_TYPEA_MANCHESTER_106KBPS;
-						nb_data++;
-						tmp_u8_data_nb_bit=0;
-						/* Write 8bits Data */
-						sniff_write_bin_8b(tmp_u8_data);
-						/* Write Parity */
-						if(parity == true)
-							sniff_write_bin_8b(manchester_106kb[ds_data]);
-
-						tmp_u8_data=0; /* Parity bit discarded */
-					}
-					break;
-
-				default:
-					bin_frame_hdr.protocol_modulation = PROTOCOL_MODULATION_UNKNOWN;
+				switch (sniff_14443a_word(&dec, u32_data)) {
+				case SNIFF_14443A_BIT:
+					continue;
+				case SNIFF_14443A_BYTE:
 					nb_data++;
-					/* Unknown protocol */
 					/* Write 8bits Data */
-					sniff_write_bin_8b(ds_data);
+					sniff_write_bin_8b(dec.byte);
+					/* Write Parity */
+					if(parity == true)
+						sniff_write_bin_8b(dec.parity);
+					/* For safety to avoid potential buffer overflow ... */
+					if (nfc_sniffer_index >= NB_SBUFFER) {
+						nfc_sniffer_index = NB_SBUFFER;
+					}
+					continue;
+				default:
 					break;
 				}
-				/* For safety to avoid potential buffer overflow ... */
-				if (nfc_sniffer_index >= NB_SBUFFER) {
-					nfc_sniffer_index = NB_SBUFFER;
-				}
+
+				/* No new data => End Of Frame detected => Wait new data & synchro */
+				if(end_of_frame == true)
+					end_of_frame_cycles = bsp_get_cyclecounter();
+				break;
 			}
 			/* End of Frame detected check if incomplete byte (at least 4bit) is present to write it as output */
-			if (tmp_u8_data_nb_bit>3) {
+			if (dec.nb_bits>3) {
 					nb_data++;
 					/* Write 8bits Data */
-					sniff_write_bin_8b(tmp_u8_data);
+					sniff_write_bin_8b(dec.acc);
 			}
 			if(end_of_frame == true)
 				sniff_write_bin_timestamp(end_of_frame_cycles);
@@ -1402,10 +1398,7 @@ void hydranfc_sniff_14443AB_bin_raw(t_hydra_console *con, bool start_of_frame, b
 
 			// DownSampling by 4 (input 32bits output 8bits filtered)
 			// In Freq of 3.39MHz => 105.9375KHz on 8bits (each bit is 848KHz so 2bits=423.75KHz)
-			ds_data  = ((downsample_4x[(f_data>>24)])<<6) |
-				   ((downsample_4x[((f_data&0x00FF0000)>>16)])<<4) |
-				   ((downsample_4x[((f_data&0x0000FF00)>>8)])<<2) |
-				   (downsample_4x[(f_data&0x000000FF)]);
+			ds_data = sniff_downsample_4x(f_data);
 
 			/* Write 8bits raw data */
 			sniff_write_bin_8b(ds_data);
@@ -1452,10 +1445,7 @@ void hydranfc_sniff_14443AB_bin_raw(t_hydra_console *con, bool start_of_frame, b
 
 				// DownSampling by 4 (input 32bits output 8bits filtered)
 				// In Freq of 3.39MHz => 105.9375KHz on 8bits (each bit is 848KHz so 2bits=423.75KHz)
-				ds_data  = ((downsample_4x[(f_data>>24)])<<6) |
-					   ((downsample_4x[((f_data&0x00FF0000)>>16)])<<4) |
-					   ((downsample_4x[((f_data&0x0000FF00)>>8)])<<2) |
-					   (downsample_4x[(f_data&0x000000FF)]);
+				ds_data = sniff_downsample_4x(f_data);
 
 				/* Write 8bits raw data */
 				sniff_write_bin_8b(ds_data);
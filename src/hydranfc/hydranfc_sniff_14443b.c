@@ -0,0 +1,269 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2015 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "hydranfc_sniff_14443b.h"
+
+/*
+ * This file does not depend on ChibiOS, it is fed with the DMA words by
+ * hydranfc_sniff_14443B() with the kernel locked.
+ */
+
+/* The decision on an etu is taken on its 16 middle samples */
+#define ETU_MIDDLE	(0x00FFFF00)
+
+/* SOF and EOF: 10-11 etu at 0 then (SOF) 2-3 etu at 1, with margin */
+#define SOF_LOW_MIN	(9)
+#define SOF_LOW_MAX	(12)
+#define SOF_HIGH_MAX	(4)
+/* Longest run of 1 between two characters */
+#define EGT_MAX		(8)
+/* Words at the same level before a PCD SOF, longer than the end of an EOF */
+#define IDLE_MIN	(4)
+
+static inline uint32_t popcount32(uint32_t v)
+{
+	v = v - ((v >> 1) & 0x55555555);
+	v = (v & 0x33333333) + ((v >> 2) & 0x33333333);
+	v = (v + (v >> 4)) & 0x0F0F0F0F;
+	return (v * 0x01010101) >> 24;
+}
+
+static inline uint32_t rotl32(uint32_t v, uint32_t n)
+{
+	return n ? ((v << n) | (v >> (32 - n))) : v;
+}
+
+/*
+ * Start of the run of changed samples at the end of the word, diff is
+ * the change mask and it shall end with a change, see edge_end().
+ * Finding the end run instead of the first change ignores isolated noise,
+ * a single unchanged sample in the run is noise too.
+ */
+static inline uint32_t edge_offset(uint32_t diff)
+{
+	diff |= ((diff << 1) & (diff >> 1)) | ((diff >> 1) & (diff >> 2) & 1);
+	return (diff == 0xFFFFFFFF) ? 0 : 32 - __builtin_ctz(~diff);
+}
+
+/* Last sample changed, or noisy after two changed samples */
+static inline int edge_end(uint32_t diff)
+{
+	return (diff & 1) || ((diff & 6) == 6);
+}
+
+/* A new level needs at least this many changed samples */
+#define EDGE_MIN	(4)
+
+/* 847.5KHz subcarrier: 4 samples period, inverted by a 2 samples shift */
+static inline int is_subcarrier(uint32_t w)
+{
+	return (popcount32(w ^ rotl32(w, 2)) >= 24);
+}
+
+/*
+ * Noise free subcarrier closest to a subcarrier word, the phase reference
+ * of the frame: a noisy sample or the start of the subcarrier in the
+ * word would be taken for a phase change in every etu.
+ */
+static inline uint32_t subcarrier_ref(uint32_t w)
+{
+	uint32_t a = popcount32(w ^ 0x33333333);
+	uint32_t b = popcount32(w ^ 0x66666666);
+	uint32_t ref_a = (a > 16) ? 0xCCCCCCCC : 0x33333333;
+	uint32_t ref_b = (b > 16) ? 0x99999999 : 0x66666666;
+
+	a = (a > 16) ? 32 - a : a;
+	b = (b > 16) ? 32 - b : b;
+	return (a <= b) ? ref_a : ref_b;
+}
+
+/* No modulation, one noisy sample allowed */
+static inline int is_constant(uint32_t w)
+{
+	uint32_t n = popcount32(w);
+
+	return (n <= 1 || n >= 31);
+}
+
+static inline uint32_t level(uint32_t w)
+{
+	return (popcount32(w) > 16) ? 0xFFFFFFFF : 0;
+}
+
+void sniff_14443b_init(sniff_14443b_t *d)
+{
+	d->state = SNIFF_14443B_ST_IDLE;
+	d->dir = 0;
+	d->count = 0;
+	d->nb_bit = 0;
+	d->byte = 0;
+	d->lsh = 0;
+	d->prev = 0;
+	d->ref = 0;
+}
+
+static inline void sniff_14443b_reset(sniff_14443b_t *d)
+{
+	d->state = SNIFF_14443B_ST_IDLE;
+	d->count = 0;
+}
+
+/* Looks for a PICC subcarrier or the start of a PCD SOF */
+static void sniff_14443b_search(sniff_14443b_t *d, uint32_t samples)
+{
+	if (is_subcarrier(samples)) {
+		d->dir = SNIFF_14443B_PICC;
+		d->ref = subcarrier_ref(samples);
+		d->state = SNIFF_14443B_ST_TR1;
+	} else if (is_constant(samples) && level(samples) == d->ref) {
+		/* Idle level */
+		if (d->count < IDLE_MIN)
+			d->count++;
+	} else if (d->count >= IDLE_MIN && edge_end(samples ^ d->ref)) {
+		/* First etu of the SOF starts on the first modulated sample */
+		d->dir = SNIFF_14443B_PCD;
+		d->lsh = edge_offset(samples ^ d->ref);
+		d->count = 0;
+		d->state = SNIFF_14443B_ST_SOF_LOW;
+	} else {
+		d->ref = level(samples);
+		d->count = 0;
+	}
+}
+
+/* Waits for the first phase reversal of the PICC subcarrier (SOF) */
+static void sniff_14443b_tr1(sniff_14443b_t *d, uint32_t samples)
+{
+	uint32_t diff;
+
+	if (!is_subcarrier(samples)) {
+		sniff_14443b_reset(d);
+		return;
+	}
+
+	diff = samples ^ d->ref;
+	if (popcount32(diff) >= EDGE_MIN && edge_end(diff)) {
+		d->lsh = edge_offset(diff);
+		/* Phase of the subcarrier in the etus */
+		d->ref = rotl32(d->ref, d->lsh);
+		d->count = 0;
+		d->state = SNIFF_14443B_ST_SOF_LOW;
+	}
+}
+
+/* Framing of the etu bits, common to PCD and PICC */
+static sniff_14443b_event_t sniff_14443b_bit(sniff_14443b_t *d, uint32_t bit)
+{
+	switch (d->state) {
+	case SNIFF_14443B_ST_SOF_LOW:
+		if (!bit) {
+			if (++d->count > SOF_LOW_MAX)
+				sniff_14443b_reset(d);
+		} else if (d->count >= SOF_LOW_MIN) {
+			d->count = 1;
+			d->state = SNIFF_14443B_ST_SOF_HIGH;
+			return SNIFF_14443B_SOF;
+		} else if (d->dir == SNIFF_14443B_PCD) {
+			/* Noise, back to the idle level */
+			d->state = SNIFF_14443B_ST_IDLE;
+			d->count = IDLE_MIN;
+		} else {
+			sniff_14443b_reset(d);
+		}
+		break;
+
+	case SNIFF_14443B_ST_SOF_HIGH:
+	case SNIFF_14443B_ST_EGT:
+		if (bit) {
+			if (++d->count > (d->state == SNIFF_14443B_ST_EGT ? EGT_MAX : SOF_HIGH_MAX)) {
+				sniff_14443b_reset(d);
+				return SNIFF_14443B_ERROR;
+			}
+		} else {
+			/* Start bit */
+			d->nb_bit = 0;
+			d->byte = 0;
+			d->state = SNIFF_14443B_ST_DATA;
+		}
+		break;
+
+	case SNIFF_14443B_ST_DATA:
+		d->byte |= bit << d->nb_bit;
+		if (++d->nb_bit == 8)
+			d->state = SNIFF_14443B_ST_STOP;
+		break;
+
+	case SNIFF_14443B_ST_STOP:
+		if (bit) {
+			d->count = 0;
+			d->state = SNIFF_14443B_ST_EGT;
+			return SNIFF_14443B_BYTE;
+		}
+		/* 10 etu at 0 is the EOF */
+		sniff_14443b_reset(d);
+		return (d->byte == 0) ? SNIFF_14443B_EOF : SNIFF_14443B_ERROR;
+	}
+
+	return SNIFF_14443B_NONE;
+}
+
+/*
+ * Feeds the next 32 samples, returns an event at most once per word as
+ * one word is one etu.
+ */
+sniff_14443b_event_t sniff_14443b_word(sniff_14443b_t *d, uint32_t samples)
+{
+	sniff_14443b_event_t ev = SNIFF_14443B_NONE;
+	uint32_t etu;
+
+	switch (d->state) {
+	case SNIFF_14443B_ST_IDLE:
+		sniff_14443b_search(d, samples);
+		break;
+
+	case SNIFF_14443B_ST_TR1:
+		sniff_14443b_tr1(d, samples);
+		break;
+
+	default:
+		/* Start of a PICC subcarrier, not a PCD modulation */
+		if (d->dir == SNIFF_14443B_PCD && d->state == SNIFF_14443B_ST_SOF_LOW &&
+		    is_subcarrier(samples)) {
+			d->dir = SNIFF_14443B_PICC;
+			d->ref = subcarrier_ref(samples);
+			d->state = SNIFF_14443B_ST_TR1;
+			break;
+		}
+
+		/* etu starting at sample lsh of the previous word */
+		etu = d->lsh ? (d->prev << d->lsh) | (samples >> (32 - d->lsh)) : d->prev;
+		ev = sniff_14443b_bit(d, popcount32((etu ^ d->ref) & ETU_MIDDLE) < 8);
+
+		/* PICC subcarrier lost before the EOF */
+		if (sniff_14443b_in_frame(d) && d->dir == SNIFF_14443B_PICC &&
+		    is_constant(samples) && ev == SNIFF_14443B_NONE) {
+			if (d->state != SNIFF_14443B_ST_SOF_LOW)
+				ev = SNIFF_14443B_ERROR;
+			sniff_14443b_reset(d);
+		}
+		break;
+	}
+
+	d->prev = samples;
+	return ev;
+}
@@ -0,0 +1,82 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2015 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _HYDRANFC_SNIFF_14443B_H_
+#define _HYDRANFC_SNIFF_14443B_H_
+
+#include <stdint.h>
+
+/*
+ * ISO14443B 106kbps real-time decoder of the TRF7970A subcarrier output
+ * sampled at 3.39MHz: one etu (128/fc) is 32 samples, one DMA word.
+ *
+ * PCD frames (10% ASK NRZ-L) are seen as a level, the idle level (no
+ * modulation) is logic 1 whatever its polarity.
+ * PICC frames (BPSK of the 847.5KHz subcarrier) are seen as a square wave
+ * of 4 samples period, the phase of the subcarrier before the SOF (TR1) is
+ * logic 1.
+ *
+ * Both then use the same framing: SOF (10-11 etu at 0, 2-3 etu at 1),
+ * characters (start bit 0, 8 data bits LSB first, stop bit 1, extra
+ * guard time at 1) and EOF (10-11 etu at 0).
+ */
+
+/* Frame direction */
+#define SNIFF_14443B_PCD	(1)
+#define SNIFF_14443B_PICC	(2)
+
+/* Events returned by sniff_14443b_word() */
+typedef enum {
+	SNIFF_14443B_NONE = 0,
+	SNIFF_14443B_SOF, /* Start of frame, see dir */
+	SNIFF_14443B_BYTE, /* New character, see byte */
+	SNIFF_14443B_EOF, /* End of frame */
+	SNIFF_14443B_ERROR, /* Framing error or signal lost, frame ended */
+} sniff_14443b_event_t;
+
+/* Decoder states */
+typedef enum {
+	SNIFF_14443B_ST_IDLE = 0,
+	SNIFF_14443B_ST_TR1, /* PICC subcarrier without modulation */
+	SNIFF_14443B_ST_SOF_LOW,
+	SNIFF_14443B_ST_SOF_HIGH,
+	SNIFF_14443B_ST_DATA,
+	SNIFF_14443B_ST_STOP,
+	SNIFF_14443B_ST_EGT,
+} sniff_14443b_state_t;
+
+typedef struct {
+	uint8_t state; /* sniff_14443b_state_t */
+	uint8_t dir;
+	uint8_t count; /* etus in the current state */
+	uint8_t nb_bit;
+	uint8_t byte;
+	uint8_t lsh; /* Offset of the etus in the DMA words */
+	uint32_t prev; /* Previous DMA word */
+	uint32_t ref; /* Logic 1 etu: idle level (PCD) or subcarrier phase (PICC) */
+} sniff_14443b_t;
+
+void sniff_14443b_init(sniff_14443b_t *d);
+sniff_14443b_event_t sniff_14443b_word(sniff_14443b_t *d, uint32_t samples);
+
+static inline int sniff_14443b_in_frame(const sniff_14443b_t *d)
+{
+	return (d->state >= SNIFF_14443B_ST_SOF_LOW);
+}
+
+#endif /* _HYDRANFC_SNIFF_14443B_H_ */
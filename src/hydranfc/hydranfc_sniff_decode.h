@@ -0,0 +1,202 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2015 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _HYDRANFC_SNIFF_DECODE_H_
+#define _HYDRANFC_SNIFF_DECODE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Word at a time version of the downsample_4x[] lookups:
+ *  ds  = downsample_4x[f_data >> 24] << 6;
+ *  ds |= downsample_4x[(f_data >> 16) & 0xFF] << 4;
+ *  ds |= downsample_4x[(f_data >> 8) & 0xFF] << 2;
+ *  ds |= downsample_4x[f_data & 0xFF];
+ *
+ * Each nibble of f_data gives one bit of the result, set if the nibble
+ * has two adjacent bits set. downsample_4x[] has two exceptions to this
+ * rule, 0x63 and 0x66 give 2 instead of 3, they are kept so the decoded
+ * frames do not change.
+ *
+ * On Cortex-M4 (CMSIS included through hal.h) the exceptions are found
+ * with USUB8/SEL, else with the portable zero byte test.
+ */
+__attribute__ ((always_inline)) static inline
+uint8_t sniff_downsample_4x(uint32_t f_data)
+{
+	uint32_t nib, fix, zero;
+
+	/* Bit 0 of each nibble: two adjacent bits set in the nibble */
+	nib = f_data & (f_data >> 1) & 0x77777777;
+	nib = (nib | (nib >> 1) | (nib >> 2)) & 0x11111111;
+
+	/* Bytes 0x63 or 0x66 (0x62-0x67 without 0x62/0x67) */
+	fix = (f_data & 0xFAFAFAFA) ^ 0x62626262;
+#if defined(__CORTEX_M) && defined(__ARM_FEATURE_DSP)
+	(void)__USUB8(fix, 0x01010101); /* GE set on non zero bytes */
+	zero = __SEL(0, 0x01010101);
+#else
+	zero = ~(((fix & 0x7F7F7F7F) + 0x7F7F7F7F) | fix);
+	zero = (zero >> 7) & 0x01010101;
+#endif
+	zero &= ~(f_data & (f_data >> 2));
+	nib &= ~zero;
+
+	/* Gather the 8 nibble bits: 2 bits per byte then one multiply */
+	nib = (nib | (nib >> 3)) & 0x03030303;
+	return (uint8_t)((nib * 0x00041041) >> 18);
+}
+
+/*
+ * ISO14443A 106kbps frame decoder, one DMA word (32 samples at 3.39MHz,
+ * one bit) at a time, same result as the miller_modified_106kb[] and
+ * manchester_106kb[] lookups of the original loop:
+ * - the first edge of the frame is aligned on bit 31 with CLZ, the
+ *   aligned word is taken from two DMA words with one 64 bits shift
+ *   (no shift by 32, which differs between Cortex-M and the host),
+ * - the bit tables are bits set when both the high and the low nibble of
+ *   the downsampled byte are in a mask, held in a register: Miller
+ *   Modified is high nibble 0xF and low nibble 0/1/3/8/9/C, Manchester
+ *   is high nibble 0xA-0xF and low nibble 0/1,
+ * - the end of frame counter (two repeated all 0 or all 1 words) and
+ *   the data/parity bits are updated without branches, a branch is
+ *   taken at the end of each byte.
+ */
+#define SNIFF_14443A_MILLER_MASKS	((0x8000 << 16) | 0x130B)
+#define SNIFF_14443A_MANCHESTER_MASKS	((0xFC00 << 16) | 0x0003)
+/*
+ * Miller frames without start bit are shifted by this number of samples
+ * (2 to 3.1us pause => 7 to 11 samples, average 9 + 6 margin), the
+ * samples shifted in are 1.
+ */
+#define SNIFF_14443A_MILLER_RESYNC	(15)
+
+/* sniff_14443a_word() results */
+#define SNIFF_14443A_BIT	(0) /* Data bit added to the byte */
+#define SNIFF_14443A_BYTE	(1) /* byte and parity are set */
+#define SNIFF_14443A_EOF	(2) /* End of frame, the word is not decoded */
+
+typedef struct {
+	uint32_t word; /* Last DMA word */
+	uint32_t rsh; /* 32 - shift aligning the first edge on bit 31 */
+	uint32_t last; /* Previous DMA word, end of frame detection */
+	uint32_t idle; /* Repeated all 0 or all 1 words */
+	uint32_t miller_rsh;
+	uint32_t miller_fill;
+	uint32_t masks; /* SNIFF_14443A_xxx_MASKS */
+	uint32_t acc; /* Data bits then parity bit, LSB first */
+	uint32_t nb_bits;
+	uint8_t byte;
+	uint8_t parity;
+} sniff_14443a_t;
+
+__attribute__ ((always_inline)) static inline
+uint32_t sniff_clz(uint32_t x)
+{
+#if defined(__CORTEX_M)
+	return __CLZ(x);
+#else
+	return x ? (uint32_t)__builtin_clz(x) : 32;
+#endif
+}
+
+/* 32 bits of hi:lo starting rsh bits from the right of hi, rsh 0 to 32 */
+__attribute__ ((always_inline)) static inline
+uint32_t sniff_14443a_align(uint32_t hi, uint32_t lo, uint32_t rsh)
+{
+	return (uint32_t)((((uint64_t)hi << 32) | lo) >> rsh);
+}
+
+/**
+  * @brief  Start of frame, aligns the first edge of the DMA words.
+  * @param  d: decoder state
+  * @param  old_bit: level before the first word
+  * @param  first: first DMA word with an edge
+  * @param  next: next DMA word
+  * @retval downsampled start bit, see detected_protocol[]
+  */
+__attribute__ ((always_inline)) static inline
+uint8_t sniff_14443a_sync(sniff_14443a_t *d, uint32_t old_bit,
+			  uint32_t first, uint32_t next)
+{
+	uint32_t f_data;
+
+	d->rsh = 32 - sniff_clz(old_bit ? ~first : first);
+	f_data = sniff_14443a_align(first, next, d->rsh);
+	d->word = next;
+	d->last = f_data;
+	d->idle = 0;
+	d->acc = 0;
+	d->nb_bits = 0;
+	return sniff_downsample_4x(f_data);
+}
+
+/**
+  * @brief  Select the bit coding of the frame.
+  * @param  d: decoder state
+  * @param  manchester: Manchester (PICC) else Miller Modified (PCD)
+  * @param  resync: Miller frame without start bit
+  * @retval None
+  */
+__attribute__ ((always_inline)) static inline
+void sniff_14443a_coding(sniff_14443a_t *d, bool manchester, bool resync)
+{
+	d->masks = manchester ? SNIFF_14443A_MANCHESTER_MASKS :
+		   SNIFF_14443A_MILLER_MASKS;
+	d->miller_rsh = resync ? SNIFF_14443A_MILLER_RESYNC : 0;
+	d->miller_fill = resync ? (0xFFFFFFFF << (32 - SNIFF_14443A_MILLER_RESYNC)) : 0;
+}
+
+/**
+  * @brief  Decode the bit of a DMA word.
+  * @param  d: decoder state
+  * @param  next: next DMA word
+  * @retval SNIFF_14443A_BIT, SNIFF_14443A_BYTE or SNIFF_14443A_EOF
+  */
+__attribute__ ((always_inline)) static inline
+uint32_t sniff_14443a_word(sniff_14443a_t *d, uint32_t next)
+{
+	uint32_t f_data, idle;
+	uint8_t ds_data;
+
+	f_data = sniff_14443a_align(d->word, next, d->rsh);
+	d->word = next;
+
+	/* Counts the repeated 0x00000000/0xFFFFFFFF words, else restarts */
+	idle = (next == d->last) & ((next + 1) <= 1);
+	d->idle = (d->idle + 1) & (0 - idle);
+	d->last = next;
+	if (d->idle > 1)
+		return SNIFF_14443A_EOF;
+
+	f_data = (f_data >> d->miller_rsh) | d->miller_fill;
+	ds_data = sniff_downsample_4x(f_data);
+	d->acc |= ((d->masks >> (16 + (ds_data >> 4))) &
+		   (d->masks >> (ds_data & 0x0F)) & 1) << d->nb_bits;
+	if (++d->nb_bits < 9)
+		return SNIFF_14443A_BIT;
+
+	d->byte = d->acc;
+	d->parity = d->acc >> 8;
+	d->acc = 0;
+	d->nb_bits = 0;
+	return SNIFF_14443A_BYTE;
+}
+
+#endif /* _HYDRANFC_SNIFF_DECODE_H_ */
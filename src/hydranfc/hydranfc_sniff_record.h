@@ -0,0 +1,159 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2015 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _HYDRANFC_SNIFF_RECORD_H_
+#define _HYDRANFC_SNIFF_RECORD_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+/*
+ * Binary record format of the NFC sniffer ("sniff record" option), see
+ * contrib/nfc_sniff_record to convert it to text or PCAP.
+ *
+ * All fields are little endian, the file starts with an 8 bytes header:
+ *  - magic "HNFR"
+ *  - version (uint8_t) then 3 reserved bytes
+ * followed by one record per frame, each record starts on 4 bytes:
+ *  - type (uint8_t), see SNIFF_RECORD_xxx
+ *  - flags (uint8_t), see SNIFF_RECORD_FLAG_xxx
+ *  - length (uint16_t), number of payload bytes
+ *  - timestamp (uint32_t), CPU cycles (168MHz) at start of frame
+ *  - duration (uint32_t), frame duration in CPU cycles, 0 if not measured
+ *  - sample (uint8_t), downsampled first symbol of the frame (the "Uxx"
+ *    value of the text output for unknown frames) then 3 reserved bytes
+ *  - payload (length bytes)
+ *  - parity ((length+7) / 8 bytes) if SNIFF_RECORD_FLAG_PARITY, the parity
+ *    bit of payload byte n is bit (n % 8) of byte (n / 8)
+ *  - padding to the next multiple of 4 bytes
+ */
+
+#define SNIFF_RECORD_MAGIC	(0x52464e48) /* "HNFR" */
+#define SNIFF_RECORD_VERSION	(1)
+#define SNIFF_RECORD_FILE_HDR_SIZE	(8)
+#define SNIFF_RECORD_HDR_SIZE	(16)
+
+/* Record types */
+#define SNIFF_RECORD_PCD	(1) /* TypeA reader, Miller Modified 106kbps */
+#define SNIFF_RECORD_PICC	(2) /* TypeA tag, Manchester 106kbps */
+#define SNIFF_RECORD_UNKNOWN	(3) /* Unknown start of frame, decoded as PCD */
+
+/* Record flags */
+#define SNIFF_RECORD_FLAG_PARITY	(1 << 0)
+#define SNIFF_RECORD_FLAG_DURATION	(1 << 1)
+
+/*
+ * Record encoder: each function writes at buf[i], a multiple of 4, and
+ * returns the index after the output.
+ * Payload bytes are gathered and stored by words, parity bits are kept in
+ * the parity buffer until the end of the record.
+ */
+typedef struct {
+	uint32_t pos;		/* Index of the record header */
+	uint32_t len;
+	uint32_t word;		/* Payload bytes not yet stored */
+	uint8_t type;
+	uint8_t *parity;
+	uint32_t parity_size;	/* Parity bits of longer frames are not kept */
+} sniff_record_t;
+
+__attribute__ ((always_inline)) static inline
+uint32_t sniff_record_file_header(uint8_t *buf, uint32_t i)
+{
+	uint32_t *hdr = (uint32_t *)&buf[i];
+
+	hdr[0] = SNIFF_RECORD_MAGIC;
+	hdr[1] = SNIFF_RECORD_VERSION;
+	return i + SNIFF_RECORD_FILE_HDR_SIZE;
+}
+
+__attribute__ ((always_inline)) static inline
+uint32_t sniff_record_start(sniff_record_t *r, uint8_t *buf, uint32_t i,
+			    uint8_t type, uint8_t sample, uint32_t nb_cycles)
+{
+	uint32_t *hdr = (uint32_t *)&buf[i];
+
+	hdr[1] = nb_cycles;
+	hdr[3] = sample;
+	r->pos = i;
+	r->type = type;
+	r->len = 0;
+	r->word = 0;
+	return i + SNIFF_RECORD_HDR_SIZE;
+}
+
+__attribute__ ((always_inline)) static inline
+uint32_t sniff_record_byte(sniff_record_t *r, uint8_t *buf, uint32_t i,
+			   uint8_t data, uint8_t parity)
+{
+	uint32_t n = r->len;
+
+	r->word |= (uint32_t)data << ((n & 3) * 8);
+	if ((n & 3) == 3) {
+		*(uint32_t *)&buf[i] = r->word;
+		i += 4;
+		r->word = 0;
+	}
+
+	if (n < r->parity_size * 8) {
+		if ((n & 7) == 0)
+			r->parity[n >> 3] = parity;
+		else
+			r->parity[n >> 3] |= parity << (n & 7);
+	}
+	r->len++;
+	return i;
+}
+
+/* Returns capacity if the parity bits do not fit before it */
+__attribute__ ((always_inline)) static inline
+uint32_t sniff_record_end(sniff_record_t *r, uint8_t *buf, uint32_t i,
+			  uint32_t capacity, bool has_duration, uint32_t duration)
+{
+	uint32_t *hdr = (uint32_t *)&buf[r->pos];
+	uint32_t flags = 0;
+	uint32_t parity_size, j;
+
+	if (r->len & 3) {
+		*(uint32_t *)&buf[i] = r->word;
+		i += 4;
+	}
+
+	parity_size = (r->len + 7) / 8;
+	if (parity_size <= r->parity_size) {
+		if (i + parity_size + 3 < capacity) {
+			flags |= SNIFF_RECORD_FLAG_PARITY;
+			memcpy(&buf[i], r->parity, parity_size);
+			for (j = parity_size; j & 3; j++)
+				buf[i + j] = 0;
+			i += j;
+		} else {
+			i = capacity;
+		}
+	}
+
+	if (has_duration)
+		flags |= SNIFF_RECORD_FLAG_DURATION;
+
+	hdr[0] = r->type | (flags << 8) | (r->len << 16);
+	hdr[2] = duration;
+	return i;
+}
+
+#endif /* _HYDRANFC_SNIFF_RECORD_H_ */
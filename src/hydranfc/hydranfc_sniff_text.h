@@ -0,0 +1,87 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2015 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _HYDRANFC_SNIFF_TEXT_H_
+#define _HYDRANFC_SNIFF_TEXT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Text output of the NFC sniffer, one line per frame:
+ *  "\r\n" timestamp "\t" tag "\t" bytes [ "\t" duration ]
+ * timestamp and duration in CPU cycles as 8 hex digits, tag "RDR", "TAG"
+ * or "U" and the downsampled first symbol, bytes as 2 hex digits
+ * separated by a space.
+ * Each function writes at buf[i] and returns the index after the output.
+ */
+
+/* Lower case hex digits, in RAM */
+extern uint8_t htoa[16];
+
+#define SNIFF_TEXT_START_SIZE	(15)
+
+__attribute__ ((always_inline)) static inline
+uint32_t sniff_text_u32(uint8_t *buf, uint32_t i, uint32_t val)
+{
+	buf[i+0] = htoa[(val >> 28) & 0x0F];
+	buf[i+1] = htoa[(val >> 24) & 0x0F];
+	buf[i+2] = htoa[(val >> 20) & 0x0F];
+	buf[i+3] = htoa[(val >> 16) & 0x0F];
+	buf[i+4] = htoa[(val >> 12) & 0x0F];
+	buf[i+5] = htoa[(val >> 8) & 0x0F];
+	buf[i+6] = htoa[(val >> 4) & 0x0F];
+	buf[i+7] = htoa[val & 0x0F];
+	return i + 8;
+}
+
+__attribute__ ((always_inline)) static inline
+uint32_t sniff_text_start(uint8_t *buf, uint32_t i, uint32_t nb_cycles,
+			  uint8_t tag0, uint8_t tag1, uint8_t tag2)
+{
+	buf[i+0] = '\r';
+	buf[i+1] = '\n';
+	sniff_text_u32(buf, i + 2, nb_cycles);
+	buf[i+10] = '\t';
+	buf[i+11] = tag0;
+	buf[i+12] = tag1;
+	buf[i+13] = tag2;
+	buf[i+14] = '\t';
+	return i + SNIFF_TEXT_START_SIZE;
+}
+
+__attribute__ ((always_inline)) static inline
+uint32_t sniff_text_8b(uint8_t *buf, uint32_t i, uint8_t data, bool add_space)
+{
+	buf[i+0] = htoa[(data & 0xF0) >> 4];
+	buf[i+1] = htoa[(data & 0x0F)];
+	if (add_space) {
+		buf[i+2] = ' ';
+		return i + 3;
+	}
+	return i + 2;
+}
+
+__attribute__ ((always_inline)) static inline
+uint32_t sniff_text_duration(uint8_t *buf, uint32_t i, uint32_t nb_cycles)
+{
+	buf[i] = '\t';
+	return sniff_text_u32(buf, i + 1, nb_cycles);
+}
+
+#endif /* _HYDRANFC_SNIFF_TEXT_H_ */
@@ -0,0 +1,128 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2015 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ch.h"
+#include "hal.h"
+
+#include "common.h"
+#include "microsd.h"
+#include "hydranfc_sniff_writer.h"
+
+/* FatFs and the SDC driver run on this stack */
+static THD_WORKING_AREA(wa_sniff_writer, 1024);
+
+static THD_FUNCTION(sniff_writer_thread, arg)
+{
+	sniff_writer_t *w = arg;
+
+	chRegSetThreadName("NFC sniff writer");
+
+	while (TRUE) {
+		chSemWait(&w->sem);
+		if (chThdShouldTerminateX())
+			break;
+
+		if (file_write(w->file, w->half[w->pending], w->pending_len))
+			w->written += w->pending_len;
+		else
+			w->error = TRUE;
+
+		w->pending = -1;
+	}
+}
+
+/*
+ * Splits buffer in two halves and starts the writer thread, file shall be
+ * already opened.
+ * The sniffer busy-waits for its data with the kernel locked, so the writer
+ * gets a priority above it: it runs as soon as a half is submitted, and
+ * then each time the sniffer unlocks the kernel (between frames) to let the
+ * SDC interrupts wake it up.
+ */
+void sniff_writer_start(sniff_writer_t *w, FIL *file, uint8_t *buffer, uint32_t size)
+{
+	w->file = file;
+	w->half_size = size / 2;
+	w->half[0] = buffer;
+	w->half[1] = buffer + w->half_size;
+	w->active = 0;
+	w->pending = -1;
+	w->pending_len = 0;
+	w->written = 0;
+	w->dropped = 0;
+	w->backlog_max = 0;
+	w->error = FALSE;
+	chSemObjectInit(&w->sem, 0);
+
+	w->thread = chThdCreateStatic(wa_sniff_writer, sizeof(wa_sniff_writer),
+				      chThdGetPriorityX() + 1,
+				      sniff_writer_thread, w);
+}
+
+/*
+ * Hands the len bytes of the active half to the writer, called with the
+ * kernel locked.
+ * Returns the half to fill next, or NULL if the writer is still busy with
+ * the other one, in that case the sniffer keeps filling the active half.
+ */
+uint8_t *sniff_writer_submitS(sniff_writer_t *w, uint32_t len)
+{
+	uint32_t backlog;
+
+	backlog = len;
+	if (w->pending >= 0)
+		backlog += w->pending_len;
+	if (backlog > w->backlog_max)
+		w->backlog_max = backlog;
+
+	if (w->pending >= 0)
+		return NULL;
+
+	w->pending_len = len;
+	w->pending = w->active;
+	w->active ^= 1;
+	chSemSignalI(&w->sem);
+	chSchRescheduleS();
+
+	return w->half[w->active];
+}
+
+/*
+ * Waits for the pending half, writes the len bytes of the active half,
+ * stops the writer and closes the file.
+ */
+bool sniff_writer_stop(sniff_writer_t *w, uint32_t len)
+{
+	while (w->pending >= 0)
+		chThdSleepMilliseconds(1);
+
+	chThdTerminate(w->thread);
+	chSemSignal(&w->sem);
+	chThdWait(w->thread);
+
+	if (len > 0) {
+		if (file_write(w->file, w->half[w->active], len))
+			w->written += len;
+		else
+			w->error = TRUE;
+	}
+	if (!file_close(w->file))
+		w->error = TRUE;
+
+	return !w->error;
+}
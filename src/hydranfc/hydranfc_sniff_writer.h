@@ -0,0 +1,58 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2015 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _HYDRANFC_SNIFF_WRITER_H_
+#define _HYDRANFC_SNIFF_WRITER_H_
+
+#include "ch.h"
+#include "ff.h"
+
+/* A half is handed to the writer once it holds at least this many bytes */
+#define SNIFF_WRITER_FLUSH_SIZE (8192)
+/* Room kept at the end of each half for the writes of a frame in progress */
+#define SNIFF_WRITER_MARGIN (512)
+
+/*
+ * Double buffer between the sniffer and a writer thread saving to a file.
+ * The sniffer fills the active half while the other one is written.
+ */
+typedef struct {
+	FIL *file;
+	uint8_t *half[2];
+	uint32_t half_size;
+	uint8_t active; /* Half filled by the sniffer */
+	volatile int8_t pending; /* Half being written, -1 if none */
+	volatile uint32_t pending_len;
+	semaphore_t sem;
+	thread_t *thread;
+	uint32_t written; /* Bytes written in the file */
+	uint32_t dropped; /* Frames dropped because both halves were full */
+	uint32_t backlog_max; /* Max bytes waiting for the writer */
+	bool error;
+} sniff_writer_t;
+
+void sniff_writer_start(sniff_writer_t *w, FIL *file, uint8_t *buffer, uint32_t size);
+uint8_t *sniff_writer_submitS(sniff_writer_t *w, uint32_t len);
+bool sniff_writer_stop(sniff_writer_t *w, uint32_t len);
+
+static inline bool sniff_writer_busy(sniff_writer_t *w)
+{
+	return (w->pending >= 0);
+}
+
+#endif /* _HYDRANFC_SNIFF_WRITER_H_ */
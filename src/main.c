@@ -39,6 +39,7 @@
 #include "hydrabus/hydrabus_bbio.h"
 #include "hydrabus/hydrabus_sump.h"
 #include "hydrabus/hydrabus_serprog.h"
+#include "hydrabus/hydrabus_detect.h"
 
 #include "bsp.h"
 #include "bsp_print_dbg.h"
@@ -72,48 +73,91 @@ t_hydra_console consoles[] = {
 THD_FUNCTION(console, arg)
 {
 	t_hydra_console *con;
-	char input;
-	int i=0;
+	uint8_t input[CONSOLE_INPUT_SIZE];
+	size_t nb_input, i;
+	detect_t detect;
+	detect_result_t mode;
 
 	con = arg;
 	chRegSetThreadName(con->thread_name);
 	tl_init(con->tl, tl_tokens, tl_dict, print, con);
 	con->tl->prompt = PROMPT;
 	tl_set_callback(con->tl, execute);
+	detect_init(&detect);
 
 	if(is_file_present(INIT_SCRIPT_NAME)) {
 		execute_script(con,INIT_SCRIPT_NAME);
 	}
 
 	while (1) {
-		input = get_char(con);
-		switch(input) {
-		case 0:
-			if (++i == 20) {
-				cmd_bbio(con);
-				i=0;
+		/* Wait for the first byte then get all the available ones */
+		nb_input = chnRead(con->sdu, input, 1);
+		if (nb_input == 0) {
+			/* USB not active */
+			chThdSleepMilliseconds(1);
+			continue;
+		}
+		nb_input += chnReadTimeout(con->sdu, input + 1,
+					   sizeof(input) - 1, TIME_IMMEDIATE);
+
+		for (i = 0; i < nb_input; i++) {
+			mode = detect_push(&detect, input[i]);
+			if (mode == DETECT_NONE) {
+				continue;
+			} else if (mode == DETECT_INPUT) {
+				tl_input(con->tl, input[i]);
+				continue;
 			}
-			break;
-		/* SUMP identification is 5*\x00 \x02 */
-		/* Allows to enter SUMP mode autmomatically */
-		case 2:
-			if(i == 5) {
+			/* The binary mode reads the rest of the input */
+			console_unread(con, &input[i + 1], nb_input - i - 1);
+			switch(mode) {
+			case DETECT_BBIO:
+				console_set_raw(con, TRUE);
+				cmd_bbio(con);
+				break;
+			case DETECT_SUMP:
+				console_set_raw(con, TRUE);
 				cprintf(con, "1ALS");
 				sump(con);
-			}
-			break;
-		/* SERPROG identification is 8*\x00, then \x10 */
-		/* Enter SERPROG mode automatically */
-		case 0x10:
-			if(i == 8) {
+				break;
+			case DETECT_SERPROG:
+				console_set_raw(con, TRUE);
 				bbio_mode_serprog(con);
+				break;
+			default:
+				break;
 			}
+			console_set_raw(con, FALSE);
 			break;
-		default:
-			i=0;
-			tl_input(con->tl, input);
 		}
-		chThdSleepMilliseconds(1);
+		/* Echo of the input */
+		console_flush(con);
+	}
+}
+
+/*
+ * Sends the buffered output of the consoles without waiting for USB and
+ * writes the complete sectors of the logs, see stream_write().
+ * The stack is sized for the FatFs and SDC driver calls of the log writes.
+ * It runs above the console threads, which may loop without blocking
+ * (sniffers, continuous reads) and would otherwise never let it run.
+ */
+static THD_WORKING_AREA(waConsoleFlush, 1024);
+static THD_FUNCTION(console_flush_thread, arg)
+{
+	int i;
+
+	(void)arg;
+	chRegSetThreadName("console flush");
+
+	while (TRUE) {
+		chThdSleepMilliseconds(CONSOLE_FLUSH_PERIOD_MS);
+		for (i = 0; i < (int)ARRAY_SIZE(consoles); i++) {
+			if (consoles[i].out.len > 0)
+				console_flush_nowait(&consoles[i]);
+			if (consoles[i].log_file.obj.fs)
+				console_flush_log_sectors(&consoles[i]);
+		}
 	}
 }
 
@@ -164,6 +208,12 @@ int main(void)
 	/* Initialize memory pool */
 	pool_init();
 
+	/* Initialize consoles output buffers */
+	for (i = 0; i < (int)ARRAY_SIZE(consoles); i++)
+		console_init(&consoles[i]);
+	chThdCreateStatic(waConsoleFlush, sizeof(waConsoleFlush), NORMALPRIO + 1,
+			  console_flush_thread, NULL);
+
 	/*
 	 * Initializes a serial-over-USB CDC driver.
 	 */
@@ -173,6 +223,9 @@ int main(void)
 	sduObjectInit(&SDU2);
 	sduStart(&SDU2, &serusb2cfg);
 
+	for (i = 0; i < (int)ARRAY_SIZE(consoles); i++)
+		console_input_init(&consoles[i]);
+
 	/*
 	 * Activates the USB1 & 2 driver and then the USB bus pull-up on D+.
 	 * Note, a delay is inserted in order to not have to disconnect the cable
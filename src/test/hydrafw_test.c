@@ -0,0 +1,186 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host test and benchmark runner of the firmware modules.
+ * Usage: hydrafw_test [test|bench] [name]
+ * Runs all the tests (or benchmarks) or only the ones named name.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "test.h"
+
+int test_adc_stream(void);
+int test_alloc(void);
+int test_bbio_can(void);
+int test_bbio_i2c(void);
+int test_bbio_spi(void);
+int test_bbio_uart(void);
+int test_can_filter(void);
+int test_can_replay(void);
+int test_can_ring(void);
+int test_console_out(void);
+int test_detect(void);
+int test_i2c_sniff(void);
+int test_isotp(void);
+int test_jtag(void);
+int test_nfc_14443a(void);
+int test_nfc_14443b(void);
+int test_nfc_encode(void);
+int test_pcapng(void);
+int test_serprog(void);
+int test_spi_flash(void);
+int test_spi_sniff(void);
+int test_sump_reader(void);
+int test_sump_trigger(void);
+int test_uart_ring(void);
+int test_xfer(void);
+
+int bench_adc_stream(void);
+int bench_alloc(void);
+int bench_bbio_can(void);
+int bench_bbio_i2c(void);
+int bench_bbio_spi(void);
+int bench_bbio_uart(void);
+int bench_can_ring(void);
+int bench_console_out(void);
+int bench_jtag(void);
+int bench_nfc_14443a(void);
+int bench_nfc_encode(void);
+int bench_serprog(void);
+int bench_sump_reader(void);
+int bench_sump_trigger(void);
+
+static const test_case_t tests[] = {
+	{ "adc_stream", test_adc_stream },
+	{ "alloc", test_alloc },
+	{ "bbio_can", test_bbio_can },
+	{ "bbio_i2c", test_bbio_i2c },
+	{ "bbio_spi", test_bbio_spi },
+	{ "bbio_uart", test_bbio_uart },
+	{ "can_filter", test_can_filter },
+	{ "can_replay", test_can_replay },
+	{ "can_ring", test_can_ring },
+	{ "console_out", test_console_out },
+	{ "detect", test_detect },
+	{ "i2c_sniff", test_i2c_sniff },
+	{ "isotp", test_isotp },
+	{ "jtag", test_jtag },
+	{ "nfc_14443a", test_nfc_14443a },
+	{ "nfc_14443b", test_nfc_14443b },
+	{ "nfc_encode", test_nfc_encode },
+	{ "pcapng", test_pcapng },
+	{ "serprog", test_serprog },
+	{ "spi_flash", test_spi_flash },
+	{ "spi_sniff", test_spi_sniff },
+	{ "sump_reader", test_sump_reader },
+	{ "sump_trigger", test_sump_trigger },
+	{ "uart_ring", test_uart_ring },
+	{ "xfer", test_xfer },
+};
+
+static const test_case_t benchs[] = {
+	{ "adc_stream", bench_adc_stream },
+	{ "alloc", bench_alloc },
+	{ "bbio_can", bench_bbio_can },
+	{ "bbio_i2c", bench_bbio_i2c },
+	{ "bbio_spi", bench_bbio_spi },
+	{ "bbio_uart", bench_bbio_uart },
+	{ "can_ring", bench_can_ring },
+	{ "console_out", bench_console_out },
+	{ "jtag", bench_jtag },
+	{ "nfc_14443a", bench_nfc_14443a },
+	{ "nfc_encode", bench_nfc_encode },
+	{ "serprog", bench_serprog },
+	{ "sump_reader", bench_sump_reader },
+	{ "sump_trigger", bench_sump_trigger },
+};
+
+static uint32_t rand_state = 1;
+
+void test_fail(const char *file, int line, const char *cond)
+{
+	printf("  %s:%d: %s failed\n", file, line, cond);
+}
+
+uint64_t test_time_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void bench_report(const char *name, uint64_t ns, uint64_t nb, const char *unit)
+{
+	if(ns == 0)
+		ns = 1;
+	printf("  %-32s %10.2f ns/%s %10.2f M%s/s\n", name,
+	       (double)ns / nb, unit, (double)nb * 1000 / ns, unit);
+}
+
+uint32_t test_rand(void)
+{
+	rand_state ^= rand_state << 13;
+	rand_state ^= rand_state >> 17;
+	rand_state ^= rand_state << 5;
+	return rand_state;
+}
+
+void test_srand(uint32_t seed)
+{
+	rand_state = seed ? seed : 1;
+}
+
+static int run(const test_case_t *list, unsigned int nb, const char *name)
+{
+	unsigned int i, failed = 0, ran = 0;
+
+	for(i = 0; i < nb; i++) {
+		if(name != NULL && strcmp(name, list[i].name))
+			continue;
+		printf("%s\n", list[i].name);
+		test_srand(1);
+		ran++;
+		if(list[i].func()) {
+			printf("  FAIL\n");
+			failed++;
+		}
+	}
+	if(ran == 0) {
+		printf("No test named %s\n", name);
+		return 1;
+	}
+	printf("%u/%u passed\n", ran - failed, ran);
+	return failed ? 1 : 0;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *name = argc > 2 ? argv[2] : NULL;
+
+	if(argc < 2 || !strcmp(argv[1], "test"))
+		return run(tests, sizeof(tests) / sizeof(tests[0]), name);
+	if(!strcmp(argv[1], "bench"))
+		return run(benchs, sizeof(benchs) / sizeof(benchs[0]), name);
+	printf("Usage: %s [test|bench] [name]\n", argv[0]);
+	return 1;
+}
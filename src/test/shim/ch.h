@@ -0,0 +1,126 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host build: the subset of the ChibiOS API used by the firmware modules
+ * run by the host tests. The console streams are simulated channels, see
+ * test/sim_chn.c, the kernel calls do nothing.
+ */
+
+#ifndef _SIM_CH_H_
+#define _SIM_CH_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifndef FALSE
+#define FALSE	false
+#endif
+#ifndef TRUE
+#define TRUE	true
+#endif
+
+typedef uint32_t systime_t;
+typedef uint32_t sysinterval_t;
+typedef int32_t msg_t;
+
+typedef struct {
+	const char *name;
+} thread_t;
+
+typedef struct {
+	int owner;
+} mutex_t;
+
+typedef struct {
+	int count;
+} binary_semaphore_t;
+
+#define MSG_OK		((msg_t)0)
+#define MSG_TIMEOUT	((msg_t)-1)
+
+#define TIME_IMMEDIATE	((sysinterval_t)0)
+#define TIME_INFINITE	((sysinterval_t)-1)
+/* CH_CFG_ST_FREQUENCY is 10kHz */
+#define TIME_MS2I(ms)	((sysinterval_t)(ms) * 10)
+#define TIME_US2I(us)	((sysinterval_t)(us) / 100)
+#define TIME_I2MS(i)	((uint32_t)(i) / 10)
+
+typedef struct sim_chn sim_chn_t;
+typedef sim_chn_t SerialUSBDriver;
+typedef sim_chn_t BaseSequentialStream;
+typedef sim_chn_t BaseChannel;
+
+size_t sim_chn_read(sim_chn_t *chn, void *bp, size_t n, sysinterval_t timeout);
+size_t sim_chn_write(sim_chn_t *chn, const void *bp, size_t n, sysinterval_t timeout);
+
+#define chnRead(ip, bp, n)		sim_chn_read((sim_chn_t *)(ip), (bp), (n), TIME_INFINITE)
+#define chnReadTimeout(ip, bp, n, t)	sim_chn_read((sim_chn_t *)(ip), (bp), (n), (t))
+#define chnWrite(ip, bp, n)		sim_chn_write((sim_chn_t *)(ip), (bp), (n), TIME_INFINITE)
+#define chnWriteTimeout(ip, bp, n, t)	sim_chn_write((sim_chn_t *)(ip), (bp), (n), (t))
+
+#define chSysLock()		do { } while(0)
+#define chSysUnlock()		do { } while(0)
+#define chSysLockFromISR()	do { } while(0)
+#define chSysUnlockFromISR()	do { } while(0)
+
+#define chMtxObjectInit(mp)	((mp)->owner = 0)
+#define chMtxLock(mp)		((mp)->owner = 1)
+#define chMtxUnlock(mp)		((mp)->owner = 0)
+
+#define chBSemObjectInit(bsp, taken)	((bsp)->count = (taken) ? 0 : 1)
+#define chBSemSignalI(bsp)		((bsp)->count = 1)
+#define chBSemSignal(bsp)		((bsp)->count = 1)
+
+static inline msg_t chBSemWaitTimeout(binary_semaphore_t *bsp, sysinterval_t t)
+{
+	(void)t;
+	bsp->count = 0;
+	return MSG_OK;
+}
+
+/* The simulated time does not advance */
+#define chVTGetSystemTime()		((systime_t)0)
+#define chVTTimeElapsedSinceX(start)	((void)(start), (sysinterval_t)0)
+
+/*
+ * There is a single thread: the threads of the modes (capture readers) are
+ * not created and the modes report it as a lack of memory.
+ */
+#define NORMALPRIO			(128)
+#define THD_FUNCTION(tname, arg)	void tname(void *arg)
+typedef void (*tfunc_t)(void *arg);
+
+thread_t *chThdCreateFromHeap(void *heapp, size_t size, const char *name,
+			      int prio, tfunc_t pf, void *arg);
+#define chThdTerminate(tp)		((void)(tp))
+static inline msg_t chThdWait(thread_t *tp)
+{
+	(void)tp;
+	return MSG_OK;
+}
+#define chThdShouldTerminateX()		(true)
+#define chRegSetThreadName(name)	((void)(name))
+
+#define chThdSleepMilliseconds(ms)	((void)(ms))
+#define chThdSleepMicroseconds(us)	((void)(us))
+#define chThdSleep(t)			((void)(t))
+#define chThdYield()			do { } while(0)
+
+#endif /* _SIM_CH_H_ */
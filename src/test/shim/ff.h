@@ -0,0 +1,56 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Host build: the types of the FatFs API, see ch.h */
+
+#ifndef _SIM_FF_H_
+#define _SIM_FF_H_
+
+#include <stdint.h>
+
+typedef unsigned int UINT;
+
+typedef enum {
+	FR_OK = 0,
+	FR_DISK_ERR,
+	FR_NOT_READY = 3,
+	FR_NO_FILE,
+} FRESULT;
+
+typedef struct {
+	void *fs;
+} FFOBJID;
+
+typedef struct {
+	FFOBJID obj;
+} FIL;
+
+typedef uint32_t FSIZE_t;
+
+#define FA_READ			0x01
+#define FA_WRITE		0x02
+#define FA_OPEN_EXISTING	0x00
+#define FA_CREATE_ALWAYS	0x08
+
+/* Implemented by test/sim_file.c */
+FRESULT f_open(FIL *fp, const char *path, uint8_t mode);
+FRESULT f_close(FIL *fp);
+FRESULT f_read(FIL *fp, void *buff, UINT btr, UINT *br);
+FRESULT f_lseek(FIL *fp, FSIZE_t ofs);
+
+#endif /* _SIM_FF_H_ */
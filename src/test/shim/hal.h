@@ -0,0 +1,55 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Host build, see ch.h */
+
+#ifndef _SIM_HAL_H_
+#define _SIM_HAL_H_
+
+#include "ch.h"
+
+/* As common/mcuconf.h */
+#define STM32_HCLK			168000000
+
+/* As common/halconf.h */
+#define SERIAL_USB_BUFFERS_SIZE		256
+#define SERIAL_USB_BUFFERS_NUMBER	2
+
+/* GPIO registers written directly by the firmware, see test/sim_gpio.c */
+typedef struct {
+	volatile uint32_t IDR;
+	volatile uint32_t ODR;
+	union {
+		volatile uint32_t W;
+		struct {
+			volatile uint16_t set;
+			volatile uint16_t clear;
+		} H;
+	} BSRR;
+} stm32_gpio_t;
+
+#define SIM_GPIO_NB_PORT	(5)
+extern stm32_gpio_t sim_gpio[SIM_GPIO_NB_PORT];
+
+#define GPIOA	(&sim_gpio[0])
+#define GPIOB	(&sim_gpio[1])
+#define GPIOC	(&sim_gpio[2])
+#define GPIOD	(&sim_gpio[3])
+#define GPIOE	(&sim_gpio[4])
+
+#endif /* _SIM_HAL_H_ */
@@ -0,0 +1,88 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host build: the registers are not reachable, the firmware modules run by
+ * the host tests only use the types of the BSP headers.
+ */
+
+#ifndef _SIM_STM32_H_
+#define _SIM_STM32_H_
+
+#include <stdint.h>
+
+typedef struct {
+	volatile uint32_t IDR;
+	volatile uint32_t ODR;
+	volatile uint32_t BSRR;
+} GPIO_TypeDef;
+
+/* Pin masks of stm32f4xx_hal_gpio.h used by the bsp_*_conf.h headers */
+#define GPIO_PIN_6			((uint16_t)0x0040)
+#define GPIO_PIN_7			((uint16_t)0x0080)
+
+/*
+ * bsp_tim_wait_irq() polls TIM4, each access is a timer period of the
+ * simulated GPIOs, see test/sim_gpio.c.
+ */
+typedef struct {
+	volatile uint32_t SR;
+} TIM_TypeDef;
+
+#define TIM_SR_UIF			(1 << 0)
+#define TIM_CLOCKDIVISION_DIV1		(0)
+#define TIM_COUNTERMODE_UP		(0)
+
+TIM_TypeDef *sim_tim4(void);
+#define TIM4				(sim_tim4())
+
+/* CAN frame headers of stm32f4xx_hal_can.h used by bsp_can.h */
+typedef struct {
+	uint32_t StdId;
+	uint32_t ExtId;
+	uint32_t IDE;
+	uint32_t RTR;
+	uint32_t DLC;
+	uint32_t TransmitGlobalTime;
+} CAN_TxHeaderTypeDef;
+
+typedef struct {
+	uint32_t StdId;
+	uint32_t ExtId;
+	uint32_t IDE;
+	uint32_t RTR;
+	uint32_t DLC;
+	uint32_t Timestamp;
+	uint32_t FilterMatchIndex;
+} CAN_RxHeaderTypeDef;
+
+#define CAN_ID_STD			(0x00000000U)
+#define CAN_ID_EXT			(0x00000004U)
+#define CAN_RTR_DATA			(0x00000000U)
+#define CAN_RTR_REMOTE			(0x00000002U)
+#define CAN_RX_FIFO0			(0x00000000U)
+#define CAN_RX_FIFO1			(0x00000001U)
+
+/* CAN_ESR bits of stm32f405xx.h */
+#define CAN_ESR_EWGF			(0x1U << 0)
+#define CAN_ESR_EPVF			(0x1U << 1)
+#define CAN_ESR_BOFF			(0x1U << 2)
+#define CAN_ESR_TEC			(0xFFU << 16)
+#define CAN_ESR_REC			(0xFFU << 24)
+
+#endif /* _SIM_STM32_H_ */
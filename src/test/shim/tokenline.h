@@ -0,0 +1,61 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Host build: the types of the tokenline parser, see ch.h */
+
+#ifndef _SIM_TOKENLINE_H_
+#define _SIM_TOKENLINE_H_
+
+#define TL_MAX_LINE_LEN		128
+#define TL_MAX_WORDS		64
+
+typedef struct token_dict {
+	int token;
+	char *tokenstr;
+} t_token_dict;
+
+typedef struct token {
+	int token;
+	int arg_type;
+	int flags;
+	struct token *subtokens;
+	char *help;
+} t_token;
+
+typedef struct tokenline_parsed {
+	int tokens[TL_MAX_WORDS];
+	char buf[TL_MAX_LINE_LEN];
+} t_tokenline_parsed;
+
+typedef struct tokenline {
+	void *user;
+} t_tokenline;
+
+enum {
+	T_ARG_UINT = 1,
+	T_ARG_FLOAT,
+	T_ARG_FREQ,
+	T_ARG_STRING,
+	T_ARG_TOKEN,
+	T_ARG_HELP,
+};
+
+/* Implemented by test/sim_console.c */
+void tl_set_prompt(t_tokenline *tl, char *prompt);
+
+#endif /* _SIM_TOKENLINE_H_ */
@@ -0,0 +1,344 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "common.h"
+#include "sim_chn.h"
+#include "sim_can.h"
+
+sim_can_state_t sim_can_state[BSP_DEV_CAN_END];
+static sim_can_dev_t *sim_can_dev[BSP_DEV_CAN_END];
+
+void sim_can_attach(bsp_dev_can_t dev_num, sim_can_dev_t *dev)
+{
+	sim_can_dev[dev_num] = dev;
+	memset(&sim_can_state[dev_num], 0, sizeof(sim_can_state_t));
+}
+
+bsp_status_t bsp_can_init(bsp_dev_can_t dev_num, mode_config_proto_t* mode_conf)
+{
+	if(dev_num >= BSP_DEV_CAN_END || mode_conf->config.can.dev_speed == 0)
+		return BSP_ERROR;
+	sim_can_state[dev_num].init = true;
+	sim_can_state[dev_num].conf = *mode_conf;
+	sim_can_state[dev_num].speed = mode_conf->config.can.dev_speed;
+	return BSP_OK;
+}
+
+bsp_status_t bsp_can_deinit(bsp_dev_can_t dev_num)
+{
+	sim_can_state[dev_num].init = false;
+	sim_can_state[dev_num].rx_full = false;
+	return BSP_OK;
+}
+
+uint32_t bsp_can_get_speed(bsp_dev_can_t dev_num)
+{
+	return sim_can_state[dev_num].speed;
+}
+
+/* As bsp_can.c, the prescaler divides 2MHz */
+bsp_status_t bsp_can_set_speed(bsp_dev_can_t dev_num, uint32_t speed)
+{
+	if(speed == 0 || speed > 2000000)
+		return BSP_ERROR;
+	sim_can_state[dev_num].speed = 2000000 / (2000000 / speed);
+	return BSP_OK;
+}
+
+uint32_t bsp_can_get_timings(bsp_dev_can_t dev_num)
+{
+	return sim_can_state[dev_num].conf.config.can.dev_timing;
+}
+
+bsp_status_t bsp_can_set_timings(bsp_dev_can_t dev_num, mode_config_proto_t* mode_conf)
+{
+	sim_can_state[dev_num].conf.config.can.dev_timing = mode_conf->config.can.dev_timing;
+	return BSP_OK;
+}
+
+bsp_status_t bsp_can_set_ts1(bsp_dev_can_t dev_num, mode_config_proto_t* mode_conf, uint8_t ts1)
+{
+	uint32_t *timing = &sim_can_state[dev_num].conf.config.can.dev_timing;
+
+	*timing = (*timing & ~0xf0000) | ((uint32_t)(ts1 - 1) << 16);
+	mode_conf->config.can.dev_timing = *timing;
+	return BSP_OK;
+}
+
+bsp_status_t bsp_can_set_ts2(bsp_dev_can_t dev_num, mode_config_proto_t* mode_conf, uint8_t ts2)
+{
+	uint32_t *timing = &sim_can_state[dev_num].conf.config.can.dev_timing;
+
+	*timing = (*timing & ~0x700000) | ((uint32_t)(ts2 - 1) << 20);
+	mode_conf->config.can.dev_timing = *timing;
+	return BSP_OK;
+}
+
+bsp_status_t bsp_can_set_sjw(bsp_dev_can_t dev_num, mode_config_proto_t* mode_conf, uint8_t sjw)
+{
+	uint32_t *timing = &sim_can_state[dev_num].conf.config.can.dev_timing;
+
+	*timing = (*timing & ~0x3000000) | ((uint32_t)(sjw - 1) << 24);
+	mode_conf->config.can.dev_timing = *timing;
+	return BSP_OK;
+}
+
+bsp_status_t bsp_can_mode_rw(bsp_dev_can_t dev_num, mode_config_proto_t* mode_conf)
+{
+	mode_conf->config.can.dev_mode = BSP_CAN_MODE_RW;
+	sim_can_state[dev_num].conf.config.can.dev_mode = BSP_CAN_MODE_RW;
+	return BSP_OK;
+}
+
+bsp_status_t bsp_can_set_filter_banks(bsp_dev_can_t dev_num, const can_filter_bank_t* banks,
+				      uint32_t nb_banks)
+{
+	if(nb_banks > BSP_CAN_FILTER_BANKS)
+		return BSP_ERROR;
+	memcpy(sim_can_state[dev_num].banks, banks, nb_banks * sizeof(can_filter_bank_t));
+	sim_can_state[dev_num].nb_banks = nb_banks;
+	return BSP_OK;
+}
+
+/* Accept all */
+bsp_status_t bsp_can_init_filter(bsp_dev_can_t dev_num, mode_config_proto_t* mode_conf)
+{
+	can_filter_bank_t bank;
+
+	(void)mode_conf;
+	bank.mode = CAN_FILTER_MODE_MASK;
+	bank.scale = 32;
+	bank.fr1 = 0;
+	bank.fr2 = 0;
+	return bsp_can_set_filter_banks(dev_num, &bank, 1);
+}
+
+/* Copy of bsp_can_prepare_filter() of bsp_can.c */
+static uint32_t sim_can_prepare_filter(uint32_t filter_value)
+{
+	uint32_t final = 0;
+
+	filter_value &= 0x1fffffff;
+	final |= (filter_value & 0x7ff) << 21;
+	final |= (filter_value & 0x1ffff800) >> 8;
+	return final;
+}
+
+bsp_status_t bsp_can_set_filter(bsp_dev_can_t dev_num, mode_config_proto_t* mode_conf)
+{
+	can_filter_bank_t bank;
+
+	bank.mode = CAN_FILTER_MODE_MASK;
+	bank.scale = 32;
+	bank.fr1 = sim_can_prepare_filter(mode_conf->config.can.filter_id);
+	bank.fr2 = sim_can_prepare_filter(mode_conf->config.can.filter_mask);
+	return bsp_can_set_filter_banks(dev_num, &bank, 1);
+}
+
+bsp_status_t bsp_can_write(bsp_dev_can_t dev_num, can_tx_frame* tx_msg)
+{
+	sim_can_dev_t *dev = sim_can_dev[dev_num];
+
+	if(!sim_can_state[dev_num].init)
+		return BSP_ERROR;
+	sim_can_state[dev_num].nb_tx++;
+	if(dev != NULL && dev->write != NULL)
+		dev->write(dev, tx_msg);
+	return BSP_OK;
+}
+
+bsp_status_t bsp_can_write_nowait(bsp_dev_can_t dev_num, can_tx_frame* tx_msg)
+{
+	return bsp_can_write(dev_num, tx_msg);
+}
+
+/* The frames sent at once, the mailboxes are always free */
+bool bsp_can_tx_done(bsp_dev_can_t dev_num)
+{
+	(void)dev_num;
+	return true;
+}
+
+/* Fills the receive FIFO with the next node frame accepted by the filters */
+bsp_status_t bsp_can_rxne(bsp_dev_can_t dev_num)
+{
+	sim_can_state_t *s = &sim_can_state[dev_num];
+	sim_can_dev_t *dev = sim_can_dev[dev_num];
+	can_rx_frame *f = &s->rx_frame;
+	uint32_t id;
+
+	while(!s->rx_full && s->init && dev != NULL && dev->read != NULL &&
+	      dev->read(dev, f)) {
+		id = (f->header.IDE == CAN_ID_EXT) ? f->header.ExtId : f->header.StdId;
+		if(can_filter_match(s->banks, s->nb_banks, id,
+				    f->header.IDE == CAN_ID_EXT,
+				    f->header.RTR == CAN_RTR_REMOTE)) {
+			f->header.FilterMatchIndex = 0;
+			s->rx_full = true;
+		} else {
+			s->nb_filtered++;
+		}
+	}
+	if(!s->rx_full) {
+		if(++s->idle >= SIM_CAN_IDLE_MAX)
+			sim_ubtn = true;
+		return 0;
+	}
+	s->idle = 0;
+	return 1;
+}
+
+bsp_status_t bsp_can_read(bsp_dev_can_t dev_num, can_rx_frame* rx_msg)
+{
+	if(!sim_can_state[dev_num].init)
+		return BSP_ERROR;
+	if(bsp_can_rxne(dev_num) == 0)
+		return BSP_TIMEOUT;
+	*rx_msg = sim_can_state[dev_num].rx_frame;
+	sim_can_state[dev_num].rx_full = false;
+	sim_can_state[dev_num].nb_rx++;
+	return BSP_OK;
+}
+
+bsp_status_t bsp_can_rx_irq_start(bsp_dev_can_t dev_num, bsp_can_rx_cb_t cb, void *arg)
+{
+	(void)dev_num;
+	(void)cb;
+	(void)arg;
+	return BSP_ERROR;
+}
+
+void bsp_can_rx_irq_stop(bsp_dev_can_t dev_num)
+{
+	(void)dev_num;
+}
+
+uint32_t bsp_can_get_overruns(bsp_dev_can_t dev_num)
+{
+	(void)dev_num;
+	return 0;
+}
+
+uint32_t bsp_can_get_errors(bsp_dev_can_t dev_num)
+{
+	(void)dev_num;
+	return 0;
+}
+
+bsp_status_t bsp_can_timer_start(bsp_can_timer_cb_t cb, void *arg)
+{
+	(void)cb;
+	(void)arg;
+	return BSP_OK;
+}
+
+uint16_t bsp_can_timer_now(void)
+{
+	return 0;
+}
+
+void bsp_can_timer_set(uint16_t compare)
+{
+	(void)compare;
+}
+
+void bsp_can_timer_stop(void)
+{
+}
+
+void bsp_can_timer_release(void)
+{
+}
+
+static void sim_can_ecu_write(sim_can_dev_t *dev, const can_tx_frame *frame)
+{
+	sim_can_ecu_t *e = (sim_can_ecu_t *)dev;
+	uint8_t dlc;
+
+	if(frame->header.IDE != CAN_ID_STD || frame->header.StdId != e->cfg.rx_id ||
+	   frame->header.RTR != CAN_RTR_DATA)
+		return;
+	e->nb_frames++;
+	dlc = (frame->header.DLC > 8) ? 8 : frame->header.DLC;
+
+	switch(e->t.state) {
+	case ISOTP_TX_WAIT_FC:
+		isotp_receive(&e->t, frame->data, dlc, &e->tx_frame);
+		return;
+	case ISOTP_TX_CF:
+		/* Half duplex, the response is being sent */
+		return;
+	case ISOTP_RX_WAIT:
+	case ISOTP_RX_CF:
+		break;
+	default:
+		isotp_recv_start(&e->t);
+		break;
+	}
+
+	if(isotp_receive(&e->t, frame->data, dlc, &e->tx_frame))
+		e->tx_full = true;
+	if(e->t.state == ISOTP_ERROR) {
+		e->errors++;
+		isotp_recv_start(&e->t);
+	} else if(e->t.state == ISOTP_DONE) {
+		e->nb_requests++;
+		memcpy(e->resp, e->req, e->t.rx_len);
+		e->resp[0] += 0x40;
+		isotp_send(&e->t, e->resp, e->t.rx_len, &e->tx_frame);
+		e->tx_full = true;
+	}
+}
+
+static bool sim_can_ecu_read(sim_can_dev_t *dev, can_rx_frame *frame)
+{
+	sim_can_ecu_t *e = (sim_can_ecu_t *)dev;
+	isotp_frame_t cf;
+	const isotp_frame_t *f;
+
+	if(e->tx_full) {
+		e->tx_full = false;
+		f = &e->tx_frame;
+	} else if(isotp_send_cf(&e->t, &cf)) {
+		f = &cf;
+	} else {
+		return false;
+	}
+
+	memset(frame, 0, sizeof(can_rx_frame));
+	frame->header.StdId = e->cfg.tx_id;
+	frame->header.IDE = CAN_ID_STD;
+	frame->header.RTR = CAN_RTR_DATA;
+	frame->header.DLC = f->dlc;
+	memcpy(frame->data, f->data, f->dlc);
+	return true;
+}
+
+void sim_can_ecu_init(sim_can_ecu_t *e, uint32_t req_id, uint32_t resp_id)
+{
+	memset(e, 0, sizeof(sim_can_ecu_t));
+	e->dev.write = sim_can_ecu_write;
+	e->dev.read = sim_can_ecu_read;
+	e->cfg.tx_id = resp_id;
+	e->cfg.rx_id = req_id;
+	e->cfg.flags = ISOTP_FLAG_PAD;
+	isotp_init(&e->t, &e->cfg, e->req, ISOTP_MAX_PDU);
+	isotp_recv_start(&e->t);
+}
@@ -0,0 +1,93 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Simulated CAN controllers: the bsp_can API on top of a node attached to
+ * the bus of each CAN device. The frames are sent at once and the node
+ * frames pass the filter banks into a one frame receive FIFO. The receive
+ * interrupts (SLCAN capture) and the replay timer are not simulated.
+ */
+
+#ifndef _SIM_CAN_H_
+#define _SIM_CAN_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "bsp_can.h"
+
+/*
+ * The time does not advance on the host: after this many reads of a bus
+ * without frame in a row, the user button is pressed and the waits for a
+ * frame end as on a timeout.
+ */
+#define SIM_CAN_IDLE_MAX	(1000000)
+
+typedef struct sim_can_dev sim_can_dev_t;
+
+struct sim_can_dev {
+	/* Frame sent by the controller */
+	void (*write)(sim_can_dev_t *dev, const can_tx_frame *frame);
+	/* Next frame sent by the node, false while it has nothing to send */
+	bool (*read)(sim_can_dev_t *dev, can_rx_frame *frame);
+};
+
+typedef struct {
+	bool init;
+	mode_config_proto_t conf;	/* Last configuration */
+	uint32_t speed;
+	can_filter_bank_t banks[BSP_CAN_FILTER_BANKS];
+	uint32_t nb_banks;
+	/* Receive FIFO */
+	bool rx_full;
+	can_rx_frame rx_frame;
+	/* Statistics */
+	uint32_t nb_tx;
+	uint32_t nb_rx;
+	uint32_t nb_filtered;		/* Node frames rejected by the filters */
+	uint32_t idle;			/* Reads without frame in a row */
+} sim_can_state_t;
+
+extern sim_can_state_t sim_can_state[BSP_DEV_CAN_END];
+
+/* Attach a node to the bus of a CAN device, NULL for none (idle bus) */
+void sim_can_attach(bsp_dev_can_t dev_num, sim_can_dev_t *dev);
+
+/*
+ * ISO-TP ECU, standard identifiers: answers each request PDU with a
+ * positive response, the request with its first byte (service identifier)
+ * plus 0x40. Its flow control asks for no block limit and no STmin.
+ */
+typedef struct {
+	sim_can_dev_t dev;
+	isotp_config_t cfg;	/* tx_id: responses, rx_id: requests */
+	isotp_t t;
+	uint8_t req[ISOTP_MAX_PDU];
+	uint8_t resp[ISOTP_MAX_PDU];
+	/* Single, first or flow control frame to send */
+	bool tx_full;
+	isotp_frame_t tx_frame;
+	/* Statistics */
+	uint32_t nb_frames;	/* Frames received with the requests identifier */
+	uint32_t nb_requests;
+	uint32_t errors;	/* Requests dropped */
+} sim_can_ecu_t;
+
+void sim_can_ecu_init(sim_can_ecu_t *e, uint32_t req_id, uint32_t resp_id);
+
+#endif /* _SIM_CAN_H_ */
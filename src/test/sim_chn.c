@@ -0,0 +1,76 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "ch.h"
+#include "sim_chn.h"
+
+bool sim_ubtn;
+
+/**
+ * @brief  Set the input script and the output capture buffer of a channel.
+ * @param  chn: Channel.
+ * @param  in: Bytes returned by the reads.
+ * @param  in_len: Number of input bytes.
+ * @param  out: Capture buffer of the writes, can be NULL.
+ * @param  out_size: Size of out.
+ */
+void sim_chn_init(sim_chn_t *chn, const uint8_t *in, size_t in_len,
+		  uint8_t *out, size_t out_size)
+{
+	memset(chn, 0, sizeof(sim_chn_t));
+	chn->in = in;
+	chn->in_len = in_len;
+	chn->out = out;
+	chn->out_size = out ? out_size : 0;
+	sim_ubtn = false;
+}
+
+size_t sim_chn_read(sim_chn_t *chn, void *bp, size_t n, sysinterval_t timeout)
+{
+	size_t len;
+
+	(void)timeout;
+	chn->nb_read++;
+	len = chn->in_len - chn->in_pos;
+	if(len < n)
+		sim_ubtn = true;
+	else
+		len = n;
+	if(len > 0)
+		memcpy(bp, chn->in + chn->in_pos, len);
+	chn->in_pos += len;
+	return len;
+}
+
+size_t sim_chn_write(sim_chn_t *chn, const void *bp, size_t n, sysinterval_t timeout)
+{
+	size_t len;
+
+	(void)timeout;
+	chn->nb_write++;
+	chn->out_total += n;
+	len = chn->out_size - chn->out_len;
+	if(len > n)
+		len = n;
+	if(len > 0)
+		memcpy(chn->out + chn->out_len, bp, len);
+	chn->out_len += len;
+	return n;
+}
@@ -0,0 +1,50 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Simulated console channel: reads are served from a scripted input
+ * buffer, writes are captured in an output buffer (or only counted when
+ * there is none, for the benchmarks).
+ * When the input is exhausted the reads return short and the simulated
+ * UBTN is pressed, so the mode loops of the firmware return.
+ */
+
+#ifndef _SIM_CHN_H_
+#define _SIM_CHN_H_
+
+#include "ch.h"
+
+struct sim_chn {
+	const uint8_t *in;
+	size_t in_len;
+	size_t in_pos;
+	uint8_t *out;
+	size_t out_size;
+	size_t out_len;		/* Bytes captured in out */
+	uint64_t out_total;	/* Bytes written, captured or not */
+	uint32_t nb_read;	/* Number of read calls */
+	uint32_t nb_write;	/* Number of write calls */
+};
+
+/* Set when a read hits the end of the input, see hydrabus_ubtn() */
+extern bool sim_ubtn;
+
+void sim_chn_init(sim_chn_t *chn, const uint8_t *in, size_t in_len,
+		  uint8_t *out, size_t out_size);
+
+#endif /* _SIM_CHN_H_ */
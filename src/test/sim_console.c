@@ -0,0 +1,144 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Console services used by the firmware modes, on top of the simulated
+ * channels: output goes straight to the console channel.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "common.h"
+#include "sim_chn.h"
+#include "sim_console.h"
+#include "hydrabus_bbio_aux.h"
+#include "hydrabus_mode.h"
+
+/**
+ * @brief  Set up a console on a simulated channel.
+ * @param  con: Console.
+ * @param  mode: Mode configuration of the console.
+ * @param  chn: Channel used for input and output.
+ */
+void sim_console_init(t_hydra_console *con, t_mode_config *mode, sim_chn_t *chn)
+{
+	memset(con, 0, sizeof(t_hydra_console));
+	memset(mode, 0, sizeof(t_mode_config));
+	con->thread_name = "sim";
+	con->sdu = chn;
+	con->mode = mode;
+	con->out_raw = true;
+}
+
+void cprint(t_hydra_console *con, const char *data, const uint32_t size)
+{
+	chnWrite(con->sdu, (const uint8_t *)data, size);
+}
+
+void cprintf(t_hydra_console *con, const char *fmt, ...)
+{
+	va_list va_args;
+	char buf[256];
+	int len;
+
+	va_start(va_args, fmt);
+	len = vsnprintf(buf, sizeof(buf), fmt, va_args);
+	va_end(va_args);
+	if(len > (int)sizeof(buf) - 1)
+		len = sizeof(buf) - 1;
+	cprint(con, buf, len);
+}
+
+void tl_set_prompt(t_tokenline *tl, char *prompt)
+{
+	(void)tl;
+	(void)prompt;
+}
+
+/* Threads are not simulated, see ch.h */
+thread_t *chThdCreateFromHeap(void *heapp, size_t size, const char *name,
+			      int prio, tfunc_t pf, void *arg)
+{
+	(void)heapp;
+	(void)size;
+	(void)name;
+	(void)prio;
+	(void)pf;
+	(void)arg;
+	return NULL;
+}
+
+uint8_t hydrabus_ubtn(void)
+{
+	return sim_ubtn;
+}
+
+/* No AUX pins on the host */
+uint8_t bbio_aux(t_hydra_console *con, uint8_t command)
+{
+	(void)con;
+	(void)command;
+	return 0;
+}
+
+void bbio_aux_write(uint8_t command)
+{
+	(void)command;
+}
+
+/* Copies of the strings of hydrabus_mode.c used by the modes run on host */
+const char hydrabus_mode_str_read_one_u8[] = "READ: 0x%02X\r\n";
+const char hydrabus_mode_str_write_one_u8[] = "WRITE: 0x%02X\r\n";
+const char hydrabus_mode_str_mul_write[] = "WRITE: ";
+const char hydrabus_mode_str_mul_read[] = "READ: ";
+const char hydrabus_mode_str_mul_value_u8[] = "0x%02X ";
+const char hydrabus_mode_str_mul_br[] = "\r\n";
+
+/* Copies of common.c */
+uint8_t reverse_u8(uint8_t value)
+{
+	value = (value & 0xcc) >> 2 | (value & 0x33) << 2;
+	value = (value & 0xaa) >> 1 | (value & 0x55) << 1;
+	return value >> 4 | value << 4;
+}
+
+uint32_t reverse_u32(uint32_t value)
+{
+	value = (value & 0x55555555) << 1 | (value & 0xAAAAAAAA) >> 1;
+	value = (value & 0x33333333) << 2 | (value & 0xCCCCCCCC) >> 2;
+	value = (value & 0x0F0F0F0F) << 4 | (value & 0xF0F0F0F0) >> 4;
+	value = (value & 0x00FF00FF) << 8 | (value & 0xFF00FF00) >> 8;
+	return value << 16 | value >> 16;
+}
+
+uint8_t hexchartonibble(char hex)
+{
+	if (hex >= '0' && hex <= '9') return hex - '0';
+	if (hex >= 'a' && hex <='f') return hex - 'a' + 10;
+	if (hex >= 'A' && hex <='F') return hex - 'A' + 10;
+	return 0;
+}
+
+uint8_t hex2byte(char * hex)
+{
+	uint8_t val = 0;
+	val = (hexchartonibble(hex[0]) << 4);
+	val += hexchartonibble(hex[1]);
+	return val;
+}
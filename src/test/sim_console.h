@@ -0,0 +1,27 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _SIM_CONSOLE_H_
+#define _SIM_CONSOLE_H_
+
+#include "common.h"
+#include "sim_chn.h"
+
+void sim_console_init(t_hydra_console *con, t_mode_config *mode, sim_chn_t *chn);
+
+#endif /* _SIM_CONSOLE_H_ */
@@ -0,0 +1,129 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "common.h"
+#include "microsd.h"
+#include "crc32.h"
+#include "sim_file.h"
+
+sim_file_t sim_file;
+
+void sim_file_reset(void)
+{
+	memset(&sim_file, 0, sizeof(sim_file));
+	sim_file.crc = CRC32_INIT;
+}
+
+bool file_open(FIL *file_handle, const char * filename, const char mode)
+{
+	(void)file_handle;
+	(void)mode;
+
+	if(sim_file.open || sim_file.open_fail)
+		return FALSE;
+	strncpy(sim_file.name, filename, sizeof(sim_file.name) - 1);
+	sim_file.open = TRUE;
+	sim_file.len = 0;
+	sim_file.crc = CRC32_INIT;
+	return TRUE;
+}
+
+bool file_write(FIL *file_handle, uint8_t *data, uint32_t len)
+{
+	(void)file_handle;
+
+	if(!sim_file.open)
+		return FALSE;
+	sim_file.nb_write++;
+	if(sim_file.write_fail_at > 0 &&
+	   sim_file.len + len > sim_file.write_fail_at)
+		return FALSE;
+	sim_file.crc = crc32_update(sim_file.crc, data, len);
+	sim_file.len += len;
+	return TRUE;
+}
+
+bool file_close(FIL *file_handle)
+{
+	(void)file_handle;
+
+	if(!sim_file.open)
+		return FALSE;
+	sim_file.open = FALSE;
+	return TRUE;
+}
+
+/*
+ * The simulated files are only written: there is no volume to mount nor
+ * file to read (CAN replay) and no pcapng capture file, the pcapng writer
+ * is checked on its own.
+ */
+bool is_fs_ready(void)
+{
+	return FALSE;
+}
+
+int mount(void)
+{
+	return FR_NOT_READY;
+}
+
+file_pcapng_t *file_pcapng_open(const char * prefix, uint32_t size)
+{
+	(void)prefix;
+	(void)size;
+	return NULL;
+}
+
+bool file_pcapng_close(file_pcapng_t *f)
+{
+	(void)f;
+	return FALSE;
+}
+
+FRESULT f_open(FIL *fp, const char *path, uint8_t mode)
+{
+	(void)fp;
+	(void)path;
+	(void)mode;
+	return FR_NOT_READY;
+}
+
+FRESULT f_close(FIL *fp)
+{
+	(void)fp;
+	return FR_NOT_READY;
+}
+
+FRESULT f_read(FIL *fp, void *buff, UINT btr, UINT *br)
+{
+	(void)fp;
+	(void)buff;
+	(void)btr;
+	*br = 0;
+	return FR_NOT_READY;
+}
+
+FRESULT f_lseek(FIL *fp, FSIZE_t ofs)
+{
+	(void)fp;
+	(void)ofs;
+	return FR_NOT_READY;
+}
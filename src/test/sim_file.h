@@ -0,0 +1,45 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Simulated SD card files for the firmware modules writing dumps: the
+ * data written is only counted and hashed (CRC-32), errors can be
+ * injected.
+ */
+
+#ifndef _SIM_FILE_H_
+#define _SIM_FILE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct {
+	char name[64];
+	bool open;
+	bool open_fail;		/* Next file_open() fails */
+	uint32_t write_fail_at;	/* file_write() fails past this length, 0 never */
+	uint32_t len;		/* Bytes written */
+	uint32_t crc;		/* CRC-32 of the bytes written */
+	uint32_t nb_write;	/* Number of file_write() calls */
+} sim_file_t;
+
+extern sim_file_t sim_file;
+
+void sim_file_reset(void);
+
+#endif /* _SIM_FILE_H_ */
@@ -0,0 +1,137 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "common.h"
+#include "bsp_tim.h"
+#include "sim_gpio.h"
+
+stm32_gpio_t sim_gpio[SIM_GPIO_NB_PORT];
+sim_gpio_state_t sim_gpio_state;
+
+static sim_gpio_hook_t sim_gpio_hook;
+static void *sim_gpio_ctx;
+static TIM_TypeDef sim_tim;
+
+static stm32_gpio_t *sim_gpio_port(bsp_gpio_port_t gpio_port)
+{
+	return &sim_gpio[(gpio_port - BSP_GPIO_PORTA) / 0x400];
+}
+
+/* Apply the BSRR writes, then let the device model update the inputs */
+static void sim_gpio_update(void)
+{
+	stm32_gpio_t *port;
+	uint32_t bsrr;
+	int i;
+
+	for(i = 0; i < SIM_GPIO_NB_PORT; i++) {
+		port = &sim_gpio[i];
+		bsrr = port->BSRR.W;
+		port->BSRR.W = 0;
+		port->ODR = (port->ODR | (bsrr & 0xFFFF)) & ~(bsrr >> 16);
+		port->IDR = (port->IDR & sim_gpio_state.in[i]) |
+			    (port->ODR & ~sim_gpio_state.in[i] & 0xFFFF);
+	}
+	if(sim_gpio_hook != NULL)
+		sim_gpio_hook(sim_gpio_ctx);
+}
+
+void sim_gpio_reset(void)
+{
+	memset(sim_gpio, 0, sizeof(sim_gpio));
+	memset(&sim_gpio_state, 0, sizeof(sim_gpio_state));
+	sim_gpio_hook = NULL;
+}
+
+void sim_gpio_attach(sim_gpio_hook_t hook, void *ctx)
+{
+	sim_gpio_hook = hook;
+	sim_gpio_ctx = ctx;
+}
+
+/* Each access is the end of a timer period */
+TIM_TypeDef *sim_tim4(void)
+{
+	sim_gpio_state.nb_period++;
+	sim_gpio_update();
+	sim_tim.SR |= TIM_SR_UIF;
+	return &sim_tim;
+}
+
+void bsp_tim_init(uint32_t tim_period, uint32_t prescaler,
+		  uint32_t clock_division, uint32_t counter_mode)
+{
+	(void)tim_period;
+	(void)clock_division;
+	(void)counter_mode;
+	sim_gpio_state.prescaler = prescaler;
+}
+
+void bsp_tim_set_prescaler(uint32_t prescaler)
+{
+	sim_gpio_state.prescaler = prescaler;
+}
+
+void bsp_tim_deinit(void)
+{
+}
+
+bsp_status_t bsp_gpio_init(bsp_gpio_port_t gpio_port, uint16_t gpio_pin,
+			   uint32_t mode, uint32_t pull)
+{
+	(void)pull;
+	if(mode == MODE_CONFIG_DEV_GPIO_IN)
+		bsp_gpio_mode_in(gpio_port, gpio_pin);
+	else
+		bsp_gpio_mode_out(gpio_port, gpio_pin);
+	return BSP_OK;
+}
+
+void bsp_gpio_set(bsp_gpio_port_t gpio_port, uint16_t gpio_pin)
+{
+	sim_gpio_port(gpio_port)->BSRR.W = 1 << gpio_pin;
+	sim_gpio_update();
+}
+
+void bsp_gpio_clr(bsp_gpio_port_t gpio_port, uint16_t gpio_pin)
+{
+	sim_gpio_port(gpio_port)->BSRR.W = 1 << (gpio_pin + 16);
+	sim_gpio_update();
+}
+
+void bsp_gpio_mode_in(bsp_gpio_port_t gpio_port, uint16_t gpio_pin)
+{
+	sim_gpio_state.in[sim_gpio_port(gpio_port) - sim_gpio] |= 1 << gpio_pin;
+}
+
+void bsp_gpio_mode_out(bsp_gpio_port_t gpio_port, uint16_t gpio_pin)
+{
+	sim_gpio_state.in[sim_gpio_port(gpio_port) - sim_gpio] &= ~(1 << gpio_pin);
+}
+
+bsp_gpio_pinstate bsp_gpio_pin_read(bsp_gpio_port_t gpio_port, uint16_t gpio_pin)
+{
+	return (sim_gpio_port(gpio_port)->IDR >> gpio_pin) & 1;
+}
+
+uint16_t bsp_gpio_port_read(bsp_gpio_port_t gpio_port)
+{
+	return sim_gpio_port(gpio_port)->IDR;
+}
@@ -0,0 +1,46 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Simulated GPIOs: the bsp_gpio API and the registers of the shim hal.h
+ * written directly by the bit-banging modes. The BSRR writes are applied
+ * at the next timer period (bsp_tim_wait_irq()/bsp_tim_clr_irq()), then
+ * the attached device model sees the outputs and drives the inputs (IDR).
+ */
+
+#ifndef _SIM_GPIO_H_
+#define _SIM_GPIO_H_
+
+#include "hal.h"
+#include "bsp_gpio.h"
+
+typedef void (*sim_gpio_hook_t)(void *ctx);
+
+typedef struct {
+	uint16_t in[SIM_GPIO_NB_PORT];	/* Pins in input mode */
+	uint32_t prescaler;		/* Last TIM4 prescaler */
+	uint64_t nb_period;		/* Timer periods */
+} sim_gpio_state_t;
+
+extern sim_gpio_state_t sim_gpio_state;
+
+void sim_gpio_reset(void);
+/* Attach a device model to the GPIOs, NULL for none */
+void sim_gpio_attach(sim_gpio_hook_t hook, void *ctx);
+
+#endif /* _SIM_GPIO_H_ */
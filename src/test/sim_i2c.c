@@ -0,0 +1,238 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "common.h"
+#include "sim_i2c.h"
+#include "bsp_i2c_slave.h"
+
+sim_i2c_state_t sim_i2c_state;
+static sim_i2c_dev_t *sim_i2c_dev;
+
+void sim_i2c_attach(sim_i2c_dev_t *dev)
+{
+	sim_i2c_dev = dev;
+	memset(&sim_i2c_state, 0, sizeof(sim_i2c_state_t));
+}
+
+bsp_status_t bsp_i2c_master_init(bsp_dev_i2c_t dev_num, mode_config_proto_t* mode_conf)
+{
+	(void)dev_num;
+	if(mode_conf->config.i2c.dev_speed > 3)
+		return BSP_ERROR;
+	sim_i2c_state.init = true;
+	sim_i2c_state.conf = *mode_conf;
+	return BSP_OK;
+}
+
+bsp_status_t bsp_i2c_master_deinit(bsp_dev_i2c_t dev_num)
+{
+	(void)dev_num;
+	sim_i2c_state.init = false;
+	return BSP_OK;
+}
+
+bsp_status_t bsp_i2c_start(bsp_dev_i2c_t dev_num)
+{
+	sim_i2c_dev_t *dev = sim_i2c_dev;
+
+	(void)dev_num;
+	if(!sim_i2c_state.init)
+		return BSP_ERROR;
+	sim_i2c_state.nb_start++;
+	if(dev != NULL && dev->start != NULL)
+		dev->start(dev);
+	return BSP_OK;
+}
+
+bsp_status_t bsp_i2c_stop(bsp_dev_i2c_t dev_num)
+{
+	sim_i2c_dev_t *dev = sim_i2c_dev;
+
+	(void)dev_num;
+	if(!sim_i2c_state.init)
+		return BSP_ERROR;
+	sim_i2c_state.nb_stop++;
+	if(dev != NULL && dev->stop != NULL)
+		dev->stop(dev);
+	return BSP_OK;
+}
+
+bsp_status_t bsp_i2c_master_write_u8(bsp_dev_i2c_t dev_num, uint8_t tx_data, uint8_t* tx_ack_flag)
+{
+	sim_i2c_dev_t *dev = sim_i2c_dev;
+
+	(void)dev_num;
+	*tx_ack_flag = FALSE;
+	if(!sim_i2c_state.init)
+		return BSP_ERROR;
+	sim_i2c_state.nb_bytes++;
+	if(dev != NULL && dev->write != NULL && dev->write(dev, tx_data))
+		*tx_ack_flag = TRUE;
+	return BSP_OK;
+}
+
+bsp_status_t bsp_i2c_master_read_u8(bsp_dev_i2c_t dev_num, uint8_t* rx_data)
+{
+	sim_i2c_dev_t *dev = sim_i2c_dev;
+
+	(void)dev_num;
+	*rx_data = 0xFF;
+	if(!sim_i2c_state.init)
+		return BSP_ERROR;
+	sim_i2c_state.nb_bytes++;
+	if(dev != NULL && dev->read != NULL)
+		*rx_data = dev->read(dev);
+	return BSP_OK;
+}
+
+void bsp_i2c_read_ack(bsp_dev_i2c_t dev_num, bool enable_ack)
+{
+	sim_i2c_dev_t *dev = sim_i2c_dev;
+
+	(void)dev_num;
+	if(dev != NULL && dev->ack != NULL)
+		dev->ack(dev, enable_ack);
+}
+
+bsp_status_t bsp_i2c_slave_init(bsp_dev_i2c_t dev_num, mode_config_proto_t* mode_conf)
+{
+	(void)dev_num;
+	(void)mode_conf;
+	return BSP_OK;
+}
+
+bsp_status_t bsp_i2c_slave_deinit(bsp_dev_i2c_t dev_num)
+{
+	(void)dev_num;
+	return BSP_OK;
+}
+
+bsp_status_t bsp_i2c_slave_sniff_start(bsp_dev_i2c_t dev_num, mode_config_proto_t* mode_conf,
+				       uint16_t* samples, uint32_t nb_samples,
+				       uint32_t* period, uint32_t* timestamp)
+{
+	(void)dev_num;
+	(void)mode_conf;
+	(void)samples;
+	(void)nb_samples;
+	(void)period;
+	(void)timestamp;
+	return BSP_ERROR;
+}
+
+uint32_t bsp_i2c_slave_sniff_get_index(bsp_dev_i2c_t dev_num)
+{
+	(void)dev_num;
+	return 0;
+}
+
+void bsp_i2c_slave_sniff_stop(bsp_dev_i2c_t dev_num)
+{
+	(void)dev_num;
+}
+
+/* EEPROM transaction states */
+enum {
+	SIM_EEPROM_IDLE,	/* Waiting for a START */
+	SIM_EEPROM_ADDR,	/* Waiting for the slave address */
+	SIM_EEPROM_PTR,		/* Waiting for the word address */
+	SIM_EEPROM_WRITE,	/* Data written */
+	SIM_EEPROM_READ,	/* Byte read, waiting for ACK/NACK */
+	SIM_EEPROM_READ_ACK,	/* Next byte can be read */
+	SIM_EEPROM_NACKED,	/* Read ended, or not addressed */
+};
+
+static void sim_eeprom_start(sim_i2c_dev_t *dev)
+{
+	((sim_eeprom_t *)dev)->state = SIM_EEPROM_ADDR;
+}
+
+static void sim_eeprom_stop(sim_i2c_dev_t *dev)
+{
+	((sim_eeprom_t *)dev)->state = SIM_EEPROM_IDLE;
+}
+
+static bool sim_eeprom_write(sim_i2c_dev_t *dev, uint8_t data)
+{
+	sim_eeprom_t *e = (sim_eeprom_t *)dev;
+
+	switch(e->state) {
+	case SIM_EEPROM_ADDR:
+		if((data >> 1) != e->addr7) {
+			e->state = SIM_EEPROM_NACKED;
+			return false;
+		}
+		e->state = (data & 1) ? SIM_EEPROM_READ_ACK : SIM_EEPROM_PTR;
+		return true;
+	case SIM_EEPROM_PTR:
+		e->ptr = data;
+		e->state = SIM_EEPROM_WRITE;
+		return true;
+	case SIM_EEPROM_WRITE:
+		e->mem[e->ptr++] = data;
+		e->nb_write++;
+		return true;
+	case SIM_EEPROM_IDLE:
+	case SIM_EEPROM_NACKED:
+		return false;
+	default:
+		/* The master writes while the slave drives SDA */
+		e->errors++;
+		return false;
+	}
+}
+
+static uint8_t sim_eeprom_read(sim_i2c_dev_t *dev)
+{
+	sim_eeprom_t *e = (sim_eeprom_t *)dev;
+
+	if(e->state != SIM_EEPROM_READ_ACK) {
+		if(e->state != SIM_EEPROM_NACKED && e->state != SIM_EEPROM_IDLE)
+			e->errors++;
+		return 0xFF;
+	}
+	e->state = SIM_EEPROM_READ;
+	e->nb_read++;
+	return e->mem[e->ptr++];
+}
+
+static void sim_eeprom_ack(sim_i2c_dev_t *dev, bool ack)
+{
+	sim_eeprom_t *e = (sim_eeprom_t *)dev;
+
+	if(e->state != SIM_EEPROM_READ)
+		return;
+	e->state = ack ? SIM_EEPROM_READ_ACK : SIM_EEPROM_NACKED;
+}
+
+void sim_eeprom_init(sim_eeprom_t *e, uint8_t addr7)
+{
+	uint32_t i;
+
+	memset(e, 0, sizeof(sim_eeprom_t));
+	e->dev.start = sim_eeprom_start;
+	e->dev.stop = sim_eeprom_stop;
+	e->dev.write = sim_eeprom_write;
+	e->dev.read = sim_eeprom_read;
+	e->dev.ack = sim_eeprom_ack;
+	e->addr7 = addr7;
+	for(i = 0; i < SIM_EEPROM_SIZE; i++)
+		e->mem[i] = (uint8_t)(i ^ 0xA5);
+}
@@ -0,0 +1,81 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Simulated I2C master: the bsp_i2c_master API on top of a device model
+ * attached to the bus. As the bit-banged master of the BSP there is a
+ * single bus, whatever the device number. The slave side only rejects the sniffer, which
+ * needs the DMA sampling of SCL/SDA.
+ */
+
+#ifndef _SIM_I2C_H_
+#define _SIM_I2C_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "bsp_i2c_master.h"
+
+typedef struct sim_i2c_dev sim_i2c_dev_t;
+
+struct sim_i2c_dev {
+	/* START (or repeated START) and STOP conditions */
+	void (*start)(sim_i2c_dev_t *dev);
+	void (*stop)(sim_i2c_dev_t *dev);
+	/* Byte written by the master, returns true for ACK */
+	bool (*write)(sim_i2c_dev_t *dev, uint8_t data);
+	/* Byte read by the master, then its ACK (true) or NACK */
+	uint8_t (*read)(sim_i2c_dev_t *dev);
+	void (*ack)(sim_i2c_dev_t *dev, bool ack);
+};
+
+typedef struct {
+	bool init;
+	mode_config_proto_t conf;	/* Last configuration */
+	uint32_t nb_start;
+	uint32_t nb_stop;
+	uint64_t nb_bytes;		/* Bytes written and read */
+} sim_i2c_state_t;
+
+extern sim_i2c_state_t sim_i2c_state;
+
+/* Attach a device model to the bus, NULL for none (NACK, SDA high) */
+void sim_i2c_attach(sim_i2c_dev_t *dev);
+
+/*
+ * 24C02 like EEPROM: 256 bytes, one byte word address, sequential reads
+ * and writes rolling over the whole array (no page limit).
+ */
+#define SIM_EEPROM_SIZE	(256)
+
+typedef struct {
+	sim_i2c_dev_t dev;
+	uint8_t addr7;		/* 7 bits slave address */
+	uint8_t mem[SIM_EEPROM_SIZE];
+	/* Current transaction */
+	uint8_t state;
+	uint8_t ptr;		/* Word address */
+	/* Statistics */
+	uint32_t nb_write;	/* Data bytes written */
+	uint32_t nb_read;
+	uint32_t errors;	/* Reads without ACK/NACK, ... */
+} sim_eeprom_t;
+
+void sim_eeprom_init(sim_eeprom_t *e, uint8_t addr7);
+
+#endif /* _SIM_I2C_H_ */
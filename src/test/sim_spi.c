@@ -0,0 +1,241 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "common.h"
+#include "bsp_spi_conf.h"
+#include "sim_spi.h"
+#include "hydrabus_mode_spi.h"
+
+/*
+ * Copy of the speed table of hydrabus_mode_spi.c, which is not built on
+ * the host (CLI mode), used by the serprog and BBIO modes.
+ */
+const uint32_t spi_speeds[2][SPI_SPEED_NB] = {
+	/* SPI1 */
+	{ 320000, 650000, 1310000, 2620000, 5250000, 10500000, 21000000, 42000000 },
+	/* SPI2 */
+	{ 160000, 320000, 650000, 1310000, 2620000, 5250000, 10500000, 21000000 },
+};
+
+sim_spi_state_t sim_spi_state[BSP_DEV_SPI_END];
+static sim_spi_dev_t *sim_spi_dev[BSP_DEV_SPI_END];
+/* Status of the transfer started by bsp_spi_transfer_start() */
+static bsp_status_t sim_spi_pending[BSP_DEV_SPI_END];
+
+void sim_spi_attach(bsp_dev_spi_t dev_num, sim_spi_dev_t *dev)
+{
+	sim_spi_dev[dev_num] = dev;
+	memset(&sim_spi_state[dev_num], 0, sizeof(sim_spi_state_t));
+}
+
+bsp_status_t bsp_spi_init(bsp_dev_spi_t dev_num, mode_config_proto_t* mode_conf)
+{
+	if(dev_num >= BSP_DEV_SPI_END || mode_conf->config.spi.dev_speed > 7)
+		return BSP_ERROR;
+	sim_spi_state[dev_num].init = true;
+	sim_spi_state[dev_num].conf = *mode_conf;
+	return BSP_OK;
+}
+
+bsp_status_t bsp_spi_deinit(bsp_dev_spi_t dev_num)
+{
+	bsp_spi_unselect(dev_num);
+	sim_spi_state[dev_num].init = false;
+	return BSP_OK;
+}
+
+static void sim_spi_cs(bsp_dev_spi_t dev_num, bool selected)
+{
+	sim_spi_dev_t *dev = sim_spi_dev[dev_num];
+
+	if(sim_spi_state[dev_num].selected == selected)
+		return;
+	sim_spi_state[dev_num].selected = selected;
+	if(dev != NULL && dev->select != NULL)
+		dev->select(dev, selected);
+}
+
+void bsp_spi_select(bsp_dev_spi_t dev_num)
+{
+	sim_spi_cs(dev_num, true);
+}
+
+void bsp_spi_unselect(bsp_dev_spi_t dev_num)
+{
+	sim_spi_cs(dev_num, false);
+}
+
+uint8_t bsp_spi_get_cs(bsp_dev_spi_t dev_num)
+{
+	return sim_spi_state[dev_num].selected ? 0 : 1;
+}
+
+uint8_t bsp_spi_rxne(bsp_dev_spi_t dev_num)
+{
+	(void)dev_num;
+	return 0;
+}
+
+bsp_status_t bsp_spi_transfer(bsp_dev_spi_t dev_num, uint8_t* tx_data, uint8_t* rx_data, uint32_t nb_data)
+{
+	sim_spi_dev_t *dev = sim_spi_dev[dev_num];
+	uint32_t i;
+	uint8_t miso;
+
+	if(!sim_spi_state[dev_num].init)
+		return BSP_ERROR;
+	if(sim_spi_state[dev_num].fail_bytes != 0 &&
+	   sim_spi_state[dev_num].nb_bytes + nb_data > sim_spi_state[dev_num].fail_bytes) {
+		sim_spi_state[dev_num].fail_bytes = 0;
+		return BSP_TIMEOUT;
+	}
+	sim_spi_state[dev_num].nb_transfer++;
+	sim_spi_state[dev_num].nb_bytes += nb_data;
+	for(i = 0; i < nb_data; i++) {
+		miso = 0xFF;
+		if(dev != NULL && dev->xfer != NULL)
+			miso = dev->xfer(dev, tx_data ? tx_data[i] : BSP_SPI_DMA_DUMMY);
+		if(rx_data != NULL)
+			rx_data[i] = miso;
+	}
+	return BSP_OK;
+}
+
+bsp_status_t bsp_spi_write_u8(bsp_dev_spi_t dev_num, uint8_t* tx_data, uint8_t nb_data)
+{
+	return bsp_spi_transfer(dev_num, tx_data, NULL, nb_data);
+}
+
+bsp_status_t bsp_spi_read_u8(bsp_dev_spi_t dev_num, uint8_t* rx_data, uint8_t nb_data)
+{
+	return bsp_spi_transfer(dev_num, NULL, rx_data, nb_data);
+}
+
+bsp_status_t bsp_spi_write_read_u8(bsp_dev_spi_t dev_num, uint8_t* tx_data, uint8_t* rx_data, uint8_t nb_data)
+{
+	return bsp_spi_transfer(dev_num, tx_data, rx_data, nb_data);
+}
+
+/* The DMA transfer starts, its error is seen by bsp_spi_transfer_wait() */
+bsp_status_t bsp_spi_transfer_start(bsp_dev_spi_t dev_num, uint8_t* tx_data, uint8_t* rx_data, uint16_t nb_data)
+{
+	sim_spi_pending[dev_num] = bsp_spi_transfer(dev_num, tx_data, rx_data, nb_data);
+	return BSP_OK;
+}
+
+bsp_status_t bsp_spi_transfer_wait(bsp_dev_spi_t dev_num)
+{
+	bsp_status_t status = sim_spi_pending[dev_num];
+
+	sim_spi_pending[dev_num] = BSP_OK;
+	return status;
+}
+
+bsp_status_t bsp_spi_rx_circular_start(bsp_dev_spi_t dev_num, uint8_t* buffer, uint16_t nb_data)
+{
+	(void)dev_num;
+	(void)buffer;
+	(void)nb_data;
+	return BSP_ERROR;
+}
+
+uint32_t bsp_spi_rx_circular_index(bsp_dev_spi_t dev_num)
+{
+	(void)dev_num;
+	return 0;
+}
+
+void bsp_spi_rx_circular_stop(bsp_dev_spi_t dev_num)
+{
+	(void)dev_num;
+}
+
+void bsp_spi_cs_event_start(bsp_dev_spi_t dev_num, bsp_spi_cs_cb_t cb, void *arg)
+{
+	(void)dev_num;
+	(void)cb;
+	(void)arg;
+}
+
+void bsp_spi_cs_event_stop(bsp_dev_spi_t dev_num)
+{
+	(void)dev_num;
+}
+
+static void sim_spi_script_select(sim_spi_dev_t *dev, bool selected)
+{
+	sim_spi_script_t *s = (sim_spi_script_t *)dev;
+
+	if(selected) {
+		s->pos = 0;
+		if(s->step >= s->nb_steps)
+			s->errors++;
+		return;
+	}
+	if(s->step < s->nb_steps) {
+		if(s->pos != s->steps[s->step].len)
+			s->errors++;
+		s->step++;
+	}
+}
+
+static uint8_t sim_spi_script_xfer(sim_spi_dev_t *dev, uint8_t mosi)
+{
+	sim_spi_script_t *s = (sim_spi_script_t *)dev;
+	const sim_spi_step_t *step;
+	uint8_t miso = 0xFF;
+
+	if(s->step >= s->nb_steps) {
+		s->errors++;
+		return miso;
+	}
+	step = &s->steps[s->step];
+	if(s->pos >= step->len) {
+		s->errors++;
+		return miso;
+	}
+	if(step->mosi != NULL && step->mosi[s->pos] != mosi)
+		s->errors++;
+	if(step->miso != NULL)
+		miso = step->miso[s->pos];
+	s->pos++;
+	return miso;
+}
+
+/**
+ * @brief  Initialize a scripted device, attach it with sim_spi_attach().
+ * @param  s: Scripted device.
+ * @param  steps: Expected transactions.
+ * @param  nb_steps: Number of transactions.
+ */
+void sim_spi_script_init(sim_spi_script_t *s, const sim_spi_step_t *steps,
+			 uint32_t nb_steps)
+{
+	memset(s, 0, sizeof(sim_spi_script_t));
+	s->dev.select = sim_spi_script_select;
+	s->dev.xfer = sim_spi_script_xfer;
+	s->steps = steps;
+	s->nb_steps = nb_steps;
+}
+
+bool sim_spi_script_done(const sim_spi_script_t *s)
+{
+	return s->errors == 0 && s->step == s->nb_steps;
+}
@@ -0,0 +1,81 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Simulated SPI masters: the bsp_spi API on top of device models attached
+ * to each SPI device. The transfers are synchronous, the circular DMA
+ * reception (sniffer) is not simulated.
+ */
+
+#ifndef _SIM_SPI_H_
+#define _SIM_SPI_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "bsp_spi.h"
+
+typedef struct sim_spi_dev sim_spi_dev_t;
+
+struct sim_spi_dev {
+	/* CS edge, selected is true when CS goes low */
+	void (*select)(sim_spi_dev_t *dev, bool selected);
+	/* Exchange one byte, returns MISO */
+	uint8_t (*xfer)(sim_spi_dev_t *dev, uint8_t mosi);
+};
+
+typedef struct {
+	bool init;
+	bool selected;
+	mode_config_proto_t conf;	/* Last configuration */
+	uint32_t nb_transfer;		/* Number of transfer calls */
+	uint64_t nb_bytes;		/* Bytes exchanged */
+	uint64_t fail_bytes;		/* The transfer going past this byte count
+					   fails with BSP_TIMEOUT, once (0: never) */
+} sim_spi_state_t;
+
+extern sim_spi_state_t sim_spi_state[BSP_DEV_SPI_END];
+
+/* Attach a device model to an SPI device, NULL for none (MISO high) */
+void sim_spi_attach(bsp_dev_spi_t dev_num, sim_spi_dev_t *dev);
+
+/*
+ * Scripted device: each CS framed transaction shall match the next step,
+ * MOSI is checked (unless NULL) and MISO is replayed (0xFF when NULL).
+ */
+typedef struct {
+	const uint8_t *mosi;
+	const uint8_t *miso;
+	uint32_t len;
+} sim_spi_step_t;
+
+typedef struct {
+	sim_spi_dev_t dev;
+	const sim_spi_step_t *steps;
+	uint32_t nb_steps;
+	uint32_t step;		/* Current step */
+	uint32_t pos;		/* Position in the current step */
+	uint32_t errors;	/* Mismatches, see sim_spi_script_done() */
+} sim_spi_script_t;
+
+void sim_spi_script_init(sim_spi_script_t *s, const sim_spi_step_t *steps,
+			 uint32_t nb_steps);
+/* True when all the steps were played without error */
+bool sim_spi_script_done(const sim_spi_script_t *s);
+
+#endif /* _SIM_SPI_H_ */
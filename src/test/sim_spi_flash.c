@@ -0,0 +1,188 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "sim_spi_flash.h"
+
+/* Length of the address of cmd, 0 if cmd has no address */
+static uint8_t flash_addr_len(sim_spi_flash_t *f, uint8_t cmd)
+{
+	switch(cmd) {
+	case 0x03:
+	case 0x0B:
+	case 0x02:
+	case 0x20:
+	case 0xD8:
+		return f->addr4 ? 4 : 3;
+	case 0x13:
+	case 0x0C:
+	case 0x12:
+	case 0x21:
+	case 0xDC:
+		return 4;
+	default:
+		return 0;
+	}
+}
+
+static uint8_t flash_read(sim_spi_flash_t *f)
+{
+	uint32_t addr = f->addr & (f->size - 1);
+
+	f->addr++;
+	f->nb_read++;
+	if(f->mem != NULL)
+		return f->mem[addr];
+	return sim_spi_flash_byte(addr);
+}
+
+static void flash_erase(sim_spi_flash_t *f, uint32_t addr, uint32_t len)
+{
+	if(!(f->status & SIM_FLASH_SR_WEL) || f->mem == NULL) {
+		f->errors++;
+		return;
+	}
+	addr &= (f->size - 1) & ~(len - 1);
+	memset(&f->mem[addr], 0xFF, len);
+	f->nb_erase++;
+}
+
+static void flash_select(sim_spi_dev_t *dev, bool selected)
+{
+	sim_spi_flash_t *f = (sim_spi_flash_t *)dev;
+	uint8_t addr_len = flash_addr_len(f, f->cmd);
+
+	if(selected) {
+		f->pos = 0;
+		f->addr = 0;
+		return;
+	}
+	if(f->pos == 0)
+		return;
+	f->nb_cmd++;
+
+	/* Erases run at the end of the command */
+	if(f->pos == 1U + addr_len) {
+		switch(f->cmd) {
+		case 0x20:
+		case 0x21:
+			flash_erase(f, f->addr, 0x1000);
+			break;
+		case 0xD8:
+		case 0xDC:
+			flash_erase(f, f->addr, 0x10000);
+			break;
+		}
+	}
+	switch(f->cmd) {
+	case 0x02:
+	case 0x12:
+		f->nb_program++;
+	/* fall through */
+	case 0x20:
+	case 0x21:
+	case 0xD8:
+	case 0xDC:
+	case 0x04:
+		f->status &= ~SIM_FLASH_SR_WEL;
+		break;
+	case 0x06:
+		f->status |= SIM_FLASH_SR_WEL;
+		break;
+	case 0xC7:
+	case 0x60:
+		flash_erase(f, 0, f->size);
+		f->status &= ~SIM_FLASH_SR_WEL;
+		break;
+	case 0xB7:
+		f->addr4 = 1;
+		break;
+	case 0xE9:
+		f->addr4 = 0;
+		break;
+	}
+}
+
+static uint8_t flash_xfer(sim_spi_dev_t *dev, uint8_t mosi)
+{
+	sim_spi_flash_t *f = (sim_spi_flash_t *)dev;
+	uint8_t addr_len;
+	uint32_t page, data_pos;
+
+	if(f->pos == 0) {
+		f->cmd = mosi;
+		f->pos = 1;
+		return 0xFF;
+	}
+	addr_len = flash_addr_len(f, f->cmd);
+	if(f->pos <= addr_len) {
+		f->addr = (f->addr << 8) | mosi;
+		f->pos++;
+		return 0xFF;
+	}
+	data_pos = f->pos - 1 - addr_len;
+	f->pos++;
+
+	switch(f->cmd) {
+	case 0x9F:
+		return f->jedec_id[data_pos % 3];
+	case 0x05:
+		return f->status;
+	case 0x03:
+	case 0x13:
+		return flash_read(f);
+	case 0x0B:
+	case 0x0C:
+		/* One dummy byte */
+		if(data_pos == 0)
+			return 0xFF;
+		return flash_read(f);
+	case 0x02:
+	case 0x12:
+		if(!(f->status & SIM_FLASH_SR_WEL) || f->mem == NULL) {
+			f->errors++;
+			return 0xFF;
+		}
+		/* The address wraps in the page */
+		page = f->addr & (f->size - 1) & ~(SIM_FLASH_PAGE_SIZE - 1);
+		f->mem[page + ((f->addr + data_pos) & (SIM_FLASH_PAGE_SIZE - 1))] &= mosi;
+		return 0xFF;
+	default:
+		f->errors++;
+		return 0xFF;
+	}
+}
+
+/**
+ * @brief  Initialize a flash model, attach it with sim_spi_attach().
+ * @param  f: Flash model.
+ * @param  jedec_id: Manufacturer, memory type and capacity bytes.
+ * @param  size: Size in bytes, power of 2.
+ * @param  mem: Memory array of size bytes, NULL for the read-only pattern.
+ */
+void sim_spi_flash_init(sim_spi_flash_t *f, const uint8_t *jedec_id,
+			uint32_t size, uint8_t *mem)
+{
+	memset(f, 0, sizeof(sim_spi_flash_t));
+	f->dev.select = flash_select;
+	f->dev.xfer = flash_xfer;
+	memcpy(f->jedec_id, jedec_id, 3);
+	f->size = size;
+	f->mem = mem;
+}
@@ -0,0 +1,63 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * SPI NOR flash model for the simulated SPI masters (see sim_spi.h):
+ * JEDEC ID, 3 and 4 bytes address reads, status, write enable, page
+ * program and erases. Without a memory array the content is a fixed
+ * pattern of the address (sim_spi_flash_byte()) and is read-only.
+ */
+
+#ifndef _SIM_SPI_FLASH_H_
+#define _SIM_SPI_FLASH_H_
+
+#include "sim_spi.h"
+
+#define SIM_FLASH_PAGE_SIZE	(256)
+#define SIM_FLASH_SR_WIP	(1 << 0)
+#define SIM_FLASH_SR_WEL	(1 << 1)
+
+typedef struct {
+	sim_spi_dev_t dev;
+	uint8_t jedec_id[3];
+	uint32_t size;		/* Power of 2 */
+	uint8_t *mem;		/* Memory array, NULL for the pattern */
+	uint8_t status;
+	uint8_t addr4;		/* 4 bytes address mode (B7/E9) */
+	/* Current transaction */
+	uint8_t cmd;
+	uint32_t pos;
+	uint32_t addr;
+	/* Statistics */
+	uint32_t nb_cmd;
+	uint64_t nb_read;	/* Data bytes read */
+	uint32_t nb_program;	/* Page programs */
+	uint32_t nb_erase;
+	uint32_t errors;	/* Unknown commands, writes without WEL... */
+} sim_spi_flash_t;
+
+void sim_spi_flash_init(sim_spi_flash_t *f, const uint8_t *jedec_id,
+			uint32_t size, uint8_t *mem);
+
+/* Content of the flash without memory array */
+static inline uint8_t sim_spi_flash_byte(uint32_t addr)
+{
+	return (uint8_t)((addr * 0x9E3779B1UL) >> 24) ^ (uint8_t)(addr >> 8);
+}
+
+#endif /* _SIM_SPI_FLASH_H_ */
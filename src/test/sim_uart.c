@@ -0,0 +1,244 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "common.h"
+#include "sim_uart.h"
+#include "hydrabus_uart_bridge.h"
+
+sim_uart_state_t sim_uart_state[BSP_DEV_UART_END];
+static sim_uart_dev_t *sim_uart_dev[BSP_DEV_UART_END];
+
+void sim_uart_attach(bsp_dev_uart_t dev_num, sim_uart_dev_t *dev)
+{
+	sim_uart_dev[dev_num] = dev;
+	memset(&sim_uart_state[dev_num], 0, sizeof(sim_uart_state_t));
+}
+
+bsp_status_t bsp_uart_init(bsp_dev_uart_t dev_num, mode_config_proto_t* mode_conf)
+{
+	/* As bsp_uart.c: the baudrate shall be 81 at least */
+	if(dev_num >= BSP_DEV_UART_END ||
+	   mode_conf->config.uart.dev_speed < 81 ||
+	   mode_conf->config.uart.dev_parity > 2)
+		return BSP_ERROR;
+	sim_uart_state[dev_num].init = true;
+	sim_uart_state[dev_num].conf = *mode_conf;
+	return BSP_OK;
+}
+
+bsp_status_t bsp_uart_deinit(bsp_dev_uart_t dev_num)
+{
+	sim_uart_state[dev_num].init = false;
+	sim_uart_state[dev_num].rx_full = false;
+	return BSP_OK;
+}
+
+/* Next byte of the device, the one read by bsp_uart_rxne() first */
+static bool sim_uart_rx(bsp_dev_uart_t dev_num, uint8_t *data)
+{
+	sim_uart_state_t *s = &sim_uart_state[dev_num];
+	sim_uart_dev_t *dev = sim_uart_dev[dev_num];
+
+	if(s->rx_full) {
+		s->rx_full = false;
+		*data = s->rx_data;
+	} else if(dev == NULL || dev->read == NULL || !dev->read(dev, data)) {
+		return false;
+	}
+	s->nb_rx++;
+	return true;
+}
+
+/*
+ * Each byte is sent then a byte is received: a loopback, or a device
+ * answering each byte at once, is read back in the same transfer. The
+ * reads time out at once when the line is idle.
+ */
+bsp_status_t bsp_uart_transfer(bsp_dev_uart_t dev_num, uint8_t* tx_data, uint8_t* rx_data, uint32_t nb_data)
+{
+	sim_uart_dev_t *dev = sim_uart_dev[dev_num];
+	uint32_t i;
+
+	if(!sim_uart_state[dev_num].init)
+		return BSP_ERROR;
+	for(i = 0; i < nb_data; i++) {
+		if(tx_data != NULL) {
+			sim_uart_state[dev_num].nb_tx++;
+			if(dev != NULL && dev->write != NULL)
+				dev->write(dev, tx_data[i]);
+		}
+		if(rx_data != NULL && !sim_uart_rx(dev_num, &rx_data[i]))
+			return BSP_TIMEOUT;
+	}
+	return BSP_OK;
+}
+
+bsp_status_t bsp_uart_write_u8(bsp_dev_uart_t dev_num, uint8_t* tx_data, uint8_t nb_data)
+{
+	return bsp_uart_transfer(dev_num, tx_data, NULL, nb_data);
+}
+
+bsp_status_t bsp_uart_read_u8(bsp_dev_uart_t dev_num, uint8_t* rx_data, uint8_t nb_data)
+{
+	return bsp_uart_transfer(dev_num, NULL, rx_data, nb_data);
+}
+
+/* As bsp_uart.c, returns the number of bytes read minus one */
+bsp_status_t bsp_uart_read_u8_timeout(bsp_dev_uart_t dev_num, uint8_t* rx_data, uint8_t nb_data, uint32_t timeout)
+{
+	uint8_t i;
+
+	(void)timeout;
+	if(!sim_uart_state[dev_num].init)
+		return 0;
+	for(i = 0; i < nb_data; i++) {
+		if(!sim_uart_rx(dev_num, &rx_data[i]))
+			break;
+	}
+	return i - 1;
+}
+
+bsp_status_t bsp_uart_write_read_u8(bsp_dev_uart_t dev_num, uint8_t* tx_data, uint8_t* rx_data, uint8_t nb_data)
+{
+	return bsp_uart_transfer(dev_num, tx_data, rx_data, nb_data);
+}
+
+bsp_status_t bsp_uart_rxne(bsp_dev_uart_t dev_num)
+{
+	sim_uart_state_t *s = &sim_uart_state[dev_num];
+	sim_uart_dev_t *dev = sim_uart_dev[dev_num];
+
+	if(!s->rx_full && s->init && dev != NULL && dev->read != NULL)
+		s->rx_full = dev->read(dev, &s->rx_data);
+	return s->rx_full;
+}
+
+uint32_t bsp_uart_get_final_baudrate(bsp_dev_uart_t dev_num)
+{
+	return sim_uart_state[dev_num].conf.config.uart.dev_speed;
+}
+
+bsp_status_t bsp_uart_rx_dma_start(bsp_dev_uart_t dev_num, uint8_t* buffer, uint16_t nb_data,
+				   bsp_uart_rx_cb_t cb, void *arg)
+{
+	(void)dev_num;
+	(void)buffer;
+	(void)nb_data;
+	(void)cb;
+	(void)arg;
+	return BSP_ERROR;
+}
+
+uint32_t bsp_uart_rx_dma_pos(bsp_dev_uart_t dev_num)
+{
+	(void)dev_num;
+	return 0;
+}
+
+void bsp_uart_rx_dma_stop(bsp_dev_uart_t dev_num)
+{
+	(void)dev_num;
+}
+
+bsp_status_t bsp_uart_tx_dma_start(bsp_dev_uart_t dev_num, uint8_t* tx_data, uint16_t nb_data)
+{
+	(void)dev_num;
+	(void)tx_data;
+	(void)nb_data;
+	return BSP_ERROR;
+}
+
+bool bsp_uart_tx_dma_busy(bsp_dev_uart_t dev_num)
+{
+	(void)dev_num;
+	return false;
+}
+
+void bsp_uart_tx_dma_stop(bsp_dev_uart_t dev_num)
+{
+	(void)dev_num;
+}
+
+bsp_status_t bsp_lin_break(bsp_dev_uart_t dev_num)
+{
+	if(!sim_uart_state[dev_num].init)
+		return BSP_ERROR;
+	return BSP_OK;
+}
+
+/*
+ * The bridge reads the receive DMA ring from its own thread, it does not
+ * start on the host (no DMA, no thread): the echo of the BBIO UART mode is
+ * refused and its bridge returns at once.
+ */
+uart_bridge_t *uart_bridge_start(t_hydra_console *con, bsp_dev_uart_t dev_num,
+				 file_pcapng_t *pcap)
+{
+	(void)con;
+	(void)dev_num;
+	(void)pcap;
+	return NULL;
+}
+
+void uart_bridge_tx(uart_bridge_t *b)
+{
+	(void)b;
+}
+
+void uart_bridge_stop(uart_bridge_t *b)
+{
+	(void)b;
+}
+
+void uart_bridge_free(uart_bridge_t *b)
+{
+	(void)b;
+}
+
+static void sim_uart_loopback_write(sim_uart_dev_t *dev, uint8_t data)
+{
+	sim_uart_loopback_t *l = (sim_uart_loopback_t *)dev;
+
+	if(l->head - l->tail == SIM_UART_LOOPBACK_SIZE) {
+		/* Overwritten before being read */
+		l->tail++;
+		l->lost++;
+	}
+	l->buf[l->head++ & (SIM_UART_LOOPBACK_SIZE - 1)] = data;
+	l->nb_write++;
+}
+
+static bool sim_uart_loopback_read(sim_uart_dev_t *dev, uint8_t *data)
+{
+	sim_uart_loopback_t *l = (sim_uart_loopback_t *)dev;
+
+	if(l->head == l->tail)
+		return false;
+	*data = l->buf[l->tail++ & (SIM_UART_LOOPBACK_SIZE - 1)];
+	l->nb_read++;
+	return true;
+}
+
+void sim_uart_loopback_init(sim_uart_loopback_t *l)
+{
+	memset(l, 0, sizeof(sim_uart_loopback_t));
+	l->dev.write = sim_uart_loopback_write;
+	l->dev.read = sim_uart_loopback_read;
+}
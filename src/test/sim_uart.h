@@ -0,0 +1,76 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Simulated UARTs: the bsp_uart API on top of device models attached to
+ * each UART device, the line runs at the CPU speed. The DMA rings of the
+ * bridge (hydrabus_uart_bridge.c) are not simulated.
+ */
+
+#ifndef _SIM_UART_H_
+#define _SIM_UART_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "bsp_uart.h"
+
+typedef struct sim_uart_dev sim_uart_dev_t;
+
+struct sim_uart_dev {
+	/* Byte sent by the UART */
+	void (*write)(sim_uart_dev_t *dev, uint8_t data);
+	/* Byte sent by the device, false while the line is idle */
+	bool (*read)(sim_uart_dev_t *dev, uint8_t *data);
+};
+
+typedef struct {
+	bool init;
+	mode_config_proto_t conf;	/* Last configuration */
+	uint64_t nb_tx;			/* Bytes sent */
+	uint64_t nb_rx;			/* Bytes received */
+	/* Byte read from the device by bsp_uart_rxne() */
+	bool rx_full;
+	uint8_t rx_data;
+} sim_uart_state_t;
+
+extern sim_uart_state_t sim_uart_state[BSP_DEV_UART_END];
+
+/* Attach a device model to a UART device, NULL for none (line idle) */
+void sim_uart_attach(bsp_dev_uart_t dev_num, sim_uart_dev_t *dev);
+
+/*
+ * Loopback plug, TX wired to RX: the bytes sent are received back. The
+ * bytes not read before SIM_UART_LOOPBACK_SIZE more are sent are lost.
+ */
+#define SIM_UART_LOOPBACK_SIZE	(256) /* Power of 2 */
+
+typedef struct {
+	sim_uart_dev_t dev;
+	uint8_t buf[SIM_UART_LOOPBACK_SIZE];
+	uint32_t head;		/* Bytes written, free running */
+	uint32_t tail;		/* Bytes read, free running */
+	/* Statistics */
+	uint32_t nb_write;
+	uint32_t nb_read;
+	uint32_t lost;
+} sim_uart_loopback_t;
+
+void sim_uart_loopback_init(sim_uart_loopback_t *l);
+
+#endif /* _SIM_UART_H_ */
@@ -0,0 +1,52 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _TEST_H_
+#define _TEST_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* A test returns 0 on success, a benchmark prints its results */
+typedef int (*test_func_t)(void);
+
+typedef struct {
+	const char *name;
+	test_func_t func;
+} test_case_t;
+
+void test_fail(const char *file, int line, const char *cond);
+
+#define TEST_ASSERT(cond) do { \
+		if(!(cond)) { \
+			test_fail(__FILE__, __LINE__, #cond); \
+			return 1; \
+		} \
+	} while(0)
+
+/* Monotonic host time in ns */
+uint64_t test_time_ns(void);
+
+/* Print a benchmark result, nb units processed in ns */
+void bench_report(const char *name, uint64_t ns, uint64_t nb, const char *unit);
+
+/* Deterministic pseudo random numbers (xorshift32) */
+uint32_t test_rand(void);
+void test_srand(uint32_t seed);
+
+#endif /* _TEST_H_ */
@@ -0,0 +1,55 @@
+# Host tests and benchmarks, see host.mk
+# The firmware modules in TESTFWSRC are built with the ChibiOS/board shim of
+# test/shim and run on simulated channels and devices.
+
+TESTSRC = test/hydrafw_test.c \
+          test/sim_can.c \
+          test/sim_chn.c \
+          test/sim_console.c \
+          test/sim_file.c \
+          test/sim_gpio.c \
+          test/sim_i2c.c \
+          test/sim_spi.c \
+          test/sim_spi_flash.c \
+          test/sim_uart.c \
+          test/test_adc_stream.c \
+          test/test_alloc.c \
+          test/test_bbio_can.c \
+          test/test_bbio_i2c.c \
+          test/test_bbio_spi.c \
+          test/test_bbio_uart.c \
+          test/test_can_filter.c \
+          test/test_can_replay.c \
+          test/test_can_ring.c \
+          test/test_console_out.c \
+          test/test_detect.c \
+          test/test_i2c_sniff.c \
+          test/test_isotp.c \
+          test/test_jtag.c \
+          test/test_nfc_14443a.c \
+          test/test_nfc_14443b.c \
+          test/test_nfc_encode.c \
+          test/test_pcapng.c \
+          test/test_serprog.c \
+          test/test_spi_flash.c \
+          test/test_spi_sniff.c \
+          test/test_sump.c \
+          test/test_sump_trigger.c \
+          test/test_uart_ring.c \
+          test/test_xfer.c
+
+TESTFWSRC = hydrabus/hydrabus_bbio_can.c \
+            hydrabus/hydrabus_bbio_i2c.c \
+            hydrabus/hydrabus_bbio_spi.c \
+            hydrabus/hydrabus_bbio_uart.c \
+            hydrabus/hydrabus_mode_can.c \
+            hydrabus/hydrabus_mode_jtag.c \
+            hydrabus/hydrabus_serprog.c \
+            hydrabus/hydrabus_spi_flash.c
+
+# Built as the firmware (Makefile HYDRAFW_OPTS), for the commands of mode_can
+TESTDEFS = -DHYDRANFC
+
+# Required include directories, the shim first
+TESTINC = ./test/shim \
+          ./test
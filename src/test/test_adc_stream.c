@@ -0,0 +1,203 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * ADC stream framing (hydrabus_adc_stream.c): a simulated circular DMA
+ * fills the sample ring while a reader, sometimes too slow, frames the
+ * blocks. A host side parser checks the headers, that the sequence
+ * numbers account for every skipped block with the LOST flag, and that
+ * no block partly overwritten by the DMA is ever sent.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "test.h"
+#include "hydrabus_adc_stream.h"
+
+#define BLOCK_MAX	(256) /* ADC_STREAM_BLOCK_MAX */
+#define RING_MAX	(0x2000) /* ADC_STREAM_RING_SIZE */
+
+static uint16_t ring[RING_MAX];
+static uint8_t out[ADC_STREAM_BLOCK_BYTES(BLOCK_MAX)];
+
+static struct {
+	uint32_t ring_size;
+	uint32_t wr; /* Samples written by the DMA, free running */
+	uint32_t start; /* wr at the stream start */
+} dma;
+
+/* Host side */
+static struct {
+	uint32_t seq; /* Next sequence number expected */
+	uint32_t blocks;
+	uint32_t lost;
+	bool end;
+} host;
+
+/* 12 bits sample n of the stream */
+static uint16_t sample(uint32_t n)
+{
+	return (n ^ (n >> 12) ^ (n >> 24)) & 0xfff;
+}
+
+static void dma_write(uint32_t nb)
+{
+	while(nb--) {
+		ring[(dma.wr - dma.start) % dma.ring_size] = sample(dma.wr);
+		dma.wr++;
+	}
+}
+
+static int host_parse(const adc_stream_t *s, const uint8_t *p, uint32_t len)
+{
+	uint32_t seq, i, n, block_len;
+
+	TEST_ASSERT(len >= sizeof(adc_stream_header_t));
+	TEST_ASSERT(p[0] == ADC_STREAM_MAGIC);
+	block_len = p[2] | (p[3] << 8);
+	seq = p[4] | (p[5] << 8) | (p[6] << 16) | ((uint32_t)p[7] << 24);
+	TEST_ASSERT(len == sizeof(adc_stream_header_t) + block_len);
+
+	/* Skipped sequence numbers are the lost blocks, flagged */
+	TEST_ASSERT(seq - host.seq < 0x80000000);
+	TEST_ASSERT(!(p[1] & ADC_STREAM_FLAG_LOST) == (seq == host.seq));
+	host.lost += seq - host.seq;
+	host.seq = seq;
+
+	if(p[1] & ADC_STREAM_FLAG_END) {
+		TEST_ASSERT(block_len == 0);
+		host.end = true;
+		return 0;
+	}
+	TEST_ASSERT(p[1] == 0 || p[1] == ADC_STREAM_FLAG_LOST);
+	TEST_ASSERT(block_len == s->block_size * 2);
+	for(i = 0; i < s->block_size; i++) {
+		n = dma.start + seq * s->block_size + i;
+		TEST_ASSERT((p[8 + 2 * i] | (p[9 + 2 * i] << 8)) == sample(n));
+	}
+	/* The DMA is a whole block away from the samples just read */
+	TEST_ASSERT(dma.wr - (dma.start + seq * s->block_size) <=
+		    dma.ring_size - s->block_size);
+	host.seq++;
+	host.blocks++;
+	return 0;
+}
+
+static int test_adc_stream_run(uint32_t block_size, uint32_t ring_size, uint32_t start)
+{
+	adc_stream_t s;
+	uint32_t k, nb, len, burst;
+
+	memset(&host, 0, sizeof(host));
+	dma.ring_size = ring_size;
+	dma.wr = start;
+	dma.start = start;
+	adc_stream_init(&s, ring, ring_size, block_size);
+	/* Same as a stream started start samples ago */
+	s.rd = start;
+	for(k = 0; k < 20000; k++) {
+		/* Sometimes more than the ring while the host is busy */
+		burst = ((test_rand() % 64) == 0) ? 2 * ring_size : block_size * 2;
+		nb = test_rand() % burst;
+		dma_write(nb);
+		len = adc_stream_block(&s, dma.wr, out);
+		if(len == 0) {
+			/* Nothing sent before a whole block */
+			TEST_ASSERT(dma.wr - s.rd < block_size);
+			continue;
+		}
+		if(host_parse(&s, out, len))
+			return 1;
+	}
+	/* Remaining complete blocks, then the end */
+	while((len = adc_stream_block(&s, dma.wr, out)) > 0) {
+		if(host_parse(&s, out, len))
+			return 1;
+	}
+	len = adc_stream_end(&s, out);
+	TEST_ASSERT(len == sizeof(adc_stream_header_t));
+	if(host_parse(&s, out, len))
+		return 1;
+	TEST_ASSERT(host.end);
+	TEST_ASSERT(host.blocks == s.blocks && host.lost == s.blocks_lost);
+	TEST_ASSERT(host.lost > 0);
+	TEST_ASSERT((host.blocks + host.lost) * block_size == s.rd - start);
+	TEST_ASSERT(dma.wr - s.rd < block_size);
+	return 0;
+}
+
+int test_adc_stream(void)
+{
+	uint32_t block_size, ring_size, k;
+
+	test_srand(25);
+
+	/* Block sizes, whole scans */
+	TEST_ASSERT(adc_stream_block_size(1, 10, BLOCK_MAX) == 1);
+	TEST_ASSERT(adc_stream_block_size(3, 150, BLOCK_MAX) == 3);
+	TEST_ASSERT(adc_stream_block_size(2, 10000, BLOCK_MAX) == 200);
+	TEST_ASSERT(adc_stream_block_size(1, 1000000, BLOCK_MAX) == 256);
+	TEST_ASSERT(adc_stream_block_size(3, 1000000, BLOCK_MAX) == 255);
+
+	/* As hydrabus_bbio_adc.c sizes the ring */
+	for(k = 0; k < 20; k++) {
+		block_size = adc_stream_block_size(1 + test_rand() % 4,
+						   test_rand() % 2000000, BLOCK_MAX);
+		ring_size = RING_MAX / block_size * block_size;
+		if(test_adc_stream_run(block_size, ring_size, 0))
+			return 1;
+	}
+	/* Smallest ring: two blocks */
+	if(test_adc_stream_run(BLOCK_MAX, 2 * BLOCK_MAX, 0))
+		return 1;
+	/* Free running sample count wrapping */
+	if(test_adc_stream_run(64, RING_MAX, 0 - 40 * RING_MAX))
+		return 1;
+	return 0;
+}
+
+/*
+ * Framing cost per sample, the ring always holds complete blocks as when
+ * the host keeps up at the highest rate.
+ */
+int bench_adc_stream(void)
+{
+	adc_stream_t s;
+	uint32_t k, len, nb = 0;
+	uint64_t t;
+
+	dma.ring_size = RING_MAX;
+	dma.wr = 0;
+	dma.start = 0;
+	dma_write(RING_MAX);
+	adc_stream_init(&s, ring, RING_MAX, BLOCK_MAX);
+
+	t = test_time_ns();
+	for(k = 0; k < 1000000; k++) {
+		/* The DMA stays a block ahead, without writing the ring */
+		len = adc_stream_block(&s, s.rd + 2 * BLOCK_MAX, out);
+		nb += len;
+	}
+	t = test_time_ns() - t;
+
+	TEST_ASSERT(nb == 1000000 * ADC_STREAM_BLOCK_BYTES(BLOCK_MAX));
+	TEST_ASSERT(s.blocks == 1000000 && s.blocks_lost == 0);
+	bench_report("adc_stream 256 samples blocks", t, (uint64_t)k * BLOCK_MAX, "sample");
+	return 0;
+}
@@ -0,0 +1,242 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Pool allocator (alloc.c): size classes, alignment, CCM fallback,
+ * statistics and a random alloc/free churn checked against the live
+ * allocations.
+ */
+
+#include <string.h>
+
+#include "test.h"
+#include "alloc.h"
+
+#define CHURN_SLOTS	(24)
+#define CHURN_MAX_SIZE	(0x2000)
+
+typedef struct {
+	uint8_t *ptr;
+	uint32_t size;
+	uint8_t fill;
+} churn_slot_t;
+
+/* Random size from 1 byte to CHURN_MAX_SIZE, mostly small */
+static uint32_t churn_size(void)
+{
+	uint32_t r = test_rand();
+
+	return 1 + (r >> 8) % (CHURN_MAX_SIZE >> (r & 3) * 2);
+}
+
+static uint32_t nb_blocks(uint32_t size)
+{
+	uint32_t n = 1;
+
+	while(n * POOL_BLOCK_SIZE < size)
+		n <<= 1;
+	return n;
+}
+
+static int churn_check(churn_slot_t *slot)
+{
+	uint32_t i;
+
+	for(i = 0; i < slot->size; i++)
+		TEST_ASSERT(slot->ptr[i] == slot->fill);
+	return 0;
+}
+
+int test_alloc(void)
+{
+	churn_slot_t slots[CHURN_SLOTS];
+	pool_alloc_info_t info;
+	pool_stats_t stats;
+	uint8_t *base, *ccm, *p[4];
+	uint32_t i, index, used;
+	churn_slot_t *slot;
+
+	/* Base address of each pool, from a whole pool allocation */
+	pool_init();
+	base = pool_alloc_bytes(POOL_BUFFER_SIZE);
+	TEST_ASSERT(base != NULL);
+	TEST_ASSERT(pool_alloc_bytes(1) == NULL);
+	ccm = pool_alloc_ccm(POOL_CCM_BUFFER_SIZE);
+	TEST_ASSERT(ccm != NULL && ccm != base);
+	/* Both full, no fallback */
+	TEST_ASSERT(pool_alloc_ccm(1) == NULL);
+	pool_free(base);
+	pool_free(ccm);
+	pool_stats(POOL_RAM, &stats);
+	TEST_ASSERT(stats.blocks_used == 0);
+	TEST_ASSERT(stats.blocks_max == POOL_BLOCK_NUMBER);
+	pool_init();
+
+	/* Invalid sizes */
+	TEST_ASSERT(pool_alloc_bytes(0) == NULL);
+	TEST_ASSERT(pool_alloc_bytes(POOL_BUFFER_SIZE + 1) == NULL);
+
+	/* Sizes rounded to a power of two number of blocks, aligned */
+	p[0] = pool_alloc_bytes(1);
+	p[1] = pool_alloc_bytes(POOL_BLOCK_SIZE + 1);
+	p[2] = pool_alloc_bytes(3 * POOL_BLOCK_SIZE);
+	p[3] = pool_alloc_bytes(POOL_BLOCK_SIZE);
+	TEST_ASSERT(p[0] == base);
+	TEST_ASSERT(p[1] == base + 2 * POOL_BLOCK_SIZE);
+	TEST_ASSERT(p[2] == base + 4 * POOL_BLOCK_SIZE);
+	TEST_ASSERT(p[3] == base + POOL_BLOCK_SIZE);
+	pool_stats(POOL_RAM, &stats);
+	TEST_ASSERT(stats.block_size == POOL_BLOCK_SIZE);
+	TEST_ASSERT(stats.blocks_total == POOL_BLOCK_NUMBER);
+	TEST_ASSERT(stats.blocks_used == 8);
+	TEST_ASSERT(stats.nb_alloc == 4);
+
+	/* Live allocations with their tags */
+	index = 0;
+	TEST_ASSERT(pool_next_alloc(POOL_RAM, &index, &info));
+	TEST_ASSERT(info.ptr == base && info.nb_blocks == 1);
+	TEST_ASSERT(!strcmp(info.tag, "test_alloc"));
+	for(i = 1; pool_next_alloc(POOL_RAM, &index, &info); i++);
+	TEST_ASSERT(i == 4);
+
+	/* Freeing NULL, a pointer inside an allocation or out of the pools */
+	pool_free(NULL);
+	pool_free(p[2] + POOL_BLOCK_SIZE);
+	pool_free(&stats);
+	pool_stats(POOL_RAM, &stats);
+	TEST_ASSERT(stats.blocks_used == 8);
+
+	/*
+	 * Holes of 1 and 2 blocks at 1: the 123 free blocks are in runs of
+	 * 3 and 120, the largest allocation is 64 blocks aligned on its size.
+	 */
+	pool_free(p[3]);
+	pool_free(p[1]);
+	pool_stats(POOL_RAM, &stats);
+	TEST_ASSERT(stats.blocks_used == 5);
+	TEST_ASSERT(stats.blocks_max == 8);
+	TEST_ASSERT(stats.largest_free == 120);
+	TEST_ASSERT(stats.largest_alloc == 64);
+	TEST_ASSERT(stats.fragmentation == 100 - 64 * 100 / 123);
+	p[1] = pool_alloc_bytes(64 * POOL_BLOCK_SIZE);
+	TEST_ASSERT(p[1] == base + 64 * POOL_BLOCK_SIZE);
+	pool_stats(POOL_RAM, &stats);
+	TEST_ASSERT(stats.largest_free == 56);
+	TEST_ASSERT(stats.largest_alloc == 32);
+	TEST_ASSERT(stats.fragmentation == 100 - 32 * 100 / 59);
+	p[3] = NULL;
+	pool_free(p[0]);
+	pool_free(p[1]);
+	pool_free(p[2]);
+	pool_free(p[3]);
+	pool_stats(POOL_RAM, &stats);
+	TEST_ASSERT(stats.blocks_used == 0 && stats.nb_alloc == 0);
+	TEST_ASSERT(stats.largest_alloc == POOL_BLOCK_NUMBER);
+	TEST_ASSERT(stats.fragmentation == 0);
+
+	/* The CCM pool falls back to the main pool when full */
+	ccm = pool_alloc_ccm(POOL_CCM_BUFFER_SIZE);
+	p[0] = pool_alloc_ccm(1);
+	TEST_ASSERT(p[0] == base);
+	pool_stats(POOL_CCM, &stats);
+	TEST_ASSERT(stats.largest_alloc == 0 && stats.fragmentation == 0);
+	pool_free(ccm);
+	pool_free(p[0]);
+
+	/* Random churn, the content of each allocation shall be preserved */
+	test_srand(1);
+	memset(slots, 0, sizeof(slots));
+	for(i = 0; i < 200000; i++) {
+		slot = &slots[test_rand() % CHURN_SLOTS];
+		if(slot->ptr != NULL) {
+			if(churn_check(slot))
+				return 1;
+			pool_free(slot->ptr);
+			slot->ptr = NULL;
+			continue;
+		}
+		slot->size = churn_size();
+		slot->ptr = pool_alloc_bytes(slot->size);
+		if(slot->ptr == NULL) {
+			/* Only when no aligned run is free */
+			pool_stats(POOL_RAM, &stats);
+			TEST_ASSERT(stats.largest_alloc < nb_blocks(slot->size));
+			continue;
+		}
+		TEST_ASSERT(slot->ptr >= base);
+		TEST_ASSERT(slot->ptr + slot->size <= base + POOL_BUFFER_SIZE);
+		TEST_ASSERT((slot->ptr - base) % (nb_blocks(slot->size) * POOL_BLOCK_SIZE) == 0);
+		slot->fill = (uint8_t)i;
+		memset(slot->ptr, slot->fill, slot->size);
+	}
+
+	used = 0;
+	for(i = 0; i < CHURN_SLOTS; i++) {
+		if(slots[i].ptr == NULL)
+			continue;
+		if(churn_check(&slots[i]))
+			return 1;
+		used += nb_blocks(slots[i].size);
+	}
+	pool_stats(POOL_RAM, &stats);
+	TEST_ASSERT(stats.blocks_used == used);
+	for(i = 0; i < CHURN_SLOTS; i++)
+		pool_free(slots[i].ptr);
+	pool_stats(POOL_RAM, &stats);
+	TEST_ASSERT(stats.blocks_used == 0);
+	return 0;
+}
+
+/*
+ * Allocation and free time of a random churn of live buffers from 1 byte
+ * to 8KB, and the fragmentation of the pool at the end.
+ */
+int bench_alloc(void)
+{
+	uint8_t *slots[CHURN_SLOTS];
+	pool_stats_t stats;
+	uint32_t i, nb = 2000000, nb_fail = 0;
+	uint8_t **slot;
+	uint64_t t;
+
+	pool_init();
+	test_srand(1);
+	memset(slots, 0, sizeof(slots));
+
+	t = test_time_ns();
+	for(i = 0; i < nb; i++) {
+		slot = &slots[test_rand() % CHURN_SLOTS];
+		if(*slot != NULL) {
+			pool_free(*slot);
+			*slot = NULL;
+		} else {
+			*slot = pool_alloc_bytes(churn_size());
+			if(*slot == NULL)
+				nb_fail++;
+		}
+	}
+	t = test_time_ns() - t;
+
+	pool_stats(POOL_RAM, &stats);
+	bench_report("alloc/free churn", t, nb, "op");
+	printf("  %u failed allocations, %u blocks used, fragmentation %u%%\n",
+	       nb_fail, stats.blocks_used, stats.fragmentation);
+	for(i = 0; i < CHURN_SLOTS; i++)
+		pool_free(slots[i]);
+	return 0;
+}
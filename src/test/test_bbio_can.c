@@ -0,0 +1,213 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * BBIO CAN mode (hydrabus_bbio_can.c) run on a simulated console and an
+ * ISO-TP ECU on the simulated CAN bus.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "test.h"
+#include "sim_console.h"
+#include "sim_can.h"
+#include "hydrabus_bbio.h"
+#include "hydrabus_bbio_can.h"
+
+#define ECU_REQ_ID	(0x7E0)
+#define ECU_RESP_ID	(0x7E8)
+
+static const uint8_t bbio_can_in[] = {
+	BBIO_MODE_ID,
+	/* Single frame request, then its response */
+	BBIO_CAN_ID, 0x00, 0x00, 0x07, 0xE0,
+	BBIO_CAN_WRITE | 2, 0x02, 0x10, 0x03,
+	BBIO_CAN_READ,
+	BBIO_CAN_READ,
+	/* Identifiers 0x100 to 0x1FF only: the response is filtered out */
+	BBIO_CAN_FILTER_ADD, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 0xFF, 0x00,
+	BBIO_CAN_WRITE | 2, 0x02, 0x3E, 0x00,
+	BBIO_CAN_READ,
+	/* Not a standard identifier */
+	BBIO_CAN_FILTER_ADD, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x08, 0x00, 0x00,
+	BBIO_CAN_FILTER_CLEAR,
+	/* Flow control after each consecutive frame of the response */
+	BBIO_CAN_ISOTP_CONFIG, 0x00, 0x00, 0x07, 0xE0, 0x00, 0x00, 0x07, 0xE8,
+	ISOTP_FLAG_PAD, 1, 0,
+	/* Segmented request and response of 20 bytes, 1s timeout */
+	BBIO_CAN_ISOTP_REQUEST, 0x00, 0x14,
+	0x22, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09,
+	0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x10, 0x11, 0x12, 0x13,
+	0x03, 0xE8,
+	BBIO_CAN_SET_SPEED | 1,
+	BBIO_CAN_FILTER_OFF,
+	BBIO_RESET,
+};
+
+static const uint8_t bbio_can_out[] = {
+	'C', 'A', 'N', '1',
+	'C', 'A', 'N', '1',
+	0x01,
+	0x01,
+	0x01, 0x00, 0x00, 0x07, 0xE8, 0x08,
+	0x02, 0x50, 0x03, 0xCC, 0xCC, 0xCC, 0xCC, 0xCC,
+	0x00,
+	0x01,
+	0x01,
+	0x00,
+	0x00,
+	0x01,
+	0x01,
+	0x01, 0x00, 0x14,
+	0x62, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09,
+	0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x10, 0x11, 0x12, 0x13,
+	0x01,
+	0x01,
+};
+
+int test_bbio_can(void)
+{
+	t_hydra_console con;
+	t_mode_config mode;
+	sim_chn_t chn;
+	sim_can_ecu_t *ecu;
+	pool_stats_t stats;
+	uint8_t out[128];
+
+	ecu = malloc(sizeof(sim_can_ecu_t));
+	TEST_ASSERT(ecu != NULL);
+	pool_init();
+	sim_chn_init(&chn, bbio_can_in, sizeof(bbio_can_in), out, sizeof(out));
+	sim_console_init(&con, &mode, &chn);
+	sim_can_ecu_init(ecu, ECU_REQ_ID, ECU_RESP_ID);
+	sim_can_attach(BSP_DEV_CAN1, &ecu->dev);
+
+	bbio_mode_can(&con);
+
+	TEST_ASSERT(!sim_ubtn);
+	TEST_ASSERT(chn.in_pos == sizeof(bbio_can_in));
+	TEST_ASSERT(chn.out_len == sizeof(bbio_can_out));
+	TEST_ASSERT(!memcmp(out, bbio_can_out, sizeof(bbio_can_out)));
+	TEST_ASSERT(ecu->nb_requests == 3);
+	TEST_ASSERT(ecu->errors == 0);
+	/* 2 single frames, request in 3 frames, 2 flow controls of the response */
+	TEST_ASSERT(sim_can_state[BSP_DEV_CAN1].nb_tx == 2 + 3 + 2);
+	TEST_ASSERT(sim_can_state[BSP_DEV_CAN1].nb_filtered == 1);
+	TEST_ASSERT(sim_can_state[BSP_DEV_CAN1].speed == 1000000);
+	TEST_ASSERT(!sim_can_state[BSP_DEV_CAN1].init);
+	pool_stats(POOL_RAM, &stats);
+	TEST_ASSERT(stats.blocks_used == 0);
+	pool_stats(POOL_CCM, &stats);
+	TEST_ASSERT(stats.blocks_used == 0);
+
+	sim_can_attach(BSP_DEV_CAN1, NULL);
+	free(ecu);
+	return 0;
+}
+
+/*
+ * Commands of the benchmark, in a mode session ended by BBIO_RESET: single
+ * frame request and read of the response when pdu_len is 0, ISO-TP
+ * request of pdu_len bytes otherwise.
+ */
+static uint8_t *bench_script(uint32_t nb, uint32_t pdu_len, uint32_t *len)
+{
+	uint8_t *in;
+	uint8_t *p;
+	uint32_t i, cmd_len;
+
+	cmd_len = pdu_len ? 5 + pdu_len : 5;
+	*len = 5 + nb * cmd_len + 1;
+	in = malloc(*len);
+	if(in == NULL)
+		return NULL;
+	in[0] = BBIO_CAN_ID;
+	in[1] = 0x00;
+	in[2] = 0x00;
+	in[3] = ECU_REQ_ID >> 8;
+	in[4] = ECU_REQ_ID & 0xFF;
+	for(i = 0; i < nb; i++) {
+		p = &in[5 + i * cmd_len];
+		if(pdu_len) {
+			memset(p, 0x5A, cmd_len);
+			p[0] = BBIO_CAN_ISOTP_REQUEST;
+			p[1] = pdu_len >> 8;
+			p[2] = pdu_len & 0xFF;
+			p[3] = 0x22;
+			p[cmd_len - 2] = 0x03;
+			p[cmd_len - 1] = 0xE8;
+		} else {
+			p[0] = BBIO_CAN_WRITE | 2;
+			p[1] = 0x02;
+			p[2] = 0x3E;
+			p[3] = 0x00;
+			p[4] = BBIO_CAN_READ;
+		}
+	}
+	in[*len - 1] = BBIO_RESET;
+	return in;
+}
+
+static int bench_bbio_can_cmd(const char *name, uint32_t pdu_len, uint32_t nb)
+{
+	t_hydra_console con;
+	t_mode_config mode;
+	sim_chn_t chn;
+	sim_can_ecu_t *ecu;
+	uint8_t *in;
+	uint32_t len;
+	uint64_t t;
+
+	in = bench_script(nb, pdu_len, &len);
+	ecu = malloc(sizeof(sim_can_ecu_t));
+	TEST_ASSERT(in != NULL && ecu != NULL);
+	pool_init();
+	sim_chn_init(&chn, in, len, NULL, 0);
+	sim_console_init(&con, &mode, &chn);
+	sim_can_ecu_init(ecu, ECU_REQ_ID, ECU_RESP_ID);
+	sim_can_attach(BSP_DEV_CAN1, &ecu->dev);
+
+	t = test_time_ns();
+	bbio_mode_can(&con);
+	t = test_time_ns() - t;
+
+	free(in);
+	TEST_ASSERT(chn.in_pos == len);
+	TEST_ASSERT(ecu->nb_requests == nb);
+	TEST_ASSERT(ecu->errors == 0);
+	if(pdu_len)
+		bench_report(name, t, (uint64_t)nb * pdu_len * 2, "B");
+	else
+		bench_report(name, t, nb, "op");
+	sim_can_attach(BSP_DEV_CAN1, NULL);
+	free(ecu);
+	return 0;
+}
+
+/*
+ * Firmware overhead of the BBIO CAN commands, the simulated ECU answers
+ * immediately: per request and response of single frames, per byte of
+ * the ISO-TP requests and responses.
+ */
+int bench_bbio_can(void)
+{
+	if(bench_bbio_can_cmd("write, read response", 0, 100000))
+		return 1;
+	return bench_bbio_can_cmd("ISO-TP request 2x4095B", 4095, 1000);
+}
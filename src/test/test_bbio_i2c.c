@@ -0,0 +1,205 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * BBIO I2C mode (hydrabus_bbio_i2c.c) run on a simulated console and an
+ * EEPROM on the simulated I2C bus.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "test.h"
+#include "sim_console.h"
+#include "sim_i2c.h"
+#include "hydrabus_bbio.h"
+#include "hydrabus_bbio_i2c.h"
+
+#define EEPROM_ADDR7	(0x50)
+#define EEPROM_W	(EEPROM_ADDR7 << 1)
+#define EEPROM_R	((EEPROM_ADDR7 << 1) | 1)
+
+static const uint8_t bbio_i2c_in[] = {
+	BBIO_MODE_ID,
+	/* Write 0x42 at 0x10 */
+	BBIO_I2C_START_BIT,
+	BBIO_I2C_BULK_WRITE | 2, EEPROM_W, 0x10, 0x42,
+	BBIO_I2C_STOP_BIT,
+	/* Set the word address then read 4 bytes */
+	BBIO_I2C_WRITE_READ, 0x00, 0x02, 0x00, 0x00, EEPROM_W, 0x10,
+	BBIO_I2C_WRITE_READ, 0x00, 0x01, 0x00, 0x04, EEPROM_R,
+	/* Byte per byte current address read */
+	BBIO_I2C_START_BIT,
+	BBIO_I2C_BULK_WRITE | 0, EEPROM_R,
+	BBIO_I2C_READ_BYTE,
+	BBIO_I2C_ACK_BIT,
+	BBIO_I2C_READ_BYTE,
+	BBIO_I2C_NACK_BIT,
+	BBIO_I2C_STOP_BIT,
+	/* No device at this address, the STOP is left to the host */
+	BBIO_I2C_WRITE_READ, 0x00, 0x01, 0x00, 0x01, 0xB0,
+	BBIO_I2C_STOP_BIT,
+	/* More than 4096 bytes to write is rejected */
+	BBIO_I2C_WRITE_READ, 0x10, 0x01, 0x00, 0x00,
+	BBIO_I2C_SET_SPEED | 3,
+	/* The sniffer needs the DMA sampling, not simulated */
+	BBIO_I2C_START_SNIFF,
+	BBIO_RESET,
+};
+
+static const uint8_t bbio_i2c_out[] = {
+	'I', '2', 'C', '1',
+	'I', '2', 'C', '1',
+	0x01,
+	0x01, 0x00, 0x00, 0x00,
+	0x01,
+	0x01,
+	0x01, 0x42, 0x11 ^ 0xA5, 0x12 ^ 0xA5, 0x13 ^ 0xA5,
+	0x01,
+	0x01, 0x00,
+	0x14 ^ 0xA5,
+	0x01,
+	0x15 ^ 0xA5,
+	0x01,
+	0x01,
+	0x00,
+	0x01,
+	0x00,
+	0x01,
+	0x00,
+};
+
+int test_bbio_i2c(void)
+{
+	t_hydra_console con;
+	t_mode_config mode;
+	sim_chn_t chn;
+	sim_eeprom_t eeprom;
+	pool_stats_t stats;
+	uint8_t out[64];
+
+	pool_init();
+	sim_chn_init(&chn, bbio_i2c_in, sizeof(bbio_i2c_in), out, sizeof(out));
+	sim_console_init(&con, &mode, &chn);
+	sim_eeprom_init(&eeprom, EEPROM_ADDR7);
+	sim_i2c_attach(&eeprom.dev);
+
+	bbio_mode_i2c(&con);
+
+	TEST_ASSERT(!sim_ubtn);
+	TEST_ASSERT(chn.in_pos == sizeof(bbio_i2c_in));
+	TEST_ASSERT(chn.out_len == sizeof(bbio_i2c_out));
+	TEST_ASSERT(!memcmp(out, bbio_i2c_out, sizeof(bbio_i2c_out)));
+	TEST_ASSERT(eeprom.mem[0x10] == 0x42);
+	TEST_ASSERT(eeprom.nb_write == 1);
+	TEST_ASSERT(eeprom.nb_read == 6);
+	TEST_ASSERT(eeprom.errors == 0);
+	TEST_ASSERT(sim_i2c_state.nb_start == 5);
+	TEST_ASSERT(sim_i2c_state.nb_stop == 5);
+	TEST_ASSERT(sim_i2c_state.conf.config.i2c.dev_speed == 3);
+	TEST_ASSERT(!sim_i2c_state.init);
+	pool_stats(POOL_RAM, &stats);
+	TEST_ASSERT(stats.blocks_used == 0);
+	pool_stats(POOL_CCM, &stats);
+	TEST_ASSERT(stats.blocks_used == 0);
+
+	sim_i2c_attach(NULL);
+	return 0;
+}
+
+/*
+ * Commands of the benchmark, in a mode session ended by BBIO_RESET:
+ * START, bulk write of 16 bytes (address, word address, 14 data), STOP or
+ * sequential reads of rd_len bytes.
+ */
+static uint8_t *bench_script(uint32_t nb, uint32_t rd_len, uint32_t *len)
+{
+	uint8_t *in;
+	uint8_t *p;
+	uint32_t i, cmd_len;
+
+	cmd_len = rd_len ? 6 : 19;
+	*len = nb * cmd_len + 1;
+	in = malloc(*len);
+	if(in == NULL)
+		return NULL;
+	for(i = 0; i < nb; i++) {
+		p = &in[i * cmd_len];
+		if(rd_len) {
+			p[0] = BBIO_I2C_WRITE_READ;
+			p[1] = 0x00;
+			p[2] = 0x01;
+			p[3] = rd_len >> 8;
+			p[4] = rd_len & 0xFF;
+			p[5] = EEPROM_R;
+		} else {
+			memset(p, 0x5A, cmd_len);
+			p[0] = BBIO_I2C_START_BIT;
+			p[1] = BBIO_I2C_BULK_WRITE | 15;
+			p[2] = EEPROM_W;
+			p[3] = (uint8_t)(i << 4);
+			p[18] = BBIO_I2C_STOP_BIT;
+		}
+	}
+	in[*len - 1] = BBIO_RESET;
+	return in;
+}
+
+static int bench_bbio_i2c_cmd(const char *name, uint32_t rd_len, uint32_t nb)
+{
+	t_hydra_console con;
+	t_mode_config mode;
+	sim_chn_t chn;
+	sim_eeprom_t eeprom;
+	uint8_t *in;
+	uint32_t len, data_len;
+	uint64_t t;
+
+	in = bench_script(nb, rd_len, &len);
+	TEST_ASSERT(in != NULL);
+	data_len = rd_len ? rd_len + 1 : 16;
+	pool_init();
+	sim_chn_init(&chn, in, len, NULL, 0);
+	sim_console_init(&con, &mode, &chn);
+	sim_eeprom_init(&eeprom, EEPROM_ADDR7);
+	sim_i2c_attach(&eeprom.dev);
+
+	t = test_time_ns();
+	bbio_mode_i2c(&con);
+	t = test_time_ns() - t;
+
+	free(in);
+	TEST_ASSERT(chn.in_pos == len);
+	TEST_ASSERT(eeprom.errors == 0);
+	TEST_ASSERT(eeprom.nb_write + eeprom.nb_read == (uint64_t)nb * (data_len - 2 + !!rd_len));
+	TEST_ASSERT(sim_i2c_state.nb_bytes == (uint64_t)nb * data_len);
+	bench_report(name, t, (uint64_t)nb * data_len, "B");
+	sim_i2c_attach(NULL);
+	return 0;
+}
+
+/*
+ * Firmware overhead per I2C byte of the BBIO I2C commands, the simulated
+ * EEPROM answers immediately.
+ */
+int bench_bbio_i2c(void)
+{
+	if(bench_bbio_i2c_cmd("bulk write 16B", 0, 100000))
+		return 1;
+	return bench_bbio_i2c_cmd("write then read 4096B", 4096, 2000);
+}
@@ -0,0 +1,162 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * BBIO SPI mode (hydrabus_bbio_spi.c) run on a simulated console and a
+ * scripted SPI device.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "test.h"
+#include "sim_console.h"
+#include "sim_spi.h"
+#include "hydrabus_bbio.h"
+#include "hydrabus_bbio_spi.h"
+
+static const uint8_t rdid_mosi[] = { 0x9F, 0x00, 0x00, 0x00 };
+static const uint8_t rdid_miso[] = { 0xFF, 0xEF, 0x40, 0x18 };
+static const uint8_t read_mosi[] = { 0x03, 0x10, 0xFF, 0xFF, 0xFF };
+static const uint8_t read_miso[] = { 0xFF, 0xFF, 0x11, 0x22, 0x33 };
+
+static const sim_spi_step_t bbio_spi_steps[] = {
+	{ rdid_mosi, rdid_miso, sizeof(rdid_mosi) },
+	{ read_mosi, read_miso, sizeof(read_mosi) },
+};
+
+static const uint8_t bbio_spi_in[] = {
+	BBIO_MODE_ID,
+	BBIO_SPI_CS_LOW,
+	BBIO_SPI_BULK_TRANSFER | 3, 0x9F, 0x00, 0x00, 0x00,
+	BBIO_SPI_CS_HIGH,
+	BBIO_SPI_WRITE_READ, 0x00, 0x02, 0x00, 0x03, 0x03, 0x10,
+	/* More than 4096 bytes to write is rejected */
+	BBIO_SPI_WRITE_READ, 0x10, 0x01, 0x00, 0x00,
+	BBIO_SPI_SET_SPEED | 2,
+	BBIO_RESET,
+};
+
+static const uint8_t bbio_spi_out[] = {
+	'S', 'P', 'I', '1',
+	'S', 'P', 'I', '1',
+	0x01,
+	0x01, 0xFF, 0xEF, 0x40, 0x18,
+	0x01,
+	0x01, 0x11, 0x22, 0x33,
+	0x00,
+	0x01,
+};
+
+int test_bbio_spi(void)
+{
+	t_hydra_console con;
+	t_mode_config mode;
+	sim_chn_t chn;
+	sim_spi_script_t dev;
+	pool_stats_t stats;
+	uint8_t out[64];
+
+	pool_init();
+	sim_chn_init(&chn, bbio_spi_in, sizeof(bbio_spi_in), out, sizeof(out));
+	sim_console_init(&con, &mode, &chn);
+	sim_spi_script_init(&dev, bbio_spi_steps, 2);
+	sim_spi_attach(BSP_DEV_SPI1, &dev.dev);
+
+	bbio_mode_spi(&con);
+
+	TEST_ASSERT(!sim_ubtn);
+	TEST_ASSERT(chn.in_pos == sizeof(bbio_spi_in));
+	TEST_ASSERT(chn.out_len == sizeof(bbio_spi_out));
+	TEST_ASSERT(!memcmp(out, bbio_spi_out, sizeof(bbio_spi_out)));
+	TEST_ASSERT(sim_spi_script_done(&dev));
+	TEST_ASSERT(sim_spi_state[BSP_DEV_SPI1].conf.config.spi.dev_speed == 2);
+	TEST_ASSERT(!sim_spi_state[BSP_DEV_SPI1].init);
+	pool_stats(POOL_RAM, &stats);
+	TEST_ASSERT(stats.blocks_used == 0);
+
+	sim_spi_attach(BSP_DEV_SPI1, NULL);
+	return 0;
+}
+
+/* Commands of the benchmark, in a mode session ended by BBIO_RESET */
+static uint8_t *bench_script(uint32_t nb, uint8_t cmd, uint32_t cmd_len,
+			     uint32_t *len)
+{
+	uint8_t *in;
+	uint32_t i;
+
+	*len = nb * cmd_len + 1;
+	in = malloc(*len);
+	if(in == NULL)
+		return NULL;
+	for(i = 0; i < nb; i++) {
+		memset(&in[i * cmd_len], 0x5A, cmd_len);
+		in[i * cmd_len] = cmd;
+		if(cmd == BBIO_SPI_WRITE_READ) {
+			/* Write cmd_len-5 bytes, read as many */
+			in[i * cmd_len + 1] = (cmd_len - 5) >> 8;
+			in[i * cmd_len + 2] = (cmd_len - 5) & 0xFF;
+			in[i * cmd_len + 3] = (cmd_len - 5) >> 8;
+			in[i * cmd_len + 4] = (cmd_len - 5) & 0xFF;
+		}
+	}
+	in[*len - 1] = BBIO_RESET;
+	return in;
+}
+
+static int bench_bbio_spi_cmd(const char *name, uint8_t cmd, uint32_t cmd_len,
+			      uint32_t data_len, uint32_t nb)
+{
+	t_hydra_console con;
+	t_mode_config mode;
+	sim_chn_t chn;
+	uint8_t *in;
+	uint32_t len;
+	uint64_t t;
+
+	in = bench_script(nb, cmd, cmd_len, &len);
+	TEST_ASSERT(in != NULL);
+	pool_init();
+	sim_chn_init(&chn, in, len, NULL, 0);
+	sim_console_init(&con, &mode, &chn);
+	sim_spi_attach(BSP_DEV_SPI1, NULL);
+
+	t = test_time_ns();
+	bbio_mode_spi(&con);
+	t = test_time_ns() - t;
+
+	free(in);
+	TEST_ASSERT(chn.in_pos == len);
+	TEST_ASSERT(sim_spi_state[BSP_DEV_SPI1].nb_bytes == (uint64_t)nb * data_len);
+	bench_report(name, t, (uint64_t)nb * data_len, "B");
+	return 0;
+}
+
+/*
+ * Firmware overhead per SPI byte of the BBIO SPI commands, the simulated
+ * SPI device answers immediately.
+ */
+int bench_bbio_spi(void)
+{
+	if(bench_bbio_spi_cmd("bulk transfer 16B",
+			      BBIO_SPI_BULK_TRANSFER | 15, 17, 16, 100000))
+		return 1;
+	return bench_bbio_spi_cmd("write then read 2x4096B",
+				  BBIO_SPI_WRITE_READ, 4096 + 5, 8192, 2000);
+}
@@ -0,0 +1,182 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * BBIO UART mode (hydrabus_bbio_uart.c) run on a simulated console and a
+ * loopback plug on the simulated UART.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "test.h"
+#include "sim_console.h"
+#include "sim_uart.h"
+#include "hydrabus_bbio.h"
+#include "hydrabus_bbio_uart.h"
+
+static const uint8_t bbio_uart_in[] = {
+	BBIO_MODE_ID,
+	/* Bulk write of 4 bytes, each one acknowledged */
+	BBIO_UART_BULK_TRANSFER | 3, 0x55, 0xAA, 0x00, 0xFF,
+	/* 115200 bauds, 9 is not a speed */
+	BBIO_UART_SET_SPEED | 10,
+	BBIO_UART_SET_SPEED | 9,
+	/* 1000000 bauds */
+	BBIO_UART_BAUD_RATE, 0x00, 0x0F, 0x42, 0x40,
+	/* Odd parity (2), 2 stop bits, then parity 3 is not valid */
+	BBIO_UART_CONFIG | 0b1010,
+	BBIO_UART_CONFIG | 0b1100,
+	/* 80 bauds is rejected by the UART */
+	BBIO_UART_BAUD_RATE, 0x00, 0x00, 0x00, 0x50,
+	BBIO_UART_CONFIG_PERIPH | 0b10,
+	/* The bridge needs the DMA and a reader thread, not simulated */
+	BBIO_UART_START_ECHO,
+	BBIO_UART_STOP_ECHO,
+	BBIO_UART_BRIDGE,
+	BBIO_RESET,
+};
+
+static const uint8_t bbio_uart_out[] = {
+	'A', 'R', 'T', '1',
+	'A', 'R', 'T', '1',
+	0x01, 0x01, 0x01, 0x01,
+	0x01,
+	0x00,
+	0x01,
+	0x01,
+	0x00,
+	0x00,
+	0x01,
+	0x00,
+	0x01,
+	0x01,
+};
+
+int test_bbio_uart(void)
+{
+	t_hydra_console con;
+	t_mode_config mode;
+	sim_chn_t chn;
+	sim_uart_loopback_t loop;
+	pool_stats_t stats;
+	uint8_t out[64];
+	uint8_t rx[4];
+
+	pool_init();
+	sim_chn_init(&chn, bbio_uart_in, sizeof(bbio_uart_in), out, sizeof(out));
+	sim_console_init(&con, &mode, &chn);
+	sim_uart_loopback_init(&loop);
+	sim_uart_attach(BSP_DEV_UART1, &loop.dev);
+
+	bbio_mode_uart(&con);
+
+	TEST_ASSERT(!sim_ubtn);
+	TEST_ASSERT(chn.in_pos == sizeof(bbio_uart_in));
+	TEST_ASSERT(chn.out_len == sizeof(bbio_uart_out));
+	TEST_ASSERT(!memcmp(out, bbio_uart_out, sizeof(bbio_uart_out)));
+	TEST_ASSERT(sim_uart_state[BSP_DEV_UART1].nb_tx == 4);
+	TEST_ASSERT(loop.nb_write == 4);
+	TEST_ASSERT(!sim_uart_state[BSP_DEV_UART1].init);
+	/* Last configuration accepted */
+	TEST_ASSERT(sim_uart_state[BSP_DEV_UART1].conf.config.uart.dev_speed == 1000000);
+	TEST_ASSERT(sim_uart_state[BSP_DEV_UART1].conf.config.uart.dev_parity == 2);
+	TEST_ASSERT(sim_uart_state[BSP_DEV_UART1].conf.config.uart.dev_stop_bit == 2);
+	pool_stats(POOL_RAM, &stats);
+	TEST_ASSERT(stats.blocks_used == 0);
+	pool_stats(POOL_CCM, &stats);
+	TEST_ASSERT(stats.blocks_used == 0);
+
+	/* The bytes sent came back on RX */
+	mode.proto.config.uart.dev_speed = 9600;
+	TEST_ASSERT(bsp_uart_init(BSP_DEV_UART1, &mode.proto) == BSP_OK);
+	TEST_ASSERT(bsp_uart_rxne(BSP_DEV_UART1));
+	TEST_ASSERT(bsp_uart_read_u8(BSP_DEV_UART1, rx, 4) == BSP_OK);
+	TEST_ASSERT(!memcmp(rx, "\x55\xAA\x00\xFF", 4));
+	TEST_ASSERT(!bsp_uart_rxne(BSP_DEV_UART1));
+	TEST_ASSERT(bsp_uart_read_u8(BSP_DEV_UART1, rx, 1) == BSP_TIMEOUT);
+
+	sim_uart_attach(BSP_DEV_UART1, NULL);
+	return 0;
+}
+
+/*
+ * Commands of the benchmark, in a mode session ended by BBIO_RESET: bulk
+ * writes of wr_len bytes (1 to 16), or speed changes when wr_len is 0.
+ */
+static uint8_t *bench_script(uint32_t nb, uint32_t wr_len, uint32_t *len)
+{
+	uint8_t *in;
+	uint32_t i, cmd_len;
+
+	cmd_len = 1 + wr_len;
+	*len = nb * cmd_len + 1;
+	in = malloc(*len);
+	if(in == NULL)
+		return NULL;
+	for(i = 0; i < nb; i++) {
+		memset(&in[i * cmd_len], 0x5A, cmd_len);
+		if(wr_len)
+			in[i * cmd_len] = BBIO_UART_BULK_TRANSFER | (wr_len - 1);
+		else
+			in[i * cmd_len] = BBIO_UART_SET_SPEED | ((i & 1) ? 4 : 10);
+	}
+	in[*len - 1] = BBIO_RESET;
+	return in;
+}
+
+static int bench_bbio_uart_cmd(const char *name, uint32_t wr_len, uint32_t nb)
+{
+	t_hydra_console con;
+	t_mode_config mode;
+	sim_chn_t chn;
+	uint8_t *in;
+	uint32_t len;
+	uint64_t t;
+
+	in = bench_script(nb, wr_len, &len);
+	TEST_ASSERT(in != NULL);
+	pool_init();
+	sim_chn_init(&chn, in, len, NULL, 0);
+	sim_console_init(&con, &mode, &chn);
+	sim_uart_attach(BSP_DEV_UART1, NULL);
+
+	t = test_time_ns();
+	bbio_mode_uart(&con);
+	t = test_time_ns() - t;
+
+	free(in);
+	TEST_ASSERT(chn.in_pos == len);
+	TEST_ASSERT(sim_uart_state[BSP_DEV_UART1].nb_tx == (uint64_t)nb * wr_len);
+	if(wr_len)
+		bench_report(name, t, (uint64_t)nb * wr_len, "B");
+	else
+		bench_report(name, t, nb, "op");
+	return 0;
+}
+
+/*
+ * Firmware overhead of the BBIO UART commands: per byte of the bulk
+ * writes, each byte acknowledged, and per UART configuration.
+ */
+int bench_bbio_uart(void)
+{
+	if(bench_bbio_uart_cmd("bulk write 16B", 16, 100000))
+		return 1;
+	return bench_bbio_uart_cmd("set speed", 0, 100000);
+}
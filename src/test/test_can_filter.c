@@ -0,0 +1,299 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * CAN acceptance filter compiler (hydrabus_can_filter.c): random rule
+ * sets compiled to 1 to 28 banks and checked with a bxCAN filter model
+ * written from the reference manual, independent of the compiler. No
+ * wanted frame is ever rejected, can_filter_match() agrees with the
+ * model, and the filters are exact when there are enough banks.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "test.h"
+#include "hydrabus_can_filter.h"
+
+#define MAX_RULES	(16) /* CAN_CONFIG_FILTER_RULES */
+#define MAX_BANKS	(28) /* Both CAN controllers */
+
+#define STD_ID_MAX	(0x7FF)
+#define EXT_ID_MAX	(0x1FFFFFFF)
+
+static can_filter_rule_t rules[MAX_RULES];
+static can_filter_bank_t banks[MAX_BANKS];
+
+/*
+ * bxCAN filter model, RM0090 "Identifier filtering":
+ * 32 bits: STID[10:0] EXID[17:0] IDE RTR 0
+ * 16 bits: STID[10:0] RTR IDE EXID[17:15]
+ */
+static uint32_t model_reg32(uint32_t id, bool ext, bool rtr)
+{
+	if(ext)
+		return (id << 3) | (1 << 2) | (rtr << 1);
+	return (id << 21) | (rtr << 1);
+}
+
+static uint32_t model_reg16(uint32_t id, bool ext, bool rtr)
+{
+	if(ext)
+		return ((id >> 18) << 5) | (rtr << 4) | (1 << 3) | ((id >> 15) & 7);
+	return (id << 5) | (rtr << 4);
+}
+
+static bool model_match(uint32_t nb_banks, uint32_t id, bool ext, bool rtr)
+{
+	uint32_t r32 = model_reg32(id, ext, rtr);
+	uint32_t r16 = model_reg16(id, ext, rtr);
+	uint32_t i, k, v[4];
+	const can_filter_bank_t *b;
+
+	for(i = 0; i < nb_banks; i++) {
+		b = &banks[i];
+		if(b->scale == 32 && b->mode == CAN_FILTER_MODE_MASK) {
+			if((r32 & b->fr2) == (b->fr1 & b->fr2))
+				return true;
+		} else if(b->scale == 32) {
+			if(r32 == b->fr1 || r32 == b->fr2)
+				return true;
+		} else if(b->mode == CAN_FILTER_MODE_MASK) {
+			/* Mask in the high half word, identifier in the low one */
+			for(k = 0; k < 2; k++) {
+				v[0] = k ? b->fr2 : b->fr1;
+				if(((r16 ^ v[0]) & (v[0] >> 16)) == 0)
+					return true;
+			}
+		} else {
+			v[0] = b->fr1 & 0xFFFF;
+			v[1] = b->fr1 >> 16;
+			v[2] = b->fr2 & 0xFFFF;
+			v[3] = b->fr2 >> 16;
+			for(k = 0; k < 4; k++) {
+				if(r16 == v[k])
+					return true;
+			}
+		}
+	}
+	return false;
+}
+
+static bool wanted(uint32_t nb_rules, uint32_t id, bool ext, bool rtr)
+{
+	uint32_t i;
+
+	for(i = 0; i < nb_rules; i++) {
+		if(!(rules[i].flags & CAN_FILTER_EXT) != !ext)
+			continue;
+		if(rtr && (rules[i].flags & CAN_FILTER_NO_RTR))
+			continue;
+		if(id >= rules[i].first && id <= rules[i].last)
+			return true;
+	}
+	return false;
+}
+
+/* Checks a frame, counts the unwanted frames accepted */
+static int check_frame(uint32_t nb_rules, uint32_t nb_banks,
+		       uint32_t id, bool ext, bool rtr, uint32_t *extra)
+{
+	bool accepted = model_match(nb_banks, id, ext, rtr);
+
+	TEST_ASSERT(can_filter_match(banks, nb_banks, id, ext, rtr) == accepted);
+	if(wanted(nb_rules, id, ext, rtr))
+		TEST_ASSERT(accepted);
+	else if(accepted)
+		(*extra)++;
+	return 0;
+}
+
+static uint32_t random_id(bool ext)
+{
+	uint32_t id = test_rand();
+
+	if(ext) {
+		/* Identifiers sharing their high bits, as the real ones */
+		id = (id & 0x1FFF0000) | (test_rand() & 0xFFFF);
+		if(test_rand() & 1)
+			id = 0x18DA0000 | (id & 0xFFFF);
+	}
+	return id & (ext ? EXT_ID_MAX : STD_ID_MAX);
+}
+
+static uint32_t random_rules(void)
+{
+	uint32_t i, nb, len;
+	bool ext;
+
+	nb = 1 + test_rand() % MAX_RULES;
+	for(i = 0; i < nb; i++) {
+		ext = (test_rand() % 3) == 0;
+		rules[i].flags = ext ? CAN_FILTER_EXT : 0;
+		if((test_rand() % 4) == 0)
+			rules[i].flags |= CAN_FILTER_NO_RTR;
+		rules[i].first = random_id(ext);
+		switch(test_rand() % 4) {
+		case 0:
+			len = 0;
+			break;
+		case 1:
+			len = test_rand() % 16;
+			break;
+		case 2:
+			len = test_rand() % 256;
+			break;
+		default:
+			len = test_rand() % (ext ? 0x100000 : 0x800);
+			break;
+		}
+		rules[i].last = rules[i].first + len;
+		if(rules[i].last > (ext ? EXT_ID_MAX : STD_ID_MAX))
+			rules[i].last = ext ? EXT_ID_MAX : STD_ID_MAX;
+	}
+	return nb;
+}
+
+static int check_banks(uint32_t nb_rules, uint32_t nb_banks, uint32_t *extra)
+{
+	uint32_t i, k, id;
+	uint32_t ids[8];
+
+	/* Every standard frame */
+	for(id = 0; id <= STD_ID_MAX; id++) {
+		if(check_frame(nb_rules, nb_banks, id, false, false, extra) ||
+		   check_frame(nb_rules, nb_banks, id, false, true, extra))
+			return 1;
+	}
+
+	/* Extended frames at the range edges, inside and around them */
+	for(i = 0; i < nb_rules; i++) {
+		if(!(rules[i].flags & CAN_FILTER_EXT))
+			continue;
+		ids[0] = rules[i].first;
+		ids[1] = rules[i].last;
+		ids[2] = rules[i].first - 1;
+		ids[3] = rules[i].last + 1;
+		for(k = 4; k < 8; k++)
+			ids[k] = rules[i].first + test_rand() % (rules[i].last - rules[i].first + 1);
+		for(k = 0; k < 8; k++) {
+			id = ids[k] & EXT_ID_MAX;
+			if(check_frame(nb_rules, nb_banks, id, true, false, extra) ||
+			   check_frame(nb_rules, nb_banks, id, true, true, extra))
+				return 1;
+		}
+	}
+	for(k = 0; k < 256; k++) {
+		id = random_id(true);
+		if(check_frame(nb_rules, nb_banks, id, true, test_rand() & 1, extra))
+			return 1;
+	}
+	return 0;
+}
+
+static int test_can_filter_parse(void)
+{
+	can_filter_rule_t r[4];
+
+	TEST_ASSERT(can_filter_parse("123,700-7ff,18DAF100-18DAF1FF", r, 4) == 3);
+	TEST_ASSERT(r[0].first == 0x123 && r[0].last == 0x123 && r[0].flags == 0);
+	TEST_ASSERT(r[1].first == 0x700 && r[1].last == 0x7FF && r[1].flags == 0);
+	TEST_ASSERT(r[2].first == 0x18DAF100 && r[2].last == 0x18DAF1FF);
+	TEST_ASSERT(r[2].flags == CAN_FILTER_EXT);
+	/* 4 digits and more are extended identifiers */
+	TEST_ASSERT(can_filter_parse("0123", r, 4) == 1 && r[0].flags == CAN_FILTER_EXT);
+	TEST_ASSERT(can_filter_parse("", r, 4) == 0);
+
+	TEST_ASSERT(can_filter_parse("800", r, 4) == -1);
+	TEST_ASSERT(can_filter_parse("20000000", r, 4) == -1);
+	TEST_ASSERT(can_filter_parse("123456789", r, 4) == -1);
+	TEST_ASSERT(can_filter_parse("7ff-700", r, 4) == -1);
+	TEST_ASSERT(can_filter_parse("700-", r, 4) == -1);
+	TEST_ASSERT(can_filter_parse("12g", r, 4) == -1);
+	TEST_ASSERT(can_filter_parse(",1", r, 4) == -1);
+	TEST_ASSERT(can_filter_parse("1,2,3,4,5", r, 4) == -1);
+	return 0;
+}
+
+int test_can_filter(void)
+{
+	uint32_t k, nb_rules, max_banks, nb_banks, extra;
+
+	test_srand(22);
+
+	if(test_can_filter_parse())
+		return 1;
+
+	/* No rule, nothing to filter */
+	TEST_ASSERT(can_filter_compile(rules, 0, banks, 1) == 0);
+
+	/* Random rule sets, down to a single bank: no wanted frame rejected */
+	for(k = 0; k < 1500; k++) {
+		nb_rules = random_rules();
+		max_banks = 1 + test_rand() % MAX_BANKS;
+		nb_banks = can_filter_compile(rules, nb_rules, banks, max_banks);
+		TEST_ASSERT(nb_banks >= 1 && nb_banks <= max_banks);
+		extra = 0;
+		if(check_banks(nb_rules, nb_banks, &extra))
+			return 1;
+	}
+
+	/* Single identifiers with enough banks: exact */
+	for(k = 0; k < 200; k++) {
+		nb_rules = 1 + test_rand() % MAX_RULES;
+		memset(rules, 0, sizeof(rules));
+		for(max_banks = 0; max_banks < nb_rules; max_banks++) {
+			rules[max_banks].flags = (test_rand() & 1) ? CAN_FILTER_EXT : 0;
+			if(test_rand() & 1)
+				rules[max_banks].flags |= CAN_FILTER_NO_RTR;
+			rules[max_banks].first = random_id(rules[max_banks].flags & CAN_FILTER_EXT);
+			rules[max_banks].last = rules[max_banks].first;
+		}
+		nb_banks = can_filter_compile(rules, nb_rules, banks, MAX_BANKS);
+		TEST_ASSERT(nb_banks <= nb_rules);
+		extra = 0;
+		if(check_banks(nb_rules, nb_banks, &extra))
+			return 1;
+		TEST_ASSERT(extra == 0);
+	}
+
+	/* Aligned standard ranges in one bank: exact */
+	rules[0].first = 0x700;
+	rules[0].last = 0x7FF;
+	rules[0].flags = 0;
+	rules[1].first = 0x100;
+	rules[1].last = 0x10F;
+	rules[1].flags = CAN_FILTER_NO_RTR;
+	TEST_ASSERT(can_filter_compile(rules, 2, banks, 1) == 1);
+	extra = 0;
+	if(check_banks(2, 1, &extra))
+		return 1;
+	TEST_ASSERT(extra == 0);
+
+	/* A single bank for the whole standard range and an extended range */
+	rules[0].first = 0;
+	rules[0].last = STD_ID_MAX;
+	rules[1].first = 0x18DAF100;
+	rules[1].last = 0x18DAF1FF;
+	rules[1].flags = CAN_FILTER_EXT;
+	TEST_ASSERT(can_filter_compile(rules, 2, banks, 1) == 1);
+	extra = 0;
+	if(check_banks(2, 1, &extra))
+		return 1;
+	return 0;
+}
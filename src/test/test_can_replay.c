@@ -0,0 +1,316 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Timed CAN replay (hydrabus_can_replay.c): candump log parser, and the
+ * scheduler driven by a simulated 16 bits 1MHz compare timer, as in
+ * can_replay_timer_cb(), with interrupt latency, full TX mailboxes and a
+ * parser falling behind. The frames are sent in order at their absolute
+ * log times over many timer wraps, the late ones are counted.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "test.h"
+#include "hydrabus_can_replay.h"
+
+#define NB_FRAMES	(3000)
+#define RING_SIZE	(64)
+#define RETRY_US	(20) /* CAN_REPLAY_RETRY_US */
+#define MARGIN_US	(2) /* Frames may be sent this early */
+
+static can_replay_entry_t ring_entries[RING_SIZE];
+static can_replay_t replay;
+static uint32_t delays[NB_FRAMES];
+static uint64_t sent_at[NB_FRAMES];
+
+static struct {
+	uint64_t t; /* Microseconds */
+	uint64_t fire; /* Next compare interrupt */
+	uint32_t irq_lat; /* Interrupt latency, up to */
+	uint32_t tx_fail; /* One frame in tx_fail finds the mailboxes full */
+	uint32_t put; /* Entries given to the schedule */
+	uint64_t stall_at; /* The parser stops at this time ... */
+	uint64_t stall_end; /* ... until this time */
+	uint64_t start; /* First interrupt, the time of the log start */
+	uint32_t nb_sent;
+} sim;
+
+static void sim_timer_set(uint16_t compare)
+{
+	uint16_t d = compare - (uint16_t)sim.t;
+
+	/* A compare equal to the counter fires after a full period */
+	sim.fire = sim.t + (d ? d : 0x10000);
+}
+
+/* Parser thread: fills the schedule, unless stalled */
+static void sim_parser(void)
+{
+	can_replay_entry_t e;
+
+	if(sim.t >= sim.stall_at && sim.t < sim.stall_end)
+		return;
+	while(sim.put < NB_FRAMES && can_replay_free(&replay) > 0) {
+		memset(&e, 0, sizeof(e));
+		e.id = sim.put;
+		e.delay = delays[sim.put];
+		can_replay_put(&replay, &e);
+		sim.put++;
+	}
+	if(sim.put == NB_FRAMES)
+		replay.eof = true;
+}
+
+/* can_replay_timer_cb() */
+static int sim_isr(void)
+{
+	const can_replay_entry_t *e;
+	uint16_t compare = 0;
+
+	while((e = can_replay_sched(&replay, sim.t, &compare)) != NULL) {
+		TEST_ASSERT(e->id == sim.nb_sent);
+		if(sim.tx_fail && (test_rand() % sim.tx_fail) == 0) {
+			compare = sim.t + RETRY_US;
+			break;
+		}
+		sent_at[sim.nb_sent++] = sim.t;
+		can_replay_sent(&replay, sim.t);
+	}
+	if(!replay.done)
+		sim_timer_set(compare);
+	return 0;
+}
+
+static int sim_run(uint64_t start)
+{
+	can_replay_init(&replay, ring_entries, RING_SIZE);
+	sim.t = start;
+	sim.put = 0;
+	sim.nb_sent = 0;
+	sim_parser();
+	/* bsp_can_timer_start(): first interrupt now, the log time starts */
+	sim.fire = start;
+	sim.start = 0;
+	while(!replay.done) {
+		sim.t = sim.fire;
+		if(sim.irq_lat)
+			sim.t += test_rand() % (sim.irq_lat + 1);
+		if(sim.start == 0)
+			sim.start = sim.t;
+		sim_parser();
+		if(sim_isr())
+			return 1;
+		TEST_ASSERT(sim.t - start < ((uint64_t)1 << 40));
+	}
+	TEST_ASSERT(sim.nb_sent == NB_FRAMES && replay.sent == NB_FRAMES);
+	return 0;
+}
+
+static void random_delays(void)
+{
+	uint32_t i;
+
+	for(i = 0; i < NB_FRAMES; i++) {
+		switch(test_rand() % 8) {
+		case 0:
+		case 1:
+			delays[i] = 0;
+			break;
+		case 2:
+		case 3:
+			delays[i] = test_rand() % 100;
+			break;
+		case 4:
+		case 5:
+			delays[i] = 100 + test_rand() % 5000;
+			break;
+		case 6:
+			delays[i] = test_rand() % 200000;
+			break;
+		default:
+			/* Several timer wraps */
+			delays[i] = test_rand() % 3000000;
+			break;
+		}
+	}
+	/* Frames out of reach of one timer period */
+	delays[1] = 0x10000;
+	delays[2] = 0x10000 - 1;
+	delays[3] = 0x4000;
+}
+
+/* Frames at their absolute times, late ones counted as the scheduler does */
+static int check_times(void)
+{
+	uint64_t due = sim.start;
+	uint32_t i, late = 0, max_late = 0;
+	int64_t err;
+
+	for(i = 0; i < NB_FRAMES; i++) {
+		due += delays[i];
+		err = (int64_t)(sent_at[i] - due);
+		TEST_ASSERT(err >= -MARGIN_US);
+		/* Within the interrupt latency unless a retry happened */
+		if(!sim.tx_fail)
+			TEST_ASSERT(err <= (int64_t)sim.irq_lat);
+		TEST_ASSERT(err < 0x7fff);
+		if(err > CAN_REPLAY_LATE_US)
+			late++;
+		if(err > (int64_t)max_late)
+			max_late = err;
+	}
+	TEST_ASSERT(replay.late == late && replay.max_late == max_late);
+	return 0;
+}
+
+static int test_can_replay_sched(void)
+{
+	uint64_t start = 0x123456789ULL;
+	uint32_t i, underruns;
+
+	memset(&sim, 0, sizeof(sim));
+	sim.stall_at = UINT64_MAX;
+
+	/* Exact timer */
+	random_delays();
+	if(sim_run(start) || check_times())
+		return 1;
+	TEST_ASSERT(replay.late == 0 && replay.underruns == 0);
+
+	/* Interrupt latency */
+	sim.irq_lat = 3;
+	if(sim_run(start) || check_times())
+		return 1;
+	TEST_ASSERT(replay.late == 0 && replay.max_late <= 3);
+
+	/* Latency longer than CAN_REPLAY_LATE_US, full TX mailboxes */
+	sim.irq_lat = 40;
+	sim.tx_fail = 8;
+	if(sim_run(start) || check_times())
+		return 1;
+	TEST_ASSERT(replay.late > 0 && replay.underruns == 0);
+	sim.irq_lat = 0;
+	sim.tx_fail = 0;
+
+	/*
+	 * Parser stalled: the schedule runs empty, the following frames are
+	 * delayed by the time spent waiting, not sent in a burst.
+	 */
+	for(i = 0; i < NB_FRAMES; i++)
+		delays[i] = 500 + test_rand() % 500;
+	sim.stall_at = start + 200000;
+	sim.stall_end = start + 600000;
+	if(sim_run(start))
+		return 1;
+	TEST_ASSERT(replay.underruns == 1 && replay.late == 0);
+	underruns = 0;
+	for(i = 1; i < NB_FRAMES; i++) {
+		if(sent_at[i] - sent_at[i - 1] > delays[i] + MARGIN_US) {
+			/* The frame following the stall, polled every 100us */
+			TEST_ASSERT(sent_at[i - 1] < sim.stall_end);
+			TEST_ASSERT(sent_at[i] >= sim.stall_end + delays[i]);
+			TEST_ASSERT(sent_at[i] <= sim.stall_end + delays[i] + 100);
+			underruns++;
+		} else {
+			TEST_ASSERT(sent_at[i] - sent_at[i - 1] + MARGIN_US >= delays[i]);
+		}
+	}
+	TEST_ASSERT(underruns == 1);
+	return 0;
+}
+
+static int test_can_replay_parse(void)
+{
+	can_replay_parser_t p;
+	can_replay_entry_t e;
+
+	can_replay_parser_init(&p, 100);
+	TEST_ASSERT(can_replay_parse_line(&p, "", &e) == 0);
+	TEST_ASSERT(can_replay_parse_line(&p, "  # comment", &e) == 0);
+
+	TEST_ASSERT(can_replay_parse_line(&p, "(1436509052.249713) can0 123#DEADBEEF", &e) == 1);
+	TEST_ASSERT(e.delay == 0 && e.id == 0x123 && e.flags == 0 && e.dlc == 4);
+	TEST_ASSERT(e.data[0] == 0xDE && e.data[3] == 0xEF);
+	TEST_ASSERT(can_replay_parse_line(&p, "(1436509052.250713) vcan1 12345678#R", &e) == 1);
+	TEST_ASSERT(e.delay == 1000 && e.id == 0x12345678 && e.dlc == 0);
+	TEST_ASSERT(e.flags == (CAN_REPLAY_FLAG_EXT | CAN_REPLAY_FLAG_RTR));
+	TEST_ASSERT(can_replay_parse_line(&p, "(1436509052.2508) can0 7FF#R8", &e) == 1);
+	TEST_ASSERT(e.delay == 87 && e.id == 0x7FF && e.dlc == 8);
+	TEST_ASSERT(e.flags == CAN_REPLAY_FLAG_RTR);
+	/* Digits after the microseconds are ignored, dots between the bytes */
+	TEST_ASSERT(can_replay_parse_line(&p, "\t(1436509052.250900999)\tcan0\t000#11.22.33 ", &e) == 1);
+	TEST_ASSERT(e.delay == 100 && e.dlc == 3 && e.data[2] == 0x33);
+	TEST_ASSERT(can_replay_parse_line(&p, "(1436509052.251) can0 123#", &e) == 1);
+	TEST_ASSERT(e.delay == 100 && e.dlc == 0);
+
+	/* Out of order timestamp sent right away, the next one keeps its time */
+	TEST_ASSERT(can_replay_parse_line(&p, "(1436509052.000000) can0 123#", &e) == 1);
+	TEST_ASSERT(e.delay == 0);
+	TEST_ASSERT(can_replay_parse_line(&p, "(1436509052.252000) can0 123#", &e) == 1);
+	TEST_ASSERT(e.delay == 1000);
+
+	/* Longest delay */
+	TEST_ASSERT(can_replay_parse_line(&p, "(1436519052.252000) can0 123#", &e) == 1);
+	TEST_ASSERT(e.delay == UINT32_MAX);
+
+	/* Rewind: the first frame follows the last one */
+	can_replay_parser_rewind(&p);
+	TEST_ASSERT(can_replay_parse_line(&p, "(1436509052.249713) can0 123#", &e) == 1);
+	TEST_ASSERT(e.delay == 0);
+
+	/* Rate, without accumulating the rounding errors */
+	can_replay_parser_init(&p, 300);
+	TEST_ASSERT(can_replay_parse_line(&p, "(10.000000) can0 123#", &e) == 1);
+	TEST_ASSERT(can_replay_parse_line(&p, "(10.000001) can0 123#", &e) == 1);
+	TEST_ASSERT(e.delay == 0);
+	TEST_ASSERT(can_replay_parse_line(&p, "(10.000002) can0 123#", &e) == 1);
+	TEST_ASSERT(e.delay == 0);
+	TEST_ASSERT(can_replay_parse_line(&p, "(10.000003) can0 123#", &e) == 1);
+	TEST_ASSERT(e.delay == 1);
+	can_replay_parser_init(&p, 50);
+	TEST_ASSERT(can_replay_parse_line(&p, "(10) can0 123#", &e) == 1);
+	TEST_ASSERT(can_replay_parse_line(&p, "(11) can0 123#", &e) == 1);
+	TEST_ASSERT(e.delay == 2000000);
+
+	/* Errors */
+	TEST_ASSERT(can_replay_parse_line(&p, "1436509052.249713 can0 123#", &e) == -1);
+	TEST_ASSERT(can_replay_parse_line(&p, "(1436509052.249713 can0 123#", &e) == -1);
+	TEST_ASSERT(can_replay_parse_line(&p, "(1436509052.249713)", &e) == -1);
+	TEST_ASSERT(can_replay_parse_line(&p, "(1436509052.249713) can0", &e) == -1);
+	TEST_ASSERT(can_replay_parse_line(&p, "(1) can0 123#1", &e) == -1);
+	TEST_ASSERT(can_replay_parse_line(&p, "(1) can0 1234#00", &e) == -1);
+	TEST_ASSERT(can_replay_parse_line(&p, "(1) can0 800#00", &e) == -1);
+	TEST_ASSERT(can_replay_parse_line(&p, "(1) can0 20000000#00", &e) == -1);
+	TEST_ASSERT(can_replay_parse_line(&p, "(1) can0 123#001122334455667788", &e) == -1);
+	TEST_ASSERT(can_replay_parse_line(&p, "(1) can0 123##0112233", &e) == -1);
+	TEST_ASSERT(can_replay_parse_line(&p, "(1) can0 123#00 x", &e) == -1);
+	return 0;
+}
+
+int test_can_replay(void)
+{
+	test_srand(24);
+
+	if(test_can_replay_parse())
+		return 1;
+	if(test_can_replay_sched())
+		return 1;
+	return 0;
+}
@@ -0,0 +1,252 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * CAN frames ring and encoders (hydrabus_can_ring.c): bursts of frames
+ * from the RX interrupts against a slower reader, dropped frames and bit
+ * counts, SLCAN lines against snprintf(), SocketCAN frames and the SLCAN
+ * millisecond clock across the cycle counter wrap.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test.h"
+#include "hydrabus_can_ring.h"
+
+#define RING_SIZE	(64)
+
+static can_ring_frame_t frames[RING_SIZE];
+static can_ring_t ring;
+
+static void random_frame(can_ring_frame_t *f, uint32_t seq)
+{
+	uint32_t i;
+
+	memset(f, 0, sizeof(*f));
+	f->flags = test_rand() & (CAN_RING_FLAG_EXT | CAN_RING_FLAG_RTR);
+	f->id = test_rand() & ((f->flags & CAN_RING_FLAG_EXT) ? 0x1fffffff : 0x7ff);
+	f->dlc = test_rand() % 9;
+	f->timestamp = seq;
+	for(i = 0; i < f->dlc; i++)
+		f->data[i] = test_rand();
+}
+
+/* SLCAN line built with snprintf() */
+static uint32_t ref_slcan(char *buf, const can_ring_frame_t *f,
+			  int timestamp, uint16_t ms)
+{
+	char *p = buf;
+	uint32_t i;
+	char c = (f->flags & CAN_RING_FLAG_RTR) ? 'r' : 't';
+
+	if(f->flags & CAN_RING_FLAG_EXT)
+		p += sprintf(p, "%c%08X%u", c - 32, (unsigned)f->id, f->dlc);
+	else
+		p += sprintf(p, "%c%03X%u", c, (unsigned)f->id, f->dlc);
+	if(!(f->flags & CAN_RING_FLAG_RTR)) {
+		for(i = 0; i < f->dlc; i++)
+			p += sprintf(p, "%02X", f->data[i]);
+	}
+	if(timestamp)
+		p += sprintf(p, "%04X", ms);
+	*p++ = '\r';
+	return p - buf;
+}
+
+static int test_can_ring_burst(void)
+{
+	can_ring_frame_t f;
+	const can_ring_frame_t *g;
+	uint32_t k, i, nb, seq = 0, next = 0, dropped = 0, bits = 0;
+	uint32_t max_fill = 0;
+
+	can_ring_init(&ring, frames, RING_SIZE);
+	for(k = 0; k < 20000; k++) {
+		/* Interrupts: a burst, sometimes longer than the free room */
+		nb = test_rand() % (RING_SIZE / 2);
+		if((test_rand() % 64) == 0)
+			nb += RING_SIZE;
+		for(i = 0; i < nb; i++) {
+			random_frame(&f, seq);
+			bits += can_frame_bits(f.flags, f.dlc);
+			if(ring.wr - ring.rd >= RING_SIZE) {
+				TEST_ASSERT(!can_ring_put(&ring, &f));
+				dropped++;
+			} else {
+				TEST_ASSERT(can_ring_put(&ring, &f));
+				if(ring.wr - ring.rd > max_fill)
+					max_fill = ring.wr - ring.rd;
+				seq++;
+			}
+		}
+		/* Reader: the frames in order, none dropped while queued */
+		nb = test_rand() % (RING_SIZE / 2 + 4);
+		while(nb-- && (g = can_ring_get(&ring)) != NULL) {
+			TEST_ASSERT(g->timestamp == next);
+			can_ring_consume(&ring);
+			next++;
+		}
+	}
+	while((g = can_ring_get(&ring)) != NULL) {
+		TEST_ASSERT(g->timestamp == next);
+		can_ring_consume(&ring);
+		next++;
+	}
+	TEST_ASSERT(next == seq);
+	TEST_ASSERT(dropped > 0 && ring.dropped == dropped);
+	TEST_ASSERT(ring.received == seq + dropped);
+	TEST_ASSERT(ring.max_fill == max_fill && max_fill == RING_SIZE);
+	TEST_ASSERT(can_ring_bits(&ring) == bits);
+	return 0;
+}
+
+static int test_can_ring_bits(void)
+{
+	uint64_t total = 0;
+	uint32_t k;
+
+	/* Free running bit counter wrapping, read often enough */
+	can_ring_init(&ring, frames, RING_SIZE);
+	ring.bits = 0xfffff000;
+	ring.bits_rd = 0xfffff000;
+	for(k = 0; k < 1000; k++) {
+		ring.bits += 67 + 64;
+		total += 67 + 64;
+		if((k % 7) == 0)
+			TEST_ASSERT(can_ring_bits(&ring) == total);
+	}
+	TEST_ASSERT(can_ring_bits(&ring) == total);
+
+	/* Standard, extended, remote frame without data */
+	TEST_ASSERT(can_frame_bits(0, 0) == 47);
+	TEST_ASSERT(can_frame_bits(0, 8) == 47 + 64);
+	TEST_ASSERT(can_frame_bits(CAN_RING_FLAG_EXT, 8) == 67 + 64);
+	TEST_ASSERT(can_frame_bits(CAN_RING_FLAG_RTR, 8) == 47);
+	return 0;
+}
+
+static int test_can_ring_format(void)
+{
+	can_ring_frame_t f;
+	char line[CAN_SLCAN_MAX_LEN + 8], ref[64];
+	uint8_t sc[CAN_SOCKETCAN_LEN];
+	uint32_t k, i, len, id, ms;
+	int ts;
+
+	for(k = 0; k < 20000; k++) {
+		random_frame(&f, 0);
+		ts = test_rand() & 1;
+		ms = test_rand() % 60000;
+		memset(line, 0x55, sizeof(line));
+		len = can_slcan_format(line, &f, ts, ms);
+		TEST_ASSERT(len <= CAN_SLCAN_MAX_LEN);
+		TEST_ASSERT(line[len] == 0x55);
+		TEST_ASSERT(len == ref_slcan(ref, &f, ts, ms));
+		TEST_ASSERT(memcmp(line, ref, len) == 0);
+
+		TEST_ASSERT(can_socketcan_format(sc, &f) == CAN_SOCKETCAN_LEN);
+		id = ((uint32_t)sc[0] << 24) | (sc[1] << 16) | (sc[2] << 8) | sc[3];
+		TEST_ASSERT((id & 0x1fffffff) == f.id);
+		TEST_ASSERT(!(id & CAN_SOCKETCAN_EFF) == !(f.flags & CAN_RING_FLAG_EXT));
+		TEST_ASSERT(!(id & CAN_SOCKETCAN_RTR) == !(f.flags & CAN_RING_FLAG_RTR));
+		TEST_ASSERT(sc[4] == f.dlc && !sc[5] && !sc[6] && !sc[7]);
+		for(i = 0; i < 8; i++) {
+			if(i < f.dlc && !(f.flags & CAN_RING_FLAG_RTR))
+				TEST_ASSERT(sc[8 + i] == f.data[i]);
+			else
+				TEST_ASSERT(sc[8 + i] == 0);
+		}
+	}
+
+	/* Longest line */
+	memset(&f, 0xff, sizeof(f));
+	f.flags = CAN_RING_FLAG_EXT;
+	f.id = 0x1fffffff;
+	f.dlc = 8;
+	TEST_ASSERT(can_slcan_format(line, &f, true, 59999) == CAN_SLCAN_MAX_LEN);
+	return 0;
+}
+
+static int test_can_ring_clock(void)
+{
+	can_slcan_clock_t c;
+	uint64_t now, start;
+	uint32_t k, per_ms = 168000, ms;
+
+	/* Starts just before the 32 bits cycle counter wrap */
+	start = 0xffff0000;
+	now = start;
+	can_slcan_clock_init(&c, per_ms, (uint32_t)now);
+	TEST_ASSERT(can_slcan_clock(&c, (uint32_t)now) == 0);
+	for(k = 0; k < 200000; k++) {
+		/* Up to 10s between the updates */
+		if((test_rand() % 16) == 0)
+			now += (uint64_t)(test_rand() % 10000) * per_ms + test_rand() % per_ms;
+		else
+			now += test_rand() % (4 * per_ms);
+		ms = can_slcan_clock(&c, (uint32_t)now);
+		TEST_ASSERT(ms == ((now - start) / per_ms) % 60000);
+
+		/* A frame received before this update keeps the current time */
+		TEST_ASSERT(can_slcan_clock(&c, (uint32_t)now - test_rand() % per_ms) == ms);
+	}
+	TEST_ASSERT(now - start > ((uint64_t)1 << 33));
+	return 0;
+}
+
+int test_can_ring(void)
+{
+	test_srand(21);
+
+	if(test_can_ring_burst())
+		return 1;
+	if(test_can_ring_bits())
+		return 1;
+	if(test_can_ring_format())
+		return 1;
+	if(test_can_ring_clock())
+		return 1;
+	return 0;
+}
+
+int bench_can_ring(void)
+{
+	can_ring_frame_t f[64];
+	char line[CAN_SLCAN_MAX_LEN];
+	uint64_t t0, t1;
+	uint32_t i, k, len = 0;
+
+	test_srand(21);
+	for(i = 0; i < 64; i++)
+		random_frame(&f[i], i);
+
+	can_ring_init(&ring, frames, RING_SIZE);
+	t0 = test_time_ns();
+	for(k = 0; k < 100000; k++) {
+		for(i = 0; i < 64; i++) {
+			can_ring_put(&ring, &f[i]);
+			len += can_slcan_format(line, can_ring_get(&ring), true, k);
+			can_ring_consume(&ring);
+		}
+	}
+	t1 = test_time_ns();
+	bench_report("can_ring put/slcan/consume", t1 - t0, 100000 * 64, "frame");
+	return len == 0;
+}
@@ -0,0 +1,210 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Console output buffer, hexdump formatter and log ring (console_out.c),
+ * the console channel is a simulated channel.
+ */
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test.h"
+#include "sim_chn.h"
+#include "console_out.h"
+
+/* Previous print_hex(): one vsnprintf() and one write per element */
+static void ref_printf(sim_chn_t *chn, const char *fmt, ...)
+{
+	va_list va_args;
+	char buf[512];
+	int len;
+
+	va_start(va_args, fmt);
+	len = vsnprintf(buf, sizeof(buf) - 1, fmt, va_args);
+	va_end(va_args);
+	sim_chn_write(chn, buf, len, TIME_INFINITE);
+}
+
+static void ref_print_hex(sim_chn_t *chn, uint8_t *data, uint8_t size)
+{
+	uint8_t ascii[17];
+	uint8_t i, j;
+	ascii[16] = '\0';
+	for (i = 0; i < size; ++i) {
+		ref_printf(chn, "%02X ", data[i]);
+		if (data[i] >= 0x20 && data[i] <= 0x7f) {
+			ascii[i % 16] = data[i];
+		} else {
+			ascii[i % 16] = '.';
+		}
+		if ((i+1) % 8 == 0 || i+1 == size) {
+			ref_printf(chn, " ");
+			if ((i+1) % 16 == 0) {
+				ref_printf(chn, "|  %s \r\n", ascii);
+			} else if (i+1 == size) {
+				ascii[(i+1) % 16] = '\0';
+				if ((i+1) % 16 <= 8) {
+					ref_printf(chn, " ");
+				}
+				for (j = (i+1) % 16; j < 16; ++j) {
+					ref_printf(chn, "   ");
+				}
+				ref_printf(chn, "|  %s \r\n", ascii);
+			}
+		}
+	}
+}
+
+static void out_write_chn(void *ctx, const uint8_t *data, uint32_t size)
+{
+	sim_chn_write(ctx, data, size, TIME_INFINITE);
+}
+
+/* print_hex() of common.c on a buffered console */
+static void out_print_hex(console_out_t *out, uint8_t *data, uint8_t size)
+{
+	char line[HEX_LINE_SIZE];
+	uint32_t i, nb;
+
+	for (i = 0; i < size; i += nb) {
+		nb = size - i < 16 ? size - i : 16;
+		console_out_write(out, (uint8_t *)line, hex_format_line(line, data + i, nb));
+	}
+}
+
+/* Accepts up to test_nb_max bytes per call, like a full USB queue */
+static uint32_t test_nb_max;
+
+static uint32_t out_write_chn_nb(void *ctx, const uint8_t *data, uint32_t size)
+{
+	if (size > test_nb_max)
+		size = test_nb_max;
+	return sim_chn_write(ctx, data, size, TIME_IMMEDIATE);
+}
+
+#define TEST_OUT_SIZE (256)
+#define TEST_LOG_SIZE (1024)
+
+int test_console_out(void)
+{
+	static uint8_t ref[8192], res[8192], data[4096], stream[65536];
+	uint8_t buf[TEST_OUT_SIZE], log_buf[TEST_LOG_SIZE];
+	const uint8_t *peek;
+	console_out_t out;
+	console_log_t log;
+	sim_chn_t ref_chn, chn;
+	uint32_t i, len, n, pos, written, read;
+
+	/* Hexdump identical to the previous print_hex() */
+	for (len = 0; len < 256; len++) {
+		for (i = 0; i < len; i++)
+			data[i] = test_rand();
+		sim_chn_init(&ref_chn, NULL, 0, ref, sizeof(ref));
+		ref_print_hex(&ref_chn, data, len);
+		sim_chn_init(&chn, NULL, 0, res, sizeof(res));
+		console_out_init(&out, buf, sizeof(buf), out_write_chn, &chn);
+		out_print_hex(&out, data, len);
+		console_out_flush(&out);
+		TEST_ASSERT(chn.out_len == ref_chn.out_len);
+		TEST_ASSERT(!memcmp(res, ref, ref_chn.out_len));
+		/* Full buffers only, then the flush */
+		TEST_ASSERT(chn.nb_write == (ref_chn.out_len + sizeof(buf) - 1) / sizeof(buf));
+	}
+
+	/* Writes of any size, flushes without waiting */
+	for (i = 0; i < sizeof(stream); i++)
+		stream[i] = test_rand();
+	sim_chn_init(&chn, NULL, 0, res, sizeof(res));
+	console_out_init(&out, buf, sizeof(buf), out_write_chn, &chn);
+	for (pos = 0; pos < sizeof(res); pos += len) {
+		len = test_rand() % (2 * TEST_OUT_SIZE);
+		if (len > sizeof(res) - pos)
+			len = sizeof(res) - pos;
+		console_out_write(&out, stream + pos, len);
+		test_nb_max = test_rand() % 64;
+		console_out_flush_nb(&out, out_write_chn_nb);
+		TEST_ASSERT(out.len < sizeof(buf));
+		TEST_ASSERT(chn.out_len + out.len == pos + len);
+	}
+	console_out_flush(&out);
+	TEST_ASSERT(chn.out_len == sizeof(res));
+	TEST_ASSERT(!memcmp(res, stream, sizeof(res)));
+
+	/* Log ring: the data read is the data written, in order */
+	console_log_init(&log, log_buf, sizeof(log_buf));
+	written = 0;
+	read = 0;
+	while (read < sizeof(stream)) {
+		len = test_rand() % 700;
+		if (len > sizeof(stream) - written)
+			len = sizeof(stream) - written;
+		n = console_log_write(&log, stream + written, len);
+		TEST_ASSERT(n == len || console_log_len(&log) == sizeof(log_buf));
+		written += n;
+		if (test_rand() % 2) {
+			len = console_log_peek(&log, &peek);
+			TEST_ASSERT(len <= console_log_len(&log));
+			TEST_ASSERT(len > 0 || console_log_len(&log) == 0);
+			TEST_ASSERT(!memcmp(peek, stream + read, len));
+			len = test_rand() % (len + 1);
+			console_log_consume(&log, len);
+			read += len;
+		}
+	}
+	TEST_ASSERT(written == sizeof(stream) && console_log_len(&log) == 0);
+	return 0;
+}
+
+/*
+ * Hexdumps of 255 bytes (the maximum of print_hex()) on the simulated
+ * console: one vsnprintf() and one channel write per element before,
+ * one formatted line per 16 bytes and one write per 256 bytes now.
+ */
+int bench_console_out(void)
+{
+	uint8_t data[255], buf[TEST_OUT_SIZE];
+	console_out_t out;
+	sim_chn_t chn;
+	uint32_t i, nb = 20000;
+	uint64_t t;
+
+	for (i = 0; i < sizeof(data); i++)
+		data[i] = test_rand();
+
+	sim_chn_init(&chn, NULL, 0, NULL, 0);
+	t = test_time_ns();
+	for (i = 0; i < nb; i++)
+		ref_print_hex(&chn, data, sizeof(data));
+	t = test_time_ns() - t;
+	bench_report("print_hex vsnprintf", t, (uint64_t)nb * sizeof(data), "B");
+	printf("  %-32s %10.2f writes/dump\n", "", (double)chn.nb_write / nb);
+
+	sim_chn_init(&chn, NULL, 0, NULL, 0);
+	console_out_init(&out, buf, sizeof(buf), out_write_chn, &chn);
+	t = test_time_ns();
+	for (i = 0; i < nb; i++) {
+		out_print_hex(&out, data, sizeof(data));
+		console_out_flush(&out);
+	}
+	t = test_time_ns() - t;
+	bench_report("print_hex buffered", t, (uint64_t)nb * sizeof(data), "B");
+	printf("  %-32s %10.2f writes/dump\n", "", (double)chn.nb_write / nb);
+	return 0;
+}
@@ -0,0 +1,116 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Detection of the binary modes in the console input (hydrabus_detect.c) */
+
+#include "test.h"
+#include "hydrabus_detect.h"
+
+typedef struct {
+	const char *name;
+	const uint8_t *in;
+	uint32_t len;
+	detect_result_t mode;	/* Detected mode, DETECT_NONE for none */
+	uint32_t pos;		/* Position of the byte entering the mode */
+	uint32_t nb_input;	/* Bytes for tokenline before pos */
+} detect_vector_t;
+
+static const uint8_t bbio_in[] = {
+	'i', 0x0D,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	/* BBIO_RESET commands for the mode */
+	0, 0, 0,
+};
+static const uint8_t sump_in[] = { 0, 0, 0, 0, 0, 0x02, 0x01, 0x00 };
+static const uint8_t sump_bad_in[] = { 0, 0, 0, 0, 0x02, 0, 0, 0, 0, 0, 0, 0x02 };
+static const uint8_t serprog_in[] = { 0, 0, 0, 0, 0, 0, 0, 0, 0x10, 0x00, 0x01 };
+static const uint8_t text_in[] = { 'a', 0, 0, 0, 0, 'b', 0, 0, 0, 0, 0, 0, 0x10, 0x02 };
+static const uint8_t reset_in[] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 'x',
+	0, 0, 0, 0, 0, 0x02,
+};
+
+static const detect_vector_t detect_vectors[] = {
+	{ "bbio", bbio_in, sizeof(bbio_in), DETECT_BBIO, 21, 2 },
+	{ "sump", sump_in, sizeof(sump_in), DETECT_SUMP, 5, 0 },
+	/* 4 and 6 zeros before 0x02 are not SUMP */
+	{ "sump count", sump_bad_in, sizeof(sump_bad_in), DETECT_NONE, 0, 0 },
+	{ "serprog", serprog_in, sizeof(serprog_in), DETECT_SERPROG, 8, 0 },
+	{ "text", text_in, sizeof(text_in), DETECT_NONE, 0, 2 },
+	/* A text byte resets the count of zeros */
+	{ "reset", reset_in, sizeof(reset_in), DETECT_SUMP, 25, 1 },
+};
+
+/* Feed a vector, returns the detected mode and its position */
+static detect_result_t detect_run(const detect_vector_t *v, uint32_t *pos,
+				  uint32_t *nb_input)
+{
+	detect_t detect;
+	detect_result_t res;
+	uint32_t i;
+
+	detect_init(&detect);
+	*nb_input = 0;
+	for(i = 0; i < v->len; i++) {
+		res = detect_push(&detect, v->in[i]);
+		if(res == DETECT_INPUT) {
+			(*nb_input)++;
+		} else if(res != DETECT_NONE) {
+			*pos = i;
+			return res;
+		}
+	}
+	return DETECT_NONE;
+}
+
+int test_detect(void)
+{
+	const detect_vector_t *v;
+	detect_t detect;
+	uint32_t i, j, pos, nb_input;
+
+	for(i = 0; i < sizeof(detect_vectors) / sizeof(detect_vectors[0]); i++) {
+		v = &detect_vectors[i];
+		pos = 0;
+		if(detect_run(v, &pos, &nb_input) != v->mode ||
+		   pos != v->pos || nb_input != v->nb_input) {
+			printf("  %s\n", v->name);
+			TEST_ASSERT(0);
+		}
+	}
+
+	/* The count restarts after a detection */
+	detect_init(&detect);
+	for(i = 0; i < 2; i++) {
+		for(j = 0; j < DETECT_SERPROG_NB_ZERO; j++)
+			TEST_ASSERT(detect_push(&detect, 0) == DETECT_NONE);
+		TEST_ASSERT(detect_push(&detect, DETECT_SERPROG_ID) == DETECT_SERPROG);
+	}
+	TEST_ASSERT(detect_push(&detect, DETECT_SERPROG_ID) == DETECT_NONE);
+	for(j = 1; j < 2 * DETECT_BBIO_NB_ZERO; j++)
+		TEST_ASSERT(detect_push(&detect, 0) ==
+			    (j % DETECT_BBIO_NB_ZERO ? DETECT_NONE : DETECT_BBIO));
+
+	/* Any other byte goes to tokenline */
+	for(j = 1; j < 256; j++) {
+		if(j == DETECT_SUMP_ID || j == DETECT_SERPROG_ID)
+			continue;
+		TEST_ASSERT(detect_push(&detect, j) == DETECT_INPUT);
+	}
+	return 0;
+}
@@ -0,0 +1,338 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * I2C sniffer decoder (hydrabus_i2c_sniff.c): SCL/SDA samples of bus
+ * transactions at 2 to 4 samples per half clock (1MHz Fm+ at 8MHz) are
+ * decoded to their events and timestamps through the DMA sample ring,
+ * with aborted bytes, overruns and a full output ring; random samples
+ * are decoded the same in random chunks as in one pass.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "test.h"
+#include "hydrabus_i2c_sniff.h"
+
+#define SNIFF_SCL	(1 << 6)
+#define SNIFF_SDA	(1 << 7)
+#define SNIFF_RING	(1024)
+#define SNIFF_OUT	(4096)
+#define SNIFF_PERIOD	(21) /* 8MHz sampling */
+#define SNIFF_T0	(0xFFFF0000) /* Cycle counter wrap in the capture */
+#define SNIFF_SAMPLES	(0x40000)
+#define SNIFF_EVENTS	(0x8000)
+
+typedef struct {
+	uint8_t type;
+	uint8_t data;
+	uint32_t timestamp;
+} sniff_ev_t;
+
+typedef struct {
+	uint16_t *smp;
+	uint32_t nb;
+	uint32_t half; /* Samples per half clock */
+	sniff_ev_t *ev; /* Expected events */
+	uint32_t nb_ev;
+} sniff_bus_t;
+
+static uint16_t ring[SNIFF_RING];
+static uint8_t out[SNIFF_OUT];
+static uint32_t ring_wr;
+static i2c_sniff_t s;
+
+/* Samples with noise on the other pins of the port */
+static void bus_put(sniff_bus_t *b, uint32_t scl, uint32_t sda, uint32_t nb)
+{
+	while(nb-- && b->nb < SNIFF_SAMPLES) {
+		b->smp[b->nb++] = (test_rand() & ~(SNIFF_SCL | SNIFF_SDA)) |
+				  (scl ? SNIFF_SCL : 0) | (sda ? SNIFF_SDA : 0);
+	}
+}
+
+/* Expected event at the next sample */
+static void bus_ev(sniff_bus_t *b, uint8_t type, uint8_t data)
+{
+	if(b->nb_ev < SNIFF_EVENTS) {
+		b->ev[b->nb_ev].type = type;
+		b->ev[b->nb_ev].data = data;
+		b->ev[b->nb_ev].timestamp = SNIFF_T0 + b->nb * SNIFF_PERIOD;
+	}
+	b->nb_ev++;
+}
+
+/* (Repeated) START from SCL low or from the idle bus */
+static void bus_start(sniff_bus_t *b, uint8_t flags)
+{
+	bus_put(b, 0, 1, b->half);
+	bus_put(b, 1, 1, b->half);
+	bus_ev(b, I2C_SNIFF_START | flags, 0);
+	bus_put(b, 1, 0, b->half);
+	bus_put(b, 0, 0, b->half);
+}
+
+static void bus_stop(sniff_bus_t *b, uint8_t flags)
+{
+	bus_put(b, 0, 0, b->half);
+	bus_put(b, 1, 0, b->half);
+	bus_ev(b, I2C_SNIFF_STOP | flags, 0);
+	bus_put(b, 1, 1, 2 * b->half);
+}
+
+/* Bits MSB first, the event at the SCL rising edge of the ACK */
+static void bus_bits(sniff_bus_t *b, uint32_t value, uint32_t nb)
+{
+	uint32_t i, bit;
+
+	for(i = 0; i < nb; i++) {
+		bit = (value >> (nb - 1 - i)) & 1;
+		bus_put(b, 0, bit, b->half);
+		if(nb == 9 && i == 8)
+			bus_ev(b, I2C_SNIFF_BYTE | (bit ? I2C_SNIFF_FLAG_NACK : 0),
+			       value >> 1);
+		bus_put(b, 1, bit, b->half);
+	}
+	bus_put(b, 0, value & 1, 1);
+}
+
+/* Write then read transactions, with repeated STARTs and aborted bytes */
+static void bus_traffic(sniff_bus_t *b, uint32_t nb_xfers)
+{
+	uint32_t n, i, len, flags = 0;
+	bool open = false;
+
+	bus_put(b, 1, 1, 8);
+	for(n = 0; n < nb_xfers; n++) {
+		b->half = 2 + test_rand() % 3;
+		bus_start(b, flags);
+		flags = 0;
+		len = test_rand() % 20;
+		for(i = 0; i <= len; i++)
+			bus_bits(b, ((test_rand() & 0xFF) << 1) | (i == len), 9);
+		open = false;
+		switch(test_rand() % 4) {
+		case 0:
+			/* Repeated START */
+			open = true;
+			break;
+		case 1:
+			/* Byte aborted by a START */
+			bus_bits(b, test_rand(), 2 + test_rand() % 6);
+			flags = I2C_SNIFF_FLAG_ABORT;
+			open = true;
+			break;
+		case 2:
+			/* Byte aborted by a STOP */
+			bus_bits(b, test_rand(), 2 + test_rand() % 6);
+			bus_stop(b, I2C_SNIFF_FLAG_ABORT);
+			bus_put(b, 1, 1, test_rand() % 50);
+			break;
+		default:
+			bus_stop(b, 0);
+			bus_put(b, 1, 1, test_rand() % 50);
+			break;
+		}
+	}
+	if(open)
+		bus_stop(b, flags);
+}
+
+static void sniff_init(void)
+{
+	i2c_sniff_init(&s, ring, SNIFF_RING, SNIFF_SCL, SNIFF_SDA, SNIFF_PERIOD,
+		       SNIFF_T0, out, SNIFF_OUT);
+	ring_wr = 0;
+}
+
+/* DMA writes */
+static void sniff_feed(const uint16_t *smp, uint32_t nb)
+{
+	while(nb--) {
+		ring[ring_wr] = *smp++;
+		ring_wr = (ring_wr + 1) & (SNIFF_RING - 1);
+	}
+}
+
+static uint32_t sniff_pop(sniff_ev_t *ev, uint32_t n)
+{
+	i2c_sniff_event_t e;
+
+	while(i2c_sniff_pop(&s, &e)) {
+		if(n < SNIFF_EVENTS) {
+			ev[n].type = e.type;
+			ev[n].data = e.data;
+			ev[n].timestamp = e.timestamp;
+		}
+		n++;
+	}
+	return n;
+}
+
+/*
+ * Feeds the samples through the ring in random chunks (up to max), pops
+ * the events, returns the number of events.
+ */
+static uint32_t sniff_run(const uint16_t *smp, uint32_t nb, uint32_t max,
+			  sniff_ev_t *ev)
+{
+	uint32_t i, chunk, n = 0;
+
+	for(i = 0; i < nb; i += chunk) {
+		chunk = 1 + test_rand() % max;
+		if(chunk > nb - i)
+			chunk = nb - i;
+		sniff_feed(smp + i, chunk);
+		i2c_sniff_process(&s, ring_wr);
+		n = sniff_pop(ev, n);
+	}
+	return n;
+}
+
+static int check_events(const sniff_ev_t *ev, const sniff_ev_t *ref, uint32_t nb)
+{
+	uint32_t i;
+
+	for(i = 0; i < nb; i++) {
+		TEST_ASSERT(ev[i].type == ref[i].type);
+		TEST_ASSERT(ev[i].data == ref[i].data);
+		TEST_ASSERT(ev[i].timestamp == ref[i].timestamp);
+	}
+	return 0;
+}
+
+int test_i2c_sniff(void)
+{
+	sniff_bus_t b;
+	sniff_ev_t *ev, *ref;
+	uint32_t k, i, nb, bit;
+
+	b.smp = malloc(SNIFF_SAMPLES * sizeof(uint16_t));
+	b.ev = malloc(SNIFF_EVENTS * sizeof(sniff_ev_t));
+	ev = malloc(SNIFF_EVENTS * sizeof(sniff_ev_t));
+	ref = malloc(SNIFF_EVENTS * sizeof(sniff_ev_t));
+	TEST_ASSERT(b.smp != NULL && b.ev != NULL && ev != NULL && ref != NULL);
+	test_srand(4);
+
+	/* Bus traffic, the processing keeps up with the DMA */
+	for(k = 0; k < 20; k++) {
+		b.nb = 0;
+		b.nb_ev = 0;
+		bus_traffic(&b, 100);
+		TEST_ASSERT(b.nb < SNIFF_SAMPLES && b.nb_ev < SNIFF_EVENTS);
+		sniff_init();
+		nb = sniff_run(b.smp, b.nb, SNIFF_RING - SNIFF_RING / 8, ev);
+		TEST_ASSERT(nb == b.nb_ev);
+		if(check_events(ev, b.ev, nb))
+			return 1;
+		TEST_ASSERT(s.events == nb && s.events_lost == 0 && s.overruns == 0);
+	}
+
+	/* Overrun in a transaction: the decoder restarts, resyncs at the next START */
+	b.nb = 0;
+	b.nb_ev = 0;
+	b.half = 3;
+	bus_put(&b, 1, 1, 8);
+	bus_start(&b, 0);
+	bus_bits(&b, 0x1A5, 9);
+	bus_bits(&b, 0x5, 3);
+	bus_put(&b, 0, 0, 1000 - b.nb);
+	sniff_init();
+	sniff_feed(b.smp, b.nb);
+	i2c_sniff_process(&s, ring_wr);
+	TEST_ASSERT(s.overruns == 1 && s.events == 0);
+	i = b.nb;
+	k = b.nb_ev;
+	bus_traffic(&b, 10);
+	b.ev[k].type |= I2C_SNIFF_FLAG_LOST;
+	nb = sniff_run(b.smp + i, b.nb - i, 100, ev);
+	TEST_ASSERT(nb == b.nb_ev - k);
+	if(check_events(ev, b.ev + k, nb))
+		return 1;
+
+	/* Output ring full: events dropped, the next one has I2C_SNIFF_FLAG_LOST */
+	b.nb = 0;
+	b.nb_ev = 0;
+	b.half = 2;
+	bus_put(&b, 1, 1, 8);
+	bus_start(&b, 0);
+	for(i = 0; i < SNIFF_OUT / sizeof(i2c_sniff_event_t) + 10; i++)
+		bus_bits(&b, (i & 0xFF) << 1, 9);
+	bus_stop(&b, 0);
+	sniff_init();
+	for(i = 0; i < b.nb; i += 64) {
+		sniff_feed(b.smp + i, (b.nb - i < 64) ? b.nb - i : 64);
+		i2c_sniff_process(&s, ring_wr);
+	}
+	nb = SNIFF_OUT / sizeof(i2c_sniff_event_t);
+	TEST_ASSERT(s.events == nb && s.events_lost == b.nb_ev - nb);
+	TEST_ASSERT(sniff_pop(ev, 0) == nb);
+	if(check_events(ev, b.ev, nb))
+		return 1;
+	i = b.nb;
+	k = b.nb_ev;
+	bus_start(&b, 0);
+	bus_stop(&b, 0);
+	b.ev[k].type |= I2C_SNIFF_FLAG_LOST;
+	TEST_ASSERT(sniff_run(b.smp + i, b.nb - i, 64, ev) == 2);
+	if(check_events(ev, b.ev + k, 2))
+		return 1;
+
+	/* Random lines: small chunks through the ring give the same events */
+	for(k = 0; k < 50; k++) {
+		nb = 1000 + test_rand() % 50000;
+		bit = SNIFF_SCL | SNIFF_SDA;
+		for(i = 0; i < nb; i++) {
+			/* Toggles of one line or both, held a few samples */
+			if((test_rand() % 3) == 0)
+				bit ^= (test_rand() % 3 + 1) << 6;
+			b.smp[i] = (test_rand() & ~(SNIFF_SCL | SNIFF_SDA)) | bit;
+		}
+		sniff_init();
+		i = sniff_run(b.smp, nb, SNIFF_RING - SNIFF_RING / 8, ref);
+		TEST_ASSERT(i > 0 && i < SNIFF_EVENTS);
+		sniff_init();
+		nb = sniff_run(b.smp, nb, 1 + test_rand() % 300, ev);
+		TEST_ASSERT(nb == i);
+		if(check_events(ev, ref, nb))
+			return 1;
+		/* Events are well formed: no byte nor STOP out of a frame */
+		for(i = 0, bit = 0; i < nb; i++) {
+			TEST_ASSERT(!(ev[i].type & I2C_SNIFF_FLAG_LOST));
+			switch(ev[i].type & I2C_SNIFF_TYPE_MASK) {
+			case I2C_SNIFF_START:
+				bit = 1;
+				break;
+			case I2C_SNIFF_STOP:
+				TEST_ASSERT(bit);
+				bit = 0;
+				break;
+			default:
+				TEST_ASSERT(bit && (ev[i].type & I2C_SNIFF_TYPE_MASK) == I2C_SNIFF_BYTE);
+				break;
+			}
+		}
+	}
+
+	free(b.smp);
+	free(b.ev);
+	free(ev);
+	free(ref);
+	return 0;
+}
@@ -0,0 +1,328 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * ISO-TP state machine (hydrabus_isotp.c): a sender and a receiver link
+ * connected back to back. PDUs of 1 to 4095 bytes with random block
+ * sizes, STmin and padding are reassembled bit exact, the frames are
+ * checked against ISO 15765-2, then lost and reordered frames, WAIT and
+ * OVERFLOW flow controls and a first frame restarting a reception.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "test.h"
+#include "hydrabus_isotp.h"
+
+static isotp_config_t cfg_tx, cfg_rx;
+static isotp_t tx, rx;
+static uint8_t pdu[ISOTP_MAX_PDU];
+static uint8_t rx_buf[ISOTP_MAX_PDU];
+
+/* Frames seen on the bus during the last transfer */
+static struct {
+	uint32_t cf;
+	uint32_t fc;
+	uint32_t max_block; /* Consecutive frames between two flow controls */
+} bus;
+
+static void links_init(uint8_t flags, uint8_t block_size, uint8_t stmin,
+		       uint16_t rx_size)
+{
+	memset(&cfg_tx, 0, sizeof(cfg_tx));
+	cfg_tx.tx_id = 0x7E0;
+	cfg_tx.rx_id = 0x7E8;
+	cfg_tx.flags = flags;
+	cfg_rx = cfg_tx;
+	cfg_rx.tx_id = 0x7E8;
+	cfg_rx.rx_id = 0x7E0;
+	cfg_rx.block_size = block_size;
+	cfg_rx.stmin = stmin;
+	isotp_init(&tx, &cfg_tx, NULL, 0);
+	isotp_init(&rx, &cfg_rx, rx_buf, rx_size);
+	memset(&bus, 0, sizeof(bus));
+}
+
+/* ISO 15765-2 frame layout, and the padding */
+static int check_frame(const isotp_frame_t *f, uint8_t flags)
+{
+	uint32_t i, len;
+
+	TEST_ASSERT(f->dlc >= 1 && f->dlc <= 8);
+	if(flags & ISOTP_FLAG_PAD)
+		TEST_ASSERT(f->dlc == 8);
+	switch(f->data[0] >> 4) {
+	case 0:
+		len = f->data[0] & 0xf;
+		TEST_ASSERT(len >= 1 && len <= 7);
+		break;
+	case 1:
+		TEST_ASSERT(f->dlc == 8);
+		return 0;
+	case 2:
+		len = 7;
+		break;
+	case 3:
+		len = 2;
+		TEST_ASSERT((f->data[0] & 0xf) <= 2);
+		break;
+	default:
+		TEST_ASSERT(0);
+		return 1;
+	}
+	if(!(flags & ISOTP_FLAG_PAD)) {
+		TEST_ASSERT(f->dlc <= 1 + len);
+		return 0;
+	}
+	for(i = 1 + len; i < 8; i++)
+		TEST_ASSERT(f->data[i] == ISOTP_PAD_BYTE);
+	return 0;
+}
+
+/* Sends the frame to the receiver, its flow control back to the sender */
+static int to_rx(const isotp_frame_t *f)
+{
+	isotp_frame_t fc;
+
+	if(check_frame(f, cfg_tx.flags))
+		return 1;
+	if(isotp_receive(&rx, f->data, f->dlc, &fc)) {
+		if(check_frame(&fc, cfg_rx.flags))
+			return 1;
+		TEST_ASSERT((fc.data[0] & 0xf0) == 0x30);
+		bus.fc++;
+		isotp_receive(&tx, fc.data, fc.dlc, &fc);
+	}
+	return 0;
+}
+
+/* Sends a PDU, the receiver is restarted when start is set */
+static int transfer(uint16_t len, bool start)
+{
+	isotp_frame_t f;
+	uint32_t block = 0, fc = 0;
+
+	if(start)
+		isotp_recv_start(&rx);
+	TEST_ASSERT(isotp_send(&tx, pdu, len, &f));
+	if(to_rx(&f))
+		return 1;
+	while(tx.state == ISOTP_TX_CF) {
+		TEST_ASSERT(tx.tx_stmin == cfg_rx.stmin);
+		TEST_ASSERT(isotp_send_cf(&tx, &f));
+		bus.cf++;
+		block = (fc == bus.fc) ? block + 1 : 1;
+		fc = bus.fc;
+		if(block > bus.max_block)
+			bus.max_block = block;
+		if(to_rx(&f))
+			return 1;
+	}
+	/* Nothing more to send */
+	TEST_ASSERT(!isotp_send_cf(&tx, &f));
+	return 0;
+}
+
+static int test_isotp_loopback(void)
+{
+	uint32_t k, i, len, bs, cf;
+	uint8_t flags;
+
+	for(k = 0; k < 3000; k++) {
+		switch(k % 4) {
+		case 0:
+			len = 1 + test_rand() % 7;
+			break;
+		case 1:
+			len = 8 + test_rand() % 120;
+			break;
+		case 2:
+			len = 1 + test_rand() % ISOTP_MAX_PDU;
+			break;
+		default:
+			len = (test_rand() & 1) ? ISOTP_MAX_PDU : 8;
+			break;
+		}
+		for(i = 0; i < len; i++)
+			pdu[i] = test_rand();
+		flags = test_rand() & ISOTP_FLAG_PAD;
+		bs = (test_rand() & 1) ? 0 : 1 + test_rand() % 16;
+		links_init(flags, bs, test_rand(), ISOTP_MAX_PDU);
+
+		if(transfer(len, true))
+			return 1;
+		TEST_ASSERT(tx.state == ISOTP_DONE && rx.state == ISOTP_DONE);
+		TEST_ASSERT(rx.rx_len == len);
+		TEST_ASSERT(memcmp(rx_buf, pdu, len) == 0);
+
+		/* One first frame then 7 bytes per consecutive frame */
+		cf = (len <= 7) ? 0 : (len - 6 + 7 - 1) / 7;
+		TEST_ASSERT(bus.cf == cf);
+		if(cf == 0)
+			TEST_ASSERT(bus.fc == 0);
+		else if(bs == 0)
+			TEST_ASSERT(bus.fc == 1 && bus.max_block == cf);
+		else
+			TEST_ASSERT(bus.fc == 1 + (cf - 1) / bs && bus.max_block <= bs);
+	}
+	return 0;
+}
+
+static int test_isotp_errors(void)
+{
+	isotp_frame_t f, cf1, cf2, fc;
+	uint8_t wait[3] = { 0x31, 0, 0 };
+	uint32_t i;
+
+	for(i = 0; i < 64; i++)
+		pdu[i] = i;
+
+	/* Lost consecutive frame */
+	links_init(0, 0, 0, ISOTP_MAX_PDU);
+	isotp_recv_start(&rx);
+	isotp_send(&tx, pdu, 64, &f);
+	if(to_rx(&f))
+		return 1;
+	isotp_send_cf(&tx, &cf1);
+	isotp_send_cf(&tx, &cf2);
+	TEST_ASSERT(!isotp_receive(&rx, cf2.data, cf2.dlc, &fc));
+	TEST_ASSERT(rx.state == ISOTP_ERROR && rx.error == ISOTP_ERR_SN);
+
+	/* Truncated consecutive frame is ignored, not stored */
+	links_init(0, 0, 0, ISOTP_MAX_PDU);
+	isotp_recv_start(&rx);
+	isotp_send(&tx, pdu, 64, &f);
+	if(to_rx(&f))
+		return 1;
+	isotp_send_cf(&tx, &cf1);
+	TEST_ASSERT(!isotp_receive(&rx, cf1.data, 5, &fc));
+	TEST_ASSERT(rx.state == ISOTP_RX_CF && rx.rx_pos == 6);
+	if(to_rx(&cf1))
+		return 1;
+	TEST_ASSERT(rx.rx_pos == 13);
+
+	/* First frame restarting the reception */
+	links_init(0, 0, 0, ISOTP_MAX_PDU);
+	isotp_recv_start(&rx);
+	isotp_send(&tx, pdu, 64, &f);
+	if(to_rx(&f))
+		return 1;
+	isotp_send_cf(&tx, &cf1);
+	if(to_rx(&cf1))
+		return 1;
+	if(transfer(40, false))
+		return 1;
+	TEST_ASSERT(rx.state == ISOTP_DONE && rx.rx_len == 40);
+	TEST_ASSERT(memcmp(rx_buf, pdu, 40) == 0);
+
+	/* PDU larger than the receive buffer: OVERFLOW flow control */
+	links_init(ISOTP_FLAG_PAD, 0, 0, 32);
+	isotp_recv_start(&rx);
+	isotp_send(&tx, pdu, 64, &f);
+	TEST_ASSERT(isotp_receive(&rx, f.data, f.dlc, &fc));
+	TEST_ASSERT(fc.data[0] == 0x32 && fc.dlc == 8);
+	TEST_ASSERT(rx.state == ISOTP_ERROR && rx.error == ISOTP_ERR_OVERFLOW);
+	isotp_receive(&tx, fc.data, fc.dlc, &f);
+	TEST_ASSERT(tx.state == ISOTP_ERROR && tx.error == ISOTP_ERR_FC);
+	TEST_ASSERT(!isotp_send_cf(&tx, &f));
+
+	/* Single frame larger than the receive buffer */
+	links_init(0, 0, 0, 4);
+	isotp_recv_start(&rx);
+	isotp_send(&tx, pdu, 5, &f);
+	TEST_ASSERT(!isotp_receive(&rx, f.data, f.dlc, &fc));
+	TEST_ASSERT(rx.state == ISOTP_ERROR && rx.error == ISOTP_ERR_OVERFLOW);
+
+	/* Up to ISOTP_MAX_WFT WAIT flow controls, then an error */
+	links_init(0, 0, 0, ISOTP_MAX_PDU);
+	isotp_send(&tx, pdu, 64, &f);
+	for(i = 0; i < ISOTP_MAX_WFT; i++) {
+		isotp_receive(&tx, wait, 3, &f);
+		TEST_ASSERT(tx.state == ISOTP_TX_WAIT_FC);
+	}
+	isotp_receive(&tx, wait, 3, &f);
+	TEST_ASSERT(tx.state == ISOTP_ERROR && tx.error == ISOTP_ERR_FC);
+
+	/* WAIT then CTS, the WAIT count restarts at each block */
+	links_init(0, 2, 0, ISOTP_MAX_PDU);
+	isotp_recv_start(&rx);
+	isotp_send(&tx, pdu, 64, &f);
+	for(i = 0; i < ISOTP_MAX_WFT; i++)
+		isotp_receive(&tx, wait, 3, &f);
+	if(to_rx(&f))
+		return 1;
+	TEST_ASSERT(tx.state == ISOTP_TX_CF);
+	isotp_send_cf(&tx, &f);
+	if(to_rx(&f))
+		return 1;
+	isotp_send_cf(&tx, &f);
+	if(to_rx(&f))
+		return 1;
+	for(i = 0; i < ISOTP_MAX_WFT; i++)
+		isotp_receive(&tx, wait, 3, &f);
+	TEST_ASSERT(tx.state == ISOTP_TX_CF);
+
+	/* Short and invalid flow status */
+	links_init(0, 0, 0, ISOTP_MAX_PDU);
+	isotp_send(&tx, pdu, 64, &f);
+	isotp_receive(&tx, wait, 2, &f);
+	TEST_ASSERT(tx.state == ISOTP_ERROR && tx.error == ISOTP_ERR_FC);
+	isotp_send(&tx, pdu, 64, &f);
+	TEST_ASSERT(tx.error == ISOTP_ERR_NONE);
+	wait[0] = 0x35;
+	isotp_receive(&tx, wait, 3, &f);
+	TEST_ASSERT(tx.state == ISOTP_ERROR && tx.error == ISOTP_ERR_FC);
+
+	/* Invalid lengths */
+	TEST_ASSERT(!isotp_send(&tx, pdu, 0, &f));
+	TEST_ASSERT(!isotp_send(&tx, pdu, ISOTP_MAX_PDU + 1, &f));
+	links_init(0, 0, 0, ISOTP_MAX_PDU);
+	isotp_recv_start(&rx);
+	f.data[0] = 0x08;
+	TEST_ASSERT(!isotp_receive(&rx, f.data, 8, &fc) && rx.state == ISOTP_RX_WAIT);
+	f.data[0] = 0x03;
+	TEST_ASSERT(!isotp_receive(&rx, f.data, 3, &fc) && rx.state == ISOTP_RX_WAIT);
+	f.data[0] = 0x10;
+	f.data[1] = 0x07;
+	TEST_ASSERT(!isotp_receive(&rx, f.data, 8, &fc) && rx.state == ISOTP_RX_WAIT);
+	/* Consecutive frame without first frame */
+	f.data[0] = 0x21;
+	TEST_ASSERT(!isotp_receive(&rx, f.data, 8, &fc) && rx.state == ISOTP_RX_WAIT);
+	return 0;
+}
+
+int test_isotp(void)
+{
+	test_srand(23);
+
+	/* STmin encoding, reserved values are the maximum */
+	TEST_ASSERT(isotp_stmin_us(0) == 0);
+	TEST_ASSERT(isotp_stmin_us(0x7f) == 127000);
+	TEST_ASSERT(isotp_stmin_us(0x80) == 127000);
+	TEST_ASSERT(isotp_stmin_us(0xf0) == 127000);
+	TEST_ASSERT(isotp_stmin_us(0xf1) == 100);
+	TEST_ASSERT(isotp_stmin_us(0xf9) == 900);
+	TEST_ASSERT(isotp_stmin_us(0xfa) == 127000);
+
+	if(test_isotp_loopback())
+		return 1;
+	if(test_isotp_errors())
+		return 1;
+	return 0;
+}
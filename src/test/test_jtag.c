@@ -0,0 +1,313 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * OpenOCD binary mode of the JTAG mode (hydrabus_mode_jtag.c) driving a
+ * simulated TAP through the simulated GPIOs, checked bit by bit against
+ * the same TAP clocked directly.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "test.h"
+#include "sim_console.h"
+#include "sim_gpio.h"
+#include "hydrabus_mode_jtag.h"
+
+/* Pins of init_proto_default() on port B */
+#define TAP_TRST	(7)
+#define TAP_TDI		(8)
+#define TAP_TDO		(9)
+#define TAP_TMS		(10)
+#define TAP_TCK		(11)
+
+#define TAP_IR_LEN	(4)
+#define TAP_IR_IDCODE	(0xE)
+#define TAP_IDCODE	(0x4BA00477)
+
+enum {
+	TLR, RTI, SELDR, CAPDR, SHDR, EX1DR, PADR, EX2DR, UPDR,
+	SELIR, CAPIR, SHIR, EX1IR, PAIR, EX2IR, UPIR,
+};
+
+/* Next state for TMS low and high */
+static const uint8_t tap_next[16][2] = {
+	[TLR] = { RTI, TLR },
+	[RTI] = { RTI, SELDR },
+	[SELDR] = { CAPDR, SELIR },
+	[CAPDR] = { SHDR, EX1DR },
+	[SHDR] = { SHDR, EX1DR },
+	[EX1DR] = { PADR, UPDR },
+	[PADR] = { PADR, EX2DR },
+	[EX2DR] = { SHDR, UPDR },
+	[UPDR] = { RTI, SELDR },
+	[SELIR] = { CAPIR, TLR },
+	[CAPIR] = { SHIR, EX1IR },
+	[SHIR] = { SHIR, EX1IR },
+	[EX1IR] = { PAIR, UPIR },
+	[PAIR] = { PAIR, EX2IR },
+	[EX2IR] = { SHIR, UPIR },
+	[UPIR] = { RTI, SELDR },
+};
+
+/* A TAP with IDCODE and BYPASS, TDO is 1 outside of the shift states */
+typedef struct {
+	uint8_t state;
+	uint8_t ir;
+	uint8_t ir_shift;
+	uint32_t dr_shift;
+	uint8_t dr_len;
+	uint8_t tdo;
+	uint8_t tck;		/* Previous TCK level, for the GPIO model */
+	uint32_t nb_clock;
+} tap_t;
+
+static void tap_reset(tap_t *tap)
+{
+	memset(tap, 0, sizeof(tap_t));
+	tap->state = TLR;
+	tap->ir = TAP_IR_IDCODE;
+	tap->tdo = 1;
+}
+
+static void tap_rising(tap_t *tap, uint8_t tms, uint8_t tdi)
+{
+	switch(tap->state) {
+	case CAPDR:
+		if(tap->ir == TAP_IR_IDCODE) {
+			tap->dr_shift = TAP_IDCODE;
+			tap->dr_len = 32;
+		} else {
+			tap->dr_shift = 0;
+			tap->dr_len = 1;
+		}
+		break;
+	case SHDR:
+		tap->dr_shift = (tap->dr_shift >> 1) |
+				((uint32_t)tdi << (tap->dr_len - 1));
+		break;
+	case CAPIR:
+		tap->ir_shift = 0x1;
+		break;
+	case SHIR:
+		tap->ir_shift = (tap->ir_shift >> 1) | (tdi << (TAP_IR_LEN - 1));
+		break;
+	}
+	tap->state = tap_next[tap->state][tms];
+	tap->nb_clock++;
+}
+
+static void tap_falling(tap_t *tap)
+{
+	switch(tap->state) {
+	case SHDR:
+		tap->tdo = tap->dr_shift & 1;
+		break;
+	case SHIR:
+		tap->tdo = tap->ir_shift & 1;
+		break;
+	case UPIR:
+		tap->ir = tap->ir_shift;
+		tap->tdo = 1;
+		break;
+	case TLR:
+		tap->ir = TAP_IR_IDCODE;
+		tap->tdo = 1;
+		break;
+	default:
+		tap->tdo = 1;
+		break;
+	}
+}
+
+/* Clock the TAP from the simulated GPIOs */
+static void tap_gpio_hook(void *ctx)
+{
+	tap_t *tap = ctx;
+	uint32_t odr = GPIOB->ODR;
+	uint8_t tck = (odr >> TAP_TCK) & 1;
+
+	if(!((odr >> TAP_TRST) & 1)) {
+		tap_reset(tap);
+	} else if(tck && !tap->tck) {
+		tap_rising(tap, (odr >> TAP_TMS) & 1, (odr >> TAP_TDI) & 1);
+	} else if(!tck && tap->tck) {
+		tap_falling(tap);
+	}
+	tap->tck = tck;
+	GPIOB->IDR = (GPIOB->IDR & ~(1 << TAP_TDO)) | (tap->tdo << TAP_TDO);
+}
+
+/*
+ * CMD_OCD_TAP_SHIFT of nb bits of tms/tdi, appended to in, and its
+ * expected answer from the reference TAP appended to out.
+ */
+static void tap_shift(tap_t *ref, uint8_t *in, uint32_t *in_len,
+		      uint8_t *out, uint32_t *out_len,
+		      const uint8_t *tms, const uint8_t *tdi, uint32_t nb)
+{
+	uint32_t i, nb_bytes = (nb + 7) / 8;
+	uint8_t tdo = 0;
+
+	in[(*in_len)++] = CMD_OCD_TAP_SHIFT;
+	in[(*in_len)++] = nb >> 8;
+	in[(*in_len)++] = nb & 0xFF;
+	memset(&in[*in_len], 0, nb_bytes * 2);
+	for(i = 0; i < nb; i++) {
+		in[*in_len + (i / 8) * 2] |= tdi[i] << (i % 8);
+		in[*in_len + (i / 8) * 2 + 1] |= tms[i] << (i % 8);
+	}
+	*in_len += nb_bytes * 2;
+
+	out[(*out_len)++] = CMD_OCD_TAP_SHIFT;
+	out[(*out_len)++] = nb >> 8;
+	out[(*out_len)++] = nb & 0xFF;
+	for(i = 0; i < nb; i++) {
+		/* TDO is sampled while TCK is high, before it changes */
+		tdo = (ref->tdo << 7) | (tdo >> 1);
+		tap_rising(ref, tms[i], tdi[i]);
+		tap_falling(ref);
+		/* The last byte is MSB aligned */
+		if(i % 8 == 7 || i == nb - 1) {
+			out[(*out_len)++] = tdo;
+			tdo = 0;
+		}
+	}
+}
+
+#define TAP_LONG_SHIFT	(40000)
+#define OCD_TAP_BENCH_BITS	(4096)
+
+int test_jtag(void)
+{
+	static uint8_t in[2 * TAP_LONG_SHIFT], out[2 * TAP_LONG_SHIFT];
+	static uint8_t exp[2 * TAP_LONG_SHIFT];
+	static uint8_t tms[TAP_LONG_SHIFT], tdi[TAP_LONG_SHIFT];
+	t_hydra_console con;
+	t_mode_config mode;
+	sim_chn_t chn;
+	pool_stats_t stats;
+	tap_t tap, ref;
+	uint32_t i, nb, in_len = 0, exp_len = 0, idcode;
+
+	tap_reset(&ref);
+	in[in_len++] = CMD_OCD_ENTER_OOCD;
+	memcpy(&exp[exp_len], "OCD1", 4);
+	exp_len += 4;
+	/* 100kHz */
+	in[in_len++] = CMD_OCD_JTAG_SPEED;
+	in[in_len++] = 0x00;
+	in[in_len++] = 0x64;
+
+	/* Test-Logic-Reset, Shift-DR, IDCODE and back to Run-Test/Idle */
+	nb = 0;
+	for(i = 0; i < 5; i++)
+		tms[nb++] = 1;
+	tms[nb++] = 0;
+	tms[nb++] = 1;
+	tms[nb++] = 0;
+	tms[nb++] = 0;
+	for(i = 0; i < 32; i++)
+		tms[nb++] = (i == 31);
+	tms[nb++] = 1;
+	tms[nb++] = 0;
+	memset(tdi, 1, nb);
+	tap_shift(&ref, in, &in_len, exp, &exp_len, tms, tdi, nb);
+	/* The 32 IDCODE bits are bits 9 to 40 of the answer */
+	idcode = 0;
+	for(i = 0; i < 32; i++)
+		idcode |= (uint32_t)((exp[exp_len - 6 + (9 + i) / 8] >> ((9 + i) % 8)) & 1) << i;
+	TEST_ASSERT(idcode == TAP_IDCODE);
+
+	/* IR and DR scans, bypass, more than OCD_TAP_SHIFT_MAX bits */
+	for(i = 0; i < TAP_LONG_SHIFT; i++) {
+		tms[i] = (test_rand() % 8) == 0;
+		tdi[i] = test_rand() & 1;
+	}
+	tap_shift(&ref, in, &in_len, exp, &exp_len, tms, tdi, 13);
+	tap_shift(&ref, in, &in_len, exp, &exp_len, tms + 13, tdi + 13, 1000);
+	tap_shift(&ref, in, &in_len, exp, &exp_len, tms, tdi, TAP_LONG_SHIFT);
+	tap_shift(&ref, in, &in_len, exp, &exp_len, tms, tdi, 0);
+	/* The next command is parsed */
+	in[in_len++] = CMD_OCD_UNKNOWN;
+	memcpy(&exp[exp_len], "BBIO1", 5);
+	exp_len += 5;
+
+	pool_init();
+	sim_gpio_reset();
+	tap_reset(&tap);
+	sim_gpio_attach(tap_gpio_hook, &tap);
+	sim_chn_init(&chn, in, in_len, out, sizeof(out));
+	sim_console_init(&con, &mode, &chn);
+
+	jtag_enter_openocd(&con);
+
+	sim_gpio_attach(NULL, NULL);
+	TEST_ASSERT(chn.in_pos == in_len);
+	TEST_ASSERT(chn.out_len == exp_len);
+	TEST_ASSERT(!memcmp(out, exp, exp_len));
+	TEST_ASSERT(tap.nb_clock == ref.nb_clock && tap.state == ref.state);
+	TEST_ASSERT(mode.proto.config.jtag.divider == 20);
+	TEST_ASSERT(sim_gpio_state.prescaler == 20);
+	pool_stats(POOL_CCM, &stats);
+	TEST_ASSERT(stats.blocks_used == 0);
+	return 0;
+}
+
+/* Firmware cost of the TAP shifts, 2 timer periods per bit */
+int bench_jtag(void)
+{
+	static uint8_t tms[OCD_TAP_BENCH_BITS], tdi[OCD_TAP_BENCH_BITS];
+	t_hydra_console con;
+	t_mode_config mode;
+	sim_chn_t chn;
+	tap_t tap, ref;
+	uint8_t *in, *exp;
+	uint32_t i, in_len = 0, exp_len = 0, nb = 100;
+	uint64_t t;
+
+	in = malloc(nb * (3 + OCD_TAP_BENCH_BITS / 4));
+	exp = malloc(nb * (3 + OCD_TAP_BENCH_BITS / 8));
+	TEST_ASSERT(in != NULL && exp != NULL);
+	for(i = 0; i < OCD_TAP_BENCH_BITS; i++) {
+		tms[i] = (test_rand() % 8) == 0;
+		tdi[i] = test_rand() & 1;
+	}
+	tap_reset(&ref);
+	for(i = 0; i < nb; i++)
+		tap_shift(&ref, in, &in_len, exp, &exp_len, tms, tdi, OCD_TAP_BENCH_BITS);
+
+	pool_init();
+	sim_gpio_reset();
+	tap_reset(&tap);
+	sim_gpio_attach(tap_gpio_hook, &tap);
+	sim_chn_init(&chn, in, in_len, NULL, 0);
+	sim_console_init(&con, &mode, &chn);
+
+	t = test_time_ns();
+	jtag_enter_openocd(&con);
+	t = test_time_ns() - t;
+
+	sim_gpio_attach(NULL, NULL);
+	free(in);
+	free(exp);
+	TEST_ASSERT(chn.out_total == exp_len);
+	bench_report("tap shift 4096 bits", t, (uint64_t)nb * OCD_TAP_BENCH_BITS, "bit");
+	return 0;
+}
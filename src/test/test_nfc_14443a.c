@@ -0,0 +1,482 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * ISO14443A 106kbps decoder of the NFC sniffer (hydranfc_sniff_decode.h):
+ * the frames of synthesized DMA traces (Miller Modified and Manchester
+ * frames with random phase, pause length and noise, random words) are
+ * decoded bit exact with a copy of the original table based loop of
+ * hydranfc_cmd_sniff.c, and the time per DMA word of both.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "test.h"
+#include "hydranfc_sniff_decode.h"
+#include "hydranfc_cmd_sniff_downsampling.h"
+#include "hydranfc_cmd_sniff_iso14443.h"
+
+/* One bit at 106kbps is 32 samples at 3.39MHz, one DMA word */
+#define NFC_SAMPLES_PER_BIT	(32)
+#define NFC_TRACE_WORDS		(0x8000)
+#define NFC_OUT_SIZE		(0x10000)
+/* Idle samples around the frames, at least the 86us frame delay time */
+#define NFC_FRAME_GAP		(9 * NFC_SAMPLES_PER_BIT)
+
+/* Decoded events, same content as the sniffer output */
+#define NFC_EV_START	(0x10000) /* | protocol << 8 | start bit */
+#define NFC_EV_BYTE	(0x20000) /* | parity << 8 | byte */
+#define NFC_EV_PART	(0x30000) /* | incomplete byte */
+
+typedef struct {
+	uint32_t *w;
+	uint32_t nb; /* samples */
+	uint32_t noise; /* flip one sample out of noise, 0 none */
+} nfc_trace_t;
+
+typedef struct {
+	uint32_t *ev;
+	uint32_t nb;
+} nfc_out_t;
+
+static void trace_put(nfc_trace_t *t, uint32_t level, uint32_t nb)
+{
+	uint32_t i, s;
+
+	for(i = 0; i < nb && t->nb < NFC_TRACE_WORDS * 32; i++, t->nb++) {
+		s = level;
+		if(t->noise && (test_rand() % t->noise) == 0)
+			s ^= 1;
+		if(s)
+			t->w[t->nb / 32] |= 0x80000000 >> (t->nb % 32);
+		else
+			t->w[t->nb / 32] &= ~(0x80000000 >> (t->nb % 32));
+	}
+}
+
+/* PICC, OOK 847.5kHz subcarrier (2 samples on, 2 off) on the first half for 1 */
+static void trace_manchester_bit(nfc_trace_t *t, uint32_t bit)
+{
+	uint32_t i;
+
+	if(!bit)
+		trace_put(t, 0, NFC_SAMPLES_PER_BIT / 2);
+	for(i = 0; i < NFC_SAMPLES_PER_BIT / 2; i += 4) {
+		trace_put(t, 0, 2);
+		trace_put(t, 1, 2);
+	}
+	if(bit)
+		trace_put(t, 0, NFC_SAMPLES_PER_BIT / 2);
+}
+
+/* PCD, 100% ASK pause of 7 to 11 samples: Z at the start, X at half bit, Y none */
+static void trace_miller_seq(nfc_trace_t *t, char seq)
+{
+	uint32_t pause = 7 + test_rand() % 5;
+
+	switch(seq) {
+	case 'Z':
+		trace_put(t, 0, pause);
+		trace_put(t, 1, NFC_SAMPLES_PER_BIT - pause);
+		break;
+	case 'X':
+		trace_put(t, 1, NFC_SAMPLES_PER_BIT / 2);
+		trace_put(t, 0, pause);
+		trace_put(t, 1, NFC_SAMPLES_PER_BIT / 2 - pause);
+		break;
+	default:
+		trace_put(t, 1, NFC_SAMPLES_PER_BIT);
+		break;
+	}
+}
+
+/* Start bit, bytes LSB first with odd parity, end of frame, idle */
+static void trace_frame(nfc_trace_t *t, bool picc, const uint8_t *data,
+			uint32_t len)
+{
+	uint32_t i, j, bit, prev = 0;
+	uint32_t idle = picc ? 0 : 1;
+
+	/* Random phase of the frame in the DMA words */
+	trace_put(t, idle, NFC_FRAME_GAP + test_rand() % 64);
+	if(picc)
+		trace_manchester_bit(t, 1);
+	else
+		trace_miller_seq(t, 'Z');
+	for(i = 0; i < len * 9; i++) {
+		j = i % 9;
+		if(j < 8) {
+			bit = (data[i / 9] >> j) & 1;
+		} else {
+			bit = 1;
+			for(j = 0; j < 8; j++)
+				bit ^= (data[i / 9] >> j) & 1;
+		}
+		if(picc)
+			trace_manchester_bit(t, bit);
+		else
+			trace_miller_seq(t, bit ? 'X' : (prev ? 'Y' : 'Z'));
+		prev = bit;
+	}
+	if(!picc) {
+		/* Logic 0 then Y */
+		trace_miller_seq(t, prev ? 'Y' : 'Z');
+		trace_miller_seq(t, 'Y');
+	}
+	trace_put(t, idle, NFC_FRAME_GAP + test_rand() % 64);
+}
+
+static void out_put(nfc_out_t *o, uint32_t ev)
+{
+	if(o->nb < NFC_OUT_SIZE)
+		o->ev[o->nb] = ev;
+	o->nb++;
+}
+
+/* Start bit to protocol, an unknown start bit is a Miller Modified frame */
+static uint32_t nfc_protocol(uint8_t ds, uint32_t *old_protocol, bool *resync)
+{
+	uint32_t protocol = detected_protocol[ds];
+
+	*resync = false;
+	if(protocol != MILLER_MODIFIED_106KHZ && protocol != MANCHESTER_106KHZ) {
+		protocol = MILLER_MODIFIED_106KHZ;
+		*resync = true;
+	}
+	*old_protocol = protocol;
+	return protocol;
+}
+
+/* Cortex-M register shifts, 0 from 32 */
+static uint32_t arm_lsl(uint32_t x, uint32_t n)
+{
+	return (n >= 32) ? 0 : x << n;
+}
+
+static uint32_t arm_lsr(uint32_t x, uint32_t n)
+{
+	return (n >= 32) ? 0 : x >> n;
+}
+
+static uint8_t ref_downsample_4x(uint32_t f_data)
+{
+	uint8_t data;
+
+	data  = (downsample_4x[(f_data>>24)])<<6;
+	data |= (downsample_4x[((f_data&0x00FF0000)>>16)])<<4;
+	data |= (downsample_4x[((f_data&0x0000FF00)>>8)])<<2;
+	data |= (downsample_4x[(f_data&0x000000FF)]);
+	return data;
+}
+
+/*
+ * Start of frame: waits for a changed word as
+ * sniff_wait_data_change_or_exit(), returns the index of the word
+ * following the first changed one, 0 at the end of the trace.
+ */
+static uint32_t nfc_wait(const uint32_t *w, uint32_t nb, uint32_t i,
+			 uint32_t *old_bit)
+{
+	uint32_t old;
+
+	if(i >= nb)
+		return 0;
+	old = w[i++];
+	*old_bit = old & 1;
+	for(; i < nb; i++) {
+		if(w[i] != old)
+			return (i + 1 < nb) ? i + 1 : 0;
+		*old_bit = w[i] & 1;
+	}
+	return 0;
+}
+
+/* Original loop of hydranfc_sniff_14443A(), with tables and shifts */
+static void ref_decode(const uint32_t *w, uint32_t nb, nfc_out_t *o)
+{
+	const u08_t *bit_table;
+	uint32_t i = 0, u32_data, old_u32_data, old_data_bit, old_data_counter;
+	uint32_t f_data, lsh_bit, rsh_bit, rsh_miller_bit, lsh_miller_bit;
+	uint32_t protocol_found, old_protocol_found = 0;
+	uint8_t ds_data, tmp_u8_data, tmp_u8_data_nb_bit;
+	bool resync;
+
+	while((i = nfc_wait(w, nb, i, &old_data_bit)) != 0) {
+		u32_data = w[i - 1];
+		tmp_u8_data = 0;
+		tmp_u8_data_nb_bit = 0;
+
+		lsh_bit = old_data_bit ? (~u32_data) : u32_data;
+		lsh_bit = lsh_bit ? (uint32_t)__builtin_clz(lsh_bit) : 32;
+		rsh_bit = 32-lsh_bit;
+		f_data = arm_lsl(u32_data, lsh_bit);
+		u32_data = w[i++];
+		f_data |= arm_lsr(u32_data, rsh_bit);
+		ds_data = ref_downsample_4x(f_data);
+
+		protocol_found = nfc_protocol(ds_data, &old_protocol_found, &resync);
+		rsh_miller_bit = resync ? 15 : 0;
+		lsh_miller_bit = 32-rsh_miller_bit;
+		out_put(o, NFC_EV_START | (protocol_found << 8) | ds_data);
+		bit_table = (protocol_found == MANCHESTER_106KHZ) ?
+			    manchester_106kb : miller_modified_106kb;
+
+		old_u32_data = f_data;
+		old_data_counter = 0;
+		while(i < nb) {
+			f_data = arm_lsl(u32_data, lsh_bit);
+			u32_data = w[i++];
+			f_data |= arm_lsr(u32_data, rsh_bit);
+
+			if (u32_data != old_u32_data) {
+				old_u32_data = u32_data;
+				old_data_counter = 0;
+			} else {
+				old_u32_data = u32_data;
+				if ( (u32_data==0xFFFFFFFF) || (u32_data==0x00000000) ) {
+					old_data_counter++;
+					if (old_data_counter>1)
+						break;
+				} else {
+					old_data_counter = 0;
+				}
+			}
+
+			f_data = arm_lsr(f_data, rsh_miller_bit) |
+				 arm_lsl(0xFFFFFFFF, lsh_miller_bit);
+			ds_data = ref_downsample_4x(f_data);
+
+			if (tmp_u8_data_nb_bit < 8) {
+				tmp_u8_data |= (bit_table[ds_data])<<tmp_u8_data_nb_bit;
+				tmp_u8_data_nb_bit++;
+			} else {
+				out_put(o, NFC_EV_BYTE | (bit_table[ds_data] << 8) | tmp_u8_data);
+				tmp_u8_data_nb_bit = 0;
+				tmp_u8_data = 0;
+			}
+		}
+		if (tmp_u8_data_nb_bit>3)
+			out_put(o, NFC_EV_PART | tmp_u8_data);
+	}
+}
+
+/* Loop of hydranfc_sniff_14443A() */
+static void kernel_decode(const uint32_t *w, uint32_t nb, nfc_out_t *o)
+{
+	sniff_14443a_t dec;
+	uint32_t i = 0, old_data_bit, protocol_found, old_protocol_found = 0;
+	uint8_t ds_data;
+	bool resync;
+
+	while((i = nfc_wait(w, nb, i, &old_data_bit)) != 0) {
+		ds_data = sniff_14443a_sync(&dec, old_data_bit, w[i - 1], w[i]);
+		i++;
+		protocol_found = nfc_protocol(ds_data, &old_protocol_found, &resync);
+		sniff_14443a_coding(&dec, protocol_found == MANCHESTER_106KHZ, resync);
+		out_put(o, NFC_EV_START | (protocol_found << 8) | ds_data);
+
+		while(i < nb) {
+			switch(sniff_14443a_word(&dec, w[i++])) {
+			case SNIFF_14443A_BIT:
+				continue;
+			case SNIFF_14443A_BYTE:
+				out_put(o, NFC_EV_BYTE | (dec.parity << 8) | dec.byte);
+				continue;
+			default:
+				break;
+			}
+			break;
+		}
+		if (dec.nb_bits>3)
+			out_put(o, NFC_EV_PART | dec.acc);
+	}
+}
+
+static int nfc_compare(const uint32_t *w, uint32_t nb, nfc_out_t *ref,
+		       nfc_out_t *out)
+{
+	ref->nb = 0;
+	out->nb = 0;
+	ref_decode(w, nb, ref);
+	kernel_decode(w, nb, out);
+	TEST_ASSERT(ref->nb <= NFC_OUT_SIZE);
+	TEST_ASSERT(out->nb == ref->nb);
+	TEST_ASSERT(!memcmp(out->ev, ref->ev, ref->nb * sizeof(uint32_t)));
+	return 0;
+}
+
+static void rand_bytes(uint8_t *data, uint32_t len)
+{
+	uint32_t i;
+
+	for(i = 0; i < len; i++)
+		data[i] = test_rand();
+}
+
+/*
+ * A capture of ISO14443A frames: REQA, ATQA, anticollision, SELECT, SAK
+ * and READ/data exchanges of a MIFARE Ultralight, same as test_nfc_encode.c.
+ */
+static const uint8_t nfc_lens[] = { 1, 2, 2, 5, 9, 3, 4, 18, 4, 18, 4, 18 };
+
+/* Exchange of PCD (even) and PICC (odd) frames, returns the number of words */
+static uint32_t trace_exchange(nfc_trace_t *t, uint8_t data[][32])
+{
+	uint32_t n;
+
+	t->nb = 0;
+	for(n = 0; n < sizeof(nfc_lens); n++) {
+		rand_bytes(data[n], nfc_lens[n]);
+		trace_frame(t, n & 1, data[n], nfc_lens[n]);
+	}
+	return t->nb / 32;
+}
+
+int test_nfc_14443a(void)
+{
+	uint8_t data[sizeof(nfc_lens)][32];
+	uint32_t *w, i, n, k, f, nb;
+	nfc_trace_t t;
+	nfc_out_t ref, out;
+
+	w = calloc(NFC_TRACE_WORDS, sizeof(uint32_t));
+	ref.ev = malloc(NFC_OUT_SIZE * sizeof(uint32_t));
+	out.ev = malloc(NFC_OUT_SIZE * sizeof(uint32_t));
+	TEST_ASSERT(w != NULL && ref.ev != NULL && out.ev != NULL);
+	t.w = w;
+	test_srand(14443);
+
+	/* Nibble masks, same bits as the tables */
+	for(i = 0; i < 256; i++) {
+		TEST_ASSERT(((SNIFF_14443A_MILLER_MASKS >> (16 + (i >> 4))) &
+			     (SNIFF_14443A_MILLER_MASKS >> (i & 0x0F)) & 1) ==
+			    miller_modified_106kb[i]);
+		TEST_ASSERT(((SNIFF_14443A_MANCHESTER_MASKS >> (16 + (i >> 4))) &
+			     (SNIFF_14443A_MANCHESTER_MASKS >> (i & 0x0F)) & 1) ==
+			    manchester_106kb[i]);
+	}
+
+	/* Clean frames are decoded */
+	t.noise = 0;
+	for(k = 0; k < 20; k++) {
+		nb = trace_exchange(&t, data);
+		if(nfc_compare(w, nb, &ref, &out))
+			return 1;
+		/* Idle level changes between the frames start empty frames */
+		for(i = 0, n = 0; i < out.nb; ) {
+			TEST_ASSERT((out.ev[i] & 0xF0000) == NFC_EV_START);
+			for(f = i++, nb = 0; i < out.nb && (out.ev[i] & 0xF0000) != NFC_EV_START; i++) {
+				if((out.ev[i] & 0xF0000) != NFC_EV_BYTE)
+					continue;
+				TEST_ASSERT(n < sizeof(nfc_lens) && nb < nfc_lens[n]);
+				TEST_ASSERT((out.ev[i] & 0xFF) == data[n][nb]);
+				nb++;
+			}
+			if(nb == 0)
+				continue;
+			TEST_ASSERT(nb == nfc_lens[n]);
+			/* PCD frames following a PICC frame are found by the resync */
+			TEST_ASSERT(((out.ev[f] >> 8) & 0xFF) == MILLER_MODIFIED_106KHZ + (n & 1));
+			n++;
+		}
+		TEST_ASSERT(n == sizeof(nfc_lens));
+	}
+
+	/* Noisy frames */
+	for(k = 0; k < 200; k++) {
+		t.noise = 16 + test_rand() % 256;
+		nb = trace_exchange(&t, data);
+		if(nfc_compare(w, nb, &ref, &out))
+			return 1;
+	}
+
+	/* Random words, repeated 0/1 words for the ends of frame */
+	for(k = 0; k < 200; k++) {
+		nb = 1 + test_rand() % 4096;
+		for(i = 0; i < nb; i++) {
+			switch(test_rand() % 4) {
+			case 0:
+				w[i] = 0;
+				break;
+			case 1:
+				w[i] = 0xFFFFFFFF;
+				break;
+			case 2:
+				w[i] = 0xFFFFFFFF >> (test_rand() % 32);
+				if(test_rand() & 1)
+					w[i] = ~w[i];
+				break;
+			default:
+				w[i] = test_rand();
+				break;
+			}
+		}
+		if(nfc_compare(w, nb, &ref, &out))
+			return 1;
+	}
+
+	free(w);
+	free(ref.ev);
+	free(out.ev);
+	return 0;
+}
+
+/*
+ * Host time per DMA word of the table loop and of the decoder on the same
+ * exchange, each DMA word must be decoded in 32 samples at 3.39MHz.
+ */
+int bench_nfc_14443a(void)
+{
+	uint8_t data[sizeof(nfc_lens)][32];
+	uint32_t *w, k, nb, nb_loop = 2000;
+	uint64_t t_ref, t;
+	nfc_trace_t tr;
+	nfc_out_t out;
+
+	w = calloc(NFC_TRACE_WORDS, sizeof(uint32_t));
+	out.ev = malloc(NFC_OUT_SIZE * sizeof(uint32_t));
+	TEST_ASSERT(w != NULL && out.ev != NULL);
+	tr.w = w;
+	tr.noise = 0;
+	test_srand(1);
+	nb = trace_exchange(&tr, data);
+
+	t_ref = test_time_ns();
+	for(k = 0; k < nb_loop; k++) {
+		out.nb = 0;
+		ref_decode(w, nb, &out);
+	}
+	t_ref = test_time_ns() - t_ref;
+	bench_report("table", t_ref, (uint64_t)nb * nb_loop, "word");
+
+	t = test_time_ns();
+	for(k = 0; k < nb_loop; k++) {
+		out.nb = 0;
+		kernel_decode(w, nb, &out);
+	}
+	t = test_time_ns() - t;
+	bench_report("kernel", t, (uint64_t)nb * nb_loop, "word");
+
+	printf("  %u words/exchange, %u events, speedup %.2f\n", nb, out.nb,
+	       (double)t_ref / t);
+	printf("  budget 9.44 us/word, 1586 cycles/word at 168MHz\n");
+	free(w);
+	free(out.ev);
+	return 0;
+}
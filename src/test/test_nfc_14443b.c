@@ -0,0 +1,257 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * ISO14443B 106kbps decoder of the NFC sniffer (hydranfc_sniff_14443b.c):
+ * synthesized DMA traces of PCD (NRZ, both idle polarities) and PICC
+ * (BPSK) frames with random phase, SOF/EOF/EGT lengths and noisy samples
+ * are decoded to their direction and bytes, truncated frames and framing
+ * errors end the frame.
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test.h"
+#include "hydranfc_sniff_14443b.h"
+
+/* One etu at 106kbps is 32 samples at 3.39MHz, one DMA word */
+#define NFCB_TRACE_WORDS	(0x4000)
+#define NFCB_MAX_EVENTS		(0x1000)
+
+typedef struct {
+	uint32_t *w;
+	uint32_t nb; /* samples */
+	uint32_t noise; /* flip one sample in a word out of noise, 0 none */
+	uint32_t pcd_idle; /* PCD logic 1 level, 0 or 1 */
+	uint32_t phase; /* PICC subcarrier phase, 0 to 3 */
+} nfcb_trace_t;
+
+typedef struct {
+	sniff_14443b_event_t ev;
+	uint8_t dir;
+	uint8_t byte;
+} nfcb_event_t;
+
+static void trace_put(nfcb_trace_t *t, uint32_t s)
+{
+	if(t->nb >= NFCB_TRACE_WORDS * 32)
+		return;
+	if(s)
+		t->w[t->nb / 32] |= 0x80000000 >> (t->nb % 32);
+	else
+		t->w[t->nb / 32] &= ~(0x80000000 >> (t->nb % 32));
+	t->nb++;
+}
+
+static void trace_pcd(nfcb_trace_t *t, uint32_t bit, uint32_t nb_etu)
+{
+	uint32_t i;
+
+	for(i = 0; i < nb_etu * 32; i++)
+		trace_put(t, bit ? t->pcd_idle : !t->pcd_idle);
+}
+
+/* Subcarrier of 4 samples period, inverted phase for 0 */
+static void trace_picc(nfcb_trace_t *t, uint32_t bit, uint32_t nb_etu)
+{
+	uint32_t i;
+
+	for(i = 0; i < nb_etu * 32; i++)
+		trace_put(t, (((t->nb + t->phase) >> 1) & 1) ^ !bit);
+}
+
+/* No subcarrier, same level as the PCD idle (no modulation at all) */
+static void trace_off(nfcb_trace_t *t, uint32_t nb)
+{
+	while(nb--)
+		trace_put(t, t->pcd_idle);
+}
+
+static void trace_bit(nfcb_trace_t *t, bool picc, uint32_t bit, uint32_t nb_etu)
+{
+	if(picc)
+		trace_picc(t, bit, nb_etu);
+	else
+		trace_pcd(t, bit, nb_etu);
+}
+
+/* Idle (or TR1), SOF, characters with EGT, EOF, idle; len 0 stops after the SOF */
+static void trace_frame(nfcb_trace_t *t, bool picc, const uint8_t *data,
+			uint32_t len)
+{
+	uint32_t i, j;
+
+	if(picc) {
+		trace_off(t, 6 * 32 + test_rand() % 32);
+		t->phase = test_rand() % 4;
+		trace_picc(t, 1, 8 + test_rand() % 8);
+	} else {
+		trace_pcd(t, 1, 6);
+		for(i = test_rand() % 32; i; i--)
+			trace_put(t, t->pcd_idle);
+	}
+	trace_bit(t, picc, 0, 10 + test_rand() % 2);
+	trace_bit(t, picc, 1, 2 + test_rand() % 2);
+	for(i = 0; i < len; i++) {
+		trace_bit(t, picc, 0, 1);
+		for(j = 0; j < 8; j++)
+			trace_bit(t, picc, (data[i] >> j) & 1, 1);
+		trace_bit(t, picc, 1, 1 + test_rand() % 3);
+	}
+	if(len == 0)
+		return;
+	trace_bit(t, picc, 0, 10 + test_rand() % 2);
+	if(picc)
+		trace_off(t, 6 * 32);
+	else
+		trace_pcd(t, 1, 6);
+}
+
+/* One noisy sample in some words */
+static void trace_noise(nfcb_trace_t *t)
+{
+	uint32_t i;
+
+	for(i = 0; i < t->nb / 32 && t->noise; i++) {
+		if(test_rand() % t->noise == 0)
+			t->w[i] ^= 1 << (test_rand() % 32);
+	}
+}
+
+static uint32_t nfcb_decode(const uint32_t *w, uint32_t nb, nfcb_event_t *ev)
+{
+	sniff_14443b_t d;
+	sniff_14443b_event_t e;
+	uint32_t i, n = 0;
+
+	sniff_14443b_init(&d);
+	for(i = 0; i < nb; i++) {
+		e = sniff_14443b_word(&d, w[i]);
+		if(e == SNIFF_14443B_NONE || n >= NFCB_MAX_EVENTS)
+			continue;
+		ev[n].ev = e;
+		ev[n].dir = d.dir;
+		ev[n].byte = d.byte;
+		n++;
+	}
+	return n;
+}
+
+/* Checks the SOF, bytes and EOF of a frame from event i */
+static int nfcb_check(const nfcb_event_t *ev, uint32_t nb, uint32_t *i,
+		      uint8_t dir, const uint8_t *data, uint32_t len)
+{
+	uint32_t k;
+
+	TEST_ASSERT(*i < nb && ev[*i].ev == SNIFF_14443B_SOF);
+	TEST_ASSERT(ev[*i].dir == dir);
+	for(k = 0, (*i)++; k < len; k++, (*i)++) {
+		TEST_ASSERT(*i < nb && ev[*i].ev == SNIFF_14443B_BYTE);
+		TEST_ASSERT(ev[*i].byte == data[k]);
+	}
+	TEST_ASSERT(*i < nb && ev[*i].ev == SNIFF_14443B_EOF);
+	(*i)++;
+	return 0;
+}
+
+/* REQB/ATQB, ATTRIB/answer and I-blocks */
+static const uint8_t nfcb_lens[] = { 5, 14, 11, 3, 8, 20, 8, 20 };
+
+int test_nfc_14443b(void)
+{
+	uint8_t data[sizeof(nfcb_lens)][32];
+	uint32_t *w, i, n, k, nb;
+	nfcb_event_t *ev;
+	nfcb_trace_t t;
+
+	w = calloc(NFCB_TRACE_WORDS, sizeof(uint32_t));
+	ev = malloc(NFCB_MAX_EVENTS * sizeof(nfcb_event_t));
+	TEST_ASSERT(w != NULL && ev != NULL);
+	t.w = w;
+	test_srand(14443);
+
+	/* PCD/PICC exchanges, clean then noisy */
+	for(k = 0; k < 400; k++) {
+		t.nb = 0;
+		t.noise = (k < 100) ? 0 : 2 + k % 8;
+		t.pcd_idle = k & 1;
+		for(n = 0; n < sizeof(nfcb_lens); n++) {
+			for(i = 0; i < nfcb_lens[n]; i++)
+				data[n][i] = test_rand();
+			trace_frame(&t, n & 1, data[n], nfcb_lens[n]);
+		}
+		trace_noise(&t);
+		nb = nfcb_decode(w, t.nb / 32, ev);
+		for(i = 0, n = 0; n < sizeof(nfcb_lens); n++) {
+			if(nfcb_check(ev, nb, &i,
+				      (n & 1) ? SNIFF_14443B_PICC : SNIFF_14443B_PCD,
+				      data[n], nfcb_lens[n]))
+				return 1;
+		}
+		TEST_ASSERT(i == nb);
+	}
+
+	/* PICC subcarrier lost in a frame */
+	t.nb = 0;
+	t.noise = 0;
+	data[0][0] = 0x50;
+	data[0][1] = 0x12;
+	trace_frame(&t, true, data[0], 0);
+	trace_picc(&t, 0, 1);
+	for(i = 0; i < 8; i++)
+		trace_picc(&t, (data[0][0] >> i) & 1, 1);
+	trace_picc(&t, 1, 1);
+	trace_picc(&t, 0, 4);
+	trace_off(&t, 10 * 32);
+	nb = nfcb_decode(w, t.nb / 32, ev);
+	TEST_ASSERT(nb == 3);
+	TEST_ASSERT(ev[0].ev == SNIFF_14443B_SOF && ev[0].dir == SNIFF_14443B_PICC);
+	TEST_ASSERT(ev[1].ev == SNIFF_14443B_BYTE && ev[1].byte == 0x50);
+	TEST_ASSERT(ev[2].ev == SNIFF_14443B_ERROR);
+
+	/* PCD character without stop bit */
+	t.nb = 0;
+	t.pcd_idle = 1;
+	trace_frame(&t, false, data[0], 0);
+	trace_pcd(&t, 0, 1);
+	for(i = 0; i < 8; i++)
+		trace_pcd(&t, (data[0][1] >> i) & 1, 1);
+	trace_pcd(&t, 0, 1);
+	trace_pcd(&t, 1, 20);
+	/* The next frame is decoded */
+	trace_frame(&t, false, data[1], 4);
+	nb = nfcb_decode(w, t.nb / 32, ev);
+	TEST_ASSERT(nb == 8);
+	TEST_ASSERT(ev[0].ev == SNIFF_14443B_SOF && ev[0].dir == SNIFF_14443B_PCD);
+	TEST_ASSERT(ev[1].ev == SNIFF_14443B_ERROR);
+	i = 2;
+	if(nfcb_check(ev, nb, &i, SNIFF_14443B_PCD, data[1], 4))
+		return 1;
+
+	/* Idle words only */
+	memset(w, 0, NFCB_TRACE_WORDS * sizeof(uint32_t));
+	TEST_ASSERT(nfcb_decode(w, NFCB_TRACE_WORDS, ev) == 0);
+	memset(w, 0xFF, NFCB_TRACE_WORDS * sizeof(uint32_t));
+	TEST_ASSERT(nfcb_decode(w, NFCB_TRACE_WORDS, ev) == 0);
+
+	free(w);
+	free(ev);
+	return 0;
+}
@@ -0,0 +1,264 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Text and binary record encoders of the NFC sniffer
+ * (hydranfc_sniff_text.h, hydranfc_sniff_record.h): exact text output,
+ * records decoded back to the sniffed frames, and the output size and
+ * time per frame of both encoders.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "test.h"
+#include "hydranfc_sniff_text.h"
+#include "hydranfc_sniff_record.h"
+
+/* Copy of the table of hydranfc_cmd_sniff.c, which is not built on the host */
+uint8_t htoa[16] = {'0','1','2','3','4','5','6','7','8','9','a','b','c','d','e','f'};
+
+#define ENC_BUF_SIZE	(0x10000)
+#define ENC_PARITY_SIZE	(2048)
+
+typedef struct {
+	uint8_t type;		/* SNIFF_RECORD_xxx */
+	uint8_t sample;
+	uint32_t timestamp;
+	uint32_t duration;	/* 0 without end of frame */
+	uint32_t len;
+	uint8_t data[64];
+	uint8_t parity[64];
+} enc_frame_t;
+
+static uint32_t get_u32(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/* Encodes a frame as the ISO14443A sniffer loop does, see hydranfc_cmd_sniff.c */
+static uint32_t enc_text(uint8_t *buf, uint32_t i, const enc_frame_t *f)
+{
+	uint32_t n;
+
+	switch(f->type) {
+	case SNIFF_RECORD_PCD:
+		i = sniff_text_start(buf, i, f->timestamp, 'R', 'D', 'R');
+		break;
+	case SNIFF_RECORD_PICC:
+		i = sniff_text_start(buf, i, f->timestamp, 'T', 'A', 'G');
+		break;
+	default:
+		i = sniff_text_start(buf, i, f->timestamp, 'U',
+				     htoa[f->sample >> 4], htoa[f->sample & 0x0F]);
+		break;
+	}
+	for(n = 0; n < f->len; n++)
+		i = sniff_text_8b(buf, i, f->data[n], true);
+	if(f->duration)
+		i = sniff_text_duration(buf, i, f->duration);
+	return i;
+}
+
+static uint32_t enc_record(sniff_record_t *r, uint8_t *buf, uint32_t i,
+			   uint32_t capacity, const enc_frame_t *f)
+{
+	uint32_t n;
+
+	i = sniff_record_start(r, buf, i, f->type, f->sample, f->timestamp);
+	for(n = 0; n < f->len; n++)
+		i = sniff_record_byte(r, buf, i, f->data[n], f->parity[n]);
+	return sniff_record_end(r, buf, i, capacity, f->duration != 0, f->duration);
+}
+
+/* Checks the record at buf[*i] against f, as contrib/nfc_sniff_record reads it */
+static int check_record(const uint8_t *buf, uint32_t *i, const enc_frame_t *f)
+{
+	const uint8_t *p = &buf[*i];
+	uint32_t n, len, pad;
+
+	TEST_ASSERT((*i & 3) == 0);
+	len = p[2] | (p[3] << 8);
+	TEST_ASSERT(p[0] == f->type);
+	TEST_ASSERT(p[1] == (SNIFF_RECORD_FLAG_PARITY |
+			     (f->duration ? SNIFF_RECORD_FLAG_DURATION : 0)));
+	TEST_ASSERT(len == f->len);
+	TEST_ASSERT(get_u32(&p[4]) == f->timestamp);
+	TEST_ASSERT(get_u32(&p[8]) == f->duration);
+	TEST_ASSERT(p[12] == f->sample);
+	p += SNIFF_RECORD_HDR_SIZE;
+	TEST_ASSERT(!memcmp(p, f->data, len));
+	pad = (4 - (len & 3)) & 3;
+	for(n = 0; n < pad; n++)
+		TEST_ASSERT(p[len + n] == 0);
+	p += len + pad;
+	for(n = 0; n < len; n++)
+		TEST_ASSERT(((p[n / 8] >> (n % 8)) & 1) == f->parity[n]);
+	len = (len + 7) / 8;
+	pad = (4 - (len & 3)) & 3;
+	for(n = 0; n < pad; n++)
+		TEST_ASSERT(p[len + n] == 0);
+	p += len + pad;
+	*i = p - buf;
+	return 0;
+}
+
+static void rand_frame(enc_frame_t *f, uint32_t len)
+{
+	uint32_t n;
+
+	f->type = 1 + test_rand() % 3;
+	f->sample = test_rand();
+	f->timestamp = test_rand();
+	f->duration = (test_rand() & 1) ? test_rand() | 1 : 0;
+	f->len = len;
+	for(n = 0; n < len; n++) {
+		f->data[n] = test_rand();
+		f->parity[n] = test_rand() & 1;
+	}
+}
+
+/* REQA then ATQA, the duration of the second frame only */
+static const char text_ref[] =
+	"\r\n0000abcd\tRDR\t26"
+	"\r\n00012345\tTAG\t44 00 \t00000d80"
+	"\r\nfedcba98\tU5a\t";
+
+int test_nfc_encode(void)
+{
+	static enc_frame_t frames[64];
+	enc_frame_t f;
+	sniff_record_t r;
+	uint8_t *buf, parity[ENC_PARITY_SIZE];
+	uint32_t i, n, pos;
+
+	buf = malloc(ENC_BUF_SIZE);
+	TEST_ASSERT(buf != NULL);
+
+	/* Text, the last partial byte has no space */
+	i = sniff_text_start(buf, 0, 0xABCD, 'R', 'D', 'R');
+	i = sniff_text_8b(buf, i, 0x26, false);
+	i = sniff_text_start(buf, i, 0x12345, 'T', 'A', 'G');
+	i = sniff_text_8b(buf, i, 0x44, true);
+	i = sniff_text_8b(buf, i, 0x00, true);
+	i = sniff_text_duration(buf, i, 0xD80);
+	f.type = SNIFF_RECORD_UNKNOWN;
+	f.sample = 0x5A;
+	f.timestamp = 0xFEDCBA98;
+	f.duration = 0;
+	f.len = 0;
+	i = enc_text(buf, i, &f);
+	TEST_ASSERT(i == sizeof(text_ref) - 1);
+	TEST_ASSERT(!memcmp(buf, text_ref, i));
+
+	/* Records of 0 to 63 bytes, decoded back */
+	test_srand(1);
+	memset(buf, 0xEE, ENC_BUF_SIZE);
+	r.parity = parity;
+	r.parity_size = sizeof(parity);
+	i = sniff_record_file_header(buf, 0);
+	TEST_ASSERT(i == SNIFF_RECORD_FILE_HDR_SIZE);
+	TEST_ASSERT(!memcmp(buf, "HNFR", 4));
+	TEST_ASSERT(buf[4] == SNIFF_RECORD_VERSION && get_u32(buf) == SNIFF_RECORD_MAGIC);
+	for(n = 0; n < 64; n++) {
+		rand_frame(&frames[n], n);
+		i = enc_record(&r, buf, i, ENC_BUF_SIZE, &frames[n]);
+	}
+	pos = SNIFF_RECORD_FILE_HDR_SIZE;
+	for(n = 0; n < 64; n++) {
+		if(check_record(buf, &pos, &frames[n]))
+			return 1;
+	}
+	TEST_ASSERT(pos == i);
+
+	/*
+	 * The parity bits (2 bytes after 32) shall fit with the 3 bytes
+	 * margin, else capacity is returned and the caller drops the record.
+	 */
+	rand_frame(&f, 16);
+	TEST_ASSERT(enc_record(&r, buf, 0, 37, &f) == 37);
+	TEST_ASSERT(enc_record(&r, buf, 0, 38, &f) == SNIFF_RECORD_HDR_SIZE + 16 + 4);
+
+	/* Parity bits beyond the parity buffer are not recorded */
+	r.parity_size = 4;
+	rand_frame(&f, 40);
+	i = enc_record(&r, buf, 0, ENC_BUF_SIZE, &f);
+	TEST_ASSERT(i == SNIFF_RECORD_HDR_SIZE + 40);
+	TEST_ASSERT(buf[1] == 0 || buf[1] == SNIFF_RECORD_FLAG_DURATION);
+
+	free(buf);
+	return 0;
+}
+
+/*
+ * A capture of ISO14443A frames: REQA, ATQA, anticollision, SELECT, SAK
+ * and READ/data exchanges of a MIFARE Ultralight.
+ */
+static const uint8_t bench_lens[] = { 1, 2, 2, 5, 9, 3, 4, 18, 4, 18, 4, 18 };
+
+static int bench_nfc_encode_one(const char *name, bool record)
+{
+	enc_frame_t frames[sizeof(bench_lens)];
+	sniff_record_t r;
+	uint8_t *buf, parity[ENC_PARITY_SIZE];
+	uint32_t i, n, k, nb = 200000, nb_frames = 0;
+	uint64_t t, bytes = 0;
+
+	buf = malloc(ENC_BUF_SIZE);
+	TEST_ASSERT(buf != NULL);
+	test_srand(1);
+	for(n = 0; n < sizeof(bench_lens); n++) {
+		rand_frame(&frames[n], bench_lens[n]);
+		frames[n].type = (n & 1) ? SNIFF_RECORD_PICC : SNIFF_RECORD_PCD;
+		frames[n].duration = 1000 + n;
+	}
+	r.parity = parity;
+	r.parity_size = sizeof(parity);
+
+	t = test_time_ns();
+	for(k = 0; k < nb; k++) {
+		i = 0;
+		for(n = 0; n < sizeof(bench_lens); n++) {
+			if(record)
+				i = enc_record(&r, buf, i, ENC_BUF_SIZE, &frames[n]);
+			else
+				i = enc_text(buf, i, &frames[n]);
+		}
+		bytes += i;
+		nb_frames += n;
+		/* Keep the output alive */
+		buf[k & 0xFF] ^= buf[i - 1];
+	}
+	t = test_time_ns() - t;
+
+	bench_report(name, t, nb_frames, "frame");
+	printf("  %.1f bytes/frame\n", (double)bytes / nb_frames);
+	free(buf);
+	return 0;
+}
+
+/*
+ * Output size and host time per frame of the sniffer encoders, the same
+ * frames in the text and the record formats.
+ */
+int bench_nfc_encode(void)
+{
+	if(bench_nfc_encode_one("text", false))
+		return 1;
+	return bench_nfc_encode_one("record", true);
+}
@@ -0,0 +1,578 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * pcapng files of the sniffers: a reader checks the blocks as Wireshark
+ * would (block lengths, options, padding, interface ids, monotonic
+ * timestamps) on the output of the buffered writer and of the SPI, I2C
+ * and CAN encoders, and the packets are compared to what was sent.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "test.h"
+#include "pcapng.h"
+#include "hydrabus_spi_sniff.h"
+#include "hydrabus_i2c_sniff.h"
+#include "hydrabus_can_ring.h"
+
+#define PCAP_MAX_IF		(8)
+#define PCAP_MAX_PACKETS	(1024)
+#define PCAP_FILE_SIZE		(0x40000)
+
+#define PCAP_TS_FREQ		(168000000)
+
+typedef struct {
+	uint32_t if_id;
+	uint64_t ts; /* ns */
+	uint32_t len;
+	const uint8_t *data;
+} pcap_packet_t;
+
+typedef struct {
+	uint32_t nb_if;
+	uint16_t linktype[PCAP_MAX_IF];
+	char name[PCAP_MAX_IF][16];
+	uint64_t last_ts[PCAP_MAX_IF];
+	uint32_t nb_packets;
+	pcap_packet_t packets[PCAP_MAX_PACKETS];
+} pcap_file_t;
+
+/* Link types and names of pcapng.c */
+static const struct {
+	uint16_t linktype;
+	const char *name;
+} pcap_links[PCAPNG_LINK_END] = {
+	[PCAPNG_LINK_ISO14443A] = { 147, "iso14443a" },
+	[PCAPNG_LINK_ISO14443B] = { 147, "iso14443b" },
+	[PCAPNG_LINK_CAN] = { 227, "can" },
+	[PCAPNG_LINK_SPI] = { 148, "spi" },
+	[PCAPNG_LINK_I2C] = { 209, "i2c" },
+	[PCAPNG_LINK_UART] = { 149, "uart" },
+};
+
+/* File written by the pcapng writer callback */
+typedef struct {
+	uint8_t *buf;
+	uint32_t size;
+	uint32_t len;
+	uint32_t writes;
+	uint32_t partial; /* Writes which are not whole chunks */
+	bool fail;
+} mem_file_t;
+
+static pcap_file_t pcap;
+
+static uint16_t get16(const uint8_t *p)
+{
+	uint16_t val;
+
+	memcpy(&val, p, sizeof(val));
+	return val;
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+	uint32_t val;
+
+	memcpy(&val, p, sizeof(val));
+	return val;
+}
+
+static bool mem_write(void *ctx, const uint8_t *data, uint32_t size)
+{
+	mem_file_t *f = (mem_file_t *)ctx;
+
+	if(f->fail || f->len + size > f->size)
+		return false;
+	if(size % PCAPNG_CHUNK_SIZE)
+		f->partial++;
+	memcpy(f->buf + f->len, data, size);
+	f->len += size;
+	f->writes++;
+	return true;
+}
+
+static void mem_init(mem_file_t *f, uint8_t *buf, uint32_t size)
+{
+	memset(f, 0, sizeof(*f));
+	f->buf = buf;
+	f->size = size;
+}
+
+static int pad_is_zero(const uint8_t *p, uint32_t len)
+{
+	uint32_t i;
+
+	for(i = len; i < ((len + 3) & ~3); i++) {
+		if(p[i] != 0)
+			return 0;
+	}
+	return 1;
+}
+
+static int pcap_parse_idb(pcap_file_t *pf, const uint8_t *p, uint32_t len)
+{
+	uint32_t i, n, code, opt_len;
+	uint16_t linktype;
+	bool name = false, tsresol = false;
+
+	TEST_ASSERT(pf->nb_if < PCAP_MAX_IF);
+	TEST_ASSERT(len >= 20 && len <= PCAPNG_IDB_SIZE_MAX);
+	linktype = get16(p + 8);
+	for(n = 0; n < PCAPNG_LINK_END; n++) {
+		if(pcap_links[n].linktype == linktype)
+			break;
+	}
+	TEST_ASSERT(n < PCAPNG_LINK_END);
+	TEST_ASSERT(get16(p + 10) == 0);
+	TEST_ASSERT(get32(p + 12) == 0xFFFF); /* snaplen */
+
+	/* Options up to opt_endofopt, which ends the block */
+	i = 16;
+	while(1) {
+		TEST_ASSERT(i + 4 <= len - 4);
+		code = get16(p + i);
+		opt_len = get16(p + i + 2);
+		i += 4;
+		if(code == 0) {
+			TEST_ASSERT(opt_len == 0);
+			break;
+		}
+		TEST_ASSERT(i + ((opt_len + 3) & ~3) <= len - 4);
+		TEST_ASSERT(pad_is_zero(p + i, opt_len));
+		if(code == 2) {
+			/* if_name */
+			TEST_ASSERT(!name && opt_len > 0 && opt_len < 16);
+			memcpy(pf->name[pf->nb_if], p + i, opt_len);
+			pf->name[pf->nb_if][opt_len] = 0;
+			name = true;
+		} else {
+			/* if_tsresol, nanoseconds */
+			TEST_ASSERT(code == 9 && !tsresol);
+			TEST_ASSERT(opt_len == 1 && p[i] == 9);
+			tsresol = true;
+		}
+		i += (opt_len + 3) & ~3;
+	}
+	TEST_ASSERT(i == len - 4);
+	TEST_ASSERT(name && tsresol);
+
+	pf->linktype[pf->nb_if] = linktype;
+	pf->last_ts[pf->nb_if] = 0;
+	pf->nb_if++;
+	return 0;
+}
+
+static int pcap_parse_epb(pcap_file_t *pf, const uint8_t *p, uint32_t len)
+{
+	pcap_packet_t *pkt;
+	uint32_t if_id, cap_len;
+	uint64_t ts;
+
+	TEST_ASSERT(len >= PCAPNG_EPB_HDR_SIZE + 4);
+	TEST_ASSERT(pf->nb_packets < PCAP_MAX_PACKETS);
+	if_id = get32(p + 8);
+	TEST_ASSERT(if_id < pf->nb_if);
+	ts = ((uint64_t)get32(p + 12) << 32) | get32(p + 16);
+	cap_len = get32(p + 20);
+	TEST_ASSERT(get32(p + 24) == cap_len);
+	TEST_ASSERT(cap_len <= 0xFFFF);
+	/* No options */
+	TEST_ASSERT(len == PCAPNG_EPB_SIZE(cap_len));
+	TEST_ASSERT(pad_is_zero(p + PCAPNG_EPB_HDR_SIZE, cap_len));
+	TEST_ASSERT(ts >= pf->last_ts[if_id]);
+	pf->last_ts[if_id] = ts;
+
+	pkt = &pf->packets[pf->nb_packets++];
+	pkt->if_id = if_id;
+	pkt->ts = ts;
+	pkt->len = cap_len;
+	pkt->data = p + PCAPNG_EPB_HDR_SIZE;
+	return 0;
+}
+
+/* Reads a whole file, the packets point to buf */
+static int pcap_parse(pcap_file_t *pf, const uint8_t *buf, uint32_t size)
+{
+	const uint8_t *p;
+	uint32_t pos, type, len;
+
+	memset(pf, 0, sizeof(*pf));
+
+	/* Section Header Block, the byte order magic gives the host order */
+	TEST_ASSERT(size >= PCAPNG_SHB_SIZE);
+	TEST_ASSERT(get32(buf) == 0x0A0D0D0A);
+	TEST_ASSERT(get32(buf + 4) == PCAPNG_SHB_SIZE);
+	TEST_ASSERT(get32(buf + 8) == 0x1A2B3C4D);
+	TEST_ASSERT(get16(buf + 12) == 1 && get16(buf + 14) == 0);
+	TEST_ASSERT(get32(buf + 16) == 0xFFFFFFFF && get32(buf + 20) == 0xFFFFFFFF);
+	TEST_ASSERT(get32(buf + 24) == PCAPNG_SHB_SIZE);
+
+	pos = PCAPNG_SHB_SIZE;
+	while(pos < size) {
+		p = buf + pos;
+		TEST_ASSERT(size - pos >= 12);
+		type = get32(p);
+		len = get32(p + 4);
+		TEST_ASSERT((len & 3) == 0 && len >= 12 && len <= size - pos);
+		TEST_ASSERT(get32(p + len - 4) == len);
+		switch(type) {
+		case 1:
+			if(pcap_parse_idb(pf, p, len))
+				return 1;
+			break;
+		case 6:
+			if(pcap_parse_epb(pf, p, len))
+				return 1;
+			break;
+		default:
+			TEST_ASSERT(0);
+		}
+		pos += len;
+	}
+	return 0;
+}
+
+/* Interface and packet n shall be data[len] of link */
+static int pcap_check(pcap_file_t *pf, uint32_t n, pcapng_link_t link,
+		      uint64_t ts, const uint8_t *data, uint32_t len)
+{
+	pcap_packet_t *pkt;
+
+	TEST_ASSERT(n < pf->nb_packets);
+	pkt = &pf->packets[n];
+	TEST_ASSERT(pf->linktype[pkt->if_id] == pcap_links[link].linktype);
+	TEST_ASSERT(!strcmp(pf->name[pkt->if_id], pcap_links[link].name));
+	TEST_ASSERT(pkt->ts == (uint64_t)((unsigned __int128)ts * 1000000000 / PCAP_TS_FREQ));
+	TEST_ASSERT(pkt->len == len);
+	TEST_ASSERT(!memcmp(pkt->data, data, len));
+	return 0;
+}
+
+static int test_pcapng_ts(void)
+{
+	uint64_t last;
+
+	TEST_ASSERT(pcapng_ts_ns(PCAP_TS_FREQ, PCAP_TS_FREQ) == 1000000000);
+	TEST_ASSERT(pcapng_ts_ns(168, PCAP_TS_FREQ) == 1000);
+	TEST_ASSERT(pcapng_ts_ns(1ULL << 40, PCAP_TS_FREQ) == 6544712070095ULL);
+
+	/* Wraps, and stamps slightly older than the last one */
+	last = 0xFFFFFF00;
+	TEST_ASSERT(pcapng_ts_extend(&last, 0x100) == 0x100000100ULL);
+	TEST_ASSERT(pcapng_ts_extend(&last, 0xF0) == 0x1000000F0ULL);
+	TEST_ASSERT(pcapng_ts_extend(&last, 0x80000000) == 0x180000000ULL);
+	TEST_ASSERT(pcapng_ts_extend(&last, 0xFFFFFF00) == 0x1FFFFFF00ULL);
+	TEST_ASSERT(pcapng_ts_extend(&last, 0x10) == 0x200000010ULL);
+	return 0;
+}
+
+#define WR_PACKETS	(500)
+
+/* All the link types through the writer, written in whole chunks */
+static int test_pcapng_writer(uint8_t *file)
+{
+	static uint8_t data[WR_PACKETS][300];
+	static uint32_t lens[WR_PACKETS];
+	static uint8_t links[WR_PACKETS];
+	static uint64_t stamps[WR_PACKETS];
+	uint8_t wbuf[4 * PCAPNG_CHUNK_SIZE];
+	pcapng_writer_t w;
+	mem_file_t f;
+	uint64_t ts = 0xFFFF0000ULL;
+	uint32_t n, i, used = 0;
+
+	test_srand(1);
+	mem_init(&f, file, PCAP_FILE_SIZE);
+	pcapng_writer_init(&w, wbuf, sizeof(wbuf), mem_write, &f, PCAP_TS_FREQ);
+	for(n = 0; n < WR_PACKETS; n++) {
+		links[n] = test_rand() % PCAPNG_LINK_END;
+		lens[n] = test_rand() % 300;
+		for(i = 0; i < lens[n]; i++)
+			data[n][i] = test_rand();
+		stamps[n] = ts;
+		TEST_ASSERT(pcapng_writer_packet(&w, links[n], ts, data[n], lens[n]));
+		ts += test_rand() % 1000000;
+	}
+	TEST_ASSERT(f.writes > 0 && f.partial == 0);
+	TEST_ASSERT(pcapng_writer_flush(&w));
+	TEST_ASSERT(w.packets == WR_PACKETS && w.dropped == 0);
+
+	if(pcap_parse(&pcap, file, f.len))
+		return 1;
+	TEST_ASSERT(pcap.nb_packets == WR_PACKETS);
+	TEST_ASSERT(pcap.nb_if == PCAPNG_LINK_END);
+	for(n = 0; n < WR_PACKETS; n++) {
+		if(pcap_check(&pcap, n, links[n], stamps[n], data[n], lens[n]))
+			return 1;
+		/* Interfaces declared at their first packet */
+		if(pcap.packets[n].if_id == used)
+			used++;
+		TEST_ASSERT(pcap.packets[n].if_id < used);
+	}
+
+	/* Packets which do not fit after writing the chunks are dropped */
+	mem_init(&f, file, PCAP_FILE_SIZE);
+	pcapng_writer_init(&w, wbuf, sizeof(wbuf), mem_write, &f, PCAP_TS_FREQ);
+	TEST_ASSERT(pcapng_writer_packet(&w, PCAPNG_LINK_UART, 0, data[0], 400));
+	TEST_ASSERT(!pcapng_writer_packet(&w, PCAPNG_LINK_UART, 1, file, 1600));
+	TEST_ASSERT(pcapng_writer_packet(&w, PCAPNG_LINK_UART, 2, file, 1400));
+	TEST_ASSERT(w.packets == 2 && w.dropped == 1);
+	TEST_ASSERT(pcapng_writer_flush(&w));
+	if(pcap_parse(&pcap, file, f.len))
+		return 1;
+	TEST_ASSERT(pcap.nb_if == 1 && pcap.nb_packets == 2);
+	TEST_ASSERT(pcap.packets[1].len == 1400);
+
+	/* A write error is reported by the next packets and the flush */
+	mem_init(&f, file, PCAP_FILE_SIZE);
+	f.fail = true;
+	pcapng_writer_init(&w, wbuf, sizeof(wbuf), mem_write, &f, PCAP_TS_FREQ);
+	for(n = 0; n < 20 && pcapng_writer_packet(&w, PCAPNG_LINK_CAN, n, data[0], 200); n++)
+		;
+	TEST_ASSERT(n < 20 && w.error);
+	TEST_ASSERT(!pcapng_writer_flush(&w));
+	return 0;
+}
+
+#define SPI_RING	(1024)
+#define SPI_OUT		(8192)
+#define SPI_XFERS	(5)
+
+typedef struct {
+	uint32_t start;
+	uint32_t nb_mosi;
+	uint32_t nb_miso;
+	bool open;
+} spi_xfer_t;
+
+/*
+ * Transactions across the cycle counter wrap: a long one split in
+ * records which keep its start time, a MOSI/MISO mismatch and one
+ * still open at the end of the capture.
+ */
+static const spi_xfer_t spi_xfers[SPI_XFERS] = {
+	{ 0xFFFFF100, 4, 4, false },
+	{ 0x00000200, 600, 600, false },
+	{ 0x00001000, 3, 5, false },
+	{ 0x00002000, 0, 0, false },
+	{ 0x00003000, 10, 10, true },
+};
+
+static int test_pcapng_spi(uint8_t *file)
+{
+	static uint8_t mosi[SPI_RING], miso[SPI_RING], out[SPI_OUT];
+	static uint8_t pairs[2 * SPI_SNIFF_RECORD_MAX];
+	static spi_sniff_t s;
+	const spi_xfer_t *x;
+	const uint8_t *data;
+	uint32_t n, i, len, nb, done, pkt = 0, size = 0;
+	uint32_t mosi_wr = 0, miso_wr = 0, mosi_rd, miso_rd;
+
+	test_srand(2);
+	spi_sniff_init(&s, SPI_SNIFF_FMT_PCAPNG, mosi, miso, SPI_RING, out, SPI_OUT);
+	s.time = 0xFFFFF000;
+	for(n = 0; n < SPI_XFERS; n++) {
+		x = &spi_xfers[n];
+		spi_sniff_tick(&s, x->start);
+		TEST_ASSERT(spi_sniff_cs_event(&s, x->start, 0, mosi_wr, miso_wr));
+		for(i = 0; i < x->nb_mosi; i++)
+			mosi[mosi_wr++ & (SPI_RING - 1)] = test_rand();
+		for(i = 0; i < x->nb_miso; i++)
+			miso[miso_wr++ & (SPI_RING - 1)] = test_rand();
+		mosi_wr &= SPI_RING - 1;
+		miso_wr &= SPI_RING - 1;
+		if(x->open) {
+			spi_sniff_close(&s, x->start + 1000, mosi_wr, miso_wr);
+		} else {
+			TEST_ASSERT(spi_sniff_cs_event(&s, x->start + 1000, 1, mosi_wr, miso_wr));
+			spi_sniff_process(&s, 0, mosi_wr, miso_wr);
+		}
+		while((len = spi_sniff_out_get(&s, &data)) > 0) {
+			memcpy(file + size, data, len);
+			size += len;
+			spi_sniff_out_consume(&s, len);
+		}
+	}
+	TEST_ASSERT(s.records_lost == 0);
+
+	if(pcap_parse(&pcap, file, size))
+		return 1;
+	TEST_ASSERT(pcap.nb_if == 1);
+
+	/* Replays the rings, the records have SPI_SNIFF_RECORD_MAX pairs at most */
+	mosi_rd = 0;
+	miso_rd = 0;
+	for(n = 0; n < SPI_XFERS; n++) {
+		x = &spi_xfers[n];
+		done = 0;
+		do {
+			nb = ((x->nb_mosi > x->nb_miso) ? x->nb_mosi : x->nb_miso) - done;
+			if(nb > SPI_SNIFF_RECORD_MAX)
+				nb = SPI_SNIFF_RECORD_MAX;
+			for(i = 0; i < nb; i++) {
+				pairs[2 * i] = (done + i < x->nb_mosi) ?
+					       mosi[(mosi_rd + done + i) & (SPI_RING - 1)] : 0;
+				pairs[2 * i + 1] = (done + i < x->nb_miso) ?
+						   miso[(miso_rd + done + i) & (SPI_RING - 1)] : 0;
+			}
+			if(pcap_check(&pcap, pkt++, PCAPNG_LINK_SPI,
+				      (x->start < 0x80000000 ? 0x100000000ULL : 0) + x->start,
+				      pairs, 2 * nb))
+				return 1;
+			done += nb;
+		} while(done < x->nb_mosi || done < x->nb_miso);
+		mosi_rd += x->nb_mosi;
+		miso_rd += x->nb_miso;
+	}
+	TEST_ASSERT(pkt == pcap.nb_packets);
+	return 0;
+}
+
+static void i2c_event(i2c_sniff_linux_t *m, pcapng_writer_t *w,
+		     uint8_t type, uint8_t data, uint32_t timestamp)
+{
+	i2c_sniff_event_t ev;
+
+	ev.type = type;
+	ev.data = data;
+	ev.timestamp = timestamp;
+	i2c_sniff_linux_event(m, &ev, w);
+}
+
+static int test_pcapng_i2c(uint8_t *file)
+{
+	static const uint8_t msg_write[] = { 0, 0, 0, 0, 0, 0xA0, 0x00 };
+	static const uint8_t msg_read[] = { 0, 0, 0, 0, 1, 0xA1, 0x55, 0x66 };
+	static uint8_t msg_long[I2C_LINUX_HDR_SIZE + 1 + I2C_LINUX_MAX_DATA];
+	static i2c_sniff_linux_t m;
+	uint8_t wbuf[4 * PCAPNG_CHUNK_SIZE];
+	pcapng_writer_t w;
+	mem_file_t f;
+	uint32_t i, t;
+
+	mem_init(&f, file, PCAP_FILE_SIZE);
+	pcapng_writer_init(&w, wbuf, sizeof(wbuf), mem_write, &f, PCAP_TS_FREQ);
+	i2c_sniff_linux_init(&m, 0xFFFFFFF0);
+
+	/* Register write then read with a repeated START, across the wrap */
+	i2c_event(&m, &w, I2C_SNIFF_START, 0, 0xFFFFFFF8);
+	i2c_event(&m, &w, I2C_SNIFF_BYTE, 0xA0, 0xFFFFFFFC);
+	i2c_event(&m, &w, I2C_SNIFF_BYTE, 0x00, 0x00000004);
+	i2c_event(&m, &w, I2C_SNIFF_START, 0, 0x00000010);
+	i2c_event(&m, &w, I2C_SNIFF_BYTE, 0xA1, 0x00000020);
+	i2c_event(&m, &w, I2C_SNIFF_BYTE, 0x55, 0x00000030);
+	i2c_event(&m, &w, I2C_SNIFF_BYTE | I2C_SNIFF_FLAG_NACK, 0x66, 0x00000040);
+	i2c_event(&m, &w, I2C_SNIFF_STOP, 0, 0x00000050);
+	/* Byte out of a message, START without address */
+	i2c_event(&m, &w, I2C_SNIFF_BYTE, 0x12, 0x00000060);
+	i2c_event(&m, &w, I2C_SNIFF_START, 0, 0x00000070);
+	i2c_event(&m, &w, I2C_SNIFF_STOP, 0, 0x00000080);
+	/* Events lost in the message, dropped */
+	i2c_event(&m, &w, I2C_SNIFF_START, 0, 0x00000090);
+	i2c_event(&m, &w, I2C_SNIFF_BYTE, 0x50, 0x000000A0);
+	i2c_event(&m, &w, I2C_SNIFF_BYTE | I2C_SNIFF_FLAG_LOST, 0x51, 0x000000B0);
+	i2c_event(&m, &w, I2C_SNIFF_BYTE, 0x52, 0x000000C0);
+	i2c_event(&m, &w, I2C_SNIFF_STOP, 0, 0x000000D0);
+	/* Truncated, after a quiet bus longer than the wrap */
+	for(i = 1; i <= 8; i++)
+		i2c_sniff_linux_tick(&m, i * 0x40000000);
+	t = 0x00001000;
+	i2c_event(&m, &w, I2C_SNIFF_START, 0, t);
+	memset(msg_long, 0, I2C_LINUX_HDR_SIZE);
+	msg_long[I2C_LINUX_HDR_SIZE] = 0xA0;
+	i2c_event(&m, &w, I2C_SNIFF_BYTE, 0xA0, t + 10);
+	for(i = 0; i < I2C_LINUX_MAX_DATA + 44; i++) {
+		if(i < I2C_LINUX_MAX_DATA)
+			msg_long[I2C_LINUX_HDR_SIZE + 1 + i] = i * 7;
+		i2c_event(&m, &w, I2C_SNIFF_BYTE, i * 7, t + 20 + i);
+	}
+	i2c_event(&m, &w, I2C_SNIFF_STOP, 0, t + 1000);
+	TEST_ASSERT(m.messages == 3 && m.truncated == 1);
+	TEST_ASSERT(pcapng_writer_flush(&w));
+
+	if(pcap_parse(&pcap, file, f.len))
+		return 1;
+	TEST_ASSERT(pcap.nb_packets == 3);
+	if(pcap_check(&pcap, 0, PCAPNG_LINK_I2C, 0xFFFFFFF8ULL,
+		      msg_write, sizeof(msg_write)) ||
+	   pcap_check(&pcap, 1, PCAPNG_LINK_I2C, 0x100000010ULL,
+		      msg_read, sizeof(msg_read)) ||
+	   pcap_check(&pcap, 2, PCAPNG_LINK_I2C, 0x300000000ULL + t,
+		      msg_long, sizeof(msg_long)))
+		return 1;
+	return 0;
+}
+
+static int test_pcapng_can(uint8_t *file)
+{
+	static const can_ring_frame_t frames[] = {
+		{ 100, 0x123, 0, 2, 0, { 0xDE, 0xAD } },
+		{ 200, 0x1ABCDEF0, CAN_RING_FLAG_EXT | CAN_RING_FLAG_FIFO1, 8, 3,
+		  { 1, 2, 3, 4, 5, 6, 7, 8 } },
+		{ 300, 0x7FF, CAN_RING_FLAG_RTR, 4, 0, { 9, 9, 9, 9 } },
+	};
+	static const uint8_t ref[][CAN_SOCKETCAN_LEN] = {
+		{ 0x00, 0x00, 0x01, 0x23, 2, 0, 0, 0, 0xDE, 0xAD, 0, 0, 0, 0, 0, 0 },
+		{ 0x9A, 0xBC, 0xDE, 0xF0, 8, 0, 0, 0, 1, 2, 3, 4, 5, 6, 7, 8 },
+		{ 0x40, 0x00, 0x07, 0xFF, 4, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+	};
+	uint8_t wbuf[4 * PCAPNG_CHUNK_SIZE], packet[CAN_SOCKETCAN_LEN];
+	pcapng_writer_t w;
+	mem_file_t f;
+	uint32_t n;
+
+	mem_init(&f, file, PCAP_FILE_SIZE);
+	pcapng_writer_init(&w, wbuf, sizeof(wbuf), mem_write, &f, PCAP_TS_FREQ);
+	for(n = 0; n < 3; n++) {
+		TEST_ASSERT(can_socketcan_format(packet, &frames[n]) == CAN_SOCKETCAN_LEN);
+		TEST_ASSERT(pcapng_writer_packet(&w, PCAPNG_LINK_CAN, frames[n].timestamp,
+						 packet, sizeof(packet)));
+	}
+	TEST_ASSERT(pcapng_writer_flush(&w));
+
+	if(pcap_parse(&pcap, file, f.len))
+		return 1;
+	TEST_ASSERT(pcap.nb_packets == 3);
+	for(n = 0; n < 3; n++) {
+		if(pcap_check(&pcap, n, PCAPNG_LINK_CAN, frames[n].timestamp,
+			      ref[n], CAN_SOCKETCAN_LEN))
+			return 1;
+	}
+	return 0;
+}
+
+int test_pcapng(void)
+{
+	uint8_t *file;
+	int ret;
+
+	file = malloc(PCAP_FILE_SIZE);
+	TEST_ASSERT(file != NULL);
+
+	ret = test_pcapng_ts() ||
+	      test_pcapng_writer(file) ||
+	      test_pcapng_spi(file) ||
+	      test_pcapng_i2c(file) ||
+	      test_pcapng_can(file);
+
+	free(file);
+	return ret;
+}
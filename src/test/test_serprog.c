@@ -0,0 +1,310 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Serprog mode (hydrabus_serprog.c) replaying a flashrom session on a
+ * simulated console and SPI flash.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "test.h"
+#include "sim_console.h"
+#include "sim_spi_flash.h"
+#include "hydrabus_serprog.h"
+
+#define SERPROG_FLASH_SIZE	(1024 * 1024)
+#define SERPROG_READ_ADDR	(0x012345)
+#define SERPROG_READ_LEN	(0x10000)
+#define SERPROG_PP_ADDR		(0x021080)
+#define SERPROG_PP_LEN		(32)
+
+static const uint8_t serprog_jedec_id[] = { 0xEF, 0x40, 0x14 };
+
+typedef struct {
+	uint8_t *buf;
+	uint32_t len;
+} serprog_buf_t;
+
+static void buf_put(serprog_buf_t *b, const void *data, uint32_t len)
+{
+	memcpy(&b->buf[b->len], data, len);
+	b->len += len;
+}
+
+static void buf_put_le(serprog_buf_t *b, uint32_t val, uint32_t len)
+{
+	uint32_t i;
+
+	for(i = 0; i < len; i++)
+		b->buf[b->len++] = (val >> (8 * i)) & 0xFF;
+}
+
+/* O_SPIOP command of tx_len bytes (from tx), reading rx_len bytes */
+static void put_spiop(serprog_buf_t *b, const uint8_t *tx, uint32_t tx_len,
+		      uint32_t rx_len)
+{
+	b->buf[b->len++] = S_CMD_O_SPIOP;
+	buf_put_le(b, tx_len, 3);
+	buf_put_le(b, rx_len, 3);
+	buf_put(b, tx, tx_len);
+}
+
+static void put_spiop_addr(serprog_buf_t *b, uint8_t cmd, uint32_t addr,
+			   uint32_t rx_len)
+{
+	uint8_t tx[4];
+
+	tx[0] = cmd;
+	tx[1] = addr >> 16;
+	tx[2] = addr >> 8;
+	tx[3] = addr;
+	put_spiop(b, tx, 4, rx_len);
+}
+
+/*
+ * Streamed read failing after fail_bytes SPI bytes (the 4 command bytes
+ * included), then a RDID. The whole chunks read before the error are sent,
+ * NAK instead of ACK when the first chunk fails.
+ */
+static int test_serprog_error(uint32_t fail_bytes)
+{
+	t_hydra_console con;
+	t_mode_config mode;
+	sim_chn_t chn;
+	sim_spi_flash_t flash;
+	serprog_buf_t in, exp;
+	uint8_t *mem, *out, tx = 0x9F;
+	uint32_t i, nb;
+
+	mem = malloc(SERPROG_FLASH_SIZE);
+	in.buf = malloc(0x100);
+	exp.buf = malloc(0x20000);
+	out = malloc(0x20000);
+	TEST_ASSERT(mem != NULL && in.buf != NULL && exp.buf != NULL && out != NULL);
+	in.len = 0;
+	exp.len = 0;
+	for(i = 0; i < SERPROG_FLASH_SIZE; i++)
+		mem[i] = sim_spi_flash_byte(i);
+
+	buf_put(&in, "\x15\x01", 2);
+	buf_put(&exp, "\x06", 1);
+	put_spiop_addr(&in, 0x03, SERPROG_READ_ADDR, SERPROG_READ_LEN);
+	nb = (fail_bytes - 4) / SERPROG_CHUNK_SIZE * SERPROG_CHUNK_SIZE;
+	if(nb == 0) {
+		buf_put(&exp, "\x15", 1);
+	} else {
+		buf_put(&exp, "\x06", 1);
+		buf_put(&exp, &mem[SERPROG_READ_ADDR], nb);
+	}
+	put_spiop(&in, &tx, 1, 3);
+	buf_put(&exp, "\x06", 1);
+	buf_put(&exp, serprog_jedec_id, 3);
+
+	pool_init();
+	sim_chn_init(&chn, in.buf, in.len, out, 0x20000);
+	sim_console_init(&con, &mode, &chn);
+	sim_spi_flash_init(&flash, serprog_jedec_id, SERPROG_FLASH_SIZE, mem);
+	sim_spi_attach(BSP_DEV_SPI2, &flash.dev);
+	sim_spi_state[BSP_DEV_SPI2].fail_bytes = fail_bytes;
+
+	bbio_mode_serprog(&con);
+
+	sim_spi_attach(BSP_DEV_SPI2, NULL);
+	TEST_ASSERT(chn.in_pos == in.len);
+	TEST_ASSERT(chn.out_len == exp.len);
+	TEST_ASSERT(!memcmp(out, exp.buf, exp.len));
+
+	free(mem);
+	free(in.buf);
+	free(exp.buf);
+	free(out);
+	return 0;
+}
+
+int test_serprog(void)
+{
+	t_hydra_console con;
+	t_mode_config mode;
+	sim_chn_t chn;
+	sim_spi_flash_t flash;
+	pool_stats_t stats;
+	serprog_buf_t in, exp;
+	uint8_t *mem, *out, tx[4 + SERPROG_PP_LEN];
+	uint32_t i;
+
+	mem = malloc(SERPROG_FLASH_SIZE);
+	in.buf = malloc(0x1000);
+	exp.buf = malloc(0x20000);
+	out = malloc(0x20000);
+	TEST_ASSERT(mem != NULL && in.buf != NULL && exp.buf != NULL && out != NULL);
+	in.len = 0;
+	exp.len = 0;
+	for(i = 0; i < SERPROG_FLASH_SIZE; i++)
+		mem[i] = sim_spi_flash_byte(i);
+
+	/* Probe and setup */
+	buf_put(&in, "\x00\x01", 2);
+	buf_put(&exp, "\x06\x01\x00", 3);
+	buf_put(&in, "\x10", 1);
+	buf_put(&exp, "\x15\x06", 2);
+	buf_put(&in, "\x05\x12\x08", 3);
+	buf_put(&exp, "\x06\x08\x06", 3);
+	buf_put(&in, "\x08\x11", 2);
+	buf_put(&exp, "\x06\x00\x10\x00\x06\x00\x00\x01", 8);
+	buf_put(&in, "\x03", 1);
+	buf_put(&exp, "\x06" "Hydrabus\0\0\0\0\0\0\0\0", 17);
+	/* 20MHz selects 10.5MHz, the fastest SPI2 speed below */
+	buf_put(&in, "\x14", 1);
+	buf_put_le(&in, 20000000, 4);
+	buf_put(&exp, "\x06", 1);
+	buf_put_le(&exp, 10500000, 4);
+	buf_put(&in, "\x15\x01", 2);
+	buf_put(&exp, "\x06", 1);
+
+	/* RDID */
+	tx[0] = 0x9F;
+	put_spiop(&in, tx, 1, 3);
+	buf_put(&exp, "\x06", 1);
+	buf_put(&exp, serprog_jedec_id, 3);
+	/* More than WRNMAXLEN bytes to write is rejected */
+	put_spiop(&in, tx, 0, 0);
+	in.buf[in.len - 6] = 0x01;
+	in.buf[in.len - 5] = 0x10;
+	buf_put(&exp, "\x15", 1);
+
+	/* Streamed read of 64KB, not aligned */
+	put_spiop_addr(&in, 0x03, SERPROG_READ_ADDR, SERPROG_READ_LEN);
+	buf_put(&exp, "\x06", 1);
+	buf_put(&exp, &mem[SERPROG_READ_ADDR], SERPROG_READ_LEN);
+
+	/* Sector erase, page program and read back */
+	tx[0] = 0x06;
+	put_spiop(&in, tx, 1, 0);
+	buf_put(&exp, "\x06", 1);
+	put_spiop_addr(&in, 0x20, SERPROG_PP_ADDR, 0);
+	buf_put(&exp, "\x06", 1);
+	tx[0] = 0x05;
+	put_spiop(&in, tx, 1, 1);
+	buf_put(&exp, "\x06\x00", 2);
+	tx[0] = 0x06;
+	put_spiop(&in, tx, 1, 0);
+	buf_put(&exp, "\x06", 1);
+	tx[0] = 0x02;
+	tx[1] = (SERPROG_PP_ADDR >> 16) & 0xFF;
+	tx[2] = (SERPROG_PP_ADDR >> 8) & 0xFF;
+	tx[3] = SERPROG_PP_ADDR & 0xFF;
+	for(i = 0; i < SERPROG_PP_LEN; i++)
+		tx[4 + i] = i * 7;
+	put_spiop(&in, tx, 4 + SERPROG_PP_LEN, 0);
+	buf_put(&exp, "\x06", 1);
+	put_spiop_addr(&in, 0x03, SERPROG_PP_ADDR - 4, SERPROG_PP_LEN + 8);
+	buf_put(&exp, "\x06\xFF\xFF\xFF\xFF", 5);
+	buf_put(&exp, &tx[4], SERPROG_PP_LEN);
+	buf_put(&exp, "\xFF\xFF\xFF\xFF", 4);
+
+	pool_init();
+	sim_chn_init(&chn, in.buf, in.len, out, 0x20000);
+	sim_console_init(&con, &mode, &chn);
+	sim_spi_flash_init(&flash, serprog_jedec_id, SERPROG_FLASH_SIZE, mem);
+	sim_spi_attach(BSP_DEV_SPI2, &flash.dev);
+
+	bbio_mode_serprog(&con);
+
+	sim_spi_attach(BSP_DEV_SPI2, NULL);
+	TEST_ASSERT(chn.in_pos == in.len);
+	TEST_ASSERT(chn.out_len == exp.len);
+	TEST_ASSERT(!memcmp(out, exp.buf, exp.len));
+	TEST_ASSERT(flash.errors == 0);
+	TEST_ASSERT(flash.nb_erase == 1 && flash.nb_program == 1);
+	TEST_ASSERT(flash.nb_read == SERPROG_READ_LEN + SERPROG_PP_LEN + 8);
+	TEST_ASSERT(mode.proto.config.spi.dev_speed == 6);
+	TEST_ASSERT(!sim_spi_state[BSP_DEV_SPI2].init);
+	pool_stats(POOL_RAM, &stats);
+	TEST_ASSERT(stats.blocks_used == 0);
+
+	free(mem);
+	free(in.buf);
+	free(exp.buf);
+	free(out);
+
+	/* SPI errors during streamed reads */
+	if(test_serprog_error(4 + 3 * SERPROG_CHUNK_SIZE + 100))
+		return 1;
+	if(test_serprog_error(4 + 100))
+		return 1;
+	return 0;
+}
+
+/*
+ * Firmware overhead of serprog reads, the simulated flash answers
+ * immediately: 64KB streamed reads (flashrom read) and 1 byte status
+ * reads (flashrom polling WIP during erases and writes).
+ */
+static int bench_serprog_spiop(const char *name, uint8_t cmd, uint32_t rx_len,
+			       uint32_t nb)
+{
+	t_hydra_console con;
+	t_mode_config mode;
+	sim_chn_t chn;
+	sim_spi_flash_t flash;
+	serprog_buf_t in;
+	uint32_t i;
+	uint64_t t;
+
+	in.buf = malloc(2 + nb * 11);
+	TEST_ASSERT(in.buf != NULL);
+	in.len = 0;
+	/* Enable the SPI, as flashrom does */
+	buf_put(&in, "\x15\x01", 2);
+	for(i = 0; i < nb; i++) {
+		if(cmd == 0x03)
+			put_spiop_addr(&in, cmd, (i * rx_len) & 0xFFFFFF, rx_len);
+		else
+			put_spiop(&in, &cmd, 1, rx_len);
+	}
+
+	pool_init();
+	sim_chn_init(&chn, in.buf, in.len, NULL, 0);
+	sim_console_init(&con, &mode, &chn);
+	sim_spi_flash_init(&flash, serprog_jedec_id, 16 * 1024 * 1024, NULL);
+	sim_spi_attach(BSP_DEV_SPI2, &flash.dev);
+
+	t = test_time_ns();
+	bbio_mode_serprog(&con);
+	t = test_time_ns() - t;
+
+	sim_spi_attach(BSP_DEV_SPI2, NULL);
+	free(in.buf);
+	TEST_ASSERT(chn.out_total == 1 + (uint64_t)nb * (rx_len + 1));
+	TEST_ASSERT(flash.errors == 0);
+	TEST_ASSERT(flash.nb_cmd == nb);
+	if(rx_len > 1)
+		bench_report(name, t, (uint64_t)nb * rx_len, "B");
+	else
+		bench_report(name, t, nb, "op");
+	return 0;
+}
+
+int bench_serprog(void)
+{
+	if(bench_serprog_spiop("spiop read 64KB", 0x03, SERPROG_READ_LEN, 512))
+		return 1;
+	return bench_serprog_spiop("spiop status", 0x05, 1, 200000);
+}
@@ -0,0 +1,183 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * SPI flash dump (hydrabus_spi_flash.c) from a simulated SPI flash to a
+ * simulated SD card file.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "test.h"
+#include "sim_console.h"
+#include "sim_file.h"
+#include "sim_spi_flash.h"
+#include "crc32.h"
+#include "sha256.h"
+#include "hydrabus_spi_flash.h"
+
+typedef struct {
+	uint8_t jedec_id[3];
+	uint32_t size;
+} spi_flash_id_t;
+
+static const spi_flash_id_t spi_flash_ids[] = {
+	{ { 0xEF, 0x40, 0x14 }, 1UL << 20 },	/* W25Q80 */
+	{ { 0xEF, 0x40, 0x18 }, 1UL << 24 },	/* W25Q128 */
+	{ { 0x01, 0x02, 0x19 }, 1UL << 25 },	/* S25FL256S */
+	{ { 0x01, 0x02, 0x20 }, 1UL << 26 },	/* S25FL512S */
+	{ { 0x20, 0xBA, 0x21 }, 1UL << 27 },	/* N25Q00AA */
+	{ { 0x20, 0xBA, 0x22 }, 1UL << 28 },	/* MT25QL02G */
+	{ { 0xC2, 0x25, 0x39 }, 1UL << 25 },	/* MX25U25635F */
+	{ { 0xC2, 0x25, 0x3C }, 1UL << 28 },	/* MX66U2G45G */
+	{ { 0xC2, 0x20, 0x1F }, 1UL << 31 },
+	{ { 0xEF, 0x40, 0x0F }, 0 },
+	{ { 0x01, 0x02, 0x23 }, 0 },
+	{ { 0xC2, 0x25, 0x38 }, 0 },
+	{ { 0x00, 0x40, 0x18 }, 0 },
+	{ { 0xFF, 0xFF, 0xFF }, 0 },
+};
+
+/* Reference CRC-32 and SHA-256 of the content of the simulated flash */
+static void spi_flash_ref(uint32_t size, uint32_t *crc, char *sha_hex)
+{
+	uint8_t buf[4096], digest[SHA256_DIGEST_SIZE];
+	sha256_ctx_t sha;
+	uint32_t addr, i;
+
+	*crc = CRC32_INIT;
+	sha256_init(&sha);
+	for(addr = 0; addr < size; addr += sizeof(buf)) {
+		for(i = 0; i < sizeof(buf); i++)
+			buf[i] = sim_spi_flash_byte(addr + i);
+		*crc = crc32_update(*crc, buf, sizeof(buf));
+		sha256_update(&sha, buf, sizeof(buf));
+	}
+	sha256_final(&sha, digest);
+	for(i = 0; i < SHA256_DIGEST_SIZE; i++)
+		sprintf(&sha_hex[2 * i], "%02x", digest[i]);
+}
+
+/*
+ * Dump a simulated flash, the output of the command is returned in out.
+ * Returns the result of spi_flash_dump().
+ */
+static bool spi_flash_run(sim_spi_flash_t *flash, const uint8_t *jedec_id,
+			  uint32_t size, char *out, uint32_t out_size)
+{
+	t_hydra_console con;
+	t_mode_config mode;
+	sim_chn_t chn;
+	bool ret;
+
+	memset(out, 0, out_size);
+	sim_chn_init(&chn, NULL, 0, (uint8_t *)out, out_size - 1);
+	sim_console_init(&con, &mode, &chn);
+	mode.proto.dev_num = BSP_DEV_SPI1;
+	mode.proto.config.spi.dev_speed = 7;
+	sim_spi_flash_init(flash, jedec_id, size, NULL);
+	sim_spi_attach(BSP_DEV_SPI1, &flash->dev);
+	bsp_spi_init(BSP_DEV_SPI1, &mode.proto);
+
+	ret = spi_flash_dump(&con, "0:dump.bin");
+
+	bsp_spi_deinit(BSP_DEV_SPI1);
+	sim_spi_attach(BSP_DEV_SPI1, NULL);
+	return ret;
+}
+
+/* Dump of a known flash, checked against the reference */
+static int spi_flash_check_dump(const uint8_t *jedec_id, uint32_t size,
+				uint8_t read_cmd)
+{
+	sim_spi_flash_t flash;
+	pool_stats_t stats;
+	char out[1024], line[128], sha_hex[2 * SHA256_DIGEST_SIZE + 1];
+	uint32_t crc;
+
+	pool_init();
+	sim_file_reset();
+	TEST_ASSERT(spi_flash_run(&flash, jedec_id, size, out, sizeof(out)));
+
+	spi_flash_ref(size, &crc, sha_hex);
+	TEST_ASSERT(!strcmp(sim_file.name, "0:dump.bin"));
+	TEST_ASSERT(!sim_file.open);
+	TEST_ASSERT(sim_file.len == size);
+	TEST_ASSERT(sim_file.crc == crc);
+	/* One read command for the whole chip */
+	TEST_ASSERT(flash.nb_cmd == 2 && flash.cmd == read_cmd);
+	TEST_ASSERT(flash.nb_read == size && flash.errors == 0);
+
+	sprintf(line, "Size: %u KiB\r\n", (unsigned int)(size / 1024));
+	TEST_ASSERT(strstr(out, line) != NULL);
+	sprintf(line, "CRC32: %08X\r\n", (unsigned int)crc);
+	TEST_ASSERT(strstr(out, line) != NULL);
+	sprintf(line, "SHA-256: %s\r\n", sha_hex);
+	TEST_ASSERT(strstr(out, line) != NULL);
+	pool_stats(POOL_RAM, &stats);
+	TEST_ASSERT(stats.blocks_used == 0);
+	return 0;
+}
+
+int test_spi_flash(void)
+{
+	sim_spi_flash_t flash;
+	pool_stats_t stats;
+	char out[1024];
+	unsigned int i;
+
+	for(i = 0; i < ARRAY_SIZE(spi_flash_ids); i++)
+		TEST_ASSERT(spi_flash_size(spi_flash_ids[i].jedec_id) ==
+			    spi_flash_ids[i].size);
+
+	/* Up to 16MiB with 3 bytes addresses, READ4B above */
+	if(spi_flash_check_dump(spi_flash_ids[0].jedec_id, 1UL << 20,
+				SPI_FLASH_CMD_READ))
+		return 1;
+	if(spi_flash_check_dump(spi_flash_ids[3].jedec_id, 1UL << 26,
+				SPI_FLASH_CMD_READ4B))
+		return 1;
+
+	/* Unknown flash, no file is created */
+	pool_init();
+	sim_file_reset();
+	TEST_ASSERT(!spi_flash_run(&flash, spi_flash_ids[9].jedec_id, 1UL << 20,
+				   out, sizeof(out)));
+	TEST_ASSERT(strstr(out, "JEDEC ID: EF 40 0F\r\nUnknown flash.\r\n") != NULL);
+	TEST_ASSERT(sim_file.name[0] == 0);
+
+	/* Write error on the SD card, the file is closed and the buffers freed */
+	sim_file_reset();
+	sim_file.write_fail_at = 100000;
+	TEST_ASSERT(!spi_flash_run(&flash, spi_flash_ids[0].jedec_id, 1UL << 20,
+				   out, sizeof(out)));
+	TEST_ASSERT(strstr(out, "Error writing file.\r\n") != NULL);
+	TEST_ASSERT(!sim_file.open && sim_file.len < 100000);
+	TEST_ASSERT(!sim_spi_state[BSP_DEV_SPI1].selected);
+
+	sim_file_reset();
+	sim_file.open_fail = TRUE;
+	TEST_ASSERT(!spi_flash_run(&flash, spi_flash_ids[0].jedec_id, 1UL << 20,
+				   out, sizeof(out)));
+	TEST_ASSERT(strstr(out, "Error opening file 0:dump.bin\r\n") != NULL);
+
+	pool_stats(POOL_RAM, &stats);
+	TEST_ASSERT(stats.blocks_used == 0);
+	return 0;
+}
@@ -0,0 +1,418 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * SPI sniffer framing (hydrabus_spi_sniff.c) on synthetic MOSI/MISO byte
+ * and CS edge streams, as written by the two DMA and the CS interrupt:
+ * the record and legacy outputs are decoded back to the transactions,
+ * with long transactions across the ring wrap, bytes sent while CS is
+ * high, MOSI/MISO mismatches, lost CS rising edges, a full CS edge queue,
+ * a stalled output ring and a capture ending with CS low.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "test.h"
+#include "hydrabus_spi_sniff.h"
+
+#define SNIFF_RING	(1024)
+#define SNIFF_OUT	(4096)
+#define SNIFF_XFERS	(64)
+#define SNIFF_XFER_MAX	(2000)
+#define SNIFF_FILE_SIZE	(0x40000)
+
+typedef struct {
+	uint32_t start;
+	uint32_t end;
+	uint32_t nb_mosi;
+	uint32_t nb_miso;
+	uint8_t mosi[SNIFF_XFER_MAX];
+	uint8_t miso[SNIFF_XFER_MAX];
+	uint8_t flags; /* SPI_SNIFF_FLAG_LOST/OPEN, decoded only */
+} sniff_xfer_t;
+
+/* DMA rings, CS interrupt and host side of the sniffer */
+typedef struct {
+	spi_sniff_t s;
+	uint8_t mosi[SNIFF_RING];
+	uint8_t miso[SNIFF_RING];
+	uint8_t out[SNIFF_OUT];
+	uint32_t mosi_wr;
+	uint32_t miso_wr;
+	uint32_t time;
+	uint32_t nb_bytes; /* since the last spi_sniff_process() */
+	uint32_t out_size; /* smaller output ring */
+	bool stall; /* the host does not read the output */
+	uint8_t *file;
+	uint32_t size;
+} sniff_sim_t;
+
+static sniff_xfer_t xfers[SNIFF_XFERS];
+static sniff_xfer_t decoded[SNIFF_XFERS];
+static sniff_sim_t sim;
+
+static void sim_init(sniff_sim_t *m, spi_sniff_fmt_t fmt, uint32_t out_size)
+{
+	m->mosi_wr = 0;
+	m->miso_wr = 0;
+	m->time = 0xFFFF0000; /* Cycle counter wrap in the capture */
+	m->nb_bytes = 0;
+	m->out_size = out_size;
+	m->stall = false;
+	m->size = 0;
+	spi_sniff_init(&m->s, fmt, m->mosi, m->miso, SNIFF_RING, m->out, out_size);
+}
+
+static void sim_read(sniff_sim_t *m)
+{
+	const uint8_t *data;
+	uint32_t len, max;
+
+	while(!m->stall && (len = spi_sniff_out_get(&m->s, &data)) > 0) {
+		/* The host reads packets of random size */
+		max = 1 + test_rand() % 300;
+		if(len > max)
+			len = max;
+		if(m->size + len <= SNIFF_FILE_SIZE)
+			memcpy(m->file + m->size, data, len);
+		m->size += len;
+		spi_sniff_out_consume(&m->s, len);
+	}
+}
+
+static void sim_process(sniff_sim_t *m)
+{
+	uint32_t events_lost;
+
+	events_lost = m->s.events_lost;
+	m->s.events_lost = 0;
+	spi_sniff_process(&m->s, events_lost, m->mosi_wr, m->miso_wr);
+	sim_read(m);
+	m->nb_bytes = 0;
+}
+
+/* One byte on MOSI and/or MISO, the main loop runs before the rings wrap */
+static void sim_byte(sniff_sim_t *m, int mosi, int miso)
+{
+	if(mosi >= 0) {
+		m->mosi[m->mosi_wr] = mosi;
+		m->mosi_wr = (m->mosi_wr + 1) & (SNIFF_RING - 1);
+	}
+	if(miso >= 0) {
+		m->miso[m->miso_wr] = miso;
+		m->miso_wr = (m->miso_wr + 1) & (SNIFF_RING - 1);
+	}
+	m->time += 64;
+	if(++m->nb_bytes >= 100 + test_rand() % 150)
+		sim_process(m);
+}
+
+static bool sim_cs(sniff_sim_t *m, uint8_t cs)
+{
+	m->time += 100;
+	return spi_sniff_cs_event(&m->s, m->time, cs, m->mosi_wr, m->miso_wr);
+}
+
+/* A transaction, its bytes then the CS rising edge unless end is false */
+static void sim_xfer(sniff_sim_t *m, sniff_xfer_t *x, bool end)
+{
+	uint32_t i, nb;
+
+	sim_cs(m, 0);
+	x->start = m->time;
+	nb = (x->nb_mosi > x->nb_miso) ? x->nb_mosi : x->nb_miso;
+	for(i = 0; i < nb; i++) {
+		sim_byte(m, (i < x->nb_mosi) ? x->mosi[i] : -1,
+			 (i < x->nb_miso) ? x->miso[i] : -1);
+	}
+	if(!end)
+		return;
+	sim_cs(m, 1);
+	x->end = m->time;
+	/* Bytes while CS is high are not part of a transaction */
+	for(i = test_rand() % 4; i; i--)
+		sim_byte(m, test_rand() & 0xFF, test_rand() & 0xFF);
+}
+
+static void rand_xfer(sniff_xfer_t *x, uint32_t max)
+{
+	uint32_t i;
+
+	x->nb_mosi = test_rand() % (max + 1);
+	x->nb_miso = x->nb_mosi;
+	/* Short MOSI/MISO mismatches, a byte lost by one of the SPI */
+	if(x->nb_mosi > 0 && x->nb_mosi < SPI_SNIFF_RECORD_MAX && (test_rand() % 8) == 0) {
+		if(test_rand() & 1)
+			x->nb_mosi--;
+		else
+			x->nb_miso--;
+	}
+	for(i = 0; i < SNIFF_XFER_MAX; i++) {
+		x->mosi[i] = test_rand();
+		x->miso[i] = test_rand();
+	}
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/* Records back to transactions, the shorter of MOSI/MISO is padded */
+static int decode_records(const uint8_t *buf, uint32_t size, uint32_t *nb_xfers)
+{
+	sniff_xfer_t *x = NULL;
+	uint32_t i = 0, k, nb, flags;
+	bool more = false;
+
+	*nb_xfers = 0;
+	while(i < size) {
+		TEST_ASSERT(size - i >= sizeof(spi_sniff_record_t));
+		TEST_ASSERT(buf[i] == SPI_SNIFF_RECORD_MAGIC);
+		flags = buf[i + 1];
+		nb = buf[i + 2] | (buf[i + 3] << 8);
+		TEST_ASSERT(nb <= SPI_SNIFF_RECORD_MAX);
+		TEST_ASSERT(size - i - sizeof(spi_sniff_record_t) >= 2 * nb);
+		/* CONT iff the previous record had MORE */
+		TEST_ASSERT(!!(flags & SPI_SNIFF_FLAG_CONT) == more);
+		if(!more) {
+			TEST_ASSERT(*nb_xfers < SNIFF_XFERS);
+			x = &decoded[(*nb_xfers)++];
+			x->start = get_u32(&buf[i + 4]);
+			x->nb_mosi = 0;
+			x->flags = 0;
+		} else {
+			TEST_ASSERT(get_u32(&buf[i + 4]) == x->start);
+		}
+		x->flags |= flags & (SPI_SNIFF_FLAG_LOST | SPI_SNIFF_FLAG_OPEN);
+		i += sizeof(spi_sniff_record_t);
+		for(k = 0; k < nb; k++, i += 2) {
+			TEST_ASSERT(x->nb_mosi < SNIFF_XFER_MAX);
+			x->mosi[x->nb_mosi] = buf[i];
+			x->miso[x->nb_mosi++] = buf[i + 1];
+		}
+		x->nb_miso = x->nb_mosi;
+		more = !!(flags & SPI_SNIFF_FLAG_MORE);
+		if(more) {
+			TEST_ASSERT(get_u32(&buf[i - 2 * nb - 4]) == 0);
+		} else {
+			x->end = x->start + get_u32(&buf[i - 2 * nb - 4]);
+		}
+	}
+	TEST_ASSERT(!more);
+	return 0;
+}
+
+/* '[' then '\' MOSI MISO per byte then ']' */
+static int decode_legacy(const uint8_t *buf, uint32_t size, uint32_t *nb_xfers)
+{
+	sniff_xfer_t *x;
+	uint32_t i = 0;
+
+	*nb_xfers = 0;
+	while(i < size) {
+		TEST_ASSERT(buf[i++] == '[');
+		TEST_ASSERT(*nb_xfers < SNIFF_XFERS);
+		x = &decoded[(*nb_xfers)++];
+		x->nb_mosi = 0;
+		x->flags = 0;
+		while(i < size && buf[i] == '\\') {
+			TEST_ASSERT(size - i >= 3 && x->nb_mosi < SNIFF_XFER_MAX);
+			x->mosi[x->nb_mosi] = buf[i + 1];
+			x->miso[x->nb_mosi++] = buf[i + 2];
+			i += 3;
+		}
+		x->nb_miso = x->nb_mosi;
+		TEST_ASSERT(i < size && buf[i++] == ']');
+	}
+	return 0;
+}
+
+/* Decoded transaction d is x, timestamps checked if times */
+static int check_xfer(const sniff_xfer_t *d, const sniff_xfer_t *x, bool times)
+{
+	uint32_t i, nb;
+
+	nb = (x->nb_mosi > x->nb_miso) ? x->nb_mosi : x->nb_miso;
+	TEST_ASSERT(d->nb_mosi == nb);
+	for(i = 0; i < nb; i++) {
+		TEST_ASSERT(d->mosi[i] == ((i < x->nb_mosi) ? x->mosi[i] : 0));
+		TEST_ASSERT(d->miso[i] == ((i < x->nb_miso) ? x->miso[i] : 0));
+	}
+	if(times) {
+		TEST_ASSERT(d->start == x->start);
+		TEST_ASSERT(d->end == x->end);
+	}
+	return 0;
+}
+
+static int decode(sniff_sim_t *m, uint32_t *nb)
+{
+	if(m->s.fmt == SPI_SNIFF_FMT_RECORD)
+		return decode_records(m->file, m->size, nb);
+	return decode_legacy(m->file, m->size, nb);
+}
+
+/* Random transactions, the last one still open at the end of the capture */
+static int test_spi_sniff_stream(spi_sniff_fmt_t fmt)
+{
+	uint32_t n, nb;
+
+	sim_init(&sim, fmt, SNIFF_OUT);
+	for(n = 0; n < SNIFF_XFERS; n++) {
+		/* Short ones, then longer than the records and the rings */
+		rand_xfer(&xfers[n], (n & 3) ? 40 : SNIFF_XFER_MAX);
+		sim_xfer(&sim, &xfers[n], n < SNIFF_XFERS - 1);
+		if(test_rand() & 1)
+			sim_process(&sim);
+	}
+	spi_sniff_close(&sim.s, sim.time, sim.mosi_wr, sim.miso_wr);
+	sim_read(&sim);
+	xfers[SNIFF_XFERS - 1].end = sim.time;
+	TEST_ASSERT(sim.s.records_lost == 0);
+
+	if(decode(&sim, &nb))
+		return 1;
+	TEST_ASSERT(nb == SNIFF_XFERS);
+	for(n = 0; n < nb; n++) {
+		if(check_xfer(&decoded[n], &xfers[n], fmt == SPI_SNIFF_FMT_RECORD))
+			return 1;
+		TEST_ASSERT(decoded[n].flags ==
+			    ((n == nb - 1 && fmt == SPI_SNIFF_FMT_RECORD) ? SPI_SNIFF_FLAG_OPEN : 0));
+	}
+	return 0;
+}
+
+/* CS rising edges lost: the next falling edge ends the transaction */
+static int test_spi_sniff_no_rise(void)
+{
+	uint32_t n, nb;
+
+	sim_init(&sim, SPI_SNIFF_FMT_RECORD, SNIFF_OUT);
+	for(n = 0; n < 4; n++) {
+		rand_xfer(&xfers[n], 300);
+		sim_xfer(&sim, &xfers[n], n & 1);
+		if(n & 1)
+			xfers[n - 1].end = xfers[n].start;
+	}
+	sim_process(&sim);
+	if(decode(&sim, &nb))
+		return 1;
+	TEST_ASSERT(nb == 4);
+	for(n = 0; n < nb; n++) {
+		if(check_xfer(&decoded[n], &xfers[n], true))
+			return 1;
+	}
+	return 0;
+}
+
+/* More CS edges than the queue between two spi_sniff_process() */
+static int test_spi_sniff_events_lost(void)
+{
+	uint32_t n, nb, lost = 0;
+
+	sim_init(&sim, SPI_SNIFF_FMT_RECORD, SNIFF_OUT);
+	for(n = 0; n < 20; n++) {
+		xfers[n].nb_mosi = 2 + n % 3;
+		xfers[n].nb_miso = xfers[n].nb_mosi;
+		xfers[n].mosi[0] = n;
+		/* No sim_byte(), spi_sniff_process() does not run */
+		if(!sim_cs(&sim, 0))
+			lost++;
+		xfers[n].start = sim.time;
+		sim.mosi_wr += xfers[n].nb_mosi;
+		sim.miso_wr += xfers[n].nb_miso;
+		memcpy(&sim.mosi[sim.mosi_wr - xfers[n].nb_mosi], xfers[n].mosi, xfers[n].nb_mosi);
+		memcpy(&sim.miso[sim.miso_wr - xfers[n].nb_miso], xfers[n].miso, xfers[n].nb_miso);
+		if(!sim_cs(&sim, 1))
+			lost++;
+		xfers[n].end = sim.time;
+	}
+	TEST_ASSERT(lost == 2 * 20 - SPI_SNIFF_EVENTS);
+	sim_process(&sim);
+	rand_xfer(&xfers[20], 40);
+	sim_xfer(&sim, &xfers[20], true);
+	sim_process(&sim);
+
+	if(decode(&sim, &nb))
+		return 1;
+	TEST_ASSERT(nb == SPI_SNIFF_EVENTS / 2 + 1);
+	for(n = 0; n < nb; n++) {
+		if(check_xfer(&decoded[n], &xfers[(n < nb - 1) ? n : 20], true))
+			return 1;
+	}
+	/* The loss is reported */
+	TEST_ASSERT(decoded[0].flags == SPI_SNIFF_FLAG_LOST);
+	return 0;
+}
+
+/* Output ring full: records dropped, the next one has SPI_SNIFF_FLAG_LOST */
+static int test_spi_sniff_stall(spi_sniff_fmt_t fmt)
+{
+	uint32_t n, nb, first;
+
+	sim_init(&sim, fmt, 256);
+	sim.stall = true;
+	for(n = 0; n < 8; n++) {
+		/* Same size, the dropped ones are the last ones */
+		rand_xfer(&xfers[n], 40);
+		xfers[n].nb_mosi = 30;
+		xfers[n].nb_miso = 30;
+		sim_xfer(&sim, &xfers[n], true);
+		sim_process(&sim);
+	}
+	TEST_ASSERT(sim.s.records_lost > 0);
+	first = 8 - sim.s.records_lost;
+	sim.stall = false;
+	sim_read(&sim);
+	for(; n < 12; n++) {
+		rand_xfer(&xfers[n], 40);
+		sim_xfer(&sim, &xfers[n], true);
+		sim_process(&sim);
+	}
+
+	if(decode(&sim, &nb))
+		return 1;
+	TEST_ASSERT(nb == first + 4);
+	for(n = 0; n < nb; n++) {
+		if(check_xfer(&decoded[n], &xfers[(n < first) ? n : n + 8 - first],
+			      fmt == SPI_SNIFF_FMT_RECORD))
+			return 1;
+		if(fmt == SPI_SNIFF_FMT_RECORD)
+			TEST_ASSERT(decoded[n].flags == ((n == first) ? SPI_SNIFF_FLAG_LOST : 0));
+	}
+	return 0;
+}
+
+int test_spi_sniff(void)
+{
+	int ret;
+
+	sim.file = malloc(SNIFF_FILE_SIZE);
+	TEST_ASSERT(sim.file != NULL);
+	test_srand(3);
+	ret = test_spi_sniff_stream(SPI_SNIFF_FMT_RECORD) ||
+	      test_spi_sniff_stream(SPI_SNIFF_FMT_LEGACY) ||
+	      test_spi_sniff_no_rise() ||
+	      test_spi_sniff_events_lost() ||
+	      test_spi_sniff_stall(SPI_SNIFF_FMT_RECORD) ||
+	      test_spi_sniff_stall(SPI_SNIFF_FMT_LEGACY);
+	free(sim.file);
+	return ret;
+}
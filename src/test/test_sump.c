@@ -0,0 +1,233 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * SUMP readout (hydrabus_sump_proto.c): the RLE stream decoded back shall
+ * match the raw readout, the ring is read at most once and the samples
+ * which were not captured are padded with the oldest one.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "test.h"
+#include "hydrabus_sump_proto.h"
+
+#define SUMP_TEST_STATES	(1024)
+#define SUMP_TEST_RUNS		(500)
+
+static uint16_t ring[SUMP_TEST_STATES];
+
+/* Read a whole capture in chunks of random size */
+static uint32_t read_capture(sump_reader_t *reader, uint8_t *out, uint32_t size)
+{
+	uint32_t len = 0, chunk, nb;
+
+	do {
+		chunk = 1 + test_rand() % 300;
+		if(chunk > size - len)
+			chunk = size - len;
+		nb = sump_reader_fill(reader, out + len, chunk);
+		len += nb;
+	} while(nb > 0 || (chunk < 4 && len < size));
+	return len;
+}
+
+static uint32_t get_word(const uint8_t *p, uint8_t sample_bytes)
+{
+	uint32_t word = 0;
+	uint8_t i;
+
+	for(i = 0; i < sample_bytes; i++)
+		word |= (uint32_t)p[i] << (8 * i);
+	return word;
+}
+
+/*
+ * Decode a RLE readout to samples from the newest to the oldest, returns
+ * the number of samples or -1 on a malformed stream.
+ */
+static int rle_decode(const uint8_t *in, uint32_t nb_words, uint8_t sample_bytes,
+		      uint32_t *out, uint32_t out_size)
+{
+	const uint32_t count_flag = 1UL << (sample_bytes * 8 - 1);
+	uint32_t *tmp, nb = 0, i, word, count;
+
+	tmp = malloc(out_size * sizeof(uint32_t));
+	if(tmp == NULL)
+		return -1;
+	/* Oldest word first */
+	for(i = nb_words; i-- > 0;) {
+		word = get_word(&in[i * sample_bytes], sample_bytes);
+		if(word & count_flag) {
+			count = word & ~count_flag;
+			if(nb == 0 || nb + count > out_size) {
+				free(tmp);
+				return -1;
+			}
+			while(count--) {
+				tmp[nb] = tmp[nb - 1];
+				nb++;
+			}
+		} else {
+			if(nb == out_size) {
+				free(tmp);
+				return -1;
+			}
+			tmp[nb++] = word;
+		}
+	}
+	for(i = 0; i < nb; i++)
+		out[i] = tmp[nb - 1 - i];
+	free(tmp);
+	return nb;
+}
+
+static void fill_ring(uint32_t max_run)
+{
+	uint32_t i = 0, run;
+	uint16_t value;
+
+	while(i < SUMP_TEST_STATES) {
+		value = test_rand();
+		run = 1 + test_rand() % max_run;
+		while(run-- && i < SUMP_TEST_STATES)
+			ring[i++] = value;
+	}
+}
+
+static void config_init(sump_config_t *config, uint8_t channels,
+			uint32_t read_count, uint32_t flags)
+{
+	sump_proto_reset(config);
+	config->channels = channels;
+	config->read_count = read_count;
+	config->flags = flags;
+}
+
+/* Expected samples, newest first, with the oldest one as padding */
+static uint32_t expected(uint32_t end, uint32_t nb_valid, uint32_t i,
+			 uint8_t channels, uint32_t mask)
+{
+	uint32_t pad = 0;
+
+	if(nb_valid > 0)
+		pad = sump_sample_pack(ring[(end - nb_valid) & (SUMP_TEST_STATES - 1)],
+				       channels) & mask;
+	if(i >= nb_valid)
+		return pad;
+	return sump_sample_pack(ring[(end - 1 - i) & (SUMP_TEST_STATES - 1)],
+				channels) & mask;
+}
+
+static int check_capture(uint8_t channels, uint32_t read_count, uint32_t end,
+			 uint32_t nb_valid, int rle)
+{
+	static uint8_t out[4 * SUMP_TEST_STATES * 2];
+	static uint32_t samples[8 * SUMP_TEST_STATES];
+	sump_config_t config;
+	sump_reader_t reader;
+	uint8_t sample_bytes = sump_sample_bytes(channels);
+	uint32_t len, i, mask;
+	int nb;
+
+	config_init(&config, channels, read_count, rle ? SUMP_FLAG_RLE : 0);
+	sump_reader_init(&reader, &config, ring, SUMP_TEST_STATES, end, nb_valid);
+	len = read_capture(&reader, out, sizeof(out));
+	TEST_ASSERT(len == read_count * sample_bytes);
+
+	if(!rle) {
+		for(i = 0; i < read_count; i++)
+			TEST_ASSERT(get_word(&out[i * sample_bytes], sample_bytes) ==
+				    expected(end, nb_valid, i, channels, 0xffff));
+		return 0;
+	}
+
+	nb = rle_decode(out, read_count, sample_bytes, samples, sizeof(samples) / 4);
+	TEST_ASSERT(nb >= (int)read_count);
+	mask = (1UL << (sample_bytes * 8 - 1)) - 1;
+	for(i = 0; i < (uint32_t)nb; i++)
+		TEST_ASSERT(samples[i] == expected(end, nb_valid, i, channels, mask));
+	return 0;
+}
+
+int test_sump_reader(void)
+{
+	uint32_t i, read_count, nb_valid, end;
+	uint8_t channels;
+
+	/* Constant full capture, RLE */
+	for(i = 0; i < SUMP_TEST_STATES; i++)
+		ring[i] = 0x1234;
+	TEST_ASSERT(!check_capture(3, SUMP_TEST_STATES, 17, SUMP_TEST_STATES, 1));
+	TEST_ASSERT(!check_capture(3, 4 * SUMP_TEST_STATES, 17, SUMP_TEST_STATES, 1));
+	TEST_ASSERT(!check_capture(1, 2 * SUMP_TEST_STATES, 0, SUMP_TEST_STATES, 1));
+
+	/* Trigger at the start, 100 samples captured */
+	fill_ring(8);
+	TEST_ASSERT(!check_capture(3, 512, 100, 100, 0));
+	TEST_ASSERT(!check_capture(3, 512, 100, 100, 1));
+	TEST_ASSERT(!check_capture(2, 512, 100, 0, 0));
+	TEST_ASSERT(!check_capture(2, 512, 100, 0, 1));
+
+	for(i = 0; i < SUMP_TEST_RUNS; i++) {
+		fill_ring(1 + test_rand() % 200);
+		channels = 1 + test_rand() % 3;
+		read_count = 4 * (1 + test_rand() % (2 * SUMP_TEST_STATES / 4));
+		nb_valid = test_rand() % (SUMP_TEST_STATES + 1);
+		end = test_rand() % SUMP_TEST_STATES;
+		TEST_ASSERT(!check_capture(channels, read_count, end, nb_valid, 0));
+		TEST_ASSERT(!check_capture(channels, read_count, end, nb_valid, 1));
+	}
+	return 0;
+}
+
+static void bench_readout(const char *name, uint8_t channels, int rle,
+			  uint32_t chunk)
+{
+	static uint8_t out[4096];
+	sump_config_t config;
+	sump_reader_t reader;
+	uint32_t i, nb = 0;
+	uint64_t t;
+
+	config_init(&config, channels, SUMP_TEST_STATES, rle ? SUMP_FLAG_RLE : 0);
+	t = test_time_ns();
+	for(i = 0; i < 2000; i++) {
+		sump_reader_init(&reader, &config, ring, SUMP_TEST_STATES, i,
+				 SUMP_TEST_STATES);
+		while(sump_reader_fill(&reader, out, chunk) > 0)
+			;
+		nb += SUMP_TEST_STATES;
+	}
+	bench_report(name, test_time_ns() - t, nb, "S");
+}
+
+/* Readout per sample, with the former 256 bytes and the 4KB staging */
+int bench_sump_reader(void)
+{
+	fill_ring(1);
+	bench_readout("raw 16ch 256B chunks", 3, 0, 256);
+	bench_readout("raw 16ch 4KB chunks", 3, 0, 4096);
+	bench_readout("raw 8ch 4KB chunks", 1, 0, 4096);
+	bench_readout("rle 16ch random 256B chunks", 3, 1, 256);
+	bench_readout("rle 16ch random 4KB chunks", 3, 1, 4096);
+	fill_ring(64);
+	bench_readout("rle 16ch runs of 32 4KB chunks", 3, 1, 4096);
+	return 0;
+}
@@ -0,0 +1,238 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * SUMP trigger (hydrabus_sump_trigger.c) fuzzed against a plain model of
+ * the OLS stages, with the samples processed in random chunks around the
+ * capture ring.
+ */
+
+#include <string.h>
+
+#include "test.h"
+#include "hydrabus_sump_proto.h"
+#include "hydrabus_sump_trigger.h"
+
+#define TRIGGER_RING_SIZE	(4096)
+#define TRIGGER_RING_MASK	(TRIGGER_RING_SIZE - 1)
+#define TRIGGER_RUNS		(20000)
+
+static uint16_t ring[TRIGGER_RING_SIZE];
+
+/* All stages evaluated on each sample, no precomputation */
+static int model_fire(const sump_config_t *config, const uint16_t *samples,
+		      uint32_t nb)
+{
+	uint32_t shift[SUMP_TRIGGER_STAGES] = { 0 };
+	uint32_t count[SUMP_TRIGGER_STAGES] = { 0 };
+	uint8_t matched[SUMP_TRIGGER_STAGES] = { 0 };
+	uint32_t t, conf, input, mask, value;
+	uint8_t i, level = 0, level_now, fired = 0, has_start = 0;
+
+	for(i = 0; i < SUMP_TRIGGER_STAGES; i++)
+		if(config->trigger_configs[i] & SUMP_TRIG_CONF_START)
+			has_start = 1;
+	if(!has_start)
+		return 0;
+
+	for(t = 0; t < nb; t++) {
+		for(i = 0; i < SUMP_TRIGGER_STAGES; i++) {
+			if(count[i] == 0 || --count[i] > 0)
+				continue;
+			if(config->trigger_configs[i] & SUMP_TRIG_CONF_START)
+				fired = 1;
+			else
+				level++;
+		}
+		level_now = level;
+		for(i = 0; i < SUMP_TRIGGER_STAGES; i++) {
+			conf = config->trigger_configs[i];
+			if(matched[i])
+				continue;
+			mask = config->trigger_masks[i];
+			value = config->trigger_values[i];
+			if(conf & SUMP_TRIG_CONF_SERIAL) {
+				shift[i] = (shift[i] << 1) |
+					   ((samples[t] >> SUMP_TRIG_CONF_CHANNEL(conf)) & 1);
+				input = shift[i];
+			} else {
+				input = samples[t];
+			}
+			if(SUMP_TRIG_CONF_LEVEL(conf) > level_now ||
+			   ((input ^ value) & mask))
+				continue;
+			matched[i] = 1;
+			if(SUMP_TRIG_CONF_DELAY(conf) > 0)
+				count[i] = SUMP_TRIG_CONF_DELAY(conf);
+			else if(conf & SUMP_TRIG_CONF_START)
+				fired = 1;
+			else
+				level++;
+		}
+		if(fired)
+			return t;
+	}
+	return -1;
+}
+
+/* A few channels set in a mask of the 16 channels */
+static uint32_t rand_mask(void)
+{
+	uint32_t mask = 0;
+	uint8_t nb = test_rand() % 4;
+
+	while(nb--)
+		mask |= 1UL << (test_rand() % 16);
+	return mask;
+}
+
+static void rand_config(sump_config_t *config)
+{
+	uint32_t conf;
+	uint8_t i;
+
+	sump_proto_reset(config);
+	for(i = 0; i < SUMP_TRIGGER_STAGES; i++) {
+		conf = (test_rand() % 4) << 16;
+		if(test_rand() % 3 == 0)
+			conf |= SUMP_TRIG_CONF_START;
+		if(test_rand() % 4 == 0)
+			conf |= test_rand() % 8;
+		if(test_rand() % 5 == 0) {
+			conf |= SUMP_TRIG_CONF_SERIAL;
+			conf |= (test_rand() % 16) << 20;
+			config->trigger_masks[i] = test_rand() & ((1UL << (test_rand() % 6)) - 1);
+		} else {
+			config->trigger_masks[i] = rand_mask();
+		}
+		config->trigger_values[i] = test_rand();
+		config->trigger_configs[i] = conf;
+	}
+}
+
+/* Samples with a few toggling channels */
+static void rand_samples(uint16_t *samples, uint32_t nb)
+{
+	uint32_t t;
+	uint16_t sample = test_rand();
+
+	for(t = 0; t < nb; t++) {
+		if(test_rand() % 4 == 0)
+			sample ^= 1 << (test_rand() % 16);
+		samples[t] = sample;
+	}
+}
+
+/* Process the samples as the DMA writes them, returns the sample number */
+static int trigger_fire(const sump_config_t *config, const uint16_t *samples,
+			uint32_t nb, uint32_t start)
+{
+	sump_trigger_t trig;
+	uint32_t written = 0, index, end, chunk;
+
+	start &= TRIGGER_RING_MASK;
+	index = start;
+	sump_trigger_init(&trig, config);
+	while(written < nb) {
+		chunk = 1 + test_rand() % 100;
+		if(chunk > nb - written)
+			chunk = nb - written;
+		for(end = written + chunk; written < end; written++)
+			ring[(start + written) & TRIGGER_RING_MASK] = samples[written];
+		index = sump_trigger_process(&trig, ring, TRIGGER_RING_MASK, index,
+					     (start + written) & TRIGGER_RING_MASK);
+		if(trig.fired)
+			return (index - start) & TRIGGER_RING_MASK;
+	}
+	return -1;
+}
+
+int test_sump_trigger(void)
+{
+	static uint16_t samples[TRIGGER_RING_SIZE - 1];
+	sump_config_t config;
+	uint32_t run, nb, fired = 0;
+	int ref;
+
+	/* Default configuration: stage 1 start, matches any sample */
+	sump_proto_reset(&config);
+	rand_samples(samples, 16);
+	TEST_ASSERT(trigger_fire(&config, samples, 16, 7) == 0);
+
+	/* No start stage: immediate */
+	config.trigger_configs[0] = 0;
+	config.trigger_masks[0] = 0xffff;
+	config.trigger_values[0] = ~samples[0];
+	TEST_ASSERT(trigger_fire(&config, samples, 16, 100) == 0);
+
+	for(run = 0; run < TRIGGER_RUNS; run++) {
+		rand_config(&config);
+		nb = 1 + test_rand() % (TRIGGER_RING_SIZE - 1);
+		rand_samples(samples, nb);
+		ref = model_fire(&config, samples, nb);
+		TEST_ASSERT(trigger_fire(&config, samples, nb, test_rand()) == ref);
+		if(ref > 0)
+			fired++;
+	}
+	/* The configurations shall not all be trivial */
+	TEST_ASSERT(fired > TRIGGER_RUNS / 10);
+	return 0;
+}
+
+static void bench_trigger(const char *name, const sump_config_t *config)
+{
+	sump_trigger_t trig;
+	uint32_t i, nb = 0;
+	uint64_t t;
+
+	t = test_time_ns();
+	for(i = 0; i < 200; i++) {
+		sump_trigger_init(&trig, config);
+		sump_trigger_process(&trig, ring, TRIGGER_RING_MASK, i,
+				     (i - 1) & TRIGGER_RING_MASK);
+		nb += TRIGGER_RING_SIZE - 1;
+	}
+	bench_report(name, test_time_ns() - t, nb, "S");
+}
+
+/* Trigger evaluation cost per sample, on samples which never match */
+int bench_sump_trigger(void)
+{
+	sump_config_t config;
+	uint32_t i;
+
+	for(i = 0; i < TRIGGER_RING_SIZE; i++)
+		ring[i] = test_rand() & 0x7fff;
+
+	sump_proto_reset(&config);
+	config.trigger_masks[0] = 0x8000;
+	config.trigger_values[0] = 0x8000;
+	bench_trigger("parallel start stage", &config);
+
+	config.trigger_configs[0] = SUMP_TRIG_CONF_START | (1UL << 16);
+	config.trigger_masks[1] = 0x8000;
+	config.trigger_values[1] = 0x8000;
+	config.trigger_configs[1] = 0;
+	bench_trigger("level 0 stage + start stage", &config);
+
+	config.trigger_masks[1] = 0xffffffff;
+	config.trigger_values[1] = 0x12345678;
+	config.trigger_configs[1] = SUMP_TRIG_CONF_SERIAL | (3UL << 20);
+	bench_trigger("serial level 0 stage + start", &config);
+	return 0;
+}
@@ -0,0 +1,172 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * UART receive ring (hydrabus_uart_ring.c) against a simulated circular
+ * DMA: remaining count, half/full transfer interrupts serviced late and
+ * bytes received between the reads of the interrupt count and of the DMA
+ * position. Every byte is read once in order while the reader keeps up,
+ * overwritten bytes are counted, and the free running counts wrap.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "test.h"
+#include "hydrabus_uart_ring.h"
+
+#define RING_SIZE	(256)
+
+typedef struct {
+	uint8_t buf[RING_SIZE];
+	uint32_t total; /* Bytes written by the DMA, free running */
+	uint32_t irq_lag; /* Bytes received before the interrupt is serviced */
+} sim_dma_t;
+
+static sim_dma_t dma;
+static uart_ring_t ring;
+
+/* Byte n of the received stream, an offset error changes the bytes */
+static uint8_t stream(uint32_t n)
+{
+	return n ^ (n >> 8) ^ (n >> 16) ^ (n >> 24);
+}
+
+static void dma_rx(uint32_t nb)
+{
+	while(nb--) {
+		dma.buf[dma.total & (RING_SIZE - 1)] = stream(dma.total);
+		dma.total++;
+	}
+}
+
+/* Half and full transfer interrupts serviced, irq_lag bytes late */
+static uint32_t dma_halves(void)
+{
+	return (dma.total - dma.irq_lag) / (RING_SIZE / 2);
+}
+
+/* Position from the remaining count, size - NDTR */
+static uint32_t dma_pos(void)
+{
+	return dma.total & (RING_SIZE - 1);
+}
+
+/*
+ * Reader thread: interrupt count, bytes received meanwhile, DMA position,
+ * then reads and checks up to max bytes.
+ */
+static int reader(uint32_t race, uint32_t max)
+{
+	const uint8_t *data;
+	uint32_t halves, len, i;
+
+	halves = dma_halves();
+	dma_rx(race);
+	uart_ring_update(&ring, halves, dma_pos());
+	TEST_ASSERT(ring.wr == dma.total);
+	while(max > 0 && (len = uart_ring_get(&ring, &data)) > 0) {
+		if(len > max)
+			len = max;
+		for(i = 0; i < len; i++)
+			TEST_ASSERT(data[i] == stream(ring.rd + i));
+		uart_ring_consume(&ring, len);
+		max -= len;
+	}
+	return 0;
+}
+
+static void sim_init(uint32_t start)
+{
+	memset(&dma, 0, sizeof(dma));
+	uart_ring_init(&ring, dma.buf, RING_SIZE);
+	/* Same as a capture started start bytes ago */
+	dma.total = start;
+	ring.wr = start;
+	ring.rd = start;
+}
+
+static int test_uart_ring_run(uint32_t start)
+{
+	uint32_t k, nb, race, max;
+
+	sim_init(start);
+	for(k = 0; k < 100000; k++) {
+		/* Late interrupt and race, less than half a ring together */
+		dma.irq_lag = test_rand() % (RING_SIZE / 4);
+		race = test_rand() % (RING_SIZE / 4);
+		nb = test_rand() % (RING_SIZE / 2);
+		dma_rx(nb);
+		/* Leave up to a quarter of the ring unread */
+		max = (ring.wr - ring.rd) + nb + race;
+		max -= test_rand() % (RING_SIZE / 4);
+		if((int32_t)max < 0)
+			max = 0;
+		if(reader(race, max))
+			return 1;
+		TEST_ASSERT(ring.wr - ring.rd <= RING_SIZE / 4);
+	}
+	/* Lossless while the reader keeps up */
+	TEST_ASSERT(ring.lost == 0 && ring.overruns == 0);
+	TEST_ASSERT(ring.received == dma.total - start);
+	TEST_ASSERT(ring.max_fill <= RING_SIZE && ring.max_fill >= RING_SIZE / 2);
+	return 0;
+}
+
+int test_uart_ring(void)
+{
+	uint32_t i, lost;
+
+	test_srand(5);
+
+	/* Reader keeping up, random interrupt latency, read sizes and races */
+	if(test_uart_ring_run(0))
+		return 1;
+	/* Free running counts wrapping */
+	if(test_uart_ring_run(0 - 1000 * RING_SIZE))
+		return 1;
+
+	/* Exactly one full ring unread is not an overrun */
+	sim_init(0);
+	dma_rx(RING_SIZE);
+	if(reader(0, RING_SIZE))
+		return 1;
+	TEST_ASSERT(ring.lost == 0 && ring.rd == RING_SIZE);
+
+	/* Reader late by more than the ring: the ring is dropped, reading restarts */
+	dma_rx(RING_SIZE + 10);
+	dma.irq_lag = 0;
+	if(reader(0, 0))
+		return 1;
+	TEST_ASSERT(ring.overruns == 1 && ring.lost == RING_SIZE + 10);
+	TEST_ASSERT(ring.rd == ring.wr);
+	lost = ring.lost;
+	for(i = 0; i < 100; i++) {
+		dma_rx(test_rand() % (RING_SIZE / 2));
+		if(reader(test_rand() % (RING_SIZE / 4), RING_SIZE))
+			return 1;
+	}
+	TEST_ASSERT(ring.overruns == 1 && ring.lost == lost);
+	TEST_ASSERT(ring.received == dma.total);
+
+	/* No new byte: nothing changes */
+	i = ring.received;
+	uart_ring_update(&ring, dma_halves(), dma_pos());
+	TEST_ASSERT(ring.received == i && ring.wr == dma.total);
+	return 0;
+}
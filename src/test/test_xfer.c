@@ -0,0 +1,129 @@
+/*
+ * HydraBus/HydraNFC
+ *
+ * Copyright (C) 2014-2020 Benjamin VERNOUX
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Transfer chunking (bsp_xfer.c) with recording backends.
+ */
+
+#include <string.h>
+
+#include "test.h"
+#include "bsp_xfer.h"
+
+#define XFER_MAX_CALLS	(16)
+
+typedef struct {
+	int dma;
+	uint8_t *tx;
+	uint8_t *rx;
+	uint16_t nb;
+} xfer_call_t;
+
+static xfer_call_t calls[XFER_MAX_CALLS];
+static uint32_t nb_calls;
+static bsp_status_t dma_status;
+static bsp_status_t poll_status;
+
+static bsp_status_t record(int dma, uint8_t *tx, uint8_t *rx, uint16_t nb)
+{
+	if(nb_calls < XFER_MAX_CALLS) {
+		calls[nb_calls].dma = dma;
+		calls[nb_calls].tx = tx;
+		calls[nb_calls].rx = rx;
+		calls[nb_calls].nb = nb;
+	}
+	nb_calls++;
+	return dma ? dma_status : poll_status;
+}
+
+static bsp_status_t xfer_poll(uint32_t dev_num, uint8_t *tx, uint8_t *rx, uint16_t nb)
+{
+	(void)dev_num;
+	return record(0, tx, rx, nb);
+}
+
+static bsp_status_t xfer_dma(uint32_t dev_num, uint8_t *tx, uint8_t *rx, uint16_t nb)
+{
+	(void)dev_num;
+	return record(1, tx, rx, nb);
+}
+
+static const bsp_xfer_ops_t ops_poll = { xfer_poll, NULL, 0 };
+static const bsp_xfer_ops_t ops_dma = { xfer_poll, xfer_dma, 32 };
+
+static void reset(bsp_status_t dma, bsp_status_t poll)
+{
+	nb_calls = 0;
+	dma_status = dma;
+	poll_status = poll;
+	memset(calls, 0, sizeof(calls));
+}
+
+int test_xfer(void)
+{
+	uint8_t *tx = (uint8_t *)0x10000, *rx = (uint8_t *)0x80000;
+	uint32_t i;
+
+	/* Nothing to transfer */
+	reset(BSP_OK, BSP_OK);
+	TEST_ASSERT(bsp_xfer(&ops_poll, 0, tx, rx, 0) == BSP_OK);
+	TEST_ASSERT(nb_calls == 0);
+
+	/* Exactly one chunk, then one more byte */
+	reset(BSP_OK, BSP_OK);
+	TEST_ASSERT(bsp_xfer(&ops_poll, 0, tx, rx, BSP_XFER_MAX_CHUNK) == BSP_OK);
+	TEST_ASSERT(nb_calls == 1 && calls[0].nb == BSP_XFER_MAX_CHUNK);
+	reset(BSP_OK, BSP_OK);
+	TEST_ASSERT(bsp_xfer(&ops_poll, 0, tx, rx, BSP_XFER_MAX_CHUNK + 1) == BSP_OK);
+	TEST_ASSERT(nb_calls == 2 && calls[1].nb == 1);
+	TEST_ASSERT(calls[1].tx == tx + BSP_XFER_MAX_CHUNK);
+	TEST_ASSERT(calls[1].rx == rx + BSP_XFER_MAX_CHUNK);
+
+	/* NULL buffers stay NULL */
+	reset(BSP_OK, BSP_OK);
+	TEST_ASSERT(bsp_xfer(&ops_poll, 0, NULL, rx, 3 * BSP_XFER_MAX_CHUNK + 5) == BSP_OK);
+	TEST_ASSERT(nb_calls == 4);
+	for(i = 0; i < 4; i++) {
+		TEST_ASSERT(calls[i].tx == NULL);
+		TEST_ASSERT(calls[i].rx == rx + i * BSP_XFER_MAX_CHUNK);
+	}
+	TEST_ASSERT(calls[3].nb == 5);
+
+	/* DMA above the threshold, polling below */
+	reset(BSP_OK, BSP_OK);
+	TEST_ASSERT(bsp_xfer(&ops_dma, 0, tx, NULL, BSP_XFER_MAX_CHUNK + 31) == BSP_OK);
+	TEST_ASSERT(nb_calls == 2 && calls[0].dma && !calls[1].dma);
+	reset(BSP_OK, BSP_OK);
+	TEST_ASSERT(bsp_xfer(&ops_dma, 0, tx, NULL, 32) == BSP_OK);
+	TEST_ASSERT(nb_calls == 1 && calls[0].dma);
+
+	/* DMA busy falls back to polling for the same chunk */
+	reset(BSP_BUSY, BSP_OK);
+	TEST_ASSERT(bsp_xfer(&ops_dma, 0, tx, rx, 100) == BSP_OK);
+	TEST_ASSERT(nb_calls == 2 && calls[0].dma && !calls[1].dma);
+	TEST_ASSERT(calls[1].tx == tx && calls[1].nb == 100);
+
+	/* The first error stops the transfer */
+	reset(BSP_TIMEOUT, BSP_OK);
+	TEST_ASSERT(bsp_xfer(&ops_dma, 0, tx, rx, 2 * BSP_XFER_MAX_CHUNK) == BSP_TIMEOUT);
+	TEST_ASSERT(nb_calls == 1);
+	reset(BSP_OK, BSP_ERROR);
+	TEST_ASSERT(bsp_xfer(&ops_poll, 0, tx, rx, 2 * BSP_XFER_MAX_CHUNK) == BSP_ERROR);
+	TEST_ASSERT(nb_calls == 1);
+	return 0;
+}